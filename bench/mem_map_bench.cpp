@@ -0,0 +1,104 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rv32.h"
+#include "device_dummy.h"
+
+//-----------------------------------------------------------------
+// Defines:
+//-----------------------------------------------------------------
+#define BENCH_RAM_BASE      0x80000000
+#define BENCH_RAM_SIZE      (1 << 20)
+#define BENCH_DEV_BASE      0x10000000
+#define BENCH_ACCESSES      (4 * 1024 * 1024)
+
+//-----------------------------------------------------------------
+// time_now: Host time in seconds
+//-----------------------------------------------------------------
+static double time_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1.0E9);
+}
+//-----------------------------------------------------------------
+// list_find: Reference linear search (pre memory_map behaviour)
+//-----------------------------------------------------------------
+static memory_base * list_find(memory_base *list, uint32_t addr)
+{
+    for (memory_base *mem = list; mem != NULL; mem = mem->next)
+        if (mem->valid_addr(addr))
+            return mem;
+    return NULL;
+}
+//-----------------------------------------------------------------
+// run: Load/store throughput with 'num_devices' in front of RAM
+//-----------------------------------------------------------------
+static void run(int num_devices)
+{
+    rv32 *sim = new rv32(BENCH_RAM_BASE, BENCH_RAM_SIZE);
+    memory_base *head = NULL;
+
+    // Devices are prepended, so RAM ends up at the tail of the list
+    for (int i=0;i<num_devices;i++)
+    {
+        device *dev = new device_dummy(BENCH_DEV_BASE + (i * 0x1000), 0x1000);
+        sim->attach_device(dev);
+        head = dev;
+    }
+
+    uint32_t mask = BENCH_RAM_SIZE - 4;
+    uint32_t sum  = 0;
+
+    // Address map
+    double t0 = time_now();
+    for (uint32_t i=0;i<BENCH_ACCESSES;i++)
+    {
+        uint32_t addr = BENCH_RAM_BASE + ((i * 4099 * 4) & mask);
+        sim->write32(addr, i);
+        sum += sim->read32(addr);
+    }
+    double t_map = time_now() - t0;
+
+    // Linear list walk
+    t0 = time_now();
+    for (uint32_t i=0;i<BENCH_ACCESSES;i++)
+    {
+        uint32_t addr = BENCH_RAM_BASE + ((i * 4099 * 4) & mask);
+        memory_base *mem = list_find(head, addr);
+        uint32_t data = 0;
+        if (mem)
+        {
+            mem->write32(addr, i);
+            mem->read32(addr, data);
+        }
+        sum += data;
+    }
+    double t_list = time_now() - t0;
+
+    printf("%8d %16.2f %16.2f %10x\n", num_devices,
+           (2.0 * BENCH_ACCESSES) / t_map / 1.0E6,
+           (2.0 * BENCH_ACCESSES) / t_list / 1.0E6,
+           sum & 0xF);
+}
+//-----------------------------------------------------------------
+// main
+//-----------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    printf("%8s %16s %16s\n", "devices", "map (Macc/s)", "list (Macc/s)");
+
+    static const int counts[] = { 1, 2, 4, 8, 16, 32 };
+    for (unsigned i=0;i<sizeof(counts)/sizeof(counts[0]);i++)
+        run(counts[i]);
+
+    return 0;
+}
@@ -0,0 +1,471 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+
+#include "elf_load.h"
+#include "console_io.h"
+#include "trace_file.h"
+#include "platform_basic.h"
+
+//-----------------------------------------------------------------
+// Defines:
+//-----------------------------------------------------------------
+#define BENCH_WORKLOAD_DIR      "bench/workloads/elf"
+#define BENCH_TOLERANCE         10          // Regression threshold (%)
+#define BENCH_TRACE_LIMIT       20          // Max traced / untraced time (--trace)
+#define BENCH_BATCH             1000000
+#define BENCH_MAX_CYCLES        200000000   // Workload hung / failed to exit
+#define BENCH_MEM_SIZE          (1 << 20)   // RAM at the model's load address
+
+// MIPS-I: the platform interrupt controller (irq 11) is out of range
+// of the cause register, so the workloads use a directly wired timer.
+#define BENCH_MIPS_TIMER_BASE   0x94000000
+#define BENCH_MIPS_TIMER_IRQ    2
+
+//-----------------------------------------------------------------
+// Models / workloads
+//-----------------------------------------------------------------
+typedef struct
+{
+    const char *name;
+    const char *elf;        // Workload ELF prefix
+    const char *march;
+    uint32_t    mem_base;
+    bool        has_mmu;
+    bool        has_trace;
+    bool        direct_timer;
+    bool        jit;        // Dynamic translation, fails if no block is translated
+} t_model;
+
+static const t_model models[] =
+{
+    { "rv32",     "rv32",   "RV32IMAC", 0x80000000, true,  true,  false, false },
+#if defined(__x86_64__)
+    { "rv32-jit", "rv32",   "RV32IMAC", 0x80000000, true,  false, false, true  },
+#endif
+    { "rv64",     "rv64",   "RV64IMAC", 0x80000000, true,  true,  false, false },
+    { "armv6m",   "armv6m", "armv6m",   0x20000000, false, false, false, false },
+    { "mips",     "mips",   "mips1",    0x10000000, false, false, true,  false },
+};
+
+static const char *workloads[] =
+{
+    "intloop",  // Integer ALU loop
+    "memcpy",   // Load / store copy loop
+    "branchy",  // Data dependent branches
+    "mmu",      // Translated loads missing the TLB (RISC-V)
+    "mmio",     // UART status reads / transmit writes
+    "irq",      // Timer interrupt storm
+};
+
+//-----------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------
+#define GETOPTS_ARGS "d:b:w:t:r:m:z:l:h"
+
+static struct option long_options[] =
+{
+    {"dir",            required_argument, 0, 'd'},
+    {"baseline",       required_argument, 0, 'b'},
+    {"write-baseline", required_argument, 0, 'w'},
+    {"tolerance",      required_argument, 0, 't'},
+    {"repeat",         required_argument, 0, 'r'},
+    {"model",          required_argument, 0, 'm'},
+    {"trace",          required_argument, 0, 'z'},
+    {"trace-limit",    required_argument, 0, 'l'},
+    {"help",           no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+};
+
+static void help_options(void)
+{
+    fprintf (stderr,"Usage:\n");
+    fprintf (stderr,"  --dir            | -d DIR    Workload ELFs (default: %s)\n", BENCH_WORKLOAD_DIR);
+    fprintf (stderr,"  --baseline       | -b FILE   Compare against a baseline\n");
+    fprintf (stderr,"  --write-baseline | -w FILE   Write results as the new baseline\n");
+    fprintf (stderr,"  --tolerance      | -t PCT    Slowdown vs the baseline reported as a regression (default %d)\n", BENCH_TOLERANCE);
+    fprintf (stderr,"  --repeat         | -r NUM    Runs per workload, fastest is reported (default 1)\n");
+    fprintf (stderr,"  --model          | -m NAME   Only run this model (rv32, rv32-jit, rv64, armv6m, mips)\n");
+    fprintf (stderr,"  --trace          | -z CODEC  Time the RISC-V workloads with a binary trace (lz, zlib, none) instead\n");
+    fprintf (stderr,"  --trace-limit    | -l NUM    Traced / untraced time reported as too slow (default %d)\n", BENCH_TRACE_LIMIT);
+    exit(-1);
+}
+
+//-----------------------------------------------------------------
+// bench_console: UART output is discarded, no input
+//-----------------------------------------------------------------
+class bench_console: public console_io
+{
+public:
+    int putchar(int ch) { return ch; }
+    int getchar(void)   { return -1; }
+};
+
+//-----------------------------------------------------------------
+// time_now: Host CPU time in seconds (not the wall clock, so time the
+// process is descheduled is not counted against the model)
+//-----------------------------------------------------------------
+static double time_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1.0E9);
+}
+//-----------------------------------------------------------------
+// stdout_mute: Hide model / loader output (-1 restores stdout)
+//-----------------------------------------------------------------
+static int stdout_mute(int saved)
+{
+    fflush(stdout);
+
+    if (saved >= 0)
+    {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        return -1;
+    }
+
+    saved = dup(STDOUT_FILENO);
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd >= 0)
+    {
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+    return saved;
+}
+//-----------------------------------------------------------------
+// run: Execute a workload to completion, returns false if it did
+// not exit cleanly (load error, fault, non-zero exit code, hung), or
+// a JIT model translated nothing (so the JIT tier can't go unnoticed).
+// With a trace file, hart 0 is traced using codec.
+//-----------------------------------------------------------------
+static bool run(const t_model *model, const char *filename, uint64_t *insts, double *seconds,
+                const char *trace_file = NULL, int codec = TRACE_CODEC_LZ)
+{
+    bench_console con;
+    uint64_t      cycles = 0;
+    bool          ok     = false;
+
+    int saved = stdout_mute(-1);
+
+    // Whole page RAM (directly backed) which the ELF sections load into
+    platform_basic *plat = new platform_basic(model->march, model->mem_base, BENCH_MEM_SIZE, &con, &cycles);
+    cpu *sim = plat->get_cpu();
+    if (sim)
+    {
+        if (model->direct_timer)
+            sim->attach_device(new device_timer_owl(BENCH_MIPS_TIMER_BASE, NULL, BENCH_MIPS_TIMER_IRQ));
+
+        sim->set_console(&con);
+        sim->enable_host_exit(false);
+
+        elf_load elf(filename, sim);
+        if (elf.load())
+        {
+            uint32_t start_addr;
+            if (!elf.get_symbol("vectors", start_addr))
+                start_addr = elf.get_entry_point() & ~1;
+            sim->reset(start_addr);
+
+            bool jit = !model->jit || sim->enable_jit(cpu::JIT_ON);
+
+            trace_writer trace;
+            bool traced = !trace_file || (trace.open(trace_file, sim->get_reg_width() == 64 ? TRACE_FILE_RV64 : 0, codec) &&
+                                          sim->enable_trace_file(&trace));
+
+            // Time includes writing out the trace
+            double t0  = time_now();
+            int status = cpu::RUN_BUDGET;
+            while (jit && traced && (status == cpu::RUN_BUDGET || status == cpu::RUN_EVENT) && cycles < BENCH_MAX_CYCLES)
+                status = sim->run(cycles, BENCH_BATCH);
+            if (trace_file)
+            {
+                sim->enable_trace_file(NULL);
+                traced &= trace.close();
+            }
+            *seconds = time_now() - t0;
+            *insts   = cycles;
+
+            if (model->jit)
+                jit &= sim->get_jit_blocks() != 0;
+
+            ok = jit && traced && (status == cpu::RUN_STOPPED) && !sim->get_fault() && sim->get_exit_code() == 0;
+        }
+    }
+
+    stdout_mute(saved);
+
+    delete sim;
+    delete plat;
+    return ok;
+}
+//-----------------------------------------------------------------
+// load_baseline: 'model workload mips' lines
+//-----------------------------------------------------------------
+static bool load_baseline(const char *filename, std::map<std::string, double> &baseline)
+{
+    FILE *f = fopen(filename, "r");
+    if (!f)
+        return false;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+        char   model[64];
+        char   workload[64];
+        double mips;
+
+        if (line[0] != '#' && sscanf(line, "%63s %63s %lf", model, workload, &mips) == 3)
+            baseline[std::string(model) + " " + workload] = mips;
+    }
+
+    fclose(f);
+    return true;
+}
+//-----------------------------------------------------------------
+// trace_bench: Time of each RISC-V workload with a binary trace vs
+// without, flags those slowed down by more than limit times
+//-----------------------------------------------------------------
+static int trace_bench(const char *dir, const char *model_filter, int repeat, int codec, double limit)
+{
+    char trace_file[] = "/tmp/bench_models_XXXXXX";
+    int fd = mkstemp(trace_file);
+    if (fd < 0)
+    {
+        fprintf (stderr,"Error: Could not create a trace file\n");
+        return -1;
+    }
+    close(fd);
+
+    int failures = 0;
+    int too_slow = 0;
+
+    printf("%-8s %-8s %12s %10s %10s %8s %10s\n", "model", "workload", "insts", "time (s)", "traced (s)", "slowdown", "trace (MB)");
+
+    for (unsigned m=0;m<sizeof(models)/sizeof(models[0]);m++)
+    {
+        const t_model *model = &models[m];
+        if (!model->has_trace || (model_filter && strcmp(model_filter, model->name)))
+            continue;
+
+        for (unsigned w=0;w<sizeof(workloads)/sizeof(workloads[0]);w++)
+        {
+            std::string filename = std::string(dir) + "/" + model->elf + "_" + workloads[w] + ".elf";
+
+            uint64_t insts  = 0;
+            double   best   = 0;
+            double   traced = 0;
+            bool     ok     = true;
+            for (int r=0;r<repeat && ok;r++)
+            {
+                double seconds = 0;
+                double seconds_traced = 0;
+                ok = run(model, filename.c_str(), &insts, &seconds) &&
+                     run(model, filename.c_str(), &insts, &seconds_traced, trace_file, codec);
+                if (ok && (r == 0 || seconds < best))
+                    best = seconds;
+                if (ok && (r == 0 || seconds_traced < traced))
+                    traced = seconds_traced;
+            }
+
+            if (!ok)
+            {
+                printf("%-8s %-8s %12s %10s %10s %8s %10s FAIL\n", model->name, workloads[w], "-", "-", "-", "-", "-");
+                failures++;
+                continue;
+            }
+
+            struct stat st;
+            double size     = stat(trace_file, &st) == 0 ? st.st_size / 1.0E6 : 0;
+            double slowdown = best > 0 ? traced / best : 0;
+            bool   slow     = slowdown > limit;
+            printf("%-8s %-8s %12llu %10.3f %10.3f %7.1fx %10.2f%s\n", model->name, workloads[w],
+                   (unsigned long long)insts, best, traced, slowdown, size, slow ? " TOO SLOW" : "");
+            if (slow)
+                too_slow++;
+        }
+    }
+
+    unlink(trace_file);
+
+    if (failures || too_slow)
+    {
+        fflush(stdout);
+        if (failures)
+            fprintf (stderr,"Error: %d workload(s) failed\n", failures);
+        if (too_slow)
+            fprintf (stderr,"Error: %d workload(s) over %.0fx slower when traced\n", too_slow, limit);
+        return 1;
+    }
+
+    return 0;
+}
+//-----------------------------------------------------------------
+// main
+//-----------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    const char *dir            = BENCH_WORKLOAD_DIR;
+    const char *baseline_file  = NULL;
+    const char *write_file     = NULL;
+    const char *model_filter   = NULL;
+    double      tolerance      = BENCH_TOLERANCE;
+    double      trace_limit    = BENCH_TRACE_LIMIT;
+    int         trace_codec    = -1;
+    int         repeat         = 1;
+    int         c;
+    int         help           = 0;
+
+    while ((c = getopt_long (argc, argv, GETOPTS_ARGS, long_options, NULL)) != -1)
+    {
+        switch(c)
+        {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'b':
+                baseline_file = optarg;
+                break;
+            case 'w':
+                write_file = optarg;
+                break;
+            case 't':
+                tolerance = atof(optarg);
+                break;
+            case 'r':
+                repeat = atoi(optarg);
+                break;
+            case 'm':
+                model_filter = optarg;
+                break;
+            case 'z':
+                if (!strcmp(optarg, "lz"))
+                    trace_codec = TRACE_CODEC_LZ;
+                else if (!strcmp(optarg, "zlib"))
+                    trace_codec = TRACE_CODEC_ZLIB;
+                else if (!strcmp(optarg, "none"))
+                    trace_codec = TRACE_CODEC_NONE;
+                else
+                    help = 1;
+                break;
+            case 'l':
+                trace_limit = atof(optarg);
+                break;
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || repeat < 1)
+        help_options();
+
+    if (trace_codec >= 0)
+        return trace_bench(dir, model_filter, repeat, trace_codec, trace_limit);
+
+    std::map<std::string, double> baseline;
+    if (baseline_file && !load_baseline(baseline_file, baseline))
+        fprintf (stderr,"Warning: Could not open baseline %s\n", baseline_file);
+
+    FILE *f_out = NULL;
+    if (write_file)
+    {
+        f_out = fopen(write_file, "w");
+        if (!f_out)
+        {
+            fprintf (stderr,"Error: Could not create %s\n", write_file);
+            return -1;
+        }
+        fprintf(f_out, "# model workload mips\n");
+    }
+
+    int failures    = 0;
+    int regressions = 0;
+
+    printf("%-8s %-8s %12s %10s %10s %10s %8s\n", "model", "workload", "insts", "time (s)", "MIPS", "baseline", "delta");
+
+    for (unsigned m=0;m<sizeof(models)/sizeof(models[0]);m++)
+    {
+        const t_model *model = &models[m];
+        if (model_filter && strcmp(model_filter, model->name))
+            continue;
+
+        for (unsigned w=0;w<sizeof(workloads)/sizeof(workloads[0]);w++)
+        {
+            if (!strcmp(workloads[w], "mmu") && !model->has_mmu)
+                continue;
+
+            std::string filename = std::string(dir) + "/" + model->elf + "_" + workloads[w] + ".elf";
+            std::string key      = std::string(model->name) + " " + workloads[w];
+
+            uint64_t insts = 0;
+            double   best  = 0;
+            bool     ok    = true;
+            for (int r=0;r<repeat && ok;r++)
+            {
+                double seconds = 0;
+                ok = run(model, filename.c_str(), &insts, &seconds);
+                if (ok && (r == 0 || seconds < best))
+                    best = seconds;
+            }
+
+            if (!ok)
+            {
+                printf("%-8s %-8s %12s %10s %10s %10s %8s\n", model->name, workloads[w], "-", "-", "-", "-", "FAIL");
+                failures++;
+                continue;
+            }
+
+            double mips = best > 0 ? (insts / best / 1.0E6) : 0;
+            if (f_out)
+                fprintf(f_out, "%s %.2f\n", key.c_str(), mips);
+
+            std::map<std::string, double>::iterator it = baseline.find(key);
+            if (it == baseline.end() || it->second <= 0)
+            {
+                printf("%-8s %-8s %12llu %10.3f %10.2f %10s %8s\n", model->name, workloads[w],
+                       (unsigned long long)insts, best, mips, "-", "-");
+                continue;
+            }
+
+            double delta = ((mips / it->second) - 1.0) * 100.0;
+            bool   slow  = delta < -tolerance;
+            printf("%-8s %-8s %12llu %10.3f %10.2f %10.2f %+7.1f%%%s\n", model->name, workloads[w],
+                   (unsigned long long)insts, best, mips, it->second, delta, slow ? " REGRESSION" : "");
+            if (slow)
+                regressions++;
+        }
+    }
+
+    if (f_out)
+        fclose(f_out);
+
+    if (failures || regressions)
+    {
+        fflush(stdout);
+        if (failures)
+            fprintf (stderr,"Error: %d workload(s) failed\n", failures);
+        if (regressions)
+            fprintf (stderr,"Error: %d workload(s) slower than the baseline (tolerance %.0f%%)\n", regressions, tolerance);
+        return 1;
+    }
+
+    return 0;
+}
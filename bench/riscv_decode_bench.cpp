@@ -0,0 +1,148 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "riscv_decode.h"
+#include "rv64_isa.h"
+
+//-----------------------------------------------------------------
+// Defines:
+//-----------------------------------------------------------------
+#define BENCH_CORPUS        4096
+#define BENCH_DECODES       (2 * 1024 * 1024)
+
+//-----------------------------------------------------------------
+// Reference: linear mask / match chain (execute() ordering)
+//-----------------------------------------------------------------
+#define REF(name, op)       { INST_##name##_MASK, INST_##name, op }
+
+static const struct
+{
+    uint32_t mask;
+    uint32_t match;
+    int      op;
+} m_ref[] =
+{
+    REF(ANDI, RV_OP_ANDI), REF(ADDI, RV_OP_ADDI), REF(SLTI, RV_OP_SLTI), REF(SLTIU, RV_OP_SLTIU),
+    REF(ORI, RV_OP_ORI), REF(XORI, RV_OP_XORI), REF(SLLI, RV_OP_SLLI), REF(SRLI, RV_OP_SRLI),
+    REF(SRAI, RV_OP_SRAI), REF(LUI, RV_OP_LUI), REF(AUIPC, RV_OP_AUIPC), REF(ADD, RV_OP_ADD),
+    REF(SUB, RV_OP_SUB), REF(SLT, RV_OP_SLT), REF(SLTU, RV_OP_SLTU), REF(XOR, RV_OP_XOR),
+    REF(OR, RV_OP_OR), REF(AND, RV_OP_AND), REF(SLL, RV_OP_SLL), REF(SRL, RV_OP_SRL),
+    REF(SRA, RV_OP_SRA), REF(JAL, RV_OP_JAL), REF(JALR, RV_OP_JALR), REF(BEQ, RV_OP_BEQ),
+    REF(BNE, RV_OP_BNE), REF(BLT, RV_OP_BLT), REF(BGE, RV_OP_BGE), REF(BLTU, RV_OP_BLTU),
+    REF(BGEU, RV_OP_BGEU), REF(LB, RV_OP_LB), REF(LH, RV_OP_LH), REF(LW, RV_OP_LW),
+    REF(LBU, RV_OP_LBU), REF(LHU, RV_OP_LHU), REF(LWU, RV_OP_LWU), REF(SB, RV_OP_SB),
+    REF(SH, RV_OP_SH), REF(SW, RV_OP_SW), REF(ECALL, RV_OP_ECALL), REF(EBREAK, RV_OP_EBREAK),
+    REF(MRET, RV_OP_MRET), REF(SRET, RV_OP_SRET), REF(SFENCE, RV_OP_SFENCE_VMA), REF(IFENCE, RV_OP_FENCE_I),
+    REF(FENCE, RV_OP_FENCE), REF(CSRRW, RV_OP_CSRRW), REF(CSRRS, RV_OP_CSRRS), REF(CSRRC, RV_OP_CSRRC),
+    REF(CSRRWI, RV_OP_CSRRWI), REF(CSRRSI, RV_OP_CSRRSI), REF(CSRRCI, RV_OP_CSRRCI), REF(WFI, RV_OP_WFI),
+    REF(MUL, RV_OP_MUL), REF(MULH, RV_OP_MULH), REF(MULHSU, RV_OP_MULHSU), REF(MULHU, RV_OP_MULHU),
+    REF(DIV, RV_OP_DIV), REF(DIVU, RV_OP_DIVU), REF(REM, RV_OP_REM), REF(REMU, RV_OP_REMU),
+    REF(AMOADD_W, RV_OP_AMOADD_W), REF(AMOXOR_W, RV_OP_AMOXOR_W), REF(AMOOR_W, RV_OP_AMOOR_W),
+    REF(AMOAND_W, RV_OP_AMOAND_W), REF(AMOMIN_W, RV_OP_AMOMIN_W), REF(AMOMAX_W, RV_OP_AMOMAX_W),
+    REF(AMOMINU_W, RV_OP_AMOMINU_W), REF(AMOMAXU_W, RV_OP_AMOMAXU_W), REF(AMOSWAP_W, RV_OP_AMOSWAP_W),
+    REF(LR_W, RV_OP_LR_W), REF(SC_W, RV_OP_SC_W), REF(SD, RV_OP_SD), REF(LD, RV_OP_LD),
+    REF(ADDIW, RV_OP_ADDIW), REF(ADDW, RV_OP_ADDW), REF(SUBW, RV_OP_SUBW), REF(SLLIW, RV_OP_SLLIW),
+    REF(SLLW, RV_OP_SLLW), REF(SRLIW, RV_OP_SRLIW), REF(SRLW, RV_OP_SRLW), REF(SRAIW, RV_OP_SRAIW),
+    REF(SRAW, RV_OP_SRAW), REF(MULW, RV_OP_MULW), REF(DIVUW, RV_OP_DIVUW), REF(DIVW, RV_OP_DIVW),
+    REF(REMUW, RV_OP_REMUW), REF(REMW, RV_OP_REMW), REF(AMOADD_D, RV_OP_AMOADD_D),
+    REF(AMOXOR_D, RV_OP_AMOXOR_D), REF(AMOOR_D, RV_OP_AMOOR_D), REF(AMOAND_D, RV_OP_AMOAND_D),
+    REF(AMOMIN_D, RV_OP_AMOMIN_D), REF(AMOMAX_D, RV_OP_AMOMAX_D), REF(AMOMINU_D, RV_OP_AMOMINU_D),
+    REF(AMOMAXU_D, RV_OP_AMOMAXU_D), REF(AMOSWAP_D, RV_OP_AMOSWAP_D), REF(LR_D, RV_OP_LR_D),
+    REF(SC_D, RV_OP_SC_D)
+};
+
+static int ref_decode(uint32_t opcode)
+{
+    for (unsigned i=0;i<sizeof(m_ref)/sizeof(m_ref[0]);i++)
+        if ((opcode & m_ref[i].mask) == m_ref[i].match)
+            return m_ref[i].op;
+    return RV_OP_ILLEGAL;
+}
+//-----------------------------------------------------------------
+// time_now: Host time in seconds
+//-----------------------------------------------------------------
+static double time_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1.0E9);
+}
+//-----------------------------------------------------------------
+// main
+//-----------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    uint32_t flags = RV_DECODE_RV64 | RV_DECODE_RVM | RV_DECODE_RVA;
+    std::vector<uint32_t> corpus[RV_OP_MAX];
+    t_riscv_inst inst;
+    int mismatch = 0;
+
+    // Exact encodings (unlikely to be hit at random)
+    static const uint32_t fixed[] = { INST_ECALL, INST_EBREAK, INST_MRET, INST_SRET, INST_WFI };
+
+    // Random 32-bit encodings, bucketed per decoded operation
+    srand(1);
+    for (int i=0;i<(16 * 1024 * 1024);i++)
+    {
+        uint32_t opcode = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        if (i < (int)(sizeof(fixed)/sizeof(fixed[0])))
+            opcode = fixed[i];
+        opcode |= 3;
+
+        riscv_decode(opcode, flags, &inst);
+
+        // Table decoder accepts a subset of the (looser) reference masks
+        if (inst.op != RV_OP_ILLEGAL && ref_decode(opcode) != inst.op)
+            mismatch++;
+
+        if (corpus[inst.op].size() < BENCH_CORPUS)
+            corpus[inst.op].push_back(opcode);
+    }
+
+    printf("%-12s %14s %14s\n", "op", "table (ns)", "linear (ns)");
+
+    double total_table = 0;
+    double total_ref   = 0;
+    int    ops         = 0;
+    uint32_t sum       = 0;
+
+    for (int op=0;op<RV_OP_MAX;op++)
+    {
+        std::vector<uint32_t> &c = corpus[op];
+        if (c.empty())
+            continue;
+
+        double t0 = time_now();
+        for (int i=0;i<BENCH_DECODES;i++)
+        {
+            riscv_decode(c[i % c.size()], flags, &inst);
+            sum += inst.op + inst.imm;
+        }
+        double t_table = (time_now() - t0) * 1.0E9 / BENCH_DECODES;
+
+        t0 = time_now();
+        for (int i=0;i<BENCH_DECODES;i++)
+            sum += ref_decode(c[i % c.size()]);
+        double t_ref = (time_now() - t0) * 1.0E9 / BENCH_DECODES;
+
+        printf("%-12s %14.2f %14.2f\n", riscv_op_name(op), t_table, t_ref);
+
+        total_table += t_table;
+        total_ref   += t_ref;
+        ops++;
+    }
+
+    printf("%-12s %14.2f %14.2f\n", "mean", total_table / ops, total_ref / ops);
+    printf("mismatches: %d (%x)\n", mismatch, sum & 0xF);
+
+    return mismatch ? 1 : 0;
+}
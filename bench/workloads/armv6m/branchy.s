@@ -0,0 +1,52 @@
+@-----------------------------------------------------------------
+@ branchy: Data dependent branches (LCG driven if / else chain)
+@-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    500000
+    .equ EXPECT,        -1192237
+
+    VECTORS _start
+
+    .thumb_func
+    .globl  _start
+_start:
+    movs    r4, #0
+    movs    r5, #1
+    ldr     r6, =LCG_MUL
+    ldr     r7, =LCG_ADD
+    ldr     r3, =ITERATIONS
+1:
+    LCG     r5, r6, r7
+    lsrs    r0, r5, #29
+    bne     2f
+    adds    r4, #1
+    b       5f
+2:
+    cmp     r0, #3
+    bhs     3f
+    adds    r4, r4, r0
+    b       5f
+3:
+    cmp     r0, #6
+    bhs     4f
+    eors    r4, r5
+    b       5f
+4:
+    subs    r4, r4, r5
+5:
+    lsrs    r0, r5, #17             @ Bit 16 -> carry
+    bcc     6f
+    lsls    r0, r4, #1
+    adds    r4, r4, r0
+6:
+    subs    r3, #1
+    bne     1b
+
+    ldr     r0, =EXPECT
+    cmp     r4, r0
+    bne     fail
+    PASS
+fail:
+    FAIL
+    .ltorg
@@ -0,0 +1,178 @@
+@-----------------------------------------------------------------
+@ cov: Decoder coverage - every Thumb operation the model decodes,
+@ conditional branches taken / not taken, BL / BLX, MRS / MSR and
+@ self-modifying code (the immediate of a movs is patched each
+@ iteration). Register and memory results are folded into a
+@ signature which is checked at the end.
+@-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    200
+    .equ EXPECT,        -1708978796
+
+    VECTORS _start
+
+    .thumb_func
+    .globl  _start
+_start:
+    movs    r0, #0
+    movs    r1, #1
+    ldr     r4, =0x12345678
+    ldr     r5, =0x80000001
+    movs    r6, #ITERATIONS
+loop:
+    @ Data processing
+    adds    r0, r0, r4
+    adcs    r0, r5
+    sbcs    r1, r0
+    subs    r2, r1, #3
+    rsbs    r3, r2, #0
+    muls    r3, r0, r3
+    eors    r0, r3
+    orrs    r1, r0
+    bics    r2, r1
+    mvns    r3, r2
+    ands    r3, r4
+    lsls    r2, r0, #7
+    lsrs    r3, r1, #31
+    asrs    r2, r5, #3
+    movs    r3, r6
+    lsls    r1, r3
+    lsrs    r2, r3
+    asrs    r5, r3
+    rors    r4, r3
+    lsls    r3, r3, #0
+    rev     r2, r0
+    rev16   r3, r1
+    revsh   r2, r4
+    sxtb    r3, r0
+    sxth    r2, r1
+    uxtb    r3, r4
+    uxth    r2, r5
+
+    @ Compares and conditional branches
+    cmp     r0, r1
+    bhi     1f
+    adds    r0, #5
+1:  cmn     r2, r3
+    bge     1f
+    subs    r1, #9
+1:  tst     r0, r4
+    bne     1f
+    adds    r2, #1
+1:  blt     1f
+    adds    r3, #1
+1:  bvs     1f
+    bmi     1f
+    bls     1f
+    bgt     1f
+    ble     1f
+
+    @ High registers, special registers, SP / PC relative
+1:  mov     r8, r0
+    add     r8, r1
+    mov     r9, r8
+    cmp     r9, r0
+    mrs     r7, apsr
+    msr     apsr, r0
+    mrs     r2, apsr
+    msr     apsr, r7
+    add     r0, sp, #16
+    sub     sp, #16
+    add     sp, #16
+    adr     r1, pool
+    ldr     r2, [r1, #4]
+    ldr     r3, pool
+
+    @ Calls
+    bl      func
+    ldr     r1, =func
+    blx     r1
+
+    @ Loads / stores (immediate, register offset, multiple, stack)
+    ldr     r1, =buf
+    str     r0, [r1, #4]
+    strh    r2, [r1, #2]
+    strb    r3, [r1, #1]
+    ldrb    r2, [r1, #4]
+    ldrh    r3, [r1, #2]
+    ldr     r2, [r1]
+    movs    r2, #4
+    str     r0, [r1, r2]
+    strh    r3, [r1, r2]
+    strb    r3, [r1, r2]
+    ldr     r3, [r1, r2]
+    ldrh    r3, [r1, r2]
+    ldrb    r3, [r1, r2]
+    ldrsb   r3, [r1, r2]
+    ldrsh   r3, [r1, r2]
+    stm     r1!, {r0, r2, r3}
+    subs    r1, #12
+    ldm     r1!, {r2, r3, r4}
+    push    {r0-r3, lr}
+    pop     {r0-r3}
+    pop     {r4}
+    ldr     r4, =0x12345678
+
+    @ Hints, barriers, interrupt masking, system registers
+    nop
+    dmb
+    dsb
+    isb
+    cpsid   i
+    cpsie   i
+    mrs     r2, primask
+    mrs     r2, control
+    mrs     r2, msp
+    str     r2, [sp, #4]
+    ldr     r3, [sp, #4]
+
+    @ Self-modifying code: patch the 'movs r2, #n' immediate
+    ldr     r1, =smc
+    ldrh    r2, [r1]
+    adds    r2, #1
+    strh    r2, [r1]
+smc:
+    movs    r2, #0
+    add     r0, r2
+    subs    r6, #1
+    beq     done
+    b       loop
+
+done:
+    @ Signature: registers and the scratch buffer
+    adds    r0, r1
+    adds    r0, r2
+    adds    r0, r3
+    adds    r0, r4
+    adds    r0, r5
+    add     r0, r8
+    add     r0, r9
+    ldr     r1, =buf
+    ldm     r1!, {r2, r3, r4}
+    eors    r0, r2
+    eors    r0, r3
+    eors    r0, r4
+
+    ldr     r1, =EXPECT
+    cmp     r0, r1
+    bne     fail
+    PASS
+fail:
+    FAIL
+
+    .thumb_func
+func:
+    adds    r0, #7
+    mov     pc, lr
+
+    .balign 4
+pool:
+    .word   0xdeadbeef
+    .word   0xcafef00d
+    .ltorg
+
+    .data
+    .balign 4
+buf:
+    .space  64
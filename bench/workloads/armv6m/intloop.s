@@ -0,0 +1,30 @@
+@-----------------------------------------------------------------
+@ intloop: Integer ALU loop (multiply, add, xor, shifts)
+@-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    1000000
+    .equ EXPECT,        352864146
+
+    VECTORS _start
+
+    .thumb_func
+    .globl  _start
+_start:
+    movs    r4, #0
+    movs    r5, #1
+    ldr     r6, =LCG_MUL
+    ldr     r7, =LCG_ADD
+    ldr     r3, =ITERATIONS
+1:
+    CHECKSUM r4, r5, r6, r7, r0
+    subs    r3, #1
+    bne     1b
+
+    ldr     r0, =EXPECT
+    cmp     r4, r0
+    bne     fail
+    PASS
+fail:
+    FAIL
+    .ltorg
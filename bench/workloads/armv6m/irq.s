@@ -0,0 +1,66 @@
+@-----------------------------------------------------------------
+@ irq: SysTick interrupt storm during the intloop checksum.
+@ The handler only uses the registers stacked on exception entry.
+@-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    500000
+    .equ EXPECT,        -1812494779
+    .equ PERIOD,        100         @ Cycles between interrupts
+    .equ MIN_TICKS,     10000
+
+    VECTORS systick
+
+    .thumb_func
+    .globl  _start
+_start:
+    ldr     r0, =ticks
+    movs    r1, #0
+    str     r1, [r0]
+
+    ldr     r0, =SYSTICK_BASE
+    ldr     r1, =PERIOD - 1
+    str     r1, [r0, #4]            @ RVR
+    movs    r1, #3                  @ ENABLE | TICKINT
+    str     r1, [r0]
+
+    movs    r4, #0
+    movs    r5, #1
+    ldr     r6, =LCG_MUL
+    ldr     r7, =LCG_ADD
+    ldr     r3, =ITERATIONS
+1:
+    CHECKSUM r4, r5, r6, r7, r0
+    subs    r3, #1
+    bne     1b
+
+    cpsid   i
+    ldr     r0, =SYSTICK_BASE
+    movs    r1, #0
+    str     r1, [r0]
+
+    ldr     r0, =EXPECT
+    cmp     r4, r0
+    bne     fail
+    ldr     r0, =ticks
+    ldr     r0, [r0]
+    ldr     r1, =MIN_TICKS
+    cmp     r0, r1
+    blo     fail
+    PASS
+fail:
+    FAIL
+
+    .thumb_func
+systick:
+    ldr     r0, =ticks
+    ldr     r1, [r0]
+    adds    r1, #1
+    str     r1, [r0]
+    bx      lr
+    .ltorg
+
+    .bss
+    .balign 4
+ticks:
+    .space  4
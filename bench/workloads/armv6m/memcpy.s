@@ -0,0 +1,66 @@
+@-----------------------------------------------------------------
+@ memcpy: Word copy of a 4KB buffer (LDM / STM)
+@-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ WORDS,         1024
+    .equ ROUNDS,        2000
+    .equ EXPECT,        -619425280  @ Sum of the source words
+
+    VECTORS _start
+
+    .thumb_func
+    .globl  _start
+_start:
+    @ Source buffer: LCG sequence
+    ldr     r0, =src
+    ldr     r1, =WORDS
+    movs    r5, #1
+    ldr     r6, =LCG_MUL
+    ldr     r7, =LCG_ADD
+1:
+    LCG     r5, r6, r7
+    str     r5, [r0]
+    adds    r0, #4
+    subs    r1, #1
+    bne     1b
+
+    ldr     r3, =ROUNDS
+2:
+    ldr     r0, =src
+    ldr     r1, =dst
+    ldr     r2, =WORDS / 4
+3:
+    ldm     r0!, {r4-r7}
+    stm     r1!, {r4-r7}
+    subs    r2, #1
+    bne     3b
+
+    subs    r3, #1
+    bne     2b
+
+    @ Destination checksum
+    ldr     r1, =dst
+    ldr     r2, =WORDS
+    movs    r4, #0
+4:
+    ldr     r0, [r1]
+    adds    r4, r4, r0
+    adds    r1, #4
+    subs    r2, #1
+    bne     4b
+
+    ldr     r0, =EXPECT
+    cmp     r4, r0
+    bne     fail
+    PASS
+fail:
+    FAIL
+    .ltorg
+
+    .bss
+    .balign 16
+src:
+    .space  WORDS * 4
+dst:
+    .space  WORDS * 4
@@ -0,0 +1,36 @@
+@-----------------------------------------------------------------
+@ mmio: UART status polls and transmit writes
+@-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    500000
+    .equ STATUS_IDLE,   0x04        @ TX empty, no RX data
+
+    VECTORS _start
+
+    .thumb_func
+    .globl  _start
+_start:
+    ldr     r0, =UART_BASE
+    ldr     r1, =ITERATIONS
+    movs    r4, #0
+    movs    r5, #STATUS_IDLE
+1:
+    ldr     r2, [r0, #8]
+    cmp     r2, r5
+    beq     2f
+    adds    r4, #1
+2:
+    movs    r3, #0x3f
+    ands    r3, r1
+    adds    r3, #0x20
+    str     r3, [r0, #4]
+    subs    r1, #1
+    bne     1b
+
+    cmp     r4, #0
+    bne     fail
+    PASS
+fail:
+    FAIL
+    .ltorg
@@ -0,0 +1,52 @@
+#-----------------------------------------------------------------
+# branchy: Data dependent branches (LCG driven if / else chain)
+#-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    500000
+    .equ EXPECT,        -1192237
+
+    .text
+    .globl  _start
+_start:
+    li      $s0, 0
+    li      $s1, 1
+    li      $s2, LCG_MUL
+    li      $s3, LCG_ADD
+    li      $s4, ITERATIONS
+1:
+    LCG     $s1, $s2, $s3
+    srl     $t0, $s1, 29
+    bnez    $t0, 2f
+    sltiu   $t1, $t0, 3
+    b       5f
+    addiu   $s0, $s0, 1
+2:
+    beqz    $t1, 3f
+    sltiu   $t1, $t0, 6
+    b       5f
+    addu    $s0, $s0, $t0
+3:
+    beqz    $t1, 4f
+    nop
+    b       5f
+    xor     $s0, $s0, $s1
+4:
+    subu    $s0, $s0, $s1
+5:
+    srl     $t0, $s1, 16
+    andi    $t0, $t0, 1
+    beqz    $t0, 6f
+    sll     $t1, $s0, 1
+    addu    $s0, $s0, $t1
+6:
+    addiu   $s4, $s4, -1
+    bnez    $s4, 1b
+    nop
+
+    li      $t0, EXPECT
+    bne     $s0, $t0, fail
+    nop
+    PASS
+fail:
+    FAIL
@@ -0,0 +1,270 @@
+#-----------------------------------------------------------------
+# cov: Decoder coverage - every operation the block cache decodes,
+# faults in taken / not taken delay slots (overflow, address error),
+# branches and calls with delay slots, a jump to a block crossing a
+# page and self-modifying code within the running block.
+# Results are folded into a signature which is checked at the end.
+#-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    200
+    .equ EXPECT,        -789051376
+
+    .text
+    .globl  _start
+_start:
+    la      $t0, handler
+    mtc0    $t0, $15                # Exception vector
+    li      $s0, 0
+    li      $s4, 0
+    li      $s5, 0
+    li      $s6, 0
+    li      $k1, 0
+    li      $s7, ITERATIONS
+loop:
+    li      $t1, 0x12345678
+    li      $t2, -7
+    addu    $t3, $t1, $t2
+    xor     $s0, $s0, $t3
+    subu    $t3, $t2, $t1
+    addu    $s0, $s0, $t3
+    and     $t3, $t1, $s0
+    or      $t4, $t3, $t2
+    xor     $t5, $t4, $s7
+    nor     $t3, $t5, $t1
+    addu    $s0, $s0, $t3
+    slt     $t3, $t2, $t1
+    sltu    $t4, $t2, $t1
+    sll     $t4, $t4, 3
+    addu    $s0, $s0, $t3
+    addu    $s0, $s0, $t4
+    addi    $t3, $s0, -1234
+    addiu   $t4, $t3, 32767
+    slti    $t5, $t4, -5
+    sltiu   $t6, $t4, -5
+    andi    $t3, $t4, 0xf0f0
+    ori     $t3, $t3, 0x8001
+    xori    $t3, $t3, 0xffff
+    lui     $t4, 0xbeef
+    addu    $s0, $s0, $t3
+    addu    $s0, $s0, $t4
+    addu    $s0, $s0, $t5
+    addu    $s0, $s0, $t6
+    sll     $t3, $s0, 7
+    srl     $t4, $s0, 9
+    sra     $t5, $t2, 3
+    sllv    $t6, $s0, $t2
+    srlv    $t7, $s0, $t2
+    srav    $t8, $t2, $s7
+    xor     $s0, $s0, $t3
+    addu    $s0, $s0, $t4
+    xor     $s0, $s0, $t5
+    addu    $s0, $s0, $t6
+    xor     $s0, $s0, $t7
+    addu    $s0, $s0, $t8
+    mult    $s0, $t2
+    mfhi    $t3
+    mflo    $t4
+    multu   $s0, $t2
+    mfhi    $t5
+    addu    $s0, $s0, $t3
+    xor     $s0, $s0, $t4
+    addu    $s0, $s0, $t5
+    div     $zero, $s0, $t2
+    mflo    $t3
+    mfhi    $t4
+    divu    $zero, $s0, $s7
+    mflo    $t5
+    mfhi    $t6
+    li      $t9, 0
+    div     $zero, $s0, $t9            # Divide by zero
+    mflo    $t7
+    li      $t8, 0x80000000
+    li      $t9, -1
+    div     $zero, $t8, $t9
+    mfhi    $t8
+    addu    $s0, $s0, $t3
+    xor     $s0, $s0, $t4
+    addu    $s0, $s0, $t5
+    xor     $s0, $s0, $t6
+    addu    $s0, $s0, $t7
+    xor     $s0, $s0, $t8
+    li      $t9, 0
+    divu    $zero, $s0, $t9
+    mflo    $t3
+    mthi    $s7
+    mtlo    $s0
+    mfhi    $t4
+    mflo    $t5
+    addu    $s0, $s0, $t3
+    addu    $s0, $s0, $t4
+    xor     $s0, $s0, $t5
+
+    # Memory
+    la      $t0, buf
+    sw      $s0, 0($t0)
+    sh      $s7, 4($t0)
+    sh      $t2, 6($t0)
+    sb      $s0, 8($t0)
+    sb      $t2, 9($t0)
+    sb      $s7, 10($t0)
+    sb      $t1, 11($t0)
+    lw      $t3, 8($t0)
+    lh      $t4, 6($t0)
+    lhu     $t5, 6($t0)
+    lb      $t6, 9($t0)
+    lbu     $t7, 9($t0)
+    addu    $s0, $s0, $t3
+    xor     $s0, $s0, $t4
+    addu    $s0, $s0, $t5
+    xor     $s0, $s0, $t6
+    addu    $s0, $s0, $t7
+    andi    $t9, $s7, 3
+    addu    $t9, $t9, $t0
+    lwl     $t3, 1($t9)
+    lwr     $t3, 4($t9)
+    move    $t4, $s0
+    lwr     $t4, 2($t9)
+    lwl     $t4, 5($t9)
+    addu    $s0, $s0, $t3
+    xor     $s0, $s0, $t4
+    swl     $s0, 13($t9)
+    swr     $t2, 18($t9)
+    swl     $t1, 22($t9)
+    swr     $s7, 24($t9)
+    lw      $t3, 12($t0)
+    lw      $t4, 16($t0)
+    lw      $t5, 20($t0)
+    lw      $t6, 24($t0)
+    addu    $s0, $s0, $t3
+    xor     $s0, $s0, $t4
+    addu    $s0, $s0, $t5
+    xor     $s0, $s0, $t6
+
+    # Branches (delay slots touch the operands)
+    andi    $t3, $s7, 1
+    beq     $t3, $zero, 1f
+    addiu   $t3, $t3, 5
+    addiu   $s0, $s0, 77
+1:  addu    $s0, $s0, $t3
+    bne     $t3, $zero, 1f
+    lw      $t4, 0($t0)
+    addiu   $s0, $s0, 99
+1:  xor     $s0, $s0, $t4
+    blez    $t2, 1f
+    sll     $t2, $t2, 1
+    addiu   $s0, $s0, 3
+1:  bgtz    $t2, 1f
+    nop
+    addiu   $s0, $s0, 5
+1:  bltz    $s0, 1f
+    addiu   $s0, $s0, 1
+    addiu   $s0, $s0, 7
+1:  bgez    $s0, 1f
+    addiu   $s0, $s0, 1
+    addiu   $s0, $s0, 11
+1:  bltzal  $s0, 1f
+    move    $t5, $ra
+1:  addu    $s0, $s0, $ra
+    addu    $s0, $s0, $t5
+    bgezal  $ra, 1f
+    nop
+1:  addu    $s0, $s0, $ra
+    jal     func
+    addiu   $t6, $zero, 3
+    addu    $s0, $s0, $v0
+    la      $t7, func
+    jalr    $t7
+    addiu   $t6, $zero, 9
+    addu    $s0, $s0, $v0
+    la      $t7, 1f
+    jalr    $t5, $t7
+    nop
+1:  addu    $s0, $s0, $t5
+    j       pagecross
+    addiu   $s0, $s0, 13
+back:
+
+    # Exceptions in delay slots / plain
+    li      $t9, 0x7fffffff
+    li      $t8, 1
+    li      $t6, 0
+    b       1f
+    add     $t7, $t9, $t8
+1:  addu    $s0, $s0, $t7
+    li      $t8, 1
+    bne     $zero, $zero, 1f
+    add     $t7, $t9, $t8
+1:  addu    $s0, $s0, $t7
+    li      $t8, -1
+    sub     $t7, $t8, $t9
+    addu    $s0, $s0, $t7
+    li      $t8, 1
+    addi    $t7, $t9, -100
+    addu    $s0, $s0, $t7
+    move    $t6, $t0
+    addiu   $t8, $t0, 1
+    b       1f
+    lw      $t7, 0($t8)
+1:  addu    $s0, $s0, $t7
+    addiu   $t8, $t0, 2
+    sw      $s0, 0($t8)
+    addiu   $t8, $t0, 3
+    lh      $t7, 0($t8)
+    addu    $s0, $s0, $t7
+
+    # Self-modifying code (patched within the running block)
+    andi    $t1, $s7, 3
+    addiu   $t1, $t1, 1
+    lui     $t2, 0x2694
+    or      $t2, $t2, $t1
+    la      $t0, smc
+    sw      $t2, 0($t0)
+smc:
+    addiu   $s4, $s4, 1
+    addu    $s0, $s0, $s4
+
+    addiu   $s7, $s7, -1
+    bnez    $s7, loop
+    nop
+
+    # Exception count, EPCs and causes
+    addu    $s0, $s0, $k1
+    addu    $s0, $s0, $s5
+    xor     $s0, $s0, $s6
+
+    li      $t0, EXPECT
+    bne     $s0, $t0, fail
+    nop
+    PASS
+fail:
+    FAIL
+
+func:
+    sll     $v0, $t6, 2
+    jr      $ra
+    addiu   $v0, $v0, 1
+
+# Exception handler: record cause / EPC and retry the faulting
+# instruction (or its branch) with $t8 = $t6 (no overflow / aligned)
+handler:
+    mfc0    $k0, $13
+    xor     $s6, $s6, $k0
+    mfc0    $k0, $14
+    addu    $s5, $s5, $k0
+    addiu   $k1, $k1, 1
+    move    $t8, $t6
+    jr      $k0
+    .word   0x42000010              # rfe (not known to the assembler)
+
+    .balign 4096
+    .space  4088
+pagecross:
+    addiu   $s0, $s0, 17
+    b       back
+    addiu   $s0, $s0, 19
+
+    .data
+    .balign 4
+buf:
+    .space  64
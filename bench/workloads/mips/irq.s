@@ -0,0 +1,65 @@
+#-----------------------------------------------------------------
+# irq: Timer interrupt storm during the intloop checksum.
+# The handler only uses k0 / k1 (tick count).
+#-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    500000
+    .equ EXPECT,        -1812494779
+    .equ PERIOD,        100         # Cycles between interrupts
+    .equ MIN_TICKS,     10000
+
+    .equ TIMER0_CTRL,   0x08
+    .equ TIMER0_CMP,    0x0c
+    .equ TIMER0_VAL,    0x10
+
+    .text
+    .globl  _start
+_start:
+    la      $t0, handler
+    mtc0    $t0, $15                # Exception vector
+    li      $k1, 0
+
+    li      $t0, TIMER_BASE
+    li      $t1, PERIOD
+    sw      $t1, TIMER0_CMP($t0)
+    sw      $zero, TIMER0_VAL($t0)
+    li      $t1, 0x6                # EN | INTEN
+    sw      $t1, TIMER0_CTRL($t0)
+    li      $t0, (1 << (8 + TIMER_IRQ)) | 1
+    mtc0    $t0, $12                # IM2 | IEc
+
+    li      $s0, 0
+    li      $s1, 1
+    li      $s2, LCG_MUL
+    li      $s3, LCG_ADD
+    li      $s4, ITERATIONS
+1:
+    CHECKSUM $s0, $s1, $s2, $s3, $t0
+    addiu   $s4, $s4, -1
+    bnez    $s4, 1b
+    nop
+
+    mtc0    $zero, $12
+    li      $t0, TIMER_BASE
+    sw      $zero, TIMER0_CTRL($t0)
+
+    li      $t0, EXPECT
+    bne     $s0, $t0, fail
+    li      $t0, MIN_TICKS
+    sltu    $t0, $k1, $t0
+    bnez    $t0, fail
+    nop
+    PASS
+fail:
+    FAIL
+
+handler:
+    lui     $k0, %hi(TIMER_BASE)
+    sw      $zero, TIMER0_VAL($k0)  # Next interrupt PERIOD cycles later
+    mtc0    $zero, $13              # Clear pending (cause)
+    addiu   $k1, $k1, 1
+    mfc0    $k0, $14                # EPC
+    nop
+    jr      $k0
+    .word   0x42000010              # rfe (not known to the assembler)
@@ -0,0 +1,32 @@
+#-----------------------------------------------------------------
+# mmio: UART status polls and transmit writes
+#-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    500000
+    .equ STATUS_IDLE,   0x04        # TX empty, no RX data
+
+    .text
+    .globl  _start
+_start:
+    li      $t0, UART_BASE
+    li      $t1, ITERATIONS
+    li      $t4, STATUS_IDLE
+    li      $s0, 0
+1:
+    lw      $t2, 8($t0)
+    andi    $t3, $t1, 0x3f
+    beq     $t2, $t4, 2f
+    addiu   $t3, $t3, 0x20
+    addiu   $s0, $s0, 1
+2:
+    sw      $t3, 4($t0)
+    addiu   $t1, $t1, -1
+    bnez    $t1, 1b
+    nop
+
+    bnez    $s0, fail
+    nop
+    PASS
+fail:
+    FAIL
@@ -0,0 +1,49 @@
+#-----------------------------------------------------------------
+# branchy: Data dependent branches (LCG driven if / else chain)
+#-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    500000
+    .equ EXPECT,        -1192237
+
+    .text
+    .globl _start
+_start:
+    li      s0, 0
+    li      s1, 1
+    li      s2, LCG_MUL
+    li      s3, LCG_ADD
+    li      s4, ITERATIONS
+    li      s5, 3
+    li      s6, 6
+1:
+    LCG     s1, s2, s3
+    SRLI32  t0, s1, 29
+    bnez    t0, 2f
+    ADDI32  s0, s0, 1
+    j       5f
+2:
+    bgeu    t0, s5, 3f
+    ADD32   s0, s0, t0
+    j       5f
+3:
+    bgeu    t0, s6, 4f
+    xor     s0, s0, s1
+    j       5f
+4:
+    SUB32   s0, s0, s1
+5:
+    SRLI32  t0, s1, 16
+    andi    t0, t0, 1
+    beqz    t0, 6f
+    SLLI32  t1, s0, 1
+    ADD32   s0, s0, t1
+6:
+    addi    s4, s4, -1
+    bnez    s4, 1b
+
+    li      t0, EXPECT
+    bne     s0, t0, fail
+    PASS
+fail:
+    FAIL
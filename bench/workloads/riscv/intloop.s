@@ -0,0 +1,26 @@
+#-----------------------------------------------------------------
+# intloop: Integer ALU loop (multiply, add, xor, shifts)
+#-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    1000000
+    .equ EXPECT,        352864146
+
+    .text
+    .globl _start
+_start:
+    li      s0, 0
+    li      s1, 1
+    li      s2, LCG_MUL
+    li      s3, LCG_ADD
+    li      s4, ITERATIONS
+1:
+    CHECKSUM s0, s1, s2, s3, t0
+    addi    s4, s4, -1
+    bnez    s4, 1b
+
+    li      t0, EXPECT
+    bne     s0, t0, fail
+    PASS
+fail:
+    FAIL
@@ -0,0 +1,54 @@
+#-----------------------------------------------------------------
+# irq: Timer interrupt storm (mtimecmp) during the intloop checksum.
+# The handler only uses t6 / s11 (tick count).
+#-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ ITERATIONS,    500000
+    .equ EXPECT,        -1812494779
+    .equ PERIOD,        100         # Timer ticks between interrupts
+    .equ MIN_TICKS,     10000
+
+    .text
+    .globl _start
+_start:
+    la      t0, trap
+    csrw    mtvec, t0
+    li      s11, 0
+
+    csrr    t0, time
+    addi    t0, t0, PERIOD
+    csrw    0x7c0, t0
+    li      t0, 0x80                # MTIE
+    csrs    mie, t0
+    csrsi   mstatus, 0x8            # MIE
+
+    li      s0, 0
+    li      s1, 1
+    li      s2, LCG_MUL
+    li      s3, LCG_ADD
+    li      s4, ITERATIONS
+1:
+    CHECKSUM s0, s1, s2, s3, t0
+    addi    s4, s4, -1
+    bnez    s4, 1b
+
+    csrci   mstatus, 0x8
+
+    li      t0, EXPECT
+    bne     s0, t0, fail
+    li      t0, MIN_TICKS
+    bltu    s11, t0, fail
+    PASS
+fail:
+    FAIL
+
+    .balign 4
+trap:
+    li      t6, 0x80
+    csrc    mip, t6
+    addi    s11, s11, 1
+    csrr    t6, time
+    addi    t6, t6, PERIOD
+    csrw    0x7c0, t6
+    mret
@@ -0,0 +1,70 @@
+#-----------------------------------------------------------------
+# memcpy: Word copy of a 4KB buffer (loads / stores)
+#-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ WORDS,         1024
+    .equ ROUNDS,        2000
+    .equ EXPECT,        -619425280  # Sum of the source words
+
+    .text
+    .globl _start
+_start:
+    # Source buffer: LCG sequence
+    la      a0, src
+    li      t1, WORDS
+    li      s1, 1
+    li      s2, LCG_MUL
+    li      s3, LCG_ADD
+1:
+    LCG     s1, s2, s3
+    sw      s1, 0(a0)
+    addi    a0, a0, 4
+    addi    t1, t1, -1
+    bnez    t1, 1b
+
+    li      s4, ROUNDS
+2:
+    la      a0, src
+    la      a1, dst
+    li      t1, WORDS / 4
+3:
+    lw      t2, 0(a0)
+    lw      t3, 4(a0)
+    lw      t4, 8(a0)
+    lw      t5, 12(a0)
+    sw      t2, 0(a1)
+    sw      t3, 4(a1)
+    sw      t4, 8(a1)
+    sw      t5, 12(a1)
+    addi    a0, a0, 16
+    addi    a1, a1, 16
+    addi    t1, t1, -1
+    bnez    t1, 3b
+
+    addi    s4, s4, -1
+    bnez    s4, 2b
+
+    # Destination checksum
+    la      a1, dst
+    li      t1, WORDS
+    li      s0, 0
+4:
+    lw      t2, 0(a1)
+    ADD32   s0, s0, t2
+    addi    a1, a1, 4
+    addi    t1, t1, -1
+    bnez    t1, 4b
+
+    li      t0, EXPECT
+    bne     s0, t0, fail
+    PASS
+fail:
+    FAIL
+
+    .bss
+    .balign 16
+src:
+    .space  WORDS * 4
+dst:
+    .space  WORDS * 4
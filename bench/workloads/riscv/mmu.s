@@ -0,0 +1,130 @@
+#-----------------------------------------------------------------
+# mmu: Translated loads (M-mode with MPRV, MPP = S) over 1024
+# virtual pages aliased onto 16 physical pages, so that every
+# access misses a small TLB.
+#-----------------------------------------------------------------
+    .include "bench.inc"
+
+    .equ VIRT_BASE,     0x40000000
+    .equ VIRT_PAGES,    1024
+    .equ PHYS_PAGES,    16
+    .equ ROUNDS,        1000
+    .equ EXPECT,        ROUNDS * (VIRT_PAGES / PHYS_PAGES) * (PHYS_PAGES * (PHYS_PAGES + 1) / 2)
+
+    .equ PTE_LEAF,      0xCF        # D A X W R V
+    .equ PTE_TABLE,     0x01
+
+    .text
+    .globl _start
+_start:
+    # Word 0 of physical page p = p + 1
+    la      a0, phys
+    li      t0, 0
+    li      t1, PHYS_PAGES
+    li      t3, 4096
+1:
+    addi    t2, t0, 1
+    sw      t2, 0(a0)
+    add     a0, a0, t3
+    addi    t0, t0, 1
+    blt     t0, t1, 1b
+
+    # Leaf entries: virtual page i -> physical page (i % PHYS_PAGES)
+    la      a0, leaf
+    la      a1, phys
+    li      t0, 0
+    li      t1, VIRT_PAGES
+2:
+    andi    t2, t0, PHYS_PAGES - 1
+    slli    t2, t2, 12
+    add     t2, t2, a1
+    srli    t2, t2, 12
+    slli    t2, t2, 10
+    ori     t2, t2, PTE_LEAF
+    SX      t2, 0(a0)
+    addi    a0, a0, PTESIZE
+    addi    t0, t0, 1
+    blt     t0, t1, 2b
+
+.if XLEN == 64
+    # Sv39: root[1] -> mid, mid[0..1] -> leaf (2 x 512 entries)
+    la      a0, mid
+    la      t0, leaf
+    srli    t0, t0, 12
+    slli    t0, t0, 10
+    ori     t0, t0, PTE_TABLE
+    sd      t0, 0(a0)
+    li      t1, 1 << 10
+    add     t0, t0, t1
+    sd      t0, 8(a0)
+
+    la      a1, root
+    srli    t0, a0, 12
+    slli    t0, t0, 10
+    ori     t0, t0, PTE_TABLE
+    sd      t0, ((VIRT_BASE >> 30) * 8)(a1)
+
+    srli    t0, a1, 12
+    li      t1, 8 << 60
+    or      t0, t0, t1
+.else
+    # Sv32: root[VIRT_BASE >> 22] -> leaf
+    la      a1, root
+    la      t0, leaf
+    srli    t0, t0, 12
+    slli    t0, t0, 10
+    ori     t0, t0, PTE_TABLE
+    li      t1, (VIRT_BASE >> 22) * 4
+    add     t1, t1, a1
+    sw      t0, 0(t1)
+
+    srli    t0, a1, 12
+    li      t1, 1 << 31
+    or      t0, t0, t1
+.endif
+    csrw    satp, t0
+    sfence.vma
+
+    # Data accesses translated as S-mode
+    li      t0, 3 << 11
+    csrc    mstatus, t0
+    li      t0, (1 << 17) | (1 << 11)
+    csrs    mstatus, t0
+
+    li      s0, 0
+    li      s4, ROUNDS
+    li      t3, 4096
+3:
+    li      t0, VIRT_BASE
+    li      t1, VIRT_PAGES
+4:
+    lw      t2, 0(t0)
+    add     s0, s0, t2
+    add     t0, t0, t3
+    addi    t1, t1, -1
+    bnez    t1, 4b
+
+    addi    s4, s4, -1
+    bnez    s4, 3b
+
+    li      t0, 1 << 17
+    csrc    mstatus, t0
+
+    li      t0, EXPECT
+    bne     s0, t0, fail
+    PASS
+fail:
+    FAIL
+
+    .bss
+    .balign 4096
+root:
+    .space  4096
+.if XLEN == 64
+mid:
+    .space  4096
+.endif
+leaf:
+    .space  VIRT_PAGES * PTESIZE
+phys:
+    .space  PHYS_PAGES * 4096
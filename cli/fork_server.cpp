@@ -0,0 +1,295 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "fork_server.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Max request line length
+#define FORK_REQUEST_MAX    4096
+
+// Max instructions per run() call
+#define FORK_RUN_BATCH      (1 << 20)
+
+// Abort flag poll interval (ms)
+#define FORK_POLL_MS        100
+
+//-----------------------------------------------------------------
+// Locals
+//-----------------------------------------------------------------
+// Connection of the test running in this (child) process
+static int m_timeout_fd = -1;
+
+//-----------------------------------------------------------------
+// timeout_handler: Wall clock limit reached, report and kill the test
+//-----------------------------------------------------------------
+static void timeout_handler(int s)
+{
+    static const char result[] = "status=timeout\n";
+    if (write(m_timeout_fd, result, sizeof(result) - 1) < 0)
+        _exit(2);
+    _exit(1);
+}
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+fork_server::fork_server(cpu *sim, smp *harts, console *con, virtio_block *vda)
+{
+    m_sim       = sim;
+    m_harts     = harts;
+    m_num_harts = harts ? harts->get_num_harts() : 1;
+    m_console   = con;
+    m_vda       = vda;
+    m_listen_fd = -1;
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+fork_server::~fork_server()
+{
+    if (m_listen_fd >= 0)
+    {
+        close(m_listen_fd);
+        unlink(m_path.c_str());
+    }
+}
+//-----------------------------------------------------------------
+// open: Listen on a Unix domain socket
+//-----------------------------------------------------------------
+bool fork_server::open(const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf (stderr,"Error: Socket path too long %s\n", path);
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listen_fd < 0)
+        return false;
+
+    unlink(path);
+    if (bind(m_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(m_listen_fd, 64) < 0)
+    {
+        fprintf (stderr,"Error: Could not listen on %s\n", path);
+        close(m_listen_fd);
+        m_listen_fd = -1;
+        return false;
+    }
+
+    m_path = path;
+
+    // Children are not waited for
+    signal(SIGCHLD, SIG_IGN);
+    return true;
+}
+//-----------------------------------------------------------------
+// serve: Fork a child per connection
+//-----------------------------------------------------------------
+bool fork_server::serve(uint64_t &cycles, volatile bool *abort)
+{
+    if (m_listen_fd < 0)
+        return false;
+
+    printf("Fork server listening on %s\n", m_path.c_str());
+
+    // Only the calling thread survives fork()
+    if (m_harts)
+        m_harts->stop_threads();
+
+    while (!*abort)
+    {
+        struct pollfd pfd;
+        pfd.fd     = m_listen_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, FORK_POLL_MS) <= 0)
+            continue;
+
+        int fd = accept(m_listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        // Buffered output would be written again by the child
+        fflush(NULL);
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(m_listen_fd);
+            m_listen_fd = -1;
+            _exit(run_test(fd, cycles));
+        }
+        else if (pid < 0)
+            fprintf (stderr,"Error: fork failed\n");
+
+        close(fd);
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------
+// run: Run all harts (as the main loop)
+//-----------------------------------------------------------------
+int fork_server::run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc)
+{
+    uint64_t end = (max_steps > ~0ULL - cycles) ? ~0ULL : cycles + max_steps;
+    int status   = cpu::RUN_BUDGET;
+
+    while (cycles < end)
+    {
+        uint64_t steps = (end - cycles) < FORK_RUN_BATCH ? (end - cycles) : FORK_RUN_BATCH;
+        status = m_harts ? m_harts->run(cycles, steps, stop_pc) : m_sim->run(cycles, steps, stop_pc);
+
+        if (status == cpu::RUN_FAULT || status == cpu::RUN_STOPPED || status == cpu::RUN_STOP_PC)
+            break;
+
+        // Breakpoints / device events are not a reason to stop
+        status = cpu::RUN_BUDGET;
+        m_sim->get_break();
+    }
+
+    return status;
+}
+//-----------------------------------------------------------------
+// run_test: Run one test request (child process), returns the exit code
+//-----------------------------------------------------------------
+int fork_server::run_test(int fd, uint64_t &cycles)
+{
+    // Also covers a client which never sends the request
+    m_timeout_fd = fd;
+    signal(SIGALRM, timeout_handler);
+    alarm(FORK_TIMEOUT_DEFAULT);
+
+    // Request line
+    char request[FORK_REQUEST_MAX];
+    int  len = 0;
+    while (len < (FORK_REQUEST_MAX - 1))
+    {
+        int res = read(fd, &request[len], 1);
+        if (res <= 0 || request[len] == '\n')
+            break;
+        len++;
+    }
+    request[len] = 0;
+
+    uint64_t    max_steps = FORK_CYCLES_DEFAULT;
+    unsigned    timeout   = FORK_TIMEOUT_DEFAULT;
+    uint64_t    stop_pc   = cpu::RUN_NO_STOP_PC;
+    const char *input     = NULL;
+    const char *log       = "/dev/null";
+    const char *overlay   = NULL;
+    std::string error;
+
+    char *save = NULL;
+    for (char *tok = strtok_r(request, " \t\r", &save); tok; tok = strtok_r(NULL, " \t\r", &save))
+    {
+        char *value = strchr(tok, '=');
+        if (!value)
+        {
+            error = std::string("Expected KEY=VALUE (") + tok + ")";
+            break;
+        }
+        *value++ = 0;
+
+        if (!strcmp(tok, "cycles"))
+            max_steps = strtoull(value, NULL, 0);
+        else if (!strcmp(tok, "timeout"))
+            timeout = strtoul(value, NULL, 0);
+        else if (!strcmp(tok, "stop-pc"))
+            stop_pc = strtoull(value, NULL, 0);
+        else if (!strcmp(tok, "input"))
+            input = value;
+        else if (!strcmp(tok, "log"))
+            log = value;
+        else if (!strcmp(tok, "vda"))
+            overlay = value;
+        else
+        {
+            error = std::string("Unknown key ") + tok;
+            break;
+        }
+    }
+
+    if (error.empty() && (!max_steps || !timeout))
+        error = "cycles and timeout must be non-zero";
+
+    // Console capture
+    int in_fd  = -1;
+    int out_fd = -1;
+    if (error.empty() && input && (in_fd = ::open(input, O_RDONLY)) < 0)
+        error = std::string("Could not open ") + input;
+    if (error.empty() && (out_fd = ::open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        error = std::string("Could not open ") + log;
+    if (m_console)
+        m_console->redirect(in_fd, out_fd);
+
+    // Private disk (the image is shared with the other tests)
+    if (error.empty() && m_vda && !m_vda->open_overlay(overlay))
+        error = std::string("Could not open overlay ") + (overlay ? overlay : "");
+
+    char result[FORK_REQUEST_MAX];
+    if (!error.empty())
+        snprintf(result, sizeof(result), "status=error message=\"%s\"\n", error.c_str());
+    else
+    {
+        for (int h=0;h<m_num_harts;h++)
+            get_hart(h)->enable_host_exit(false);
+
+        // A hung test (e.g. waiting for input) is killed
+        alarm(timeout);
+
+        uint64_t start  = cycles;
+        int      status = run(cycles, max_steps, stop_pc);
+
+        alarm(0);
+
+        const char *status_name = "budget";
+        int         exit_code   = 0;
+
+        for (int h=0;h<m_num_harts;h++)
+            if (get_hart(h)->get_fault())
+                status = cpu::RUN_FAULT;
+
+        if (status == cpu::RUN_FAULT)
+            status_name = "fault";
+        else if (status == cpu::RUN_STOPPED)
+        {
+            status_name = "stopped";
+            for (int h=0;h<m_num_harts && !exit_code;h++)
+                exit_code = get_hart(h)->get_exit_code();
+        }
+        else if (status == cpu::RUN_STOP_PC)
+            status_name = "stop_pc";
+
+        snprintf(result, sizeof(result), "status=%s exit_code=%d cycles=%llu\n",
+                 status_name, exit_code, (unsigned long long)(cycles - start));
+    }
+
+    if (write(fd, result, strlen(result)) < 0)
+        fprintf (stderr,"Error: Could not send result\n");
+    close(fd);
+
+    return error.empty() ? 0 : 1;
+}
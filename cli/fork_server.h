@@ -0,0 +1,68 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __FORK_SERVER_H__
+#define __FORK_SERVER_H__
+
+#include <stdint.h>
+#include <string>
+#include "cpu.h"
+#include "console.h"
+#include "virtio_block.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Per test limits (unless set by the request)
+#define FORK_CYCLES_DEFAULT     10000000000ULL
+#define FORK_TIMEOUT_DEFAULT    600
+
+//-----------------------------------------------------------------
+// fork_server: Run tests from an initialised (e.g. booted) system.
+//-----------------------------------------------------------------
+// Listens on a Unix domain socket. Each connection is handled by a
+// fork() of the simulator, so tests start from the same state and
+// share guest RAM copy-on-write. A connection sends one line of
+// whitespace separated KEY=VALUE pairs:
+//   cycles=NUM    Max instructions to execute (default: FORK_CYCLES_DEFAULT)
+//   timeout=SECS  Wall clock limit, the test is killed after this
+//                 (default: FORK_TIMEOUT_DEFAULT)
+//   stop-pc=PC    Stop at PC address
+//   input=FILE    Console input
+//   log=FILE      Console output (default: discarded)
+//   vda=FILE      VirtIO disk overlay (default: temporary file)
+// and receives one line with the result:
+//   status=stopped|stop_pc|budget|fault exit_code=NUM cycles=NUM
+// or status=timeout / status=error message="...".
+class fork_server
+{
+public:
+    fork_server(cpu *sim, smp *harts, console *con, virtio_block *vda);
+   ~fork_server();
+
+    bool open(const char *path);
+
+    // Accept connections until abort is set (parent process)
+    bool serve(uint64_t &cycles, volatile bool *abort);
+
+protected:
+    int  run_test(int fd, uint64_t &cycles);
+    int  run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc);
+    cpu *get_hart(int h) { return m_harts ? m_harts->get_hart(h) : m_sim; }
+
+protected:
+    cpu          *m_sim;
+    smp          *m_harts;
+    int           m_num_harts;
+    console      *m_console;
+    virtio_block *m_vda;
+
+    int           m_listen_fd;
+    std::string   m_path;
+};
+
+#endif
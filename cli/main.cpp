@@ -16,6 +16,12 @@
 #include "console.h"
 #include "elf_load.h"
 #include "bin_load.h"
+#include "sim_dump.h"
+#include "bbv.h"
+#include "profiler.h"
+#include "callgrind.h"
+#include "host_stats.h"
+#include "riscv_tlb.h"
 
 #include "platform_basic.h"
 #include "platform_virt.h"
@@ -29,7 +35,10 @@ static volatile bool m_user_abort = false;
 //-----------------------------------------------------------------
 // Command line options
 //-----------------------------------------------------------------
-#define GETOPTS_ARGS "m:t:v:f:c:r:b:s:e:ED:P:p:j:k:V:T:h"
+#define GETOPTS_ARGS "m:t:v:f:c:r:b:s:e:ED:P:p:j:k:V:T:J:d:L:n:B:I:F:N:G:o:z:H:h"
+
+// Max instructions per run() call (user abort is polled in between)
+#define RUN_BATCH_MAX       (1 << 20)
 
 static struct option long_options[] =
 {
@@ -52,6 +61,18 @@ static struct option long_options[] =
     {"elf-phys",   no_argument,       0, 'E'},
     {"vda",        required_argument, 0, 'V'},
     {"tap",        required_argument, 0, 'T'},
+    {"jit",        required_argument, 0, 'J'},
+    {"timebase",   required_argument, 0, 'd'},
+    {"tlb",        required_argument, 0, 'L'},
+    {"harts",      required_argument, 0, 'n'},
+    {"bbv",        required_argument, 0, 'B'},
+    {"bbv-interval", required_argument, 0, 'I'},
+    {"profile",    required_argument, 0, 'F'},
+    {"profile-interval", required_argument, 0, 'N'},
+    {"callgrind",  required_argument, 0, 'G'},
+    {"trace-file", required_argument, 0, 'o'},
+    {"trace-codec", required_argument, 0, 'z'},
+    {"host-stats", required_argument, 0, 'H'},
     {"help",       no_argument,       0, 'h'},
     {0, 0, 0, 0}
 };
@@ -68,6 +89,9 @@ static void help_options(void)
     fprintf (stderr,"  --cycles     | -c NUM        Max instructions to execute\n");
     fprintf (stderr,"  --stop-pc    | -r PC         Stop at PC address\n");
     fprintf (stderr,"  --trace-pc   | -e PC         Trace from PC address\n");
+    fprintf (stderr,"  --trace-file | -o FILE       Write a binary instruction trace of hart 0 (RISC-V, see exactstep-trace)\n");
+    fprintf (stderr,"  --trace-codec | -z NAME      Trace file compression (lz, zlib or none, default lz)\n");
+    fprintf (stderr,"  --host-stats | -H FILE       Write simulator host performance stats (JSON, every %ds, needs HAS_HOST_STATS=True)\n", HOST_STATS_INTERVAL_DEFAULT);
     fprintf (stderr,"  --elf-phys   | -E            Load to ELF section to physical addresses (suitable for bootloaders)\n");
     fprintf (stderr,"  --mem-base   | -b VAL        Memory base address (for binary loads)\n");
     fprintf (stderr,"  --mem-size   | -s VAL        Memory size (for binary loads)\n");
@@ -78,6 +102,15 @@ static void help_options(void)
     fprintf (stderr,"  --dump-reg-s | -S NUM        Number of register file entries to dump\n");
     fprintf (stderr,"  --vda        | -V FILE       Disk image for VirtIO block device (/dev/vda)\n");
     fprintf (stderr,"  --tap        | -T TAP        Tap device for VirtIO net device\n");
+    fprintf (stderr,"  --jit        | -J 0/1/2      Dynamic translation (1 = on, 2 = lockstep check against interpreter)\n");
+    fprintf (stderr,"  --timebase   | -d NUM        CPU cycles per timer (mtime) tick (default 1)\n");
+    fprintf (stderr,"  --tlb        | -L NUM[:WAYS] Entries (and ways) of each of the ITLB / DTLB (RISC-V, default %d:%d)\n", RISCV_TLB_ENTRIES, RISCV_TLB_WAYS);
+    fprintf (stderr,"  --harts      | -n NUM        Number of harts (virt platform, default 1)\n");
+    fprintf (stderr,"  --bbv        | -B FILE       Write basic block vectors (SimPoint format) of hart 0\n");
+    fprintf (stderr,"  --bbv-interval | -I NUM      Cycles per basic block vector (default %d)\n", BBV_INTERVAL_DEFAULT);
+    fprintf (stderr,"  --profile    | -F FILE       Write a PC sampling profile of hart 0 (and FILE.folded call stacks)\n");
+    fprintf (stderr,"  --profile-interval | -N NUM  Instructions per profile sample (default %d)\n", PROFILE_INTERVAL_DEFAULT);
+    fprintf (stderr,"  --callgrind  | -G FILE       Write a call graph profile (callgrind format, FILE.N for hart N > 0)\n");
     exit(-1);
 }
 //-----------------------------------------------------------------
@@ -93,140 +126,6 @@ static void sigint_handler(int s)
     m_user_abort = true;
 }
 //-----------------------------------------------------------------
-// create_dump_file: Create memory dump file
-//-----------------------------------------------------------------
-static bool create_dump_file(cpu *sim, const char *dump_file, uint32_t dump_start, uint32_t dump_end)
-{
-    int  dump_size  = dump_end - dump_start;
-
-    // Nothing to do...
-    if (dump_size <= 0 || !dump_file)
-        return false;
-
-    const char *ext = strrchr(dump_file, '.');
-    bool sig_txt_file = ext && !strcmp(ext, ".output");
-
-    printf("Dumping post simulation memory: 0x%08x-0x%08x (%d bytes) [%s]\n", dump_start, dump_end, dump_size, dump_file);
-
-    uint8_t *buffer = new uint8_t[dump_size];
-    for (uint32_t i=0;i<dump_size;i++)
-        buffer[i] = sim->read(dump_start + i);
-
-    // Binary block
-    if (!sig_txt_file)
-    {
-        // Write file data
-        FILE *f = fopen(dump_file, "wb");
-        if (f)
-        {
-            fwrite(buffer, 1, dump_size, f);
-            fclose(f);
-        }
-    }
-    // Signature text file
-    else
-    {
-        // Write file data
-        FILE *f = fopen(dump_file, "w");
-        if (f)
-        {
-            uint32_t *w = (uint32_t*)buffer;
-            for (int r=0;r<(dump_size/4);r++)
-                fprintf(f, "%08x\n", *w++);
-            fclose(f);
-        }
-    }
-
-    delete buffer;
-    buffer = NULL;
-    return true;
-}
-//-----------------------------------------------------------------
-// create_dump_regfile: Dump register file contents
-//-----------------------------------------------------------------
-static bool create_dump_regfile(cpu *sim, const char *dump_file, uint32_t dump_num)
-{
-    // Nothing to do...
-    if (dump_num == 0 || !dump_file)
-        return false;
-
-    const char *ext = strrchr(dump_file, '.');
-    bool sig_txt_file = ext && !strcmp(ext, ".txt");
-
-    printf("Dumping post simulation registers: %s\n", dump_file);
-
-    // 64-bit
-    if (sim->get_reg_width() == 64)
-    {
-        uint64_t *buffer = new uint64_t[dump_num];
-        for (uint32_t i=0;i<dump_num;i++)
-            buffer[i] = sim->get_register(i);
-
-        // Binary block
-        if (!sig_txt_file)
-        {
-            // Write file data
-            FILE *f = fopen(dump_file, "wb");
-            if (f)
-            {
-                fwrite(buffer, sizeof(buffer[0]), dump_num, f);
-                fclose(f);
-            }
-        }
-        // Text file
-        else
-        {
-            // Write file data
-            FILE *f = fopen(dump_file, "w");
-            if (f)
-            {
-                for (uint32_t i=0;i<dump_num;i++)
-                    fprintf(f, "%16llx\n", buffer[i]);
-                fclose(f);
-            }
-        }
-
-        delete[] buffer;
-        buffer = NULL;
-    }
-    // 32-bit
-    else
-    {
-        uint32_t *buffer = new uint32_t[dump_num];
-        for (uint32_t i=0;i<dump_num;i++)
-            buffer[i] = sim->get_register(i);
-
-        // Binary block
-        if (!sig_txt_file)
-        {
-            // Write file data
-            FILE *f = fopen(dump_file, "wb");
-            if (f)
-            {
-                fwrite(buffer, sizeof(buffer[0]), dump_num, f);
-                fclose(f);
-            }
-        }
-        // Text file
-        else
-        {
-            // Write file data
-            FILE *f = fopen(dump_file, "w");
-            if (f)
-            {
-                for (uint32_t i=0;i<dump_num;i++)
-                    fprintf(f, "%08x\n", buffer[i]);
-                fclose(f);
-            }
-        }
-
-        delete[] buffer;
-        buffer = NULL;
-    }
-
-    return true;
-}
-//-----------------------------------------------------------------
 // main
 //-----------------------------------------------------------------
 int main(int argc, char *argv[])
@@ -256,6 +155,19 @@ int main(int argc, char *argv[])
     bool           load_phys      = false;
     const char *   vda_file       = NULL;
     const char *   tap_device     = NULL;
+    int            jit_mode       = cpu::JIT_OFF;
+    uint32_t       timebase_div   = 1;
+    int            tlb_entries    = 0;
+    int            tlb_ways       = RISCV_TLB_WAYS;
+    int            num_harts      = 1;
+    const char *   bbv_file       = NULL;
+    uint64_t       bbv_interval   = BBV_INTERVAL_DEFAULT;
+    const char *   profile_file   = NULL;
+    uint64_t       profile_interval = PROFILE_INTERVAL_DEFAULT;
+    const char *   callgrind_file = NULL;
+    const char *   trace_file     = NULL;
+    int            trace_codec    = TRACE_CODEC_LZ;
+    const char *   host_stats_file = NULL;
     int c;
 
     int option_index = 0;
@@ -331,6 +243,54 @@ int main(int argc, char *argv[])
             case 'T':
                 tap_device = optarg;
                 break;
+            case 'J':
+                jit_mode = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                timebase_div = strtoul(optarg, NULL, 0);
+                break;
+            case 'L':
+            {
+                char *end = NULL;
+                tlb_entries = strtoul(optarg, &end, 0);
+                if (end && *end == ':')
+                    tlb_ways = strtoul(end + 1, NULL, 0);
+                break;
+            }
+            case 'n':
+                num_harts = strtoul(optarg, NULL, 0);
+                break;
+            case 'B':
+                bbv_file = optarg;
+                break;
+            case 'I':
+                bbv_interval = strtoull(optarg, NULL, 0);
+                break;
+            case 'F':
+                profile_file = optarg;
+                break;
+            case 'N':
+                profile_interval = strtoull(optarg, NULL, 0);
+                break;
+            case 'G':
+                callgrind_file = optarg;
+                break;
+            case 'o':
+                trace_file = optarg;
+                break;
+            case 'z':
+                if (!strcmp(optarg, "lz"))
+                    trace_codec = TRACE_CODEC_LZ;
+                else if (!strcmp(optarg, "zlib"))
+                    trace_codec = TRACE_CODEC_ZLIB;
+                else if (!strcmp(optarg, "none"))
+                    trace_codec = TRACE_CODEC_NONE;
+                else
+                    help = 1;
+                break;
+            case 'H':
+                host_stats_file = optarg;
+                break;
             case '?':
             default:
                 help = 1;   
@@ -341,6 +301,10 @@ int main(int argc, char *argv[])
     if (help || (filename == NULL))
         help_options();
 
+    // Host performance stats (before anything is loaded)
+    if (host_stats_file && !host_stats::open(host_stats_file, HOST_STATS_INTERVAL_DEFAULT))
+        return -1;
+
     console_io *con = new console();
 
     if (!march)
@@ -359,7 +323,7 @@ int main(int argc, char *argv[])
     else if (!strcmp(platform_name, "basic"))
         plat = new platform_basic(march, 0x20000000, 0x00010000, con, &cycles, 100000000);
     else if (!strcmp(platform_name, "virt"))
-        plat = new platform_virt(march, 0x80000000, (64 << 20), con, &cycles, 100000000);
+        plat = new platform_virt(march, 0x80000000, (64 << 20), con, &cycles, 100000000, num_harts);
     else
     {
         fprintf (stderr,"Error: Unsupported platform\n");
@@ -371,6 +335,16 @@ int main(int argc, char *argv[])
     if (!sim)
         return -1;
     sim->set_console(con);
+    sim->set_timebase_div(timebase_div);
+
+    // Secondary harts
+    smp *harts = plat->get_smp();
+    num_harts  = harts ? harts->get_num_harts() : 1;
+    for (int h=1;h<num_harts;h++)
+    {
+        harts->get_hart(h)->set_console(con);
+        harts->get_hart(h)->set_timebase_div(timebase_div);
+    }
 
     if (explicit_mem)
     {
@@ -453,30 +427,208 @@ int main(int argc, char *argv[])
 
     // Reset CPU to given start PC
     printf("Starting from 0x%08x\n", start_addr);
-    sim->reset(start_addr);
+    for (int h=0;h<num_harts;h++)
+    {
+        cpu *hart = harts ? harts->get_hart(h) : sim;
+        hart->reset(start_addr);
+
+        // Enable trace?
+        if (trace)
+            hart->enable_trace(trace_mask);
 
-    // Enable trace?
-    if (trace)
-        sim->enable_trace(trace_mask);
+        // Dynamic translation
+        if (jit_mode != cpu::JIT_OFF && !hart->enable_jit(jit_mode) && h == 0)
+            fprintf (stderr,"Warning: Dynamic translation not supported for this CPU / host\n");
+
+        // TLB geometry
+        if (tlb_entries && !hart->set_tlb_size(tlb_entries, tlb_ways) && h == 0)
+            fprintf (stderr,"Warning: TLB size %d:%d not supported for this CPU\n", tlb_entries, tlb_ways);
+    }
 
     // Catch SIGINT to restore terminal settings on exit
     signal(SIGINT, sigint_handler);
 
-    uint32_t current_pc = 0;
-    while (!sim->get_fault() && !sim->get_stopped() && current_pc != stop_pc && !m_user_abort)
+    // Basic block vectors (one per interval)
+    bbv      bb;
+    uint64_t bbv_next = bbv_interval;
+    if (bbv_file)
     {
-        current_pc = sim->get_pc();
-        sim->step(cycles);
-        cycles++;
+        if (!sim->set_monitor(&bb))
+        {
+            fprintf (stderr,"Error: --bbv not supported for this CPU\n");
+            return -1;
+        }
+        if (!bbv_interval || !bb.open(bbv_file))
+        {
+            fprintf (stderr,"Error: Could not create %s\n", bbv_file);
+            return -1;
+        }
+    }
+
+    // PC sampling profile (the monitor tracks the call stack)
+    profiler prof;
+    uint64_t prof_next = profile_interval;
+    if (profile_file)
+    {
+        if (bbv_file || !profile_interval)
+        {
+            fprintf (stderr,"Error: %s\n", bbv_file ? "--profile cannot be combined with --bbv" : "Invalid profile interval");
+            return -1;
+        }
+        if (!sim->set_monitor(&prof))
+        {
+            fprintf (stderr,"Error: --profile not supported for this CPU\n");
+            return -1;
+        }
+    }
+
+    // Call graph profile (per hart)
+    std::vector<callgrind> call_graphs;
+    if (callgrind_file)
+    {
+        if (bbv_file || profile_file)
+        {
+            fprintf (stderr,"Error: --callgrind cannot be combined with --bbv / --profile\n");
+            return -1;
+        }
+
+        call_graphs.resize(num_harts);
+        for (int h=0;h<num_harts;h++)
+        {
+            if (!(harts ? harts->get_hart(h) : sim)->set_monitor(&call_graphs[h]))
+            {
+                fprintf (stderr,"Error: --callgrind not supported for this CPU\n");
+                return -1;
+            }
+        }
+    }
+
+    // Binary instruction trace (from the trace PC, if set)
+    trace_writer trace_out;
+    if (trace_file)
+    {
+        if (!trace_out.open(trace_file, sim->get_reg_width() == 64 ? TRACE_FILE_RV64 : 0, trace_codec))
+            return -1;
+
+        if (trace_pc == 0xFFFFFFFF && !sim->enable_trace_file(&trace_out))
+        {
+            fprintf (stderr,"Error: --trace-file not supported for this CPU\n");
+            return -1;
+        }
+    }
+
+    // Trace is enabled once the instruction at the trace PC has executed
+    // (run() stops there first, then at the stop PC)
+    bool     trace_wait  = (trace_pc != 0xFFFFFFFF);
+    uint64_t run_stop_pc = (stop_pc != 0xFFFFFFFF) ? stop_pc : cpu::RUN_NO_STOP_PC;
+    while (!m_user_abort)
+    {
+        uint64_t budget = (uint64_t)max_cycles - cycles;
+        uint64_t steps  = budget < RUN_BATCH_MAX ? budget : RUN_BATCH_MAX;
+
+        // Stop at the end of the interval
+        if (bbv_file && (bbv_next - cycles) < steps)
+            steps = bbv_next - cycles;
+        if (profile_file && (prof_next - cycles) < steps)
+            steps = prof_next - cycles;
+
+        uint64_t run_pc = trace_wait ? trace_pc : run_stop_pc;
+        int status = harts ? harts->run(cycles, steps, run_pc) : sim->run(cycles, steps, run_pc);
+
+        host_stats::poll(cycles);
 
-        if (max_cycles == cycles) break;
+        if (bbv_file && cycles >= bbv_next)
+        {
+            bb.end_interval();
+            bbv_next += bbv_interval;
+        }
+
+        if (profile_file && cycles >= prof_next)
+        {
+            prof.sample(sim->get_pc64());
+            prof_next = cycles + profile_interval;
+        }
 
         // Turn trace on
-        if (trace_pc == current_pc)
-            sim->enable_trace(trace_mask);
+        if (status == cpu::RUN_STOP_PC && trace_wait)
+        {
+            trace_wait = false;
+            if (trace || !trace_file)
+                sim->enable_trace(trace_mask);
+            if (trace_file && !sim->enable_trace_file(&trace_out))
+                fprintf (stderr,"Error: --trace-file not supported for this CPU\n");
+            if (trace_pc != stop_pc)
+                status = cpu::RUN_BUDGET;
+        }
+
+        if (status == cpu::RUN_FAULT || status == cpu::RUN_STOPPED || status == cpu::RUN_STOP_PC)
+            break;
+
+        if (max_cycles == cycles)
+            break;
+    }
+
+    host_stats::close(cycles);
+
+    if (bbv_file)
+    {
+        sim->set_monitor(NULL);
+        bb.close();
+        printf("BBV: %llu intervals of %llu cycles written to %s\n",
+               (unsigned long long)bb.get_intervals(), (unsigned long long)bbv_interval, bbv_file);
+    }
+
+    if (profile_file)
+    {
+        sim->set_monitor(NULL);
+
+        // Symbols from the ELF (binaries are profiled by address)
+        elf_load symbols(filename, NULL);
+        if (!prof.write(profile_file, is_bin ? NULL : &symbols))
+        {
+            fprintf (stderr,"Error: Could not create %s\n", profile_file);
+            return -1;
+        }
+        printf("Profile: %llu samples written to %s\n", (unsigned long long)prof.get_samples(), profile_file);
+    }
+
+    if (callgrind_file)
+    {
+        elf_load symbols(filename, NULL);
+        for (int h=0;h<num_harts;h++)
+        {
+            (harts ? harts->get_hart(h) : sim)->set_monitor(NULL);
+
+            std::string out = callgrind_file;
+            if (h)
+            {
+                char suffix[16];
+                sprintf(suffix, ".%d", h);
+                out += suffix;
+            }
+
+            if (!call_graphs[h].write(out.c_str(), is_bin ? NULL : &symbols, filename))
+            {
+                fprintf (stderr,"Error: Could not create %s\n", out.c_str());
+                return -1;
+            }
+            printf("Callgrind: %llu instructions written to %s\n", (unsigned long long)call_graphs[h].get_instructions(), out.c_str());
+        }
+    }
+
+    if (trace_file)
+    {
+        sim->enable_trace_file(NULL);
+        if (!trace_out.close())
+            return -1;
+        printf("Trace: %llu bytes of records written to %s\n", (unsigned long long)trace_out.get_raw_size(), trace_file);
     }
 
     // Fault occurred?
+    for (int h=1;h<num_harts;h++)
+        if (harts->get_hart(h)->get_fault())
+            return 1;
+
     if (sim->get_fault())
         return 1;
     else
@@ -487,7 +639,12 @@ int main(int argc, char *argv[])
         if (dump_reg_file)
             create_dump_regfile(sim, dump_reg_file, dump_reg_num);
 
-        sim->stats_dump();
+        for (int h=0;h<num_harts;h++)
+        {
+            if (harts)
+                printf("Hart %d:\n", h);
+            (harts ? harts->get_hart(h) : sim)->stats_dump();
+        }
         return 0;
     }
 }
@@ -0,0 +1,510 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "console_io.h"
+#include "elf_load.h"
+#include "sim_dump.h"
+
+#include "platform_basic.h"
+#include "platform_virt.h"
+
+//-----------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------
+#define GETOPTS_ARGS "l:j:s:qh"
+
+// Max instructions per run() call
+#define RUN_BATCH_MAX       (1 << 20)
+
+// Max manifest line length
+#define MANIFEST_LINE_MAX   4096
+
+static struct option long_options[] =
+{
+    {"manifest",   required_argument, 0, 'l'},
+    {"jobs",       required_argument, 0, 'j'},
+    {"summary",    required_argument, 0, 's'},
+    {"quiet",      no_argument,       0, 'q'},
+    {"help",       no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+};
+
+static void help_options(void)
+{
+    fprintf (stderr,"Usage:\n");
+    fprintf (stderr,"  --manifest   | -l FILE       Job list (one job per line)\n");
+    fprintf (stderr,"  --jobs       | -j NUM        Worker threads (default: number of host cores)\n");
+    fprintf (stderr,"  --summary    | -s FILE       JSON summary file (default: stdout)\n");
+    fprintf (stderr,"  --quiet      | -q            Discard simulator messages\n");
+    fprintf (stderr,"\n");
+    fprintf (stderr,"Manifest lines are whitespace separated KEY=VALUE pairs ('#' starts a comment):\n");
+    fprintf (stderr,"  elf=FILE          File to load (ELF, required)\n");
+    fprintf (stderr,"  name=NAME         Job name in the summary (default: ELF filename)\n");
+    fprintf (stderr,"  march=MISA        Machine variant (default RV32IMAC)\n");
+    fprintf (stderr,"  platform=NAME     Platform to simulate (basic|virt)\n");
+    fprintf (stderr,"  cycles=NUM        Max instructions to execute\n");
+    fprintf (stderr,"  budget-ok=1/0     Running out of cycles is a pass (default: fail)\n");
+    fprintf (stderr,"  stop-pc=SYM/A     Stop at PC address\n");
+    fprintf (stderr,"  elf-phys=1/0      Load to ELF section to physical addresses\n");
+    fprintf (stderr,"  mem-base=VAL      Extra memory base address\n");
+    fprintf (stderr,"  mem-size=VAL      Extra memory size\n");
+    fprintf (stderr,"  dump-file=FILE    File to dump memory contents to after completion\n");
+    fprintf (stderr,"  dump-start=SYM/A  Symbol name for memory dump start (or 0xADDR)\n");
+    fprintf (stderr,"  dump-end=SYM/A    Symbol name for memory dump end (or 0xADDR)\n");
+    fprintf (stderr,"  dump-reg-f=FILE   File to dump register file contents to after completion\n");
+    fprintf (stderr,"  dump-reg-s=NUM    Number of register file entries to dump\n");
+    fprintf (stderr,"  log=FILE          File to write the console output to\n");
+    exit(-1);
+}
+
+//-----------------------------------------------------------------
+// console_log: Console output captured per job
+//-----------------------------------------------------------------
+class console_log: public console_io
+{
+public:
+    int putchar(int ch) { m_text += (char)ch; return 0; }
+    int getchar(void)   { return -1; }
+
+    std::string m_text;
+};
+
+//-----------------------------------------------------------------
+// Job
+//-----------------------------------------------------------------
+typedef struct
+{
+    // Options
+    std::string name;
+    std::string elf;
+    std::string march;
+    std::string platform;
+    int64_t     max_cycles;
+    bool        budget_ok;
+    std::string stop_pc;
+    bool        load_phys;
+    bool        explicit_mem;
+    uint32_t    mem_base;
+    uint32_t    mem_size;
+    std::string dump_file;
+    std::string dump_start;
+    std::string dump_end;
+    std::string dump_reg_file;
+    uint32_t    dump_reg_num;
+    std::string log_file;
+
+    // Shared (read-only) ELF image
+    elf_load   *image;
+
+    // Result
+    std::string status;
+    int         exit_code;
+    uint64_t    cycles;
+    double      seconds;
+} t_job;
+
+//-----------------------------------------------------------------
+// parse_manifest: Read job list
+//-----------------------------------------------------------------
+static bool parse_manifest(const char *filename, std::vector<t_job> &jobs)
+{
+    FILE *f = fopen(filename, "r");
+    if (!f)
+    {
+        fprintf (stderr,"Error: Could not open %s\n", filename);
+        return false;
+    }
+
+    char line[MANIFEST_LINE_MAX];
+    int  line_num = 0;
+    bool ok       = true;
+    while (ok && fgets(line, sizeof(line), f))
+    {
+        line_num++;
+
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+
+        t_job job;
+        job.march        = "RV32IMAC";
+        job.platform     = "basic";
+        job.max_cycles   = (int64_t)-1;
+        job.budget_ok    = false;
+        job.load_phys    = false;
+        job.explicit_mem = false;
+        job.mem_base     = 0x00000000;
+        job.mem_size     = (32 * 1024 * 1024);
+        job.dump_reg_num = 32;
+        job.image        = NULL;
+        job.exit_code    = 0;
+        job.cycles       = 0;
+        job.seconds      = 0;
+
+        int   fields = 0;
+        char *save   = NULL;
+        for (char *tok = strtok_r(line, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save))
+        {
+            char *value = strchr(tok, '=');
+            if (!value)
+            {
+                fprintf (stderr,"Error: %s:%d: Expected KEY=VALUE (%s)\n", filename, line_num, tok);
+                ok = false;
+                break;
+            }
+            *value++ = 0;
+            fields++;
+
+            if (!strcmp(tok, "elf"))             job.elf           = value;
+            else if (!strcmp(tok, "name"))       job.name          = value;
+            else if (!strcmp(tok, "march"))      job.march         = value;
+            else if (!strcmp(tok, "platform"))   job.platform      = value;
+            else if (!strcmp(tok, "cycles"))     job.max_cycles    = (int64_t)strtoull(value, NULL, 0);
+            else if (!strcmp(tok, "budget-ok"))  job.budget_ok     = strtoul(value, NULL, 0) != 0;
+            else if (!strcmp(tok, "stop-pc"))    job.stop_pc       = value;
+            else if (!strcmp(tok, "elf-phys"))   job.load_phys     = strtoul(value, NULL, 0) != 0;
+            else if (!strcmp(tok, "mem-base"))   { job.mem_base = strtoul(value, NULL, 0); job.explicit_mem = true; }
+            else if (!strcmp(tok, "mem-size"))   { job.mem_size = strtoul(value, NULL, 0); job.explicit_mem = true; }
+            else if (!strcmp(tok, "dump-file"))  job.dump_file     = value;
+            else if (!strcmp(tok, "dump-start")) job.dump_start    = value;
+            else if (!strcmp(tok, "dump-end"))   job.dump_end      = value;
+            else if (!strcmp(tok, "dump-reg-f")) job.dump_reg_file = value;
+            else if (!strcmp(tok, "dump-reg-s")) job.dump_reg_num  = strtoul(value, NULL, 0);
+            else if (!strcmp(tok, "log"))        job.log_file      = value;
+            else
+            {
+                fprintf (stderr,"Error: %s:%d: Unknown key '%s'\n", filename, line_num, tok);
+                ok = false;
+                break;
+            }
+        }
+
+        // Blank line
+        if (!ok || fields == 0)
+            continue;
+
+        if (job.elf.empty())
+        {
+            fprintf (stderr,"Error: %s:%d: No elf specified\n", filename, line_num);
+            ok = false;
+            break;
+        }
+
+        if (job.name.empty())
+            job.name = job.elf;
+
+        jobs.push_back(job);
+    }
+
+    fclose(f);
+    return ok;
+}
+//-----------------------------------------------------------------
+// resolve_addr: 0xADDR or ELF symbol name
+//-----------------------------------------------------------------
+static bool resolve_addr(elf_load *image, const std::string &str, uint32_t &addr)
+{
+    if (str.empty())
+        return false;
+    if (!strncmp(str.c_str(), "0x", 2))
+    {
+        addr = strtoul(str.c_str(), NULL, 0);
+        return true;
+    }
+    return image->get_symbol(str.c_str(), addr);
+}
+//-----------------------------------------------------------------
+// run_job: Simulate a single job on this thread
+//-----------------------------------------------------------------
+static void run_job(t_job &job)
+{
+    std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+
+    console_log   con;
+    uint64_t      cycles = 0;
+    platform_cpu *plat   = NULL;
+
+    if (job.platform == "basic")
+        plat = new platform_basic(job.march.c_str(), 0x20000000, 0x00010000, &con, &cycles, 100000000);
+    else if (job.platform == "virt")
+        plat = new platform_virt(job.march.c_str(), 0x80000000, (64 << 20), &con, &cycles, 100000000);
+    else
+    {
+        job.status = "bad_platform";
+        return;
+    }
+
+    cpu *sim = plat->get_cpu();
+    if (!sim)
+    {
+        job.status = "bad_march";
+        delete plat;
+        return;
+    }
+    sim->set_console(&con);
+
+    // Target exit codes end this job, not the process
+    sim->enable_host_exit(false);
+
+    if (job.explicit_mem)
+        sim->create_memory(job.mem_base, job.mem_size);
+
+    if (!job.image->load(sim))
+    {
+        job.status = "load_error";
+        delete sim;
+        delete plat;
+        return;
+    }
+
+    // Find boot vectors
+    uint32_t start_addr = 0;
+    if (!job.image->get_symbol("vectors", start_addr))
+        start_addr = job.image->get_entry_point() & ~1;
+
+    uint32_t dump_start = 0;
+    uint32_t dump_end   = 0;
+    uint32_t stop_pc    = 0;
+    resolve_addr(job.image, job.dump_start, dump_start);
+    resolve_addr(job.image, job.dump_end, dump_end);
+
+    uint64_t run_stop_pc = resolve_addr(job.image, job.stop_pc, stop_pc) ? stop_pc : cpu::RUN_NO_STOP_PC;
+
+    sim->reset(start_addr);
+
+    int status = cpu::RUN_BUDGET;
+    while (job.max_cycles == (int64_t)-1 || cycles < (uint64_t)job.max_cycles)
+    {
+        uint64_t budget = (uint64_t)job.max_cycles - cycles;
+        status = sim->run(cycles, budget < RUN_BATCH_MAX ? budget : RUN_BATCH_MAX, run_stop_pc);
+
+        if (status == cpu::RUN_FAULT || status == cpu::RUN_STOPPED || status == cpu::RUN_STOP_PC)
+            break;
+
+        // No breakpoints are set - clear any target requested break
+        if (status == cpu::RUN_BREAK)
+            sim->get_break();
+    }
+
+    job.cycles    = cycles;
+    job.exit_code = sim->get_exit_code();
+
+    if (sim->get_fault())
+        job.status = "fault";
+    else
+    {
+        if (status == cpu::RUN_STOPPED)
+            job.status = "stopped";
+        else if (status == cpu::RUN_STOP_PC)
+            job.status = "stop_pc";
+        else
+            job.status = "budget";
+
+        // Dump memory contents after execution?
+        if (!job.dump_file.empty())
+            create_dump_file(sim, job.dump_file.c_str(), dump_start, dump_end);
+        if (!job.dump_reg_file.empty())
+            create_dump_regfile(sim, job.dump_reg_file.c_str(), job.dump_reg_num);
+    }
+
+    if (!job.log_file.empty())
+    {
+        FILE *f = fopen(job.log_file.c_str(), "w");
+        if (f)
+        {
+            fwrite(con.m_text.c_str(), 1, con.m_text.size(), f);
+            fclose(f);
+        }
+    }
+
+    delete sim;
+    delete plat;
+
+    job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+}
+//-----------------------------------------------------------------
+// run_pool: Call fn(0..count-1) from num_threads worker threads
+//-----------------------------------------------------------------
+static void run_pool(int num_threads, int count, std::function<void(int)> fn)
+{
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+
+    for (int t=0;t<num_threads && t<count;t++)
+        workers.push_back(std::thread([&]()
+        {
+            int idx;
+            while ((idx = next++) < count)
+                fn(idx);
+        }));
+
+    for (unsigned t=0;t<workers.size();t++)
+        workers[t].join();
+}
+//-----------------------------------------------------------------
+// json_string: Quote string for the JSON summary
+//-----------------------------------------------------------------
+static std::string json_string(const std::string &str)
+{
+    std::string out = "\"";
+    for (size_t i=0;i<str.size();i++)
+    {
+        char ch = str[i];
+        if (ch == '"' || ch == '\\')
+        {
+            out += '\\';
+            out += ch;
+        }
+        else if ((unsigned char)ch < 0x20)
+        {
+            char esc[8];
+            sprintf(esc, "\\u%04x", ch);
+            out += esc;
+        }
+        else
+            out += ch;
+    }
+    return out + "\"";
+}
+//-----------------------------------------------------------------
+// main
+//-----------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    const char *   manifest       = NULL;
+    const char *   summary_file   = NULL;
+    int            num_threads    = (int)std::thread::hardware_concurrency();
+    bool           quiet          = false;
+    int            help           = 0;
+    int c;
+
+    int option_index = 0;
+    while ((c = getopt_long (argc, argv, GETOPTS_ARGS, long_options, &option_index)) != -1)
+    {
+        switch(c)
+        {
+            case 'l':
+                manifest = optarg;
+                break;
+            case 'j':
+                num_threads = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                summary_file = optarg;
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || manifest == NULL)
+        help_options();
+
+    if (num_threads < 1)
+        num_threads = 1;
+
+    std::vector<t_job> jobs;
+    if (!parse_manifest(manifest, jobs))
+        return -1;
+
+    // Summary goes to stdout unless a file is specified
+    FILE *summary = summary_file ? fopen(summary_file, "w") : fdopen(dup(fileno(stdout)), "w");
+    if (!summary)
+    {
+        fprintf (stderr,"Error: Could not open %s\n", summary_file);
+        return -1;
+    }
+
+    // Simulator messages are not useful with many jobs in flight
+    if (quiet)
+        freopen("/dev/null", "w", stdout);
+
+    // Parse each ELF once (shared between jobs)
+    std::map<std::string, elf_load *> image_map;
+    std::vector<elf_load *>           images;
+    for (unsigned i=0;i<jobs.size();i++)
+    {
+        std::string key = jobs[i].elf + (jobs[i].load_phys ? ":phys" : "");
+        if (image_map.find(key) == image_map.end())
+        {
+            image_map[key] = new elf_load(jobs[i].elf.c_str(), NULL, jobs[i].load_phys);
+            images.push_back(image_map[key]);
+        }
+        jobs[i].image = image_map[key];
+    }
+
+    run_pool(num_threads, (int)images.size(), [&](int idx) { images[idx]->parse(); });
+
+    // Run jobs
+    std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+    std::mutex progress_lock;
+    std::atomic<int> done(0);
+    run_pool(num_threads, (int)jobs.size(), [&](int idx)
+    {
+        t_job &job = jobs[idx];
+        if (job.image->parse())
+            run_job(job);
+        else
+            job.status = "load_error";
+
+        std::lock_guard<std::mutex> lock(progress_lock);
+        fprintf(stderr, "[%d/%d] %s: %s (exit %d)\n", ++done, (int)jobs.size(), job.name.c_str(), job.status.c_str(), job.exit_code);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+    // Summary
+    int failed = 0;
+    fprintf(summary, "{\n");
+    fprintf(summary, "  \"threads\": %d,\n", num_threads);
+    fprintf(summary, "  \"seconds\": %.3f,\n", seconds);
+    fprintf(summary, "  \"jobs\": [\n");
+    for (unsigned i=0;i<jobs.size();i++)
+    {
+        t_job &job = jobs[i];
+        // A job still running when its cycle budget ran out did not finish,
+        // unless the manifest says that is expected (budget-ok=1)
+        bool finished = job.status == "stopped" || job.status == "stop_pc" || (job.status == "budget" && job.budget_ok);
+        bool passed   = finished && job.exit_code == 0;
+        if (!passed)
+            failed++;
+
+        fprintf(summary, "    {\"name\": %s, \"elf\": %s, \"march\": %s, \"status\": %s, \"exit_code\": %d, \"passed\": %s, \"cycles\": %llu, \"seconds\": %.3f}%s\n",
+                json_string(job.name).c_str(), json_string(job.elf).c_str(), json_string(job.march).c_str(),
+                json_string(job.status).c_str(), job.exit_code, passed ? "true" : "false",
+                (unsigned long long)job.cycles, job.seconds, (i + 1 < jobs.size()) ? "," : "");
+    }
+    fprintf(summary, "  ],\n");
+    fprintf(summary, "  \"passed\": %d,\n", (int)jobs.size() - failed);
+    fprintf(summary, "  \"failed\": %d\n", failed);
+    fprintf(summary, "}\n");
+    fclose(summary);
+
+    for (unsigned i=0;i<images.size();i++)
+        delete images[i];
+
+    return failed ? 1 : 0;
+}
@@ -12,10 +12,19 @@
 #include <unistd.h>
 #include <signal.h>
 #include <getopt.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
 
 #include "console.h"
 #include "elf_load.h"
 #include "bin_load.h"
+#include "checkpoint.h"
+#include "fork_server.h"
+#include "bbv.h"
+#include "host_stats.h"
+#include "riscv_tlb.h"
 
 #include "platform_device_tree.h"
 #include "sbi.h"
@@ -28,7 +37,10 @@ static volatile bool m_user_abort = false;
 //-----------------------------------------------------------------
 // Command line options
 //-----------------------------------------------------------------
-#define GETOPTS_ARGS "t:v:r:f:D:B:m:c:e:V:T:i:b:h"
+#define GETOPTS_ARGS "t:v:r:f:D:B:m:c:e:V:T:i:b:d:L:K:s:R:A:k:I:S:W:C:XH:h"
+
+// Max instructions per run() call (user abort is polled in between)
+#define RUN_BATCH_MAX       (1 << 20)
 
 static struct option long_options[] =
 {
@@ -45,6 +57,19 @@ static struct option long_options[] =
     {"vda",        required_argument, 0, 'V'},
     {"tap",        required_argument, 0, 'T'},
     {"initrd",     required_argument, 0, 'i'},
+    {"timebase",   required_argument, 0, 'd'},
+    {"tlb",        required_argument, 0, 'L'},
+    {"save-cycle",         required_argument, 0, 'K'},
+    {"save-checkpoint",    required_argument, 0, 's'},
+    {"restore-checkpoint", required_argument, 0, 'R'},
+    {"fork-server",        required_argument, 0, 'A'},
+    {"bbv",                required_argument, 0, 'k'},
+    {"bbv-interval",       required_argument, 0, 'I'},
+    {"simpoints",          required_argument, 0, 'S'},
+    {"simpoint-weights",   required_argument, 0, 'W'},
+    {"simpoint-ckpt",      required_argument, 0, 'C'},
+    {"simpoint-run",       no_argument,       0, 'X'},
+    {"host-stats",         required_argument, 0, 'H'},
     {"help",       no_argument,       0, 'h'},
     {0, 0, 0, 0}
 };
@@ -66,6 +91,19 @@ static void help_options(void)
     fprintf (stderr,"  --vda        | -V FILE       Disk image for VirtIO block device (/dev/vda)\n");
     fprintf (stderr,"  --tap        | -T TAP        Tap device for VirtIO net device\n");
     fprintf (stderr,"  --initrd     | -i FILE       initrd binary (optional)\n");
+    fprintf (stderr,"  --timebase   | -d NUM        CPU cycles per timer (mtime) tick (default 1)\n");
+    fprintf (stderr,"  --tlb        | -L NUM[:WAYS] Entries (and ways) of each of the ITLB / DTLB (default %d:%d)\n", RISCV_TLB_ENTRIES, RISCV_TLB_WAYS);
+    fprintf (stderr,"  --save-cycle         | -K NUM       Cycle of the following --save-checkpoint\n");
+    fprintf (stderr,"  --save-checkpoint    | -s FILE      Save state to FILE (at the --save-cycle given before it)\n");
+    fprintf (stderr,"  --restore-checkpoint | -R FILE      Resume from a saved state (same options)\n");
+    fprintf (stderr,"  --fork-server        | -A SOCKET    Once booted (--stop-pc / --cycles), fork a run per connection\n");
+    fprintf (stderr,"  --bbv                | -k FILE      Write basic block vectors (SimPoint format) of hart 0\n");
+    fprintf (stderr,"  --bbv-interval       | -I NUM       Cycles per basic block vector / SimPoint interval (default %d)\n", BBV_INTERVAL_DEFAULT);
+    fprintf (stderr,"  --simpoints          | -S FILE      SimPoint intervals (used with --simpoint-ckpt)\n");
+    fprintf (stderr,"  --simpoint-weights   | -W FILE      SimPoint weights (optional)\n");
+    fprintf (stderr,"  --simpoint-ckpt      | -C PREFIX    Save a checkpoint (PREFIX.N) at the start of each SimPoint interval N\n");
+    fprintf (stderr,"  --simpoint-run       | -X           Restore each SimPoint checkpoint instead and run its interval (stats)\n");
+    fprintf (stderr,"  --host-stats         | -H FILE      Write simulator host performance stats (JSON, every %ds, needs HAS_HOST_STATS=True)\n", HOST_STATS_INTERVAL_DEFAULT);
     exit(-1);
 }
 //-----------------------------------------------------------------
@@ -81,6 +119,145 @@ static void sigint_handler(int s)
     m_user_abort = true;
 }
 //-----------------------------------------------------------------
+// checkpoint_harts: Save / restore the state of all harts (the boot
+// hart also holds the memories and devices)
+//-----------------------------------------------------------------
+static bool checkpoint_harts(const char *filename, bool restore, cpu *sim, smp *harts)
+{
+    checkpoint cp;
+    if (restore ? !cp.open_restore(filename) : !cp.open_save(filename))
+        return false;
+
+    int num_harts = harts ? harts->get_num_harts() : 1;
+    for (int h=0;h<num_harts && cp.ok();h++)
+        (harts ? harts->get_hart(h) : sim)->serialize(cp);
+
+    return cp.close();
+}
+//-----------------------------------------------------------------
+// Checkpoint to save at a cycle
+//-----------------------------------------------------------------
+typedef struct
+{
+    uint64_t    cycle;
+    std::string filename;
+} t_save_point;
+
+static bool save_point_earlier(const t_save_point &a, const t_save_point &b)
+{
+    return a.cycle < b.cycle;
+}
+//-----------------------------------------------------------------
+// SimPoint (interval index, cluster and weight)
+//-----------------------------------------------------------------
+typedef struct
+{
+    uint64_t    interval;
+    int         cluster;
+    double      weight;
+} t_simpoint;
+
+static bool simpoint_earlier(const t_simpoint &a, const t_simpoint &b)
+{
+    return a.interval < b.interval;
+}
+//-----------------------------------------------------------------
+// load_simpoints: Read SimPoint output ('interval cluster' per line)
+// and optional weights ('weight cluster' per line)
+//-----------------------------------------------------------------
+static bool load_simpoints(const char *filename, const char *weights_file, std::vector<t_simpoint> &points)
+{
+    FILE *f = fopen(filename, "r");
+    if (!f)
+    {
+        fprintf (stderr,"Error: Could not open %s\n", filename);
+        return false;
+    }
+
+    unsigned long long interval;
+    int cluster;
+    while (fscanf(f, "%llu %d", &interval, &cluster) == 2)
+    {
+        t_simpoint p;
+        p.interval = interval;
+        p.cluster  = cluster;
+        p.weight   = 0;
+        points.push_back(p);
+    }
+    fclose(f);
+
+    if (weights_file)
+    {
+        f = fopen(weights_file, "r");
+        if (!f)
+        {
+            fprintf (stderr,"Error: Could not open %s\n", weights_file);
+            return false;
+        }
+
+        std::map<int, double> weights;
+        double weight;
+        while (fscanf(f, "%lf %d", &weight, &cluster) == 2)
+            weights[cluster] = weight;
+        fclose(f);
+
+        for (unsigned i=0;i<points.size();i++)
+            points[i].weight = weights[points[i].cluster];
+    }
+
+    std::sort(points.begin(), points.end(), simpoint_earlier);
+    return !points.empty();
+}
+//-----------------------------------------------------------------
+// simpoint_ckpt: Checkpoint filename for a SimPoint interval
+//-----------------------------------------------------------------
+static std::string simpoint_ckpt(const char *prefix, uint64_t interval)
+{
+    char suffix[32];
+    sprintf(suffix, ".%llu", (unsigned long long)interval);
+    return std::string(prefix) + suffix;
+}
+//-----------------------------------------------------------------
+// run_simpoints: Run each SimPoint interval from its checkpoint
+//-----------------------------------------------------------------
+static int run_simpoints(cpu *sim, smp *harts, uint64_t &cycles, const std::vector<t_simpoint> &points,
+                         const char *prefix, uint64_t interval)
+{
+    int num_harts = harts ? harts->get_num_harts() : 1;
+
+    for (unsigned i=0;i<points.size() && !m_user_abort;i++)
+    {
+        std::string ckpt = simpoint_ckpt(prefix, points[i].interval);
+        if (!checkpoint_harts(ckpt.c_str(), true, sim, harts))
+            return -1;
+
+        for (int h=0;h<num_harts;h++)
+            (harts ? harts->get_hart(h) : sim)->stats_reset();
+
+        uint64_t start = cycles;
+        uint64_t end   = cycles + interval;
+        while (cycles < end && !m_user_abort)
+        {
+            uint64_t steps = (end - cycles) < RUN_BATCH_MAX ? (end - cycles) : RUN_BATCH_MAX;
+            int status = harts ? harts->run(cycles, steps, cpu::RUN_NO_STOP_PC) : sim->run(cycles, steps);
+            if (status == cpu::RUN_FAULT || status == cpu::RUN_STOPPED)
+                break;
+        }
+
+        printf("SimPoint %d: interval %llu, weight %f, cycles %llu-%llu\n", points[i].cluster,
+               (unsigned long long)points[i].interval, points[i].weight,
+               (unsigned long long)start, (unsigned long long)cycles);
+        for (int h=0;h<num_harts;h++)
+        {
+            if (harts)
+                printf("Hart %d:\n", h);
+            (harts ? harts->get_hart(h) : sim)->stats_dump();
+        }
+    }
+
+    return 0;
+}
+//-----------------------------------------------------------------
 // main
 //-----------------------------------------------------------------
 int main(int argc, char *argv[])
@@ -101,6 +278,20 @@ int main(int argc, char *argv[])
     const char *   vda_file       = NULL;
     const char *   tap_device     = NULL;
     const char *   initrd_filename= NULL;
+    uint32_t       timebase_div   = 1;
+    int            tlb_entries    = 0;
+    int            tlb_ways       = RISCV_TLB_WAYS;
+    uint64_t       save_cycle     = (uint64_t)-1;
+    std::vector<t_save_point> saves;
+    const char *   restore_file   = NULL;
+    const char *   fork_socket    = NULL;
+    const char *   bbv_file       = NULL;
+    uint64_t       bbv_interval   = BBV_INTERVAL_DEFAULT;
+    const char *   simpoint_file  = NULL;
+    const char *   simpoint_wfile = NULL;
+    const char *   simpoint_prefix= NULL;
+    bool           simpoint_run   = false;
+    const char *   host_stats_file= NULL;
     int c;
 
     int option_index = 0;
@@ -149,6 +340,58 @@ int main(int argc, char *argv[])
             case 'i':
                 initrd_filename = optarg;
                 break;
+            case 'd':
+                timebase_div = strtoul(optarg, NULL, 0);
+                break;
+            case 'L':
+            {
+                char *end = NULL;
+                tlb_entries = strtoul(optarg, &end, 0);
+                if (end && *end == ':')
+                    tlb_ways = strtoul(end + 1, NULL, 0);
+                break;
+            }
+            case 'K':
+                save_cycle = strtoull(optarg, NULL, 0);
+                break;
+            case 's':
+            {
+                t_save_point save;
+                save.cycle    = save_cycle;
+                save.filename = optarg;
+                if (save_cycle != (uint64_t)-1)
+                    saves.push_back(save);
+                else
+                    help = 1;
+                break;
+            }
+            case 'R':
+                restore_file = optarg;
+                break;
+            case 'A':
+                fork_socket = optarg;
+                break;
+            case 'k':
+                bbv_file = optarg;
+                break;
+            case 'I':
+                bbv_interval = strtoull(optarg, NULL, 0);
+                break;
+            case 'S':
+                simpoint_file = optarg;
+                break;
+            case 'W':
+                simpoint_wfile = optarg;
+                break;
+            case 'C':
+                simpoint_prefix = optarg;
+                break;
+            case 'H':
+                host_stats_file = optarg;
+                break;
+            case 'X':
+                simpoint_run = true;
+                break;
             case '?':
             default:
                 help = 1;   
@@ -156,10 +399,58 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (help || (filename == NULL || device_blob == NULL))
+    if (help || (filename == NULL || device_blob == NULL) || !bbv_interval)
         help_options();
 
-    console_io *con = new console();
+    // Each test forked from the booted system would share these
+    if (fork_socket && tap_device)
+    {
+        fprintf (stderr,"Error: --fork-server can't be used with --tap\n");
+        return -1;
+    }
+    if (fork_socket && (trace || trace_pc != 0xFFFFFFFF))
+    {
+        fprintf (stderr,"Error: --fork-server can't be used with --trace / --trace-pc\n");
+        return -1;
+    }
+
+    // Checkpoints save / restore the disk writes (to an overlay), but
+    // not the host side of a tap device
+    bool checkpoints = restore_file || !saves.empty() || simpoint_prefix;
+    if (checkpoints && tap_device)
+    {
+        fprintf (stderr,"Error: Checkpoints can't be used with --tap\n");
+        return -1;
+    }
+
+    // Host performance stats (before anything is loaded)
+    if (host_stats_file && !host_stats::open(host_stats_file, HOST_STATS_INTERVAL_DEFAULT))
+        return -1;
+
+    // SimPoint intervals
+    std::vector<t_simpoint> simpoints;
+    if (simpoint_file || simpoint_prefix)
+    {
+        if (!simpoint_file || !simpoint_prefix)
+            help_options();
+        if (!load_simpoints(simpoint_file, simpoint_wfile, simpoints))
+            return -1;
+
+        // Checkpoint the start of each interval
+        if (!simpoint_run)
+        {
+            for (unsigned i=0;i<simpoints.size();i++)
+            {
+                t_save_point save;
+                save.cycle    = simpoints[i].interval * bbv_interval;
+                save.filename = simpoint_ckpt(simpoint_prefix, simpoints[i].interval);
+                saves.push_back(save);
+            }
+        }
+    }
+    std::stable_sort(saves.begin(), saves.end(), save_point_earlier);
+
+    console *con = new console();
 
     if (!march)
         march = "RV32IMAC";
@@ -171,6 +462,25 @@ int main(int argc, char *argv[])
     sim->set_cpu_frequency(100000000);
     sim->set_cycle_counter(&cycles);
     sim->set_console(con);
+    sim->set_timebase_div(timebase_div);
+    if (tlb_entries && !sim->set_tlb_size(tlb_entries, tlb_ways))
+    {
+        fprintf (stderr,"Error: Unsupported TLB size %d:%d\n", tlb_entries, tlb_ways);
+        return -1;
+    }
+
+    // Secondary harts (one per device tree 'cpu' node)
+    smp *harts     = plat->get_smp();
+    int  num_harts = harts ? harts->get_num_harts() : 1;
+    for (int h=1;h<num_harts;h++)
+    {
+        cpu *hart = harts->get_hart(h);
+        hart->set_cpu_frequency(100000000);
+        hart->set_console(con);
+        hart->set_timebase_div(timebase_div);
+        if (tlb_entries)
+            hart->set_tlb_size(tlb_entries, tlb_ways);
+    }
 
     // Get memory
     uint32_t mem_base = plat->get_mem_base();
@@ -259,19 +569,24 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    // Setup SBI
-    sim->reset(mem_base);
-    sbi::setup(sim, con, mem_base, dtb_base);
+    // Setup SBI (all harts enter the kernel, which picks a boot hart)
+    for (int h=0;h<num_harts;h++)
+    {
+        cpu *hart = harts ? harts->get_hart(h) : sim;
+        hart->reset(mem_base);
+        sbi::setup(hart, con, mem_base, dtb_base);
+    }
 
     // User specified virtio block device file
     int vda_idx = 0;
+    virtio_block *vda_blk_dev = NULL;
     if (vda_file)
     {
         virtio * vda_dev = (virtio *)sim->find_device("virtio", vda_idx++);
         if (vda_dev)
         {
-            virtio_block *vda_blk_dev = new virtio_block(vda_dev);
-            if (!vda_blk_dev->open(vda_file))
+            vda_blk_dev = new virtio_block(vda_dev);
+            if (!vda_blk_dev->open(vda_file) || (checkpoints && !vda_blk_dev->open_overlay(NULL)))
             {
                 fprintf (stderr,"Error: Could not open %s\n", vda_file);
                 return -1;
@@ -298,34 +613,132 @@ int main(int argc, char *argv[])
 
     // Enable trace?
     if (trace)
-        sim->enable_trace(trace_mask);
+        for (int h=0;h<num_harts;h++)
+            (harts ? harts->get_hart(h) : sim)->enable_trace(trace_mask);
 
     cycles = 0;
 
+    // Resume from a checkpoint (taken with the same configuration)
+    if (restore_file)
+    {
+        if (!checkpoint_harts(restore_file, true, sim, harts))
+            return -1;
+        printf("Restored checkpoint %s at cycle %llu\n", restore_file, (unsigned long long)cycles);
+    }
+
     // Catch SIGINT to restore terminal settings on exit
     signal(SIGINT, sigint_handler);
 
-    uint32_t current_pc = 0;
-    while (!sim->get_fault() && !sim->get_stopped() && current_pc != stop_pc && !m_user_abort)
+    // Detailed runs of the SimPoint intervals only
+    if (simpoint_run)
+        return run_simpoints(sim, harts, cycles, simpoints, simpoint_prefix, bbv_interval);
+
+    // Basic block vectors (one per interval)
+    bbv      bb;
+    uint64_t bbv_next = (cycles / bbv_interval + 1) * bbv_interval;
+    if (bbv_file)
     {
-        current_pc = sim->get_pc();
-        sim->step(cycles);
-        cycles++;
+        if (!sim->set_monitor(&bb))
+        {
+            fprintf (stderr,"Error: --bbv not supported for this CPU\n");
+            return -1;
+        }
+        if (!bb.open(bbv_file))
+        {
+            fprintf (stderr,"Error: Could not create %s\n", bbv_file);
+            return -1;
+        }
+    }
 
-        if (max_cycles != (int64_t)-1 && max_cycles == cycles)
-            break;
+    // A fork server without a boot point serves from the current state
+    bool boot = !(fork_socket && stop_pc == 0xFFFFFFFF && max_cycles == (int64_t)-1);
+
+    unsigned save_idx = 0;
+    while (save_idx < saves.size() && saves[save_idx].cycle < cycles)
+        save_idx++;
+
+    // Trace is enabled once the instruction at the trace PC has executed
+    // (run() stops there first, then at the stop PC)
+    bool     trace_wait  = (trace_pc != 0xFFFFFFFF);
+    uint64_t run_stop_pc = (stop_pc != 0xFFFFFFFF) ? stop_pc : cpu::RUN_NO_STOP_PC;
+    while (boot && !m_user_abort)
+    {
+        uint64_t budget = (uint64_t)max_cycles - cycles;
+        uint64_t steps  = budget < RUN_BATCH_MAX ? budget : RUN_BATCH_MAX;
+
+        // Stop exactly at the next checkpoint / interval end
+        if (save_idx < saves.size() && (saves[save_idx].cycle - cycles) < steps)
+            steps = saves[save_idx].cycle - cycles;
+        if (bbv_file && (bbv_next - cycles) < steps)
+            steps = bbv_next - cycles;
+
+        uint64_t run_pc = trace_wait ? trace_pc : run_stop_pc;
+        int status = steps ? (harts ? harts->run(cycles, steps, run_pc) : sim->run(cycles, steps, run_pc)) : cpu::RUN_BUDGET;
+
+        host_stats::poll(cycles);
+
+        if (bbv_file && cycles >= bbv_next)
+        {
+            bb.end_interval();
+            bbv_next += bbv_interval;
+        }
 
         // Turn trace on
-        if (trace_pc == current_pc)
+        if (status == cpu::RUN_STOP_PC && trace_wait)
+        {
+            trace_wait = false;
             sim->enable_trace(trace_mask);
+            if (trace_pc != stop_pc)
+                status = cpu::RUN_BUDGET;
+        }
+
+        if (status == cpu::RUN_FAULT || status == cpu::RUN_STOPPED || status == cpu::RUN_STOP_PC)
+            break;
+
+        for (;save_idx < saves.size() && cycles >= saves[save_idx].cycle;save_idx++)
+        {
+            if (!checkpoint_harts(saves[save_idx].filename.c_str(), false, sim, harts))
+                return -1;
+            printf("Saved checkpoint %s at cycle %llu\n", saves[save_idx].filename.c_str(), (unsigned long long)cycles);
+        }
+
+        // All SimPoint checkpoints taken
+        if (simpoint_prefix && save_idx == saves.size())
+            break;
+
+        if (max_cycles != (int64_t)-1 && max_cycles == cycles)
+            break;
+    }
+
+    host_stats::close(cycles);
+
+    if (bbv_file)
+    {
+        sim->set_monitor(NULL);
+        bb.close();
+        printf("BBV: %llu intervals of %llu cycles written to %s\n",
+               (unsigned long long)bb.get_intervals(), (unsigned long long)bbv_interval, bbv_file);
     }
 
     // Fault occurred?
-    if (sim->get_fault())
-        return 1;
-    else
+    for (int h=0;h<num_harts;h++)
+        if ((harts ? harts->get_hart(h) : sim)->get_fault())
+            return 1;
+
+    // Run tests from the booted state
+    if (fork_socket && !m_user_abort && !sim->get_stopped())
     {
-        sim->stats_dump();
+        fork_server server(sim, harts, con, vda_blk_dev);
+        if (!server.open(fork_socket) || !server.serve(cycles, &m_user_abort))
+            return -1;
         return 0;
     }
+
+    for (int h=0;h<num_harts;h++)
+    {
+        if (harts)
+            printf("Hart %d:\n", h);
+        (harts ? harts->get_hart(h) : sim)->stats_dump();
+    }
+    return 0;
 }
@@ -0,0 +1,171 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "trace_file.h"
+#include "riscv_decode.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Trace mask (as --trace-mask of the simulator)
+#define LOG_INST            (1 << 0)
+#define LOG_REGISTERS       (1 << 2)
+#define LOG_MEM             (1 << 3)
+
+// Decoder only: exceptions (interrupts are shown with LOG_INST)
+#define LOG_EXCEPTION       (1 << 5)
+
+//-----------------------------------------------------------------
+// Command line options
+//-----------------------------------------------------------------
+#define GETOPTS_ARGS "f:v:n:h"
+
+static struct option long_options[] =
+{
+    {"file",       required_argument, 0, 'f'},
+    {"trace-mask", required_argument, 0, 'v'},
+    {"cycles",     required_argument, 0, 'n'},
+    {"help",       no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+};
+
+static void help_options(void)
+{
+    fprintf (stderr,"Usage:\n");
+    fprintf (stderr,"  --file       | -f FILE       Binary trace file (from --trace-file)\n");
+    fprintf (stderr,"  --trace-mask | -v 0xXX       Trace mask (default: 1 = instructions)\n");
+    fprintf (stderr,"                               0x01 instructions, 0x04 registers, 0x08 memory, 0x20 exceptions\n");
+    fprintf (stderr,"  --cycles     | -n NUM        Max instructions to print\n");
+    exit(-1);
+}
+
+//-----------------------------------------------------------------
+// dump_registers: Register file after an instruction
+//-----------------------------------------------------------------
+static void dump_registers(const uint64_t *regs, bool rv64)
+{
+    for (int i=0;i<32;i+=4)
+    {
+        if (rv64)
+            printf(" %d:  %016llx %016llx %016llx %016llx\n", i,
+                   (unsigned long long)regs[i+0], (unsigned long long)regs[i+1],
+                   (unsigned long long)regs[i+2], (unsigned long long)regs[i+3]);
+        else
+            printf(" %d:  %08x %08x %08x %08x\n", i,
+                   (uint32_t)regs[i+0], (uint32_t)regs[i+1], (uint32_t)regs[i+2], (uint32_t)regs[i+3]);
+    }
+}
+
+//-----------------------------------------------------------------
+// main
+//-----------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    const char *   filename   = NULL;
+    uint32_t       trace_mask = LOG_INST;
+    uint64_t       max_insts  = ~0ULL;
+    int            c;
+    int            help       = 0;
+
+    while ((c = getopt_long (argc, argv, GETOPTS_ARGS, long_options, NULL)) != -1)
+    {
+        switch(c)
+        {
+            case 'f':
+                filename = optarg;
+                break;
+            case 'v':
+                trace_mask = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                max_insts = strtoull(optarg, NULL, 0);
+                break;
+            case '?':
+            default:
+                help = 1;
+                break;
+        }
+    }
+
+    if (help || filename == NULL)
+        help_options();
+
+    trace_reader trace;
+    if (!trace.open(filename))
+        return -1;
+
+    bool     rv64      = (trace.get_flags() & TRACE_FILE_RV64) != 0;
+    uint32_t flags     = rv64 ? RV_DECODE_RV64 : 0;
+    uint64_t interrupt = rv64 ? (1ULL << 63) : (1ULL << 31);
+    uint64_t regs[32]  = { 0 };
+    uint64_t insts     = 0;
+    bool     completed = false;
+
+    t_trace_record rec;
+    while (trace.next(&rec))
+    {
+        switch (rec.type)
+        {
+            case TRACE_INST:
+            {
+                // Registers are dumped once the previous instruction has completed
+                if (completed && (trace_mask & LOG_REGISTERS))
+                    dump_registers(regs, rv64);
+
+                if (insts++ == max_insts)
+                    return 0;
+
+                completed = true;
+
+                char text[64];
+                if ((trace_mask & LOG_INST) && riscv_disasm(rec.opcode, rec.pc, flags, text, sizeof(text)))
+                {
+                    if (rv64)
+                        printf("%016llx: %s\n", (unsigned long long)rec.pc, text);
+                    else
+                        printf("%08x: %s\n", (uint32_t)rec.pc, text);
+                }
+            }
+            break;
+            case TRACE_REG:
+                regs[rec.reg] = rec.value;
+                break;
+            case TRACE_LOAD:
+                if (trace_mask & LOG_MEM)
+                {
+                    printf("LOAD: VA 0x%08x PA 0x%08x Width %d\n", (uint32_t)rec.addr, (uint32_t)rec.phys, rec.width);
+                    printf("LOAD_RESULT: 0x%08x\n", (uint32_t)rec.value);
+                }
+                break;
+            case TRACE_STORE:
+                if (trace_mask & LOG_MEM)
+                    printf("STORE: VA 0x%08x PA 0x%08x Value 0x%08x Width %d\n", (uint32_t)rec.addr, (uint32_t)rec.phys, (uint32_t)rec.value, rec.width);
+                break;
+            case TRACE_EXCEPTION:
+                if ((rec.cause & interrupt) && (trace_mask & LOG_INST))
+                    printf("Interrupt%d taken...\n", (int)(rec.cause & ~interrupt));
+                else if (!(rec.cause & interrupt) && (trace_mask & LOG_EXCEPTION))
+                    printf("Exception%d: PC 0x%llx -> 0x%llx\n", (int)rec.cause,
+                           (unsigned long long)rec.pc, (unsigned long long)rec.target);
+                break;
+            case TRACE_ABORT:
+                // Faulting instruction (the handler is part of the same step)
+                completed = false;
+                break;
+        }
+    }
+
+    if (completed && (trace_mask & LOG_REGISTERS))
+        dump_registers(regs, rv64);
+
+    return trace.ok() ? 0 : -1;
+}
@@ -0,0 +1,147 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "sim_dump.h"
+
+//-----------------------------------------------------------------
+// create_dump_file: Create memory dump file
+//-----------------------------------------------------------------
+bool create_dump_file(cpu *sim, const char *dump_file, uint32_t dump_start, uint32_t dump_end)
+{
+    int  dump_size  = dump_end - dump_start;
+
+    // Nothing to do...
+    if (dump_size <= 0 || !dump_file)
+        return false;
+
+    const char *ext = strrchr(dump_file, '.');
+    bool sig_txt_file = ext && !strcmp(ext, ".output");
+
+    printf("Dumping post simulation memory: 0x%08x-0x%08x (%d bytes) [%s]\n", dump_start, dump_end, dump_size, dump_file);
+
+    uint8_t *buffer = new uint8_t[dump_size];
+    for (uint32_t i=0;i<dump_size;i++)
+        buffer[i] = sim->read(dump_start + i);
+
+    // Binary block
+    if (!sig_txt_file)
+    {
+        // Write file data
+        FILE *f = fopen(dump_file, "wb");
+        if (f)
+        {
+            fwrite(buffer, 1, dump_size, f);
+            fclose(f);
+        }
+    }
+    // Signature text file
+    else
+    {
+        // Write file data
+        FILE *f = fopen(dump_file, "w");
+        if (f)
+        {
+            uint32_t *w = (uint32_t*)buffer;
+            for (int r=0;r<(dump_size/4);r++)
+                fprintf(f, "%08x\n", *w++);
+            fclose(f);
+        }
+    }
+
+    delete[] buffer;
+    buffer = NULL;
+    return true;
+}
+//-----------------------------------------------------------------
+// create_dump_regfile: Dump register file contents
+//-----------------------------------------------------------------
+bool create_dump_regfile(cpu *sim, const char *dump_file, uint32_t dump_num)
+{
+    // Nothing to do...
+    if (dump_num == 0 || !dump_file)
+        return false;
+
+    const char *ext = strrchr(dump_file, '.');
+    bool sig_txt_file = ext && !strcmp(ext, ".txt");
+
+    printf("Dumping post simulation registers: %s\n", dump_file);
+
+    // 64-bit
+    if (sim->get_reg_width() == 64)
+    {
+        uint64_t *buffer = new uint64_t[dump_num];
+        for (uint32_t i=0;i<dump_num;i++)
+            buffer[i] = sim->get_register(i);
+
+        // Binary block
+        if (!sig_txt_file)
+        {
+            // Write file data
+            FILE *f = fopen(dump_file, "wb");
+            if (f)
+            {
+                fwrite(buffer, sizeof(buffer[0]), dump_num, f);
+                fclose(f);
+            }
+        }
+        // Text file
+        else
+        {
+            // Write file data
+            FILE *f = fopen(dump_file, "w");
+            if (f)
+            {
+                for (uint32_t i=0;i<dump_num;i++)
+                    fprintf(f, "%16llx\n", buffer[i]);
+                fclose(f);
+            }
+        }
+
+        delete[] buffer;
+        buffer = NULL;
+    }
+    // 32-bit
+    else
+    {
+        uint32_t *buffer = new uint32_t[dump_num];
+        for (uint32_t i=0;i<dump_num;i++)
+            buffer[i] = sim->get_register(i);
+
+        // Binary block
+        if (!sig_txt_file)
+        {
+            // Write file data
+            FILE *f = fopen(dump_file, "wb");
+            if (f)
+            {
+                fwrite(buffer, sizeof(buffer[0]), dump_num, f);
+                fclose(f);
+            }
+        }
+        // Text file
+        else
+        {
+            // Write file data
+            FILE *f = fopen(dump_file, "w");
+            if (f)
+            {
+                for (uint32_t i=0;i<dump_num;i++)
+                    fprintf(f, "%08x\n", buffer[i]);
+                fclose(f);
+            }
+        }
+
+        delete[] buffer;
+        buffer = NULL;
+    }
+
+    return true;
+}
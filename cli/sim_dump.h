@@ -0,0 +1,22 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __SIM_DUMP_H__
+#define __SIM_DUMP_H__
+
+#include <stdint.h>
+#include "cpu.h"
+
+//-----------------------------------------------------------------
+// Post simulation dumps (memory signature / register file).
+// Files ending .output (memory) or .txt (registers) are written as
+// text, otherwise binary.
+//-----------------------------------------------------------------
+bool create_dump_file(cpu *sim, const char *dump_file, uint32_t dump_start, uint32_t dump_end);
+bool create_dump_regfile(cpu *sim, const char *dump_file, uint32_t dump_num);
+
+#endif
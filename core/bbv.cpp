@@ -0,0 +1,138 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include "bbv.h"
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+bbv::bbv()
+{
+    m_file       = NULL;
+    m_intervals  = 0;
+    m_inst       = 0;
+    m_block_open = false;
+    m_block_last = false;
+    m_block_pc   = 0;
+    m_block_len  = 0;
+    m_last_pc    = 0;
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+bbv::~bbv()
+{
+    close();
+}
+//-----------------------------------------------------------------
+// open: Create output file
+//-----------------------------------------------------------------
+bool bbv::open(const char *filename)
+{
+    m_file = fopen(filename, "w");
+    return m_file != NULL;
+}
+//-----------------------------------------------------------------
+// close: Write the final (partial) interval and close the file
+//-----------------------------------------------------------------
+void bbv::close(void)
+{
+    if (!m_file)
+        return;
+
+    end_interval();
+    fclose(m_file);
+    m_file = NULL;
+}
+//-----------------------------------------------------------------
+// block_count: Add the instructions of the current block
+//-----------------------------------------------------------------
+void bbv::block_count(void)
+{
+    if (!m_block_len)
+        return;
+
+    std::unordered_map<uint64_t, uint32_t>::iterator it = m_ids.find(m_block_pc);
+    uint32_t id;
+    if (it == m_ids.end())
+    {
+        id = m_ids.size();
+        m_ids[m_block_pc] = id;
+        m_counts.push_back(0);
+    }
+    else
+        id = it->second;
+
+    if (!m_counts[id])
+        m_touched.push_back(id);
+    m_counts[id] += m_block_len;
+    m_block_len   = 0;
+}
+//-----------------------------------------------------------------
+// end_interval: Write the block counts for the current interval
+//-----------------------------------------------------------------
+void bbv::end_interval(void)
+{
+    // A block spanning intervals is counted in both
+    block_count();
+
+    if (!m_inst)
+        return;
+
+    if (m_file)
+    {
+        fprintf(m_file, "T");
+        for (unsigned i=0;i<m_touched.size();i++)
+            fprintf(m_file, ":%u:%llu ", m_touched[i] + 1, (unsigned long long)m_counts[m_touched[i]]);
+        fprintf(m_file, "\n");
+    }
+
+    for (unsigned i=0;i<m_touched.size();i++)
+        m_counts[m_touched[i]] = 0;
+    m_touched.clear();
+
+    m_inst = 0;
+    m_intervals++;
+}
+//-----------------------------------------------------------------
+// exception: Trap ends the current block
+//-----------------------------------------------------------------
+void bbv::exception(uint64_t src, uint64_t dst, uint64_t cause)
+{
+    block_count();
+    m_block_open = false;
+    m_block_last = false;
+}
+//-----------------------------------------------------------------
+// commit_pc: Instruction executed
+//-----------------------------------------------------------------
+void bbv::commit_pc(uint64_t pc)
+{
+    // Discontinuity (e.g. interrupt)
+    if (m_block_open && (pc <= m_last_pc || (pc - m_last_pc) > BBV_INST_MAX))
+    {
+        block_count();
+        m_block_open = false;
+    }
+
+    if (!m_block_open)
+    {
+        m_block_pc   = pc;
+        m_block_open = true;
+    }
+
+    m_block_len++;
+    m_last_pc = pc;
+    m_inst++;
+
+    if (m_block_last)
+    {
+        block_count();
+        m_block_open = false;
+        m_block_last = false;
+    }
+}
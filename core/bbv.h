@@ -0,0 +1,77 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __BBV_H__
+#define __BBV_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <unordered_map>
+#include "cpu_monitor.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Largest sequential PC step within a basic block (instruction size)
+#define BBV_INST_MAX        4
+
+// Default interval length (cycles)
+#define BBV_INTERVAL_DEFAULT    10000000
+
+//-----------------------------------------------------------------
+// bbv: Basic block vector profile (SimPoint .bb format)
+//-----------------------------------------------------------------
+// Counts the instructions executed in each basic block. A block ends
+// after a branch / jump or at a discontinuity in the committed PC
+// (exception, interrupt). The caller splits execution into intervals;
+// each interval is written as one line of block id / count pairs;
+//   T:<id>:<count> :<id>:<count> ...
+// with block ids numbered from 1 in order of first execution.
+class bbv: public cpu_monitor
+{
+public:
+                bbv();
+               ~bbv();
+
+    bool        open(const char *filename);
+    void        close(void);
+
+    // Write the counts since the last interval
+    void        end_interval(void);
+    uint64_t    get_intervals(void) { return m_intervals; }
+
+    // cpu_monitor
+    void        exception(uint64_t src, uint64_t dst, uint64_t cause);
+    void        branch(uint64_t src, uint64_t dst, bool taken) { m_block_last = true; }
+    void        branch_jump(uint64_t src, uint64_t dst)       { m_block_last = true; }
+    void        branch_call(uint64_t src, uint64_t dst)       { m_block_last = true; }
+    void        branch_ret(uint64_t src, uint64_t dst)        { m_block_last = true; }
+    void        commit_pc(uint64_t pc);
+
+private:
+    void        block_count(void);
+
+private:
+    FILE       *m_file;
+    uint64_t    m_intervals;
+    uint64_t    m_inst;         // Instructions in the current interval
+
+    // Current block
+    bool        m_block_open;
+    bool        m_block_last;   // Committing instruction ends the block
+    uint64_t    m_block_pc;
+    uint32_t    m_block_len;    // Instructions not yet counted
+    uint64_t    m_last_pc;
+
+    // Block id (-1) by start PC, counts for the current interval
+    std::unordered_map<uint64_t, uint32_t> m_ids;
+    std::vector<uint64_t> m_counts;
+    std::vector<uint32_t> m_touched;
+};
+
+#endif
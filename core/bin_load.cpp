@@ -12,6 +12,7 @@
 #include <string>
 
 #include "bin_load.h"
+#include "host_stats.h"
 
 //--------------------------------------------------------------------
 // Constructor
@@ -26,6 +27,8 @@ bin_load::bin_load(const char *filename, mem_api *target)
 //-----------------------------------------------------------------
 bool bin_load::load(uint32_t mem_base, uint32_t mem_size)
 {
+    HOST_STATS_TIMER(TIMER_LOAD);
+
     // Load file
     FILE *f = fopen(m_filename.c_str(), "rb");
     if (f)
@@ -50,16 +53,10 @@ bool bin_load::load(uint32_t mem_base, uint32_t mem_size)
             else
             {
                 error = 0;
-                for (int i=0;i<len;i++)
+                if (!m_target->write_block(mem_base, buf, len))
                 {
-                    if (m_target->valid_addr(mem_base + i))
-                        m_target->write(mem_base + i, buf[i]);
-                    else
-                    {
-                        fprintf (stderr,"Error: Could not load image to memory\n");
-                        error = 1;
-                        break;
-                    }
+                    fprintf (stderr,"Error: Could not load image to memory\n");
+                    error = 1;
                 }
             }
 
@@ -80,6 +77,8 @@ bool bin_load::load(uint32_t mem_base, uint32_t mem_size)
 //-----------------------------------------------------------------
 bool bin_load::load(uint32_t mem_base)
 {
+    HOST_STATS_TIMER(TIMER_LOAD);
+
     // Load file
     FILE *f = fopen(m_filename.c_str(), "rb");
     if (f)
@@ -100,16 +99,10 @@ bool bin_load::load(uint32_t mem_base)
             int len = fread(buf, 1, size, f);
 
             error = 0;
-            for (int i=0;i<len;i++)
+            if (!m_target->write_block(mem_base, buf, len))
             {
-                if (m_target->valid_addr(mem_base + i))
-                    m_target->write(mem_base + i, buf[i]);
-                else
-                {
-                    fprintf (stderr,"Error: Could not load image to memory\n");
-                    error = 1;
-                    break;
-                }
+                fprintf (stderr,"Error: Could not load image to memory\n");
+                error = 1;
             }
 
             free(buf);
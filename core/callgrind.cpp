@@ -0,0 +1,353 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include "callgrind.h"
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+callgrind::callgrind()
+{
+    m_total.ir     = 0;
+    m_total.cycles = 0;
+    m_last         = NULL;
+
+    // Top level (no trap)
+    t_context ctx;
+    ctx.epc   = 0;
+    ctx.entry = 0;
+    ctx.start = m_total;
+    m_contexts.push_back(ctx);
+}
+//-----------------------------------------------------------------
+// exception: Trap to a handler
+//-----------------------------------------------------------------
+void callgrind::exception(uint64_t src, uint64_t dst, uint64_t cause)
+{
+    push_event(EVENT_TRAP, src, dst);
+}
+//-----------------------------------------------------------------
+// branch_call: Function call
+//-----------------------------------------------------------------
+void callgrind::branch_call(uint64_t src, uint64_t dst)
+{
+    push_event(EVENT_CALL, src, dst);
+}
+//-----------------------------------------------------------------
+// branch_ret: Function return
+//-----------------------------------------------------------------
+void callgrind::branch_ret(uint64_t src, uint64_t dst)
+{
+    push_event(EVENT_RET, src, dst);
+}
+//-----------------------------------------------------------------
+// push_event: Queue an event until its instruction is committed
+//-----------------------------------------------------------------
+void callgrind::push_event(int type, uint64_t src, uint64_t dst)
+{
+    t_event ev;
+    ev.type = type;
+    ev.src  = src;
+    ev.dst  = dst;
+    m_pending.push_back(ev);
+}
+//-----------------------------------------------------------------
+// call: Add a call (and the cost since start) to a call site
+//-----------------------------------------------------------------
+void callgrind::call(t_frame &caller, uint64_t call_pc, uint64_t entry, const t_cost &start)
+{
+    t_call &c = caller.func->calls[std::make_pair(call_pc, entry)];
+    c.count++;
+    c.incl.ir     += m_total.ir - start.ir;
+    c.incl.cycles += m_total.cycles - start.cycles;
+}
+//-----------------------------------------------------------------
+// unwind: Return from frames (above depth)
+//-----------------------------------------------------------------
+void callgrind::unwind(t_context &ctx, unsigned depth)
+{
+    while (ctx.stack.size() > depth)
+    {
+        t_frame frame = ctx.stack.back();
+        ctx.stack.pop_back();
+
+        if (!ctx.stack.empty())
+            call(ctx.stack.back(), frame.call_pc, frame.entry, frame.start);
+    }
+}
+//-----------------------------------------------------------------
+// trap_return: Leave the current trap handler
+//-----------------------------------------------------------------
+void callgrind::trap_return(void)
+{
+    t_context &ctx = m_contexts.back();
+    unwind(ctx, 0);
+
+    uint64_t epc   = ctx.epc;
+    uint64_t entry = ctx.entry;
+    t_cost   start = ctx.start;
+    m_contexts.pop_back();
+
+    t_context &parent = m_contexts.back();
+    if (!parent.stack.empty())
+        call(parent.stack.back(), epc, entry, start);
+}
+//-----------------------------------------------------------------
+// apply: Update the call stacks
+//-----------------------------------------------------------------
+void callgrind::apply(const t_event &ev)
+{
+    t_context &ctx = m_contexts.back();
+
+    if (ev.type == EVENT_CALL)
+    {
+        if (ctx.stack.empty())
+            return;
+
+        // Too deep (e.g. unmatched calls), flatten
+        if (ctx.stack.size() >= CALLGRIND_STACK_MAX)
+            unwind(ctx, 1);
+
+        t_frame frame;
+        frame.entry   = ev.dst;
+        frame.call_pc = ev.src;
+        frame.func    = &m_funcs[ev.dst];
+        frame.start   = m_total;
+        ctx.stack.push_back(frame);
+    }
+    else if (ev.type == EVENT_RET)
+    {
+        // Unwind to the frame called from just before the return address
+        for (int i=(int)ctx.stack.size()-1;i>0;i--)
+        {
+            if (ev.dst > ctx.stack[i].call_pc && ev.dst <= ctx.stack[i].call_pc + CALLGRIND_CALL_MAX)
+            {
+                unwind(ctx, i);
+                return;
+            }
+        }
+
+        // Return from the outermost function (entered before profiling
+        // started), continue in a new one
+        if (ctx.stack.size() == 1)
+            ctx.stack.clear();
+    }
+    else
+    {
+        // Unmatched trap returns (e.g. context switch), drop the oldest
+        if (m_contexts.size() > CALLGRIND_TRAP_MAX)
+        {
+            unwind(m_contexts[1], 0);
+            m_contexts.erase(m_contexts.begin() + 1);
+        }
+
+        t_context trap;
+        trap.epc   = ev.src;
+        trap.entry = ev.dst;
+        trap.start = m_total;
+        m_contexts.push_back(trap);
+    }
+}
+//-----------------------------------------------------------------
+// commit_pc: Count an instruction
+//-----------------------------------------------------------------
+void callgrind::commit_pc(uint64_t pc)
+{
+    // Events raised before this instruction (interrupts)
+    unsigned pending = 0;
+    for (unsigned i=0;i<m_pending.size();i++)
+    {
+        if (m_pending[i].src != pc)
+            apply(m_pending[i]);
+        else
+            m_pending[pending++] = m_pending[i];
+    }
+    m_pending.resize(pending);
+
+    // Resumed after the trapping instruction
+    if (m_contexts.size() > 1 && (pc - m_contexts.back().epc) <= CALLGRIND_TRAP_INST_MAX)
+        trap_return();
+
+    t_context &ctx = m_contexts.back();
+    if (ctx.stack.empty())
+    {
+        t_frame frame;
+        frame.entry   = pc;
+        frame.call_pc = 0;
+        frame.func    = &m_funcs[pc];
+        frame.start   = m_total;
+        ctx.stack.push_back(frame);
+    }
+
+    t_cost &cost = ctx.stack.back().func->self[pc];
+    cost.ir++;
+    cost.cycles++;
+    m_total.ir++;
+    m_total.cycles++;
+    m_last = &cost;
+
+    // Calls / returns / exceptions of this instruction
+    for (unsigned i=0;i<m_pending.size();i++)
+        apply(m_pending[i]);
+    m_pending.clear();
+}
+//-----------------------------------------------------------------
+// idle: Cycles asleep are charged to the last instruction (WFI)
+//-----------------------------------------------------------------
+void callgrind::idle(uint64_t cycles)
+{
+    m_total.cycles += cycles;
+    if (m_last)
+        m_last->cycles += cycles;
+}
+//-----------------------------------------------------------------
+// write: Write callgrind format profile
+//-----------------------------------------------------------------
+bool callgrind::write(const char *filename, elf_load *symbols, const char *cmd)
+{
+    typedef struct
+    {
+        uint64_t count;
+        t_cost   incl;
+        uint64_t entry;
+    } t_out_call;
+
+    typedef struct
+    {
+        std::map<uint64_t, t_cost> self;
+        std::map<std::pair<uint64_t, std::string>, t_out_call> calls;
+    } t_out_func;
+
+    // Functions (merged by name, i.e. symbol containing the entry PC)
+    std::map<uint64_t, std::string> names;
+    std::map<std::string, t_out_func> funcs;
+
+    for (std::unordered_map<uint64_t, t_func>::const_iterator f = m_funcs.begin(); f != m_funcs.end(); ++f)
+    {
+        names[f->first] = symbol(symbols, f->first);
+        for (std::map<std::pair<uint64_t, uint64_t>, t_call>::const_iterator c = f->second.calls.begin(); c != f->second.calls.end(); ++c)
+            if (names.find(c->first.second) == names.end())
+                names[c->first.second] = symbol(symbols, c->first.second);
+    }
+    for (unsigned i=0;i<m_contexts.size();i++)
+        if (names.find(m_contexts[i].entry) == names.end())
+            names[m_contexts[i].entry] = symbol(symbols, m_contexts[i].entry);
+
+    for (std::unordered_map<uint64_t, t_func>::const_iterator f = m_funcs.begin(); f != m_funcs.end(); ++f)
+    {
+        t_out_func &out = funcs[names[f->first]];
+
+        for (std::unordered_map<uint64_t, t_cost>::const_iterator s = f->second.self.begin(); s != f->second.self.end(); ++s)
+        {
+            t_cost &cost = out.self[s->first];
+            cost.ir     += s->second.ir;
+            cost.cycles += s->second.cycles;
+        }
+
+        for (std::map<std::pair<uint64_t, uint64_t>, t_call>::const_iterator c = f->second.calls.begin(); c != f->second.calls.end(); ++c)
+        {
+            t_out_call &call = out.calls[std::make_pair(c->first.first, names[c->first.second])];
+            call.count       += c->second.count;
+            call.incl.ir     += c->second.incl.ir;
+            call.incl.cycles += c->second.incl.cycles;
+            call.entry        = c->first.second;
+        }
+    }
+
+    // Calls still in progress (e.g. main) are included up to now
+    for (unsigned i=0;i<m_contexts.size();i++)
+    {
+        const t_context &ctx = m_contexts[i];
+        for (unsigned j=1;j<ctx.stack.size();j++)
+        {
+            t_out_func &out  = funcs[names[ctx.stack[j-1].entry]];
+            t_out_call &call = out.calls[std::make_pair(ctx.stack[j].call_pc, names[ctx.stack[j].entry])];
+            call.count++;
+            call.incl.ir     += m_total.ir - ctx.stack[j].start.ir;
+            call.incl.cycles += m_total.cycles - ctx.stack[j].start.cycles;
+            call.entry        = ctx.stack[j].entry;
+        }
+
+        // Trap handlers, called from the interrupted function
+        if (i && !m_contexts[i-1].stack.empty())
+        {
+            t_out_func &out  = funcs[names[m_contexts[i-1].stack.back().entry]];
+            t_out_call &call = out.calls[std::make_pair(ctx.epc, names[ctx.entry])];
+            call.count++;
+            call.incl.ir     += m_total.ir - ctx.start.ir;
+            call.incl.cycles += m_total.cycles - ctx.start.cycles;
+            call.entry        = ctx.entry;
+        }
+    }
+
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "# callgrind format\n");
+    fprintf(f, "version: 1\n");
+    fprintf(f, "creator: exactstep\n");
+    if (cmd)
+        fprintf(f, "cmd: %s\n", cmd);
+    fprintf(f, "positions: instr\n");
+    fprintf(f, "events: Ir Cycles\n");
+    fprintf(f, "summary: %llu %llu\n", (unsigned long long)m_total.ir, (unsigned long long)m_total.cycles);
+
+    // Function names are compressed to an id after first use
+    std::map<std::string, int> ids;
+    for (std::map<std::string, t_out_func>::const_iterator it = funcs.begin(); it != funcs.end(); ++it)
+    {
+        fprintf(f, "\nfn=%s\n", compress_name(ids, it->first).c_str());
+
+        for (std::map<uint64_t, t_cost>::const_iterator s = it->second.self.begin(); s != it->second.self.end(); ++s)
+            fprintf(f, "0x%llx %llu %llu\n", (unsigned long long)s->first,
+                    (unsigned long long)s->second.ir, (unsigned long long)s->second.cycles);
+
+        for (std::map<std::pair<uint64_t, std::string>, t_out_call>::const_iterator c = it->second.calls.begin(); c != it->second.calls.end(); ++c)
+        {
+            fprintf(f, "cfn=%s\n", compress_name(ids, c->first.second).c_str());
+            fprintf(f, "calls=%llu 0x%llx\n", (unsigned long long)c->second.count, (unsigned long long)c->second.entry);
+            fprintf(f, "0x%llx %llu %llu\n", (unsigned long long)c->first.first,
+                    (unsigned long long)c->second.incl.ir, (unsigned long long)c->second.incl.cycles);
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+//-----------------------------------------------------------------
+// symbol: Function name for an address
+//-----------------------------------------------------------------
+std::string callgrind::symbol(elf_load *symbols, uint64_t addr)
+{
+    const char *name = symbols ? symbols->get_symbol_name(addr) : NULL;
+    if (name)
+        return std::string(name);
+
+    char str[32];
+    sprintf(str, "0x%08llx", (unsigned long long)addr);
+    return std::string(str);
+}
+//-----------------------------------------------------------------
+// compress_name: '(id) name' on first use, then '(id)'
+//-----------------------------------------------------------------
+std::string callgrind::compress_name(std::map<std::string, int> &ids, const std::string &name)
+{
+    char str[32];
+    std::map<std::string, int>::iterator it = ids.find(name);
+    if (it != ids.end())
+    {
+        sprintf(str, "(%d)", it->second);
+        return std::string(str);
+    }
+
+    int id = ids.size() + 1;
+    ids[name] = id;
+    sprintf(str, "(%d) ", id);
+    return std::string(str) + name;
+}
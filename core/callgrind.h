@@ -0,0 +1,130 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __CALLGRIND_H__
+#define __CALLGRIND_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include "cpu_monitor.h"
+#include "elf_load.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Deepest call stack tracked (per trap level)
+#define CALLGRIND_STACK_MAX     1024
+
+// Nested traps tracked (unmatched trap returns are dropped)
+#define CALLGRIND_TRAP_MAX      8
+
+// Largest call instruction (incl. delay slot), return address range
+#define CALLGRIND_CALL_MAX      8
+
+// Largest trapping instruction, return address range
+#define CALLGRIND_TRAP_INST_MAX 4
+
+//-----------------------------------------------------------------
+// callgrind: Call graph profiler (callgrind format, for KCachegrind)
+//-----------------------------------------------------------------
+// Keeps a shadow call stack from the call / return hooks and counts
+// instructions (Ir) and cycles (incl. idle WFI cycles) per PC of each
+// function, and per call site the calls made and their inclusive cost.
+// A return unwinds to the frame it returns to (longjmp). Exceptions
+// and interrupts start a new stack (handler code runs in another
+// privilege mode), which is left when execution resumes at the trapping
+// PC. The trap is recorded as a call from the interrupted function.
+// One instance per hart.
+class callgrind: public cpu_monitor
+{
+public:
+                callgrind();
+
+    // Symbolize (against an ELF, or NULL for addresses) and write
+    bool        write(const char *filename, elf_load *symbols, const char *cmd);
+
+    uint64_t    get_instructions(void) { return m_total.ir; }
+
+    // cpu_monitor
+    void        exception(uint64_t src, uint64_t dst, uint64_t cause);
+    void        branch_call(uint64_t src, uint64_t dst);
+    void        branch_ret(uint64_t src, uint64_t dst);
+    void        commit_pc(uint64_t pc);
+    void        idle(uint64_t cycles);
+
+private:
+    typedef struct
+    {
+        uint64_t ir;
+        uint64_t cycles;
+    } t_cost;
+
+    typedef struct
+    {
+        uint64_t count;
+        t_cost   incl;
+    } t_call;
+
+    typedef struct
+    {
+        std::unordered_map<uint64_t, t_cost> self;                  // By PC
+        std::map<std::pair<uint64_t, uint64_t>, t_call> calls;      // By call PC, callee entry
+    } t_func;
+
+    typedef struct
+    {
+        uint64_t entry;
+        uint64_t call_pc;
+        t_func  *func;
+        t_cost   start;     // Totals on entry
+    } t_frame;
+
+    typedef struct
+    {
+        std::vector<t_frame> stack;
+        uint64_t epc;       // Trapping PC
+        uint64_t entry;     // Handler
+        t_cost   start;
+    } t_context;
+
+    typedef struct
+    {
+        int      type;
+        uint64_t src;
+        uint64_t dst;
+    } t_event;
+
+    enum
+    {
+        EVENT_CALL,
+        EVENT_RET,
+        EVENT_TRAP
+    };
+
+    void        push_event(int type, uint64_t src, uint64_t dst);
+    void        apply(const t_event &ev);
+    void        call(t_frame &caller, uint64_t call_pc, uint64_t entry, const t_cost &start);
+    void        unwind(t_context &ctx, unsigned depth);
+    void        trap_return(void);
+    std::string symbol(elf_load *symbols, uint64_t addr);
+    std::string compress_name(std::map<std::string, int> &ids, const std::string &name);
+
+private:
+    std::unordered_map<uint64_t, t_func> m_funcs;   // By entry PC
+    std::vector<t_context> m_contexts;
+    t_cost      m_total;
+    t_cost     *m_last;     // Cost of the last committed PC (idle cycles)
+
+    // Events are reported before the instruction is committed; applied
+    // after it (or before, if raised by another PC, e.g. interrupts)
+    std::vector<t_event> m_pending;
+};
+
+#endif
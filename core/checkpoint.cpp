@@ -0,0 +1,400 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <string.h>
+#include <stdarg.h>
+#include <zlib.h>
+#include "checkpoint.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Compressed memory image I/O chunk
+#define CHECKPOINT_ZCHUNK   (256 * 1024)
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+checkpoint::checkpoint()
+{
+    m_file     = NULL;
+    m_restore  = false;
+    m_ok       = true;
+    m_size_pos = 0;
+    m_size     = 0;
+    m_pos      = 0;
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+checkpoint::~checkpoint()
+{
+    if (m_file)
+        fclose(m_file);
+}
+//-----------------------------------------------------------------
+// fail: Report an error (the first one only), returns false
+//-----------------------------------------------------------------
+bool checkpoint::fail(const char *fmt, ...)
+{
+    if (m_ok)
+    {
+        va_list args;
+
+        fprintf(stderr, "ERROR: Checkpoint: ");
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        fprintf(stderr, "\n");
+    }
+
+    m_ok = false;
+    return false;
+}
+//-----------------------------------------------------------------
+// open_save: Create checkpoint file
+//-----------------------------------------------------------------
+bool checkpoint::open_save(const char *filename)
+{
+    m_restore = false;
+    m_file    = fopen(filename, "wb");
+    if (!m_file)
+        return fail("Could not create '%s'", filename);
+
+    uint32_t version = CHECKPOINT_VERSION;
+    if (fwrite(CHECKPOINT_MAGIC, 1, 8, m_file) != 8 ||
+        fwrite(&version, sizeof(version), 1, m_file) != 1)
+        return fail("Write error '%s'", filename);
+
+    return true;
+}
+//-----------------------------------------------------------------
+// open_restore: Open checkpoint file
+//-----------------------------------------------------------------
+bool checkpoint::open_restore(const char *filename)
+{
+    m_restore = true;
+    m_file    = fopen(filename, "rb");
+    if (!m_file)
+        return fail("Could not open '%s'", filename);
+
+    char     magic[8];
+    uint32_t version = 0;
+    if (fread(magic, 1, 8, m_file) != 8 || memcmp(magic, CHECKPOINT_MAGIC, 8) != 0 ||
+        fread(&version, sizeof(version), 1, m_file) != 1)
+        return fail("'%s' is not a checkpoint file", filename);
+
+    if (version != CHECKPOINT_VERSION)
+        return fail("'%s' has unsupported version %d", filename, version);
+
+    return true;
+}
+//-----------------------------------------------------------------
+// flush_section: Patch the length of the current section (save) /
+// check the current section was fully consumed (restore)
+//-----------------------------------------------------------------
+bool checkpoint::flush_section(void)
+{
+    if (m_name.empty() || !m_ok)
+        return m_ok;
+
+    if (m_restore)
+    {
+        if (m_pos != m_size)
+            return fail("Section '%s' size mismatch", m_name.c_str());
+        return true;
+    }
+
+    // Payload was written after the length placeholder
+    uint64_t size = m_pos;
+    if (fseeko(m_file, m_size_pos, SEEK_SET) != 0 ||
+        fwrite(&size, sizeof(size), 1, m_file) != 1 ||
+        fseeko(m_file, 0, SEEK_END) != 0)
+        return fail("Write error (section '%s')", m_name.c_str());
+
+    return true;
+}
+//-----------------------------------------------------------------
+// close: Finish the checkpoint file
+//-----------------------------------------------------------------
+bool checkpoint::close(void)
+{
+    if (!m_file)
+        return false;
+
+    flush_section();
+
+    // End marker
+    if (!m_restore && m_ok)
+    {
+        uint32_t len = 0;
+        if (fwrite(&len, sizeof(len), 1, m_file) != 1)
+            fail("Write error");
+    }
+
+    if (fclose(m_file) != 0 && !m_restore)
+        fail("Write error");
+
+    m_file = NULL;
+    m_name.clear();
+    m_buf.clear();
+    return m_ok;
+}
+//-----------------------------------------------------------------
+// section: Start the next section
+//-----------------------------------------------------------------
+int checkpoint::section(const char *name, int version)
+{
+    if (!m_file || !flush_section())
+        return 0;
+
+    m_name = name;
+    m_pos  = 0;
+    m_size = 0;
+
+    uint32_t len = m_name.size();
+    if (!m_restore)
+    {
+        // Length is patched once the payload is written
+        uint32_t ver  = version;
+        uint64_t size = 0;
+        if (fwrite(&len, sizeof(len), 1, m_file) != 1 ||
+            fwrite(name, 1, len, m_file) != len ||
+            fwrite(&ver, sizeof(ver), 1, m_file) != 1 ||
+            (m_size_pos = ftello(m_file)) < 0 ||
+            fwrite(&size, sizeof(size), 1, m_file) != 1)
+        {
+            fail("Write error (section '%s')", name);
+            return 0;
+        }
+        return version;
+    }
+
+    // Sections are restored in the order they were saved
+    uint32_t    saved_len = 0;
+    uint32_t    saved_ver = 0;
+    uint64_t    size      = 0;
+    std::string saved_name;
+
+    if (fread(&saved_len, sizeof(saved_len), 1, m_file) != 1 || saved_len > 256)
+    {
+        fail("Section '%s' missing", name);
+        return 0;
+    }
+
+    saved_name.resize(saved_len);
+    if ((saved_len && fread(&saved_name[0], 1, saved_len, m_file) != saved_len) ||
+        fread(&saved_ver, sizeof(saved_ver), 1, m_file) != 1 ||
+        fread(&size, sizeof(size), 1, m_file) != 1)
+    {
+        fail("Section '%s' truncated", name);
+        return 0;
+    }
+
+    if (saved_name != m_name)
+    {
+        fail("Expected section '%s', found '%s' (different configuration?)", name, saved_name.c_str());
+        return 0;
+    }
+
+    if (saved_ver == 0 || saved_ver > (uint32_t)version)
+    {
+        fail("Section '%s' has unsupported version %d", name, saved_ver);
+        return 0;
+    }
+
+    // Payload is read as it is consumed
+    m_size = size;
+    return saved_ver;
+}
+//-----------------------------------------------------------------
+// io: Transfer a buffer
+//-----------------------------------------------------------------
+void checkpoint::io(void *data, uint32_t size)
+{
+    if (!m_ok || !size)
+        return;
+
+    if (!m_restore)
+    {
+        if (fwrite(data, 1, size, m_file) != size)
+            fail("Write error (section '%s')", m_name.c_str());
+    }
+    else if (m_pos + size > m_size || fread(data, 1, size, m_file) != size)
+        fail("Section '%s' truncated", m_name.c_str());
+
+    m_pos += size;
+}
+//-----------------------------------------------------------------
+// io: Transfer a string
+//-----------------------------------------------------------------
+void checkpoint::io(std::string &value)
+{
+    uint32_t len = value.size();
+    io(len);
+
+    if (m_restore)
+    {
+        if (len > m_size - m_pos)
+        {
+            fail("Section '%s' truncated", m_name.c_str());
+            return;
+        }
+        value.resize(len);
+    }
+
+    if (len)
+        io(&value[0], len);
+}
+//-----------------------------------------------------------------
+// io_mem: Transfer a memory buffer.
+// Pages which are all zero are only recorded in a bitmap, the other
+// pages form a single deflate stream. It is streamed through a fixed
+// size buffer (not held in memory) and inflated directly into the
+// buffer on restore.
+//-----------------------------------------------------------------
+void checkpoint::io_mem(uint8_t *data, uint32_t size)
+{
+    static const uint8_t zero_page[CHECKPOINT_PAGE_SIZE] = { 0 };
+
+    uint32_t saved_size = size;
+    io(saved_size);
+    if (saved_size != size)
+    {
+        fail("Section '%s' memory size mismatch (0x%08x != 0x%08x)", m_name.c_str(), saved_size, size);
+        return;
+    }
+
+    uint32_t pages = (size + CHECKPOINT_PAGE_SIZE - 1) / CHECKPOINT_PAGE_SIZE;
+    std::vector<uint8_t> used((pages + 7) / 8, 0);
+
+    if (!m_restore)
+    {
+        for (uint32_t p=0;p<pages;p++)
+        {
+            uint32_t offset = p * CHECKPOINT_PAGE_SIZE;
+            uint32_t len    = (size - offset) < CHECKPOINT_PAGE_SIZE ? (size - offset) : CHECKPOINT_PAGE_SIZE;
+            if (memcmp(data + offset, zero_page, len) != 0)
+                used[p / 8] |= 1 << (p % 8);
+        }
+    }
+
+    if (!used.empty())
+        io(&used[0], used.size());
+    if (!m_ok)
+        return;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    // Compressed stream passes through a fixed size buffer
+    m_buf.resize(CHECKPOINT_ZCHUNK);
+
+    if (!m_restore)
+    {
+        // Compressed length (patched below)
+        off_t    len_pos = ftello(m_file);
+        uint64_t zsize   = 0;
+        io(zsize);
+
+        if (len_pos < 0 || deflateInit(&zs, Z_BEST_SPEED) != Z_OK)
+        {
+            fail("deflateInit failed");
+            return;
+        }
+
+        for (uint32_t p=0;p<=pages && m_ok;p++)
+        {
+            int flush = (p == pages) ? Z_FINISH : Z_NO_FLUSH;
+            if (flush == Z_NO_FLUSH)
+            {
+                if (!(used[p / 8] & (1 << (p % 8))))
+                    continue;
+
+                uint32_t offset = p * CHECKPOINT_PAGE_SIZE;
+                zs.next_in  = data + offset;
+                zs.avail_in = (size - offset) < CHECKPOINT_PAGE_SIZE ? (size - offset) : CHECKPOINT_PAGE_SIZE;
+            }
+
+            // Write out each full buffer (and the tail)
+            int ret;
+            do
+            {
+                zs.next_out  = &m_buf[0];
+                zs.avail_out = CHECKPOINT_ZCHUNK;
+                ret = deflate(&zs, flush);
+
+                uint32_t out = CHECKPOINT_ZCHUNK - zs.avail_out;
+                io(&m_buf[0], out);
+                zsize += out;
+            }
+            while (m_ok && (zs.avail_out == 0 || (flush == Z_FINISH && ret == Z_OK)));
+        }
+        deflateEnd(&zs);
+
+        if (m_ok && (fseeko(m_file, len_pos, SEEK_SET) != 0 ||
+                     fwrite(&zsize, sizeof(zsize), 1, m_file) != 1 ||
+                     fseeko(m_file, 0, SEEK_END) != 0))
+            fail("Write error (section '%s')", m_name.c_str());
+        return;
+    }
+
+    uint64_t zsize = 0;
+    io(zsize);
+    if (!m_ok || zsize > m_size - m_pos)
+    {
+        fail("Section '%s' truncated", m_name.c_str());
+        return;
+    }
+
+    if (inflateInit(&zs) != Z_OK)
+    {
+        fail("inflateInit failed");
+        return;
+    }
+
+    uint64_t zleft = zsize;
+    for (uint32_t p=0;p<pages && m_ok;p++)
+    {
+        uint32_t offset = p * CHECKPOINT_PAGE_SIZE;
+        uint32_t len    = (size - offset) < CHECKPOINT_PAGE_SIZE ? (size - offset) : CHECKPOINT_PAGE_SIZE;
+
+        if (!(used[p / 8] & (1 << (p % 8))))
+        {
+            memset(data + offset, 0, len);
+            continue;
+        }
+
+        zs.next_out  = data + offset;
+        zs.avail_out = len;
+        while (zs.avail_out != 0 && m_ok)
+        {
+            // Refill from the file
+            if (zs.avail_in == 0 && zleft)
+            {
+                uint32_t chunk = zleft < CHECKPOINT_ZCHUNK ? (uint32_t)zleft : CHECKPOINT_ZCHUNK;
+                io(&m_buf[0], chunk);
+                zs.next_in  = &m_buf[0];
+                zs.avail_in = chunk;
+                zleft      -= chunk;
+            }
+
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && !(ret == Z_STREAM_END && zs.avail_out == 0))
+                fail("Section '%s' corrupt memory image", m_name.c_str());
+        }
+    }
+    inflateEnd(&zs);
+
+    // Skip any unused tail of the stream
+    if (m_ok && zleft)
+    {
+        if (fseeko(m_file, zleft, SEEK_CUR) != 0)
+            fail("Section '%s' truncated", m_name.c_str());
+        m_pos += zleft;
+    }
+}
@@ -0,0 +1,82 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+#define CHECKPOINT_MAGIC        "EXSTCKPT"
+#define CHECKPOINT_VERSION      1
+
+// Granularity of zero page elision for memory regions
+#define CHECKPOINT_PAGE_SIZE    4096
+
+//-----------------------------------------------------------------
+// checkpoint: Simulation state file (save or restore)
+//-----------------------------------------------------------------
+// A checkpoint is a sequence of named, versioned sections (one per CPU,
+// memory region and device). The same serialize() code is used in both
+// directions: io() writes the referenced value when saving, and
+// overwrites it from the file when restoring. Sections are streamed
+// to / from the file, so the file must be seekable.
+// Values are stored in host byte order.
+class checkpoint
+{
+public:
+                checkpoint();
+               ~checkpoint();
+
+    bool        open_save(const char *filename);
+    bool        open_restore(const char *filename);
+    bool        close(void);
+
+    bool        is_restore(void) { return m_restore; }
+
+    // False once any error has been reported
+    bool        ok(void)         { return m_ok; }
+    bool        fail(const char *fmt, ...);
+
+    // Start the next section. Returns the section version (on restore
+    // the version that was saved), or 0 on error.
+    int         section(const char *name, int version);
+
+    // Transfer a value / buffer
+    void        io(void *data, uint32_t size);
+    template <typename T>
+    void        io(T &value) { io(&value, sizeof(T)); }
+    void        io(std::string &value);
+
+    // Transfer a memory buffer (sparse, compressed)
+    void        io_mem(uint8_t *data, uint32_t size);
+
+private:
+    bool        flush_section(void);
+
+private:
+    FILE       *m_file;
+    bool        m_restore;
+    bool        m_ok;
+
+    // Current section (the length is patched once it is written)
+    std::string m_name;
+    off_t       m_size_pos;
+    uint64_t    m_size;
+    uint64_t    m_pos;
+
+    // Compressed memory image chunk (io_mem)
+    std::vector<uint8_t> m_buf;
+};
+
+#endif
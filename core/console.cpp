@@ -15,6 +15,7 @@
 #include <signal.h>
 
 #include "console.h"
+#include "host_stats.h"
 
 //-----------------------------------------------------------------
 // Locals
@@ -45,6 +46,9 @@ console::console()
 {
     struct termios term;
 
+    m_in_fd  = STDIN_FILENO;
+    m_out_fd = -1;
+
     // Backup terminal settings
     tcgetattr(fileno(stdin), &_term_settings);
 
@@ -66,6 +70,12 @@ console::console()
 //-----------------------------------------------------------------
 int console::putchar(int ch)
 {
+    if (m_out_fd >= 0)
+    {
+        char c = ch;
+        return write(m_out_fd, &c, 1) == 1 ? 0 : -1;
+    }
+
     fprintf(stderr, "%c", ch);
     return 0;
 }
@@ -74,8 +84,10 @@ int console::putchar(int ch)
 //-----------------------------------------------------------------
 int console::getchar(void)
 {
+    HOST_STATS_TIMER(TIMER_CONSOLE_GETCHAR);
+
     char ch;
-    if (read(STDIN_FILENO,&ch,1) == 1) 
+    if (m_in_fd >= 0 && read(m_in_fd,&ch,1) == 1) 
         return ch;
     return -1;
 }
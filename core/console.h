@@ -20,6 +20,13 @@ public:
 
     int putchar(int ch);
     int getchar(void);
+
+    // Redirect input / output to file descriptors (-1: no input / stderr)
+    void redirect(int in_fd, int out_fd) { m_in_fd = in_fd; m_out_fd = out_fd; }
+
+private:
+    int m_in_fd;
+    int m_out_fd;
 };
 
 #endif
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <algorithm>
 #include "cpu.h"
 
 //-----------------------------------------------------------------
@@ -19,18 +20,65 @@ cpu::cpu() :
     m_p_cycles        { NULL },
     m_clock_freq      { 100000000 },
     m_clock_per       { 10.0 },
+    m_timebase_div    { 1 },
+    m_timer_when      { SCHED_NEVER },
     m_memories        { NULL },
     m_devices         { NULL },
+    m_own_memory      { true },
+    m_sched_now       { 0 },
+    m_smp             { NULL },
+    m_hart_id         { 0 },
+    m_irq_level       { 0 },
+    m_irq_changed     { 0 },
+    m_fence_req       { 0 },
     m_console         { NULL },
+    m_monitor         { NULL },
+    m_trace_file      { NULL },
     m_has_breakpoints { false },
     m_stopped         { false },
     m_fault           { false },
     m_break           { false },
+    m_device_event    { false },
+    m_host_exit       { true },
+    m_exit_code       { 0 },
     m_trace           { 0 },
     m_syscall_if      { NULL }
 {
 }
 //-----------------------------------------------------------------
+// Destructor: Free memories and devices (unless shared with another hart)
+//-----------------------------------------------------------------
+cpu::~cpu()
+{
+    if (!m_own_memory)
+        return;
+
+    // Devices are also on the memory list
+    memory_base *mem = m_memories;
+    while (mem)
+    {
+        memory_base *next = mem->next;
+        delete mem;
+        mem = next;
+    }
+    m_memories = NULL;
+    m_devices  = NULL;
+}
+//-----------------------------------------------------------------
+// sim_exit: Simulation exit request from the target.
+// A non-zero exit code ends the host process unless disabled.
+//-----------------------------------------------------------------
+void cpu::sim_exit(int code)
+{
+    m_exit_code = code;
+
+    // Abnormal exit
+    if (code && m_host_exit)
+        exit(code);
+    else
+        m_stopped = true;
+}
+//-----------------------------------------------------------------
 // error: Handle an error
 //-----------------------------------------------------------------
 bool cpu::error(bool is_fatal, const char *fmt, ...)
@@ -67,6 +115,7 @@ bool cpu::attach_memory(memory_base *memory)
 
     memory->next = m_memories;
     m_memories = memory;
+    m_mem_map.add(memory);
     memory->reset();
 
     return true;
@@ -83,11 +132,288 @@ bool cpu::attach_device(device *dev)
 
     dev->device_next = m_devices;
     m_devices = dev;
+    dev->sched_cpu   = this;
     dev->reset();
 
+    // First clock() call on the next step
+    sched_device(dev, m_sched_now);
+
     return true;
 }
 //-----------------------------------------------------------------
+// share_memory: Use the memory regions and devices of another hart
+// (devices remain clocked by their owner)
+//-----------------------------------------------------------------
+void cpu::share_memory(cpu *owner)
+{
+    assert(m_memories == NULL);
+
+    std::vector<memory_base *> regions;
+    for (memory_base *mem = owner->m_memories; mem != NULL; mem = mem->next)
+        regions.push_back(mem);
+
+    // Lowest priority (first attached) region first
+    for (int i=(int)regions.size()-1;i>=0;i--)
+        m_mem_map.add(regions[i]);
+
+    m_memories   = owner->m_memories;
+    m_devices    = owner->m_devices;
+    m_own_memory = false;
+}
+//-----------------------------------------------------------------
+// post_interrupt: Raise / drop an interrupt on this hart from any thread
+//-----------------------------------------------------------------
+void cpu::post_interrupt(int irq, bool level)
+{
+    // Single hart - apply now
+    if (!m_smp)
+    {
+        if (level)
+            set_interrupt(irq);
+        else
+            clr_interrupt(irq);
+        return;
+    }
+
+    // Level first, the hart applies the latest level of each changed irq
+    if (level)
+        m_irq_level.fetch_or(1u << irq);
+    else
+        m_irq_level.fetch_and(~(1u << irq));
+    m_irq_changed.fetch_or(1u << irq);
+}
+//-----------------------------------------------------------------
+// post_fence: Request a fence (eFence mask) on this hart from any thread
+//-----------------------------------------------------------------
+void cpu::post_fence(uint32_t mask)
+{
+    if (!m_smp)
+        remote_fence(mask);
+    else
+        m_fence_req.fetch_or(mask);
+}
+//-----------------------------------------------------------------
+// smp_poll: Apply interrupts / fences posted by other harts
+//-----------------------------------------------------------------
+void cpu::smp_poll(void)
+{
+    if (m_irq_changed.load(std::memory_order_relaxed))
+    {
+        uint32_t changed = m_irq_changed.exchange(0);
+        uint32_t level   = m_irq_level.load();
+
+        for (int irq=0;changed != 0;irq++, changed >>= 1)
+        {
+            if (!(changed & 1))
+                continue;
+
+            if (level & (1u << irq))
+                set_interrupt(irq);
+            else
+                clr_interrupt(irq);
+        }
+    }
+
+    if (m_fence_req.load(std::memory_order_relaxed))
+        remote_fence(m_fence_req.exchange(0));
+}
+//-----------------------------------------------------------------
+// Event queue ordering (earliest cycle at the heap top)
+//-----------------------------------------------------------------
+bool cpu::sched_later(const t_dev_event &a, const t_dev_event &b)
+{
+    return a.when > b.when;
+}
+//-----------------------------------------------------------------
+// sched_device: Queue a clock() call for a device at an absolute cycle
+//-----------------------------------------------------------------
+void cpu::sched_device(device *dev, uint64_t when)
+{
+    t_dev_event ev;
+    ev.when = when;
+    ev.dev  = dev;
+
+    // Any earlier entry for this device becomes stale
+    dev->sched_when = when;
+    m_dev_events.push_back(ev);
+    std::push_heap(m_dev_events.begin(), m_dev_events.end(), sched_later);
+
+    // Too many stale entries (frequently woken device with a distant
+    // deadline), rebuild with one entry per scheduled device.
+    if (m_dev_events.size() > SCHED_COMPACT)
+    {
+        m_dev_events.clear();
+        for (device *d = m_devices; d != NULL; d = d->device_next)
+        {
+            if (d->sched_when == SCHED_NEVER)
+                continue;
+
+            ev.when = d->sched_when;
+            ev.dev  = d;
+            m_dev_events.push_back(ev);
+        }
+        std::make_heap(m_dev_events.begin(), m_dev_events.end(), sched_later);
+    }
+}
+//-----------------------------------------------------------------
+// sched_wake: Device state changed (register access / interrupt),
+// clock it on the next step
+//-----------------------------------------------------------------
+void cpu::sched_wake(device *dev)
+{
+    if (dev->sched_when > m_sched_now)
+        sched_device(dev, m_sched_now);
+}
+//-----------------------------------------------------------------
+// sched_next_event: Cycle of the next device clock() call or CPU timer
+// event (SCHED_NEVER if all devices are idle)
+//-----------------------------------------------------------------
+uint64_t cpu::sched_next_event(void)
+{
+    if (m_smp && m_hart_id == 0)
+    {
+        bus_lock();
+        uint64_t next = sched_next_locked();
+        bus_unlock();
+        return next;
+    }
+
+    return sched_next_locked();
+}
+//-----------------------------------------------------------------
+// sched_next_locked: sched_next_event() with the device queue owned
+//-----------------------------------------------------------------
+uint64_t cpu::sched_next_locked(void)
+{
+    // Drop stale entries from the top
+    while (!m_dev_events.empty() && m_dev_events.front().when != m_dev_events.front().dev->sched_when)
+    {
+        std::pop_heap(m_dev_events.begin(), m_dev_events.end(), sched_later);
+        m_dev_events.pop_back();
+    }
+
+    uint64_t next = m_dev_events.empty() ? SCHED_NEVER : m_dev_events.front().when;
+    return next < m_timer_when ? next : m_timer_when;
+}
+//-----------------------------------------------------------------
+// device::sched_cycle: Cycle count at the last CPU step
+//-----------------------------------------------------------------
+uint64_t device::sched_cycle(void)
+{
+    return sched_cpu ? sched_cpu->sched_cycle() : 0;
+}
+//-----------------------------------------------------------------
+// device::sched_wake: Request a clock() call on the next CPU step
+//-----------------------------------------------------------------
+void device::sched_wake(void)
+{
+    if (sched_cpu)
+        sched_cpu->sched_wake(this);
+}
+//-----------------------------------------------------------------
+// device::serialize: Default for devices without checkpoint support
+//-----------------------------------------------------------------
+void device::serialize(checkpoint &cp)
+{
+    cp.fail("Device '%s' does not support checkpoints", m_name.c_str());
+}
+//-----------------------------------------------------------------
+// device::serialize_sched: Checkpoint next clock() call / irq events
+//-----------------------------------------------------------------
+void device::serialize_sched(checkpoint &cp)
+{
+    cp.io(sched_when);
+    cp.io(m_irq_raised);
+    cp.io(m_irq_dropped);
+}
+//-----------------------------------------------------------------
+// serialize: Save / restore the simulation state to a checkpoint.
+// The hart owning the memories also saves the memory regions (RAM)
+// and devices, harts sharing them only their own state.
+//-----------------------------------------------------------------
+bool cpu::serialize(checkpoint &cp)
+{
+    cp.section("cpu", 1);
+
+    uint64_t cycles = *m_p_cycles;
+    cp.io(cycles);
+    cp.io(m_timer_when);
+    cp.io(m_sched_now);
+    cp.io(m_stopped);
+    cp.io(m_fault);
+    cp.io(m_exit_code);
+
+    uint32_t irq_level   = m_irq_level;
+    uint32_t irq_changed = m_irq_changed;
+    uint32_t fence_req   = m_fence_req;
+    cp.io(irq_level);
+    cp.io(irq_changed);
+    cp.io(fence_req);
+
+    if (cp.is_restore())
+    {
+        *m_p_cycles    = cycles;
+        m_irq_level    = irq_level;
+        m_irq_changed  = irq_changed;
+        m_fence_req    = fence_req;
+        m_break        = false;
+        m_device_event = false;
+    }
+
+    // Architectural state
+    if (!serialize_arch(cp))
+        return cp.fail("CPU model does not support checkpoints");
+
+    if (!m_own_memory)
+        return cp.ok();
+
+    // Memory regions (devices follow)
+    for (memory_base *mem = m_memories; mem != NULL && cp.ok(); mem = mem->next)
+    {
+        uint32_t base = 0;
+        uint32_t size = 0;
+        uint8_t *buf  = mem->get_dmi(base, size);
+        if (!buf)
+            continue;
+
+        cp.section("mem", 1);
+
+        uint32_t saved_base = base;
+        cp.io(saved_base);
+        if (saved_base != base)
+            return cp.fail("Memory region 0x%08x missing", saved_base);
+
+        cp.io_mem(buf, size);
+    }
+
+    // Devices
+    for (device *dev = m_devices; dev != NULL && cp.ok(); dev = dev->device_next)
+    {
+        cp.section("dev", 1);
+
+        std::string name = dev->get_name();
+        uint32_t    base = dev->get_base();
+        cp.io(name);
+        cp.io(base);
+        if (name != dev->get_name() || base != dev->get_base())
+            return cp.fail("Device %s@0x%08x missing", name.c_str(), base);
+
+        dev->serialize_sched(cp);
+        dev->serialize(cp);
+    }
+
+    // Rebuild the device event queue
+    if (cp.is_restore() && cp.ok())
+    {
+        m_dev_events.clear();
+        for (device *dev = m_devices; dev != NULL; dev = dev->device_next)
+            if (dev->sched_when != SCHED_NEVER)
+                sched_device(dev, dev->sched_when);
+    }
+
+    return cp.ok();
+}
+//-----------------------------------------------------------------
 // get_break: Get breakpoint status (and clear)
 //-----------------------------------------------------------------
 bool cpu::get_break(void)
@@ -136,23 +462,30 @@ bool cpu::check_breakpoint(uint32_t pc)
 //-----------------------------------------------------------------
 bool cpu::valid_addr(uint32_t address)
 {
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-            return true;
-
-    return false;
+    return m_mem_map.find(address, m_memories) != NULL;
 }
 //-----------------------------------------------------------------
 // write: Write a byte to memory (physical address)
 //-----------------------------------------------------------------
 void cpu::write(uint32_t address, uint8_t data)
 {
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-        {
-            mem->write8(address, data);
-            return ;
-        }
+    invalidate_code(address, 1);
+
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+    {
+        *host = data;
+        return ;
+    }
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        bus_lock();
+        mem->write8(address, data);
+        bus_unlock();
+        return ;
+    }
 
     error(false, "Failed store @ 0x%08x\n", address);
 }
@@ -161,15 +494,58 @@ void cpu::write(uint32_t address, uint8_t data)
 //-----------------------------------------------------------------
 uint8_t cpu::read(uint32_t address)
 {
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+        return *host;
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        uint8_t data = 0;
+        bus_lock();
+        mem->read8(address, data);
+        bus_unlock();
+        return data;
+    }
+
+    return 0;
+}
+//-----------------------------------------------------------------
+// write_block: Write a block of bytes to memory (physical address)
+//-----------------------------------------------------------------
+bool cpu::write_block(uint32_t address, uint8_t *data, int length)
+{
+    invalidate_code(address, length);
+
+    while (length > 0)
+    {
+        // Copy up to the end of the current page
+        int chunk = memory_map::PAGE_SIZE - (address & (memory_map::PAGE_SIZE-1));
+        if (chunk > length)
+            chunk = length;
+
+        uint8_t *host = get_host_ptr(address);
+        if (host)
+            memcpy(host, data, chunk);
+        else
         {
-            uint8_t data = 0;
-            mem->read8(address, data);
-            return data;
+            for (int i=0;i<chunk;i++)
+            {
+                memory_base *mem = find_memory(address + i);
+                if (!mem)
+                    return false;
+                bus_lock();
+                mem->write8(address + i, data[i]);
+                bus_unlock();
+            }
         }
 
-    return 0;
+        address += chunk;
+        data    += chunk;
+        length  -= chunk;
+    }
+
+    return true;
 }
 //-----------------------------------------------------------------
 // write16: Write a word to memory (physical address)
@@ -177,13 +553,23 @@ uint8_t cpu::read(uint32_t address)
 void cpu::write16(uint32_t address, uint16_t data)
 {
     address &= ~1;
+    invalidate_code(address, 2);
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-        {
-            mem->write16(address, data);
-            return ;
-        }
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+    {
+        mem_store16(host, data);
+        return ;
+    }
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        bus_lock();
+        mem->write16(address, data);
+        bus_unlock();
+        return ;
+    }
 
     error(false, "Failed store @ 0x%08x\n", address);
 }
@@ -194,13 +580,19 @@ uint16_t cpu::read16(uint32_t address)
 {
     address &= ~1;
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-        {
-            uint16_t data = 0;
-            mem->read16(address, data);
-            return data;
-        }
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+        return mem_load16(host);
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        uint16_t data = 0;
+        bus_lock();
+        mem->read16(address, data);
+        bus_unlock();
+        return data;
+    }
 
     return 0;
 }
@@ -210,13 +602,23 @@ uint16_t cpu::read16(uint32_t address)
 void cpu::write32(uint32_t address, uint32_t data)
 {
     address &= ~3;
+    invalidate_code(address, 4);
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-        {
-            mem->write32(address, data);
-            return ;
-        }
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+    {
+        mem_store32(host, data);
+        return ;
+    }
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        bus_lock();
+        mem->write32(address, data);
+        bus_unlock();
+        return ;
+    }
 
     error(false, "Failed store @ 0x%08x\n", address);
 }
@@ -227,13 +629,19 @@ uint32_t cpu::read32(uint32_t address)
 {
     address &= ~3;
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-        {
-            uint32_t data = 0;
-            mem->read32(address, data);
-            return data;
-        }
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+        return mem_load32(host);
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        uint32_t data = 0;
+        bus_lock();
+        mem->read32(address, data);
+        bus_unlock();
+        return data;
+    }
 
     return 0;
 }
@@ -244,13 +652,19 @@ uint32_t cpu::ifetch32(uint32_t address)
 {
     address &= ~3;
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-        {
-            uint32_t data = 0;
-            mem->ifetch32(address, data);
-            return data;
-        }
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+        return mem_load32(host);
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        uint32_t data = 0;
+        bus_lock();
+        mem->ifetch32(address, data);
+        bus_unlock();
+        return data;
+    }
 
     return 0;
 }
@@ -261,13 +675,19 @@ uint16_t cpu::ifetch16(uint32_t address)
 {
     address &= ~1;
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-        {
-            uint16_t data = 0;
-            mem->ifetch16(address, data);
-            return data;
-        }
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+        return mem_load16(host);
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        uint16_t data = 0;
+        bus_lock();
+        mem->ifetch16(address, data);
+        bus_unlock();
+        return data;
+    }
 
     return 0;
 }
@@ -280,16 +700,83 @@ void cpu::step(uint64_t cycles)
     if (m_has_breakpoints && check_breakpoint(get_pc()))
         m_break = true;
 
-    // Clock peripherals
-    for (device *dev = m_devices; dev != NULL; dev = dev->device_next)
+    // Interrupts / fences from other harts
+    if (m_smp)
+        smp_poll();
+
+    // CPU internal timer
+    if (cycles >= m_timer_when)
+    {
+        m_timer_when = SCHED_NEVER;
+        timer_expired();
+    }
+
+    // Device event queue is shared with other harts accessing devices
+    bool bus_owner = m_smp && m_hart_id == 0;
+    if (bus_owner)
+        bus_lock();
+
+    m_sched_now = cycles;
+
+    // Clock peripherals which are due
+    while (!m_dev_events.empty() && m_dev_events.front().when <= cycles)
     {
-        dev->clock(cycles);
+        t_dev_event ev = m_dev_events.front();
+        std::pop_heap(m_dev_events.begin(), m_dev_events.end(), sched_later);
+        m_dev_events.pop_back();
+
+        device *dev = ev.dev;
+        if (dev->sched_when != ev.when)
+            continue;
+
+        // Mark as in service (wake requests are redundant until rescheduled)
+        dev->sched_when = cycles;
+
+        int delta;
+        {
+            HOST_STATS_TIMER(TIMER_DEVICES);
+            delta = dev->clock(cycles);
+        }
+        if (delta != memory_base::CLOCK_IDLE)
+            sched_device(dev, cycles + (delta > 0 ? delta : 1));
+        else
+            dev->sched_when = SCHED_NEVER;
 
         if (dev->event_irq_raised())
+        {
             set_interrupt(dev->get_irq_num());
+            m_device_event = true;
+        }
         else if (dev->event_irq_dropped())
+        {
             clr_interrupt(dev->get_irq_num());
+            m_device_event = true;
+        }
     }
+
+    if (bus_owner)
+        bus_unlock();
+}
+//-----------------------------------------------------------------
+// run: Execute up to max_steps instructions (generic model loop)
+//-----------------------------------------------------------------
+int cpu::run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc)
+{
+    uint64_t end = cycles + max_steps;
+
+    m_device_event = false;
+    while (cycles < end)
+    {
+        uint64_t pc = get_pc64();
+        step(cycles);
+        cycles++;
+
+        int status = run_status(pc, stop_pc);
+        if (status != RUN_BUDGET)
+            return status;
+    }
+
+    return RUN_BUDGET;
 }
 //-----------------------------------------------------------------
 // find_device: Find device by name and index
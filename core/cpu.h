@@ -10,11 +10,18 @@
 
 #include <stdint.h>
 #include <vector>
+#include <atomic>
 #include "memory.h"
+#include "memory_map.h"
 #include "device.h"
 #include "mem_api.h"
 #include "console_io.h"
 #include "syscall_if.h"
+#include "smp.h"
+#include "checkpoint.h"
+#include "cpu_monitor.h"
+#include "trace_file.h"
+#include "host_stats.h"
 
 //--------------------------------------------------------------------
 // CPU model base class
@@ -23,12 +30,14 @@ class cpu: public mem_api
 {
 public:
     cpu();
+    virtual ~cpu();
 
     // mem_api
     virtual bool      create_memory(uint32_t addr, uint32_t size, uint8_t *mem = NULL);
     virtual bool      valid_addr(uint32_t addr);
     virtual void      write(uint32_t addr, uint8_t data);
     virtual uint8_t   read(uint32_t addr);
+    virtual bool      write_block(uint32_t addr, uint8_t *data, int length);
 
     // Memory access helpers
     virtual bool      attach_memory(memory_base *memory);
@@ -49,9 +58,37 @@ public:
     virtual bool      get_fault(void)   { return m_fault; }
     virtual bool      get_stopped(void) { return m_stopped; }
 
+    // Target requested end of simulation (e.g. from a syscall handler)
+    void              sim_exit(int code);
+
+    // Exit code requested by the target (valid once stopped)
+    int               get_exit_code(void) { return m_exit_code; }
+
+    // A non-zero target exit code ends the host process (default), or
+    // just stops the CPU (e.g. several simulations in one process)
+    void              enable_host_exit(bool en) { m_host_exit = en; }
+
     // Execute one instruction
     virtual void      step(uint64_t cycles);
 
+    // Execute a basic block (up to max_steps), returns instructions executed
+    virtual int       step_block(uint64_t cycles, int max_steps) { step(cycles); return 1; }
+
+    // Batch execution: run up to max_steps instructions (advancing cycles).
+    // Returns early (eRunStop) on a fault, stop request, breakpoint, a device
+    // interrupt event or once the instruction at stop_pc has executed.
+    enum eRunStop
+    {
+        RUN_BUDGET,     // Instruction budget exhausted
+        RUN_FAULT,
+        RUN_STOPPED,
+        RUN_BREAK,      // Cleared by get_break()
+        RUN_STOP_PC,
+        RUN_EVENT       // Device raised / dropped an interrupt
+    };
+    static const uint64_t RUN_NO_STOP_PC = ~0ULL;
+    virtual int       run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc = RUN_NO_STOP_PC);
+
     // Breakpoints
     virtual bool      get_break(void);
     virtual bool      set_breakpoint(uint32_t pc);
@@ -95,13 +132,48 @@ public:
     // Instruction trace
     virtual void      enable_trace(uint32_t mask) { m_trace = mask; }
 
-    // Monitor executed instructions
-    virtual void      log_exception(uint64_t src, uint64_t dst, uint64_t cause) { }
-    virtual void      log_branch(uint64_t src, uint64_t dst, bool taken) { }
-    virtual void      log_branch_jump(uint64_t src, uint64_t dst) { }
-    virtual void      log_branch_call(uint64_t src, uint64_t dst) { }
-    virtual void      log_branch_ret(uint64_t src, uint64_t dst) { }
-    virtual void      log_commit_pc(uint64_t pc) { }
+    // Binary instruction trace (NULL to detach). Returns false if not
+    // supported by the model.
+    virtual bool      enable_trace_file(trace_writer *file) { return file == NULL; }
+
+    // Dynamic translation (where supported by the model)
+    enum eJitMode
+    {
+        JIT_OFF,
+        JIT_ON,
+        JIT_CHECK   // Lockstep against the interpreter
+    };
+    virtual bool      enable_jit(int mode) { return mode == JIT_OFF; }
+
+    // Blocks translated since the model was created (0 without a JIT)
+    virtual uint32_t  get_jit_blocks(void) { return 0; }
+
+    // TLB geometry (where supported by the model), applies to each of
+    // the instruction and data TLBs. Returns false if not supported.
+    virtual bool      set_tlb_size(int entries, int ways) { return false; }
+
+    // Monitor executed instructions (default: forward to the monitor).
+    // Block execution only calls these when a monitor is attached.
+    virtual void      log_exception(uint64_t src, uint64_t dst, uint64_t cause) { if (m_monitor) m_monitor->exception(src, dst, cause); }
+    virtual void      log_branch(uint64_t src, uint64_t dst, bool taken) { if (m_monitor) m_monitor->branch(src, dst, taken); }
+    virtual void      log_branch_jump(uint64_t src, uint64_t dst) { if (m_monitor) m_monitor->branch_jump(src, dst); }
+    virtual void      log_branch_call(uint64_t src, uint64_t dst) { if (m_monitor) m_monitor->branch_call(src, dst); }
+    virtual void      log_branch_ret(uint64_t src, uint64_t dst) { if (m_monitor) m_monitor->branch_ret(src, dst); }
+    virtual void      log_commit_pc(uint64_t pc) { if (m_monitor) m_monitor->commit_pc(pc); }
+    virtual void      log_idle(uint64_t cycles) { if (m_monitor) m_monitor->idle(cycles); }
+
+    // Attach an instruction monitor (NULL to detach). Translated code
+    // does not report instructions, so this turns the JIT off.
+    // Returns false if the model does not report instructions.
+    bool              set_monitor(cpu_monitor *mon)
+    {
+        if (mon && !has_monitor())
+            return false;
+        m_monitor = mon;
+        if (mon) enable_jit(JIT_OFF);
+        return true;
+    }
+    virtual bool      has_monitor(void) { return false; }
 
     // Stats
     virtual void      stats_reset(void) = 0;
@@ -118,26 +190,139 @@ public:
     uint64_t          get_cycle_value(void)          { return *m_p_cycles; }
     uint64_t          get_timestamp_ns(void)         { return (uint64_t)(m_clock_per * (*m_p_cycles)); }
 
+    // Timer (mtime) clock: one tick every N CPU cycles
+    void              set_timebase_div(uint32_t n)   { m_timebase_div = n ? n : 1; }
+    uint32_t          get_timebase_div(void)         { return m_timebase_div; }
+
     // Error message
     bool              error(bool is_fatal, const char *fmt, ...);
 
     // Find device by name and index
     device *          find_device(std::string name, int idx);
 
+    // Device event scheduling
+    uint64_t          sched_cycle(void)              { return m_sched_now; }
+    void              sched_wake(device *dev);
+
+    // Multi-hart (SMP) support
+    void              set_smp(smp *group, int hart_id) { m_smp = group; m_hart_id = hart_id; }
+    smp *             get_smp(void)                  { return m_smp; }
+    int               get_hart_id(void)              { return m_hart_id; }
+
+    // Use the memories / devices of another hart (shared physical memory map)
+    void              share_memory(cpu *owner);
+
+    // Interrupt / fence requests from another hart or host thread (applied
+    // by this hart on its next step)
+    void              post_interrupt(int irq, bool level);
+    enum eFence
+    {
+        FENCE_I   = (1 << 0),
+        FENCE_VMA = (1 << 1)
+    };
+    void              post_fence(uint32_t mask);
+
+    // Save / restore simulation state (direction set by the checkpoint)
+    bool              serialize(checkpoint &cp);
+
+protected:
+    // Batch execution status after an instruction / block (pc = last executed)
+    int                 run_status(uint64_t pc, uint64_t stop_pc)
+    {
+        if (m_fault)        return RUN_FAULT;
+        if (m_stopped)      return RUN_STOPPED;
+        if (m_break)        return RUN_BREAK;
+        if (pc == stop_pc)  return RUN_STOP_PC;
+        if (m_device_event) return RUN_EVENT;
+        return RUN_BUDGET;
+    }
+
+    // Physical address -> memory region (for an access without a host pointer)
+    memory_base *       find_memory(uint32_t addr)
+    {
+        memory_base *mem = m_mem_map.find(addr, m_memories);
+        HOST_STATS_MMIO(mem);
+        return mem;
+    }
+
+    // Physical address -> host pointer (RAM only, valid to the end of the page)
+    uint8_t *           get_host_ptr(uint32_t addr) { return m_mem_map.find_host(addr); }
+
+    // Memory written outside of the instruction stream (loaders, debugger, DMA)
+    virtual void        invalidate_code(uint32_t addr, int length) { }
+
+    // Queue device clock() call at an absolute cycle
+    void                sched_device(device *dev, uint64_t when);
+
+    // Cycle of the earliest pending device clock() call or timer event
+    // (idle fast-forward)
+    uint64_t            sched_next_event(void);
+    uint64_t            sched_next_locked(void);
+
+    // CPU internal timer: timer_expired() is called from step() once the
+    // armed (absolute) cycle is reached
+    void                timer_arm(uint64_t when) { m_timer_when = when; }
+    virtual void        timer_expired(void) { }
+
+    // Checkpoint of the model specific (architectural) state.
+    // Returns false if not supported by the model.
+    virtual bool        serialize_arch(checkpoint &cp) { return false; }
+
+    // Fence requested by another hart (eFence mask)
+    virtual void        remote_fence(uint32_t mask) { }
+
+    // Apply interrupts / fences posted by other harts
+    void                smp_poll(void);
+
+    // Serialise device accesses between harts
+    void                bus_lock(void)     { if (m_smp) m_smp->bus_lock(); }
+    void                bus_unlock(void)   { if (m_smp) m_smp->bus_unlock(); }
+
+    // LR/SC reservations between harts (always held for a single hart)
+    void                smp_reserve(uint64_t addr)          { if (m_smp) m_smp->reserve(m_hart_id, addr); }
+    bool                smp_take_reservation(uint64_t addr) { return !m_smp || m_smp->take_reservation(m_hart_id, addr); }
+    void                smp_atomic_store(uint64_t addr)     { if (m_smp) m_smp->break_reservations(m_hart_id, addr); }
+
 protected:
     // CPU clock
     uint64_t           *m_p_cycles;
     uint32_t            m_clock_freq; // Frequency (in Hz)
     double              m_clock_per;  // Period (in ns)
+    uint32_t            m_timebase_div;
+    uint64_t            m_timer_when;
 
     // Memory
     memory_base        *m_memories;
     device             *m_devices;
+    memory_map          m_mem_map;
+    bool                m_own_memory;
+
+    // Device event queue (min-heap on cycle, stale entries skipped)
+    typedef struct
+    {
+        uint64_t when;
+        device  *dev;
+    } t_dev_event;
+    std::vector <t_dev_event > m_dev_events;
+    static bool         sched_later(const t_dev_event &a, const t_dev_event &b);
+    static const uint64_t SCHED_NEVER   = ~0ULL;
+    static const unsigned SCHED_COMPACT = 1024;
+    uint64_t            m_sched_now;
+
+    // Multi-hart group (NULL for a single hart)
+    smp                *m_smp;
+    int                 m_hart_id;
+    std::atomic<uint32_t> m_irq_level;   // Posted interrupt levels
+    std::atomic<uint32_t> m_irq_changed; // Posted interrupts to apply
+    std::atomic<uint32_t> m_fence_req;
 
     // Status
     bool                m_stopped;
     bool                m_fault;
     bool                m_break;
+    bool                m_device_event;
+    bool                m_host_exit;
+    int                 m_exit_code;
     int                 m_trace;
 
     // Breakpoints
@@ -147,6 +332,12 @@ protected:
     // Console
     console_io         *m_console;
 
+    // Instruction monitor
+    cpu_monitor        *m_monitor;
+
+    // Binary instruction trace
+    trace_writer       *m_trace_file;
+
     // System call hosting
     syscall_if         *m_syscall_if;
 };
@@ -0,0 +1,34 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __CPU_MONITOR_H__
+#define __CPU_MONITOR_H__
+
+#include <stdint.h>
+
+//--------------------------------------------------------------------
+// cpu_monitor: Observer of executed instructions (see cpu::set_monitor)
+//--------------------------------------------------------------------
+// Control flow events are reported before commit_pc() of the same
+// instruction.
+class cpu_monitor
+{
+public:
+    virtual ~cpu_monitor() { }
+
+    virtual void exception(uint64_t src, uint64_t dst, uint64_t cause) { }
+    virtual void branch(uint64_t src, uint64_t dst, bool taken) { }
+    virtual void branch_jump(uint64_t src, uint64_t dst) { }
+    virtual void branch_call(uint64_t src, uint64_t dst) { }
+    virtual void branch_ret(uint64_t src, uint64_t dst) { }
+    virtual void commit_pc(uint64_t pc) { }
+
+    // Cycles spent asleep (WFI) without executing instructions
+    virtual void idle(uint64_t cycles) { }
+};
+
+#endif
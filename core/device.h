@@ -9,6 +9,9 @@
 #define __DEVICE_H__
 
 #include "memory.h"
+#include "checkpoint.h"
+
+class cpu;
 
 //--------------------------------------------------------------------
 // Device base class
@@ -24,6 +27,8 @@ public:
         m_irq_raised  = false;
         m_irq_dropped = false;
         device_next   = NULL;
+        sched_cpu     = NULL;
+        sched_when    = 0;
     }
 
     virtual void set_irq(int irq) { }
@@ -39,7 +44,10 @@ public:
         if (m_irq_ctrl)
             m_irq_ctrl->set_irq(m_irq_number);
         else
+        {
             m_irq_raised = true;
+            sched_wake();
+        }
     }
 
     virtual void drop_interrupt(void)
@@ -47,7 +55,10 @@ public:
         if (m_irq_ctrl)
             m_irq_ctrl->clr_irq(m_irq_number);
         else
+        {
             m_irq_dropped = true;
+            sched_wake();
+        }
     }
 
     virtual bool event_irq_raised(void)
@@ -90,9 +101,24 @@ public:
         return false;
     }
 
+    // Event scheduler: current cycle / request clock() on the next step
+    uint64_t         sched_cycle(void);
+    void             sched_wake(void);
+
+    // Checkpoint: save / restore device registers (default: fail, so
+    // state is never silently dropped, stateless devices override this)
+    virtual void     serialize(checkpoint &cp);
+
+    // Checkpoint: scheduled clock() call and undelivered interrupt events
+    void             serialize_sched(checkpoint &cp);
+
 public:
     device*          device_next;
 
+    // Owning CPU and absolute cycle of the next clock() call
+    cpu *            sched_cpu;
+    uint64_t         sched_when;
+
 protected:
     const int        m_irq_number;
     device         * m_irq_ctrl;
@@ -12,10 +12,12 @@
 #include <libelf.h>
 #include <fcntl.h>
 #include <gelf.h>
-#include <bfd.h>
 #include <string>
+#include <algorithm>
 
 #include "elf_load.h"
+#include "memory_map.h"
+#include "host_stats.h"
 
 //--------------------------------------------------------------------
 // Constructor
@@ -27,19 +29,27 @@ elf_load::elf_load(const char *filename, mem_api *target, bool load_to_paddr /*=
     m_entry_point   = 0;
     m_load_to_paddr = load_to_paddr;
     m_load_offset   = load_offset;
+    m_parsed        = false;
+    m_valid         = false;
+    m_is64          = false;
 }
 //--------------------------------------------------------------------
-// load: Load ELF to target
+// parse: Read loadable sections and symbols from the ELF (once)
 //--------------------------------------------------------------------
-bool elf_load::load(void)
+bool elf_load::parse(void)
 {
     int fd;
     Elf * e;
-    Elf_Kind ek;
     Elf_Scn *scn;
     Elf_Data *data;
     size_t shstrndx;
-    int num_phdrs = 0;
+    size_t num_phdrs = 0;
+
+    if (m_parsed)
+        return m_valid;
+    m_parsed = true;
+
+    HOST_STATS_TIMER(TIMER_LOAD);
 
     if (elf_version ( EV_CURRENT ) == EV_NONE)
         return false;
@@ -48,175 +58,220 @@ bool elf_load::load(void)
         return false;
 
     if ((e = elf_begin ( fd , ELF_C_READ, NULL )) == NULL)
+    {
+        close (fd);
         return false;
-    
-    ek = elf_kind ( e );
-    if (ek != ELF_K_ELF)
-        return false;
+    }
 
     // Get section name header index
-    if (elf_getshdrstrndx(e, &shstrndx)!=0)
+    if (elf_kind ( e ) != ELF_K_ELF || elf_getshdrstrndx(e, &shstrndx) != 0)
+    {
+        elf_end (e);
+        close (fd);
         return false;
+    }
+
+    m_is64 = (gelf_getclass(e) == ELFCLASS64);
 
     // Get entry point
     {
         GElf_Ehdr _ehdr;
         GElf_Ehdr *ehdr = gelf_getehdr(e, &_ehdr);
         m_entry_point = ehdr ? (uint32_t)ehdr->e_entry : 0;
-        num_phdrs = ehdr ? ehdr->e_phnum : 0;
     }
+    elf_getphdrnum(e, &num_phdrs);
 
-    int section_idx = 0;
-    while ((scn = elf_getscn(e, section_idx)) != NULL)
+    scn = NULL;
+    while ((scn = elf_nextscn(e, scn)) != NULL)
     {
-        Elf32_Shdr *shdr = elf32_getshdr(scn);
+        GElf_Shdr shdr;
+        if (gelf_getshdr(scn, &shdr) == NULL)
+            continue;
 
-        // 64-bit target
-        if (!shdr)
+        // Symbol table
+        if (shdr.sh_type == SHT_SYMTAB)
         {
-            Elf64_Shdr *shdr64 = elf64_getshdr(scn);
-
-            if ((shdr64->sh_flags & SHF_ALLOC) && (shdr64->sh_size > 0))
+            data = elf_getdata(scn, NULL);
+            int count = (data && shdr.sh_entsize) ? (int)(shdr.sh_size / shdr.sh_entsize) : 0;
+            for (int i=0;i<count;i++)
             {
-                data = elf_getdata(scn, NULL);
-                uint64_t base_addr = shdr64->sh_addr + m_load_offset;
+                GElf_Sym sym;
+                if (gelf_getsym(data, i, &sym) == NULL || sym.st_name == 0)
+                    continue;
 
-                printf("Memory: 0x%lx - 0x%lx (Size=%ldKB) [%s]\n", shdr64->sh_addr, shdr64->sh_addr + shdr64->sh_size - 1, shdr64->sh_size / 1024, elf_strptr(e, shstrndx, shdr64->sh_name));
+                const char *name = elf_strptr(e, shdr.sh_link, sym.st_name);
 
-                // Load to physical address instead of the virtual target?
-                if (m_load_to_paddr)
-                {
-                    Elf64_Phdr *ptbl = elf64_getphdr(e);
-                    for (int i=0;i<num_phdrs;i++,ptbl++)
-                        if (base_addr == ptbl->p_vaddr)
-                        {
-                            base_addr = ptbl->p_paddr;
-                            break;
-                        }
-                }
+                // First definition wins
+                if (name && m_symbols.find(name) == m_symbols.end())
+                    m_symbols[name] = (uint32_t)sym.st_value;
 
-                if (!m_target->create_memory(base_addr, shdr64->sh_size))
+                // Address index of functions / code labels (not local
+                // labels or ARM / RISC-V mapping symbols)
+                int type = GELF_ST_TYPE(sym.st_info);
+                if (name && sym.st_shndx != SHN_UNDEF && sym.st_shndx < SHN_LORESERVE &&
+                    (type == STT_FUNC || type == STT_NOTYPE) &&
+                    name[0] != '$' && strncmp(name, ".L", 2) != 0)
                 {
-                    fprintf(stderr, "ERROR: Cannot allocate memory region\n");
-                    close (fd);
-                    return false;
-                }
+                    t_symbol entry;
+                    entry.addr = sym.st_value;
+                    entry.size = sym.st_size;
+                    entry.name = name;
 
-                if (shdr64->sh_type == SHT_PROGBITS)
-                {                
-                    int i;
-                    for (i=0;i<shdr64->sh_size;i++)
-                    {
-                        uint32_t load_addr = base_addr + i;
-                        if (m_target->valid_addr(load_addr))
-                            m_target->write(load_addr, ((uint8_t*)data->d_buf)[i]);
-                        else
-                        {
-                            fprintf(stderr, "ERROR: Cannot write byte to 0x%08x\n", load_addr);
-                            close (fd);
-                            return false;
-                        }
-                    }
+                    // Thumb functions have bit 0 set
+                    if (type == STT_FUNC)
+                        entry.addr &= ~1ULL;
+                    m_sym_index.push_back(entry);
                 }
-            }            
+            }
+            continue;
         }
-        // 32-bit target - section which need allocating
-        else if ((shdr->sh_flags & SHF_ALLOC) && (shdr->sh_size > 0))
-        {
-            data = elf_getdata(scn, NULL);
-            uint32_t base_addr = shdr->sh_addr + m_load_offset;
 
-            printf("Memory: 0x%x - 0x%x (Size=%dKB) [%s]\n", shdr->sh_addr, shdr->sh_addr + shdr->sh_size - 1, shdr->sh_size / 1024, elf_strptr(e, shstrndx, shdr->sh_name));
+        // Sections which need allocating
+        if (!(shdr.sh_flags & SHF_ALLOC) || shdr.sh_size == 0)
+            continue;
 
-            // Load to physical address instead of the virtual target?
-            if (m_load_to_paddr)
-            {
-                Elf32_Phdr *ptbl = elf32_getphdr(e);
-                for (int i=0;i<num_phdrs;i++,ptbl++)
-                    if (base_addr == ptbl->p_vaddr)
-                    {
-                        base_addr = ptbl->p_paddr;
-                        break;
-                    }
-            }
+        t_section section;
+        section.name      = elf_strptr(e, shstrndx, shdr.sh_name);
+        section.vaddr     = shdr.sh_addr;
+        section.load_addr = m_is64 ? (uint64_t)(shdr.sh_addr + m_load_offset) : (uint32_t)(shdr.sh_addr + m_load_offset);
+        section.size      = shdr.sh_size;
 
-            if (!m_target->create_memory(base_addr, shdr->sh_size))
+        // Load to physical address instead of the virtual target?
+        if (m_load_to_paddr)
+        {
+            for (size_t i=0;i<num_phdrs;i++)
             {
-                fprintf(stderr, "ERROR: Cannot allocate memory region\n");
-                close (fd);
-                return false;
-            }
-
-            if (shdr->sh_type == SHT_PROGBITS)
-            {                
-                int i;
-                for (i=0;i<shdr->sh_size;i++)
+                GElf_Phdr phdr;
+                if (gelf_getphdr(e, (int)i, &phdr) && section.load_addr == phdr.p_vaddr)
                 {
-                    uint32_t load_addr = base_addr + i;
-                    if (m_target->valid_addr(load_addr))
-                        m_target->write(load_addr, ((uint8_t*)data->d_buf)[i]);
-                    else
-                    {
-                        fprintf(stderr, "ERROR: Cannot write byte to 0x%08x\n", load_addr);
-                        close (fd);
-                        return false;
-                    }
+                    section.load_addr = phdr.p_paddr;
+                    break;
                 }
             }
         }
 
-        section_idx++;
-    }    
+        if (shdr.sh_type == SHT_PROGBITS)
+        {
+            data = elf_getdata(scn, NULL);
+            if (data && data->d_buf)
+                section.data.assign((uint8_t*)data->d_buf, (uint8_t*)data->d_buf + shdr.sh_size);
+            else
+                section.data.resize(shdr.sh_size, 0);
+        }
+
+        m_sections.push_back(section);
+    }
 
     elf_end ( e );
     close ( fd );
-    
+
+    std::stable_sort(m_sym_index.begin(), m_sym_index.end(), symbol_earlier);
+
+    m_valid = true;
     return true;
 }
 //--------------------------------------------------------------------
-// get_symbol: Get symbol from ELF
+// load: Load ELF to target
 //--------------------------------------------------------------------
-bool elf_load::get_symbol(const char *symname, uint32_t &value)
+bool elf_load::load(mem_api *target)
 {
-    bfd *ibfd;
-    asymbol **symtab;
-    long nsize, nsyms, i;
-    symbol_info syminfo;
-    char **matching;
+    if (!parse())
+        return false;
 
-    bfd_init();
+    HOST_STATS_TIMER(TIMER_LOAD);
 
-    ibfd = bfd_openr(m_filename.c_str(), NULL);
-    if (ibfd == NULL) 
+    // Memory for the sections, rounded out to whole pages and merged so
+    // that each page is owned by a single region (direct memory interface)
+    std::vector< std::pair<uint64_t, uint64_t> > regions;
+    for (size_t i=0;i<m_sections.size();i++)
     {
-        printf("ERROR: get_symbol: bfd_openr error\n");
-        return false;
+        uint64_t base = m_sections[i].load_addr & ~((uint64_t)memory_map::PAGE_SIZE-1);
+        uint64_t end  = (m_sections[i].load_addr + m_sections[i].size + memory_map::PAGE_SIZE-1) & ~((uint64_t)memory_map::PAGE_SIZE-1);
+        regions.push_back(std::make_pair(base, end));
     }
+    std::sort(regions.begin(), regions.end());
 
-    if (!bfd_check_format_matches(ibfd, bfd_object, &matching)) 
+    for (size_t i=0;i<regions.size();)
     {
-        printf("ERROR: get_symbol: format_matches\n");
-        return false;
-    }
- 
-    nsize  = bfd_get_symtab_upper_bound (ibfd);
-    symtab = (asymbol **)malloc(nsize);
-    nsyms  = bfd_canonicalize_symtab(ibfd, symtab);
+        uint64_t base = regions[i].first;
+        uint64_t end  = regions[i].second;
+        for (i++;i<regions.size() && regions[i].first <= end;i++)
+            end = std::max(end, regions[i].second);
 
-    bool found = false;
+        if (!target->create_memory((uint32_t)base, (uint32_t)(end - base)))
+        {
+            fprintf(stderr, "ERROR: Cannot allocate memory region\n");
+            return false;
+        }
+    }
 
-    for (i = 0; i < nsyms; i++)
+    for (size_t i=0;i<m_sections.size();i++)
     {
-        if (strcmp(symtab[i]->name, symname) == 0)
+        const t_section &section = m_sections[i];
+
+        if (m_is64)
+            printf("Memory: 0x%lx - 0x%lx (Size=%ldKB) [%s]\n", section.vaddr, section.vaddr + section.size - 1, section.size / 1024, section.name.c_str());
+        else
+            printf("Memory: 0x%x - 0x%x (Size=%dKB) [%s]\n", (uint32_t)section.vaddr, (uint32_t)(section.vaddr + section.size - 1), (uint32_t)(section.size / 1024), section.name.c_str());
+
+        if (!section.data.empty())
         {
-            bfd_symbol_info(symtab[i], &syminfo);
-            value = syminfo.value;
-            found = true;
-            break;
+            if (!target->write_block((uint32_t)section.load_addr, (uint8_t*)&section.data[0], section.size))
+            {
+                fprintf(stderr, "ERROR: Cannot write section to 0x%08x\n", (uint32_t)section.load_addr);
+                return false;
+            }
         }
     }
 
-    bfd_close(ibfd);    
+    return true;
+}
+//--------------------------------------------------------------------
+// get_symbol: Get symbol from ELF
+//--------------------------------------------------------------------
+bool elf_load::get_symbol(const char *symname, uint32_t &value)
+{
+    if (!parse())
+        return false;
+
+    std::map<std::string, uint32_t>::const_iterator it = m_symbols.find(symname);
+    if (it == m_symbols.end())
+        return false;
+
+    value = it->second;
+    return true;
+}
+//--------------------------------------------------------------------
+// get_symbol_name: Find the function containing an address
+//--------------------------------------------------------------------
+const char *elf_load::get_symbol_name(uint64_t addr, uint64_t *sym_addr /*= NULL*/)
+{
+    if (!parse() || m_sym_index.empty())
+        return NULL;
+
+    // Last symbol at or before addr
+    t_symbol key;
+    key.addr = addr;
+    std::vector<t_symbol>::const_iterator it = std::upper_bound(m_sym_index.begin(), m_sym_index.end(), key, symbol_earlier);
+    if (it == m_sym_index.begin())
+        return NULL;
+    --it;
+
+    // Prefer a sized symbol (function) over a label at the same address
+    std::vector<t_symbol>::const_iterator first = it;
+    while (first != m_sym_index.begin() && (first - 1)->addr == it->addr)
+        --first;
+    for (std::vector<t_symbol>::const_iterator s = first; s <= it; ++s)
+        if (s->size)
+        {
+            it = s;
+            break;
+        }
+
+    if (it->size && addr >= it->addr + it->size)
+        return NULL;
 
-    return found;
+    if (sym_addr)
+        *sym_addr = it->addr;
+    return it->name.c_str();
 }
@@ -10,25 +10,61 @@
 
 #include "mem_api.h"
 #include <string>
+#include <vector>
+#include <map>
 
 //--------------------------------------------------------------------
 // ELF loader
 //--------------------------------------------------------------------
+// The file is read once (parse()); the parsed image is read-only
+// afterwards and may be loaded into several targets concurrently.
 class elf_load
 {
 public:
     elf_load(const char *filename, mem_api *target, bool load_to_paddr = false, int64_t load_offset = 0);
 
-    bool     load(void);
+    bool     parse(void);
+    bool     load(void) { return load(m_target); }
+    bool     load(mem_api *target);
     uint32_t get_entry_point(void) { return m_entry_point; }
     bool     get_symbol(const char *symname, uint32_t &value);
 
+    // Function containing addr (sorted symbol index), NULL if none
+    const char *get_symbol_name(uint64_t addr, uint64_t *sym_addr = NULL);
+
+protected:
+    typedef struct
+    {
+        std::string          name;
+        uint64_t             vaddr;
+        uint64_t             load_addr;
+        uint64_t             size;
+        std::vector<uint8_t> data;  // Empty if not loaded from file (SHT_NOBITS)
+    } t_section;
+
+    typedef struct
+    {
+        uint64_t             addr;
+        uint64_t             size;  // 0 if unknown (extends to the next symbol)
+        std::string          name;
+    } t_symbol;
+
+    static bool symbol_earlier(const t_symbol &a, const t_symbol &b) { return a.addr < b.addr; }
+
 protected:
     std::string m_filename;
     mem_api *   m_target;
     uint32_t    m_entry_point;
     bool        m_load_to_paddr;
     int64_t     m_load_offset;
+
+    // Parsed image
+    bool        m_parsed;
+    bool        m_valid;
+    bool        m_is64;
+    std::vector<t_section> m_sections;
+    std::map<std::string, uint32_t> m_symbols;
+    std::vector<t_symbol> m_sym_index;  // Code symbols, sorted by address
 };
 
 #endif
@@ -0,0 +1,175 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include "host_stats.h"
+
+#ifdef INCLUDE_HOST_STATS
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include "memory.h"
+
+//-----------------------------------------------------------------
+// Locals
+//-----------------------------------------------------------------
+host_stats::t_timer        host_stats::m_timers[TIMER_MAX];
+std::atomic<uint64_t>      host_stats::m_counters[COUNT_MAX];
+
+static const char *timer_names[host_stats::TIMER_MAX] =
+{
+    "mmu_walk",
+    "devices",
+    "virtio_request",
+    "console_getchar",
+    "load"
+};
+
+static const char *counter_names[host_stats::COUNT_MAX] =
+{
+    "tlb_hit",
+    "tlb_miss",
+    "soft_tlb_hit",
+    "soft_tlb_miss",
+    "decode_hit",
+    "decode_miss",
+    "block_hit",
+    "block_miss"
+};
+
+typedef std::chrono::steady_clock t_clock;
+
+static std::mutex                  m_lock;
+static std::vector<memory_base *>  m_memories;
+static FILE                       *m_file;
+static double                      m_interval;
+static t_clock::time_point         m_start_time;
+static t_clock::time_point         m_last_time;
+static uint64_t                    m_start_ticks;
+static uint64_t                    m_last_cycles;
+
+//-----------------------------------------------------------------
+// add_memory: Track accesses to a memory / device
+//-----------------------------------------------------------------
+void host_stats::add_memory(memory_base *mem)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_memories.push_back(mem);
+}
+//-----------------------------------------------------------------
+// remove_memory: Memory / device destroyed
+//-----------------------------------------------------------------
+void host_stats::remove_memory(memory_base *mem)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_memories.erase(std::remove(m_memories.begin(), m_memories.end(), mem), m_memories.end());
+}
+//-----------------------------------------------------------------
+// open: Create stats file (dumped every interval seconds)
+//-----------------------------------------------------------------
+bool host_stats::open(const char *filename, double interval)
+{
+    m_file = fopen(filename, "w");
+    if (!m_file)
+    {
+        fprintf(stderr, "ERROR: Host stats: Could not create '%s'\n", filename);
+        return false;
+    }
+
+    m_interval    = interval;
+    m_start_time  = t_clock::now();
+    m_last_time   = m_start_time;
+    m_start_ticks = ticks();
+    m_last_cycles = 0;
+    return true;
+}
+//-----------------------------------------------------------------
+// poll: Dump if the interval has elapsed
+//-----------------------------------------------------------------
+void host_stats::poll(uint64_t cycles)
+{
+    if (m_file && std::chrono::duration<double>(t_clock::now() - m_last_time).count() >= m_interval)
+        dump(cycles);
+}
+//-----------------------------------------------------------------
+// close: Final dump
+//-----------------------------------------------------------------
+void host_stats::close(uint64_t cycles)
+{
+    if (!m_file)
+        return;
+
+    dump(cycles);
+    fclose(m_file);
+    m_file = NULL;
+}
+//-----------------------------------------------------------------
+// dump: Write one JSON object (totals since open)
+//-----------------------------------------------------------------
+void host_stats::dump(uint64_t cycles)
+{
+    t_clock::time_point now = t_clock::now();
+    double   elapsed = std::chrono::duration<double>(now - m_start_time).count();
+    double   period  = std::chrono::duration<double>(now - m_last_time).count();
+    uint64_t tsc     = ticks() - m_start_ticks;
+
+    // Host ticks per ms (TSC calibrated against the wall clock)
+    double tick_ms = (elapsed > 0) ? (tsc / (elapsed * 1000.0)) : 1.0;
+
+    fprintf(m_file, "{\"time\": %.3f, \"cycles\": %llu, \"mips\": %.2f, \"mips_avg\": %.2f",
+            elapsed, (unsigned long long)cycles,
+            period  > 0 ? (cycles - m_last_cycles) / (period * 1e6) : 0.0,
+            elapsed > 0 ? (cycles / (elapsed * 1e6)) : 0.0);
+
+    fprintf(m_file, ", \"timers\": {");
+    for (int i=0;i<TIMER_MAX;i++)
+    {
+        uint64_t t = m_timers[i].ticks.load(std::memory_order_relaxed);
+        fprintf(m_file, "%s\"%s\": {\"calls\": %llu, \"ticks\": %llu, \"ms\": %.3f}", i ? ", " : "", timer_names[i],
+                (unsigned long long)m_timers[i].calls.load(std::memory_order_relaxed),
+                (unsigned long long)t, t / tick_ms);
+    }
+
+    fprintf(m_file, "}, \"counters\": {");
+    for (int i=0;i<COUNT_MAX;i++)
+        fprintf(m_file, "%s\"%s\": %llu", i ? ", " : "", counter_names[i],
+                (unsigned long long)m_counters[i].load(std::memory_order_relaxed));
+
+    fprintf(m_file, "}, \"mmio\": [");
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        bool first = true;
+        for (size_t i=0;i<m_memories.size();i++)
+        {
+            uint64_t accesses = m_memories[i]->host_accesses.load(std::memory_order_relaxed);
+            if (!accesses)
+                continue;
+
+            fprintf(m_file, "%s{\"name\": \"%s\", \"base\": \"0x%08x\", \"accesses\": %llu}", first ? "" : ", ",
+                    m_memories[i]->get_name().c_str(), m_memories[i]->get_base(), (unsigned long long)accesses);
+            first = false;
+        }
+    }
+    fprintf(m_file, "]}\n");
+    fflush(m_file);
+
+    m_last_time   = now;
+    m_last_cycles = cycles;
+}
+
+#else
+
+//-----------------------------------------------------------------
+// open: Not built with host stats
+//-----------------------------------------------------------------
+bool host_stats::open(const char *filename, double interval)
+{
+    fprintf(stderr, "ERROR: Host stats not enabled (build with HAS_HOST_STATS=True)\n");
+    return false;
+}
+
+#endif
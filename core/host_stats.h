@@ -0,0 +1,139 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __HOST_STATS_H__
+#define __HOST_STATS_H__
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Default interval between dumps (seconds)
+#define HOST_STATS_INTERVAL_DEFAULT     1
+
+//-----------------------------------------------------------------
+// Host side instrumentation (make HAS_HOST_STATS=True).
+//-----------------------------------------------------------------
+// Host time spent in simulator subsystems (TSC ticks, inclusive of
+// nested timers) and event counters, dumped periodically as one JSON
+// object per line. Without INCLUDE_HOST_STATS the hooks are empty and
+// host_stats::open() fails.
+#ifdef INCLUDE_HOST_STATS
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class memory_base;
+
+class host_stats
+{
+public:
+    enum eTimer
+    {
+        TIMER_MMU_WALK,         // Page table walks (TLB miss)
+        TIMER_DEVICES,          // Device clock() calls from cpu::step
+        TIMER_VIRTIO_REQUEST,   // VirtIO block requests
+        TIMER_CONSOLE_GETCHAR,  // Console input polling
+        TIMER_LOAD,             // ELF / binary loaders
+        TIMER_MAX
+    };
+
+    enum eCounter
+    {
+        COUNT_TLB_HIT,          // MMU TLB (translation enabled)
+        COUNT_TLB_MISS,
+        COUNT_SOFT_TLB_HIT,     // VA -> host pointer cache
+        COUNT_SOFT_TLB_MISS,
+        COUNT_DECODE_HIT,       // Pre-decoded instruction cache
+        COUNT_DECODE_MISS,
+        COUNT_BLOCK_HIT,        // Basic block cache (lookups, not chained)
+        COUNT_BLOCK_MISS,
+        COUNT_MAX
+    };
+
+    static void     count(int c)                { m_counters[c].fetch_add(1, std::memory_order_relaxed); }
+    static void     timer(int t, uint64_t ticks)
+    {
+        m_timers[t].calls.fetch_add(1, std::memory_order_relaxed);
+        m_timers[t].ticks.fetch_add(ticks, std::memory_order_relaxed);
+    }
+
+    // Host timestamp (TSC where available)
+    static uint64_t ticks(void)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // Memories / devices (accesses after a host pointer miss, i.e. MMIO)
+    static void     add_memory(memory_base *mem);
+    static void     remove_memory(memory_base *mem);
+
+    // Periodic dump (every interval seconds, from poll())
+    static bool     open(const char *filename, double interval);
+    static void     poll(uint64_t cycles);
+    static void     close(uint64_t cycles);
+
+protected:
+    static void     dump(uint64_t cycles);
+
+protected:
+    typedef struct
+    {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> ticks;
+    } t_timer;
+
+    static t_timer                m_timers[TIMER_MAX];
+    static std::atomic<uint64_t>  m_counters[COUNT_MAX];
+};
+
+//-----------------------------------------------------------------
+// host_stats_timer: Scoped timer
+//-----------------------------------------------------------------
+class host_stats_timer
+{
+public:
+    host_stats_timer(int t): m_timer(t), m_start(host_stats::ticks()) { }
+   ~host_stats_timer() { host_stats::timer(m_timer, host_stats::ticks() - m_start); }
+
+private:
+    int      m_timer;
+    uint64_t m_start;
+};
+
+#define HOST_STATS_TIMER(t)         host_stats_timer __host_stats_timer(host_stats::t)
+#define HOST_STATS_COUNT(c)         host_stats::count(host_stats::c)
+#define HOST_STATS_HIT(hit, h, m)   host_stats::count((hit) ? host_stats::h : host_stats::m)
+#define HOST_STATS_MMIO(mem)        do { if (mem) (mem)->host_accesses.fetch_add(1, std::memory_order_relaxed); } while (0)
+
+#else
+
+class host_stats
+{
+public:
+    static bool     open(const char *filename, double interval); // Reports the build option
+    static void     poll(uint64_t cycles) { }
+    static void     close(uint64_t cycles) { }
+};
+
+#define HOST_STATS_TIMER(t)
+#define HOST_STATS_COUNT(c)         do { } while (0)
+#define HOST_STATS_HIT(hit, h, m)   do { } while (0)
+#define HOST_STATS_MMIO(mem)        do { } while (0)
+
+#endif
+
+#endif
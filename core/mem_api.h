@@ -20,6 +20,7 @@ public:
     virtual bool    valid_addr(uint32_t addr) = 0;
     virtual void    write(uint32_t addr, uint8_t data) = 0;
     virtual uint8_t read(uint32_t addr) = 0;
+    virtual bool    write_block(uint32_t addr, uint8_t *data, int length) = 0;
 };
 
 #endif
\ No newline at end of file
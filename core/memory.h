@@ -11,6 +11,109 @@
 #include <stdint.h>
 #include <string>
 #include <string.h>
+#include "host_stats.h"
+
+//--------------------------------------------------------------------
+// Host memory helpers (guest memory is little endian)
+//--------------------------------------------------------------------
+static inline uint16_t mem_load16(const uint8_t *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap16(v);
+#endif
+    return v;
+}
+static inline uint32_t mem_load32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+static inline uint64_t mem_load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+static inline void mem_store16(uint8_t *p, uint16_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap16(v);
+#endif
+    memcpy(p, &v, sizeof(v));
+}
+static inline void mem_store32(uint8_t *p, uint32_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    memcpy(p, &v, sizeof(v));
+}
+static inline void mem_store64(uint8_t *p, uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    memcpy(p, &v, sizeof(v));
+}
+
+//--------------------------------------------------------------------
+// Atomic accessors (naturally aligned host memory, shared between harts)
+// mem_cas: Store v if the word holds *expected, else return the current
+// value in *expected.
+//--------------------------------------------------------------------
+static inline uint32_t mem_atomic_load32(uint8_t *p)
+{
+    uint32_t v = __atomic_load_n((uint32_t *)p, __ATOMIC_SEQ_CST);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+static inline uint64_t mem_atomic_load64(uint8_t *p)
+{
+    uint64_t v = __atomic_load_n((uint64_t *)p, __ATOMIC_SEQ_CST);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+static inline bool mem_cas32(uint8_t *p, uint32_t *expected, uint32_t v)
+{
+    uint32_t e = *expected;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    e = __builtin_bswap32(e);
+    v = __builtin_bswap32(v);
+#endif
+    bool ok = __atomic_compare_exchange_n((uint32_t *)p, &e, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    e = __builtin_bswap32(e);
+#endif
+    *expected = e;
+    return ok;
+}
+static inline bool mem_cas64(uint8_t *p, uint64_t *expected, uint64_t v)
+{
+    uint64_t e = *expected;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    e = __builtin_bswap64(e);
+    v = __builtin_bswap64(v);
+#endif
+    bool ok = __atomic_compare_exchange_n((uint64_t *)p, &e, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    e = __builtin_bswap64(e);
+#endif
+    *expected = e;
+    return ok;
+}
 
 //--------------------------------------------------------------------
 // Base interface for memories / devices
@@ -25,9 +128,21 @@ public:
     {
         m_trace     = false;
         next        = NULL;        
+#ifdef INCLUDE_HOST_STATS
+        host_accesses = 0;
+        host_stats::add_memory(this);
+#endif
+    }
+    virtual ~memory_base()
+    {
+#ifdef INCLUDE_HOST_STATS
+        host_stats::remove_memory(this);
+#endif
     }
 
     std::string get_name(void)     { return m_name; }
+    uint32_t    get_base(void)     { return m_base; }
+    uint32_t    get_size(void)     { return m_size; }
     void enable_trace(bool en)     { m_trace = en; }
 
     // Reset / Init
@@ -116,12 +231,25 @@ public:
     // Min access width
     virtual int min_access_size(void) { return 1; }
 
+    // Direct memory interface: host buffer backing [base, base+size).
+    // Returns NULL for regions with side effects (devices / MMIO).
+    virtual uint8_t *get_dmi(uint32_t &base, uint32_t &size) { return NULL; }
+
     // Clock: Clock peripheral (returns next call cycle delta)
+    // cycles is the absolute cycle count (may advance by more than one
+    // between calls). Return N > 0 to be called again in N cycles, 0 to be
+    // polled on every step or CLOCK_IDLE to sleep until woken (device).
+    static const int CLOCK_IDLE = 0x7FFFFFFF;
     virtual int clock(uint64_t cycles) { return 0; }
 
 public:
     memory_base *next;
 
+#ifdef INCLUDE_HOST_STATS
+    // Accesses not served from a host pointer (host_stats)
+    std::atomic<uint64_t> host_accesses;
+#endif
+
 protected:
     const uint32_t    m_base;
     const uint32_t    m_size;
@@ -137,6 +265,7 @@ class memory: public memory_base
 public:
     memory(std::string name, uint32_t base, uint32_t size, uint8_t * buf = NULL): memory_base(name, base, size)
     {
+        m_own = (buf == NULL && size != 0);
         if (buf)
             m_mem = buf;
         else if (size)
@@ -144,6 +273,11 @@ public:
         else
             m_mem = NULL;
     }
+    ~memory()
+    {
+        if (m_own)
+            delete [] m_mem;
+    }
 
     virtual void reset(void)
     {
@@ -169,8 +303,65 @@ public:
         return false;
     }
 
+    // Native width accesses
+    bool write16(uint32_t addr, uint32_t data)
+    {
+        if (m_trace || !in_range(addr, 2))
+            return memory_base::write16(addr, data);
+        mem_store16(&m_mem[addr - m_base], data);
+        return true;
+    }
+    bool write32(uint32_t addr, uint32_t data)
+    {
+        if (m_trace || !in_range(addr, 4))
+            return memory_base::write32(addr, data);
+        mem_store32(&m_mem[addr - m_base], data);
+        return true;
+    }
+    bool read16(uint32_t addr, uint16_t &data)
+    {
+        if (m_trace || !in_range(addr, 2))
+            return memory_base::read16(addr, data);
+        data = mem_load16(&m_mem[addr - m_base]);
+        return true;
+    }
+    bool read32(uint32_t addr, uint32_t &data)
+    {
+        if (m_trace || !in_range(addr, 4))
+            return memory_base::read32(addr, data);
+        data = mem_load32(&m_mem[addr - m_base]);
+        return true;
+    }
+    bool write_block(uint32_t addr, uint8_t *data, int length)
+    {
+        if (m_trace || !in_range(addr, length))
+            return memory_base::write_block(addr, data, length);
+        memcpy(&m_mem[addr - m_base], data, length);
+        return true;
+    }
+    bool read_block(uint32_t addr, uint8_t *data, int length)
+    {
+        if (m_trace || !in_range(addr, length))
+            return memory_base::read_block(addr, data, length);
+        memcpy(data, &m_mem[addr - m_base], length);
+        return true;
+    }
+
+    uint8_t *get_dmi(uint32_t &base, uint32_t &size)
+    {
+        if (m_trace || !m_mem)
+            return NULL;
+        base = m_base;
+        size = m_size;
+        return m_mem;
+    }
+
+protected:
+    bool in_range(uint32_t addr, uint32_t len) { return (addr - m_base) < m_size && len <= (m_size - (addr - m_base)); }
+
 protected:
     uint8_t  *m_mem;
+    bool      m_own;
 };
 
 #endif
@@ -0,0 +1,84 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "memory_map.h"
+
+uint8_t memory_map::m_partial_marker;
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+memory_map::memory_map()
+{
+    for (uint32_t i=0;i<L1_ENTRIES;i++)
+        m_l1[i] = NULL;
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+memory_map::~memory_map()
+{
+    for (uint32_t i=0;i<L1_ENTRIES;i++)
+        delete [] m_l1[i];
+}
+//-----------------------------------------------------------------
+// set_page: Set region owning a page
+//-----------------------------------------------------------------
+void memory_map::set_page(uint32_t page, memory_base *mem, uint8_t *host)
+{
+    t_page *l2 = m_l1[page >> L2_BITS];
+    if (!l2)
+    {
+        l2 = new t_page[L2_ENTRIES];
+        for (uint32_t i=0;i<L2_ENTRIES;i++)
+        {
+            l2[i].mem  = NULL;
+            l2[i].host = NULL;
+        }
+        m_l1[page >> L2_BITS] = l2;
+    }
+
+    l2[page & (L2_ENTRIES-1)].mem  = mem;
+    l2[page & (L2_ENTRIES-1)].host = host;
+}
+//-----------------------------------------------------------------
+// add: Add region to the map (overrides earlier regions)
+//-----------------------------------------------------------------
+void memory_map::add(memory_base *mem)
+{
+    uint64_t base = mem->get_base();
+    uint64_t end  = base + mem->get_size();
+    uint64_t page_size = PAGE_SIZE;
+
+    if (end > ((uint64_t)1 << 32))
+        end = ((uint64_t)1 << 32);
+
+    // Directly backed by host memory?
+    uint32_t dmi_base = 0;
+    uint32_t dmi_size = 0;
+    uint8_t *dmi      = mem->get_dmi(dmi_base, dmi_size);
+
+    for (uint64_t addr = base & ~(page_size-1); addr < end; addr += page_size)
+    {
+        uint32_t page = addr >> PAGE_SHIFT;
+
+        // Region covers the whole page - it takes precedence over any earlier ones
+        if (base <= addr && end >= (addr + page_size))
+        {
+            uint8_t *host = NULL;
+            if (dmi && addr >= dmi_base && (addr + page_size) <= ((uint64_t)dmi_base + dmi_size))
+                host = dmi + (addr - dmi_base);
+
+            set_page(page, mem, host);
+        }
+        // Page shared with other regions (or holes) - resolve on access
+        else
+            set_page(page, partial(), NULL);
+    }
+}
@@ -0,0 +1,85 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __MEMORY_MAP_H__
+#define __MEMORY_MAP_H__
+
+#include <stdint.h>
+#include "memory.h"
+
+//--------------------------------------------------------------------
+// memory_map: Page granular physical address -> memory_base lookup
+//--------------------------------------------------------------------
+// Two level radix table over the 32-bit physical address space.
+// Each page entry is either:
+// - NULL:        nothing mapped in this page
+// - memory_base: the page is wholly owned by a single region
+// - MAP_PARTIAL: multiple/partial regions share this page, the
+//                caller must fall back to a search of the region list
+// Pages wholly owned by a region with a direct memory interface
+// (see memory_base::get_dmi) also record the backing host pointer.
+class memory_map
+{
+public:
+    static const int      PAGE_SHIFT  = 12;
+    static const uint32_t PAGE_SIZE   = 1 << PAGE_SHIFT;
+    static const int      L2_BITS     = 10;
+    static const int      L1_BITS     = 32 - PAGE_SHIFT - L2_BITS;
+    static const uint32_t L1_ENTRIES  = 1 << L1_BITS;
+    static const uint32_t L2_ENTRIES  = 1 << L2_BITS;
+
+                        memory_map();
+                       ~memory_map();
+
+    // Add a region (higher priority than all previously added)
+    void                add(memory_base *mem);
+
+    // Lookup region for an address (list must be the priority ordered region list)
+    memory_base *       find(uint32_t addr, memory_base *list)
+    {
+        t_page *l2 = m_l1[addr >> (PAGE_SHIFT + L2_BITS)];
+        if (!l2)
+            return NULL;
+
+        memory_base *mem = l2[(addr >> PAGE_SHIFT) & (L2_ENTRIES-1)].mem;
+        if (mem != partial())
+            return mem;
+
+        for (mem = list; mem != NULL; mem = mem->next)
+            if (mem->valid_addr(addr))
+                return mem;
+
+        return NULL;
+    }
+
+    // Lookup host pointer for an address (NULL if not directly backed).
+    // The pointer is valid up to the end of the containing page.
+    uint8_t *           find_host(uint32_t addr)
+    {
+        t_page *l2 = m_l1[addr >> (PAGE_SHIFT + L2_BITS)];
+        if (!l2)
+            return NULL;
+
+        uint8_t *host = l2[(addr >> PAGE_SHIFT) & (L2_ENTRIES-1)].host;
+        return host ? (host + (addr & (PAGE_SIZE-1))) : NULL;
+    }
+
+private:
+    typedef struct
+    {
+        memory_base *mem;
+        uint8_t     *host;
+    } t_page;
+
+    static memory_base *partial(void) { return (memory_base *)&m_partial_marker; }
+    void                set_page(uint32_t page, memory_base *mem, uint8_t *host);
+
+    static uint8_t      m_partial_marker;
+    t_page *            m_l1[L1_ENTRIES];
+};
+
+#endif
@@ -0,0 +1,154 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <set>
+#include <algorithm>
+#include "profiler.h"
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+profiler::profiler()
+{
+    m_samples = 0;
+}
+//-----------------------------------------------------------------
+// branch_call: Push a frame
+//-----------------------------------------------------------------
+void profiler::branch_call(uint64_t src, uint64_t dst)
+{
+    if (m_stack.size() == PROFILE_STACK_MAX)
+        m_stack.erase(m_stack.begin());
+
+    t_frame frame;
+    frame.call_pc = src;
+    frame.func_pc = dst;
+    m_stack.push_back(frame);
+}
+//-----------------------------------------------------------------
+// branch_ret: Pop to the frame called from just before the return
+// address (frames left by longjmp / tail calls are dropped too)
+//-----------------------------------------------------------------
+void profiler::branch_ret(uint64_t src, uint64_t dst)
+{
+    for (int i=(int)m_stack.size()-1;i>=0;i--)
+    {
+        if (dst > m_stack[i].call_pc && dst <= m_stack[i].call_pc + PROFILE_CALL_MAX)
+        {
+            m_stack.resize(i);
+            return;
+        }
+    }
+
+    // Unknown return address (e.g. called before profiling started)
+}
+//-----------------------------------------------------------------
+// sample: Count the current call chain
+//-----------------------------------------------------------------
+void profiler::sample(uint64_t pc)
+{
+    m_chain.resize(m_stack.size() + 1);
+    for (unsigned i=0;i<m_stack.size();i++)
+        m_chain[i] = m_stack[i].func_pc;
+    m_chain[m_stack.size()] = pc;
+
+    m_chains[m_chain]++;
+    m_samples++;
+}
+//-----------------------------------------------------------------
+// symbol: Function name for an address
+//-----------------------------------------------------------------
+std::string profiler::symbol(elf_load *symbols, uint64_t addr)
+{
+    const char *name = symbols ? symbols->get_symbol_name(addr) : NULL;
+    if (name)
+        return std::string(name);
+
+    char str[32];
+    sprintf(str, "0x%08llx", (unsigned long long)addr);
+    return std::string(str);
+}
+//-----------------------------------------------------------------
+// write: Write the flat profile (FILE) and folded stacks (FILE.folded)
+//-----------------------------------------------------------------
+bool profiler::write(const char *filename, elf_load *symbols)
+{
+    std::map<std::string, uint64_t> folded;
+    std::map<std::string, uint64_t> self;
+    std::map<std::string, uint64_t> cumulative;
+    std::map<uint64_t, std::string> names;
+
+    for (std::map<std::vector<uint64_t>, uint64_t>::const_iterator it = m_chains.begin(); it != m_chains.end(); ++it)
+    {
+        const std::vector<uint64_t> &chain = it->first;
+        std::string           stack;
+        std::set<std::string> seen;
+        std::string           prev;
+
+        for (unsigned i=0;i<chain.size();i++)
+        {
+            std::map<uint64_t, std::string>::iterator n = names.find(chain[i]);
+            if (n == names.end())
+                n = names.insert(std::make_pair(chain[i], symbol(symbols, chain[i]))).first;
+            const std::string &name = n->second;
+
+            // Leaf PC within the innermost called function
+            bool same_func = (i == chain.size() - 1) && i && (name == prev);
+            if (!same_func)
+            {
+                if (!stack.empty())
+                    stack += ";";
+                stack += name;
+            }
+            prev = name;
+
+            // Recursive functions are counted once per sample
+            if (seen.insert(name).second)
+                cumulative[name] += it->second;
+        }
+
+        self[prev]     += it->second;
+        folded[stack]  += it->second;
+    }
+
+    // Flat profile, hottest first
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        return false;
+
+    std::vector<std::pair<uint64_t, std::string> > order;
+    for (std::map<std::string, uint64_t>::const_iterator it = cumulative.begin(); it != cumulative.end(); ++it)
+        order.push_back(std::make_pair(self[it->first], it->first));
+    std::sort(order.begin(), order.end());
+    std::reverse(order.begin(), order.end());
+
+    double total = m_samples ? (double)m_samples : 1.0;
+    fprintf(f, "# Samples: %llu\n", (unsigned long long)m_samples);
+    fprintf(f, "#     Self      %%      Cumul      %%  Function\n");
+    for (unsigned i=0;i<order.size();i++)
+    {
+        uint64_t cumul = cumulative[order[i].second];
+        fprintf(f, "%10llu %6.2f%% %10llu %6.2f%%  %s\n",
+                (unsigned long long)order[i].first, (order[i].first * 100.0) / total,
+                (unsigned long long)cumul, (cumul * 100.0) / total,
+                order[i].second.c_str());
+    }
+    fclose(f);
+
+    // Folded stacks
+    std::string folded_file = std::string(filename) + ".folded";
+    f = fopen(folded_file.c_str(), "w");
+    if (!f)
+        return false;
+
+    for (std::map<std::string, uint64_t>::const_iterator it = folded.begin(); it != folded.end(); ++it)
+        fprintf(f, "%s %llu\n", it->first.c_str(), (unsigned long long)it->second);
+    fclose(f);
+
+    return true;
+}
@@ -0,0 +1,75 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "cpu_monitor.h"
+#include "elf_load.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Default sample period (instructions)
+#define PROFILE_INTERVAL_DEFAULT    1000
+
+// Deepest call stack tracked (outermost frames are dropped)
+#define PROFILE_STACK_MAX           128
+
+// Largest call instruction (incl. delay slot), return address range
+#define PROFILE_CALL_MAX            8
+
+//-----------------------------------------------------------------
+// profiler: Statistical PC sampling profiler
+//-----------------------------------------------------------------
+// The caller samples the PC periodically (e.g. every N instructions
+// from the run loop). Calls and returns are tracked as a monitor to
+// keep a shadow call stack, so each sample records the call chain.
+// Samples are symbolized on write();
+//   FILE         Flat (self) and cumulative (incl. callees) samples
+//                per function, hottest first
+//   FILE.folded  Folded stacks ('outer;inner;leaf count') for
+//                flamegraph.pl and similar tools
+class profiler: public cpu_monitor
+{
+public:
+                profiler();
+
+    // Record the current call chain with a leaf PC
+    void        sample(uint64_t pc);
+    uint64_t    get_samples(void) { return m_samples; }
+
+    // Symbolize (against an ELF, or NULL for addresses) and write
+    bool        write(const char *filename, elf_load *symbols);
+
+    // cpu_monitor
+    void        branch_call(uint64_t src, uint64_t dst);
+    void        branch_ret(uint64_t src, uint64_t dst);
+
+private:
+    std::string symbol(elf_load *symbols, uint64_t addr);
+
+private:
+    typedef struct
+    {
+        uint64_t call_pc;
+        uint64_t func_pc;
+    } t_frame;
+
+    std::vector<t_frame> m_stack;
+    uint64_t    m_samples;
+
+    // Sample counts by call chain (function entry PCs, then leaf PC)
+    std::map<std::vector<uint64_t>, uint64_t> m_chains;
+    std::vector<uint64_t> m_chain;
+};
+
+#endif
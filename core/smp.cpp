@@ -0,0 +1,241 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <assert.h>
+#include "smp.h"
+#include "cpu.h"
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+smp::smp(uint32_t quantum /*= SMP_QUANTUM*/)
+{
+    m_quantum      = quantum ? quantum : 1;
+    m_started      = false;
+    m_threads      = false;
+    m_sync_gen     = 0;
+    m_sync_end     = 0;
+    m_sync_stop_pc = cpu::RUN_NO_STOP_PC;
+    m_sync_pending = 0;
+    m_sync_exit    = false;
+}
+//-----------------------------------------------------------------
+// Destructor: Stop the hart threads
+//-----------------------------------------------------------------
+smp::~smp()
+{
+    stop_threads();
+
+    for (unsigned i=0;i<m_harts.size();i++)
+        delete m_harts[i];
+}
+//-----------------------------------------------------------------
+// stop_threads: Stop the secondary hart threads (between run() calls)
+//-----------------------------------------------------------------
+void smp::stop_threads(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sync_lock);
+        m_sync_exit = true;
+    }
+    m_sync_start.notify_all();
+
+    for (unsigned i=0;i<m_harts.size();i++)
+    {
+        if (m_harts[i]->thread)
+        {
+            m_harts[i]->thread->join();
+            delete m_harts[i]->thread;
+            m_harts[i]->thread = NULL;
+        }
+    }
+
+    m_sync_exit = false;
+    m_threads   = false;
+}
+//-----------------------------------------------------------------
+// add_hart: Add a hart to the group
+//-----------------------------------------------------------------
+bool smp::add_hart(cpu *hart)
+{
+    assert(!m_started);
+
+    t_hart *h = new t_hart;
+    h->hart   = hart;
+    h->cycles = 0;
+    h->status = cpu::RUN_BUDGET;
+    h->thread = NULL;
+    h->reservation = SMP_NO_RESERVATION;
+
+    // Secondary harts count cycles locally (the boot hart uses the
+    // counter passed to run())
+    if (!m_harts.empty())
+        hart->set_cycle_counter(&h->cycles);
+
+    hart->set_smp(this, (int)m_harts.size());
+    m_harts.push_back(h);
+    return true;
+}
+//-----------------------------------------------------------------
+// reserve: LR reservation of hart id on the granule holding addr
+// (set before LR reads the word, so a later store breaks it)
+//-----------------------------------------------------------------
+void smp::reserve(int id, uint64_t addr)
+{
+    m_harts[id]->reservation = addr & ~(uint64_t)(SMP_RESERVE_GRANULE-1);
+}
+//-----------------------------------------------------------------
+// take_reservation: Release the reservation of hart id, true if it
+// still covered addr
+//-----------------------------------------------------------------
+bool smp::take_reservation(int id, uint64_t addr)
+{
+    uint64_t granule = addr & ~(uint64_t)(SMP_RESERVE_GRANULE-1);
+    return m_harts[id]->reservation.exchange(SMP_NO_RESERVATION) == granule;
+}
+//-----------------------------------------------------------------
+// break_reservations: Store from hart id, other harts lose their
+// reservation on the granule holding addr
+//-----------------------------------------------------------------
+void smp::break_reservations(int id, uint64_t addr)
+{
+    uint64_t granule = addr & ~(uint64_t)(SMP_RESERVE_GRANULE-1);
+
+    for (unsigned i=0;i<m_harts.size();i++)
+    {
+        uint64_t held = granule;
+        if ((int)i != id)
+            m_harts[i]->reservation.compare_exchange_strong(held, SMP_NO_RESERVATION);
+    }
+}
+//-----------------------------------------------------------------
+// start: Share the boot hart's memory map and start the hart threads
+// (memories may be added to the boot hart until the first run())
+//-----------------------------------------------------------------
+void smp::start(uint64_t cycles)
+{
+    m_started = true;
+
+    cpu *boot = m_harts[0]->hart;
+    for (unsigned i=1;i<m_harts.size();i++)
+        m_harts[i]->hart->share_memory(boot);
+
+    start_threads(cycles);
+}
+//-----------------------------------------------------------------
+// start_threads: Start a thread per secondary hart, from the boot
+// hart's cycle count
+//-----------------------------------------------------------------
+void smp::start_threads(uint64_t cycles)
+{
+    m_threads = true;
+
+    for (unsigned i=1;i<m_harts.size();i++)
+    {
+        t_hart *h = m_harts[i];
+        h->cycles = cycles;
+        h->thread = new std::thread(&smp::worker, this, h, m_sync_gen);
+    }
+}
+//-----------------------------------------------------------------
+// run_hart: Run a hart up to an absolute cycle (device events are not
+// a reason to stop)
+//-----------------------------------------------------------------
+int smp::run_hart(cpu *hart, uint64_t &cycles, uint64_t end, uint64_t stop_pc)
+{
+    while (cycles < end)
+    {
+        int status = hart->run(cycles, end - cycles, stop_pc);
+        if (status != cpu::RUN_BUDGET && status != cpu::RUN_EVENT)
+            return status;
+    }
+
+    return cpu::RUN_BUDGET;
+}
+//-----------------------------------------------------------------
+// worker: Secondary hart thread, one quantum per barrier generation
+// (after generation gen)
+//-----------------------------------------------------------------
+void smp::worker(t_hart *h, uint64_t gen)
+{
+    for (;;)
+    {
+        uint64_t end;
+        uint64_t stop_pc;
+        {
+            std::unique_lock<std::mutex> lock(m_sync_lock);
+            while (m_sync_gen == gen && !m_sync_exit)
+                m_sync_start.wait(lock);
+
+            if (m_sync_exit)
+                return;
+
+            gen     = m_sync_gen;
+            end     = m_sync_end;
+            stop_pc = m_sync_stop_pc;
+        }
+
+        h->status = run_hart(h->hart, h->cycles, end, stop_pc);
+
+        {
+            std::lock_guard<std::mutex> lock(m_sync_lock);
+            if (--m_sync_pending == 0)
+                m_sync_done.notify_one();
+        }
+    }
+}
+//-----------------------------------------------------------------
+// run: Run all harts in lock-step quanta
+//-----------------------------------------------------------------
+int smp::run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc)
+{
+    if (m_harts.empty())
+        return cpu::RUN_STOPPED;
+
+    if (!m_started)
+        start(cycles);
+    else if (!m_threads)
+        start_threads(cycles);
+
+    uint64_t end = cycles + max_steps;
+    while (cycles < end)
+    {
+        uint64_t quantum_end = cycles + m_quantum;
+        if (quantum_end > end)
+            quantum_end = end;
+
+        // Release the secondary harts
+        {
+            std::lock_guard<std::mutex> lock(m_sync_lock);
+            m_sync_end     = quantum_end;
+            m_sync_stop_pc = stop_pc;
+            m_sync_pending = (int)m_harts.size() - 1;
+            m_sync_gen++;
+        }
+        m_sync_start.notify_all();
+
+        // Boot hart runs on this thread
+        int status = run_hart(m_harts[0]->hart, cycles, quantum_end, stop_pc);
+
+        // Barrier
+        {
+            std::unique_lock<std::mutex> lock(m_sync_lock);
+            while (m_sync_pending != 0)
+                m_sync_done.wait(lock);
+        }
+
+        // Stop on the first hart to fault / stop / hit a breakpoint
+        for (unsigned i=1;i<m_harts.size() && status == cpu::RUN_BUDGET;i++)
+            status = m_harts[i]->status;
+
+        if (status != cpu::RUN_BUDGET)
+            return status;
+    }
+
+    return cpu::RUN_BUDGET;
+}
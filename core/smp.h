@@ -0,0 +1,140 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __SMP_H__
+#define __SMP_H__
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class cpu;
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Cycles each hart executes between synchronisation points
+#define SMP_QUANTUM         8192
+
+// LR/SC reservation granule (bytes) and 'no reservation' marker
+#define SMP_RESERVE_GRANULE 8
+#define SMP_NO_RESERVATION  (~0ULL)
+
+//--------------------------------------------------------------------
+// smp: Symmetric multi-hart group
+//--------------------------------------------------------------------
+// Each hart runs on its own host thread for a quantum of cycles, then
+// all harts meet at a barrier, so hart clocks never drift apart by more
+// than one quantum.
+// Hart 0 (the boot hart) owns the memories and devices (and the device
+// event queue); the other harts share its physical memory map.
+// Device accesses and atomic memory operations are serialised between
+// harts, RAM accesses are not.
+// Interrupts / fences posted by another hart are applied at the next
+// block boundary of a running hart. A hart asleep in WFI skips ahead to
+// the end of the quantum, so it only wakes at the next barrier (up to
+// one quantum of latency).
+// LR/SC: SC and AMO stores break the reservations other harts hold on
+// the same granule. Plain stores are not tracked, a store from another
+// hart is only detected by SC if it changed the word (A->B->A passes).
+class smp
+{
+public:
+                        smp(uint32_t quantum = SMP_QUANTUM);
+                       ~smp();
+
+    // Add a hart (the first hart added is the boot hart)
+    bool                add_hart(cpu *hart);
+    int                 get_num_harts(void)  { return (int)m_harts.size(); }
+    cpu *               get_hart(int id)     { return (id >= 0 && id < (int)m_harts.size()) ? m_harts[id]->hart : NULL; }
+
+    // Run all harts for up to max_steps cycles (the boot hart on the
+    // calling thread, using its cycle counter). Returns as cpu::run().
+    int                 run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc);
+
+    // Stop the secondary hart threads between run() calls (e.g. before
+    // fork(), which only duplicates the calling thread). They are
+    // restarted by the next run().
+    void                stop_threads(void);
+
+    // Serialise device accesses / atomic memory operations between harts
+    void                bus_lock(void)       { m_bus_lock.lock(); }
+    void                bus_unlock(void)     { m_bus_lock.unlock(); }
+    void                atomic_lock(void)    { m_atomic_lock.lock(); }
+    void                atomic_unlock(void)  { m_atomic_lock.unlock(); }
+
+    // LR/SC reservations (physical addresses)
+    // reserve: LR from a hart (replaces its reservation)
+    // take_reservation: SC from a hart, true if addr was still reserved
+    // (the reservation is released either way)
+    // break_reservations: SC / AMO store from a hart, breaks the
+    // reservations of the other harts on the same granule
+    void                reserve(int id, uint64_t addr);
+    bool                take_reservation(int id, uint64_t addr);
+    void                break_reservations(int id, uint64_t addr);
+
+protected:
+    typedef struct
+    {
+        cpu            *hart;
+        uint64_t        cycles;
+        int             status;
+        std::thread    *thread;
+        std::atomic<uint64_t> reservation;
+    } t_hart;
+
+    void                start(uint64_t cycles);
+    void                start_threads(uint64_t cycles);
+    void                worker(t_hart *h, uint64_t gen);
+    static int          run_hart(cpu *hart, uint64_t &cycles, uint64_t end, uint64_t stop_pc);
+
+protected:
+    std::vector <t_hart *> m_harts;
+    uint32_t            m_quantum;
+    bool                m_started;
+    bool                m_threads;
+
+    std::recursive_mutex m_bus_lock;  // Device clock() may access memory
+    std::mutex          m_atomic_lock;
+
+    // Quantum barrier
+    std::mutex          m_sync_lock;
+    std::condition_variable m_sync_start;
+    std::condition_variable m_sync_done;
+    uint64_t            m_sync_gen;
+    uint64_t            m_sync_end;
+    uint64_t            m_sync_stop_pc;
+    int                 m_sync_pending;
+    bool                m_sync_exit;
+};
+
+//--------------------------------------------------------------------
+// smp_atomic_guard: Holds the atomic lock of a hart group for the scope
+// (no-op for a single hart or a non-atomic instruction)
+//--------------------------------------------------------------------
+class smp_atomic_guard
+{
+public:
+    smp_atomic_guard(smp *group, bool atomic): m_group(atomic ? group : NULL)
+    {
+        if (m_group)
+            m_group->atomic_lock();
+    }
+   ~smp_atomic_guard()
+    {
+        if (m_group)
+            m_group->atomic_unlock();
+    }
+
+private:
+    smp *m_group;
+};
+
+#endif
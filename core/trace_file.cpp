@@ -0,0 +1,571 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <string.h>
+#include <chrono>
+#include <zlib.h>
+#include "trace_file.h"
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+// Writer thread poll interval when the ring is empty (us)
+#define TRACE_POLL_US       100
+
+// LZ codec
+#define TRACE_LZ_HASH_BITS  12
+#define TRACE_LZ_MIN_MATCH  4
+#define TRACE_LZ_MAX_OFFSET 0xFFFF
+#define TRACE_LZ_LAST_LITS  12  // Matches don't start in the last bytes
+
+//-----------------------------------------------------------------
+// LZ block codec: a sequence of [token][literal length][literals]
+// [offset:16][match length] where the token holds the literal count
+// (high nibble) and the match length - 4 (low nibble); 15 is continued
+// in the length bytes (255 = more follow). The final sequence has
+// literals only.
+//-----------------------------------------------------------------
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - TRACE_LZ_HASH_BITS);
+}
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+static uint8_t *lz_put_length(uint8_t *p, uint32_t len)
+{
+    for (;len >= 255;len -= 255)
+        *p++ = 255;
+    *p++ = (uint8_t)len;
+    return p;
+}
+static bool lz_get_length(const uint8_t **p, const uint8_t *end, uint32_t *len)
+{
+    while (*p < end && *len <= TRACE_BLOCK_SIZE)
+    {
+        uint8_t b = *(*p)++;
+        *len += b;
+        if (b != 255)
+            return true;
+    }
+    return false;
+}
+static uint8_t *lz_put_sequence(uint8_t *p, const uint8_t *lits, uint32_t num_lits)
+{
+    if (num_lits >= 15)
+        p = lz_put_length(p, num_lits - 15);
+    memcpy(p, lits, num_lits);
+    return p + num_lits;
+}
+//-----------------------------------------------------------------
+// lz_compress: Compress a block into dst (TRACE_BLOCK_BOUND), returns
+// the compressed length
+//-----------------------------------------------------------------
+static uint32_t lz_compress(const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+    uint32_t table[1 << TRACE_LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t *end    = src + len;
+    const uint8_t *limit  = len > TRACE_LZ_LAST_LITS ? end - TRACE_LZ_LAST_LITS : src;
+    const uint8_t *anchor = src;
+    const uint8_t *ip     = src;
+    uint8_t       *op     = dst;
+    uint32_t       misses = 0;
+
+    while (ip < limit)
+    {
+        uint32_t       seq = lz_read32(ip);
+        uint32_t       h   = lz_hash(seq);
+        const uint8_t *ref = src + table[h];
+        table[h] = ip - src;
+
+        // Step faster through data which isn't matching
+        if (ref >= ip || (ip - ref) > TRACE_LZ_MAX_OFFSET || lz_read32(ref) != seq)
+        {
+            ip += 1 + (misses++ >> 5);
+            continue;
+        }
+        misses = 0;
+
+        const uint8_t *mp = ip + TRACE_LZ_MIN_MATCH;
+        const uint8_t *rp = ref + TRACE_LZ_MIN_MATCH;
+        while (mp < end && *mp == *rp)
+            mp++, rp++;
+
+        uint32_t num_lits  = ip - anchor;
+        uint32_t match_len = (mp - ip) - TRACE_LZ_MIN_MATCH;
+        uint32_t offset    = ip - ref;
+
+        *op++ = ((num_lits < 15 ? num_lits : 15) << 4) | (match_len < 15 ? match_len : 15);
+        op    = lz_put_sequence(op, anchor, num_lits);
+        *op++ = offset >> 0;
+        *op++ = offset >> 8;
+        if (match_len >= 15)
+            op = lz_put_length(op, match_len - 15);
+
+        ip     = mp;
+        anchor = ip;
+    }
+
+    uint32_t num_lits = end - anchor;
+    *op++ = (num_lits < 15 ? num_lits : 15) << 4;
+    op    = lz_put_sequence(op, anchor, num_lits);
+    return op - dst;
+}
+//-----------------------------------------------------------------
+// lz_decompress: Expand a block of exactly len bytes
+//-----------------------------------------------------------------
+static bool lz_decompress(const uint8_t *src, uint32_t zlen, uint8_t *dst, uint32_t len)
+{
+    const uint8_t *ip   = src;
+    const uint8_t *iend = src + zlen;
+    uint8_t       *op   = dst;
+    uint8_t       *oend = dst + len;
+
+    while (ip < iend)
+    {
+        uint32_t token    = *ip++;
+        uint32_t num_lits = token >> 4;
+        if (num_lits == 15 && !lz_get_length(&ip, iend, &num_lits))
+            return false;
+        if (num_lits > (uint32_t)(iend - ip) || num_lits > (uint32_t)(oend - op))
+            return false;
+        memcpy(op, ip, num_lits);
+        op += num_lits;
+        ip += num_lits;
+
+        // Final sequence
+        if (ip == iend)
+            break;
+
+        if ((iend - ip) < 2)
+            return false;
+        uint32_t offset    = ip[0] | (ip[1] << 8);
+        uint32_t match_len = token & 15;
+        ip += 2;
+        if (match_len == 15 && !lz_get_length(&ip, iend, &match_len))
+            return false;
+        match_len += TRACE_LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (uint32_t)(op - dst) || match_len > (uint32_t)(oend - op))
+            return false;
+
+        // Overlapping copies repeat the last offset bytes
+        const uint8_t *mp = op - offset;
+        if (offset >= match_len)
+            memcpy(op, mp, match_len);
+        else
+            for (uint32_t i=0;i<match_len;i++)
+                op[i] = mp[i];
+        op += match_len;
+    }
+
+    return op == oend;
+}
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+trace_writer::trace_writer()
+{
+    m_file      = NULL;
+    m_head      = 0;
+    m_tail      = 0;
+    m_closing   = false;
+    m_error     = false;
+    m_codec     = TRACE_CODEC_LZ;
+    m_block     = NULL;
+    m_pos       = NULL;
+    m_limit     = NULL;
+    m_raw_size  = 0;
+    m_insts     = 0;
+    m_next_pc   = 0;
+    m_last_addr = 0;
+    memset(m_regs, 0, sizeof(m_regs));
+    memset(m_ring_len, 0, sizeof(m_ring_len));
+    memset(m_threads, 0, sizeof(m_threads));
+
+    // Entries start invalid (odd PC)
+    t_opcode_entry invalid = { 1, 0 };
+    m_opcodes.assign(TRACE_OPCODE_CACHE, invalid);
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+trace_writer::~trace_writer()
+{
+    close();
+}
+//-----------------------------------------------------------------
+// open: Create trace file and start the writer thread
+//-----------------------------------------------------------------
+bool trace_writer::open(const char *filename, uint32_t flags, int codec)
+{
+    m_codec = codec;
+    flags   = (flags & ~TRACE_FILE_CODEC_MASK) | (codec << TRACE_FILE_CODEC_SHIFT);
+
+    m_file = fopen(filename, "wb");
+    if (!m_file)
+    {
+        fprintf(stderr, "ERROR: Trace: Could not create '%s'\n", filename);
+        return false;
+    }
+
+    uint32_t version = TRACE_FILE_VERSION;
+    if (fwrite(TRACE_FILE_MAGIC, 1, 8, m_file) != 8 ||
+        fwrite(&version, sizeof(version), 1, m_file) != 1 ||
+        fwrite(&flags, sizeof(flags), 1, m_file) != 1)
+    {
+        fprintf(stderr, "ERROR: Trace: Write error '%s'\n", filename);
+        fclose(m_file);
+        m_file = NULL;
+        return false;
+    }
+
+    m_ring.resize(TRACE_RING_BLOCKS * TRACE_BLOCK_SIZE);
+    m_block  = &m_ring[0];
+    m_pos    = m_block;
+    m_limit  = m_block + TRACE_BLOCK_SIZE - TRACE_RECORD_MAX;
+    for (int i=0;i<TRACE_WRITER_THREADS;i++)
+        m_threads[i] = new std::thread(&trace_writer::writer_thread, this, i);
+    return true;
+}
+//-----------------------------------------------------------------
+// close: Write out the remaining records and close the file
+//-----------------------------------------------------------------
+bool trace_writer::close(void)
+{
+    if (!m_file)
+        return false;
+
+    if (m_pos != m_block)
+        flush_block();
+
+    m_closing = true;
+    for (int i=0;i<TRACE_WRITER_THREADS;i++)
+    {
+        m_threads[i]->join();
+        delete m_threads[i];
+        m_threads[i] = NULL;
+    }
+
+    if (fclose(m_file) != 0)
+        m_error = true;
+    m_file = NULL;
+
+    if (m_error)
+        fprintf(stderr, "ERROR: Trace: Write error\n");
+
+    return !m_error;
+}
+//-----------------------------------------------------------------
+// flush_block: Queue the current block, move to the next free one
+//-----------------------------------------------------------------
+void trace_writer::flush_block(void)
+{
+    uint32_t head = m_head.load(std::memory_order_relaxed);
+
+    m_ring_len[head % TRACE_RING_BLOCKS] = m_pos - m_block;
+    m_raw_size += m_pos - m_block;
+    m_head.store(++head, std::memory_order_release);
+
+    // Ring full - wait for the writer threads
+    while ((head - m_tail.load(std::memory_order_acquire)) >= TRACE_RING_BLOCKS)
+        std::this_thread::yield();
+
+    m_block = &m_ring[(head % TRACE_RING_BLOCKS) * TRACE_BLOCK_SIZE];
+    m_pos   = m_block;
+    m_limit = m_block + TRACE_BLOCK_SIZE - TRACE_RECORD_MAX;
+}
+//-----------------------------------------------------------------
+// writer_thread: Compress blocks first, first + TRACE_WRITER_THREADS, ...
+// and write them once the preceding block has been written
+//-----------------------------------------------------------------
+void trace_writer::writer_thread(uint32_t first)
+{
+    std::vector<uint8_t> zbuf(TRACE_BLOCK_BOUND);
+
+    for (uint32_t seq=first;;seq+=TRACE_WRITER_THREADS)
+    {
+        // Wait for the block to be queued (blocks queued before close() are still written)
+        while ((int32_t)(m_head.load(std::memory_order_acquire) - seq) <= 0)
+        {
+            if (m_closing && (int32_t)(m_head.load(std::memory_order_acquire) - seq) <= 0)
+                return;
+            std::this_thread::sleep_for(std::chrono::microseconds(TRACE_POLL_US));
+        }
+
+        uint32_t       idx  = seq % TRACE_RING_BLOCKS;
+        const uint8_t *data = &m_ring[idx * TRACE_BLOCK_SIZE];
+        uint32_t       len  = m_ring_len[idx];
+        uint32_t       zlen = len;
+
+        if (m_codec == TRACE_CODEC_LZ)
+            zlen = lz_compress(data, len, &zbuf[0]);
+        else if (m_codec == TRACE_CODEC_ZLIB)
+        {
+            uLongf dlen = zbuf.size();
+            if (compress2(&zbuf[0], &dlen, data, len, Z_BEST_SPEED) != Z_OK)
+                m_error = true;
+            zlen = dlen;
+        }
+
+        // Stored (compressed length == length) unless it got smaller
+        const uint8_t *zdata = &zbuf[0];
+        if (zlen >= len)
+        {
+            zdata = data;
+            zlen  = len;
+        }
+
+        // Blocks are written in order
+        while (m_tail.load(std::memory_order_acquire) != seq)
+            std::this_thread::yield();
+
+        if (!m_error && !write_block(len, zdata, zlen))
+            m_error = true;
+
+        m_tail.store(seq + 1, std::memory_order_release);
+    }
+}
+//-----------------------------------------------------------------
+// write_block: Write [raw length][compressed length][data]
+//-----------------------------------------------------------------
+bool trace_writer::write_block(uint32_t len, const uint8_t *zdata, uint32_t zlen)
+{
+    uint32_t hdr[2] = { len, zlen };
+    return fwrite(hdr, sizeof(hdr), 1, m_file) == 1 &&
+           fwrite(zdata, 1, zlen, m_file) == zlen;
+}
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+trace_reader::trace_reader()
+{
+    m_file      = NULL;
+    m_flags     = 0;
+    m_version   = 0;
+    m_codec     = TRACE_CODEC_ZLIB;
+    m_ok        = true;
+    m_pos       = 0;
+    m_next_pc   = 0;
+    m_last_addr = 0;
+    memset(m_regs, 0, sizeof(m_regs));
+
+    t_opcode_entry invalid = { 1, 0 };
+    m_opcodes.assign(TRACE_OPCODE_CACHE, invalid);
+}
+//-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+trace_reader::~trace_reader()
+{
+    if (m_file)
+        fclose(m_file);
+}
+//-----------------------------------------------------------------
+// fail: Report an error, returns false
+//-----------------------------------------------------------------
+bool trace_reader::fail(const char *msg)
+{
+    if (m_ok)
+        fprintf(stderr, "ERROR: Trace: %s\n", msg);
+    m_ok = false;
+    return false;
+}
+//-----------------------------------------------------------------
+// open: Open trace file
+//-----------------------------------------------------------------
+bool trace_reader::open(const char *filename)
+{
+    m_file = fopen(filename, "rb");
+    if (!m_file)
+    {
+        fprintf(stderr, "ERROR: Trace: Could not open '%s'\n", filename);
+        return m_ok = false;
+    }
+
+    char magic[8];
+    if (fread(magic, 1, 8, m_file) != 8 || memcmp(magic, TRACE_FILE_MAGIC, 8) != 0 ||
+        fread(&m_version, sizeof(m_version), 1, m_file) != 1 ||
+        fread(&m_flags, sizeof(m_flags), 1, m_file) != 1)
+        return fail("Not a trace file");
+
+    if (m_version != TRACE_FILE_VERSION && m_version != 1)
+        return fail("Unsupported trace file version");
+
+    // Version 1 traces are always deflated
+    m_codec = (m_version == 1) ? TRACE_CODEC_ZLIB : (m_flags & TRACE_FILE_CODEC_MASK) >> TRACE_FILE_CODEC_SHIFT;
+    if (m_codec > TRACE_CODEC_ZLIB)
+        return fail("Unsupported trace compression");
+
+    return true;
+}
+//-----------------------------------------------------------------
+// read_block: Read and decompress the next block
+//-----------------------------------------------------------------
+bool trace_reader::read_block(void)
+{
+    uint32_t hdr[2];
+    if (fread(hdr, sizeof(hdr), 1, m_file) != 1)
+        return false;
+
+    if (hdr[0] > TRACE_BLOCK_SIZE || hdr[1] > TRACE_BLOCK_BOUND)
+        return fail("Corrupt block header");
+
+    // Blocks which didn't compress are stored (version 2, equal lengths)
+    bool stored = (m_version > 1) && hdr[0] == hdr[1];
+    if (!stored && m_codec == TRACE_CODEC_NONE)
+        return fail("Corrupt block header");
+
+    m_block.resize(hdr[0]);
+    m_zbuf.resize(hdr[1]);
+    if (hdr[1] && fread(stored ? &m_block[0] : &m_zbuf[0], 1, hdr[1], m_file) != hdr[1])
+        return fail("Truncated block");
+
+    if (stored || !hdr[0])
+        ;
+    else if (m_codec == TRACE_CODEC_LZ)
+    {
+        if (!lz_decompress(&m_zbuf[0], hdr[1], &m_block[0], hdr[0]))
+            return fail("Corrupt block");
+    }
+    else
+    {
+        uLongf len = hdr[0];
+        if (uncompress(&m_block[0], &len, &m_zbuf[0], hdr[1]) != Z_OK || len != hdr[0])
+            return fail("Corrupt block");
+    }
+
+    m_pos = 0;
+    return true;
+}
+//-----------------------------------------------------------------
+// get_varint: Unsigned LEB128 value
+//-----------------------------------------------------------------
+bool trace_reader::get_varint(uint64_t *v)
+{
+    *v = 0;
+    for (int shift=0;shift<64;shift+=7)
+    {
+        if (m_pos >= m_block.size())
+            return fail("Truncated record");
+
+        uint8_t b = m_block[m_pos++];
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+
+    return fail("Corrupt record");
+}
+//-----------------------------------------------------------------
+// get_svarint: Zigzag encoded signed value
+//-----------------------------------------------------------------
+bool trace_reader::get_svarint(int64_t *v)
+{
+    uint64_t u;
+    if (!get_varint(&u))
+        return false;
+
+    *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    return true;
+}
+//-----------------------------------------------------------------
+// next: Decode the next record
+//-----------------------------------------------------------------
+bool trace_reader::next(t_trace_record *rec)
+{
+    if (!m_file || !m_ok)
+        return false;
+
+    // Records do not span blocks
+    while (m_pos >= m_block.size())
+        if (!read_block())
+            return false;
+
+    memset(rec, 0, sizeof(*rec));
+
+    uint8_t tag = m_block[m_pos++];
+    int64_t delta;
+
+    rec->type = tag & TRACE_TYPE_MASK;
+    switch (rec->type)
+    {
+        case TRACE_INST:
+        {
+            rec->pc = m_next_pc;
+            if ((tag & TRACE_INST_JUMP))
+            {
+                if (!get_svarint(&delta))
+                    return false;
+                rec->pc += delta;
+            }
+
+            rec->size = (tag & TRACE_INST_RVC) ? 2 : 4;
+
+            t_opcode_entry *entry = &m_opcodes[(rec->pc >> 1) & (TRACE_OPCODE_CACHE-1)];
+            if (tag & TRACE_INST_CACHED)
+                rec->opcode = entry->opcode;
+            else
+            {
+                if (m_pos + rec->size > m_block.size())
+                    return fail("Truncated record");
+
+                for (int i=0;i<rec->size;i++)
+                    rec->opcode |= (uint32_t)m_block[m_pos++] << (8 * i);
+
+                entry->pc     = rec->pc;
+                entry->opcode = rec->opcode;
+            }
+
+            m_next_pc = rec->pc + rec->size;
+        }
+        break;
+        case TRACE_REG:
+            rec->reg = (tag >> TRACE_REG_SHIFT) & 31;
+            if (!get_svarint(&delta))
+                return false;
+            m_regs[rec->reg] += delta;
+            rec->value = m_regs[rec->reg];
+            break;
+        case TRACE_LOAD:
+        case TRACE_STORE:
+            rec->width = 1 << ((tag >> TRACE_MEM_WIDTH_SHIFT) & 3);
+            if (!get_svarint(&delta))
+                return false;
+            rec->addr   = m_last_addr + delta;
+            rec->phys   = rec->addr;
+            m_last_addr = rec->addr;
+
+            if ((tag & TRACE_MEM_PHYS))
+            {
+                if (!get_svarint(&delta))
+                    return false;
+                rec->phys += delta;
+            }
+
+            if (!get_varint(&rec->value))
+                return false;
+            break;
+        case TRACE_EXCEPTION:
+            if (!get_varint(&rec->cause) || !get_varint(&rec->pc) || !get_varint(&rec->target))
+                return false;
+            break;
+        case TRACE_ABORT:
+            break;
+        default:
+            return fail("Unknown record type");
+    }
+
+    return true;
+}
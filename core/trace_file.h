@@ -0,0 +1,306 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __TRACE_FILE_H__
+#define __TRACE_FILE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------
+#define TRACE_FILE_MAGIC        "EXSTTRCE"
+#define TRACE_FILE_VERSION      2   // 1: Deflate only, no codec in the flags
+
+// File header flags
+#define TRACE_FILE_RV64         (1 << 0)
+#define TRACE_FILE_CODEC_SHIFT  8   // Block compression (eTraceCodec)
+#define TRACE_FILE_CODEC_MASK   (0xF << TRACE_FILE_CODEC_SHIFT)
+
+// Records are compressed in blocks of up to this size
+#define TRACE_BLOCK_SIZE        (256 * 1024)
+
+// Largest compressed block (LZ worst case, above the deflate bound)
+#define TRACE_BLOCK_BOUND       (TRACE_BLOCK_SIZE + (TRACE_BLOCK_SIZE / 255) + 64)
+
+// Blocks queued for the writer threads
+#define TRACE_RING_BLOCKS       16
+
+// Compression threads (blocks are still written in order)
+#define TRACE_WRITER_THREADS    4
+
+// Largest encoded record
+#define TRACE_RECORD_MAX        40
+
+// Opcodes of recently traced PCs (not repeated in the trace)
+#define TRACE_OPCODE_CACHE      4096
+
+// Record tag: type in the low bits, type specific flags above
+#define TRACE_TYPE_MASK         0x7
+#define TRACE_INST_JUMP         (1 << 3)  // PC is not the sequential PC (delta follows)
+#define TRACE_INST_RVC          (1 << 4)  // 16-bit opcode
+#define TRACE_INST_CACHED       (1 << 5)  // Opcode as last traced at this PC
+#define TRACE_REG_SHIFT         3         // Register number
+#define TRACE_MEM_WIDTH_SHIFT   3         // log2(width)
+#define TRACE_MEM_PHYS          (1 << 5)  // PA != VA (delta follows)
+
+// Block compression
+enum eTraceCodec
+{
+    TRACE_CODEC_NONE,   // Records as encoded
+    TRACE_CODEC_LZ,     // Byte oriented LZ77 (fast, default)
+    TRACE_CODEC_ZLIB    // Deflate (smaller, several times slower to write)
+};
+
+enum eTraceRecord
+{
+    TRACE_INST,
+    TRACE_REG,
+    TRACE_LOAD,
+    TRACE_STORE,
+    TRACE_EXCEPTION,
+    TRACE_ABORT         // Last instruction did not complete (fault)
+};
+
+//-----------------------------------------------------------------
+// t_trace_record: Decoded trace record
+//-----------------------------------------------------------------
+typedef struct
+{
+    int      type;      // eTraceRecord
+    uint64_t pc;        // INST, EXCEPTION
+    uint32_t opcode;    // INST
+    int      size;      // INST (2 or 4)
+    int      reg;       // REG
+    uint64_t value;     // REG, LOAD, STORE
+    uint64_t addr;      // LOAD, STORE (VA)
+    uint64_t phys;      // LOAD, STORE (PA)
+    int      width;     // LOAD, STORE
+    uint64_t target;    // EXCEPTION (handler)
+    uint64_t cause;     // EXCEPTION
+} t_trace_record;
+
+// Opcode cache entry (writer and reader keep identical copies)
+typedef struct
+{
+    uint64_t pc;
+    uint32_t opcode;
+} t_opcode_entry;
+
+//-----------------------------------------------------------------
+// trace_writer: Binary instruction trace (simulation thread side)
+//-----------------------------------------------------------------
+// Records are delta encoded against the previous record of the same
+// kind (sequential PCs are implicit, register writes are relative to
+// the previous value of the register) into a block buffer. Full blocks
+// are handed to writer threads through a lock-free ring; each thread
+// compresses every TRACE_WRITER_THREADS'th block and they are written
+// out in order. The simulation only blocks when the writers fall a
+// full ring behind. Blocks which don't compress are stored as is.
+class trace_writer
+{
+public:
+                trace_writer();
+               ~trace_writer();
+
+    bool        open(const char *filename, uint32_t flags, int codec = TRACE_CODEC_LZ);
+    bool        close(void);
+
+    // Instruction fetched (before it executes)
+    void        inst(uint64_t pc, uint32_t opcode, int size)
+    {
+        t_opcode_entry *entry = &m_opcodes[(pc >> 1) & (TRACE_OPCODE_CACHE-1)];
+
+        if (size == 2)
+            opcode &= 0xFFFF;
+
+        uint8_t *p   = m_pos;
+        uint8_t  tag = TRACE_INST | (size == 2 ? TRACE_INST_RVC : 0);
+        bool  cached = (entry->pc == pc && entry->opcode == opcode);
+        if (cached)
+            tag |= TRACE_INST_CACHED;
+
+        if (pc == m_next_pc)
+            *p++ = tag;
+        else
+        {
+            *p++ = tag | TRACE_INST_JUMP;
+            p    = put_svarint(p, (int64_t)(pc - m_next_pc));
+        }
+
+        if (!cached)
+        {
+            *p++ = opcode >> 0;
+            *p++ = opcode >> 8;
+            if (size != 2)
+            {
+                *p++ = opcode >> 16;
+                *p++ = opcode >> 24;
+            }
+
+            entry->pc     = pc;
+            entry->opcode = opcode;
+        }
+
+        m_next_pc = pc + size;
+        m_insts++;
+        commit(p);
+    }
+
+    // Register writeback
+    void        reg(int r, uint64_t value)
+    {
+        uint8_t *p = m_pos;
+        *p++ = TRACE_REG | (r << TRACE_REG_SHIFT);
+        p    = put_svarint(p, (int64_t)(value - m_regs[r & 31]));
+        m_regs[r & 31] = value;
+        commit(p);
+    }
+
+    // Memory access (after translation)
+    void        mem(bool store, uint64_t addr, uint64_t phys, uint64_t value, int width)
+    {
+        int log2_width = (width == 8) ? 3 : (width == 4) ? 2 : (width == 2) ? 1 : 0;
+
+        uint8_t *p = m_pos;
+        *p++ = (store ? TRACE_STORE : TRACE_LOAD) | (log2_width << TRACE_MEM_WIDTH_SHIFT) | (phys != addr ? TRACE_MEM_PHYS : 0);
+        p    = put_svarint(p, (int64_t)(addr - m_last_addr));
+        if (phys != addr)
+            p = put_svarint(p, (int64_t)(phys - addr));
+        p    = put_varint(p, value);
+
+        m_last_addr = addr;
+        commit(p);
+    }
+
+    // Exception / interrupt taken
+    void        exception(uint64_t pc, uint64_t target, uint64_t cause)
+    {
+        uint8_t *p = m_pos;
+        *p++ = TRACE_EXCEPTION;
+        p    = put_varint(p, cause);
+        p    = put_varint(p, pc);
+        p    = put_varint(p, target);
+        commit(p);
+    }
+
+    // Instruction aborted by an exception
+    void        abort(void)
+    {
+        uint8_t *p = m_pos;
+        *p++ = TRACE_ABORT;
+        commit(p);
+    }
+
+    // Instructions recorded
+    uint64_t    get_insts(void) { return m_insts; }
+
+    // Bytes of records written (before compression)
+    uint64_t    get_raw_size(void) { return m_raw_size + (m_pos - m_block); }
+
+protected:
+    static uint8_t *put_varint(uint8_t *p, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            *p++ = (uint8_t)v | 0x80;
+            v >>= 7;
+        }
+        *p++ = (uint8_t)v;
+        return p;
+    }
+
+    static uint8_t *put_svarint(uint8_t *p, int64_t v)
+    {
+        return put_varint(p, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+    }
+
+    void        commit(uint8_t *p)
+    {
+        m_pos = p;
+        if (m_pos > m_limit)
+            flush_block();
+    }
+
+    void        flush_block(void);
+    void        writer_thread(uint32_t first);
+    bool        write_block(uint32_t len, const uint8_t *zdata, uint32_t zlen);
+
+protected:
+    FILE       *m_file;
+
+    // Ring of block buffers (producer fills m_head, m_tail is the next
+    // block to be written to the file)
+    std::vector<uint8_t>  m_ring;
+    uint32_t              m_ring_len[TRACE_RING_BLOCKS];
+    std::atomic<uint32_t> m_head;
+    std::atomic<uint32_t> m_tail;
+    std::atomic<bool>     m_closing;
+    std::atomic<bool>     m_error;
+    std::thread          *m_threads[TRACE_WRITER_THREADS];
+    int                   m_codec;
+
+    // Current block
+    uint8_t    *m_block;
+    uint8_t    *m_pos;
+    uint8_t    *m_limit;
+    uint64_t    m_raw_size;
+    uint64_t    m_insts;
+
+    // Delta encoding state
+    uint64_t    m_next_pc;
+    uint64_t    m_last_addr;
+    uint64_t    m_regs[32];
+    std::vector<t_opcode_entry> m_opcodes;
+};
+
+//-----------------------------------------------------------------
+// trace_reader: Binary instruction trace (decoder side)
+//-----------------------------------------------------------------
+class trace_reader
+{
+public:
+                trace_reader();
+               ~trace_reader();
+
+    bool        open(const char *filename);
+    uint32_t    get_flags(void) { return m_flags; }
+
+    // Next record, false at the end of the trace (or on error)
+    bool        next(t_trace_record *rec);
+
+    // False if the trace was truncated or corrupt
+    bool        ok(void) { return m_ok; }
+
+protected:
+    bool        read_block(void);
+    bool        get_varint(uint64_t *v);
+    bool        get_svarint(int64_t *v);
+    bool        fail(const char *msg);
+
+protected:
+    FILE       *m_file;
+    uint32_t    m_flags;
+    uint32_t    m_version;
+    int         m_codec;
+    bool        m_ok;
+
+    std::vector<uint8_t> m_block;
+    std::vector<uint8_t> m_zbuf;
+    uint32_t    m_pos;
+
+    uint64_t    m_next_pc;
+    uint64_t    m_last_addr;
+    uint64_t    m_regs[32];
+    std::vector<t_opcode_entry> m_opcodes;
+};
+
+#endif
@@ -34,6 +34,11 @@
 #define ALL_FLAGS   (APSR_N | APSR_Z | APSR_C | APSR_V)
 #define FLAGS_NZC   (APSR_N | APSR_Z | APSR_C)
 
+// Lazily evaluated APSR fields (m_flags_lazy)
+#define FLAGS_LAZY_NZ       (1 << 0)    // N, Z from m_flags_res
+#define FLAGS_LAZY_C        (1 << 1)    // C from m_flags_op1 + m_flags_op2 + m_flags_cin
+#define FLAGS_LAZY_V        (1 << 2)    // V from m_flags_op1 + m_flags_op2 + m_flags_cin
+
 #define PRIMASK_PM          (1 << 0)
 
 #define CONTROL_NPRIV       (1 << 0)
@@ -42,6 +47,11 @@
 
 #define EXC_RETURN          0xFFFFFFE0
 
+#define DECODE_INVALID      0xFFFFFFFF
+
+// First halfword of a 32-bit instruction (BL, MRS, MSR, barriers, UDF_W)
+#define INST_IS_32BIT(i)    (((i) & 0xF800) == 0xF000)
+
 #define DPRINTF(l,a)        do { if (m_trace & l) printf a; } while (0)
 #define TRACE_ENABLED(l)    (m_trace & l)
 
@@ -57,6 +67,10 @@
 //-----------------------------------------------------------------
 armv6m::armv6m(uint32_t baseAddr /*= 0*/, uint32_t len /*= 0*/)
 {
+    m_decode.resize(DECODE_ENTRIES);
+    m_decode_pages.resize(((1ULL << 32) >> DECODE_PGSHIFT) / 32);
+    decode_flush();
+
     m_systick = new device_systick(0xE000E010, NULL, 0);    
     attach_device(m_systick);
 
@@ -103,6 +117,8 @@ uint32_t armv6m::get_register(int r)
 //-----------------------------------------------------------------
 void armv6m::set_flag(uint32_t flag, bool val)
 {
+    armv6m_flags_eval();
+
     if (val)
         m_apsr |= flag;
     else
@@ -113,7 +129,7 @@ void armv6m::set_flag(uint32_t flag, bool val)
 //-----------------------------------------------------------------
 bool armv6m::get_flag(uint32_t flag)
 {
-    return (m_apsr & flag) != 0;
+    return (armv6m_flags_eval() & flag) != 0;
 }
 //-----------------------------------------------------------------
 // reset: Reset CPU state
@@ -126,6 +142,7 @@ void armv6m::reset(uint32_t start_addr)
         m_regfile[i] = 0; 
 
     m_apsr = 0;
+    m_flags_lazy = 0;
 
     m_entry_point = start_addr;
 
@@ -147,6 +164,15 @@ void armv6m::reset(uint32_t start_addr)
     m_systick_irq = false;
 }
 //-----------------------------------------------------------------
+// attach_memory: Attach memory (invalidates decoded instructions)
+//-----------------------------------------------------------------
+bool armv6m::attach_memory(memory_base *memory)
+{
+    bool ok = cpu::attach_memory(memory);
+    decode_flush();
+    return ok;
+}
+//-----------------------------------------------------------------
 // get_opcode: Get instruction from address
 //-----------------------------------------------------------------
 uint32_t armv6m::get_opcode(uint32_t address)
@@ -159,30 +185,22 @@ uint32_t armv6m::get_opcode(uint32_t address)
 void armv6m::step(uint64_t cycles)
 {
     uint32_t pc, pc_x;
-    uint16_t inst;
-    uint16_t inst2;
-    int inst_32_bit;
+    t_armv6m_inst tmp;
 
     pc = m_regfile[REG_PC];
     // EXC_RETURN value in PC
     if ((pc & EXC_RETURN) == EXC_RETURN) pc = armv6m_exc_return(pc);
 
-    // Fetch
-    inst = armv6m_read_inst(pc);
-
-    // Decode
-    inst_32_bit = armv6m_decode(inst);
+    // Fetch & decode (pre-decoded where possible)
+    const t_armv6m_inst *inst = armv6m_fetch(pc, &tmp);
 
-    // [32-bit instruction] Fetch another half word
-    inst2 = (inst_32_bit) ? armv6m_read_inst(pc + 2) : 0;
-
-    DPRINTF(LOG_FETCH, ("%08X: 0x%04X \n", pc, inst));
+    DPRINTF(LOG_FETCH, ("%08X: 0x%04X \n", pc, inst->opcode));
     
-    if (TRACE_ENABLED(LOG_INST)) armv6m_dump_inst(inst);
+    if (TRACE_ENABLED(LOG_INST)) armv6m_dump_inst(inst->opcode);
 
     // Execute
     pc_x = pc;
-    pc = armv6m_execute(inst, inst2);
+    pc = armv6m_execute(inst);
 
     // Monitor executed instructions
     log_commit_pc(pc_x);
@@ -198,6 +216,7 @@ void armv6m::step(uint64_t cycles)
             else
                 printf("%08x %08x %08x %08x\n", m_regfile[i+0], m_regfile[i+1], m_regfile[i+2], m_regfile[i+3]);
         }
+        armv6m_flags_eval();
         printf("Flags = %c%c%c%c\n", m_apsr & APSR_N ? 'N':'-', 
                                      m_apsr & APSR_Z ? 'Z':'-',
                                      m_apsr & APSR_C ? 'C':'-',
@@ -208,7 +227,7 @@ void armv6m::step(uint64_t cycles)
     {
         static uint32_t old_apsr = 0;
 
-        if (m_apsr != old_apsr)
+        if (armv6m_flags_eval() != old_apsr)
         {
             printf("%08X: Flags = %c%c%c%c\n", pc, // or pc_x ??
                                     m_apsr & APSR_N ? 'N':'-', 
@@ -242,6 +261,27 @@ void armv6m::step(uint64_t cycles)
     cpu::step(cycles);
 }
 //-----------------------------------------------------------------
+// run: Execute up to max_steps instructions
+//-----------------------------------------------------------------
+int armv6m::run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc)
+{
+    uint64_t end = cycles + max_steps;
+
+    m_device_event = false;
+    while (cycles < end)
+    {
+        uint32_t pc = m_regfile[REG_PC];
+        armv6m::step(cycles);
+        cycles++;
+
+        int status = run_status(pc, stop_pc);
+        if (status != RUN_BUDGET)
+            return status;
+    }
+
+    return RUN_BUDGET;
+}
+//-----------------------------------------------------------------
 // set_interrupt: Register pending interrupt
 //-----------------------------------------------------------------
 void armv6m::set_interrupt(int irq)
@@ -278,72 +318,86 @@ void armv6m::armv6m_update_sp(uint32_t sp)
         m_msp = sp;
 }
 //-------------------------------------------------------------------
-// armv6m_update_n_z_flags:
-//-------------------------------------------------------------------
-void armv6m::armv6m_update_n_z_flags(uint32_t rd)
-{
-    // Zero
-    if (rd == 0)
-        m_apsr |= APSR_Z; 
-    else 
-        m_apsr &=~APSR_Z;
-
-    // Negative
-    if (rd & 0x80000000)
-        m_apsr |=APSR_N; 
-    else 
-        m_apsr &=~APSR_N;
-}
-//-------------------------------------------------------------------
-// armv6m_add_with_carry:
+// armv6m_flags_eval: Materialise lazily evaluated flags into m_apsr
 //-------------------------------------------------------------------
-uint32_t armv6m::armv6m_add_with_carry(uint32_t rn, uint32_t rm, uint32_t carry_in, uint32_t mask)
+uint32_t armv6m::armv6m_flags_eval(void)
 {
-    uint32_t res;
-
-    // Perform addition
-    res = rn + rm + carry_in;
+    if (!m_flags_lazy)
+        return m_apsr;
 
-    // Zero
-    if (mask & APSR_Z)
+    if (m_flags_lazy & FLAGS_LAZY_NZ)
     {
-        if ((res & 0xFFFFFFFF) == 0)
-            m_apsr |= APSR_Z; 
-        else 
-            m_apsr &=~APSR_Z;
+        m_apsr &= ~(APSR_N | APSR_Z);
+        m_apsr |= (m_flags_res & 0x80000000) ? APSR_N : 0;
+        m_apsr |= (m_flags_res == 0)         ? APSR_Z : 0;
     }
 
-    // Negative
-    if (mask & APSR_N)
+    if (m_flags_lazy & FLAGS_LAZY_C)
     {
-        if (res & 0x80000000)
-            m_apsr |=APSR_N; 
-        else 
-            m_apsr &=~APSR_N;
-    }
+        uint64_t unsigned_sum = (uint64_t)m_flags_op1 + (uint64_t)m_flags_op2 + m_flags_cin;
 
-    // Carry
-    if (mask & APSR_C)
-    {
-        uint64_t unsigned_sum = (uint64_t)rn + (uint64_t)rm + carry_in;
-        if (unsigned_sum == (uint64_t)res)
-            m_apsr &=~APSR_C;
-        else
-            m_apsr |= APSR_C;
+        m_apsr &= ~APSR_C;
+        m_apsr |= (unsigned_sum >> 32) ? APSR_C : 0;
     }
 
-    // Overflow
-    if (mask & APSR_V)
+    if (m_flags_lazy & FLAGS_LAZY_V)
     {
-        int64_t signed_sum = (int64_t)(int32_t)rn + (int64_t)(int32_t)rm + carry_in;
+        uint32_t res = m_flags_op1 + m_flags_op2 + m_flags_cin;
 
-        if (signed_sum == (int64_t)(int32_t)res)
-            m_apsr &=~APSR_V;
-        else
-            m_apsr |= APSR_V;
+        // Operands of the same sign, result of the other
+        m_apsr &= ~APSR_V;
+        m_apsr |= (((m_flags_op1 ^ res) & (m_flags_op2 ^ res)) & 0x80000000) ? APSR_V : 0;
     }
 
-    return (uint32_t)res;
+    m_flags_lazy = 0;
+    return m_apsr;
+}
+//-------------------------------------------------------------------
+// armv6m_flags_carry: Current value of the C flag
+//-------------------------------------------------------------------
+uint32_t armv6m::armv6m_flags_carry(void)
+{
+    if (m_flags_lazy & FLAGS_LAZY_C)
+        return (((uint64_t)m_flags_op1 + (uint64_t)m_flags_op2 + m_flags_cin) >> 32) ? 1 : 0;
+
+    return (m_apsr & APSR_C) ? 1 : 0;
+}
+//-------------------------------------------------------------------
+// armv6m_flags_set_carry: Shifter carry out
+//-------------------------------------------------------------------
+void armv6m::armv6m_flags_set_carry(bool c)
+{
+    if (c)
+        m_apsr |= APSR_C;
+    else
+        m_apsr &=~APSR_C;
+
+    m_flags_lazy &= ~FLAGS_LAZY_C;
+}
+//-------------------------------------------------------------------
+// armv6m_update_n_z_flags:
+//-------------------------------------------------------------------
+void armv6m::armv6m_update_n_z_flags(uint32_t rd)
+{
+    // Evaluated on demand
+    m_flags_res   = rd;
+    m_flags_lazy |= FLAGS_LAZY_NZ;
+}
+//-------------------------------------------------------------------
+// armv6m_add_with_carry: rn + rm + carry_in (updates N, Z, C, V)
+//-------------------------------------------------------------------
+uint32_t armv6m::armv6m_add_with_carry(uint32_t rn, uint32_t rm, uint32_t carry_in)
+{
+    uint32_t res = rn + rm + carry_in;
+
+    // Flags evaluated on demand from the operands
+    m_flags_res  = res;
+    m_flags_op1  = rn;
+    m_flags_op2  = rm;
+    m_flags_cin  = carry_in;
+    m_flags_lazy = FLAGS_LAZY_NZ | FLAGS_LAZY_C | FLAGS_LAZY_V;
+
+    return res;
 }
 //-------------------------------------------------------------------
 // armv6m_shift_left:
@@ -355,24 +409,9 @@ uint32_t armv6m::armv6m_shift_left(uint32_t val, uint32_t shift, uint32_t mask)
 
     // Carry Out (res[32])
     if (mask & APSR_C)
-    {
-        if (res & ((uint64_t)1 << 32))
-            m_apsr |= APSR_C;
-        else
-            m_apsr &=~APSR_C;
-    }
-
-    // Zero
-    if ((res & 0xFFFFFFFF) == 0)
-        m_apsr |= APSR_Z; 
-    else 
-        m_apsr &=~APSR_Z;
+        armv6m_flags_set_carry(res & ((uint64_t)1 << 32));
 
-    // Negative
-    if (res & 0x80000000)
-        m_apsr |=APSR_N; 
-    else 
-        m_apsr &=~APSR_N;
+    armv6m_update_n_z_flags((uint32_t)res);
 
     return (uint32_t)res;
 }
@@ -387,25 +426,12 @@ uint32_t armv6m::armv6m_shift_right(uint32_t val, uint32_t shift, uint32_t mask)
     if ((mask & APSR_C) && (shift > 0))
     {
         // Last lost bit shifted right
-        if ((val & (1 << (shift-1))) && (shift <= 32))
-            m_apsr |= APSR_C;
-        else
-            m_apsr &=~APSR_C;
+        armv6m_flags_set_carry((val & (1 << (shift-1))) && (shift <= 32));
     }
 
     res >>= shift;
 
-    // Zero
-    if ((res & 0xFFFFFFFF) == 0)
-        m_apsr |= APSR_Z; 
-    else 
-        m_apsr &=~APSR_Z;
-
-    // Negative
-    if (res & 0x80000000)
-        m_apsr |=APSR_N; 
-    else 
-        m_apsr &=~APSR_N;
+    armv6m_update_n_z_flags(res);
 
     return res;
 }
@@ -420,25 +446,12 @@ uint32_t armv6m::armv6m_arith_shift_right(uint32_t val, uint32_t shift, uint32_t
     if ((mask & APSR_C) && (shift > 0))
     {
         // Last lost bit shifted right
-        if (val & (1 << (shift-1)))
-            m_apsr |= APSR_C;
-        else
-            m_apsr &=~APSR_C;
+        armv6m_flags_set_carry(val & (1 << (shift-1)));
     }
 
     res >>= shift;
 
-    // Zero
-    if ((res & 0xFFFFFFFF) == 0)
-        m_apsr |= APSR_Z; 
-    else 
-        m_apsr &=~APSR_Z;
-
-    // Negative
-    if (res & 0x80000000)
-        m_apsr |=APSR_N; 
-    else 
-        m_apsr &=~APSR_N;
+    armv6m_update_n_z_flags(res);
 
     return res;
 }
@@ -460,22 +473,9 @@ uint32_t armv6m::armv6m_rotate_right(uint32_t val, uint32_t shift, uint32_t mask
     }
 
     // Carry out
-    if (res & 0x80000000)
-        m_apsr |= APSR_C;
-    else
-        m_apsr &=~APSR_C;
-
-    // Zero
-    if ((res & 0xFFFFFFFF) == 0)
-        m_apsr |= APSR_Z; 
-    else 
-        m_apsr &=~APSR_Z;
+    armv6m_flags_set_carry(res & 0x80000000);
 
-    // Negative
-    if (res & 0x80000000)
-        m_apsr |=APSR_N; 
-    else 
-        m_apsr &=~APSR_N;
+    armv6m_update_n_z_flags(res);
 
     return res;
 }
@@ -525,7 +525,7 @@ uint32_t armv6m::armv6m_exception(uint32_t pc, uint32_t exception)
 
     // Push frame onto current stack
     sp-=4;
-    write32(sp, m_apsr);
+    write32(sp, armv6m_flags_eval());
     sp-=4;
     write32(sp, m_regfile[REG_PC]);
     sp-=4;
@@ -624,6 +624,7 @@ uint32_t armv6m::armv6m_exc_return(uint32_t pc)
         m_regfile[REG_PC] = read32(sp);
         sp+=4;
         m_apsr = read32(sp);
+        m_flags_lazy = 0;
         sp+=4;
         armv6m_update_sp(sp);
         
@@ -631,37 +632,44 @@ uint32_t armv6m::armv6m_exc_return(uint32_t pc)
     }
 }
 //-------------------------------------------------------------------
-// armv6m_decode: Decode ARMv6m instruction
+// armv6m_decode: Decode ARMv6m instruction (inst2 is the following
+// halfword, only used by 32-bit instructions)
 // Returns:
-//  0 = 16-bit instruction, execute
-//  1 = 32-bit instruction, fetch next word
+//  0 = 16-bit instruction
+//  1 = 32-bit instruction
 //-------------------------------------------------------------------
-int armv6m::armv6m_decode(uint16_t inst)
+int armv6m::armv6m_decode(uint16_t inst, uint16_t inst2, t_armv6m_inst *d)
 {
     int res = 0;
     int v_decoded = 0;
 
-    m_rd = 0;
-    m_rt = 0;
-    m_rm = 0;
-    m_rn = 0;
-    m_imm = 0;
-    m_reglist = 0;
-    m_cond = 0;
+    memset(d, 0, sizeof(*d));
+    d->opcode = inst;
 
     // Group 0?
     if (!v_decoded)
     {
         v_decoded = 1;
-        m_inst_group = INST_IGRP0;
         switch(inst & INST_IGRP0_MASK)
         {
             // BCC - BCC <label>
             // 1 1 0 1 cond imm8
             case INST_BCC_OPCODE:
             {
-                m_cond = (inst >> 8) & 0x0F;
-                m_imm  = (inst >> 0) & 0xFF;
+                d->cond = (inst >> 8) & 0x0F;
+                d->imm  = armv6m_sign_extend((inst >> 0) & 0xFF, 8) << 1;
+
+                // SVC
+                if (d->cond == 15)
+                {
+                    d->op  = ARMV6M_OP_SVC;
+                    d->imm = (inst >> 0) & 0xFF;
+                }
+                // AL
+                else if (d->cond == 14)
+                    d->op = ARMV6M_OP_B;
+                else
+                    d->op = ARMV6M_OP_BCC;
             }
             break;
             default:
@@ -674,7 +682,6 @@ int armv6m::armv6m_decode(uint16_t inst)
     if (!v_decoded)
     {
         v_decoded = 1;
-        m_inst_group = INST_IGRP1;
         switch(inst & INST_IGRP1_MASK)
         {
             // ADDS - ADDS <Rdn>,#<imm8>
@@ -684,9 +691,10 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 0 1 11 Rdn imm8
             case INST_SUBS_1_OPCODE:
             {
-                m_rd = (inst >> 8) & 0x7;
-                m_rn = m_rd;
-                m_imm= (inst >> 0) & 0xFF;
+                d->op = ((inst & INST_IGRP1_MASK) == INST_ADDS_1_OPCODE) ? ARMV6M_OP_ADDS_IMM : ARMV6M_OP_SUBS_IMM;
+                d->rd = (inst >> 8) & 0x7;
+                d->rn = d->rd;
+                d->imm= (inst >> 0) & 0xFF;
             }
             break;
 
@@ -697,24 +705,41 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 0 1 0 0 Rd imm8
             case INST_MOVS_OPCODE:
             {
-                m_rd = (inst >> 8) & 0x7;
-                m_imm= (inst >> 0) & 0xFF;
+                d->op = ((inst & INST_IGRP1_MASK) == INST_ADR_OPCODE) ? ARMV6M_OP_ADR : ARMV6M_OP_MOVS_IMM;
+                d->rd = (inst >> 8) & 0x7;
+                d->imm= (inst >> 0) & 0xFF;
             }
             break;
 
             // ASRS - ASRS <Rd>,<Rm>,#<imm5>
             // 0 0 0 1 0 imm5 Rm Rd
             case INST_ASRS_OPCODE:
-            // LSLS - LSLS <Rd>,<Rm>,#<imm5>
-            // 0 0 0 0 0 imm5 Rm Rd
-            case INST_LSLS_OPCODE:
             // LSRS - LSRS <Rd>,<Rm>,#<imm5>
             // 0 0 0 0 1 imm5 Rm Rd
             case INST_LSRS_OPCODE:
             {
-                m_imm= (inst >> 6) & 0x1F;
-                m_rm = (inst >> 3) & 0x7;
-                m_rd = (inst >> 0) & 0x7;
+                d->op = ((inst & INST_IGRP1_MASK) == INST_ASRS_OPCODE) ? ARMV6M_OP_ASRS_IMM : ARMV6M_OP_LSRS_IMM;
+                d->imm= (inst >> 6) & 0x1F;
+                d->rm = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
+
+                // Shift of 32
+                if (d->imm == 0)
+                    d->imm = 32;
+            }
+            break;
+
+            // LSLS - LSLS <Rd>,<Rm>,#<imm5>
+            // 0 0 0 0 0 imm5 Rm Rd
+            // MOVS - MOVS <Rd>,<Rm>
+            // 0 0 0 0 0 0 0 0 0 0 Rm Rd
+            //case INST_MOVS_1_OPCODE:
+            case INST_LSLS_OPCODE:
+            {
+                d->imm= (inst >> 6) & 0x1F;
+                d->rm = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
+                d->op = d->imm ? ARMV6M_OP_LSLS_IMM : ARMV6M_OP_MOVS_REG;
             }
             break;
 
@@ -722,7 +747,8 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 1 1 1 0 0 imm11
             case INST_B_OPCODE:
             {
-                m_imm= (inst >> 0) & 0x7FF;
+                d->op = ARMV6M_OP_B;
+                d->imm= armv6m_sign_extend((inst >> 0) & 0x7FF, 11) << 1;
             }
             break;
 
@@ -730,15 +756,22 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 1 1 1 01 S imm10 1 1 J1 1 J2 imm11
             case INST_BL_OPCODE:
             {
+                // Check next instruction to work out if this is a BL or MSR
+                if ((inst2 & 0xC000) != 0xC000)
+                {
+                    v_decoded = 0;
+                    break;
+                }
+
                 // 32-bit instruction
                 res = 1;
-                m_imm = (inst >> 0) & 0x7FF;
-                m_rd = REG_LR; // Implicit
+                d->op = ARMV6M_OP_BL;
+                d->rd = REG_LR; // Implicit
 
-                // TODO: Clean this up
-                // Check next instruction to work out if this is a BL or MSR
-                if ((armv6m_read_inst(m_regfile[REG_PC]+2) & 0xC000) != 0xC000)
-                    v_decoded = 0;
+                // Offset = imm11:imm11 halfwords (J1 / J2 not used)
+                d->imm = armv6m_sign_extend((inst >> 0) & 0x7FF, 11) << 11;
+                d->imm|= (inst2 >> 0) & 0x7FF;
+                d->imm<<= 1;
             }
             break;
 
@@ -746,8 +779,9 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 0 1 0 1 Rn imm8
             case INST_CMP_OPCODE:
             {
-                m_rn = (inst >> 8) & 0x7;
-                m_imm= (inst >> 0) & 0xFF;
+                d->op = ARMV6M_OP_CMP_IMM;
+                d->rn = (inst >> 8) & 0x7;
+                d->imm= (inst >> 0) & 0xFF;
             }
             break;
 
@@ -756,40 +790,57 @@ int armv6m::armv6m_decode(uint16_t inst)
             // LDM - LDM <Rn>,<registers> <Rn> included in <registers>
             // 1 1 0 0 1 Rn register_list
             //case INST_LDM_1_OPCODE:
-            case INST_LDM_OPCODE:   
+            case INST_LDM_OPCODE:
             // STM - STM <Rn>!,<registers>
             // 1 1 0 0 0 Rn register_list
             case INST_STM_OPCODE:
             {
-                m_rn = (inst >> 8) & 0x7;
-                m_rd = m_rn;
-                m_reglist = (inst >> 0) & 0xFF;
+                d->op = ((inst & INST_IGRP1_MASK) == INST_LDM_OPCODE) ? ARMV6M_OP_LDM : ARMV6M_OP_STM;
+                d->rn = (inst >> 8) & 0x7;
+                d->rd = d->rn;
+                d->reglist = (inst >> 0) & 0xFF;
             }
             break;
 
             // LDR - LDR <Rt>, [<Rn>{,#<imm5>}]
             // 0 1 1 0 1 imm5 Rn Rt
             case INST_LDR_OPCODE:
-            // LDRB - LDRB <Rt>,[<Rn>{,#<imm5>}]
-            // 0 1 1 1 1 imm5 Rn Rt
-            case INST_LDRB_OPCODE:
-            // LDRH - LDRH <Rt>,[<Rn>{,#<imm5>}]
-            // 1 0 0 0 1 imm5 Rn Rt
-            case INST_LDRH_OPCODE:
             // STR - STR <Rt>, [<Rn>{,#<imm5>}]
             // 0 1 1 0 0 imm5 Rn Rt
             case INST_STR_OPCODE:
+            {
+                d->op = ((inst & INST_IGRP1_MASK) == INST_LDR_OPCODE) ? ARMV6M_OP_LDR_IMM : ARMV6M_OP_STR_IMM;
+                d->imm= ((inst >> 6) & 0x1F) << 2;
+                d->rn = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
+            }
+            break;
+
+            // LDRB - LDRB <Rt>,[<Rn>{,#<imm5>}]
+            // 0 1 1 1 1 imm5 Rn Rt
+            case INST_LDRB_OPCODE:
             // STRB - STRB <Rt>,[<Rn>,#<imm5>]
             // 0 1 1 1 0 imm5 Rn Rt
             case INST_STRB_OPCODE:
+            {
+                d->op = ((inst & INST_IGRP1_MASK) == INST_LDRB_OPCODE) ? ARMV6M_OP_LDRB_IMM : ARMV6M_OP_STRB_IMM;
+                d->imm= (inst >> 6) & 0x1F;
+                d->rn = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
+            }
+            break;
+
+            // LDRH - LDRH <Rt>,[<Rn>{,#<imm5>}]
+            // 1 0 0 0 1 imm5 Rn Rt
+            case INST_LDRH_OPCODE:
             // STRH - STRH <Rt>,[<Rn>{,#<imm5>}]
             // 1 0 0 0 0 imm5 Rn Rt
             case INST_STRH_OPCODE:
             {
-                m_imm= (inst >> 6) & 0x1F;
-                m_rn = (inst >> 3) & 0x7;
-                m_rt = (inst >> 0) & 0x7;
-                m_rd = m_rt;
+                d->op = ((inst & INST_IGRP1_MASK) == INST_LDRH_OPCODE) ? ARMV6M_OP_LDRH_IMM : ARMV6M_OP_STRH_IMM;
+                d->imm= ((inst >> 6) & 0x1F) << 1;
+                d->rn = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
             }
             break;
 
@@ -797,9 +848,9 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 1 0 0 1 Rt imm8
             case INST_LDR_2_OPCODE:
             {
-                m_rt = (inst >> 8) & 0x7;
-                m_rd = m_rt;
-                m_imm= (inst >> 0) & 0xFF;
+                d->op = ARMV6M_OP_LDR_LIT;
+                d->rd = (inst >> 8) & 0x7;
+                d->imm= ((inst >> 0) & 0xFF) << 2;
             }
             break;
 
@@ -813,10 +864,15 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 1 0 1 0 1 Rd imm8
             case INST_ADD_1_OPCODE:
             {
-                m_rt = (inst >> 8) & 0x7;
-                m_rn = REG_SP;
-                m_rd = m_rt;
-                m_imm= (inst >> 0) & 0xFF;
+                switch (inst & INST_IGRP1_MASK)
+                {
+                    case INST_LDR_1_OPCODE: d->op = ARMV6M_OP_LDR_IMM; break;
+                    case INST_STR_1_OPCODE: d->op = ARMV6M_OP_STR_IMM; break;
+                    default:                d->op = ARMV6M_OP_ADD_IMM; break;
+                }
+                d->rd = (inst >> 8) & 0x7;
+                d->rn = REG_SP;
+                d->imm= ((inst >> 0) & 0xFF) << 2;
             }
             break;
 
@@ -830,7 +886,6 @@ int armv6m::armv6m_decode(uint16_t inst)
     if (!v_decoded)
     {
         v_decoded = 1;
-        m_inst_group = INST_IGRP2;
         switch(inst & INST_IGRP2_MASK)
         {
 
@@ -841,9 +896,10 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 0 0 11 1 1 imm3 Rn Rd
             case INST_SUBS_OPCODE:
             {
-                m_imm= (inst >> 6) & 0x7;
-                m_rn = (inst >> 3) & 0x7;
-                m_rd = (inst >> 0) & 0x7;
+                d->op = ((inst & INST_IGRP2_MASK) == INST_ADDS_OPCODE) ? ARMV6M_OP_ADDS_IMM : ARMV6M_OP_SUBS_IMM;
+                d->imm= (inst >> 6) & 0x7;
+                d->rn = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
             }
             break;
 
@@ -854,9 +910,10 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 0 0 11 0 1 Rm Rn Rd
             case INST_SUBS_2_OPCODE:
             {
-                m_rm = (inst >> 6) & 0x7;
-                m_rn = (inst >> 3) & 0x7;
-                m_rd = (inst >> 0) & 0x7;
+                d->op = ((inst & INST_IGRP2_MASK) == INST_ADDS_2_OPCODE) ? ARMV6M_OP_ADDS_REG : ARMV6M_OP_SUBS_REG;
+                d->rm = (inst >> 6) & 0x7;
+                d->rn = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
             }
             break;
 
@@ -885,10 +942,20 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 1 0 1 0 0 1 Rm Rn Rt
             case INST_STRH_1_OPCODE:
             {
-                m_rm = (inst >> 6) & 0x7;
-                m_rn = (inst >> 3) & 0x7;
-                m_rt = (inst >> 0) & 0x7;
-                m_rd = m_rt;
+                switch (inst & INST_IGRP2_MASK)
+                {
+                    case INST_LDR_3_OPCODE:  d->op = ARMV6M_OP_LDR_REG;   break;
+                    case INST_LDRB_1_OPCODE: d->op = ARMV6M_OP_LDRB_REG;  break;
+                    case INST_LDRH_1_OPCODE: d->op = ARMV6M_OP_LDRH_REG;  break;
+                    case INST_LDRSB_OPCODE:  d->op = ARMV6M_OP_LDRSB_REG; break;
+                    case INST_LDRSH_OPCODE:  d->op = ARMV6M_OP_LDRSH_REG; break;
+                    case INST_STR_2_OPCODE:  d->op = ARMV6M_OP_STR_REG;   break;
+                    case INST_STRB_1_OPCODE: d->op = ARMV6M_OP_STRB_REG;  break;
+                    default:                 d->op = ARMV6M_OP_STRH_REG;  break;
+                }
+                d->rm = (inst >> 6) & 0x7;
+                d->rn = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
             }
             break;
 
@@ -896,9 +963,10 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 1 0 1 1 1 1 0 P register_list
             case INST_POP_OPCODE:
             {
-                m_reglist = (inst >> 0) & 0xFF;
+                d->op = ARMV6M_OP_POP;
+                d->reglist = (inst >> 0) & 0xFF;
                 if (inst & (1 << 8))
-                    m_reglist |= (1 << REG_PC);
+                    d->reglist |= (1 << REG_PC);
             }
             break;
 
@@ -906,9 +974,10 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 1 0 1 1 0 1 0 M register_list
             case INST_PUSH_OPCODE:
             {
-                m_reglist = (inst >> 0) & 0xFF;
+                d->op = ARMV6M_OP_PUSH;
+                d->reglist = (inst >> 0) & 0xFF;
                 if (inst & (1 << 8))
-                    m_reglist |= (1 << REG_LR);
+                    d->reglist |= (1 << REG_LR);
             }
             break;
 
@@ -922,17 +991,17 @@ int armv6m::armv6m_decode(uint16_t inst)
     if (!v_decoded)
     {
         v_decoded = 1;
-        m_inst_group = INST_IGRP3;
         switch(inst & INST_IGRP3_MASK)
         {
             // ADD - ADD <Rdn>,<Rm>
             // 0 1 0 0 0 1 0 0 Rm Rdn
             case INST_ADD_OPCODE:
             {
-                m_rm = (inst >> 3) & 0xF;
-                m_rd = (inst >> 0) & 0x7;
-                m_rd|= (inst >> 4) & 0x8;
-                m_rn = m_rd;
+                d->op = ARMV6M_OP_ADD_REG;
+                d->rm = (inst >> 3) & 0xF;
+                d->rd = (inst >> 0) & 0x7;
+                d->rd|= (inst >> 4) & 0x8;
+                d->rn = d->rd;
             }
             break;
 
@@ -946,7 +1015,13 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 1 1 0 1 1 1 1 0 imm8
             case INST_UDF_OPCODE:
             {
-                m_imm = (inst >> 0) & 0xFF;
+                switch (inst & INST_IGRP3_MASK)
+                {
+                    case INST_BKPT_OPCODE: d->op = ARMV6M_OP_BKPT;  break;
+                    case INST_SVC_OPCODE:  d->op = ARMV6M_OP_SVC;   break;
+                    default:               d->op = ARMV6M_OP_UNDEF; break;
+                }
+                d->imm = (inst >> 0) & 0xFF;
             }
             break;
 
@@ -954,9 +1029,10 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 1 0 0 0 1 0 1 N Rm Rn
             case INST_CMP_2_OPCODE:
             {
-                m_rm = (inst >> 3) & 0xF;
-                m_rn = (inst >> 0) & 0x7;
-                m_rn|= (inst >> 4) & 0x8;
+                d->op = ARMV6M_OP_CMP_REG;
+                d->rm = (inst >> 3) & 0xF;
+                d->rn = (inst >> 0) & 0x7;
+                d->rn|= (inst >> 4) & 0x8;
             }
             break;
 
@@ -964,9 +1040,10 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 1 0 0 0 1 1 0 D Rm Rd
             case INST_MOV_OPCODE:
             {
-                m_rm = (inst >> 3) & 0xF;
-                m_rd = (inst >> 0) & 0x7;
-                m_rd|= (inst >> 4) & 0x8;
+                d->op = ARMV6M_OP_MOV_REG;
+                d->rm = (inst >> 3) & 0xF;
+                d->rd = (inst >> 0) & 0x7;
+                d->rd|= (inst >> 4) & 0x8;
             }
             break;
             default:
@@ -979,7 +1056,6 @@ int armv6m::armv6m_decode(uint16_t inst)
     if (!v_decoded)
     {
         v_decoded = 1;
-        m_inst_group = INST_IGRP4;
         switch(inst & INST_IGRP4_MASK)
         {
             // ADD - ADD SP,SP,#<imm7>
@@ -989,9 +1065,10 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 1 0 1 1 000 0 1 imm7
             case INST_SUB_OPCODE:
             {
-                m_rn = REG_SP; // Implicit
-                m_rd = REG_SP; // Implicit
-                m_imm= (inst >> 0) & 0x7F;
+                d->op = ((inst & INST_IGRP4_MASK) == INST_ADD_2_OPCODE) ? ARMV6M_OP_ADD_IMM : ARMV6M_OP_SUB_IMM;
+                d->rn = REG_SP; // Implicit
+                d->rd = REG_SP; // Implicit
+                d->imm= ((inst >> 0) & 0x7F) << 2;
             }
             break;
 
@@ -999,8 +1076,9 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 1 0 0 0 1 1 1 1 Rm (0) (0) (0)
             case INST_BLX_OPCODE:
             {
-                m_rm = (inst >> 3) & 0xF;
-                m_rd = REG_LR;
+                d->op = ARMV6M_OP_BLX;
+                d->rm = (inst >> 3) & 0xF;
+                d->rd = REG_LR;
             }
             break;
 
@@ -1008,7 +1086,8 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 1 0 0 0 1 1 1 0 Rm (0) (0) (0)
             case INST_BX_OPCODE:
             {
-                m_rm = (inst >> 3) & 0xF;
+                d->op = ARMV6M_OP_BX;
+                d->rm = (inst >> 3) & 0xF;
             }
             break;
 
@@ -1022,58 +1101,59 @@ int armv6m::armv6m_decode(uint16_t inst)
     if (!v_decoded)
     {
         v_decoded = 1;
-        m_inst_group = INST_IGRP5;
         switch(inst & INST_IGRP5_MASK)
         {
             // ADCS - ADCS <Rdn>,<Rm>
             // 0 1 0 0 0 0 0 1 0 1 Rm Rdn
-            case INST_ADCS_OPCODE:
+            case INST_ADCS_OPCODE: d->op = ARMV6M_OP_ADCS; goto rdn_rm;
             // ANDS - ANDS <Rdn>,<Rm>
             // 0 1 0 0 0 0 0 0 0 0 Rm Rdn
-            case INST_ANDS_OPCODE:
+            case INST_ANDS_OPCODE: d->op = ARMV6M_OP_ANDS; goto rdn_rm;
             // ASRS - ASRS <Rdn>,<Rm>
             // 0 1 0 0 0 0 0 1 0 0 Rm Rdn
-            case INST_ASRS_1_OPCODE:
+            case INST_ASRS_1_OPCODE: d->op = ARMV6M_OP_ASRS_REG; goto rdn_rm;
             // BICS - BICS <Rdn>,<Rm>
             // 0 1 0 0 0 0 1 1 1 0 Rm Rdn
-            case INST_BICS_OPCODE:
+            case INST_BICS_OPCODE: d->op = ARMV6M_OP_BICS; goto rdn_rm;
             // EORS - EORS <Rdn>,<Rm>
             // 0 1 0 0 0 0 0 0 0 1 Rm Rdn
-            case INST_EORS_OPCODE:
+            case INST_EORS_OPCODE: d->op = ARMV6M_OP_EORS; goto rdn_rm;
             // LSLS - LSLS <Rdn>,<Rm>
             // 0 1 0 0 0 0 0 0 1 0 Rm Rdn
-            case INST_LSLS_1_OPCODE:
+            case INST_LSLS_1_OPCODE: d->op = ARMV6M_OP_LSLS_REG; goto rdn_rm;
             // LSRS - LSRS <Rdn>,<Rm>
             // 0 1 0 0 0 0 0 0 1 1 Rm Rdn
-            case INST_LSRS_1_OPCODE:
+            case INST_LSRS_1_OPCODE: d->op = ARMV6M_OP_LSRS_REG; goto rdn_rm;
             // ORRS - ORRS <Rdn>,<Rm>
             // 0 1 0 0 0 0 1 1 0 0 Rm Rdn
-            case INST_ORRS_OPCODE:
+            case INST_ORRS_OPCODE: d->op = ARMV6M_OP_ORRS; goto rdn_rm;
             // RORS - RORS <Rdn>,<Rm>
             // 0 1 0 0 0 0 0 1 1 1 Rm Rdn
-            case INST_RORS_OPCODE:
+            case INST_RORS_OPCODE: d->op = ARMV6M_OP_RORS; goto rdn_rm;
             // SBCS - SBCS <Rdn>,<Rm>
             // 0 1 0 0 0 0 0 1 1 0 Rm Rdn
-            case INST_SBCS_OPCODE:
+            case INST_SBCS_OPCODE: d->op = ARMV6M_OP_SBCS; goto rdn_rm;
+            rdn_rm:
             {
-                m_rm = (inst >> 3) & 0x7;
-                m_rd = (inst >> 0) & 0x7;
-                m_rn = m_rd;
+                d->rm = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
+                d->rn = d->rd;
             }
             break;
 
             // CMN - CMN <Rn>,<Rm>
             // 0 1 0 0 0 0 1 0 1 1 Rm Rn
-            case INST_CMN_OPCODE:
+            case INST_CMN_OPCODE: d->op = ARMV6M_OP_CMN; goto rn_rm;
             // CMP - CMP <Rn>,<Rm> <Rn> and <Rm> both from R0-R7
             // 0 1 0 0 0 0 1 0 1 0 Rm Rn
-            case INST_CMP_1_OPCODE:
+            case INST_CMP_1_OPCODE: d->op = ARMV6M_OP_CMP_REG; goto rn_rm;
             // TST - TST <Rn>,<Rm>
             // 000 1 0 0 1 0 0 0 Rm Rn
-            case INST_TST_OPCODE:
+            case INST_TST_OPCODE: d->op = ARMV6M_OP_TST; goto rn_rm;
+            rn_rm:
             {
-                m_rm = (inst >> 3) & 0x7;
-                m_rn = (inst >> 0) & 0x7;
+                d->rm = (inst >> 3) & 0x7;
+                d->rn = (inst >> 0) & 0x7;
             }
             break;
 
@@ -1081,39 +1161,41 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 1 0 0 0 0 1 1 0 1 Rn Rdm
             case INST_MULS_OPCODE:
             {
-                m_rn = (inst >> 3) & 0x7;
-                m_rd = (inst >> 0) & 0x7;
-                m_rm = m_rd;
+                d->op = ARMV6M_OP_MULS;
+                d->rn = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
+                d->rm = d->rd;
             }
             break;
 
             // MVNS - MVNS <Rd>,<Rm>
             // 0 1 0 0 0 0 1 1 1 1 Rm Rd
-            case INST_MVNS_OPCODE:
+            case INST_MVNS_OPCODE: d->op = ARMV6M_OP_MVNS; goto rd_rm;
             // REV - REV <Rd>,<Rm>
             // 1 0 1 1 1 0 1 0 0 0 Rm Rd
-            case INST_REV_OPCODE:
+            case INST_REV_OPCODE: d->op = ARMV6M_OP_REV; goto rd_rm;
             // REV16 - REV16 <Rd>,<Rm>
             // 1 0 1 1 1 0 1 0 0 1 Rm Rd
-            case INST_REV16_OPCODE:
+            case INST_REV16_OPCODE: d->op = ARMV6M_OP_REV16; goto rd_rm;
             // REVSH - REVSH <Rd>,<Rm>
             // 1 0 1 1 1 0 1 0 1 1 Rm Rd
-            case INST_REVSH_OPCODE:
+            case INST_REVSH_OPCODE: d->op = ARMV6M_OP_REVSH; goto rd_rm;
             // SXTB - SXTB <Rd>,<Rm>
             // 1 0 1 1 100 0 0 1 Rm Rd
-            case INST_SXTB_OPCODE:
+            case INST_SXTB_OPCODE: d->op = ARMV6M_OP_SXTB; goto rd_rm;
             // SXTH - SXTH <Rd>,<Rm>
             // 1 0 1 1 100 0 0 0 Rm Rd
-            case INST_SXTH_OPCODE:
+            case INST_SXTH_OPCODE: d->op = ARMV6M_OP_SXTH; goto rd_rm;
             // UXTB - UXTB <Rd>,<Rm>
             // 1 0 1 1 100 0 1 1 Rm Rd
-            case INST_UXTB_OPCODE:
+            case INST_UXTB_OPCODE: d->op = ARMV6M_OP_UXTB; goto rd_rm;
             // UXTH - UXTH <Rd>,<Rm>
             // 1 0 1 1 100 0 1 0 Rm Rd
-            case INST_UXTH_OPCODE:
+            case INST_UXTH_OPCODE: d->op = ARMV6M_OP_UXTH; goto rd_rm;
+            rd_rm:
             {
-                m_rm = (inst >> 3) & 0x7;
-                m_rd = (inst >> 0) & 0x7;
+                d->rm = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
             }
             break;
 
@@ -1121,8 +1203,9 @@ int armv6m::armv6m_decode(uint16_t inst)
             // 0 1 0 0 0 0 1 0 0 1 Rn Rd
             case INST_RSBS_OPCODE:
             {
-                m_rn = (inst >> 3) & 0x7;
-                m_rd = (inst >> 0) & 0x7;
+                d->op = ARMV6M_OP_RSBS;
+                d->rn = (inst >> 3) & 0x7;
+                d->rd = (inst >> 0) & 0x7;
             }
             break;
 
@@ -1136,7 +1219,6 @@ int armv6m::armv6m_decode(uint16_t inst)
     if (!v_decoded)
     {
         v_decoded = 1;
-        m_inst_group = INST_IGRP6;
         switch(inst & INST_IGRP6_MASK)
         {
             // MRS - MRS <Rd>,<spec_reg>
@@ -1145,23 +1227,28 @@ int armv6m::armv6m_decode(uint16_t inst)
             {
                 // 32-bit instruction
                 res = 1;
+                d->op = ARMV6M_OP_MRS;
+                d->rd = (inst2 >> 8) & 0xF;
+                d->imm= (inst2 >> 0) & 0xFF; // SYSm
             }
             break;
             // MSR - MSR <spec_reg>,<Rn>
             // 1 1 1 01 0 1 1 1 0 0 (0) Rn 1 0 (0) 0 (1) (0) (0) (0) SYSm
             case INST_MSR_OPCODE:
             {
-                m_rn = (inst >> 0) & 0xF;
-
                 // 32-bit instruction
-                res = 1;                
+                res = 1;
+                d->op = ARMV6M_OP_MSR;
+                d->rn = (inst >> 0) & 0xF;
+                d->imm= (inst2 >> 0) & 0xFF; // SYSm
             }
             break;
             // CPS - CPS<effect> i
             // 1 0 1 1 0 1 1 0 0 1 1 im (0) (0) (1) (0)
             case INST_CPS_OPCODE:
             {
-                m_imm = (inst >> 4) & 0x1;
+                d->op = ARMV6M_OP_CPS;
+                d->imm= (inst >> 4) & 0x1;
             }
             break;
             default:
@@ -1174,7 +1261,6 @@ int armv6m::armv6m_decode(uint16_t inst)
     if (!v_decoded)
     {
         v_decoded = 1;
-        m_inst_group = INST_IGRP7;
         switch(inst & INST_IGRP7_MASK)
         {
             // DMB - DMB #<option>
@@ -1186,13 +1272,6 @@ int armv6m::armv6m_decode(uint16_t inst)
             // ISB - ISB #<option>
             // 1 1 1 01 0 1 1 1 0 1 1 (1) (1) (1) (1) 1 0 (0) 0 (1) (1) (1) (1) 0 1 1 0 option
             case INST_ISB_OPCODE:
-            {
-                // 32-bit instruction
-                res = 1;
-
-                // Do nothing
-            }
-            break;
             // UDF_W - UDF_W #<imm16>
             // 1 11 1 0 1 1 1 1 1 1 1 imm4 1 0 1 0 imm12
             case INST_UDF_W_OPCODE:
@@ -1201,6 +1280,7 @@ int armv6m::armv6m_decode(uint16_t inst)
                 res = 1;
 
                 // Do nothing
+                d->op = ARMV6M_OP_NOP;
             }
             break;
             default:
@@ -1213,44 +1293,34 @@ int armv6m::armv6m_decode(uint16_t inst)
     if (!v_decoded)
     {
         v_decoded = 1;
-        m_inst_group = INST_IGRP8;
         switch(inst & INST_IGRP8_MASK)
         {
             // NOP - NOP
             // 1 0 1 1 1 1 1 1 0 0 0 0 0 0 0 0
             case INST_NOP_OPCODE:
-            {
-                // Do nothing
-            }
-            break;
             // SEV - SEV
             // 1 0 1 1 1 1 1 1 0 1 0 0 0 0 0 0
             case INST_SEV_OPCODE:
-            {
-                // Do nothing
-            }
-            break;
             // WFE - WFE
             // 1 0 1 1 1 1 1 1 0 0 1 0 0 0 0 0
             case INST_WFE_OPCODE:
             {
                 // Do nothing
+                d->op = ARMV6M_OP_NOP;
             }
             break;
             // WFI - WFI
             // 1 0 1 1 1 1 1 1 0 0 1 1 0 0 0 0
             case INST_WFI_OPCODE:
             {
-                // Do nothing
-                assert(0);
+                d->op = ARMV6M_OP_WFI;
             }
             break;
             // YIELD - YIELD
             // 1 0 1 1 1 1 1 1 0 0 0 1 0 0 0 0
             case INST_YIELD_OPCODE:
             {
-                // Do nothing
-                assert(0);
+                d->op = ARMV6M_OP_YIELD;
             }
             break;
             default:
@@ -1262,1111 +1332,634 @@ int armv6m::armv6m_decode(uint16_t inst)
     if (!v_decoded)
     {
         assert(!"Instruction decode failed");
+        d->op = ARMV6M_OP_UNDEF;
     }
 
+    d->size = res ? 4 : 2;
     return res;
 }
 //-------------------------------------------------------------------
-// armv6m_execute:
+// armv6m_fetch: Decoded instruction at pc (pre-decoded where possible,
+// otherwise decoded into tmp)
 //-------------------------------------------------------------------
-uint32_t armv6m::armv6m_execute(uint16_t inst, uint16_t inst2)
+const t_armv6m_inst *armv6m::armv6m_fetch(uint32_t pc, t_armv6m_inst *tmp)
 {
-    uint32_t reg_rm = m_regfile[m_rm];
-    uint32_t reg_rn = m_regfile[m_rn];
-    uint32_t reg_rd = 0;
-    uint32_t pc = m_regfile[REG_PC];
-    uint32_t offset = 0;
-    int write_rd = 0;
+    t_decoded *entry = &m_decode[(pc >> 1) & (DECODE_ENTRIES-1)];
+    HOST_STATS_HIT(entry->pc == pc, COUNT_DECODE_HIT, COUNT_DECODE_MISS);
+    if (entry->pc == pc || decode_fill(entry, pc))
+        return &entry->inst;
+
+    uint16_t inst  = armv6m_read_inst(pc);
+    uint16_t inst2 = INST_IS_32BIT(inst) ? armv6m_read_inst(pc + 2) : 0;
+    armv6m_decode(inst, inst2, tmp);
+    return tmp;
+}
+//-------------------------------------------------------------------
+// decode_fill: Decode instruction at pc into cache entry
+//-------------------------------------------------------------------
+bool armv6m::decode_fill(t_decoded *entry, uint32_t pc)
+{
+    if (pc & 1)
+        return false;
+
+    // Only directly backed memory is cached (devices may have side effects)
+    uint8_t *host  = get_host_ptr(pc);
+    uint32_t avail = memory_map::PAGE_SIZE - (pc & (memory_map::PAGE_SIZE-1));
+    if (!host)
+    {
+        // Page shared between regions (e.g. small ELF sections)
+        memory_base *mem = find_memory(pc);
+        uint32_t dmi_base = 0;
+        uint32_t dmi_size = 0;
+        uint8_t *dmi = mem ? mem->get_dmi(dmi_base, dmi_size) : NULL;
+        if (!dmi || pc < dmi_base || (pc - dmi_base) >= dmi_size)
+            return false;
+
+        host  = dmi + (pc - dmi_base);
+        avail = dmi_size - (pc - dmi_base);
+    }
 
-    // Increment PC to next location
-    pc += 2;
+    if (avail < 2)
+        return false;
 
-    switch (m_inst_group)
+    uint16_t inst  = mem_load16(host);
+    uint16_t inst2 = 0;
+    if (INST_IS_32BIT(inst))
     {
-    case INST_IGRP0:
+        // Don't cache 32-bit instructions which straddle the region
+        if (avail < 4)
+            return false;
+        inst2 = mem_load16(host + 2);
+    }
+
+    armv6m_decode(inst, inst2, &entry->inst);
+    entry->pc = pc;
+
+    uint32_t page = pc >> DECODE_PGSHIFT;
+    m_decode_pages[page >> 5] |= (1 << (page & 31));
+    return true;
+}
+//-------------------------------------------------------------------
+// decode_flush: Invalidate all pre-decoded instructions
+//-------------------------------------------------------------------
+void armv6m::decode_flush(void)
+{
+    for (int i=0;i<DECODE_ENTRIES;i++)
+        m_decode[i].pc = DECODE_INVALID;
+
+    memset(&m_decode_pages[0], 0, m_decode_pages.size() * sizeof(uint32_t));
+}
+//-------------------------------------------------------------------
+// invalidate_code: Memory written (stores, loaders, debugger)
+//-------------------------------------------------------------------
+void armv6m::invalidate_code(uint32_t addr, int length)
+{
+    // Large writes (loaders): drop everything
+    if (length >= (DECODE_ENTRIES * 2))
     {
-        switch(inst & INST_IGRP0_MASK)
-        {
-            // BCC - BCC <label>
-            // 1 1 0 1 m_cond imm8
-            case INST_BCC_OPCODE:
-            {
-                // Sign extend offset
-                offset = armv6m_sign_extend(m_imm, 8);
+        decode_flush();
+        return;
+    }
 
-                // Convert to words
-                offset = offset << 1;
+    // Each written halfword, plus a 32-bit instruction starting in the
+    // halfword before the write.
+    uint32_t pc = (addr & ~1) - 2;
+    int      n  = ((addr & 1) + length + 1) / 2 + 1;
+    for (int i=0;i<n;i++, pc += 2)
+    {
+        if (!decode_page_cached(pc))
+            continue;
 
-                // Make relative to PC + 4
-                offset = offset + pc + 2;               
+        t_decoded *entry = &m_decode[(pc >> 1) & (DECODE_ENTRIES-1)];
+        if (entry->pc == pc)
+            entry->pc = DECODE_INVALID;
+    }
+}
+//-------------------------------------------------------------------
+// armv6m_execute: Execute a decoded instruction, returns the next PC
+//-------------------------------------------------------------------
+uint32_t armv6m::armv6m_execute(const t_armv6m_inst *inst)
+{
+    // Handlers (indexed by eArmv6mOp)
+    static const void *dispatch[] =
+    {
+        &&op_undef,
+        &&op_bcc,       &&op_b,         &&op_bl,        &&op_blx,       &&op_bx,
+        &&op_svc,       &&op_bkpt,
+        &&op_adds_imm,  &&op_adds_reg,  &&op_subs_imm,  &&op_subs_reg,
+        &&op_adcs,      &&op_sbcs,      &&op_rsbs,
+        &&op_cmp_imm,   &&op_cmp_reg,   &&op_cmn,
+        &&op_add_reg,   &&op_add_imm,   &&op_sub_imm,   &&op_adr,       &&op_muls,
+        &&op_movs_imm,  &&op_movs_reg,  &&op_mov_reg,   &&op_mvns,
+        &&op_ands,      &&op_eors,      &&op_orrs,      &&op_bics,      &&op_tst,
+        &&op_lsls_imm,  &&op_lsrs_imm,  &&op_asrs_imm,
+        &&op_lsls_reg,  &&op_lsrs_reg,  &&op_asrs_reg,  &&op_rors,
+        &&op_rev,       &&op_rev16,     &&op_revsh,
+        &&op_sxtb,      &&op_sxth,      &&op_uxtb,      &&op_uxth,
+        &&op_ldr_imm,   &&op_ldr_lit,   &&op_ldr_reg,
+        &&op_ldrb_imm,  &&op_ldrb_reg,  &&op_ldrh_imm,  &&op_ldrh_reg,
+        &&op_ldrsb_reg, &&op_ldrsh_reg,
+        &&op_str_imm,   &&op_str_reg,   &&op_strb_imm,  &&op_strb_reg,
+        &&op_strh_imm,  &&op_strh_reg,
+        &&op_ldm,       &&op_stm,       &&op_push,      &&op_pop,
+        &&op_mrs,       &&op_msr,       &&op_cps,
+        &&op_nop,       &&op_wfi,       &&op_yield
+    };
+    static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == ARMV6M_OP_MAX, "Dispatch table mismatch");
+
+    uint32_t reg_rm = m_regfile[inst->rm];
+    uint32_t reg_rn = m_regfile[inst->rn];
+    uint32_t reg_rd = 0;
+    uint32_t pc_x   = m_regfile[REG_PC];
+    uint32_t pc     = pc_x + inst->size;
+
+    // Branch targets are relative to PC + 4
+#define TARGET          (pc_x + 4 + inst->imm)
+
+    goto *dispatch[inst->op];
+
+op_bcc:
+    if (armv6m_condition(inst->cond))
+        pc = TARGET;
+    goto done;
+op_b:
+    pc = TARGET;
+    goto done;
+op_bl:
+    // rd = REG_LR
+    reg_rd = pc | 1;
+    pc     = TARGET;
+    goto write_rd;
+op_blx:
+    // rd = REG_LR
+    reg_rd = pc | 1;
+    pc     = reg_rm & ~1;
+    goto write_rd;
+op_bx:
+    if ((reg_rm & EXC_RETURN) == EXC_RETURN)
+        pc = reg_rm;
+    else
+        pc = reg_rm & ~1;
+    goto done;
+op_svc:
+    pc = armv6m_exception(pc, 11);
+    goto done;
+op_bkpt:
+    // Instruction used for program exit
+    printf("Exit code = %d\n", inst->imm);
+    sim_exit(inst->imm);
+    goto done;
+
+op_adds_imm:
+    reg_rd = armv6m_add_with_carry(reg_rn, inst->imm, 0);
+    goto write_rd;
+op_adds_reg:
+    reg_rd = armv6m_add_with_carry(reg_rn, reg_rm, 0);
+    goto write_rd;
+op_subs_imm:
+    reg_rd = armv6m_add_with_carry(reg_rn, ~inst->imm, 1);
+    goto write_rd;
+op_subs_reg:
+    reg_rd = armv6m_add_with_carry(reg_rn, ~reg_rm, 1);
+    goto write_rd;
+op_adcs:
+    reg_rd = armv6m_add_with_carry(reg_rn, reg_rm, armv6m_flags_carry());
+    goto write_rd;
+op_sbcs:
+    reg_rd = armv6m_add_with_carry(reg_rn, ~reg_rm, armv6m_flags_carry());
+    goto write_rd;
+op_rsbs:
+    reg_rd = armv6m_add_with_carry(~reg_rn, 0, 1);
+    goto write_rd;
+op_cmp_imm:
+    armv6m_add_with_carry(reg_rn, ~inst->imm, 1);
+    goto done;
+op_cmp_reg:
+    armv6m_add_with_carry(reg_rn, ~reg_rm, 1);
+    goto done;
+op_cmn:
+    armv6m_add_with_carry(reg_rn, reg_rm, 0);
+    goto done;
+op_add_reg:
+    reg_rd = reg_rn + reg_rm;
+    goto write_rd;
+op_add_imm:
+    reg_rd = reg_rn + inst->imm;
+    goto write_rd;
+op_sub_imm:
+    reg_rd = reg_rn - inst->imm;
+    goto write_rd;
+op_adr:
+    reg_rd = pc_x + 4 + inst->imm;
+    goto write_rd;
+op_muls:
+    reg_rd = reg_rn * reg_rm;
+    armv6m_update_n_z_flags(reg_rd);
+    goto write_rd;
+
+op_movs_imm:
+    reg_rd = inst->imm;
+    armv6m_update_n_z_flags(reg_rd);
+    goto write_rd;
+op_movs_reg:
+    reg_rd = reg_rm;
+    armv6m_update_n_z_flags(reg_rd);
+    goto write_rd;
+op_mov_reg:
+    // Write to PC (no normal writeback)
+    if (inst->rd == REG_PC)
+    {
+        pc = reg_rm & ~1;
+        goto done;
+    }
+    reg_rd = reg_rm;
+    goto write_rd;
+op_mvns:
+    reg_rd = ~reg_rm;
+    armv6m_update_n_z_flags(reg_rd);
+    goto write_rd;
+op_ands:
+    reg_rd = reg_rn & reg_rm;
+    armv6m_update_n_z_flags(reg_rd);
+    goto write_rd;
+op_eors:
+    reg_rd = reg_rn ^ reg_rm;
+    armv6m_update_n_z_flags(reg_rd);
+    goto write_rd;
+op_orrs:
+    reg_rd = reg_rn | reg_rm;
+    armv6m_update_n_z_flags(reg_rd);
+    goto write_rd;
+op_bics:
+    reg_rd = reg_rn & (~reg_rm);
+    armv6m_update_n_z_flags(reg_rd);
+    goto write_rd;
+op_tst:
+    // No writeback
+    armv6m_update_n_z_flags(reg_rn & reg_rm);
+    goto done;
+
+op_lsls_imm:
+    reg_rd = armv6m_shift_left(reg_rm, inst->imm, FLAGS_NZC);
+    goto write_rd;
+op_lsrs_imm:
+    reg_rd = armv6m_shift_right(reg_rm, inst->imm, FLAGS_NZC);
+    goto write_rd;
+op_asrs_imm:
+    reg_rd = armv6m_arith_shift_right(reg_rm, inst->imm, FLAGS_NZC);
+    goto write_rd;
+op_lsls_reg:
+    if (reg_rm == 0)
+    {
+        reg_rd = reg_rn;
+        armv6m_update_n_z_flags(reg_rd);
+    }
+    else
+        reg_rd = armv6m_shift_left(reg_rn, reg_rm, FLAGS_NZC);
+    goto write_rd;
+op_lsrs_reg:
+    reg_rd = armv6m_shift_right(reg_rn, reg_rm & 0xFF, FLAGS_NZC);
+    goto write_rd;
+op_asrs_reg:
+    reg_rd = armv6m_arith_shift_right(reg_rn, reg_rm, FLAGS_NZC);
+    goto write_rd;
+op_rors:
+    reg_rd = armv6m_rotate_right(reg_rn, reg_rm & 0xFF, FLAGS_NZC);
+    goto write_rd;
+
+op_rev:
+    reg_rd =((reg_rm>> 0)&0xFF)<<24;
+    reg_rd|=((reg_rm>> 8)&0xFF)<<16;
+    reg_rd|=((reg_rm>>16)&0xFF)<< 8;
+    reg_rd|=((reg_rm>>24)&0xFF)<< 0;
+    goto write_rd;
+op_rev16:
+    reg_rd =((reg_rm>> 0)&0xFF)<< 8;
+    reg_rd|=((reg_rm>> 8)&0xFF)<< 0;
+    reg_rd|=((reg_rm>>16)&0xFF)<<24;
+    reg_rd|=((reg_rm>>24)&0xFF)<<16;
+    goto write_rd;
+op_revsh:
+    reg_rd =((reg_rm>> 0)&0xFF)<< 8;
+    reg_rd|=((reg_rm>> 8)&0xFF)<< 0;
+    reg_rd = armv6m_sign_extend(reg_rd, 16);
+    goto write_rd;
+op_sxtb:
+    reg_rd = armv6m_sign_extend(reg_rm & 0xFF, 8);
+    goto write_rd;
+op_sxth:
+    reg_rd = armv6m_sign_extend(reg_rm & 0xFFFF, 16);
+    goto write_rd;
+op_uxtb:
+    reg_rd = reg_rm & 0xFF;
+    goto write_rd;
+op_uxth:
+    reg_rd = reg_rm & 0xFFFF;
+    goto write_rd;
+
+op_ldr_imm:
+    m_regfile[inst->rd] = read32(reg_rn + inst->imm);
+    goto done;
+op_ldr_lit:
+    m_regfile[inst->rd] = read32((pc_x & 0xFFFFFFFC) + inst->imm + 4);
+    goto done;
+op_ldr_reg:
+    m_regfile[inst->rd] = read32(reg_rn + reg_rm);
+    goto done;
+op_ldrb_imm:
+    m_regfile[inst->rd] = read(reg_rn + inst->imm);
+    goto done;
+op_ldrb_reg:
+    m_regfile[inst->rd] = read(reg_rn + reg_rm);
+    goto done;
+op_ldrh_imm:
+    m_regfile[inst->rd] = read16(reg_rn + inst->imm);
+    goto done;
+op_ldrh_reg:
+    m_regfile[inst->rd] = read16(reg_rn + reg_rm);
+    goto done;
+op_ldrsb_reg:
+    m_regfile[inst->rd] = armv6m_sign_extend(read(reg_rn + reg_rm), 8);
+    goto done;
+op_ldrsh_reg:
+    m_regfile[inst->rd] = armv6m_sign_extend(read16(reg_rn + reg_rm), 16);
+    goto done;
+op_str_imm:
+    write32(reg_rn + inst->imm, m_regfile[inst->rd]);
+    goto done;
+op_str_reg:
+    write32(reg_rn + reg_rm, m_regfile[inst->rd]);
+    goto done;
+op_strb_imm:
+    write(reg_rn + inst->imm, m_regfile[inst->rd]);
+    goto done;
+op_strb_reg:
+    write(reg_rn + reg_rm, m_regfile[inst->rd]);
+    goto done;
+op_strh_imm:
+    write16(reg_rn + inst->imm, m_regfile[inst->rd]);
+    goto done;
+op_strh_reg:
+    write16(reg_rn + reg_rm, m_regfile[inst->rd]);
+    goto done;
+
+op_ldm:
+{
+    uint32_t reglist = inst->reglist;
 
-                switch (m_cond)
-                {
-                    case 0: // EQ
-                        if (m_apsr & APSR_Z)
-                            pc = offset;
-                        break;
-                    case 1: // NE
-                        if ((m_apsr & APSR_Z) == 0)
-                            pc = offset;
-                        break;
-                    case 2: // CS/HS
-                        if (m_apsr & APSR_C)
-                            pc = offset;
-                        break;
-                    case 3: // CC/LO
-                        if ((m_apsr & APSR_C) == 0)
-                            pc = offset;
-                        break;
-                    case 4: // MI
-                        if (m_apsr & APSR_N)
-                            pc = offset;
-                        break;
-                    case 5: // PL
-                        if ((m_apsr & APSR_N) == 0)
-                            pc = offset;
-                        break;
-                    case 6: // VS
-                        if (m_apsr & APSR_V)
-                            pc = offset;
-                        break;
-                    case 7: // VC
-                        if ((m_apsr & APSR_V) == 0)
-                            pc = offset;
-                        break;
-                    case 8: // HI
-                        if ((m_apsr & APSR_C) && ((m_apsr & APSR_Z) == 0))
-                            pc = offset;
-                        break;
-                    case 9: // LS
-                        if (((m_apsr & APSR_C) == 0) || (m_apsr & APSR_Z))
-                            pc = offset;
-
-                        break;
-                    case 10: // GE
-                        if (((m_apsr & APSR_N) >> APSR_N_SHIFT) == ((m_apsr & APSR_V) >> APSR_V_SHIFT))
-                            pc = offset;
-                        break;
-                    case 11: // LT
-                        if (((m_apsr & APSR_N) >> APSR_N_SHIFT) != ((m_apsr & APSR_V) >> APSR_V_SHIFT))
-                            pc = offset;
-                        break;
-                    case 12: // GT
-                        if (((m_apsr & APSR_Z) == 0) && (((m_apsr & APSR_N) >> APSR_N_SHIFT) == ((m_apsr & APSR_V) >> APSR_V_SHIFT)))
-                            pc = offset;
-                        break;
-                    case 13: // LE
-                        if ((m_apsr & APSR_Z) || (((m_apsr & APSR_N) >> APSR_N_SHIFT) != ((m_apsr & APSR_V) >> APSR_V_SHIFT)))
-                            pc = offset;
-                        break;
-                    case 14: // AL
-                        pc = offset;
-                        break;
-                    case 15: // SVC
-                        pc = armv6m_exception(pc, 11);
-                        break;
-                    default:
-                        assert(!"Bad condition code");
-                        break;
-                }
-            }
-            break;
+    for (int i=0;i<REGISTERS && reglist != 0;i++)
+    {
+        if (reglist & (1 << i))
+        {
+            m_regfile[i] = read32(reg_rn);
+            reg_rn += 4;
+            reglist &= ~(1 << i);
         }
     }
-    break;
-    case INST_IGRP1:
+
+    m_regfile[inst->rd] = reg_rn;
+    goto done;
+}
+op_stm:
+{
+    uint32_t reglist = inst->reglist;
+
+    reg_rd = reg_rn;
+    for (int i=0;i<REGISTERS && reglist != 0;i++)
     {
-        switch(inst & INST_IGRP1_MASK)
+        if (reglist & (1 << i))
         {
-            // ADDS - ADDS <Rdn>,#<imm8>
-            // 0 0 1 1 0 Rdn imm8
-            case INST_ADDS_1_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, m_imm, 0, ALL_FLAGS);
-                write_rd = 1;
-            }
-            break;
-            // ADD - ADD <Rd>,SP,#<imm8>
-            // 1 0 1 0 1 Rd imm8
-            case INST_ADD_1_OPCODE:
-            {
-                reg_rd = reg_rn + (m_imm << 2);
-                write_rd = 1;
-            }
-            break;
-            // ADR - ADR <Rd>,<label>
-            // 1 0 1 0 0 Rd imm8
-            case INST_ADR_OPCODE:
+            write32(reg_rd, m_regfile[i]);
+            reg_rd += 4;
+            reglist &= ~(1 << i);
+        }
+    }
+    goto write_rd;
+}
+op_pop:
+{
+    uint32_t reglist = inst->reglist;
+    uint32_t sp = m_regfile[REG_SP];
+
+    for (int i=0;i<REGISTERS && reglist != 0;i++)
+    {
+        if (reglist & (1 << i))
+        {
+            m_regfile[i] = read32(sp);
+            DPRINTF(LOG_PUSHPOP, ("STACK: POP R%d (%x) from %x\n",i,m_regfile[i], sp));
+
+            sp+=4;
+
+            if (i == REG_PC)
             {
-                reg_rd = pc + m_imm + 2;
-                write_rd = 1;
+                if ((m_regfile[REG_PC] & EXC_RETURN) != EXC_RETURN)
+                    m_regfile[REG_PC] &= ~1;
+                pc = m_regfile[REG_PC];
             }
-            break;
-            // ASRS - ASRS <Rd>,<Rm>,#<imm5>
-            // 0 0 0 1 0 imm5 Rm Rd
-            case INST_ASRS_OPCODE:
-            {
-                if (m_imm == 0)
-                    m_imm = 32;
 
-                reg_rd = armv6m_arith_shift_right(reg_rm, m_imm, FLAGS_NZC);
-                write_rd = 1;
-            }
-            break;
-            // B - B <label>
-            // 1 1 1 0 0 imm11
-            case INST_B_OPCODE:
-            {
-                // Sign extend offset
-                offset = armv6m_sign_extend(m_imm, 11);
+            reglist &= ~(1 << i);
+        }
+    }
 
-                // Convert to words
-                offset = offset << 1;
+    armv6m_update_sp(sp);
+    goto done;
+}
+op_push:
+{
+    uint32_t reglist = inst->reglist;
+    uint32_t sp = m_regfile[REG_SP];
+    uint32_t addr = sp - (4 * __builtin_popcount(reglist));
 
-                // Make relative to PC + 4
-                offset = offset + pc + 2;
+    for (int i=0;i<REGISTERS && reglist != 0;i++)
+    {
+        if (reglist & (1 << i))
+        {
+            DPRINTF(LOG_PUSHPOP, ("STACK: PUSH R%d (%x) to %x\n",i,m_regfile[i], addr));
+            write32(addr, m_regfile[i]);
+            sp-=4;
+            addr+=4;
+            reglist &= ~(1 << i);
+        }
+    }
 
-                pc = offset;
-            }
-            break;
-            // BL - BL <label>
-            // 1 1 1 01 S imm10 1 1 J1 1 J2 imm11
-            case INST_BL_OPCODE:
-            {
-                // Sign extend
-                offset = armv6m_sign_extend(m_imm, 11);
-                offset <<= 11;
+    armv6m_update_sp(sp);
+    goto done;
+}
 
-                // Additional range
-                m_imm = (inst2 >> 0) & 0x7FF;
-                offset |= m_imm;
+op_mrs:
+{
+    uint32_t sysm = inst->imm;
 
-                // Make relative to PC
-                offset <<= 1;
-                offset += pc;
+    switch ((sysm >> 3) & 0x1F)
+    {
+    case 0:
+    {
+        uint32_t val = 0;
 
-                // m_rd = REG_LR
-                reg_rd = (pc + 2) | 1;
-                write_rd = 1;
+        if (sysm & 0x1)
+            val |= m_ipsr&0x1FF;
 
-                pc = offset + 2;
-            }
-            break;
-            // CMP - CMP <Rn>,#<imm8>
-            // 0 0 1 0 1 Rn imm8
-            case INST_CMP_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, ~m_imm, 1, ALL_FLAGS);
-                // No writeback
-            }
-            break;
-            // LDM - LDM <Rn>!,<registers> <Rn> not included in <registers>
-            // 1 1 0 0 1 Rn register_list
-            // LDM - LDM <Rn>,<registers> <Rn> included in <registers>
-            // 1 1 0 0 1 Rn register_list
-            //case INST_LDM_1_OPCODE:
-            case INST_LDM_OPCODE:   
-            {
-                int i;
-
-                for (i=0;i<REGISTERS && m_reglist != 0;i++)
-                {
-                    if (m_reglist & (1 << i))
-                    {
-                        m_regfile[i] = read32(reg_rn);
-                        if (i == REG_PC)
-                        {
-                            if ((m_regfile[REG_PC] & EXC_RETURN) != EXC_RETURN)
-                                m_regfile[REG_PC] &= ~1;
-                            pc = m_regfile[REG_PC];
-                        }
-                        reg_rn += 4;
-                        m_reglist &= ~(1 << i);
-                    }               
-                }
-
-                m_regfile[m_rd] = reg_rn;
-                assert(m_rd != REG_PC);
-            }
-            break;
-            // LDR - LDR <Rt>, [<Rn>{,#<imm5>}]
-            // 0 1 1 0 1 imm5 Rn Rt
-            case INST_LDR_OPCODE:
-            {
-                m_regfile[m_rt] = read32(reg_rn + (m_imm << 2));
-                assert(m_rd != REG_PC);
-            }
-            break;
-            // LDR - LDR <Rt>,[SP{,#<imm8>}]
-            // 1 0 0 1 1 Rt imm8
-            case INST_LDR_1_OPCODE:
-            {
-                m_regfile[m_rt] = read32(reg_rn + (m_imm << 2));
-                assert(m_rd != REG_PC);
-            }
-            break;
-            // LDR - LDR <Rt>,<label>
-            // 0 1 0 0 1 Rt imm8
-            case INST_LDR_2_OPCODE:
-            {
-                m_regfile[m_rt] = read32((m_regfile[REG_PC] & 0xFFFFFFFC) + (m_imm << 2) + 4);
-                assert(m_rd != REG_PC);
-            }
-            break;
-            // LDRB - LDRB <Rt>,[<Rn>{,#<imm5>}]
-            // 0 1 1 1 1 imm5 Rn Rt
-            case INST_LDRB_OPCODE:
-            {
-                m_regfile[m_rt] = read(reg_rn + m_imm);
-            }
-            break;
-            // LDRH - LDRH <Rt>,[<Rn>{,#<imm5>}]
-            // 1 0 0 0 1 imm5 Rn Rt
-            case INST_LDRH_OPCODE:
-            {
-                m_regfile[m_rt] = read16(reg_rn + (m_imm << 1));
-            }
-            break;
-            // LSLS - LSLS <Rd>,<Rm>,#<imm5>
-            // 0 0 0 0 0 imm5 Rm Rd
-            // MOVS - MOVS <Rd>,<Rm>
-            // 0 0 0 0 0 0 0 0 0 0 Rm Rd
-            //case INST_MOVS_1_OPCODE:
-            case INST_LSLS_OPCODE:
-            {
-                // MOVS <Rd>,<Rm>
-                if (m_imm == 0)
-                {
-                    reg_rd = reg_rm;
-                    write_rd = 1;
-
-                    // Update N & Z
-                    armv6m_update_n_z_flags(reg_rd);
-                }
-                // LSLS <Rd>,<Rm>,#<imm5>
-                else
-                {
-                    reg_rd = armv6m_shift_left(reg_rm, m_imm, FLAGS_NZC);
-                    write_rd = 1;
-                }
-            }
-            break;
-            // LSRS - LSRS <Rd>,<Rm>,#<imm5>
-            // 0 0 0 0 1 imm5 Rm Rd
-            case INST_LSRS_OPCODE:
-            {
-                if (m_imm == 0)
-                    m_imm = 32;
-
-                reg_rd = armv6m_shift_right(reg_rm, m_imm, FLAGS_NZC);
-                write_rd = 1;
-            }
-            break;
-            // MOVS - MOVS <Rd>,#<imm8>
-            // 0 0 1 0 0 Rd imm8
-            case INST_MOVS_OPCODE:
-            {
-                reg_rd = m_imm;
-                write_rd = 1;
-
-                armv6m_update_n_z_flags(reg_rd);
-            }
-            break;
-            // STM - STM <Rn>!,<registers>
-            // 1 1 0 0 0 Rn register_list
-            case INST_STM_OPCODE:
-            {
-                int i;
-                uint32_t addr = reg_rn;
-
-                for (i=0;i<REGISTERS && m_reglist != 0;i++)
-                {
-                    if (m_reglist & (1 << i))
-                    {
-                        write32(addr, m_regfile[i]);
-                        addr+=4;
-                        m_reglist &= ~(1 << i);
-                    }               
-                }
-
-                reg_rd = addr;
-                write_rd = 1;
-            }
-            break;
-            // STR - STR <Rt>, [<Rn>{,#<imm5>}]
-            // 0 1 1 0 0 imm5 Rn Rt
-            case INST_STR_OPCODE:
-            {
-                write32(reg_rn + (m_imm << 2), m_regfile[m_rt]);
-            }
-            break;
-            // STR - STR <Rt>,[SP,#<imm8>]
-            // 1 0 0 1 0 Rt imm8
-            case INST_STR_1_OPCODE:
-            {
-                write32(reg_rn + (m_imm << 2), m_regfile[m_rt]);
-            }
-            break;
-            // STRB - STRB <Rt>,[<Rn>,#<imm5>]
-            // 0 1 1 1 0 imm5 Rn Rt
-            case INST_STRB_OPCODE:
-            {
-                write(reg_rn + m_imm, m_regfile[m_rt]);
-            }
-            break;
-            // STRH - STRH <Rt>,[<Rn>{,#<imm5>}]
-            // 1 0 0 0 0 imm5 Rn Rt
-            case INST_STRH_OPCODE:
-            {
-                write16(reg_rn + (m_imm << 1), m_regfile[m_rt]);
-            }
-            break;
-            // SUBS - SUBS <Rdn>,#<imm8>
-            // 0 0 1 11 Rdn imm8
-            case INST_SUBS_1_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, ~m_imm, 1, ALL_FLAGS);
-                write_rd = 1;
-            }
-            break;
-        }
-    }
-    break;
-    case INST_IGRP2:
-    {
-        switch(inst & INST_IGRP2_MASK)
-        {
-            // ADDS - ADDS <Rd>,<Rn>,#<imm3>
-            // 0 0 0 1 1 1 0 imm3 Rn Rd
-            case INST_ADDS_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, m_imm, 0, ALL_FLAGS);
-                write_rd = 1;
-            }
-            break;
-            // ADDS - ADDS <Rd>,<Rn>,<Rm>
-            // 0 0 0 1 1 0 0 Rm Rn Rd
-            case INST_ADDS_2_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, reg_rm, 0, ALL_FLAGS);
-                write_rd = 1;
-            }
-            break;
-            // LDR - LDR <Rt>,[<Rn>,<Rm>]
-            // 0 1 0 1 1 0 0 Rm Rn Rt
-            case INST_LDR_3_OPCODE:
-            {
-                m_regfile[m_rt] = read32(reg_rn + reg_rm);
-                assert(m_rt != REG_PC);
-            }
-            break;
-            // LDRB - LDRB <Rt>,[<Rn>,<Rm>]
-            // 0 1 0 1 1 1 0 Rm Rn Rt
-            case INST_LDRB_1_OPCODE:
-            {
-                m_regfile[m_rt] = read(reg_rn + reg_rm);
-            }
-            break;
-            // LDRH - LDRH <Rt>,[<Rn>,<Rm>]
-            // 0 1 0 1 1 0 1 Rm Rn Rt
-            case INST_LDRH_1_OPCODE:
-            {
-                m_regfile[m_rt] = read16(reg_rn + reg_rm);
-            }
-            break;
-            // LDRSB - LDRSB <Rt>,[<Rn>,<Rm>]
-            // 0 1 0 1 0 1 1 Rm Rn Rt
-            case INST_LDRSB_OPCODE:
-            {
-                reg_rd = read(reg_rn + reg_rm);
-                m_regfile[m_rt] = armv6m_sign_extend(reg_rd, 8);
-            }
-            break;
-            // LDRSH - LDRSH <Rt>,[<Rn>,<Rm>]
-            // 0 1 0 1 1 1 1 Rm Rn Rt
-            case INST_LDRSH_OPCODE:
-            {
-                reg_rd = read16(reg_rn + reg_rm);
-                m_regfile[m_rt] = armv6m_sign_extend(reg_rd, 16);
-            }
-            break;
-            // POP - POP <registers>
-            // 1 0 1 1 1 1 0 P register_list
-            case INST_POP_OPCODE:
-            {
-                int i;
-                uint32_t sp = m_regfile[REG_SP];
-                
-                for (i=0;i<REGISTERS && m_reglist != 0;i++)
-                {
-                    if (m_reglist & (1 << i))
-                    {                       
-                        m_regfile[i] = read32(sp);
-                        DPRINTF(LOG_PUSHPOP, ("STACK: POP R%d (%x) from %x\n",i,m_regfile[i], sp));
-
-                        sp+=4;
-
-                        if (i == REG_PC)
-                        {
-                            if ((m_regfile[REG_PC] & EXC_RETURN) != EXC_RETURN)
-                                m_regfile[REG_PC] &= ~1;
-                            pc = m_regfile[REG_PC];
-                        }
-                        
-                        m_reglist &= ~(1 << i);
-                    }               
-                }
-
-                armv6m_update_sp(sp);
-            }
-            break;
-            // PUSH - PUSH <registers>
-            // 1 0 1 1 0 1 0 M register_list
-            case INST_PUSH_OPCODE:
-            {
-                int i;
-                uint32_t sp = m_regfile[REG_SP];
-                uint32_t addr = sp;
-                int bits_set = 0;
-
-                for (i=0;i<REGISTERS;i++)
-                    if (m_reglist & (1 << i))
-                        bits_set++;
-
-                addr -= (4 * bits_set);
-
-                for (i=0;i<REGISTERS && m_reglist != 0;i++)
-                {
-                    if (m_reglist & (1 << i))
-                    {
-                        DPRINTF(LOG_PUSHPOP, ("STACK: PUSH R%d (%x) to %x\n",i,m_regfile[i], addr));
-                        write32(addr, m_regfile[i]);
-                        sp-=4;
-                        addr+=4;
-                        m_reglist &= ~(1 << i);
-                    }               
-                }
-
-                armv6m_update_sp(sp);
-            }
-            break;
-            // STR - STR <Rt>,[<Rn>,<Rm>]
-            // 0 1 0 1 0 00 Rm Rn Rt
-            case INST_STR_2_OPCODE:
-            {
-                write32(reg_rn + reg_rm, m_regfile[m_rt]);
-            }
-            break;
-            // STRB - STRB <Rt>,[<Rn>,<Rm>]
-            // 0 1 0 1 0 1 0 Rm Rn Rt
-            case INST_STRB_1_OPCODE:
-            {
-                write(reg_rn + reg_rm, m_regfile[m_rt]);
-            }
-            break;
-            // STRH - STRH <Rt>,[<Rn>,<Rm>]
-            // 0 1 0 1 0 0 1 Rm Rn Rt
-            case INST_STRH_1_OPCODE:
-            {
-                write16(reg_rn + reg_rm, m_regfile[m_rt]);
-            }
-            break;
-            // SUBS - SUBS <Rd>,<Rn>,#<imm3>
-            // 0 0 0 11 1 1 imm3 Rn Rd
-            case INST_SUBS_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, ~m_imm, 1, ALL_FLAGS);
-                write_rd = 1;
-            }
-            break;
-            // SUBS - SUBS <Rd>,<Rn>,<Rm>
-            // 0 0 0 11 0 1 Rm Rn Rd
-            case INST_SUBS_2_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, ~reg_rm, 1, ALL_FLAGS);
-                write_rd = 1;
-            }
-            break;
-        }
-    }
-    break;
-    case INST_IGRP3:
-    {
-        switch(inst & INST_IGRP3_MASK)
-        {
-            // ADD - ADD <Rdn>,<Rm>
-            // 0 1 0 0 0 1 0 0 Rm Rdn
-            case INST_ADD_OPCODE:
-            {
-                reg_rd = reg_rn + reg_rm;
-                write_rd = 1;
-            }
-            break;
-            // BKPT - BKPT #<imm8>
-            // 1 0 1 1 1 1 1 0 imm8
-            case INST_BKPT_OPCODE:
-            {
-                // Instruction used for program exit
-                printf("Exit code = %d\n", m_imm);
-                // Abnormal exit
-                if (m_imm)
-                    exit(m_imm);
-                else
-                    m_stopped = true;
-            }
-            break;
-            // CMP - CMP <Rn>,<Rm> <Rn> and <Rm> not both from R0-R7
-            // 0 1 0 0 0 1 0 1 N Rm Rn
-            case INST_CMP_2_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, ~reg_rm, 1, ALL_FLAGS);
-            }
-            break;
-            // MOV - MOV <Rd>,<Rm> Otherwise all versions of the Thumb instruction set.
-            // 0 1 0 0 0 1 1 0 D Rm Rd
-            case INST_MOV_OPCODE:
-            {
-                // Write to PC
-                if (m_rd == REG_PC)
-                {
-                    pc = reg_rm & ~1;
-
-                    // Don't do normal writeback
-                    write_rd = 0;
-                }
-                // Normal register
-                else
-                {
-                    reg_rd = reg_rm;
-                    write_rd = 1;
-                }
-            }
-            break;
-            // SVC - SVC #<imm8>
-            // 1 1 0 1 111 1 imm8
-            case INST_SVC_OPCODE:
-            {
-                pc = armv6m_exception(pc, 11);
-            }
-            break;
-            // UDF - UDF #<imm8>
-            // 1 1 0 1 1 1 1 0 imm8
-            case INST_UDF_OPCODE:
-            {
-                assert(!"Not implemented");
-            }
-            break;
-        }
-    }
-    break;
-    case INST_IGRP4:
-    {
-        switch(inst & INST_IGRP4_MASK)
-        {
-            // ADD - ADD SP,SP,#<imm7>
-            // 1 0 1 1 0 0 0 0 0 imm7
-            case INST_ADD_2_OPCODE:
-            {
-                reg_rd = reg_rn + (m_imm << 2);
-                write_rd = 1;
-            }
-            break;
-            // BLX - BLX <Rm>
-            // 0 1 0 0 0 1 1 1 1 Rm (0) (0) (0)
-            case INST_BLX_OPCODE:
-            {
-                // m_rd = REG_LR
-                reg_rd = pc | 1;
-                write_rd = 1;
-
-                pc = reg_rm & ~1;
-            }
-            break;
-            // BX - BX <Rm>
-            // 0 1 0 0 0 1 1 1 0 Rm (0) (0) (0)
-            case INST_BX_OPCODE:
-            {
-                if ((reg_rm & EXC_RETURN) == EXC_RETURN)
-                    pc = reg_rm;
-                else
-                    pc = reg_rm & ~1;
-            }
-            break;
-            // SUB - SUB SP,SP,#<imm7>
-            // 1 0 1 1 000 0 1 imm7
-            case INST_SUB_OPCODE:
-            {
-                reg_rd = reg_rn - (m_imm << 2);
-                write_rd = 1;
-            }
-            break;
+        if (!(sysm & 0x4))
+            val |= (armv6m_flags_eval() & 0xF8000000);
+
+        val|= m_ipsr;
+        val|= m_epsr;
+
+        reg_rd = val;
+        goto write_rd;
+    }
+    case 1:
+    {
+        switch (sysm & 0x7)
+        {
+        case 0:
+            // Main SP
+            reg_rd = m_msp;
+            goto write_rd;
+        case 1:
+            // Process SP
+            reg_rd = m_psp;
+            goto write_rd;
         }
     }
     break;
-    case INST_IGRP5:
+    case 2:
     {
-        switch(inst & INST_IGRP5_MASK)
+        switch (sysm & 0x7)
         {
-            // ADCS - ADCS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 0 1 0 1 Rm Rdn
-            case INST_ADCS_OPCODE:
-            {       
-                reg_rd = armv6m_add_with_carry(reg_rn, reg_rm, (m_apsr & APSR_C) ? 1 : 0, ALL_FLAGS);
-                write_rd = 1;
-            }
-            break;
-            // ANDS - ANDS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 0 0 0 0 Rm Rdn
-            case INST_ANDS_OPCODE:
-            {
-                reg_rd = reg_rn & reg_rm;
-                write_rd = 1;
-
-                armv6m_update_n_z_flags(reg_rd);
-            }
-            break;
-            // ASRS - ASRS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 0 1 0 0 Rm Rdn
-            case INST_ASRS_1_OPCODE:
-            {
-                reg_rd = armv6m_arith_shift_right(reg_rn, reg_rm, FLAGS_NZC);
-                write_rd = 1;
-            }
-            break;
-            // BICS - BICS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 1 1 1 0 Rm Rdn
-            case INST_BICS_OPCODE:
-            {
-                reg_rd = reg_rn & (~reg_rm);
-                write_rd = 1;
-
-                armv6m_update_n_z_flags(reg_rd);
-            }
-            break;
-            // CMN - CMN <Rn>,<Rm>
-            // 0 1 0 0 0 0 1 0 1 1 Rm Rn
-            case INST_CMN_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, reg_rm, 0, ALL_FLAGS);
-            }
-            break;
-            // CMP - CMP <Rn>,<Rm> <Rn> and <Rm> both from R0-R7
-            // 0 1 0 0 0 0 1 0 1 0 Rm Rn
-            case INST_CMP_1_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, ~reg_rm, 1, ALL_FLAGS);
-            }
-            break;
-            // EORS - EORS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 0 0 0 1 Rm Rdn
-            case INST_EORS_OPCODE:
-            {
-                reg_rd = reg_rn ^ reg_rm;
-                write_rd = 1;
-
-                armv6m_update_n_z_flags(reg_rd);
-            }
-            break;
-            // LSLS - LSLS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 0 0 1 0 Rm Rdn
-            case INST_LSLS_1_OPCODE:
-            {
-                if (reg_rm == 0)
-                {
-                    reg_rd   = reg_rn;
-                    write_rd = 1;
-
-                    // Update N & Z
-                    armv6m_update_n_z_flags(reg_rd);
-                }
-                else
-                {
-                    reg_rd = armv6m_shift_left(reg_rn, reg_rm, FLAGS_NZC);
-                    write_rd = 1;
-                }
-            }
-            break;
-            // LSRS - LSRS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 0 0 1 1 Rm Rdn
-            case INST_LSRS_1_OPCODE:
-            {
-                reg_rd = armv6m_shift_right(reg_rn, reg_rm & 0xFF, FLAGS_NZC);
-                write_rd = 1;
-            }
-            break;
-            // MULS - MULS <Rdm>,<Rn>,<Rdm>
-            // 0 1 0 0 0 0 1 1 0 1 Rn Rdm
-            case INST_MULS_OPCODE:
-            {
-                reg_rd = reg_rn * reg_rm;
-                write_rd = 1;
-
-                armv6m_update_n_z_flags(reg_rd);
-            }
-            break;
-            // MVNS - MVNS <Rd>,<Rm>
-            // 0 1 0 0 0 0 1 1 1 1 Rm Rd
-            case INST_MVNS_OPCODE:
-            {
-                reg_rd = ~reg_rm;
-                write_rd = 1;
-
-                armv6m_update_n_z_flags(reg_rd);
-            }
-            break;
-            // ORRS - ORRS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 1 1 0 0 Rm Rdn
-            case INST_ORRS_OPCODE:
-            {
-                reg_rd = reg_rn | reg_rm;
-                write_rd = 1;
-
-                armv6m_update_n_z_flags(reg_rd);
-            }
-            break;
-            // REV - REV <Rd>,<Rm>
-            // 1 0 1 1 1 0 1 0 0 0 Rm Rd
-            case INST_REV_OPCODE:
-            {
-                reg_rd =((reg_rm>> 0)&0xFF)<<24;
-                reg_rd|=((reg_rm>> 8)&0xFF)<<16;
-                reg_rd|=((reg_rm>>16)&0xFF)<< 8;
-                reg_rd|=((reg_rm>>24)&0xFF)<< 0;
-                write_rd = 1;
-            }
-            break;
-            // REV16 - REV16 <Rd>,<Rm>
-            // 1 0 1 1 1 0 1 0 0 1 Rm Rd
-            case INST_REV16_OPCODE:
-            {
-                reg_rd =((reg_rm>> 0)&0xFF)<< 8;
-                reg_rd|=((reg_rm>> 8)&0xFF)<< 0;
-                reg_rd|=((reg_rm>>16)&0xFF)<<24;
-                reg_rd|=((reg_rm>>24)&0xFF)<<16;
-                write_rd = 1;
-            }
-            break;
-            // REVSH - REVSH <Rd>,<Rm>
-            // 1 0 1 1 1 0 1 0 1 1 Rm Rd
-            case INST_REVSH_OPCODE:
-            {
-                reg_rd =((reg_rm>> 0)&0xFF)<< 8;
-                reg_rd|=((reg_rm>> 8)&0xFF)<< 0;
-                reg_rd = armv6m_sign_extend(reg_rd, 16);
-                write_rd = 1;
-            }
-            break;
-            // RORS - RORS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 0 1 1 1 Rm Rdn
-            case INST_RORS_OPCODE:
-            {
-                reg_rd = armv6m_rotate_right(reg_rn, reg_rm & 0xFF, FLAGS_NZC);
-                write_rd = 1;
-            }
-            break;
-            // RSBS - RSBS <Rd>,<Rn>,#0
-            // 0 1 0 0 0 0 1 0 0 1 Rn Rd
-            case INST_RSBS_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(~reg_rn, 0, 1, ALL_FLAGS);
-
-                write_rd = 1;
-            }
-            break;
-            // SBCS - SBCS <Rdn>,<Rm>
-            // 0 1 0 0 0 0 0 1 1 0 Rm Rdn
-            case INST_SBCS_OPCODE:
-            {
-                reg_rd = armv6m_add_with_carry(reg_rn, ~reg_rm, (m_apsr & APSR_C) ? 1 : 0, ALL_FLAGS);
-                write_rd = 1;
-            }
-            break;
-            // SXTB - SXTB <Rd>,<Rm>
-            // 1 0 1 1 100 0 0 1 Rm Rd
-            case INST_SXTB_OPCODE:
-            {
-                reg_rd = reg_rm & 0xFF;
-                if(reg_rd & 0x80) 
-                    reg_rd|=(~0)<<8;
-                write_rd = 1;
-            }
-            break;
-            // SXTH - SXTH <Rd>,<Rm>
-            // 1 0 1 1 100 0 0 0 Rm Rd
-            case INST_SXTH_OPCODE:
-            {
-                reg_rd = reg_rm & 0xFFFF;
-                if(reg_rd & 0x8000) 
-                    reg_rd|=(~0)<<16;
-                write_rd = 1;
-            }
-            break;
-            // TST - TST <Rn>,<Rm>
-            // 000 1 0 0 1 0 0 0 Rm Rn
-            case INST_TST_OPCODE:
-            {
-                reg_rd = reg_rn & reg_rm;
-                // No writeback
-                armv6m_update_n_z_flags(reg_rd);
-            }
-            break;
-            // UXTB - UXTB <Rd>,<Rm>
-            // 1 0 1 1 100 0 1 1 Rm Rd
-            case INST_UXTB_OPCODE:
-            {
-                reg_rd = reg_rm & 0xFF;
-                write_rd = 1;
-            }
-            break;
-            // UXTH - UXTH <Rd>,<Rm>
-            // 1 0 1 1 100 0 1 0 Rm Rd
-            case INST_UXTH_OPCODE:
-            {
-                reg_rd = reg_rm & 0xFFFF;
-                write_rd = 1;
-            }
-            break;
+        case 0:
+            // PRIMASK.PM
+            reg_rd = m_primask & PRIMASK_PM;
+            goto write_rd;
+        case 4:
+            // Control<1:0>
+            reg_rd = m_control & CONTROL_MASK;
+            goto write_rd;
         }
     }
     break;
-    case INST_IGRP6:
+    }
+    goto done;
+}
+op_msr:
+{
+    uint32_t sysm = inst->imm;
+
+    switch ((sysm >> 3) & 0x1F)
     {
-        switch(inst & INST_IGRP6_MASK)
+    case 0:
+    {
+        if (!(sysm & 0x4))
         {
-            // MRS - MRS <Rd>,<spec_reg>
-            // 1 1 1 01 0 1 1 1 1 1 (0) (1) (1) (1) (1) 1 0 (0) 0 Rd SYSm
-            case INST_MRS_OPCODE:
-            {
-                uint32_t sysm = (inst2>>0) & 0xFF;
-                m_rd = (inst2>>8) & 0xF;              
-
-                // Increment PC past second instruction word
-                pc += 2;
-
-                switch ((sysm >> 3) & 0x1F)
-                {
-                case 0:
-                {
-                    uint32_t val = 0;
-
-                    if (sysm & 0x1)
-                        val |= m_ipsr&0x1FF;
-
-                    if (!(sysm & 0x4))
-                        val |= (m_apsr & 0xF8000000);
-
-                    val|= m_ipsr;
-                    val|= m_epsr;
-
-                    reg_rd = val;
-                    write_rd = 1;
-                }
-                break;
-                case 1:
-                {
-                    switch (sysm & 0x7)
-                    {
-                    case 0:
-                        // Main SP
-                        reg_rd = m_msp;
-                        write_rd = 1;
-                        break;
-                    case 1:
-                        // Process SP
-                        reg_rd = m_psp;
-                        write_rd = 1;
-                        break;
-                    }           
-                }
-                break;
-                case 2:
-                {
-                    switch (sysm & 0x7)
-                    {
-                    case 0:
-                        // PRIMASK.PM
-                        reg_rd = m_primask & PRIMASK_PM;
-                        write_rd = 1;
-                        break;
-                    case 4:
-                        // Control<1:0>
-                        reg_rd = m_control & CONTROL_MASK;
-                        write_rd = 1;
-                        break;
-                    }           
-                }
-                break;
-                }
-
-            }
-            break;
-            // MSR - MSR <spec_reg>,<Rn>
-            // 1 1 1 01 0 1 1 1 0 0 (0) Rn 1 0 (0) 0 (1) (0) (0) (0) SYSm
-            case INST_MSR_OPCODE:
-            {
-                uint32_t sysm = (inst2 >> 0) & 0xFF;
-
-                // Increment PC past second instruction word
-                pc += 2;
-
-                switch ((sysm >> 3) & 0x1F)
-                {
-                case 0:
-                {
-                    if (!(sysm & 0x4))
-                        m_apsr = reg_rn & 0xF8000000;
-                }
-                break;
-                case 1:
-                {
-                    // TODO: Only if priviledged...
-                    switch (sysm & 0x7)
-                    {
-                    case 0:
-                        // Main SP
-                        m_msp = reg_rn;
-                        break;
-                    case 1:
-                        // Process SP
-                        m_psp = reg_rn;
-                        break;
-                    }           
-                }
-                break;
-                case 2:
-                {
-                    // TODO: Only if priviledged...
-                    switch (sysm&0x7)
-                    {
-                    case 0:
-                        // PRIMASK.PM
-                        m_primask = reg_rn & PRIMASK_PM;
-                        break;
-                    case 4:
-                        // Control<1:0>
-                        if (m_current_mode == MODE_THREAD)
-                        {
-                            m_control = reg_rn & CONTROL_MASK;
-
-                            // Allow switching of current SP
-                            //if (m_control & CONTROL_SPSEL)
-                            //  spsel = SP_MSP;
-                            //else
-                            //  spsel = SP_PSP;
-                        }
-                        break;
-                    }           
-                }
-                break;
-                }
-            }
-            break;
-            // CPS - CPS<effect> i
-            // 1 0 1 1 0 1 1 0 0 1 1 im (0) (0) (1) (0)
-            case INST_CPS_OPCODE:
-            {       
-                // TODO: Only if priviledged...
-
-                // Enable
-                if (m_imm == 0)
-                    m_primask&= ~PRIMASK_PM;
-                // Disable
-                else
-                    m_primask|= PRIMASK_PM;
-            }
-            break;
+            m_apsr = reg_rn & 0xF8000000;
+            m_flags_lazy = 0;
         }
     }
     break;
-    case INST_IGRP7:
+    case 1:
     {
-        switch(inst & INST_IGRP7_MASK)
+        // TODO: Only if priviledged...
+        switch (sysm & 0x7)
         {
-            // DMB - DMB #<option>
-            // 1 1 1 01 0 1 1 1 0 1 1 (1) (1) (1) (1) 1 0 (0) 0 (1) (1) (1) (1) 0 1 0 1 option
-            //case INST_DMB_OPCODE:
-            // DSB - DSB #<option>
-            // 1 1 1 01 0 1 1 1 0 1 1 (1) (1) (1) (1) 1 0 (0) 0 (1) (1) (1) (1) 0 1 0 0 option
-            //case INST_DSB_OPCODE:
-            // ISB - ISB #<option>
-            // 1 1 1 01 0 1 1 1 0 1 1 (1) (1) (1) (1) 1 0 (0) 0 (1) (1) (1) (1) 0 1 1 0 option
-            case INST_ISB_OPCODE:
-            {
-                // Increment PC past second instruction word
-                pc += 2;
-            }
+        case 0:
+            // Main SP
+            m_msp = reg_rn;
             break;
-            // UDF_W - UDF_W #<imm16>
-            // 1 11 1 0 1 1 1 1 1 1 1 imm4 1 0 1 0 imm12
-            case INST_UDF_W_OPCODE:
-            {
-                // Increment PC past second instruction word
-                pc += 2;
-            }
+        case 1:
+            // Process SP
+            m_psp = reg_rn;
             break;
         }
     }
     break;
-    case INST_IGRP8:
+    case 2:
     {
-        switch(inst & INST_IGRP8_MASK)
+        // TODO: Only if priviledged...
+        switch (sysm&0x7)
         {
-            // NOP - NOP
-            // 1 0 1 1 1 1 1 1 0 0 0 0 0 0 0 0
-            case INST_NOP_OPCODE:
-            {
-                // Not implemented
-            }
-            break;
-            // SEV - SEV
-            // 1 0 1 1 1 1 1 1 0 1 0 0 0 0 0 0
-            case INST_SEV_OPCODE:
-            {
-                // Not implemented
-            }
-            break;
-            // WFE - WFE
-            // 1 0 1 1 1 1 1 1 0 0 1 0 0 0 0 0
-            case INST_WFE_OPCODE:
-            {
-                // Not implemented
-            }
-            break;
-            // WFI - WFI
-            // 1 0 1 1 1 1 1 1 0 0 1 1 0 0 0 0
-            case INST_WFI_OPCODE:
-            {
-                assert(!"Not implemented");
-            }
+        case 0:
+            // PRIMASK.PM
+            m_primask = reg_rn & PRIMASK_PM;
             break;
-            // YIELD - YIELD
-            // 1 0 1 1 1 1 1 1 0 0 0 1 0 0 0 0
-            case INST_YIELD_OPCODE:
-            {
-                assert(!"Not implemented");
-            }
+        case 4:
+            // Control<1:0>
+            if (m_current_mode == MODE_THREAD)
+                m_control = reg_rn & CONTROL_MASK;
             break;
         }
     }
     break;
     }
+    goto done;
+}
+op_cps:
+    // TODO: Only if priviledged...
 
-    if (write_rd)
-    {
-        if (m_rd == REG_SP)
-            armv6m_update_sp(reg_rd);
-        else
-            m_regfile[m_rd] = reg_rd;
-    }
+    // Enable
+    if (inst->imm == 0)
+        m_primask&= ~PRIMASK_PM;
+    // Disable
+    else
+        m_primask|= PRIMASK_PM;
+    goto done;
+
+op_nop:
+    // Not implemented
+    goto done;
+op_wfi:
+op_yield:
+op_undef:
+    assert(!"Not implemented");
+    goto done;
+
+#undef TARGET
+
+write_rd:
+    if (inst->rd == REG_SP)
+        armv6m_update_sp(reg_rd);
+    else
+        m_regfile[inst->rd] = reg_rd;
 
-    // Can't perform a writeback to PC using normal mechanism as 
+    // Can't perform a writeback to PC using normal mechanism as
     // this is a special register...
-    if (write_rd)
-    {
-        assert(m_rd != REG_PC);
-    }
+    assert(inst->rd != REG_PC);
 
+done:
     m_regfile[REG_PC] = pc;
-    
+
     return pc;
-}
\ No newline at end of file
+}
+//-------------------------------------------------------------------
+// armv6m_condition: Evaluate condition code against APSR
+//-------------------------------------------------------------------
+bool armv6m::armv6m_condition(uint32_t cond)
+{
+    armv6m_flags_eval();
+
+    bool n = (m_apsr & APSR_N) != 0;
+    bool z = (m_apsr & APSR_Z) != 0;
+    bool c = (m_apsr & APSR_C) != 0;
+    bool v = (m_apsr & APSR_V) != 0;
+
+    switch (cond)
+    {
+        case 0:  return z;              // EQ
+        case 1:  return !z;             // NE
+        case 2:  return c;              // CS/HS
+        case 3:  return !c;             // CC/LO
+        case 4:  return n;              // MI
+        case 5:  return !n;             // PL
+        case 6:  return v;              // VS
+        case 7:  return !v;             // VC
+        case 8:  return c && !z;        // HI
+        case 9:  return !c || z;        // LS
+        case 10: return n == v;         // GE
+        case 11: return n != v;         // LT
+        case 12: return !z && (n == v); // GT
+        case 13: return z || (n != v);  // LE
+        case 14: return true;           // AL
+        default:
+            assert(!"Bad condition code");
+            return false;
+    }
+}
@@ -14,6 +14,118 @@
 #include "cpu.h"
 #include "device_systick.h"
 
+//--------------------------------------------------------------------
+// Decoded operations
+//--------------------------------------------------------------------
+enum eArmv6mOp
+{
+    ARMV6M_OP_UNDEF,
+
+    // Branches / exceptions
+    ARMV6M_OP_BCC,
+    ARMV6M_OP_B,
+    ARMV6M_OP_BL,
+    ARMV6M_OP_BLX,
+    ARMV6M_OP_BX,
+    ARMV6M_OP_SVC,
+    ARMV6M_OP_BKPT,
+
+    // Arithmetic
+    ARMV6M_OP_ADDS_IMM,
+    ARMV6M_OP_ADDS_REG,
+    ARMV6M_OP_SUBS_IMM,
+    ARMV6M_OP_SUBS_REG,
+    ARMV6M_OP_ADCS,
+    ARMV6M_OP_SBCS,
+    ARMV6M_OP_RSBS,
+    ARMV6M_OP_CMP_IMM,
+    ARMV6M_OP_CMP_REG,
+    ARMV6M_OP_CMN,
+    ARMV6M_OP_ADD_REG,
+    ARMV6M_OP_ADD_IMM,      // ADD <Rd>,SP,#<imm8> / ADD SP,SP,#<imm7>
+    ARMV6M_OP_SUB_IMM,      // SUB SP,SP,#<imm7>
+    ARMV6M_OP_ADR,
+    ARMV6M_OP_MULS,
+
+    // Moves / logical
+    ARMV6M_OP_MOVS_IMM,
+    ARMV6M_OP_MOVS_REG,
+    ARMV6M_OP_MOV_REG,
+    ARMV6M_OP_MVNS,
+    ARMV6M_OP_ANDS,
+    ARMV6M_OP_EORS,
+    ARMV6M_OP_ORRS,
+    ARMV6M_OP_BICS,
+    ARMV6M_OP_TST,
+
+    // Shifts
+    ARMV6M_OP_LSLS_IMM,
+    ARMV6M_OP_LSRS_IMM,
+    ARMV6M_OP_ASRS_IMM,
+    ARMV6M_OP_LSLS_REG,
+    ARMV6M_OP_LSRS_REG,
+    ARMV6M_OP_ASRS_REG,
+    ARMV6M_OP_RORS,
+
+    // Byte reverse / extend
+    ARMV6M_OP_REV,
+    ARMV6M_OP_REV16,
+    ARMV6M_OP_REVSH,
+    ARMV6M_OP_SXTB,
+    ARMV6M_OP_SXTH,
+    ARMV6M_OP_UXTB,
+    ARMV6M_OP_UXTH,
+
+    // Loads / stores
+    ARMV6M_OP_LDR_IMM,
+    ARMV6M_OP_LDR_LIT,
+    ARMV6M_OP_LDR_REG,
+    ARMV6M_OP_LDRB_IMM,
+    ARMV6M_OP_LDRB_REG,
+    ARMV6M_OP_LDRH_IMM,
+    ARMV6M_OP_LDRH_REG,
+    ARMV6M_OP_LDRSB_REG,
+    ARMV6M_OP_LDRSH_REG,
+    ARMV6M_OP_STR_IMM,
+    ARMV6M_OP_STR_REG,
+    ARMV6M_OP_STRB_IMM,
+    ARMV6M_OP_STRB_REG,
+    ARMV6M_OP_STRH_IMM,
+    ARMV6M_OP_STRH_REG,
+    ARMV6M_OP_LDM,
+    ARMV6M_OP_STM,
+    ARMV6M_OP_PUSH,
+    ARMV6M_OP_POP,
+
+    // System
+    ARMV6M_OP_MRS,
+    ARMV6M_OP_MSR,
+    ARMV6M_OP_CPS,
+    ARMV6M_OP_NOP,          // NOP, SEV, WFE, barriers, UDF_W
+    ARMV6M_OP_WFI,
+    ARMV6M_OP_YIELD,
+
+    ARMV6M_OP_MAX
+};
+
+//--------------------------------------------------------------------
+// Decoded instruction
+//--------------------------------------------------------------------
+// Immediates are pre-scaled, branch targets are relative to PC + 4.
+// Loads / stores use rd as the transfer register (Rt).
+typedef struct
+{
+    uint8_t     op;         // eArmv6mOp
+    uint8_t     size;       // 2 or 4 (BL, MRS, MSR, barriers)
+    uint8_t     rd;
+    uint8_t     rn;
+    uint8_t     rm;
+    uint8_t     cond;
+    uint16_t    reglist;
+    uint32_t    imm;
+    uint16_t    opcode;     // First halfword (tracing)
+} t_armv6m_inst;
+
 //--------------------------------------------------------------------
 // armv6m: Simple ARM v6m model
 //--------------------------------------------------------------------
@@ -25,6 +137,7 @@ public:
     void                reset(uint32_t start_addr);
     uint32_t            get_opcode(uint32_t pc);
     void                step(uint64_t cycles);
+    int                 run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc = RUN_NO_STOP_PC);
 
     void                set_interrupt(int irq);
     void                clr_interrupt(int irq) { }
@@ -39,6 +152,9 @@ public:
     void                set_register(int r, uint32_t val);
     void                set_pc(uint32_t val);
 
+    bool                attach_memory(memory_base *memory);
+    bool                has_monitor(void) { return true; }
+
     void                stats_reset(void) { }
     void                stats_dump(void)  { }
 
@@ -54,20 +170,42 @@ public:
 protected:
     uint16_t            armv6m_read_inst(uint32_t addr);
     void                armv6m_update_sp(uint32_t sp);
+    uint32_t            armv6m_flags_eval(void);
+    uint32_t            armv6m_flags_carry(void);
+    void                armv6m_flags_set_carry(bool c);
     void                armv6m_update_n_z_flags(uint32_t rd);
-    uint32_t            armv6m_add_with_carry(uint32_t rn, uint32_t rm, uint32_t carry_in, uint32_t mask);
+    uint32_t            armv6m_add_with_carry(uint32_t rn, uint32_t rm, uint32_t carry_in);
     uint32_t            armv6m_shift_left(uint32_t val, uint32_t shift, uint32_t mask);
     uint32_t            armv6m_shift_right(uint32_t val, uint32_t shift, uint32_t mask);
     uint32_t            armv6m_arith_shift_right(uint32_t val, uint32_t shift, uint32_t mask);
     uint32_t            armv6m_rotate_right(uint32_t val, uint32_t shift, uint32_t mask);
     uint32_t            armv6m_sign_extend(uint32_t val, int offset);
+    bool                armv6m_condition(uint32_t cond);
     void                armv6m_dump_inst(uint16_t inst);
     uint32_t            armv6m_exception(uint32_t pc, uint32_t exception);
     uint32_t            armv6m_exc_return(uint32_t pc);
+    void                invalidate_code(uint32_t addr, int length);
 
 public:
-    int                 armv6m_decode(uint16_t inst);
-    uint32_t            armv6m_execute(uint16_t inst, uint16_t inst2);
+    int                 armv6m_decode(uint16_t inst, uint16_t inst2, t_armv6m_inst *d);
+    uint32_t            armv6m_execute(const t_armv6m_inst *inst);
+
+// Pre-decoded instruction cache
+protected:
+    typedef struct
+    {
+        uint32_t        pc;     // Halfword address tag
+        t_armv6m_inst   inst;
+    } t_decoded;
+
+    const t_armv6m_inst *armv6m_fetch(uint32_t pc, t_armv6m_inst *tmp);
+    void                decode_flush(void);
+    bool                decode_fill(t_decoded *entry, uint32_t pc);
+    bool                decode_page_cached(uint32_t addr)
+    {
+        uint32_t page = addr >> DECODE_PGSHIFT;
+        return m_decode_pages[page >> 5] & (1 << (page & 31));
+    }
 
 protected:  
 
@@ -87,15 +225,18 @@ protected:
 
     uint32_t            m_entry_point;
 
-    // Decode
-    int                 m_inst_group;
-    uint32_t            m_rd;
-    uint32_t            m_rt;
-    uint32_t            m_rm;
-    uint32_t            m_rn;
-    uint32_t            m_imm;
-    uint32_t            m_cond;
-    uint32_t            m_reglist;
+    // Lazy APSR: last flag setting result / operands (see armv6m_flags_eval)
+    uint32_t            m_flags_lazy;
+    uint32_t            m_flags_res;
+    uint32_t            m_flags_op1;
+    uint32_t            m_flags_op2;
+    uint32_t            m_flags_cin;
+
+    // Decoded instruction cache (direct mapped on halfword address)
+    static const int    DECODE_ENTRIES = 8192;
+    static const int    DECODE_PGSHIFT = 12;
+    std::vector<t_decoded> m_decode;
+    std::vector<uint32_t>  m_decode_pages; // Pages holding cached entries
 
     // Built in peripherals
     device_systick    * m_systick;
@@ -27,6 +27,8 @@
 
 #define SET_LOAD_DELAY_SLOT(_reg)
 
+#define BLOCK_INVALID       0xFFFFFFFF
+
 #define ARITH_OVERFLOW(_op1, _op2, _res) ((((_op1) & 0x80000000) == ((_op2) & 0x80000000)) && \
                                           (((_op1) & 0x80000000) != ((_res) & 0x80000000)))
 
@@ -96,6 +98,9 @@ mips_i::mips_i(uint32_t baseAddr /*= 0*/, uint32_t len /*= 0*/): cpu()
 {
     m_enable_mem_errors  = true;
 
+    m_blocks.resize(BLOCK_ENTRIES);
+    m_block_pages.resize(((1ULL << 32) >> BLOCK_PGSHIFT) / 32);
+
     // Some memory defined
     if (len != 0)
         create_memory(baseAddr, len);
@@ -184,6 +189,7 @@ void mips_i::reset(uint32_t start_addr)
     m_pc_next   = start_addr;
     m_pc_x      = start_addr;
 
+    block_flush();
     stats_reset();
 }
 //-----------------------------------------------------------------
@@ -212,43 +218,64 @@ int mips_i::load(uint32_t pc, uint32_t address, uint32_t *result, int width, boo
     m_stats[STATS_LOADS]++;
     *result = 0;
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(physical))
+    // Directly backed memory
+    uint8_t *host = get_host_ptr(physical);
+    if (host)
+    {
+        switch (width)
         {
-            switch (width)
-            {
-                case 4:
-                    mem->read32(physical, *result);
-                    break;
-                case 2:
-                {
-                    uint16_t dh = 0;
-                    mem->read16(physical, dh);
-                    *result |= dh;
-
-                    if (signedLoad && ((*result) & (1 << 15)))
-                         *result |= 0xFFFF0000;
-                }
+            case 4:
+                *result = mem_load32(host);
                 break;
-                case 1:
-                {
-                    uint8_t db = 0;
-                    mem->read8(physical + 0, db);
-                    *result |= ((uint32_t)db << 0);
+            case 2:
+                *result = signedLoad ? (uint32_t)(int16_t)mem_load16(host) : mem_load16(host);
+                break;
+            default:
+                *result = signedLoad ? (uint32_t)(int8_t)*host : *host;
+                break;
+        }
 
-                    if (signedLoad && ((*result) & (1 << 7)))
-                         *result |= 0xFFFFFF00;
-                }
+        DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
+        return 1;
+    }
+
+    memory_base *mem = find_memory(physical);
+    if (mem)
+    {
+        switch (width)
+        {
+            case 4:
+                mem->read32(physical, *result);
                 break;
-                default:
-                    assert(!"Invalid");
-                    break;
+            case 2:
+            {
+                uint16_t dh = 0;
+                mem->read16(physical, dh);
+                *result |= dh;
+
+                if (signedLoad && ((*result) & (1 << 15)))
+                     *result |= 0xFFFF0000;
             }
+            break;
+            case 1:
+            {
+                uint8_t db = 0;
+                mem->read8(physical + 0, db);
+                *result |= ((uint32_t)db << 0);
 
-            DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
-            return 1;
+                if (signedLoad && ((*result) & (1 << 7)))
+                     *result |= 0xFFFFFF00;
+            }
+            break;
+            default:
+                assert(!"Invalid");
+                break;
         }
 
+        DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
+        return 1;
+    }
+
     if (m_enable_mem_errors)
     {
         exception(EXC_DBE, pc, address);
@@ -276,67 +303,90 @@ int mips_i::store(uint32_t pc, uint32_t address, uint32_t data, int width, uint8
 
     m_stats[STATS_STORES]++;
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(physical))
+    // Self-modifying code
+    if (block_page_cached(physical))
+        block_invalidate(physical);
+
+    // Directly backed memory (full width accesses)
+    uint8_t *host = get_host_ptr(physical);
+    if (host && (width != 4 || mask == 0xF))
+    {
+        switch (width)
         {
-            switch (width)
+            case 4:
+                mem_store32(host, data);
+                break;
+            case 2:
+                mem_store16(host, data);
+                break;
+            default:
+                *host = data;
+                break;
+        }
+        return 1;
+    }
+
+    memory_base *mem = find_memory(physical);
+    if (mem)
+    {
+        switch (width)
+        {
+            case 4:
             {
-                case 4:
+                switch (mask)
                 {
-                    switch (mask)
-                    {
-                        case 0xF:
-                            mem->write32(physical, data);
-                            break;
-                        // SWR/SWL patterns
-                        case 0x7:
-                            mem->write8(physical + 0, data >> 0);
-                            mem->write8(physical + 1, data >> 8);
-                            mem->write8(physical + 2, data >> 16);
-                            break;
-                        case 0xe:
-                            mem->write8(physical + 1, data >> 8);
-                            mem->write8(physical + 2, data >> 16);
-                            mem->write8(physical + 3, data >> 24);
-                            break;
-                        case 0xc:
-                            mem->write8(physical + 2, data >> 16);
-                            mem->write8(physical + 3, data >> 24);
-                            break;
-                        case 0x3:
-                            mem->write8(physical + 0, data >> 0);
-                            mem->write8(physical + 1, data >> 8);
-                            break;
-                        case 0x8:
-                            mem->write8(physical + 3, data >> 24);
-                            break;
-                        case 0x4:
-                            mem->write8(physical + 2, data >> 16);
-                            break;
-                        case 0x2:
-                            mem->write8(physical + 1, data >> 8);
-                            break;
-                        case 0x1:
-                            mem->write8(physical + 0, data >> 0);
-                            break;
-                        default:
-                            assert(!"Invalid");
-                            break;
-                    }
+                    case 0xF:
+                        mem->write32(physical, data);
+                        break;
+                    // SWR/SWL patterns
+                    case 0x7:
+                        mem->write8(physical + 0, data >> 0);
+                        mem->write8(physical + 1, data >> 8);
+                        mem->write8(physical + 2, data >> 16);
+                        break;
+                    case 0xe:
+                        mem->write8(physical + 1, data >> 8);
+                        mem->write8(physical + 2, data >> 16);
+                        mem->write8(physical + 3, data >> 24);
+                        break;
+                    case 0xc:
+                        mem->write8(physical + 2, data >> 16);
+                        mem->write8(physical + 3, data >> 24);
+                        break;
+                    case 0x3:
+                        mem->write8(physical + 0, data >> 0);
+                        mem->write8(physical + 1, data >> 8);
+                        break;
+                    case 0x8:
+                        mem->write8(physical + 3, data >> 24);
+                        break;
+                    case 0x4:
+                        mem->write8(physical + 2, data >> 16);
+                        break;
+                    case 0x2:
+                        mem->write8(physical + 1, data >> 8);
+                        break;
+                    case 0x1:
+                        mem->write8(physical + 0, data >> 0);
+                        break;
+                    default:
+                        assert(!"Invalid");
+                        break;
                 }
+            }
+            break;
+            case 2:
+                mem->write16(physical, data & 0xFFFF);
                 break;
-                case 2:
-                    mem->write16(physical, data & 0xFFFF);
-                    break;
-                case 1:
-                    mem->write8(physical, data & 0xFF);
-                    break;
-                default:
-                    assert(!"Invalid");
-                    break;
-            }        
-            return 1;
-        }
+            case 1:
+                mem->write8(physical, data & 0xFF);
+                break;
+            default:
+                assert(!"Invalid");
+                break;
+        }        
+        return 1;
+    }
 
     if (m_enable_mem_errors)
     {
@@ -1180,6 +1230,629 @@ void mips_i::step(uint64_t cycles)
     cpu::step(cycles);
 }
 //-----------------------------------------------------------------
+// irq_pending: Interrupt pending and enabled
+//-----------------------------------------------------------------
+bool mips_i::irq_pending(void)
+{
+    return SR_BF_GET(m_status, IEC) &&
+           (SR_BF_GETM(m_status, IM0, 0xFF) & CAUSE_BF_GET(m_cause, IP0, 0xFF)) != 0;
+}
+//-----------------------------------------------------------------
+// decode: Decode opcode for the block cache (returns false for
+// instructions left to execute(): coprocessor, syscall, break, invalid)
+//-----------------------------------------------------------------
+bool mips_i::decode(uint32_t opcode, t_mips_inst *d)
+{
+    uint32_t inst   = (opcode >> OPCODE_INST_SHIFT) & OPCODE_INST_MASK;
+    uint32_t rs     = (opcode >> OPCODE_RS_SHIFT)   & OPCODE_RS_MASK;
+    uint32_t rt     = (opcode >> OPCODE_RT_SHIFT)   & OPCODE_RT_MASK;
+    uint32_t rd     = (opcode >> OPCODE_RD_SHIFT)   & OPCODE_RD_MASK;
+    uint32_t re     = (opcode >> OPCODE_RE_SHIFT)   & OPCODE_RE_MASK;
+    uint32_t func   = (opcode >> OPCODE_FUNC_SHIFT) & OPCODE_FUNC_MASK;
+    uint32_t imm    = (opcode >> OPCODE_IMM_SHIFT)  & OPCODE_IMM_MASK;
+    uint32_t target = (opcode >> OPCODE_ADDR_SHIFT) & OPCODE_ADDR_MASK;
+
+    d->op  = MIPS_OP_INVALID;
+    d->rs  = rs;
+    d->rt  = rt;
+    d->rd  = rt;
+    d->imm = (uint32_t)(int16_t)imm;
+
+    if (opcode == 0x00000000)
+    {
+        d->op = MIPS_OP_NOP;
+        return true;
+    }
+
+    switch (inst)
+    {
+        case 0x00:/*SPECIAL*/
+            d->rd = rd;
+            switch (func)
+            {
+            case INSTR_R_SLL:   d->op = MIPS_OP_SLL;  d->imm = re; break;
+            case INSTR_R_SRL:   d->op = MIPS_OP_SRL;  d->imm = re; break;
+            case INSTR_R_SRA:   d->op = MIPS_OP_SRA;  d->imm = re; break;
+            case INSTR_R_SLLV:  d->op = MIPS_OP_SLLV;  break;
+            case INSTR_R_SRLV:  d->op = MIPS_OP_SRLV;  break;
+            case INSTR_R_SRAV:  d->op = MIPS_OP_SRAV;  break;
+            case INSTR_R_JR:    d->op = MIPS_OP_JR;    break;
+            case INSTR_R_JALR:  d->op = MIPS_OP_JALR;  break;
+            case INSTR_R_MFHI:  d->op = MIPS_OP_MFHI;  break;
+            case INSTR_R_MTHI:  d->op = MIPS_OP_MTHI;  break;
+            case INSTR_R_MFLO:  d->op = MIPS_OP_MFLO;  break;
+            case INSTR_R_MTLO:  d->op = MIPS_OP_MTLO;  break;
+            case INSTR_R_MULT:  d->op = MIPS_OP_MULT;  break;
+            case INSTR_R_MULTU: d->op = MIPS_OP_MULTU; break;
+            case INSTR_R_DIV:   d->op = MIPS_OP_DIV;   break;
+            case INSTR_R_DIVU:  d->op = MIPS_OP_DIVU;  break;
+            case INSTR_R_ADD:   d->op = MIPS_OP_ADD;   break;
+            case INSTR_R_ADDU:  d->op = MIPS_OP_ADDU;  break;
+            case INSTR_R_SUB:   d->op = MIPS_OP_SUB;   break;
+            case INSTR_R_SUBU:  d->op = MIPS_OP_SUBU;  break;
+            case INSTR_R_AND:   d->op = MIPS_OP_AND;   break;
+            case INSTR_R_OR:    d->op = MIPS_OP_OR;    break;
+            case INSTR_R_XOR:   d->op = MIPS_OP_XOR;   break;
+            case INSTR_R_NOR:   d->op = MIPS_OP_NOR;   break;
+            case INSTR_R_SLT:   d->op = MIPS_OP_SLT;   break;
+            case INSTR_R_SLTU:  d->op = MIPS_OP_SLTU;  break;
+            default:
+                return false;
+            }
+            break;
+        case INSTR_I_REGIMM:
+            d->imm <<= 2;
+            d->rd    = MIPS_REG_RA;
+            switch (rt)
+            {
+            case INSTR_I_COND_BLTZAL: d->op = MIPS_OP_BLTZAL; break;
+            case INSTR_I_COND_BLTZ:   d->op = MIPS_OP_BLTZ;   break;
+            case INSTR_I_COND_BGEZAL: d->op = MIPS_OP_BGEZAL; break;
+            case INSTR_I_COND_BGEZ:   d->op = MIPS_OP_BGEZ;   break;
+            default:
+                return false;
+            }
+            break;
+        case INSTR_J_JAL:
+            d->op  = MIPS_OP_JAL;
+            d->rd  = MIPS_REG_RA;
+            d->imm = target << 2;
+            break;
+        case INSTR_J_J:
+            d->op  = MIPS_OP_J;
+            d->imm = target << 2;
+            break;
+        case INSTR_J_BEQ:   d->op = MIPS_OP_BEQ;  d->imm <<= 2; break;
+        case INSTR_J_BNE:   d->op = MIPS_OP_BNE;  d->imm <<= 2; break;
+        case INSTR_J_BLEZ:  d->op = MIPS_OP_BLEZ; d->imm <<= 2; break;
+        case INSTR_J_BGTZ:  d->op = MIPS_OP_BGTZ; d->imm <<= 2; break;
+        case INSTR_I_ADDI:  d->op = MIPS_OP_ADDI;  break;
+        case INSTR_I_ADDIU: d->op = MIPS_OP_ADDIU; break;
+        case INSTR_I_SLTI:  d->op = MIPS_OP_SLTI;  break;
+        case INSTR_I_SLTIU: d->op = MIPS_OP_SLTIU; break;
+        case INSTR_I_ANDI:  d->op = MIPS_OP_ANDI; d->imm = imm; break;
+        case INSTR_I_ORI:   d->op = MIPS_OP_ORI;  d->imm = imm; break;
+        case INSTR_I_XORI:  d->op = MIPS_OP_XORI; d->imm = imm; break;
+        case INSTR_I_LUI:   d->op = MIPS_OP_LUI;  d->imm = imm << 16; break;
+        case INSTR_I_LB:    d->op = MIPS_OP_LB;  break;
+        case INSTR_I_LH:    d->op = MIPS_OP_LH;  break;
+        case INSTR_I_LW:    d->op = MIPS_OP_LW;  break;
+        case INSTR_I_LBU:   d->op = MIPS_OP_LBU; break;
+        case INSTR_I_LHU:   d->op = MIPS_OP_LHU; break;
+        case INSTR_I_LWL:   d->op = MIPS_OP_LWL; break;
+        case INSTR_I_LWR:   d->op = MIPS_OP_LWR; break;
+        case INSTR_I_SB:    d->op = MIPS_OP_SB;  break;
+        case INSTR_I_SH:    d->op = MIPS_OP_SH;  break;
+        case INSTR_I_SW:    d->op = MIPS_OP_SW;  break;
+        case INSTR_I_SWL:   d->op = MIPS_OP_SWL; break;
+        case INSTR_I_SWR:   d->op = MIPS_OP_SWR; break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------
+// block_flush: Invalidate all cached blocks
+//-----------------------------------------------------------------
+void mips_i::block_flush(void)
+{
+    for (int i=0;i<BLOCK_ENTRIES;i++)
+        m_blocks[i].pc = BLOCK_INVALID;
+
+    memset(&m_block_pages[0], 0, m_block_pages.size() * sizeof(uint32_t));
+}
+//-----------------------------------------------------------------
+// block_invalidate: Invalidate cached blocks in a page
+//-----------------------------------------------------------------
+void mips_i::block_invalidate(uint32_t addr)
+{
+    uint32_t page = addr >> BLOCK_PGSHIFT;
+    uint32_t idx  = (page << (BLOCK_PGSHIFT - 2));
+
+    // A page maps onto a contiguous (wrapping) run of entries
+    for (int i=0;i<(1 << (BLOCK_PGSHIFT - 2));i++)
+    {
+        t_block *block = &m_blocks[(idx + i) & (BLOCK_ENTRIES-1)];
+        if ((block->pc >> BLOCK_PGSHIFT) == page)
+            block->pc = BLOCK_INVALID;
+    }
+
+    m_block_pages[page >> 5] &= ~(1 << (page & 31));
+}
+//-----------------------------------------------------------------
+// invalidate_code: Memory modified outside of the instruction stream
+//-----------------------------------------------------------------
+void mips_i::invalidate_code(uint32_t addr, int length)
+{
+    uint64_t end = (uint64_t)addr + length;
+    for (uint64_t a = addr & ~((1 << BLOCK_PGSHIFT) - 1); a < end; a += (1 << BLOCK_PGSHIFT))
+        if (block_page_cached(a))
+            block_invalidate(a);
+}
+//-----------------------------------------------------------------
+// block_find: Lookup (or build) the block at the current PC
+//-----------------------------------------------------------------
+mips_i::t_block *mips_i::block_find(void)
+{
+    // Misaligned fetch faults are raised by execute()
+    if (m_pc & 3)
+        return NULL;
+
+    t_block *block = &m_blocks[(m_pc >> 2) & (BLOCK_ENTRIES-1)];
+    bool hit = (block->pc == m_pc);
+    HOST_STATS_HIT(hit, COUNT_BLOCK_HIT, COUNT_BLOCK_MISS);
+    if (hit)
+        return block;
+
+    return block_build(block, m_pc) ? block : NULL;
+}
+//-----------------------------------------------------------------
+// block_build: Decode instructions up to (and including) the next
+// branch and its delay slot
+//-----------------------------------------------------------------
+bool mips_i::block_build(t_block *block, uint32_t pc)
+{
+    // Blocks never cross a page
+    uint32_t avail = (1 << BLOCK_PGSHIFT) - (pc & ((1 << BLOCK_PGSHIFT) - 1));
+
+    // Only directly backed memory is cached (devices may have side effects)
+    uint8_t *host = get_host_ptr(pc);
+    if (!host)
+    {
+        // Page shared between regions (e.g. small ELF sections)
+        memory_base *mem = find_memory(pc);
+        uint32_t dmi_base = 0;
+        uint32_t dmi_size = 0;
+        uint8_t *dmi = mem ? mem->get_dmi(dmi_base, dmi_size) : NULL;
+        if (!dmi || pc < dmi_base || (pc - dmi_base) >= dmi_size)
+            return false;
+
+        host = dmi + (pc - dmi_base);
+        if (dmi_size - (pc - dmi_base) < avail)
+            avail = dmi_size - (pc - dmi_base);
+    }
+
+    int max   = (avail / 4) < BLOCK_MAX_INSTS ? (avail / 4) : BLOCK_MAX_INSTS;
+    int count = 0;
+
+    while (count < max)
+    {
+        t_mips_inst *inst = &block->inst[count];
+        if (!decode(mem_load32(host + count * 4), inst))
+            break;
+
+        if (inst->op >= MIPS_OP_J)
+        {
+            // Branch and delay slot execute as one unit (a branch in the
+            // delay slot, or a slot outside the block is single stepped)
+            t_mips_inst *ds = inst + 1;
+            if (count + 2 <= max && decode(mem_load32(host + (count + 1) * 4), ds) && ds->op < MIPS_OP_J)
+                count += 2;
+            break;
+        }
+
+        count++;
+    }
+
+    block->inst[count].op = MIPS_OP_INVALID;
+    if (count == 0)
+    {
+        block->pc = BLOCK_INVALID;
+        return false;
+    }
+
+    block->pc      = pc;
+    block->count   = count;
+    block->link[0] = NULL;
+    block->link[1] = NULL;
+
+    // Stores to this page must drop the block
+    uint32_t page = pc >> BLOCK_PGSHIFT;
+    m_block_pages[page >> 5] |= (1 << (page & 31));
+    return true;
+}
+//-----------------------------------------------------------------
+// block_next: Follow (or create) the chain to the successor block
+//-----------------------------------------------------------------
+mips_i::t_block *mips_i::block_next(t_block *block, int succ)
+{
+    uint32_t tag  = block->pc;
+    t_block *next = block->link[succ];
+
+    // Chained: same successor PC, not evicted
+    if (next && next->pc == m_pc)
+        return next;
+
+    next = block_find();
+    if (next && block->pc == tag)
+        block->link[succ] = next;
+
+    return next;
+}
+//-----------------------------------------------------------------
+// block_execute: Execute a block using threaded dispatch.
+// Returns the number of instructions executed, succ is the chain link
+// to the successor block (0 = fall-through, 1 = taken, -1 = none).
+//-----------------------------------------------------------------
+int mips_i::block_execute(t_block *block, int *succ)
+{
+    // Handlers (indexed by eMipsOp)
+    static const void *dispatch[] =
+    {
+        &&op_end,   &&op_nop,
+        &&op_sll,   &&op_srl,   &&op_sra,   &&op_sllv,  &&op_srlv,  &&op_srav,
+        &&op_mfhi,  &&op_mthi,  &&op_mflo,  &&op_mtlo,
+        &&op_mult,  &&op_multu, &&op_div,   &&op_divu,
+        &&op_add,   &&op_addu,  &&op_sub,   &&op_subu,
+        &&op_and,   &&op_or,    &&op_xor,   &&op_nor,   &&op_slt,   &&op_sltu,
+        &&op_addi,  &&op_addiu, &&op_slti,  &&op_sltiu,
+        &&op_andi,  &&op_ori,   &&op_xori,  &&op_lui,
+        &&op_lb,    &&op_lh,    &&op_lw,    &&op_lbu,   &&op_lhu,   &&op_lwl,   &&op_lwr,
+        &&op_sb,    &&op_sh,    &&op_sw,    &&op_swl,   &&op_swr,
+        &&op_j,     &&op_jal,   &&op_jr,    &&op_jalr,
+        &&op_beq,   &&op_bne,   &&op_blez,  &&op_bgtz,
+        &&op_bltz,  &&op_bgez,  &&op_bltzal,&&op_bgezal
+    };
+    static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == MIPS_OP_MAX, "Dispatch table mismatch");
+
+    const t_mips_inst *inst = block->inst;
+    uint32_t tag    = block->pc;
+    uint32_t pc     = m_pc;
+    uint32_t target = 0;
+    int      count  = 0;
+
+    *succ = 0;
+
+#define RS              m_gpr[inst->rs]
+#define RT              m_gpr[inst->rt]
+#define WRITE_RD(v)     do { m_gpr[inst->rd] = (v); m_gpr[0] = 0; } while (0)
+#define DISPATCH()      goto *dispatch[inst->op]
+#define NEXT()          do { pc += 4; inst++; count++; DISPATCH(); } while (0)
+#define LOAD(w, s)      do { uint32_t v; \
+                             if (!load(pc, RS + inst->imm, &v, w, s)) goto fault; \
+                             WRITE_RD(v); NEXT(); } while (0)
+#define STORE(a, v, w, m) do { if (!store(pc, a, v, w, m)) goto fault; \
+                             if (block->pc != tag || m_stopped) goto modified; \
+                             NEXT(); } while (0)
+// Taken: the delay slot (next in the block) runs with BD set, then the block exits to target
+#define BRANCH(c, t)    do { if (c) { target = (t); *succ = 1; m_branch_ds = true; m_stats[STATS_BRANCHES]++; } \
+                             NEXT(); } while (0)
+
+    DISPATCH();
+
+op_nop:
+    m_stats[STATS_NOP]++;
+    NEXT();
+
+op_sll:     WRITE_RD(RT << inst->imm); NEXT();
+op_srl:     WRITE_RD(RT >> inst->imm); NEXT();
+op_sra:     WRITE_RD((int32_t)RT >> inst->imm); NEXT();
+op_sllv:    WRITE_RD(RT << (RS & 31)); NEXT();
+op_srlv:    WRITE_RD(RT >> (RS & 31)); NEXT();
+op_srav:    WRITE_RD((int32_t)RT >> (RS & 31)); NEXT();
+op_mfhi:    WRITE_RD(m_hi); NEXT();
+op_mthi:    m_hi = RS; NEXT();
+op_mflo:    WRITE_RD(m_lo); NEXT();
+op_mtlo:    m_lo = RS; NEXT();
+op_addu:    WRITE_RD(RS + RT); NEXT();
+op_subu:    WRITE_RD(RS - RT); NEXT();
+op_and:     WRITE_RD(RS & RT); NEXT();
+op_or:      WRITE_RD(RS | RT); NEXT();
+op_xor:     WRITE_RD(RS ^ RT); NEXT();
+op_nor:     WRITE_RD(~(RS | RT)); NEXT();
+op_slt:     WRITE_RD((int32_t)RS < (int32_t)RT); NEXT();
+op_sltu:    WRITE_RD(RS < RT); NEXT();
+op_addiu:   WRITE_RD(RS + inst->imm); NEXT();
+op_slti:    WRITE_RD((int32_t)RS < (int32_t)inst->imm); NEXT();
+op_sltiu:   WRITE_RD(RS < inst->imm); NEXT();
+op_andi:    WRITE_RD(RS & inst->imm); NEXT();
+op_ori:     WRITE_RD(RS | inst->imm); NEXT();
+op_xori:    WRITE_RD(RS ^ inst->imm); NEXT();
+op_lui:     WRITE_RD(inst->imm); NEXT();
+
+op_mult:
+{
+    int64_t res = (int64_t)(int32_t)RS * (int64_t)(int32_t)RT;
+    m_hi = res >> 32;
+    m_lo = res >> 0;
+    NEXT();
+}
+op_multu:
+{
+    uint64_t res = (uint64_t)RS * (uint64_t)RT;
+    m_hi = res >> 32;
+    m_lo = res >> 0;
+    NEXT();
+}
+op_div:
+    if (RT == 0)
+    {
+        m_lo = ((int32_t)RS < 0) ? 1 : -1;
+        m_hi = RS;
+    }
+    else if (RS == 0x80000000 && RT == 0xffffffff)
+    {
+        m_lo = 0x80000000;
+        m_hi = 0x00000000;
+    }
+    else
+    {
+        m_lo = (int32_t)RS / (int32_t)RT;
+        m_hi = (int32_t)RS % (int32_t)RT;
+    }
+    NEXT();
+op_divu:
+    if (RT == 0)
+    {
+        m_lo = -1;
+        m_hi = RS;
+    }
+    else
+    {
+        m_lo = RS / RT;
+        m_hi = RS % RT;
+    }
+    NEXT();
+
+op_add:
+{
+    uint32_t res = RS + RT;
+    if (ARITH_OVERFLOW(RS, RT, res))
+    {
+        exception(EXC_OV, pc);
+        goto fault;
+    }
+    WRITE_RD(res);
+    NEXT();
+}
+op_sub:
+{
+    uint32_t res = RS - RT;
+    if (ARITH_OVERFLOW(RS, RT, res))
+    {
+        exception(EXC_OV, pc);
+        goto fault;
+    }
+    WRITE_RD(res);
+    NEXT();
+}
+op_addi:
+{
+    uint32_t res = RS + inst->imm;
+    if (ARITH_OVERFLOW(RS, inst->imm, res))
+    {
+        exception(EXC_OV, pc);
+        goto fault;
+    }
+    WRITE_RD(res);
+    NEXT();
+}
+
+op_lb:      LOAD(1, true);
+op_lh:      LOAD(2, true);
+op_lw:      LOAD(4, true);
+op_lbu:     LOAD(1, false);
+op_lhu:     LOAD(2, false);
+
+op_lwl:
+{
+    uint32_t addr = RS + inst->imm;
+    uint32_t v    = 0;
+    if (!load(pc, addr & ~3, &v, 4, false))
+        goto fault;
+
+    uint32_t mask = 0x00FFFFFF >> ((addr & 3) * 8);
+    v <<= ((3-(addr & 3)) * 8);
+    WRITE_RD((RT & mask) | v);
+    NEXT();
+}
+op_lwr:
+{
+    uint32_t addr = RS + inst->imm;
+    uint32_t v    = 0;
+    if (!load(pc, addr & ~3, &v, 4, false))
+        goto fault;
+
+    uint32_t mask = 0xFFFFFF00 << ((3-(addr & 3)) * 8);
+    v >>= ((addr & 3) * 8);
+    WRITE_RD((RT & mask) | v);
+    NEXT();
+}
+
+op_sb:
+{
+    uint32_t addr = RS + inst->imm;
+    STORE(addr, RT, 1, 1 << (addr & 3));
+}
+op_sh:
+{
+    uint32_t addr = RS + inst->imm;
+    STORE(addr, RT, 2, 0x3 << (addr & 2));
+}
+op_sw:
+    STORE(RS + inst->imm, RT, 4, 0xF);
+op_swl:
+{
+    uint32_t addr = RS + inst->imm;
+    STORE(addr & ~3, RT >> ((3 - (addr & 3)) * 8), 4, 0xF >> (3 - (addr & 3)));
+}
+op_swr:
+{
+    uint32_t addr = RS + inst->imm;
+    STORE(addr & ~3, RT << ((addr & 3) * 8), 4, (0xF << (addr & 3)) & 0xF);
+}
+
+// Branch targets are relative to the delay slot, links skip it
+op_j:       BRANCH(true, ((pc + 4) & 0xf0000000) | inst->imm);
+op_jr:      BRANCH(true, RS);
+op_beq:     BRANCH(RS == RT, pc + 4 + inst->imm);
+op_bne:     BRANCH(RS != RT, pc + 4 + inst->imm);
+op_blez:    BRANCH((int32_t)RS <= 0, pc + 4 + inst->imm);
+op_bgtz:    BRANCH((int32_t)RS > 0, pc + 4 + inst->imm);
+op_bltz:    BRANCH((int32_t)RS < 0, pc + 4 + inst->imm);
+op_bgez:    BRANCH((int32_t)RS >= 0, pc + 4 + inst->imm);
+
+op_jal:
+    WRITE_RD(pc + 8);
+    BRANCH(true, ((pc + 4) & 0xf0000000) | inst->imm);
+op_jalr:
+{
+    uint32_t t = RS;
+    WRITE_RD(pc + 8);
+    BRANCH(true, t);
+}
+op_bltzal:
+{
+    bool taken = (int32_t)RS < 0;
+    WRITE_RD(pc + 8);
+    BRANCH(taken, pc + 4 + inst->imm);
+}
+op_bgezal:
+{
+    bool taken = (int32_t)RS >= 0;
+    WRITE_RD(pc + 8);
+    BRANCH(taken, pc + 4 + inst->imm);
+}
+
+op_end:
+    // Fall-through, or branch target once the delay slot has executed
+    m_pc_x       = pc - 4;
+    m_pc         = *succ ? target : pc;
+    m_pc_next    = m_pc + 4;
+    m_branch_ds  = false;
+    m_take_excpn = false;
+    return count;
+
+modified:
+    // Store hit this block (or stopped the CPU), the remainder is refetched
+    if (inst[1].op == MIPS_OP_INVALID)
+        NEXT();
+
+    m_pc_x       = pc;
+    m_pc         = pc + 4;
+    m_pc_next    = m_pc + 4;
+    m_take_excpn = false;
+    *succ        = -1;
+    return count + 1;
+
+fault:
+    // Exception raised (EPC / cause already recorded), writeback squashed
+    m_pc_x       = pc;
+    m_pc         = m_isr_vector;
+    m_pc_next    = m_pc + 4;
+    m_take_excpn = true;
+    m_stats[STATS_EXCEPTIONS]++;
+    m_stats[STATS_BRANCHES]++;
+    *succ        = -1;
+    return count + 1;
+
+#undef RS
+#undef RT
+#undef WRITE_RD
+#undef DISPATCH
+#undef NEXT
+#undef LOAD
+#undef STORE
+#undef BRANCH
+}
+//-----------------------------------------------------------------
+// step_block: Execute chained blocks (up to max_steps).
+// Devices are clocked and interrupts checked once per block.
+//-----------------------------------------------------------------
+int mips_i::step_block(uint64_t cycles, int max_steps)
+{
+    t_block *block = NULL;
+
+    m_device_event = false;
+
+    // Tracing, breakpoints, delay slots and interrupt entry use the
+    // per-instruction path
+    if (!m_trace && !m_trace_file && !m_has_breakpoints && max_steps >= BLOCK_MAX_INSTS &&
+        !m_branch_ds && m_pc_next == m_pc + 4 && !irq_pending())
+        block = block_find();
+
+    if (!block)
+    {
+        step(cycles);
+        return 1;
+    }
+
+    int total = 0;
+    while (block)
+    {
+        int succ;
+        int count = block_execute(block, &succ);
+
+        total    += count;
+        m_cycles += count;
+        m_stats[STATS_INSTRUCTIONS] += count;
+
+        // Clock peripherals
+        cpu::step(cycles + total - 1);
+
+        if (succ < 0 || (total + BLOCK_MAX_INSTS) > max_steps || m_stopped || m_fault || m_break)
+            break;
+
+        // Device event or interrupt to take
+        if (m_device_event || irq_pending())
+            break;
+
+        block = block_next(block, succ);
+    }
+
+    return total;
+}
+//-----------------------------------------------------------------
+// run: Execute up to max_steps instructions
+//-----------------------------------------------------------------
+int mips_i::run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc)
+{
+    uint64_t end = cycles + max_steps;
+
+    m_device_event = false;
+    while (cycles < end)
+    {
+        // Blocks only end at branches, single step when watching for a PC
+        if (stop_pc == RUN_NO_STOP_PC)
+        {
+            uint64_t budget = end - cycles;
+            cycles += mips_i::step_block(cycles, budget < RUN_BLOCK_STEPS ? (int)budget : RUN_BLOCK_STEPS);
+        }
+        else
+        {
+            mips_i::step(cycles);
+            cycles++;
+        }
+
+        int status = run_status(m_pc_x, stop_pc);
+        if (status != RUN_BUDGET)
+            return status;
+    }
+
+    return RUN_BUDGET;
+}
+//-----------------------------------------------------------------
 // set_interrupt: Register pending interrupt
 //-----------------------------------------------------------------
 void mips_i::set_interrupt(int irq)
@@ -13,6 +13,82 @@
 #include "memory.h"
 #include "cpu.h"
 
+//--------------------------------------------------------------------
+// Decoded instruction (block cache)
+//--------------------------------------------------------------------
+enum eMipsOp
+{
+    MIPS_OP_INVALID,    // End of block
+    MIPS_OP_NOP,
+    MIPS_OP_SLL,
+    MIPS_OP_SRL,
+    MIPS_OP_SRA,
+    MIPS_OP_SLLV,
+    MIPS_OP_SRLV,
+    MIPS_OP_SRAV,
+    MIPS_OP_MFHI,
+    MIPS_OP_MTHI,
+    MIPS_OP_MFLO,
+    MIPS_OP_MTLO,
+    MIPS_OP_MULT,
+    MIPS_OP_MULTU,
+    MIPS_OP_DIV,
+    MIPS_OP_DIVU,
+    MIPS_OP_ADD,
+    MIPS_OP_ADDU,
+    MIPS_OP_SUB,
+    MIPS_OP_SUBU,
+    MIPS_OP_AND,
+    MIPS_OP_OR,
+    MIPS_OP_XOR,
+    MIPS_OP_NOR,
+    MIPS_OP_SLT,
+    MIPS_OP_SLTU,
+    MIPS_OP_ADDI,
+    MIPS_OP_ADDIU,
+    MIPS_OP_SLTI,
+    MIPS_OP_SLTIU,
+    MIPS_OP_ANDI,
+    MIPS_OP_ORI,
+    MIPS_OP_XORI,
+    MIPS_OP_LUI,
+    MIPS_OP_LB,
+    MIPS_OP_LH,
+    MIPS_OP_LW,
+    MIPS_OP_LBU,
+    MIPS_OP_LHU,
+    MIPS_OP_LWL,
+    MIPS_OP_LWR,
+    MIPS_OP_SB,
+    MIPS_OP_SH,
+    MIPS_OP_SW,
+    MIPS_OP_SWL,
+    MIPS_OP_SWR,
+    // Branches / jumps (followed by their delay slot)
+    MIPS_OP_J,
+    MIPS_OP_JAL,
+    MIPS_OP_JR,
+    MIPS_OP_JALR,
+    MIPS_OP_BEQ,
+    MIPS_OP_BNE,
+    MIPS_OP_BLEZ,
+    MIPS_OP_BGTZ,
+    MIPS_OP_BLTZ,
+    MIPS_OP_BGEZ,
+    MIPS_OP_BLTZAL,
+    MIPS_OP_BGEZAL,
+    MIPS_OP_MAX
+};
+
+typedef struct
+{
+    uint8_t     op;
+    uint8_t     rs;
+    uint8_t     rt;
+    uint8_t     rd;     // Writeback register (rd, rt or ra)
+    uint32_t    imm;    // Extended immediate, shift amount, branch offset or jump target
+} t_mips_inst;
+
 //--------------------------------------------------------------------
 // Class
 //--------------------------------------------------------------------
@@ -24,6 +100,8 @@ public:
     void                reset(uint32_t start_addr);
     uint32_t            get_opcode(uint32_t pc);
     void                step(uint64_t cycles);
+    int                 step_block(uint64_t cycles, int max_steps);
+    int                 run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc = RUN_NO_STOP_PC);
 
     void                set_interrupt(int irq);
     void                clr_interrupt(int irq) { }
@@ -62,6 +140,37 @@ protected:
     virtual int         copro0_inst(uint32_t pc, uint32_t opc, uint32_t reg_rs, uint32_t reg_rt, int &wb_reg, uint32_t &result);
     virtual int         copro_inst(int cop,  uint32_t pc, uint32_t opc, uint32_t reg_rs, uint32_t reg_rt, int &wb_reg, uint32_t &result);
 
+    bool                decode(uint32_t opcode, t_mips_inst *inst);
+    bool                irq_pending(void);
+    void                invalidate_code(uint32_t addr, int length);
+
+// Basic block cache
+private:
+    static const int    BLOCK_ENTRIES   = 4096;
+    static const int    BLOCK_MAX_INSTS = 32;
+    static const int    BLOCK_PGSHIFT   = 12;
+    static const int    RUN_BLOCK_STEPS = 4096; // Per step_block() call from run()
+
+    typedef struct t_block
+    {
+        uint32_t        pc;
+        int             count;
+        struct t_block *link[2];    // Successors (fall-through, taken)
+        t_mips_inst     inst[BLOCK_MAX_INSTS + 1]; // MIPS_OP_INVALID terminated
+    } t_block;
+
+    t_block *           block_find(void);
+    bool                block_build(t_block *block, uint32_t pc);
+    t_block *           block_next(t_block *block, int succ);
+    int                 block_execute(t_block *block, int *succ);
+    void                block_flush(void);
+    void                block_invalidate(uint32_t addr);
+    bool                block_page_cached(uint32_t addr)
+    {
+        uint32_t page = addr >> BLOCK_PGSHIFT;
+        return m_block_pages[page >> 5] & (1 << (page & 31));
+    }
+
 private:
 
     // Other registers
@@ -81,6 +190,10 @@ private:
     uint32_t           m_cycles;
     uint32_t           m_gpr[32];
 
+    // Basic blocks (direct mapped on PC)
+    std::vector<t_block>  m_blocks;
+    std::vector<uint32_t> m_block_pages; // Pages holding cached blocks
+
     enum eStatsMips
     { 
         STATS_MIN,
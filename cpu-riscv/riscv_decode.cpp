@@ -0,0 +1,761 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdint.h>
+#include <stdio.h>
+#include "riscv_decode.h"
+
+//-----------------------------------------------------------------
+// Defines:
+//-----------------------------------------------------------------
+#define REG_RA              1
+#define REG_SP              2
+
+// Extension / XLEN required by a table entry
+#define REQ_RV64            RV_DECODE_RV64
+#define REQ_RVM             RV_DECODE_RVM
+#define REQ_RVA             RV_DECODE_RVA
+
+// Operand formats (leaf entries)
+enum eFormat
+{
+    FMT_NONE,       // rd, rs1, rs2 as encoded, no immediate
+    FMT_R,
+    FMT_I,
+    FMT_S,
+    FMT_B,
+    FMT_U,
+    FMT_J,
+    FMT_SHIFT,      // SLLI / SRLI / SRAI (funct6 / funct7 selects SRAI)
+    FMT_SHIFTW,     // SLLIW / SRLIW / SRAIW
+    FMT_CSRI,
+
+    // Second level tables
+    FMT_OP,         // funct7
+    FMT_OP32,       // funct7
+    FMT_SYSTEM,     // funct12
+    FMT_AMO         // funct5
+};
+
+// Compressed formats
+enum eCFormat
+{
+    CFMT_ILLEGAL,
+    CFMT_ADDI4SPN,
+    CFMT_CL_W,
+    CFMT_CL_D,
+    CFMT_CS_W,
+    CFMT_CS_D,
+    CFMT_ADDI,
+    CFMT_JAL,
+    CFMT_ADDIW,
+    CFMT_LI,
+    CFMT_LUI,
+    CFMT_ALU,
+    CFMT_J,
+    CFMT_BRANCH,
+    CFMT_SLLI,
+    CFMT_LWSP,
+    CFMT_LDSP,
+    CFMT_CR,
+    CFMT_SWSP,
+    CFMT_SDSP
+};
+
+typedef struct
+{
+    uint8_t op;
+    uint8_t fmt;
+    uint8_t req;
+} t_entry;
+
+static constexpr t_entry E(int op, int fmt, int req = 0) { return t_entry { (uint8_t)op, (uint8_t)fmt, (uint8_t)req }; }
+
+#define ILL                 E(RV_OP_ILLEGAL, FMT_NONE)
+#define ILL8                ILL, ILL, ILL, ILL, ILL, ILL, ILL, ILL
+#define ALL8(e)             e, e, e, e, e, e, e, e
+
+//-----------------------------------------------------------------
+// Level 1: [major opcode][funct3]
+//-----------------------------------------------------------------
+static const t_entry m_major[32][8] =
+{
+    // 0x03: LOAD
+    { E(RV_OP_LB, FMT_I), E(RV_OP_LH, FMT_I), E(RV_OP_LW, FMT_I), E(RV_OP_LD, FMT_I, REQ_RV64),
+      E(RV_OP_LBU, FMT_I), E(RV_OP_LHU, FMT_I), E(RV_OP_LWU, FMT_I, REQ_RV64), ILL },
+    // 0x07: LOAD-FP
+    { ILL8 },
+    // 0x0b: CUSTOM-0
+    { ILL8 },
+    // 0x0f: MISC-MEM
+    { E(RV_OP_FENCE, FMT_I), E(RV_OP_FENCE_I, FMT_I), ILL, ILL, ILL, ILL, ILL, ILL },
+    // 0x13: OP-IMM
+    { E(RV_OP_ADDI, FMT_I), E(RV_OP_SLLI, FMT_SHIFT), E(RV_OP_SLTI, FMT_I), E(RV_OP_SLTIU, FMT_I),
+      E(RV_OP_XORI, FMT_I), E(RV_OP_SRLI, FMT_SHIFT), E(RV_OP_ORI, FMT_I), E(RV_OP_ANDI, FMT_I) },
+    // 0x17: AUIPC
+    { ALL8(E(RV_OP_AUIPC, FMT_U)) },
+    // 0x1b: OP-IMM-32
+    { E(RV_OP_ADDIW, FMT_I, REQ_RV64), E(RV_OP_SLLIW, FMT_SHIFTW, REQ_RV64), ILL, ILL,
+      ILL, E(RV_OP_SRLIW, FMT_SHIFTW, REQ_RV64), ILL, ILL },
+    // 0x1f: 48-bit
+    { ILL8 },
+    // 0x23: STORE
+    { E(RV_OP_SB, FMT_S), E(RV_OP_SH, FMT_S), E(RV_OP_SW, FMT_S), E(RV_OP_SD, FMT_S, REQ_RV64),
+      ILL, ILL, ILL, ILL },
+    // 0x27: STORE-FP
+    { ILL8 },
+    // 0x2b: CUSTOM-1
+    { ILL8 },
+    // 0x2f: AMO
+    { ILL, ILL, E(RV_OP_ILLEGAL, FMT_AMO, REQ_RVA), E(RV_OP_ILLEGAL, FMT_AMO, REQ_RVA | REQ_RV64),
+      ILL, ILL, ILL, ILL },
+    // 0x33: OP
+    { ALL8(E(RV_OP_ILLEGAL, FMT_OP)) },
+    // 0x37: LUI
+    { ALL8(E(RV_OP_LUI, FMT_U)) },
+    // 0x3b: OP-32
+    { ALL8(E(RV_OP_ILLEGAL, FMT_OP32, REQ_RV64)) },
+    // 0x3f: 64-bit
+    { ILL8 },
+    // 0x43 - 0x5f: FP / CUSTOM-2 / 48-bit
+    { ILL8 }, { ILL8 }, { ILL8 }, { ILL8 }, { ILL8 }, { ILL8 }, { ILL8 }, { ILL8 },
+    // 0x63: BRANCH
+    { E(RV_OP_BEQ, FMT_B), E(RV_OP_BNE, FMT_B), ILL, ILL,
+      E(RV_OP_BLT, FMT_B), E(RV_OP_BGE, FMT_B), E(RV_OP_BLTU, FMT_B), E(RV_OP_BGEU, FMT_B) },
+    // 0x67: JALR
+    { E(RV_OP_JALR, FMT_I), ILL, ILL, ILL, ILL, ILL, ILL, ILL },
+    // 0x6b: Reserved
+    { ILL8 },
+    // 0x6f: JAL
+    { ALL8(E(RV_OP_JAL, FMT_J)) },
+    // 0x73: SYSTEM
+    { E(RV_OP_ILLEGAL, FMT_SYSTEM), E(RV_OP_CSRRW, FMT_I), E(RV_OP_CSRRS, FMT_I), E(RV_OP_CSRRC, FMT_I),
+      ILL, E(RV_OP_CSRRWI, FMT_CSRI), E(RV_OP_CSRRSI, FMT_CSRI), E(RV_OP_CSRRCI, FMT_CSRI) },
+    // 0x77: Reserved
+    { ILL8 },
+    // 0x7b: CUSTOM-3
+    { ILL8 },
+    // 0x7f: 80-bit+
+    { ILL8 }
+};
+
+//-----------------------------------------------------------------
+// Level 2: OP / OP-32 [funct7 class][funct3]
+// funct7 class: 0 = 0x00, 1 = 0x20, 2 = 0x01 (M), 3 = invalid
+//-----------------------------------------------------------------
+static const t_entry m_op[4][8] =
+{
+    { E(RV_OP_ADD, FMT_R), E(RV_OP_SLL, FMT_R), E(RV_OP_SLT, FMT_R), E(RV_OP_SLTU, FMT_R),
+      E(RV_OP_XOR, FMT_R), E(RV_OP_SRL, FMT_R), E(RV_OP_OR, FMT_R),  E(RV_OP_AND, FMT_R) },
+    { E(RV_OP_SUB, FMT_R), ILL, ILL, ILL, ILL, E(RV_OP_SRA, FMT_R), ILL, ILL },
+    { E(RV_OP_MUL, FMT_R, REQ_RVM),  E(RV_OP_MULH, FMT_R, REQ_RVM), E(RV_OP_MULHSU, FMT_R, REQ_RVM), E(RV_OP_MULHU, FMT_R, REQ_RVM),
+      E(RV_OP_DIV, FMT_R, REQ_RVM),  E(RV_OP_DIVU, FMT_R, REQ_RVM), E(RV_OP_REM, FMT_R, REQ_RVM),    E(RV_OP_REMU, FMT_R, REQ_RVM) },
+    { ILL8 }
+};
+
+static const t_entry m_op32[4][8] =
+{
+    { E(RV_OP_ADDW, FMT_R), E(RV_OP_SLLW, FMT_R), ILL, ILL, ILL, E(RV_OP_SRLW, FMT_R), ILL, ILL },
+    { E(RV_OP_SUBW, FMT_R), ILL, ILL, ILL, ILL, E(RV_OP_SRAW, FMT_R), ILL, ILL },
+    { E(RV_OP_MULW, FMT_R, REQ_RVM), ILL, ILL, ILL,
+      E(RV_OP_DIVW, FMT_R, REQ_RVM), E(RV_OP_DIVUW, FMT_R, REQ_RVM), E(RV_OP_REMW, FMT_R, REQ_RVM), E(RV_OP_REMUW, FMT_R, REQ_RVM) },
+    { ILL8 }
+};
+
+//-----------------------------------------------------------------
+// Level 2: AMO [funct5] (.W forms, .D = .W + (LR_D - LR_W))
+//-----------------------------------------------------------------
+static const uint8_t m_amo[32] =
+{
+    RV_OP_AMOADD_W,  RV_OP_AMOSWAP_W, RV_OP_LR_W,    RV_OP_SC_W,
+    RV_OP_AMOXOR_W,  RV_OP_ILLEGAL,   RV_OP_ILLEGAL, RV_OP_ILLEGAL,
+    RV_OP_AMOOR_W,   RV_OP_ILLEGAL,   RV_OP_ILLEGAL, RV_OP_ILLEGAL,
+    RV_OP_AMOAND_W,  RV_OP_ILLEGAL,   RV_OP_ILLEGAL, RV_OP_ILLEGAL,
+    RV_OP_AMOMIN_W,  RV_OP_ILLEGAL,   RV_OP_ILLEGAL, RV_OP_ILLEGAL,
+    RV_OP_AMOMAX_W,  RV_OP_ILLEGAL,   RV_OP_ILLEGAL, RV_OP_ILLEGAL,
+    RV_OP_AMOMINU_W, RV_OP_ILLEGAL,   RV_OP_ILLEGAL, RV_OP_ILLEGAL,
+    RV_OP_AMOMAXU_W, RV_OP_ILLEGAL,   RV_OP_ILLEGAL, RV_OP_ILLEGAL
+};
+
+//-----------------------------------------------------------------
+// Compressed: [RV64][quadrant * 8 + funct3]
+//-----------------------------------------------------------------
+static const uint8_t m_rvc[2][24] =
+{
+    // RV32
+    {
+        CFMT_ADDI4SPN, CFMT_ILLEGAL, CFMT_CL_W, CFMT_ILLEGAL, CFMT_ILLEGAL, CFMT_ILLEGAL, CFMT_CS_W, CFMT_ILLEGAL,
+        CFMT_ADDI,     CFMT_JAL,     CFMT_LI,   CFMT_LUI,     CFMT_ALU,     CFMT_J,       CFMT_BRANCH, CFMT_BRANCH,
+        CFMT_SLLI,     CFMT_ILLEGAL, CFMT_LWSP, CFMT_ILLEGAL, CFMT_CR,      CFMT_ILLEGAL, CFMT_SWSP, CFMT_ILLEGAL
+    },
+    // RV64
+    {
+        CFMT_ADDI4SPN, CFMT_ILLEGAL, CFMT_CL_W, CFMT_CL_D,    CFMT_ILLEGAL, CFMT_ILLEGAL, CFMT_CS_W, CFMT_CS_D,
+        CFMT_ADDI,     CFMT_ADDIW,   CFMT_LI,   CFMT_LUI,     CFMT_ALU,     CFMT_J,       CFMT_BRANCH, CFMT_BRANCH,
+        CFMT_SLLI,     CFMT_ILLEGAL, CFMT_LWSP, CFMT_LDSP,    CFMT_CR,      CFMT_ILLEGAL, CFMT_SWSP, CFMT_SDSP
+    }
+};
+
+//-----------------------------------------------------------------
+// Operation names
+//-----------------------------------------------------------------
+static const char *m_op_names[RV_OP_MAX] =
+{
+    "illegal",
+    "lui", "auipc", "jal", "jalr",
+    "beq", "bne", "blt", "bge", "bltu", "bgeu",
+    "lb", "lh", "lw", "lbu", "lhu", "lwu", "ld",
+    "sb", "sh", "sw", "sd",
+    "addi", "slti", "sltiu", "xori", "ori", "andi", "slli", "srli", "srai",
+    "add", "sub", "sll", "slt", "sltu", "xor", "srl", "sra", "or", "and",
+    "addiw", "slliw", "srliw", "sraiw", "addw", "subw", "sllw", "srlw", "sraw",
+    "fence", "fence.i", "sfence.vma", "ecall", "ebreak", "mret", "sret", "wfi",
+    "csrrw", "csrrs", "csrrc", "csrrwi", "csrrsi", "csrrci",
+    "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu",
+    "mulw", "divw", "divuw", "remw", "remuw",
+    "lr.w", "sc.w", "amoswap.w", "amoadd.w", "amoxor.w", "amoand.w", "amoor.w",
+    "amomin.w", "amomax.w", "amominu.w", "amomaxu.w",
+    "lr.d", "sc.d", "amoswap.d", "amoadd.d", "amoxor.d", "amoand.d", "amoor.d",
+    "amomin.d", "amomax.d", "amominu.d", "amomaxu.d"
+};
+
+//-----------------------------------------------------------------
+// Field extraction
+//-----------------------------------------------------------------
+static inline uint32_t bits(uint32_t x, int lo, int len)  { return (x >> lo) & ((1u << len) - 1); }
+static inline int32_t  sbits(uint32_t x, int lo, int len) { return (int32_t)(x << (32 - lo - len)) >> (32 - len); }
+
+static inline int32_t imm_i(uint32_t x) { return (int32_t)x >> 20; }
+static inline int32_t imm_s(uint32_t x) { return ((int32_t)x >> 20 & ~0x1F) | bits(x, 7, 5); }
+static inline int32_t imm_b(uint32_t x) { return (sbits(x, 31, 1) << 12) | (bits(x, 7, 1) << 11) | (bits(x, 25, 6) << 5) | (bits(x, 8, 4) << 1); }
+static inline int32_t imm_u(uint32_t x) { return (int32_t)(x & 0xFFFFF000); }
+static inline int32_t imm_j(uint32_t x) { return (sbits(x, 31, 1) << 20) | (bits(x, 12, 8) << 12) | (bits(x, 20, 1) << 11) | (bits(x, 21, 10) << 1); }
+
+// Compressed immediates (as per Spike)
+static inline int32_t c_imm(uint32_t x)          { return bits(x, 2, 5) | (sbits(x, 12, 1) << 5); }
+static inline int32_t c_zimm(uint32_t x)         { return bits(x, 2, 5) | (bits(x, 12, 1) << 5); }
+static inline int32_t c_addi4spn_imm(uint32_t x) { return (bits(x, 6, 1) << 2) | (bits(x, 5, 1) << 3) | (bits(x, 11, 2) << 4) | (bits(x, 7, 4) << 6); }
+static inline int32_t c_addi16sp_imm(uint32_t x) { return (bits(x, 6, 1) << 4) | (bits(x, 2, 1) << 5) | (bits(x, 5, 1) << 6) | (bits(x, 3, 2) << 7) | (sbits(x, 12, 1) << 9); }
+static inline int32_t c_lwsp_imm(uint32_t x)     { return (bits(x, 4, 3) << 2) | (bits(x, 12, 1) << 5) | (bits(x, 2, 2) << 6); }
+static inline int32_t c_ldsp_imm(uint32_t x)     { return (bits(x, 5, 2) << 3) | (bits(x, 12, 1) << 5) | (bits(x, 2, 3) << 6); }
+static inline int32_t c_swsp_imm(uint32_t x)     { return (bits(x, 9, 4) << 2) | (bits(x, 7, 2) << 6); }
+static inline int32_t c_sdsp_imm(uint32_t x)     { return (bits(x, 10, 3) << 3) | (bits(x, 7, 3) << 6); }
+static inline int32_t c_lw_imm(uint32_t x)       { return (bits(x, 6, 1) << 2) | (bits(x, 10, 3) << 3) | (bits(x, 5, 1) << 6); }
+static inline int32_t c_ld_imm(uint32_t x)       { return (bits(x, 10, 3) << 3) | (bits(x, 5, 2) << 6); }
+static inline int32_t c_j_imm(uint32_t x)        { return (bits(x, 3, 3) << 1) | (bits(x, 11, 1) << 4) | (bits(x, 2, 1) << 5) | (bits(x, 7, 1) << 6) | (bits(x, 6, 1) << 7) | (bits(x, 9, 2) << 8) | (bits(x, 8, 1) << 10) | (sbits(x, 12, 1) << 11); }
+static inline int32_t c_b_imm(uint32_t x)        { return (bits(x, 3, 2) << 1) | (bits(x, 10, 2) << 3) | (bits(x, 2, 1) << 5) | (bits(x, 5, 2) << 6) | (sbits(x, 12, 1) << 8); }
+
+//-----------------------------------------------------------------
+// decode_rvc: Expand compressed instruction
+//-----------------------------------------------------------------
+static bool decode_rvc(uint32_t opcode, uint32_t flags, t_riscv_inst *inst)
+{
+    bool     rv64  = (flags & RV_DECODE_RV64) != 0;
+    uint32_t rd    = bits(opcode, 7, 5);
+    uint32_t rs2   = bits(opcode, 2, 5);
+    uint32_t rs1s  = 8 + bits(opcode, 7, 3);
+    uint32_t rs2s  = 8 + bits(opcode, 2, 3);
+
+    inst->size = 2;
+    inst->rd   = rd;
+    inst->rs1  = rd;
+    inst->rs2  = rs2;
+
+    switch (m_rvc[rv64][(opcode & 3) * 8 + bits(opcode, 13, 3)])
+    {
+        case CFMT_ADDI4SPN:
+            if (opcode == 0)
+                return false;
+            inst->op  = RV_OP_ADDI;
+            inst->rd  = rs2s;
+            inst->rs1 = REG_SP;
+            inst->imm = c_addi4spn_imm(opcode);
+            return true;
+        case CFMT_CL_W:
+        case CFMT_CL_D:
+            inst->op  = (m_rvc[rv64][bits(opcode, 13, 3)] == CFMT_CL_W) ? RV_OP_LW : RV_OP_LD;
+            inst->rd  = rs2s;
+            inst->rs1 = rs1s;
+            inst->imm = (inst->op == RV_OP_LW) ? c_lw_imm(opcode) : c_ld_imm(opcode);
+            return true;
+        case CFMT_CS_W:
+        case CFMT_CS_D:
+            inst->op  = (m_rvc[rv64][bits(opcode, 13, 3)] == CFMT_CS_W) ? RV_OP_SW : RV_OP_SD;
+            inst->rd  = 0;
+            inst->rs1 = rs1s;
+            inst->rs2 = rs2s;
+            inst->imm = (inst->op == RV_OP_SW) ? c_lw_imm(opcode) : c_ld_imm(opcode);
+            return true;
+        case CFMT_ADDI:
+            inst->op  = RV_OP_ADDI;
+            inst->imm = c_imm(opcode);
+            return true;
+        case CFMT_ADDIW:
+            inst->op  = RV_OP_ADDIW;
+            inst->imm = c_imm(opcode);
+            return true;
+        case CFMT_JAL:
+            inst->op  = RV_OP_JAL;
+            inst->rd  = REG_RA;
+            inst->imm = c_j_imm(opcode);
+            return true;
+        case CFMT_LI:
+            inst->op  = RV_OP_ADDI;
+            inst->rs1 = 0;
+            inst->imm = c_imm(opcode);
+            return true;
+        case CFMT_LUI:
+            // C.ADDI16SP
+            if (rd == REG_SP)
+            {
+                inst->op  = RV_OP_ADDI;
+                inst->imm = c_addi16sp_imm(opcode);
+            }
+            // C.LUI
+            else
+            {
+                inst->op  = RV_OP_LUI;
+                inst->imm = c_imm(opcode) << 12;
+            }
+            return true;
+        case CFMT_ALU:
+            inst->rd  = rs1s;
+            inst->rs1 = rs1s;
+            inst->rs2 = rs2s;
+            switch (bits(opcode, 10, 2))
+            {
+                // C.SRLI, C.SRAI
+                case 0:
+                case 1:
+                    if (!rv64 && (opcode & (1 << 12)))
+                        return false;
+                    inst->op  = bits(opcode, 10, 2) ? RV_OP_SRAI : RV_OP_SRLI;
+                    inst->imm = c_zimm(opcode);
+                    return true;
+                // C.ANDI
+                case 2:
+                    inst->op  = RV_OP_ANDI;
+                    inst->imm = c_imm(opcode);
+                    return true;
+                // C.SUB, C.XOR, C.OR, C.AND / C.SUBW, C.ADDW
+                default:
+                {
+                    static const uint8_t alu_ops[8] =
+                    {
+                        RV_OP_SUB,  RV_OP_XOR,  RV_OP_OR,      RV_OP_AND,
+                        RV_OP_SUBW, RV_OP_ADDW, RV_OP_ILLEGAL, RV_OP_ILLEGAL
+                    };
+                    uint32_t idx = (bits(opcode, 12, 1) << 2) | bits(opcode, 5, 2);
+                    if (idx >= 4 && !rv64)
+                        return false;
+                    inst->op  = alu_ops[idx];
+                    return inst->op != RV_OP_ILLEGAL;
+                }
+            }
+        case CFMT_J:
+            inst->op  = RV_OP_JAL;
+            inst->rd  = 0;
+            inst->imm = c_j_imm(opcode);
+            return true;
+        case CFMT_BRANCH:
+            inst->op  = bits(opcode, 13, 1) ? RV_OP_BNE : RV_OP_BEQ;
+            inst->rd  = 0;
+            inst->rs1 = rs1s;
+            inst->rs2 = 0;
+            inst->imm = c_b_imm(opcode);
+            return true;
+        case CFMT_SLLI:
+            if (!rv64 && (opcode & (1 << 12)))
+                return false;
+            inst->op  = RV_OP_SLLI;
+            inst->imm = c_zimm(opcode);
+            return true;
+        case CFMT_LWSP:
+            inst->op  = RV_OP_LW;
+            inst->rs1 = REG_SP;
+            inst->imm = c_lwsp_imm(opcode);
+            return true;
+        case CFMT_LDSP:
+            inst->op  = RV_OP_LD;
+            inst->rs1 = REG_SP;
+            inst->imm = c_ldsp_imm(opcode);
+            return true;
+        case CFMT_CR:
+            inst->imm = 0;
+            if (!(opcode & (1 << 12)))
+            {
+                // C.JR
+                if (rs2 == 0)
+                {
+                    inst->op = RV_OP_JALR;
+                    inst->rd = 0;
+                }
+                // C.MV
+                else
+                {
+                    inst->op  = RV_OP_ADD;
+                    inst->rs1 = 0;
+                }
+            }
+            // C.EBREAK
+            else if (rd == 0 && rs2 == 0)
+            {
+                inst->op  = RV_OP_EBREAK;
+                inst->rs1 = 0;
+            }
+            // C.JALR
+            else if (rs2 == 0)
+            {
+                inst->op = RV_OP_JALR;
+                inst->rd = REG_RA;
+            }
+            // C.ADD
+            else
+                inst->op = RV_OP_ADD;
+            return true;
+        case CFMT_SWSP:
+        case CFMT_SDSP:
+            inst->op  = (m_rvc[rv64][16 + bits(opcode, 13, 3)] == CFMT_SWSP) ? RV_OP_SW : RV_OP_SD;
+            inst->rd  = 0;
+            inst->rs1 = REG_SP;
+            inst->imm = (inst->op == RV_OP_SW) ? c_swsp_imm(opcode) : c_sdsp_imm(opcode);
+            return true;
+        default:
+            return false;
+    }
+}
+//-----------------------------------------------------------------
+// riscv_decode: Table driven instruction decode
+//-----------------------------------------------------------------
+bool riscv_decode(uint32_t opcode, uint32_t flags, t_riscv_inst *inst)
+{
+    inst->opcode = opcode;
+    inst->op     = RV_OP_ILLEGAL;
+    inst->size   = 4;
+    inst->rd     = bits(opcode, 7, 5);
+    inst->rs1    = bits(opcode, 15, 5);
+    inst->rs2    = bits(opcode, 20, 5);
+    inst->imm    = 0;
+
+    // Compressed
+    if ((opcode & 3) != 3)
+    {
+        inst->opcode = opcode & 0xFFFF;
+        if (!(flags & RV_DECODE_RVC) || !decode_rvc(opcode & 0xFFFF, flags, inst))
+        {
+            inst->op = RV_OP_ILLEGAL;
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t funct3 = bits(opcode, 12, 3);
+    t_entry  e      = m_major[bits(opcode, 2, 5)][funct3];
+
+    switch (e.fmt)
+    {
+        case FMT_OP:
+        case FMT_OP32:
+        {
+            uint32_t funct7 = bits(opcode, 25, 7);
+            uint32_t cls    = (funct7 & ~0x21) ? 3 : ((funct7 >> 5) | ((funct7 & 1) << 1));
+            uint8_t  req    = e.req;
+            e = (e.fmt == FMT_OP) ? m_op[cls][funct3] : m_op32[cls][funct3];
+            e.req |= req;
+        }
+        break;
+        case FMT_AMO:
+        {
+            uint8_t op = m_amo[bits(opcode, 27, 5)];
+            if (op == RV_OP_ILLEGAL || ((op == RV_OP_LR_W) && inst->rs2 != 0))
+                return false;
+            if (funct3 == 3)
+                op += RV_OP_LR_D - RV_OP_LR_W;
+            e.op  = op;
+            e.fmt = FMT_R;
+        }
+        break;
+        case FMT_SYSTEM:
+        {
+            // SFENCE.VMA
+            if ((opcode & 0xFE007FFF) == 0x12000073)
+            {
+                e.op  = RV_OP_SFENCE_VMA;
+                e.fmt = FMT_NONE;
+                break;
+            }
+
+            // rd, rs1 must be zero
+            if (opcode & 0x000F8F80)
+                return false;
+
+            switch (opcode >> 20)
+            {
+                case 0x000: e.op = RV_OP_ECALL;  break;
+                case 0x001: e.op = RV_OP_EBREAK; break;
+                case 0x102: e.op = RV_OP_SRET;   break;
+                case 0x302: e.op = RV_OP_MRET;   break;
+                case 0x105: e.op = RV_OP_WFI;    break;
+                default:    return false;
+            }
+            e.fmt = FMT_NONE;
+        }
+        break;
+        default:
+            break;
+    }
+
+    // Required XLEN / extensions
+    if (e.op == RV_OP_ILLEGAL || (e.req & ~flags))
+        return false;
+
+    inst->op = e.op;
+    switch (e.fmt)
+    {
+        case FMT_I:
+            inst->imm = imm_i(opcode);
+            break;
+        case FMT_S:
+            inst->imm = imm_s(opcode);
+            inst->rd  = 0;
+            break;
+        case FMT_B:
+            inst->imm = imm_b(opcode);
+            inst->rd  = 0;
+            break;
+        case FMT_U:
+            inst->imm = imm_u(opcode);
+            break;
+        case FMT_J:
+            inst->imm = imm_j(opcode);
+            break;
+        case FMT_SHIFT:
+        {
+            // RV64: 6-bit shamt + funct6, RV32: 5-bit shamt + funct7
+            bool     rv64  = (flags & RV_DECODE_RV64) != 0;
+            uint32_t upper = rv64 ? bits(opcode, 26, 6) : bits(opcode, 25, 7);
+            uint32_t arith = rv64 ? 0x10 : 0x20;
+
+            if ((upper & ~arith) || (upper && inst->op == RV_OP_SLLI))
+            {
+                inst->op = RV_OP_ILLEGAL;
+                return false;
+            }
+            if (upper)
+                inst->op = RV_OP_SRAI;
+            inst->imm = bits(opcode, 20, rv64 ? 6 : 5);
+        }
+        break;
+        case FMT_SHIFTW:
+        {
+            uint32_t upper = bits(opcode, 25, 7);
+            if ((upper & ~0x20) || (upper && inst->op == RV_OP_SLLIW))
+            {
+                inst->op = RV_OP_ILLEGAL;
+                return false;
+            }
+            if (upper)
+                inst->op = RV_OP_SRAIW;
+            inst->imm = bits(opcode, 20, 5);
+        }
+        break;
+        case FMT_CSRI:
+            inst->imm = imm_i(opcode);
+            break;
+        default:
+            break;
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------
+// riscv_op_name: Mnemonic for decoded operation
+//-----------------------------------------------------------------
+const char *riscv_op_name(int op)
+{
+    if (op < 0 || op >= RV_OP_MAX)
+        return "";
+    return m_op_names[op];
+}
+//-----------------------------------------------------------------
+// disasm_rvc: Compressed instruction text
+//-----------------------------------------------------------------
+static bool disasm_rvc(uint32_t opcode, uint64_t pc, bool rv64, char *buf, int len)
+{
+    uint32_t funct3 = bits(opcode, 13, 3);
+    int      rd     = bits(opcode, 7, 5);
+    int      rs2    = bits(opcode, 2, 5);
+    int      rs1s   = 8 + bits(opcode, 7, 3);
+    int      rs2s   = 8 + bits(opcode, 2, 3);
+    uint32_t target = (uint32_t)(pc + c_j_imm(opcode));
+
+    switch (opcode & 3)
+    {
+        // Quadrant 0
+        case 0:
+            if (funct3 == 0 && opcode != 0)
+                snprintf(buf, len, "c.addi4spn r%d,r%d,%d", rs2s, REG_SP, c_addi4spn_imm(opcode));
+            else if (funct3 == 2)
+                snprintf(buf, len, "c.lw r%d, %d(r%d)", rs2s, c_lw_imm(opcode), rs1s);
+            else if (funct3 == 3 && rv64)
+                snprintf(buf, len, "c.ld r%d, %d(r%d)", rs2s, c_ld_imm(opcode), rs1s);
+            else if (funct3 == 6)
+                snprintf(buf, len, "c.sw %d(r%d), r%d", c_lw_imm(opcode), rs1s, rs2s);
+            else if (funct3 == 7 && rv64)
+                snprintf(buf, len, "c.sd %d(r%d), r%d", c_ld_imm(opcode), rs1s, rs2s);
+            else
+                return false;
+            return true;
+        // Quadrant 1
+        case 1:
+            if (funct3 == 0)
+                snprintf(buf, len, "c.addi r%d, %d", rd, c_imm(opcode));
+            else if (funct3 == 1 && rv64)
+                snprintf(buf, len, "c.addiw r%d, %d", rd, c_imm(opcode));
+            else if (funct3 == 1)
+                snprintf(buf, len, "c.jal 0x%08x", target);
+            else if (funct3 == 2)
+                snprintf(buf, len, "c.li r%d, %d", rd, c_imm(opcode));
+            else if (funct3 == 3 && rd == REG_SP)
+                snprintf(buf, len, "c.addi16sp r%d, r%d, %d", REG_SP, REG_SP, c_addi16sp_imm(opcode));
+            else if (funct3 == 3)
+                snprintf(buf, len, "c.lui r%d, 0x%x", rd, c_imm(opcode) << 12);
+            else if (funct3 == 4)
+            {
+                static const char *alu_names[8] = { "c.sub", "c.xor", "c.or", "c.and", "c.subw", "c.addw", NULL, NULL };
+                uint32_t idx = (bits(opcode, 12, 1) << 2) | bits(opcode, 5, 2);
+
+                if (bits(opcode, 10, 2) == 0)
+                    snprintf(buf, len, "c.srli r%d, %d", rs1s, c_zimm(opcode));
+                else if (bits(opcode, 10, 2) == 1)
+                    snprintf(buf, len, "c.srai r%d, %d", rs1s, c_zimm(opcode));
+                else if (bits(opcode, 10, 2) == 2)
+                    snprintf(buf, len, "c.andi r%d, 0x%08x", rs1s, c_imm(opcode));
+                else if (idx == 5 && rv64)
+                    snprintf(buf, len, "c.addw r%d, r%d, r%d", rs1s, rs1s, rs2s);
+                else if (idx < 4 || (idx == 4 && rv64))
+                    snprintf(buf, len, "%s r%d, r%d", alu_names[idx], rs1s, rs2s);
+                else
+                    return false;
+            }
+            else if (funct3 == 5)
+                snprintf(buf, len, "c.j 0x%08x", target);
+            else
+                snprintf(buf, len, "%s r%d, %d", funct3 == 6 ? "c.beqz" : "c.bnez", rs1s, c_b_imm(opcode));
+            return true;
+        // Quadrant 2
+        case 2:
+            if (funct3 == 0)
+                snprintf(buf, len, "c.slli r%d, %d", rd, c_zimm(opcode));
+            else if (funct3 == 2)
+                snprintf(buf, len, "c.lwsp r%d, %d(r%d)", rd, c_lwsp_imm(opcode), REG_SP);
+            else if (funct3 == 3 && rv64)
+                snprintf(buf, len, "c.ldsp r%d, %d(r%d)", rd, c_ldsp_imm(opcode), REG_SP);
+            else if (funct3 == 4 && !(opcode & (1 << 12)))
+            {
+                if (rs2 == 0)
+                    snprintf(buf, len, "c.jr r%d", rd);
+                else
+                    snprintf(buf, len, "c.mv r%d, r%d", rd, rs2);
+            }
+            else if (funct3 == 4)
+            {
+                if (rd == 0 && rs2 == 0)
+                    snprintf(buf, len, "c.ebreak");
+                else if (rs2 == 0)
+                    snprintf(buf, len, "c.jalr r%d, r%d", REG_RA, rd);
+                else
+                    snprintf(buf, len, "c.add r%d, r%d, r%d", rd, rd, rs2);
+            }
+            else if (funct3 == 6)
+                snprintf(buf, len, "c.swsp r%d, %d(r%d)", rs2, c_swsp_imm(opcode), REG_SP);
+            else if (funct3 == 7 && rv64)
+                snprintf(buf, len, "c.sdsp r%d, %d(r%d)", rs2, c_sdsp_imm(opcode), REG_SP);
+            else
+                return false;
+            return true;
+        default:
+            return false;
+    }
+}
+//-----------------------------------------------------------------
+// riscv_disasm: Instruction text (matches the trace output of the
+// full decoders in rv32.cpp / rv64.cpp, operand order included)
+//-----------------------------------------------------------------
+bool riscv_disasm(uint32_t opcode, uint64_t pc, uint32_t flags, char *buf, int len)
+{
+    t_riscv_inst inst;
+
+    if ((opcode & 3) != 3)
+        return disasm_rvc(opcode & 0xFFFF, pc, (flags & RV_DECODE_RV64) != 0, buf, len);
+
+    // LWU is also accepted by the RV32 model
+    flags |= RV_DECODE_RVM | RV_DECODE_RVA;
+    if (!riscv_decode(opcode, flags, &inst) &&
+        !(riscv_decode(opcode, flags | RV_DECODE_RV64, &inst) && inst.op == RV_OP_LWU))
+        return false;
+
+    int         rd   = bits(opcode, 7, 5);
+    int         rs1  = bits(opcode, 15, 5);
+    int         rs2  = bits(opcode, 20, 5);
+    const char *name = m_op_names[inst.op];
+
+    switch (inst.op)
+    {
+        case RV_OP_LUI:
+        case RV_OP_AUIPC:
+            snprintf(buf, len, "%s r%d, 0x%x", name, rd, imm_u(opcode));
+            break;
+        case RV_OP_JAL:
+            snprintf(buf, len, "%s r%d, %d", name, rd, imm_j(opcode));
+            break;
+        case RV_OP_JALR:
+            snprintf(buf, len, "%s r%d, r%d", name, rs1, imm_i(opcode));
+            break;
+        case RV_OP_BEQ: case RV_OP_BNE: case RV_OP_BLT:
+        case RV_OP_BGE: case RV_OP_BLTU: case RV_OP_BGEU:
+            snprintf(buf, len, "%s r%d, r%d, %d", name, rs1, rs2, imm_b(opcode));
+            break;
+        case RV_OP_LB: case RV_OP_LH: case RV_OP_LW: case RV_OP_LBU:
+        case RV_OP_LHU: case RV_OP_LWU: case RV_OP_LD:
+            snprintf(buf, len, "%s r%d, %d(r%d)", name, rd, imm_i(opcode), rs1);
+            break;
+        case RV_OP_SB: case RV_OP_SH: case RV_OP_SW: case RV_OP_SD:
+            snprintf(buf, len, "%s %d(r%d), r%d", name, imm_s(opcode), rs1, rs2);
+            break;
+        case RV_OP_ADDI: case RV_OP_SLTI: case RV_OP_SLTIU: case RV_OP_XORI:
+        case RV_OP_ORI: case RV_OP_ANDI: case RV_OP_ADDIW:
+            snprintf(buf, len, "%s r%d, r%d, %d", name, rd, rs1, imm_i(opcode));
+            break;
+        case RV_OP_SLLI: case RV_OP_SRLI: case RV_OP_SRAI:
+        case RV_OP_SLLIW: case RV_OP_SRLIW: case RV_OP_SRAIW:
+            snprintf(buf, len, "%s r%d, r%d, %d", name, rd, rs1, inst.imm);
+            break;
+        case RV_OP_FENCE: case RV_OP_FENCE_I: case RV_OP_SFENCE_VMA:
+            snprintf(buf, len, "fence");
+            break;
+        case RV_OP_ECALL: case RV_OP_EBREAK: case RV_OP_MRET:
+        case RV_OP_SRET: case RV_OP_WFI:
+            snprintf(buf, len, "%s", name);
+            break;
+        case RV_OP_CSRRW: case RV_OP_CSRRS: case RV_OP_CSRRC:
+            snprintf(buf, len, "csr%s r%d, r%d, 0x%x", name + 4, rd, rs1, imm_i(opcode));
+            break;
+        case RV_OP_CSRRWI: case RV_OP_CSRRSI: case RV_OP_CSRRCI:
+            snprintf(buf, len, "csr%s r%d, %d, 0x%x", name + 4, rd, rs1, imm_i(opcode));
+            break;
+        // The RV64 model traces amoadd.d as amoadd.w
+        case RV_OP_AMOADD_D:
+            snprintf(buf, len, "%s r%d, r%d, r%d", m_op_names[RV_OP_AMOADD_W], rd, rs1, rs2);
+            break;
+        default:
+            snprintf(buf, len, "%s r%d, r%d, r%d", name, rd, rs1, rs2);
+            break;
+    }
+
+    return true;
+}
@@ -0,0 +1,178 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __RISCV_DECODE_H__
+#define __RISCV_DECODE_H__
+
+#include <stdint.h>
+
+//--------------------------------------------------------------------
+// Decoded operations (shared by the RV32 and RV64 models)
+//--------------------------------------------------------------------
+enum eRiscvOp
+{
+    RV_OP_ILLEGAL,
+
+    // RV32I / RV64I
+    RV_OP_LUI,
+    RV_OP_AUIPC,
+    RV_OP_JAL,
+    RV_OP_JALR,
+    RV_OP_BEQ,
+    RV_OP_BNE,
+    RV_OP_BLT,
+    RV_OP_BGE,
+    RV_OP_BLTU,
+    RV_OP_BGEU,
+    RV_OP_LB,
+    RV_OP_LH,
+    RV_OP_LW,
+    RV_OP_LBU,
+    RV_OP_LHU,
+    RV_OP_LWU,
+    RV_OP_LD,
+    RV_OP_SB,
+    RV_OP_SH,
+    RV_OP_SW,
+    RV_OP_SD,
+    RV_OP_ADDI,
+    RV_OP_SLTI,
+    RV_OP_SLTIU,
+    RV_OP_XORI,
+    RV_OP_ORI,
+    RV_OP_ANDI,
+    RV_OP_SLLI,
+    RV_OP_SRLI,
+    RV_OP_SRAI,
+    RV_OP_ADD,
+    RV_OP_SUB,
+    RV_OP_SLL,
+    RV_OP_SLT,
+    RV_OP_SLTU,
+    RV_OP_XOR,
+    RV_OP_SRL,
+    RV_OP_SRA,
+    RV_OP_OR,
+    RV_OP_AND,
+    RV_OP_ADDIW,
+    RV_OP_SLLIW,
+    RV_OP_SRLIW,
+    RV_OP_SRAIW,
+    RV_OP_ADDW,
+    RV_OP_SUBW,
+    RV_OP_SLLW,
+    RV_OP_SRLW,
+    RV_OP_SRAW,
+
+    // System
+    RV_OP_FENCE,
+    RV_OP_FENCE_I,
+    RV_OP_SFENCE_VMA,
+    RV_OP_ECALL,
+    RV_OP_EBREAK,
+    RV_OP_MRET,
+    RV_OP_SRET,
+    RV_OP_WFI,
+    RV_OP_CSRRW,
+    RV_OP_CSRRS,
+    RV_OP_CSRRC,
+    RV_OP_CSRRWI,
+    RV_OP_CSRRSI,
+    RV_OP_CSRRCI,
+
+    // M Extension
+    RV_OP_MUL,
+    RV_OP_MULH,
+    RV_OP_MULHSU,
+    RV_OP_MULHU,
+    RV_OP_DIV,
+    RV_OP_DIVU,
+    RV_OP_REM,
+    RV_OP_REMU,
+    RV_OP_MULW,
+    RV_OP_DIVW,
+    RV_OP_DIVUW,
+    RV_OP_REMW,
+    RV_OP_REMUW,
+
+    // A Extension
+    RV_OP_LR_W,
+    RV_OP_SC_W,
+    RV_OP_AMOSWAP_W,
+    RV_OP_AMOADD_W,
+    RV_OP_AMOXOR_W,
+    RV_OP_AMOAND_W,
+    RV_OP_AMOOR_W,
+    RV_OP_AMOMIN_W,
+    RV_OP_AMOMAX_W,
+    RV_OP_AMOMINU_W,
+    RV_OP_AMOMAXU_W,
+    RV_OP_LR_D,
+    RV_OP_SC_D,
+    RV_OP_AMOSWAP_D,
+    RV_OP_AMOADD_D,
+    RV_OP_AMOXOR_D,
+    RV_OP_AMOAND_D,
+    RV_OP_AMOOR_D,
+    RV_OP_AMOMIN_D,
+    RV_OP_AMOMAX_D,
+    RV_OP_AMOMINU_D,
+    RV_OP_AMOMAXU_D,
+
+    RV_OP_MAX
+};
+
+//--------------------------------------------------------------------
+// Decoder options
+//--------------------------------------------------------------------
+#define RV_DECODE_RV64      (1 << 0)
+#define RV_DECODE_RVM       (1 << 1)
+#define RV_DECODE_RVA       (1 << 2)
+#define RV_DECODE_RVC       (1 << 3)
+
+//--------------------------------------------------------------------
+// Decoded instruction
+//--------------------------------------------------------------------
+// Compressed instructions are expanded to their base equivalent
+// (size = 2). Instructions without a destination (branches, stores,
+// fences) have rd = 0.
+// imm holds the sign-extended immediate, shift amount or CSR number.
+// For CSRR*I, rs1 holds the 5-bit zero-extended immediate.
+typedef struct
+{
+    uint32_t    opcode;
+    uint8_t     op;     // eRiscvOp
+    uint8_t     size;
+    uint8_t     rd;
+    uint8_t     rs1;
+    uint8_t     rs2;
+    int32_t     imm;
+} t_riscv_inst;
+
+//--------------------------------------------------------------------
+// riscv_decode: Decode an instruction in a bounded number of table
+// lookups (major opcode -> funct3 -> funct7 / funct5 / funct12).
+// Returns false (op = RV_OP_ILLEGAL) for unsupported encodings.
+//--------------------------------------------------------------------
+bool        riscv_decode(uint32_t opcode, uint32_t flags, t_riscv_inst *inst);
+
+// Mnemonic for a decoded operation
+const char *riscv_op_name(int op);
+
+// Instruction text as printed by the RV32 / RV64 instruction trace
+// (without the PC prefix). flags: RV_DECODE_RV64 selects the RV64
+// compressed forms. Returns false for illegal instructions.
+bool        riscv_disasm(uint32_t opcode, uint64_t pc, uint32_t flags, char *buf, int len);
+
+// Operation ends a basic block (control flow, CSR access or system)
+static inline bool riscv_ends_block(int op)
+{
+    return (op >= RV_OP_JAL && op <= RV_OP_BGEU) ||
+           (op >= RV_OP_FENCE_I && op <= RV_OP_CSRRCI);
+}
+
+#endif
@@ -0,0 +1,122 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include "riscv_tlb.h"
+
+//-----------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------
+riscv_tlb::riscv_tlb()
+{
+    m_sets       = 0;
+    m_ways       = 0;
+    m_levels     = 1;
+    m_idx_bits   = 0;
+    m_level_used = 0;
+
+    resize(RISCV_TLB_ENTRIES, RISCV_TLB_WAYS);
+}
+//-----------------------------------------------------------------
+// configure: Set page table format (levels, VPN bits per level)
+//-----------------------------------------------------------------
+void riscv_tlb::configure(int levels, int idx_bits)
+{
+    m_levels   = levels;
+    m_idx_bits = idx_bits;
+    flush();
+}
+//-----------------------------------------------------------------
+// resize: Change number of entries / ways (flushes the TLB)
+//-----------------------------------------------------------------
+bool riscv_tlb::resize(int entries, int ways)
+{
+    if (ways < 1 || entries < ways || (entries % ways) != 0)
+        return false;
+
+    int sets = entries / ways;
+    if (sets & (sets - 1))
+        return false;
+
+    m_sets = sets;
+    m_ways = ways;
+    m_entries.resize(entries);
+    flush();
+    return true;
+}
+//-----------------------------------------------------------------
+// insert: Add a translation, replacing an invalid or else the least
+// recently used way
+//-----------------------------------------------------------------
+void riscv_tlb::insert(uint64_t vpn, int level, uint32_t asid, bool global, uint64_t pte)
+{
+    int      shift = level * m_idx_bits;
+    uint64_t tag   = vpn >> shift;
+    t_entry *set   = &m_entries[(tag & (m_sets-1)) * m_ways];
+
+    int victim = m_ways - 1;
+    for (int w=0;w<m_ways-1;w++)
+        if (set[w].level < 0)
+        {
+            victim = w;
+            break;
+        }
+
+    memmove(&set[1], &set[0], victim * sizeof(t_entry));
+
+    set[0].tag    = tag;
+    set[0].pte    = pte & ~(((((uint64_t)1) << shift) - 1) << RISCV_TLB_PGSHIFT);
+    set[0].asid   = asid;
+    set[0].level  = level;
+    set[0].global = global;
+
+    m_level_used |= (1 << level);
+}
+//-----------------------------------------------------------------
+// flush: Invalidate all entries
+//-----------------------------------------------------------------
+void riscv_tlb::flush(void)
+{
+    for (size_t i=0;i<m_entries.size();i++)
+    {
+        m_entries[i].tag   = 0;
+        m_entries[i].level = -1;
+    }
+    m_level_used = 0;
+}
+//-----------------------------------------------------------------
+// flush_vma: Invalidate entries by address and / or ASID
+//-----------------------------------------------------------------
+void riscv_tlb::flush_vma(bool by_addr, uint64_t vpn, bool by_asid, uint32_t asid)
+{
+    if (!by_addr && !by_asid)
+    {
+        flush();
+        return;
+    }
+
+    // All entries for an address space
+    if (!by_addr)
+    {
+        for (size_t i=0;i<m_entries.size();i++)
+            if (flush_match(&m_entries[i], by_asid, asid))
+                m_entries[i].level = -1;
+        return;
+    }
+
+    // Only the sets which can hold the address (one per level)
+    for (int level=0;level<m_levels;level++)
+    {
+        if (!(m_level_used & (1 << level)))
+            continue;
+
+        uint64_t tag = vpn >> (level * m_idx_bits);
+        t_entry *set = &m_entries[(tag & (m_sets-1)) * m_ways];
+        for (int w=0;w<m_ways;w++)
+            if (set[w].tag == tag && set[w].level == level && flush_match(&set[w], by_asid, asid))
+                set[w].level = -1;
+    }
+}
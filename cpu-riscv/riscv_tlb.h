@@ -0,0 +1,108 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#ifndef __RISCV_TLB_H__
+#define __RISCV_TLB_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+//--------------------------------------------------------------------
+// Defines
+//--------------------------------------------------------------------
+#define RISCV_TLB_ENTRIES   256
+#define RISCV_TLB_WAYS      4
+#define RISCV_TLB_PGSHIFT   12
+
+//--------------------------------------------------------------------
+// riscv_tlb: Set associative, ASID tagged TLB (shared by the RV32 and
+// RV64 models).
+// Entries hold the leaf translation in the form the page table walker
+// returns it (physical page address | PTE flags) and map either a 4KB
+// page (level 0) or a superpage (Sv32 4MB, Sv39 2MB / 1GB).
+// Global (G bit) entries match any ASID. Each set is kept in most
+// recently used order, the last way is replaced.
+//--------------------------------------------------------------------
+class riscv_tlb
+{
+public:
+                        riscv_tlb();
+
+    // Page table format (levels, VPN bits per level)
+    void                configure(int levels, int idx_bits);
+
+    // Geometry, returns false if invalid (sets must be a power of 2)
+    bool                resize(int entries, int ways);
+    int                 get_entries(void) const { return m_sets * m_ways; }
+    int                 get_ways(void) const    { return m_ways; }
+
+    // Lookup a virtual page number, returns the 4KB leaf translation
+    bool                lookup(uint64_t vpn, uint32_t asid, uint64_t *pte)
+    {
+        for (int level=0;level<m_levels;level++)
+        {
+            if (!(m_level_used & (1 << level)))
+                continue;
+
+            int      shift = level * m_idx_bits;
+            uint64_t tag   = vpn >> shift;
+            t_entry *set   = &m_entries[(tag & (m_sets-1)) * m_ways];
+            for (int w=0;w<m_ways;w++)
+            {
+                if (set[w].tag == tag && set[w].level == level && (set[w].global || set[w].asid == asid))
+                {
+                    *pte = set[w].pte | ((vpn & ((((uint64_t)1) << shift) - 1)) << RISCV_TLB_PGSHIFT);
+
+                    // Most recently used first
+                    if (w)
+                    {
+                        t_entry hit = set[w];
+                        memmove(&set[1], &set[0], w * sizeof(t_entry));
+                        set[0] = hit;
+                    }
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Add a translation (pte = 4KB leaf translation of vpn)
+    void                insert(uint64_t vpn, int level, uint32_t asid, bool global, uint64_t pte);
+
+    // Invalidate everything
+    void                flush(void);
+
+    // SFENCE.VMA: by address (vpn) and / or by ASID. Global entries are
+    // kept when flushing by ASID.
+    void                flush_vma(bool by_addr, uint64_t vpn, bool by_asid, uint32_t asid);
+
+private:
+    typedef struct
+    {
+        uint64_t        tag;    // vpn >> (level * idx_bits)
+        uint64_t        pte;    // Page address | PTE flags
+        uint32_t        asid;
+        int8_t          level;  // -1 = invalid
+        bool            global;
+    } t_entry;
+
+    bool                flush_match(const t_entry *e, bool by_asid, uint32_t asid)
+    {
+        return e->level >= 0 && (!by_asid || (!e->global && e->asid == asid));
+    }
+
+    std::vector<t_entry> m_entries;
+    int                 m_sets;
+    int                 m_ways;
+    int                 m_levels;
+    int                 m_idx_bits;
+    uint32_t            m_level_used;   // Levels holding entries
+};
+
+#endif
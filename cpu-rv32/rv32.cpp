@@ -26,6 +26,9 @@
 #define TRACE_ENABLED(l)    (m_trace & l)
 #define INST_STAT(l)
 
+// Odd PC - can never match a fetch address
+#define DECODE_INVALID      0xFFFFFFFF
+
 //-----------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------
@@ -40,6 +43,35 @@ rv32::rv32(uint32_t baseAddr /*= 0*/, uint32_t len /*= 0*/): cpu()
     m_enable_mtimecmp    = false;
     m_enable_sbi         = false;
 
+    m_decode.resize(DECODE_ENTRIES);
+    m_decode_pages.resize(((1ULL << 32) >> DECODE_PGSHIFT) / 32);
+    m_nohost_pages.resize(((1ULL << 32) >> DECODE_PGSHIFT) / 32);
+    m_blocks.resize(BLOCK_ENTRIES);
+    m_block_epoch = 0;
+    m_nohost_vpage = DECODE_INVALID;
+    m_nohost_priv  = 0;
+    m_nohost_epoch = 0;
+    m_block_counted = 0;
+    m_run_stop_pc = DECODE_INVALID;
+    m_wfi         = false;
+    m_cycle_now   = 0;
+    m_time_cycle  = 0;
+    m_time_base   = 0;
+
+    m_jit_mode     = JIT_OFF;
+    m_jit_cache    = NULL;
+    m_jit_used     = 0;
+    m_jit_blocks   = 0;
+    m_jit_exec     = false;
+    m_jit_record   = false;
+    m_jit_replay   = false;
+    m_jit_mismatch = false;
+    m_jit_log_pos  = 0;
+    jit_tlb_flush();
+
+    m_itlb.configure(MMU_LEVELS, MMU_PTIDXBITS);
+    m_dtlb.configure(MMU_LEVELS, MMU_PTIDXBITS);
+
     // Some memory defined
     if (len != 0)
         create_memory(baseAddr, len);
@@ -47,12 +79,20 @@ rv32::rv32(uint32_t baseAddr /*= 0*/, uint32_t len /*= 0*/): cpu()
     reset(baseAddr);
 }
 //-----------------------------------------------------------------
+// Destructor
+//-----------------------------------------------------------------
+rv32::~rv32()
+{
+    jit_release();
+}
+//-----------------------------------------------------------------
 // set_pc: Set PC
 //-----------------------------------------------------------------
 void rv32::set_pc(uint32_t pc)
 {
     m_pc        = pc;
     m_pc_x      = pc;
+    m_wfi       = false;
 }
 //-----------------------------------------------------------------
 // set_register: Set register value
@@ -68,8 +108,8 @@ void rv32::set_register(int r, uint32_t val)
     else if (r == (RISCV_REGNO_CSR0 + CSR_MTVAL)) m_csr_mtval = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIE)) m_csr_mie = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIP)) m_csr_mip = val;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) m_csr_mtime = val;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIMECMP)) m_csr_mtimecmp = val; // Non-std
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) time_set(val);
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIMECMP)) { m_csr_mtimecmp = val; timer_rearm(); } // Non-std
     else if (r == (RISCV_REGNO_CSR0 + CSR_MSCRATCH)) m_csr_mscratch = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIDELEG)) m_csr_mideleg = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MEDELEG)) m_csr_medeleg = val;
@@ -96,8 +136,8 @@ uint32_t rv32::get_register(int r)
     else if (r == (RISCV_REGNO_CSR0 + CSR_MTVAL)) return m_csr_mtval;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIE)) return m_csr_mie;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIP)) return m_csr_mip;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MCYCLE)) return m_csr_mtime;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) return m_csr_mtime;
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MCYCLE)) return m_cycle_now;
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) return time_now();
     else if (r == (RISCV_REGNO_CSR0 + CSR_MTIMECMP)) return m_csr_mtimecmp; // Non-std
     else if (r == (RISCV_REGNO_CSR0 + CSR_MSCRATCH)) return m_csr_mscratch;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIDELEG)) return m_csr_mideleg;
@@ -120,6 +160,7 @@ void rv32::reset(uint32_t start_addr)
     m_pc        = start_addr;
     m_pc_x      = start_addr;
     m_load_res  = 0;
+    m_load_val  = 0;
 
     for (int i=0;i<REGISTERS;i++)
         m_gpr[i] = 0;
@@ -135,9 +176,11 @@ void rv32::reset(uint32_t start_addr)
     m_csr_mcause   = 0;
     m_csr_mevec    = 0;
     m_csr_mtval    = 0;
-    m_csr_mtime    = 0;
     m_csr_mtimecmp = 0;
     m_csr_mtime_ie = false;
+    if (m_p_cycles)
+        m_cycle_now = *m_p_cycles;
+    time_set(0);
     m_csr_mscratch = 0;
 
     m_csr_sepc     = 0;
@@ -150,12 +193,24 @@ void rv32::reset(uint32_t start_addr)
     m_fault       = false;
     m_break       = false;
     m_trace       = 0;
+    m_wfi         = false;
 
     mmu_flush();
+    decode_flush();
 
     stats_reset();
 }
 //-----------------------------------------------------------------
+// attach_memory: Attach memory (invalidates decoded instructions)
+//-----------------------------------------------------------------
+bool rv32::attach_memory(memory_base *memory)
+{
+    bool ok = cpu::attach_memory(memory);
+    decode_flush();
+    jit_tlb_flush();
+    return ok;
+}
+//-----------------------------------------------------------------
 // get_opcode: Get instruction from address
 //-----------------------------------------------------------------
 uint32_t rv32::get_opcode(uint32_t address)
@@ -174,15 +229,23 @@ uint32_t rv32::get_opcode(uint32_t address)
 //-----------------------------------------------------------------
 int rv32::mmu_read_word(uint32_t address, uint32_t *val)
 {
-    int m;
     *val = 0;
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-        {
-            mem->read32(address, *val);
-            return 1;
-        }
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+    {
+        *val = mem_load32(host);
+        return 1;
+    }
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        bus_lock();
+        mem->read32(address, *val);
+        bus_unlock();
+        return 1;
+    }
 
     return 0;
 }
@@ -191,16 +254,40 @@ int rv32::mmu_read_word(uint32_t address, uint32_t *val)
 //-----------------------------------------------------------------
 void rv32::mmu_flush(void)
 {
-    for (int i=0;i<MMU_TLB_ENTRIES;i++)
-    {
-        m_mmu_addr[i] = 0;
-        m_mmu_pte[i]  = 0;
-    }
+    m_itlb.flush();
+    m_dtlb.flush();
+
+    // Block chains rely on the old translations
+    m_block_epoch++;
+}
+//-----------------------------------------------------------------
+// mmu_fence: SFENCE.VMA (by address and / or ASID)
+//-----------------------------------------------------------------
+void rv32::mmu_fence(bool by_addr, uint32_t addr, bool by_asid, uint32_t asid)
+{
+    asid &= SATP_ASID_MASK;
+    m_itlb.flush_vma(by_addr, addr >> MMU_PGSHIFT, by_asid, asid);
+    m_dtlb.flush_vma(by_addr, addr >> MMU_PGSHIFT, by_asid, asid);
+
+    // Block chains rely on the old translations
+    m_block_epoch++;
+}
+//-----------------------------------------------------------------
+// set_tlb_size: Set ITLB / DTLB geometry (each)
+//-----------------------------------------------------------------
+bool rv32::set_tlb_size(int entries, int ways)
+{
+    if (!m_itlb.resize(entries, ways))
+        return false;
+    m_dtlb.resize(entries, ways);
+
+    m_block_epoch++;
+    return true;
 }
 //-----------------------------------------------------------------
 // mmu_walk: Page table walker
 //-----------------------------------------------------------------
-uint32_t rv32::mmu_walk(uint32_t addr)
+uint32_t rv32::mmu_walk(uint32_t addr, bool fetch /*= false*/)
 {
     int shift = 32 - MMU_VA_BITS;
     uint32_t pte = 0;
@@ -221,14 +308,24 @@ uint32_t rv32::mmu_walk(uint32_t addr)
     }
     else
     {
+        uint32_t   asid = ((m_csr_satp >> SATP_ASID_SHIFT) & SATP_ASID_MASK);
+        riscv_tlb *tlb  = fetch ? &m_itlb : &m_dtlb;
+
         // Fast path lookup in TLBs
-        uint32_t tlb_entry = (addr >> MMU_PGSHIFT) & (MMU_TLB_ENTRIES-1);
-        uint32_t tlb_match = (addr >> MMU_PGSHIFT);
-        if (m_mmu_addr[tlb_entry] == tlb_match && m_mmu_pte[tlb_entry] != 0)
-            return m_mmu_pte[tlb_entry];
+        uint64_t tlb_pte;
+        if (tlb->lookup(addr >> MMU_PGSHIFT, asid, &tlb_pte))
+        {
+            HOST_STATS_COUNT(COUNT_TLB_HIT);
+            m_stats[fetch ? STATS_ITLB_HIT : STATS_DTLB_HIT]++;
+            return (uint32_t)tlb_pte;
+        }
+
+        HOST_STATS_COUNT(COUNT_TLB_MISS);
+        HOST_STATS_TIMER(TIMER_MMU_WALK);
+        m_stats[fetch ? STATS_ITLB_MISS : STATS_DTLB_MISS]++;
 
-        uint32_t base = ((m_csr_satp >> SATP_PPN_SHIFT) & SATP_PPN_MASK) * PAGE_SIZE;
-        uint32_t asid = ((m_csr_satp >> SATP_ASID_SHIFT) & SATP_ASID_MASK);
+        uint32_t base   = ((m_csr_satp >> SATP_PPN_SHIFT) & SATP_PPN_MASK) * PAGE_SIZE;
+        bool     global = false;
 
         DPRINTF(LOG_MMU, ("MMU: MMU enabled - base 0x%08x\n", base));
 
@@ -251,6 +348,10 @@ uint32_t rv32::mmu_walk(uint32_t addr)
 
             uint32_t ppn = pte >> PAGE_PFN_SHIFT;
 
+            // Global mappings (applies to all levels below)
+            if (pte & PAGE_GLOBAL)
+                global = true;
+
             // Invalid mapping
             if (!(pte & PAGE_PRESENT))
             {
@@ -297,8 +398,16 @@ uint32_t rv32::mmu_walk(uint32_t addr)
                     error(false, "%08x: PTE access out of range %x\n", m_pc, addr);
                 }
 
-                m_mmu_addr[tlb_entry] = tlb_match;
-                m_mmu_pte[tlb_entry]  = pte;
+                // Superpages are cached as a single entry if entirely backed
+                if (pte)
+                {
+                    uint64_t pgmask = (((uint64_t)MMU_PGSIZE) << ptshift) - 1;
+                    int      level  = i;
+                    if (level && !(valid_addr(ptd_addr & ~pgmask) && valid_addr(ptd_addr | pgmask)))
+                        level = 0;
+
+                    tlb->insert(addr >> MMU_PGSHIFT, level, asid, global, pte);
+                }
                 break;
             }
         }
@@ -320,7 +429,7 @@ int rv32::mmu_i_translate(uint32_t addr, uint32_t *physical)
         return 1; 
     }
     
-    uint32_t pte = mmu_walk(addr);
+    uint32_t pte = mmu_walk(addr, true);
 
     // Reserved configurations
     if (((pte & (PAGE_EXEC | PAGE_READ | PAGE_WRITE)) == PAGE_WRITE) ||
@@ -487,43 +596,70 @@ int rv32::load(uint32_t pc, uint32_t address, uint32_t *result, int width, bool
         return 0;
     }
 
-    // Aligned loads
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(physical))
+    // Aligned loads - directly backed memory
+    uint8_t *host = get_host_ptr(physical);
+    if (host)
+    {
+        switch (width)
         {
-            switch (width)
-            {
-                case 4:
-                    mem->read32(physical, *result);
-                    break;
-                case 2:
-                {
-                    uint16_t dh = 0;
-                    mem->read16(physical, dh);
-                    *result |= dh;
-
-                    if (signedLoad && ((*result) & (1 << 15)))
-                         *result |= 0xFFFF0000;
-                }
+            case 4:
+                *result = mem_load32(host);
                 break;
-                case 1:
-                {
-                    uint8_t db = 0;
-                    mem->read8(physical + 0, db);
-                    *result |= ((uint32_t)db << 0);
+            case 2:
+                *result = signedLoad ? (uint32_t)(int16_t)mem_load16(host) : mem_load16(host);
+                break;
+            default:
+                *result = signedLoad ? (uint32_t)(int8_t)*host : *host;
+                break;
+        }
 
-                    if (signedLoad && ((*result) & (1 << 7)))
-                         *result |= 0xFFFFFF00;
-                }
+        DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
+        if (m_trace_file)
+            m_trace_file->mem(false, address, physical, *result, width);
+        return 1;
+    }
+
+    // Aligned loads - devices
+    memory_base *mem = find_memory(physical);
+    if (mem)
+    {
+        bus_lock();
+        switch (width)
+        {
+            case 4:
+                mem->read32(physical, *result);
                 break;
-                default:
-                    assert(!"Invalid");
-                    break;
+            case 2:
+            {
+                uint16_t dh = 0;
+                mem->read16(physical, dh);
+                *result |= dh;
+
+                if (signedLoad && ((*result) & (1 << 15)))
+                     *result |= 0xFFFF0000;
             }
+            break;
+            case 1:
+            {
+                uint8_t db = 0;
+                mem->read8(physical + 0, db);
+                *result |= ((uint32_t)db << 0);
 
-            DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
-            return 1;
+                if (signedLoad && ((*result) & (1 << 7)))
+                     *result |= 0xFFFFFF00;
+            }
+            break;
+            default:
+                assert(!"Invalid");
+                break;
         }
+        bus_unlock();
+
+        DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
+        if (m_trace_file)
+            m_trace_file->mem(false, address, physical, *result, width);
+        return 1;
+    }
 
     if (m_enable_mem_errors)
     {
@@ -546,6 +682,8 @@ int rv32::store(uint32_t pc, uint32_t address, uint32_t data, int width)
         return 0;
 
     DPRINTF(LOG_MEM, ("STORE: VA 0x%08x PA 0x%08x Value 0x%08x Width %d\n", address, physical, data, width));
+    if (m_trace_file)
+        m_trace_file->mem(true, address, physical, data, width);
     m_stats[STATS_STORES]++;
 
     // Detect misaligned store
@@ -570,27 +708,52 @@ int rv32::store(uint32_t pc, uint32_t address, uint32_t data, int width)
         return 0;
     }    
 
-    // Aligned stores
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(physical))
+    // Self-modifying code
+    if (decode_page_cached(physical))
+        decode_invalidate(physical);
+
+    // Aligned stores - directly backed memory
+    uint8_t *host = get_host_ptr(physical);
+    if (host)
+    {
+        switch (width)
         {
-            switch (width)
-            {
-                case 4:
-                    mem->write32(physical, data);
-                    break;
-                case 2:
-                    mem->write16(physical, data & 0xFFFF);
-                    break;
-                case 1:
-                    mem->write8(physical, data & 0xFF);
-                    break;
-                default:
-                    assert(!"Invalid");
-                    break;
-            }
-            return 1;
+            case 4:
+                mem_store32(host, data);
+                break;
+            case 2:
+                mem_store16(host, data);
+                break;
+            default:
+                *host = data;
+                break;
+        }
+        return 1;
+    }
+
+    // Aligned stores - devices
+    memory_base *mem = find_memory(physical);
+    if (mem)
+    {
+        bus_lock();
+        switch (width)
+        {
+            case 4:
+                mem->write32(physical, data);
+                break;
+            case 2:
+                mem->write16(physical, data & 0xFFFF);
+                break;
+            case 1:
+                mem->write8(physical, data & 0xFF);
+                break;
+            default:
+                assert(!"Invalid");
+                break;
         }
+        bus_unlock();
+        return 1;
+    }
 
     if (m_enable_mem_errors)
     {
@@ -661,9 +824,9 @@ bool rv32::access_csr(uint32_t address, uint32_t data, bool set, bool clr, uint3
     misa_val |= m_enable_rvc ? MISA_RVC : 0;
     misa_val |= m_enable_rva ? MISA_RVA : 0;
 
-    // SATP write - flush cached TLBs
+    // SATP write - TLB entries are ASID tagged, but block chains are not
     if (((address & 0xFFF) == CSR_SATP) && (set || clr))
-        mmu_flush();
+        m_block_epoch++;
 
     switch (address & 0xFFF)
     {
@@ -677,11 +840,7 @@ bool rv32::access_csr(uint32_t address, uint32_t data, bool set, bool clr, uint3
                 case CSR_SIM_CTRL_EXIT:
                     stats_dump();
                     printf("Exit code = %d\n", (char)(data & 0xFF));
-                    // Abnormal exit
-                    if (data & 0xFF)
-                        exit(data & 0xFF);
-                    else
-                        m_stopped = true;
+                    sim_exit(data & 0xFF);
                     break;
                 case CSR_SIM_CTRL_PUTC:
                     if (m_console)
@@ -744,7 +903,7 @@ bool rv32::access_csr(uint32_t address, uint32_t data, bool set, bool clr, uint3
         CSR_STD(MIDELEG, m_csr_mideleg)
         CSR_STD(MEDELEG, m_csr_medeleg)
         CSR_STD(MSCRATCH,m_csr_mscratch)
-        CSR_CONST(MHARTID,  MHARTID_VALUE)
+        CSR_CONST(MHARTID,  MHARTID_VALUE + m_hart_id)
         //--------------------------------------------------------
         // Standard - Supervisor
         //--------------------------------------------------------
@@ -765,13 +924,13 @@ bool rv32::access_csr(uint32_t address, uint32_t data, bool set, bool clr, uint3
         CSR_CONST(PMPCFG2, 0)
         CSR_CONST(PMPADDR0, 0)
         case CSR_MTIME:
-            result      = m_csr_mtime;
+            result      = time_now();
             break;
         case CSR_MTIMEH:
-            result      = m_csr_mtime >> 32;
+            result      = time_now() >> 32;
             break;
        case CSR_MCYCLE:
-            result      = m_csr_mtime;
+            result      = m_cycle_now;
             break;
 
         // Non-std behaviour
@@ -790,6 +949,7 @@ bool rv32::access_csr(uint32_t address, uint32_t data, bool set, bool clr, uint3
                 m_csr_mtime_ie = true;
 
             m_enable_mtimecmp = true;
+            timer_rearm();
             break;
 
         default:
@@ -797,8 +957,15 @@ bool rv32::access_csr(uint32_t address, uint32_t data, bool set, bool clr, uint3
             break;
     }
 
-    m_enable_rvc = (misa_val & MISA_RVC) ? true : false;
-    m_enable_rva = (misa_val & MISA_RVA) ? true : false;
+    // C / A extension toggled - decoded instructions are stale
+    bool rvc = (misa_val & MISA_RVC) ? true : false;
+    bool rva = (misa_val & MISA_RVA) ? true : false;
+    if (rvc != m_enable_rvc || rva != m_enable_rva)
+    {
+        m_enable_rvc = rvc;
+        m_enable_rva = rva;
+        decode_flush();
+    }
 
     return false;
 }
@@ -877,6 +1044,9 @@ void rv32::exception(uint32_t cause, uint32_t pc, uint32_t badaddr /*= 0*/)
         // Set new PC
         m_pc = m_csr_mevec;
     }
+
+    if (m_trace_file)
+        m_trace_file->exception(pc, m_pc, cause);
 }
 //-----------------------------------------------------------------
 // execute: Instruction execution stage
@@ -896,1373 +1066,1192 @@ bool rv32::execute(void)
         return false;
     }
 
-    // Get opcode at current PC
-    uint32_t opcode = get_opcode(phy_pc);
-    m_pc_x = m_pc;
-
-    // Extract registers
-    int rd          = (opcode & OPCODE_RD_MASK)  >> OPCODE_RD_SHIFT;
-    int rs1         = (opcode & OPCODE_RS1_MASK) >> OPCODE_RS1_SHIFT;
-    int rs2         = (opcode & OPCODE_RS2_MASK) >> OPCODE_RS2_SHIFT;
-
-    // Extract immediates
-    int typei_imm   = ((signed)(opcode & OPCODE_TYPEI_IMM_MASK)) >> OPCODE_TYPEI_IMM_SHIFT;
-    int typeu_imm   = ((signed)(opcode & OPCODE_TYPEU_IMM_MASK)) >> OPCODE_TYPEU_IMM_SHIFT;
-    int imm20       = typeu_imm << OPCODE_TYPEU_IMM_SHIFT;
-    int imm12       = typei_imm;
-    int bimm        = OPCODE_SBTYPE_IMM(opcode);
-    int jimm20      = OPCODE_UJTYPE_IMM(opcode);
-    int storeimm    = OPCODE_STYPE_IMM(opcode);
-    int shamt       = ((signed)(opcode & OPCODE_SHAMT_MASK)) >> OPCODE_SHAMT_SHIFT;
-
-    // Retrieve registers
-    uint32_t reg_rd  = 0;
-    uint32_t reg_rs1 = m_gpr[rs1];
-    uint32_t reg_rs2 = m_gpr[rs2];
-    uint32_t pc      = m_pc;
-
-    bool take_exception = false;
-
-    DPRINTF(LOG_OPCODES,( "%08x: %08x\n", pc, opcode));
-    DPRINTF(LOG_OPCODES,( "        rd(%d) r%d = %d, r%d = %d\n", rd, rs1, reg_rs1, rs2, reg_rs2));
-
-    // As RVC is not supported, fault on opcode which is all zeros
-    if (opcode == 0)
-    {
-        error(false, "Bad instruction @ %x\n", pc);
-
-        exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        m_fault = true;
-        take_exception = true;        
-    }
-    else if ((opcode & INST_ANDI_MASK) == INST_ANDI)
-    {
-        DPRINTF(LOG_INST,("%08x: andi r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_ANDI);
-        reg_rd = reg_rs1 & imm12;
-        pc += 4;
-    }
-    else if ((opcode & INST_ORI_MASK) == INST_ORI)
-    {
-        DPRINTF(LOG_INST,("%08x: ori r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_ORI);
-        reg_rd = reg_rs1 | imm12;
-        pc += 4;
-    }
-    else if ((opcode & INST_XORI_MASK) == INST_XORI)
-    {
-        DPRINTF(LOG_INST,("%08x: xori r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_XORI);
-        reg_rd = reg_rs1 ^ imm12;
-        pc += 4;
-    }
-    else if ((opcode & INST_ADDI_MASK) == INST_ADDI)
-    {
-        DPRINTF(LOG_INST,("%08x: addi r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_ADDI);
-        reg_rd = reg_rs1 + imm12;
-        pc += 4;
-    }
-    else if ((opcode & INST_SLTI_MASK) == INST_SLTI)
-    {
-        DPRINTF(LOG_INST,("%08x: slti r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_SLTI);
-        reg_rd = (signed)reg_rs1 < (signed)imm12;
-        pc += 4;
-    }
-    else if ((opcode & INST_SLTIU_MASK) == INST_SLTIU)
-    {
-        DPRINTF(LOG_INST,("%08x: sltiu r%d, r%d, %d\n", pc, rd, rs1, (unsigned)imm12));
-        INST_STAT(ENUM_INST_SLTIU);
-        reg_rd = (unsigned)reg_rs1 < (unsigned)imm12;
-        pc += 4;
-    }
-    else if ((opcode & INST_SLLI_MASK) == INST_SLLI)
-    {
-        DPRINTF(LOG_INST,("%08x: slli r%d, r%d, %d\n", pc, rd, rs1, shamt));
-        INST_STAT(ENUM_INST_SLLI);
-        reg_rd = reg_rs1 << shamt;
-        pc += 4;
-    }
-    else if ((opcode & INST_SRLI_MASK) == INST_SRLI)
-    {
-        DPRINTF(LOG_INST,("%08x: srli r%d, r%d, %d\n", pc, rd, rs1, shamt));
-        INST_STAT(ENUM_INST_SRLI);
-        reg_rd = (unsigned)reg_rs1 >> shamt;
-        pc += 4;
-    }
-    else if ((opcode & INST_SRAI_MASK) == INST_SRAI)
-    {
-        DPRINTF(LOG_INST,("%08x: srai r%d, r%d, %d\n", pc, rd, rs1, shamt));
-        INST_STAT(ENUM_INST_SRAI);
-        reg_rd = (signed)reg_rs1 >> shamt;
-        pc += 4;
-    }
-    else if ((opcode & INST_LUI_MASK) == INST_LUI)
-    {
-        DPRINTF(LOG_INST,("%08x: lui r%d, 0x%x\n", pc, rd, imm20));
-        INST_STAT(ENUM_INST_LUI);
-        reg_rd = imm20;
-        pc += 4;
-    }
-    else if ((opcode & INST_AUIPC_MASK) == INST_AUIPC)
-    {
-        DPRINTF(LOG_INST,("%08x: auipc r%d, 0x%x\n", pc, rd, imm20));
-        INST_STAT(ENUM_INST_AUIPC);
-        reg_rd = imm20 + pc;
-        pc += 4;
-    }
-    else if ((opcode & INST_ADD_MASK) == INST_ADD)
-    {
-        DPRINTF(LOG_INST,("%08x: add r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_ADD);
-        reg_rd = reg_rs1 + reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_SUB_MASK) == INST_SUB)
-    {
-        DPRINTF(LOG_INST,("%08x: sub r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SUB);
-        reg_rd = reg_rs1 - reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_SLT_MASK) == INST_SLT)
-    {
-        DPRINTF(LOG_INST,("%08x: slt r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SLT);
-        reg_rd = (signed)reg_rs1 < (signed)reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_SLTU_MASK) == INST_SLTU)
-    {
-        DPRINTF(LOG_INST,("%08x: sltu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SLTU);
-        reg_rd = (unsigned)reg_rs1 < (unsigned)reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_XOR_MASK) == INST_XOR)
-    {
-        DPRINTF(LOG_INST,("%08x: xor r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_XOR);
-        reg_rd = reg_rs1 ^ reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_OR_MASK) == INST_OR)
-    {
-        DPRINTF(LOG_INST,("%08x: or r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_OR);
-        reg_rd = reg_rs1 | reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_AND_MASK) == INST_AND)
-    {
-        DPRINTF(LOG_INST,("%08x: and r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_AND);
-        reg_rd = reg_rs1 & reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_SLL_MASK) == INST_SLL)
-    {
-        DPRINTF(LOG_INST,("%08x: sll r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SLL);
-        reg_rd = reg_rs1 << reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_SRL_MASK) == INST_SRL)
-    {
-        DPRINTF(LOG_INST,("%08x: srl r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SRL);
-        reg_rd = (unsigned)reg_rs1 >> reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_SRA_MASK) == INST_SRA)
-    {
-        DPRINTF(LOG_INST,("%08x: sra r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SRA);
-        reg_rd = (signed)reg_rs1 >> reg_rs2;
-        pc += 4;
-    }
-    else if ((opcode & INST_JAL_MASK) == INST_JAL)
+    // Pre-decoded instruction (decoded in place if it can't be cached)
+    t_decoded   *entry = &m_decode[(phy_pc >> 1) & (DECODE_ENTRIES-1)];
+    t_riscv_inst uncached;
+    const t_riscv_inst *inst = &entry->inst;
+    HOST_STATS_HIT(entry->pc == phy_pc, COUNT_DECODE_HIT, COUNT_DECODE_MISS);
+    if (decode_page_nohost(phy_pc))
     {
-        DPRINTF(LOG_INST,("%08x: jal r%d, %d\n", pc, rd, jimm20));
-        INST_STAT(ENUM_INST_JAL);
-        reg_rd = pc + 4;
-        pc = pc + jimm20;
-
-        if (rd == RISCV_REG_RA)
-            log_branch_call(m_pc, pc);
-        else
-            log_branch_jump(m_pc, pc);
-
-        m_stats[STATS_BRANCHES]++;
+        // Not directly backed, fetched every time and only decoded again
+        // when the opcode differs from the cached entry
+        uint32_t opcode = get_opcode(phy_pc);
+        if (entry->pc != phy_pc || entry->inst.opcode != ((opcode & 3) == 3 ? opcode : (opcode & 0xFFFF)))
+        {
+            riscv_decode(opcode, decode_flags(), &entry->inst);
+            entry->pc = phy_pc;
+        }
     }
-    else if ((opcode & INST_JALR_MASK) == INST_JALR)
+    else if (entry->pc != phy_pc && !decode_fill(entry, phy_pc))
     {
-        DPRINTF(LOG_INST,("%08x: jalr r%d, r%d\n", pc, rs1, imm12));
-        INST_STAT(ENUM_INST_JALR);
-        reg_rd = pc + 4;
-        pc = (reg_rs1 + imm12) & ~1;
-
-        if (rs1 == RISCV_REG_RA && imm12 == 0)
-            log_branch_ret(m_pc, pc);
-        else if (rd == RISCV_REG_RA)
-            log_branch_call(m_pc, pc);
-        else
-            log_branch_jump(m_pc, pc);
-
-        m_stats[STATS_BRANCHES]++;        
+        riscv_decode(get_opcode(phy_pc), decode_flags(), &uncached);
+        inst = &uncached;
     }
-    else if ((opcode & INST_BEQ_MASK) == INST_BEQ)
-    {
-        DPRINTF(LOG_INST,("%08x: beq r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BEQ);
 
-        bool take_branch = (reg_rs1 == reg_rs2);
-        if (take_branch)
-            pc = pc + bimm;
-        else
-            pc += 4;
+    m_pc_x = m_pc;
 
-        log_branch(m_pc, pc, take_branch);
+    if (m_trace_file)
+        m_trace_file->inst(m_pc, inst->opcode, inst->size);
 
-        // No writeback
-        rd = 0;
+    if (m_trace & (LOG_INST | LOG_OPCODES))
+        trace_inst(inst);
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BNE_MASK) == INST_BNE)
+    if (inst->op == RV_OP_ILLEGAL)
     {
-        DPRINTF(LOG_INST,("%08x: bne r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BNE);
-
-        bool take_branch = (reg_rs1 != reg_rs2);
-        if (take_branch)
-            pc = pc + bimm;
-        else
-            pc += 4;
-
-        log_branch(m_pc, pc, take_branch);
-
-        // No writeback
-        rd = 0;
+        // Zero and reserved compressed encodings stop the simulation
+        if (inst->size == 2 || inst->opcode == 0)
+        {
+            error(false, "Bad instruction @ %x (opcode %x)\n", m_pc, inst->opcode);
+            m_fault = true;
+        }
 
-        m_stats[STATS_BRANCHES]++;        
+        exception(MCAUSE_ILLEGAL_INSTRUCTION, m_pc, inst->opcode);
+        log_commit_pc(m_pc_x);
+        return true;
     }
-    else if ((opcode & INST_BLT_MASK) == INST_BLT)
-    {
-        DPRINTF(LOG_INST,("%08x: blt r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BLT);
-
-        bool take_branch = ((signed)reg_rs1 < (signed)reg_rs2);
-        if (take_branch)
-            pc = pc + bimm;
-        else
-            pc += 4;
 
-        log_branch(m_pc, pc, take_branch);
+    return execute_decoded(inst);
+}
+//-----------------------------------------------------------------
+// trace_inst: Instruction trace (LOG_OPCODES / LOG_INST)
+//-----------------------------------------------------------------
+void rv32::trace_inst(const t_riscv_inst *inst)
+{
+    DPRINTF(LOG_OPCODES,( "%08x: %08x\n", m_pc, inst->opcode));
+    DPRINTF(LOG_OPCODES,( "        rd(%d) r%d = %d, r%d = %d\n", inst->rd, inst->rs1, m_gpr[inst->rs1], inst->rs2, m_gpr[inst->rs2]));
 
-        // No writeback
-        rd = 0;
+    char text[64];
+    if ((m_trace & LOG_INST) && riscv_disasm(inst->opcode, m_pc, 0, text, sizeof(text)))
+        printf("%08x: %s\n", m_pc, text);
+}
+//-----------------------------------------------------------------
+// check_interrupts: Take highest priority pending interrupt (if enabled)
+//-----------------------------------------------------------------
+bool rv32::check_interrupts(uint32_t pc)
+{
+    uint32_t pending_interrupts = (m_csr_mip & m_csr_mie);
+    uint32_t m_enabled          = m_csr_mpriv < PRIV_MACHINE || (m_csr_mpriv == PRIV_MACHINE && (m_csr_msr & SR_MIE));
+    uint32_t s_enabled          = m_csr_mpriv < PRIV_SUPER   || (m_csr_mpriv == PRIV_SUPER   && (m_csr_msr & SR_SIE));
+    uint32_t m_interrupts       = pending_interrupts & ~m_csr_mideleg & -m_enabled;
+    uint32_t s_interrupts       = pending_interrupts & m_csr_mideleg & -s_enabled;
+    uint32_t interrupts         = m_interrupts ? m_interrupts : s_interrupts;
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BGE_MASK) == INST_BGE)
+    // Interrupt pending and mask enabled
+    if (interrupts)
     {
-        DPRINTF(LOG_INST,("%08x: bge r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BGE);
-
-        bool take_branch = ((signed)reg_rs1 >= (signed)reg_rs2);
-        if (take_branch)
-            pc = pc + bimm;
-        else
-            pc += 4;
-
-        log_branch(m_pc, pc, take_branch);
-
-        // No writeback
-        rd = 0;
-
-        m_stats[STATS_BRANCHES]++;        
+        for (int i=IRQ_MIN;i<IRQ_MAX;i++)
+        {
+            if (interrupts & (1 << i))
+            {
+                // Only service one interrupt per cycle
+                DPRINTF(LOG_INST,( "Interrupt%d taken...\n", i));
+                exception(MCAUSE_INTERRUPT + i, pc);
+                return true;
+            }
+        }
     }
-    else if ((opcode & INST_BLTU_MASK) == INST_BLTU)
-    {
-        DPRINTF(LOG_INST,("%08x: bltu r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BLTU);
-
-        bool take_branch = ((unsigned)reg_rs1 < (unsigned)reg_rs2);
-        if (take_branch)
-            pc = pc + bimm;
-        else
-            pc += 4;
 
-        log_branch(m_pc, pc, take_branch);
-
-        // No writeback
-        rd = 0;
-
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BGEU_MASK) == INST_BGEU)
-    {
-        DPRINTF(LOG_INST,("%08x: bgeu r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BGEU);
+    return false;
+}
+//-----------------------------------------------------------------
+// decode_flush: Invalidate all pre-decoded instructions
+//-----------------------------------------------------------------
+void rv32::decode_flush(void)
+{
+    for (int i=0;i<DECODE_ENTRIES;i++)
+        m_decode[i].pc = DECODE_INVALID;
 
-        bool take_branch = ((unsigned)reg_rs1 >= (unsigned)reg_rs2);
-        if (take_branch)
-            pc = pc + bimm;
-        else
-            pc += 4;
+    for (int i=0;i<BLOCK_ENTRIES;i++)
+        m_blocks[i].pc = DECODE_INVALID;
 
-        log_branch(m_pc, pc, take_branch);
+    jit_flush();
 
-        // No writeback
-        rd = 0;
+    memset(&m_decode_pages[0], 0, m_decode_pages.size() * sizeof(uint32_t));
+    memset(&m_nohost_pages[0], 0, m_nohost_pages.size() * sizeof(uint32_t));
+    m_nohost_vpage = DECODE_INVALID;
+}
+//-----------------------------------------------------------------
+// decode_invalidate: Invalidate pre-decoded instructions in a page
+//-----------------------------------------------------------------
+void rv32::decode_invalidate(uint32_t addr)
+{
+    uint32_t page = addr >> DECODE_PGSHIFT;
+    uint32_t idx  = (page << (DECODE_PGSHIFT - 1));
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_LB_MASK) == INST_LB)
-    {
-        DPRINTF(LOG_INST,("%08x: lb r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LB);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 1, true))
-            pc += 4;
-        else
-            return false;
-    }
-    else if ((opcode & INST_LH_MASK) == INST_LH)
-    {
-        DPRINTF(LOG_INST,("%08x: lh r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LH);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 2, true))
-            pc += 4;
-        else
-            return false;
-    }
-    else if ((opcode & INST_LW_MASK) == INST_LW)
-    {
-        INST_STAT(ENUM_INST_LW);
-        DPRINTF(LOG_INST,("%08x: lw r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 4, true))
-            pc += 4;
-        else
-            return false;
-    }
-    else if ((opcode & INST_LBU_MASK) == INST_LBU)
+    // A page maps onto a contiguous (wrapping) run of entries
+    for (int i=0;i<(1 << (DECODE_PGSHIFT - 1));i++)
     {
-        DPRINTF(LOG_INST,("%08x: lbu r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LBU);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 1, false))
-            pc += 4;
-        else
-            return false;
+        t_decoded *inst = &m_decode[(idx + i) & (DECODE_ENTRIES-1)];
+        if ((inst->pc >> DECODE_PGSHIFT) == page)
+            inst->pc = DECODE_INVALID;
     }
-    else if ((opcode & INST_LHU_MASK) == INST_LHU)
+
+    idx = (page << (DECODE_PGSHIFT - 1));
+    for (int i=0;i<(1 << (DECODE_PGSHIFT - 1));i++)
     {
-        DPRINTF(LOG_INST,("%08x: lhu r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LHU);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 2, false))
-            pc += 4;
-        else
-            return false;
+        t_block *block = &m_blocks[(idx + i) & (BLOCK_ENTRIES-1)];
+        if ((block->pc >> DECODE_PGSHIFT) == page)
+            block->pc = DECODE_INVALID;
     }
-    else if ((opcode & INST_LWU_MASK) == INST_LWU)
+
+    m_decode_pages[page >> 5] &= ~(1 << (page & 31));
+}
+//-----------------------------------------------------------------
+// decode_nohost_mark: Page has no host pointer, so it is not retried
+// by the decode / block caches (until the next flush)
+//-----------------------------------------------------------------
+void rv32::decode_nohost_mark(uint32_t addr)
+{
+    uint32_t page = addr >> DECODE_PGSHIFT;
+    m_nohost_pages[page >> 5] |= (1 << (page & 31));
+}
+//-----------------------------------------------------------------
+// decode_page_mark: Page holds cached code (stores must invalidate)
+//-----------------------------------------------------------------
+void rv32::decode_page_mark(uint32_t addr)
+{
+    uint32_t page = addr >> DECODE_PGSHIFT;
+    m_decode_pages[page >> 5] |= (1 << (page & 31));
+
+    // Translated stores must take the slow path to this page
+    t_jit_tlb *e = &m_jit_tlb[1][page & (JIT_TLB_ENTRIES-1)];
+    if (e->tag == (page << DECODE_PGSHIFT))
+        e->tag = 0xFFF;
+}
+//-----------------------------------------------------------------
+// invalidate_code: Memory modified outside of the instruction stream
+//-----------------------------------------------------------------
+void rv32::invalidate_code(uint32_t addr, int length)
+{
+    uint64_t end = (uint64_t)addr + length;
+    for (uint64_t a = addr & ~((1 << DECODE_PGSHIFT) - 1); a < end; a += (1 << DECODE_PGSHIFT))
+        if (decode_page_cached(a))
+            decode_invalidate(a);
+}
+//-----------------------------------------------------------------
+// decode_fill: Decode instruction at physical PC into cache entry
+//-----------------------------------------------------------------
+bool rv32::decode_fill(t_decoded *inst, uint32_t phy_pc)
+{
+    // Only directly backed memory is cached (devices may have side effects)
+    uint8_t *host = get_host_ptr(phy_pc);
+    if (!host)
     {
-        DPRINTF(LOG_INST,("%08x: lwu r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LWU);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 4, false))
-            pc += 4;
-        else
-            return false;
+        decode_nohost_mark(phy_pc);
+        return false;
     }
-    else if ((opcode & INST_SB_MASK) == INST_SB)
-    {
-        DPRINTF(LOG_INST,("%08x: sb %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        INST_STAT(ENUM_INST_SB);
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 1))
-            pc += 4;
-        else
-            return false;
 
-        // No writeback
-        rd = 0;
-    }
-    else if ((opcode & INST_SH_MASK) == INST_SH)
+    uint32_t opcode = mem_load16(host);
+    if ((opcode & 3) == 3)
     {
-        DPRINTF(LOG_INST,("%08x: sh %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        INST_STAT(ENUM_INST_SH);
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 2))
-            pc += 4;
-        else
+        // Don't cache 32-bit instructions which straddle a page
+        if ((phy_pc & ((1 << DECODE_PGSHIFT) - 1)) == ((1 << DECODE_PGSHIFT) - 2))
             return false;
-
-        // No writeback
-        rd = 0;
+        opcode = mem_load32(host);
     }
-    else if ((opcode & INST_SW_MASK) == INST_SW)
-    {
-        DPRINTF(LOG_INST,("%08x: sw %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        INST_STAT(ENUM_INST_SW);
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 4))
-            pc += 4;
-        else
-            return false;
 
-        // No writeback
-        rd = 0;
-    }
-    else if (m_enable_rvm && (opcode & INST_MUL_MASK) == INST_MUL)
-    {
-        DPRINTF(LOG_INST,("%08x: mul r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_MUL);
-        m_stats[STATS_MUL]++;
-        reg_rd = (signed)reg_rs1 * (signed)reg_rs2;
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_MULH_MASK) == INST_MULH)
-    {
-        long long res = ((long long) (int)reg_rs1) * ((long long)(int)reg_rs2);
-        INST_STAT(ENUM_INST_MULH);
-        m_stats[STATS_MUL]++;
-        DPRINTF(LOG_INST,("%08x: mulh r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        reg_rd = (int)(res >> 32);
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_MULHSU_MASK) == INST_MULHSU)
-    {
-        long long res = ((long long) (int)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2);
-        INST_STAT(ENUM_INST_MULHSU);
-        m_stats[STATS_MUL]++;
-        DPRINTF(LOG_INST,("%08x: mulhsu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        reg_rd = (int)(res >> 32);
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_MULHU_MASK) == INST_MULHU)
-    {
-        unsigned long long res = ((unsigned long long) (unsigned)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2);
-        INST_STAT(ENUM_INST_MULHU);
-        m_stats[STATS_MUL]++;
-        DPRINTF(LOG_INST,("%08x: mulhu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        reg_rd = (int)(res >> 32);
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_DIV_MASK) == INST_DIV)
-    {
-        DPRINTF(LOG_INST,("%08x: div r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_DIV);
-        m_stats[STATS_DIV]++;
-        if ((signed)reg_rs1 == INT32_MIN && (signed)reg_rs2 == -1)
-            reg_rd = reg_rs1;
-        else if (reg_rs2 != 0)
-            reg_rd = (signed)reg_rs1 / (signed)reg_rs2;
-        else
-            reg_rd = (unsigned)-1;
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_DIVU_MASK) == INST_DIVU)
-    {
-        DPRINTF(LOG_INST,("%08x: divu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_DIVU);
-        m_stats[STATS_DIV]++;
-        if (reg_rs2 != 0)
-            reg_rd = (unsigned)reg_rs1 / (unsigned)reg_rs2;
-        else
-            reg_rd = (unsigned)-1;
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_REM_MASK) == INST_REM)
-    {
-        DPRINTF(LOG_INST,("%08x: rem r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_REM);
-        m_stats[STATS_DIV]++;
+    riscv_decode(opcode, decode_flags(), &inst->inst);
 
-        if((signed)reg_rs1 == INT32_MIN && (signed)reg_rs2 == -1)
-            reg_rd = 0;
-        else if (reg_rs2 != 0)
-            reg_rd = (signed)reg_rs1 % (signed)reg_rs2;
-        else
-            reg_rd = reg_rs1;
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_REMU_MASK) == INST_REMU)
-    {
-        DPRINTF(LOG_INST,("%08x: remu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_REMU);
-        m_stats[STATS_DIV]++;
-        if (reg_rs2 != 0)
-            reg_rd = (unsigned)reg_rs1 % (unsigned)reg_rs2;
-        else
-            reg_rd = reg_rs1;
-        pc += 4;
-    }
-    else if ((opcode & INST_ECALL_MASK) == INST_ECALL)
-    {
-        DPRINTF(LOG_INST,("%08x: ecall\n", pc));
-        INST_STAT(ENUM_INST_ECALL);
+    inst->pc = phy_pc;
 
-        // Semi-hosted system call?
-        if (syscall_handler())
-            pc += 4;
-        else
-        {
-            exception(MCAUSE_ECALL_U + m_csr_mpriv, pc);
-            take_exception   = true;
-        }
-    }
-    else if ((opcode & INST_EBREAK_MASK) == INST_EBREAK)
-    {
-        DPRINTF(LOG_INST,("%08x: ebreak\n", pc));
-        INST_STAT(ENUM_INST_EBREAK);
+    decode_page_mark(phy_pc);
+    return true;
+}
+//-----------------------------------------------------------------
+// execute_decoded: Execute a pre-decoded instruction
+//-----------------------------------------------------------------
+bool rv32::execute_decoded(const t_riscv_inst *inst)
+{
+    uint32_t reg_rd  = 0;
+    uint32_t reg_rs1 = m_gpr[inst->rs1];
+    uint32_t reg_rs2 = m_gpr[inst->rs2];
+    int32_t  imm     = inst->imm;
+    uint32_t pc      = m_pc;
+    uint32_t npc     = pc + inst->size;
+    bool take_branch = false;
+    bool take_exception = false;
 
-        exception(MCAUSE_BREAKPOINT, pc);
-        take_exception   = true;
-        m_break          = true;
-    }
-    else if ((opcode & INST_MRET_MASK) == INST_MRET)
-    {
-        DPRINTF(LOG_INST,("%08x: mret\n", pc));
-        INST_STAT(ENUM_INST_MRET);
+    switch (inst->op)
+    {
+        case RV_OP_ANDI:  reg_rd = reg_rs1 & imm; break;
+        case RV_OP_ORI:   reg_rd = reg_rs1 | imm; break;
+        case RV_OP_XORI:  reg_rd = reg_rs1 ^ imm; break;
+        case RV_OP_ADDI:  reg_rd = reg_rs1 + imm; break;
+        case RV_OP_SLTI:  reg_rd = (signed)reg_rs1 < (signed)imm; break;
+        case RV_OP_SLTIU: reg_rd = (unsigned)reg_rs1 < (unsigned)imm; break;
+        case RV_OP_SLLI:  reg_rd = reg_rs1 << imm; break;
+        case RV_OP_SRLI:  reg_rd = (unsigned)reg_rs1 >> imm; break;
+        case RV_OP_SRAI:  reg_rd = (signed)reg_rs1 >> imm; break;
+        case RV_OP_LUI:   reg_rd = imm; break;
+        case RV_OP_AUIPC: reg_rd = imm + pc; break;
+        case RV_OP_ADD:   reg_rd = reg_rs1 + reg_rs2; break;
+        case RV_OP_SUB:   reg_rd = reg_rs1 - reg_rs2; break;
+        case RV_OP_SLT:   reg_rd = (signed)reg_rs1 < (signed)reg_rs2; break;
+        case RV_OP_SLTU:  reg_rd = (unsigned)reg_rs1 < (unsigned)reg_rs2; break;
+        case RV_OP_XOR:   reg_rd = reg_rs1 ^ reg_rs2; break;
+        case RV_OP_OR:    reg_rd = reg_rs1 | reg_rs2; break;
+        case RV_OP_AND:   reg_rd = reg_rs1 & reg_rs2; break;
+        case RV_OP_SLL:   reg_rd = reg_rs1 << reg_rs2; break;
+        case RV_OP_SRL:   reg_rd = (unsigned)reg_rs1 >> reg_rs2; break;
+        case RV_OP_SRA:   reg_rd = (signed)reg_rs1 >> reg_rs2; break;
+        case RV_OP_JAL:
+            reg_rd = npc;
+            npc    = pc + imm;
+
+            // Branch to self: idle until interrupted
+            if (imm == 0)
+                wfi_sleep();
+
+            if (inst->rd == RISCV_REG_RA)
+                log_branch_call(m_pc, npc);
+            else
+                log_branch_jump(m_pc, npc);
 
-        assert(m_csr_mpriv == PRIV_MACHINE);
+            if (inst->size == 4)
+                m_stats[STATS_BRANCHES]++;
+            break;
+        case RV_OP_JALR:
+            reg_rd = npc;
+            npc    = (reg_rs1 + imm) & ~1;
+
+            if (inst->rs1 == RISCV_REG_RA && imm == 0)
+                log_branch_ret(m_pc, npc);
+            else if (inst->rd == RISCV_REG_RA)
+                log_branch_call(m_pc, npc);
+            else
+                log_branch_jump(m_pc, npc);
 
-        uint32_t s        = m_csr_msr;
-        uint32_t prev_prv = SR_GET_MPP(m_csr_msr);
+            if (inst->size == 4)
+                m_stats[STATS_BRANCHES]++;
+            break;
+        case RV_OP_BEQ:
+        case RV_OP_BNE:
+        case RV_OP_BLT:
+        case RV_OP_BGE:
+        case RV_OP_BLTU:
+        case RV_OP_BGEU:
+            switch (inst->op)
+            {
+                case RV_OP_BEQ:  take_branch = (reg_rs1 == reg_rs2); break;
+                case RV_OP_BNE:  take_branch = (reg_rs1 != reg_rs2); break;
+                case RV_OP_BLT:  take_branch = ((signed)reg_rs1 < (signed)reg_rs2); break;
+                case RV_OP_BGE:  take_branch = ((signed)reg_rs1 >= (signed)reg_rs2); break;
+                case RV_OP_BLTU: take_branch = ((unsigned)reg_rs1 < (unsigned)reg_rs2); break;
+                default:         take_branch = ((unsigned)reg_rs1 >= (unsigned)reg_rs2); break;
+            }
 
-        // Interrupt enable pop
-        s &= ~SR_MIE;
-        s |= (s & SR_MPIE) ? SR_MIE : 0;
-        s |= SR_MPIE;
+            if (take_branch)
+                npc = pc + imm;
 
-        // Set next MPP to user mode
-        s &= ~SR_MPP;
-        s |=  SR_MPP_U;
+            log_branch(m_pc, npc, take_branch);
 
-        // Set privilege level to previous MPP
-        m_csr_mpriv   = prev_prv;
-        m_csr_msr     = s;
+            if (inst->size == 4)
+                m_stats[STATS_BRANCHES]++;
+            break;
+        case RV_OP_LB:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 1, true))
+                return false;
+            break;
+        case RV_OP_LH:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 2, true))
+                return false;
+            break;
+        case RV_OP_LW:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 4, true))
+                return false;
+            break;
+        case RV_OP_LBU:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 1, false))
+                return false;
+            break;
+        case RV_OP_LHU:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 2, false))
+                return false;
+            break;
+        case RV_OP_SB:
+            if (!store(pc, reg_rs1 + imm, reg_rs2, 1))
+                return false;
+            break;
+        case RV_OP_SH:
+            if (!store(pc, reg_rs1 + imm, reg_rs2, 2))
+                return false;
+            break;
+        case RV_OP_SW:
+            if (!store(pc, reg_rs1 + imm, reg_rs2, 4))
+                return false;
+            break;
+        case RV_OP_MUL:
+            m_stats[STATS_MUL]++;
+            reg_rd = (signed)reg_rs1 * (signed)reg_rs2;
+            break;
+        case RV_OP_MULH:
+            m_stats[STATS_MUL]++;
+            reg_rd = (int)((((long long) (int)reg_rs1) * ((long long)(int)reg_rs2)) >> 32);
+            break;
+        case RV_OP_MULHSU:
+            m_stats[STATS_MUL]++;
+            reg_rd = (int)((((long long) (int)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2)) >> 32);
+            break;
+        case RV_OP_MULHU:
+            m_stats[STATS_MUL]++;
+            reg_rd = (int)((((unsigned long long) (unsigned)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2)) >> 32);
+            break;
+        case RV_OP_DIV:
+            m_stats[STATS_DIV]++;
+            if ((signed)reg_rs1 == INT32_MIN && (signed)reg_rs2 == -1)
+                reg_rd = reg_rs1;
+            else if (reg_rs2 != 0)
+                reg_rd = (signed)reg_rs1 / (signed)reg_rs2;
+            else
+                reg_rd = (unsigned)-1;
+            break;
+        case RV_OP_DIVU:
+            m_stats[STATS_DIV]++;
+            if (reg_rs2 != 0)
+                reg_rd = (unsigned)reg_rs1 / (unsigned)reg_rs2;
+            else
+                reg_rd = (unsigned)-1;
+            break;
+        case RV_OP_REM:
+            m_stats[STATS_DIV]++;
+            if ((signed)reg_rs1 == INT32_MIN && (signed)reg_rs2 == -1)
+                reg_rd = 0;
+            else if (reg_rs2 != 0)
+                reg_rd = (signed)reg_rs1 % (signed)reg_rs2;
+            else
+                reg_rd = reg_rs1;
+            break;
+        case RV_OP_REMU:
+            m_stats[STATS_DIV]++;
+            if (reg_rs2 != 0)
+                reg_rd = (unsigned)reg_rs1 % (unsigned)reg_rs2;
+            else
+                reg_rd = reg_rs1;
+            break;
+        case RV_OP_ECALL:
+            // Semi-hosted system call?
+            if (!syscall_handler())
+            {
+                exception(MCAUSE_ECALL_U + m_csr_mpriv, pc);
+                take_exception = true;
+            }
+            break;
+        case RV_OP_EBREAK:
+            exception(MCAUSE_BREAKPOINT, pc);
+            take_exception = true;
+            m_break        = true;
+            break;
+        case RV_OP_MRET:
+        {
+            assert(m_csr_mpriv == PRIV_MACHINE);
 
-        // Return to EPC
-        pc = m_csr_mepc;
-    }
-    else if ((opcode & INST_SRET_MASK) == INST_SRET)
-    {
-        DPRINTF(LOG_INST,("%08x: sret\n", pc));
-        INST_STAT(ENUM_INST_SRET);
+            uint32_t s        = m_csr_msr;
+            uint32_t prev_prv = SR_GET_MPP(m_csr_msr);
 
-        assert(m_csr_mpriv == PRIV_SUPER);
+            // Interrupt enable pop
+            s &= ~SR_MIE;
+            s |= (s & SR_MPIE) ? SR_MIE : 0;
+            s |= SR_MPIE;
 
-        uint32_t s        = m_csr_msr;
-        uint32_t prev_prv = (m_csr_msr & SR_SPP) ? PRIV_SUPER : PRIV_USER;
+            // Set next MPP to user mode
+            s &= ~SR_MPP;
+            s |=  SR_MPP_U;
 
-        // Interrupt enable pop
-        s &= ~SR_SIE;
-        s |= (s & SR_SPIE) ? SR_SIE : 0;
-        s |= SR_SPIE;
+            // Set privilege level to previous MPP
+            m_csr_mpriv   = prev_prv;
+            m_csr_msr     = s;
 
-        // Set next SPP to user mode
-        s &= ~SR_SPP;
+            // Return to EPC
+            npc = m_csr_mepc;
+        }
+        break;
+        case RV_OP_SRET:
+        {
+            assert(m_csr_mpriv == PRIV_SUPER);
 
-        // Set privilege level to previous MPP
-        m_csr_mpriv   = prev_prv;
-        m_csr_msr     = s;
+            uint32_t s        = m_csr_msr;
+            uint32_t prev_prv = (m_csr_msr & SR_SPP) ? PRIV_SUPER : PRIV_USER;
 
-        // Return to EPC
-        pc = m_csr_sepc;
-    }
-    else if ( ((opcode & INST_SFENCE_MASK) == INST_SFENCE) ||
-              ((opcode & INST_FENCE_MASK) == INST_FENCE) ||
-              ((opcode & INST_IFENCE_MASK) == INST_IFENCE))
-    {
-        DPRINTF(LOG_INST,("%08x: fence\n", pc));
-        INST_STAT(ENUM_INST_FENCE);
+            // Interrupt enable pop
+            s &= ~SR_SIE;
+            s |= (s & SR_SPIE) ? SR_SIE : 0;
+            s |= SR_SPIE;
 
-        // SFENCE.VMA
-        if ((opcode & INST_SFENCE_MASK) == INST_SFENCE)
-            mmu_flush();
-        pc += 4;
-    }
-    else if ((opcode & INST_CSRRW_MASK) == INST_CSRRW)
-    {
-        DPRINTF(LOG_INST,("%08x: csrw r%d, r%d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRW);
-        take_exception = access_csr(imm12, reg_rs1, true, true, reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }    
-    else if ((opcode & INST_CSRRS_MASK) == INST_CSRRS)
-    {
-        DPRINTF(LOG_INST,("%08x: csrs r%d, r%d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRS);
-        take_exception = access_csr(imm12, reg_rs1, (rs1 != 0), false, reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_CSRRC_MASK) == INST_CSRRC)
-    {
-        DPRINTF(LOG_INST,("%08x: csrc r%d, r%d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRC);
-        take_exception = access_csr(imm12, reg_rs1, false, (rs1 != 0), reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_CSRRWI_MASK) == INST_CSRRWI)
-    {
-        DPRINTF(LOG_INST,("%08x: csrwi r%d, %d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRWI);
-        take_exception = access_csr(imm12, rs1, true, true, reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_CSRRSI_MASK) == INST_CSRRSI)
-    {
-        DPRINTF(LOG_INST,("%08x: csrsi r%d, %d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRSI);
-        take_exception = access_csr(imm12, rs1, (rs1 != 0), false, reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_CSRRCI_MASK) == INST_CSRRCI)
-    {
-        DPRINTF(LOG_INST,("%08x: csrci r%d, %d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRCI);
-        take_exception = access_csr(imm12, rs1, false, (rs1 != 0), reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_WFI_MASK) == INST_WFI)
-    {
-        DPRINTF(LOG_INST,("%08x: wfi\n", pc));
-        INST_STAT(ENUM_INST_WFI);
-        pc += 4;
-    }
-    //-----------------------------------------------------------------
-    // A Extension
-    //-----------------------------------------------------------------
-    else if (m_enable_rva && (opcode & INST_AMOADD_W_MASK) == INST_AMOADD_W)
-    {
-        DPRINTF(LOG_INST,("%08x: amoadd.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+            // Set next SPP to user mode
+            s &= ~SR_SPP;
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+            // Set privilege level to previous MPP
+            m_csr_mpriv   = prev_prv;
+            m_csr_msr     = s;
 
-        // Modify
-        uint32_t val = reg_rd + reg_rs2;
+            // Return to EPC
+            npc = m_csr_sepc;
+        }
+        break;
+        case RV_OP_FENCE:
+            break;
+        case RV_OP_WFI:
+            wfi_sleep();
+            break;
+        case RV_OP_FENCE_I:
+            decode_flush();
+            break;
+        case RV_OP_SFENCE_VMA:
+            mmu_fence(inst->rs1 != 0, reg_rs1, inst->rs2 != 0, reg_rs2);
+            break;
+        case RV_OP_CSRRW:
+        case RV_OP_CSRRS:
+        case RV_OP_CSRRC:
+        case RV_OP_CSRRWI:
+        case RV_OP_CSRRSI:
+        case RV_OP_CSRRCI:
+        {
+            // CSRR*I: rs1 field is the immediate operand
+            uint32_t data = (inst->op >= RV_OP_CSRRWI) ? inst->rs1 : reg_rs1;
+            bool     set  = (inst->op == RV_OP_CSRRW || inst->op == RV_OP_CSRRWI) ||
+                            ((inst->op == RV_OP_CSRRS || inst->op == RV_OP_CSRRSI) && inst->rs1 != 0);
+            bool     clr  = (inst->op == RV_OP_CSRRW || inst->op == RV_OP_CSRRWI) ||
+                            ((inst->op == RV_OP_CSRRC || inst->op == RV_OP_CSRRCI) && inst->rs1 != 0);
+
+            take_exception = access_csr(imm, data, set, clr, reg_rd);
+            if (take_exception)
+                exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, inst->opcode);
+        }
+        break;
+        case RV_OP_AMOADD_W:
+        case RV_OP_AMOXOR_W:
+        case RV_OP_AMOOR_W:
+        case RV_OP_AMOAND_W:
+        case RV_OP_AMOMIN_W:
+        case RV_OP_AMOMAX_W:
+        case RV_OP_AMOMINU_W:
+        case RV_OP_AMOMAXU_W:
+        case RV_OP_AMOSWAP_W:
+        {
+            uint32_t physical = 0;
+            uint8_t *host     = NULL;
+            if (!atomic_translate(pc, reg_rs1, 4, true, &physical, &host))
+                return false;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+            // Devices: read / modify / write serialised between harts
+            smp_atomic_guard atomic(m_smp, !host);
 
-        INST_STAT(ENUM_INST_ADD);
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOXOR_W_MASK) == INST_AMOXOR_W)
-    {
-        DPRINTF(LOG_INST,("%08x: amoxor.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+            // Read
+            if (host)
+                reg_rd = mem_atomic_load32(host);
+            else if (!load(pc, reg_rs1, &reg_rd, 4, true))
+                return false;
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+            // Modify (retried if another hart wrote the word)
+            uint32_t val;
+            do
+            {
+                val = reg_rs2;
+                switch (inst->op)
+                {
+                    case RV_OP_AMOADD_W:  val = reg_rd + reg_rs2; break;
+                    case RV_OP_AMOXOR_W:  val = reg_rd ^ reg_rs2; break;
+                    case RV_OP_AMOOR_W:   val = reg_rd | reg_rs2; break;
+                    case RV_OP_AMOAND_W:  val = reg_rd & reg_rs2; break;
+                    case RV_OP_AMOMIN_W:  if ((int32_t)reg_rd < (int32_t)reg_rs2) val = reg_rd; break;
+                    case RV_OP_AMOMAX_W:  if ((int32_t)reg_rd > (int32_t)reg_rs2) val = reg_rd; break;
+                    case RV_OP_AMOMINU_W: if ((uint32_t)reg_rd < (uint32_t)reg_rs2) val = reg_rd; break;
+                    case RV_OP_AMOMAXU_W: if ((uint32_t)reg_rd > (uint32_t)reg_rs2) val = reg_rd; break;
+                    default: break;
+                }
+            }
+            while (host && !mem_cas32(host, &reg_rd, val));
 
-        // Modify
-        uint32_t val = reg_rd ^ reg_rs2;
+            // Write
+            if (host)
+            {
+                atomic_access(reg_rs1, physical, false, reg_rd, 4);
+                atomic_access(reg_rs1, physical, true, val, 4);
+            }
+            else if (!store(pc, reg_rs1, val, 4))
+                return false;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+            smp_atomic_store(physical);
+        }
+        break;
+        case RV_OP_LR_W:
+        {
+            uint32_t physical = 0;
+            uint8_t *host     = NULL;
+            if (!atomic_translate(pc, reg_rs1, 4, false, &physical, &host))
+                return false;
 
-        INST_STAT(ENUM_INST_XOR);
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOOR_W_MASK) == INST_AMOOR_W)
-    {
-        DPRINTF(LOG_INST,("%08x: amoor.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+            // Reserve before the read (a store after it breaks the reservation)
+            smp_reserve(physical);
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+            if (host)
+            {
+                reg_rd = mem_atomic_load32(host);
+                atomic_access(reg_rs1, physical, false, reg_rd, 4);
+            }
+            else if (!load(pc, reg_rs1, &reg_rd, 4, true))
+                return false;
 
-        // Modify
-        uint32_t val = reg_rd | reg_rs2;
+            // Record load address and value (SC also fails if the word changed)
+            m_load_res = reg_rs1;
+            m_load_val = reg_rd;
+        }
+        break;
+        case RV_OP_SC_W:
+            reg_rd = 1;
+            if (m_load_res == reg_rs1)
+            {
+                uint32_t physical = 0;
+                uint8_t *host     = NULL;
+                if (!atomic_translate(pc, reg_rs1, 4, true, &physical, &host))
+                    return false;
+
+                // Write if the reservation is still held and the word still
+                // holds the value LR returned
+                if (host)
+                {
+                    uint32_t expected = m_load_val;
+                    if (smp_take_reservation(physical) && mem_cas32(host, &expected, reg_rs2))
+                    {
+                        atomic_access(reg_rs1, physical, true, reg_rs2, 4);
+                        smp_atomic_store(physical);
+                        reg_rd = 0;
+                    }
+                }
+                else
+                {
+                    smp_atomic_guard atomic(m_smp, true);
+                    if (smp_take_reservation(physical) && sc_check(physical))
+                    {
+                        if (!store(pc, reg_rs1, reg_rs2, 4))
+                            return false;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+                        smp_atomic_store(physical);
+                        reg_rd = 0;
+                    }
+                }
+            }
 
-        INST_STAT(ENUM_INST_OR);
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
+            m_load_res = 0;
+            break;
+        default:
+            assert(!"Invalid pre-decoded instruction");
+            break;
     }
-    else if (m_enable_rva && (opcode & INST_AMOAND_W_MASK) == INST_AMOAND_W)
+
+    if (inst->rd != 0 && !take_exception)
     {
-        DPRINTF(LOG_INST,("%08x: amoand.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+        m_gpr[inst->rd] = reg_rd;
+        if (m_trace_file)
+            m_trace_file->reg(inst->rd, reg_rd);
+    }
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+    // Monitor executed instructions
+    log_commit_pc(m_pc_x);
 
-        // Modify
-        uint32_t val = reg_rd & reg_rs2;
+    if (take_exception)
+        return true;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+    // Pending interrupt
+    if ((m_csr_mip & m_csr_mie) && check_interrupts(npc))
+        return true;
 
-        INST_STAT(ENUM_INST_AND);
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOMIN_W_MASK) == INST_AMOMIN_W)
-    {
-        DPRINTF(LOG_INST,("%08x: amomin.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+    m_pc = npc;
+    return true;
+}
+//-----------------------------------------------------------------
+// block_mode: Privilege / translation mode blocks are tagged with
+//-----------------------------------------------------------------
+uint32_t rv32::block_mode(void)
+{
+    // Machine mode - no MMU
+    if (m_csr_mpriv > PRIV_SUPER)
+        return PRIV_MACHINE;
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+    return m_csr_mpriv | ((m_csr_satp & SATP_MODE) ? 4 : 0);
+}
+//-----------------------------------------------------------------
+// block_find: Lookup (or build) the basic block at the current PC
+//-----------------------------------------------------------------
+rv32::t_block *rv32::block_find(void)
+{
+    // Misaligned fetch faults are raised by the single step path
+    if (m_pc & (m_enable_rvc ? 1 : 3))
+        return NULL;
 
-        // Modify
-        uint32_t val = reg_rs2;
-        if ((int32_t)reg_rd < (int32_t)reg_rs2)
-            val = reg_rd;
+    // Still on the page which had no host pointer, straight to execute()
+    if ((m_pc >> DECODE_PGSHIFT) == m_nohost_vpage && m_csr_mpriv == m_nohost_priv && m_block_epoch == m_nohost_epoch)
+        return NULL;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+    uint32_t phy_pc;
+    if (!mmu_i_translate(m_pc, &phy_pc))
+        return NULL;
 
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOMAX_W_MASK) == INST_AMOMAX_W)
+    // Not directly backed, executed by the single step path
+    if (decode_page_nohost(phy_pc))
     {
-        DPRINTF(LOG_INST,("%08x: amomax.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+        m_nohost_vpage = m_pc >> DECODE_PGSHIFT;
+        m_nohost_priv  = m_csr_mpriv;
+        m_nohost_epoch = m_block_epoch;
+        return NULL;
+    }
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+    uint32_t mode  = block_mode();
+    t_block *block = &m_blocks[(phy_pc >> 1) & (BLOCK_ENTRIES-1)];
+    bool hit = (block->pc == phy_pc && block->mode == mode);
+    HOST_STATS_HIT(hit, COUNT_BLOCK_HIT, COUNT_BLOCK_MISS);
+    if (hit)
+        return block;
 
-        // Modify
-        uint32_t val = reg_rs2;
-        if ((int32_t)reg_rd > (int32_t)reg_rs2)
-            val = reg_rd;
+    return block_build(block, phy_pc, mode) ? block : NULL;
+}
+//-----------------------------------------------------------------
+// block_build: Decode instructions up to the end of a basic block
+//-----------------------------------------------------------------
+bool rv32::block_build(t_block *block, uint32_t phy_pc, uint32_t mode)
+{
+    // Only directly backed memory is cached (devices may have side effects)
+    uint8_t *host = get_host_ptr(phy_pc);
+    if (!host)
+    {
+        decode_nohost_mark(phy_pc);
+        return false;
+    }
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+    uint32_t flags = decode_flags();
 
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOMINU_W_MASK) == INST_AMOMINU_W)
+    // Blocks never cross a page (physically contiguous, one translation)
+    uint32_t offset = phy_pc & ((1 << DECODE_PGSHIFT) - 1);
+    uint32_t end    = (1 << DECODE_PGSHIFT);
+    int      count  = 0;
+
+    while (count < BLOCK_MAX_INSTS && offset < end)
     {
-        DPRINTF(LOG_INST,("%08x: amominu.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+        uint32_t opcode = mem_load16(host);
+        if ((opcode & 3) == 3)
+        {
+            if (offset + 4 > end)
+                break;
+            opcode = mem_load32(host);
+        }
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+        // Unsupported encodings are left to the full decoder
+        t_riscv_inst *inst = &block->inst[count];
+        if (!riscv_decode(opcode, flags, inst))
+            break;
 
-        // Modify
-        uint32_t val = reg_rs2;
-        if ((uint32_t)reg_rd < (uint32_t)reg_rs2)
-            val = reg_rd;
+        count++;
+        host   += inst->size;
+        offset += inst->size;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+        if (riscv_ends_block(inst->op))
+            break;
 
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
+        // Stop PC of run() (page offset, so any mapping of the page ends here)
+        if ((offset - inst->size) == (m_run_stop_pc & ((1 << DECODE_PGSHIFT) - 1)))
+            break;
     }
-    else if (m_enable_rva && (opcode & INST_AMOMAXU_W_MASK) == INST_AMOMAXU_W)
+
+    block->inst[count].op   = RV_OP_ILLEGAL;
+    block->inst[count].size = 0;
+    if (count == 0)
     {
-        DPRINTF(LOG_INST,("%08x: amomaxu.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+        block->pc = DECODE_INVALID;
+        return false;
+    }
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+    block->pc         = phy_pc;
+    block->mode       = mode;
+    block->count      = count;
+    block->link[0]    = NULL;
+    block->link[1]    = NULL;
+    block->hits       = 0;
+    block->code       = NULL;
 
-        // Modify
-        uint32_t val = reg_rs2;
-        if ((uint32_t)reg_rd > (uint32_t)reg_rs2)
-            val = reg_rd;
+    // Stores to this page must drop the block
+    decode_page_mark(phy_pc);
+    return true;
+}
+//-----------------------------------------------------------------
+// block_next: Follow (or create) the chain to the successor block
+//-----------------------------------------------------------------
+rv32::t_block *rv32::block_next(t_block *block, int succ, uint32_t entry_pc)
+{
+    uint32_t tag   = block->pc;
+    t_block *next  = block->link[succ];
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+    // Chained: same successor PC, translations unchanged, not evicted
+    if (next && block->link_epoch == m_block_epoch && block->link_pc[succ] == m_pc &&
+        next->pc == block->link_phy[succ] && next->mode == block->mode)
+        return next;
+
+    next = block_find();
+    if (!next || block->pc != tag || next->mode != block->mode)
+        return next;
 
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
+    // Under translation only chain within the page that was looked up
+    if ((block->mode & 4) && ((entry_pc ^ m_pc) >> DECODE_PGSHIFT))
+        return next;
+
+    if (block->link_epoch != m_block_epoch)
+    {
+        block->link[0]    = NULL;
+        block->link[1]    = NULL;
+        block->link_epoch = m_block_epoch;
     }
-    else if (m_enable_rva && (opcode & INST_AMOSWAP_W_MASK) == INST_AMOSWAP_W)
+
+    block->link[succ]     = next;
+    block->link_pc[succ]  = m_pc;
+    block->link_phy[succ] = next->pc;
+    return next;
+}
+//-----------------------------------------------------------------
+// block_execute: Execute a basic block using threaded dispatch.
+// Returns the number of instructions executed, succ is the chain link
+// to the successor block (-1 = none).
+//-----------------------------------------------------------------
+int rv32::block_execute(t_block *block, int *succ)
+{
+    // Handlers (indexed by eRiscvOp)
+    static const void *dispatch[] =
+    {
+        &&op_end,                                                   // ILLEGAL (end of block)
+        &&op_lui,   &&op_auipc, &&op_jal,   &&op_jalr,
+        &&op_beq,   &&op_bne,   &&op_blt,   &&op_bge,   &&op_bltu,  &&op_bgeu,
+        &&op_lb,    &&op_lh,    &&op_lw,    &&op_lbu,   &&op_lhu,   &&op_slow,  &&op_slow,
+        &&op_sb,    &&op_sh,    &&op_sw,    &&op_slow,
+        &&op_addi,  &&op_slti,  &&op_sltiu, &&op_xori,  &&op_ori,   &&op_andi,
+        &&op_slli,  &&op_srli,  &&op_srai,
+        &&op_add,   &&op_sub,   &&op_sll,   &&op_slt,   &&op_sltu,  &&op_xor,
+        &&op_srl,   &&op_sra,   &&op_or,    &&op_and,
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,                          // *IW
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,              // *W
+        &&op_fence, &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,              // FENCE .. EBREAK
+        &&op_slow,  &&op_slow,  &&op_slow,                                      // MRET, SRET, WFI
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  // CSR*
+        &&op_mul,   &&op_mulh,  &&op_mulhsu,&&op_mulhu,
+        &&op_div,   &&op_divu,  &&op_rem,   &&op_remu,
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,              // M *W
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  // A (W)
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  // A (D)
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow
+    };
+    static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == RV_OP_MAX, "Dispatch table mismatch");
+
+    const t_riscv_inst *inst = block->inst;
+    uint32_t tag   = block->pc;
+    uint32_t pc    = m_pc;
+    int      count = 0;
+
+    *succ = -1;
+
+#define RS1             m_gpr[inst->rs1]
+#define RS2             m_gpr[inst->rs2]
+#define WRITE_RD(v)     do { m_gpr[inst->rd] = (v); m_gpr[0] = 0; } while (0)
+#define DISPATCH()      goto *dispatch[inst->op]
+#define NEXT()          do { if (m_monitor) log_commit_pc(pc); pc += inst->size; inst++; count++; DISPATCH(); } while (0)
+#define LOAD(w, s)      do { uint32_t v; m_pc = pc; \
+                             if (!load(pc, RS1 + inst->imm, &v, w, s)) goto fault; \
+                             if (m_jit_record) jit_record(RS1 + inst->imm, v, w, false, false); \
+                             WRITE_RD(v); NEXT(); } while (0)
+#define STORE(w)        do { m_pc = pc; \
+                             if (!store(pc, RS1 + inst->imm, RS2, w)) goto fault; \
+                             if (m_jit_record) jit_record(RS1 + inst->imm, RS2, w, true, false); \
+                             if (block->pc != tag) goto modified; \
+                             NEXT(); } while (0)
+#define BRANCH(c)       do { bool taken = (c); \
+                             uint32_t npc = taken ? pc + inst->imm : pc + inst->size; \
+                             if (m_monitor) log_branch(pc, npc, taken); \
+                             if (inst->size == 4) m_stats[STATS_BRANCHES]++; \
+                             if (m_monitor) log_commit_pc(pc); \
+                             m_pc_x = pc; m_pc = npc; *succ = taken; \
+                             return count + 1; } while (0)
+
+    DISPATCH();
+
+op_lui:     WRITE_RD(inst->imm); NEXT();
+op_auipc:   WRITE_RD(pc + inst->imm); NEXT();
+op_addi:    WRITE_RD(RS1 + inst->imm); NEXT();
+op_slti:    WRITE_RD((int32_t)RS1 < inst->imm); NEXT();
+op_sltiu:   WRITE_RD(RS1 < (uint32_t)inst->imm); NEXT();
+op_xori:    WRITE_RD(RS1 ^ inst->imm); NEXT();
+op_ori:     WRITE_RD(RS1 | inst->imm); NEXT();
+op_andi:    WRITE_RD(RS1 & inst->imm); NEXT();
+op_slli:    WRITE_RD(RS1 << inst->imm); NEXT();
+op_srli:    WRITE_RD(RS1 >> inst->imm); NEXT();
+op_srai:    WRITE_RD((int32_t)RS1 >> inst->imm); NEXT();
+op_add:     WRITE_RD(RS1 + RS2); NEXT();
+op_sub:     WRITE_RD(RS1 - RS2); NEXT();
+op_sll:     WRITE_RD(RS1 << (RS2 & 31)); NEXT();
+op_slt:     WRITE_RD((int32_t)RS1 < (int32_t)RS2); NEXT();
+op_sltu:    WRITE_RD(RS1 < RS2); NEXT();
+op_xor:     WRITE_RD(RS1 ^ RS2); NEXT();
+op_srl:     WRITE_RD(RS1 >> (RS2 & 31)); NEXT();
+op_sra:     WRITE_RD((int32_t)RS1 >> (RS2 & 31)); NEXT();
+op_or:      WRITE_RD(RS1 | RS2); NEXT();
+op_and:     WRITE_RD(RS1 & RS2); NEXT();
+op_fence:   WRITE_RD(0); NEXT();
+
+op_mul:
+    m_stats[STATS_MUL]++;
+    WRITE_RD((int32_t)RS1 * (int32_t)RS2);
+    NEXT();
+op_mulh:
+    m_stats[STATS_MUL]++;
+    WRITE_RD((uint32_t)(((int64_t)(int32_t)RS1 * (int64_t)(int32_t)RS2) >> 32));
+    NEXT();
+op_mulhsu:
+    m_stats[STATS_MUL]++;
+    WRITE_RD((uint32_t)(((int64_t)(int32_t)RS1 * (uint64_t)RS2) >> 32));
+    NEXT();
+op_mulhu:
+    m_stats[STATS_MUL]++;
+    WRITE_RD((uint32_t)(((uint64_t)RS1 * (uint64_t)RS2) >> 32));
+    NEXT();
+op_div:
+    m_stats[STATS_DIV]++;
+    if ((int32_t)RS1 == INT32_MIN && (int32_t)RS2 == -1)
+        WRITE_RD(RS1);
+    else if (RS2 != 0)
+        WRITE_RD((int32_t)RS1 / (int32_t)RS2);
+    else
+        WRITE_RD((uint32_t)-1);
+    NEXT();
+op_divu:
+    m_stats[STATS_DIV]++;
+    WRITE_RD(RS2 ? RS1 / RS2 : (uint32_t)-1);
+    NEXT();
+op_rem:
+    m_stats[STATS_DIV]++;
+    if ((int32_t)RS1 == INT32_MIN && (int32_t)RS2 == -1)
+        WRITE_RD(0);
+    else if (RS2 != 0)
+        WRITE_RD((int32_t)RS1 % (int32_t)RS2);
+    else
+        WRITE_RD(RS1);
+    NEXT();
+op_remu:
+    m_stats[STATS_DIV]++;
+    WRITE_RD(RS2 ? RS1 % RS2 : RS1);
+    NEXT();
+
+op_lb:      LOAD(1, true);
+op_lh:      LOAD(2, true);
+op_lw:      LOAD(4, true);
+op_lbu:     LOAD(1, false);
+op_lhu:     LOAD(2, false);
+op_sb:      STORE(1);
+op_sh:      STORE(2);
+op_sw:      STORE(4);
+
+op_beq:     BRANCH(RS1 == RS2);
+op_bne:     BRANCH(RS1 != RS2);
+op_blt:     BRANCH((int32_t)RS1 <  (int32_t)RS2);
+op_bge:     BRANCH((int32_t)RS1 >= (int32_t)RS2);
+op_bltu:    BRANCH(RS1 <  RS2);
+op_bgeu:    BRANCH(RS1 >= RS2);
+
+op_jal:
+{
+    uint32_t npc = pc + inst->imm;
+    WRITE_RD(pc + inst->size);
+
+    if (m_monitor)
     {
-        DPRINTF(LOG_INST,("%08x: amoswap.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+        if (inst->rd == RISCV_REG_RA)
+            log_branch_call(pc, npc);
+        else
+            log_branch_jump(pc, npc);
+    }
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+    if (inst->size == 4)
+        m_stats[STATS_BRANCHES]++;
 
-        // Write
-        if (!store(pc, reg_rs1, reg_rs2, 4))
-            return false;
+    if (m_monitor)
+        log_commit_pc(pc);
+    m_pc_x = pc;
+    m_pc   = npc;
+    *succ  = 1;
+    return count + 1;
+}
+op_jalr:
+{
+    uint32_t npc = (RS1 + inst->imm) & ~1;
+    WRITE_RD(pc + inst->size);
 
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_LR_W_MASK) == INST_LR_W)
+    if (m_monitor)
     {
-        DPRINTF(LOG_INST,("%08x: lr.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+        if (inst->rs1 == RISCV_REG_RA && inst->imm == 0)
+            log_branch_ret(pc, npc);
+        else if (inst->rd == RISCV_REG_RA)
+            log_branch_call(pc, npc);
+        else
+            log_branch_jump(pc, npc);
+    }
 
-        // Record load address
-        m_load_res = reg_rs1;
+    if (inst->size == 4)
+        m_stats[STATS_BRANCHES]++;
 
-        INST_STAT(ENUM_INST_LW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_SC_W_MASK) == INST_SC_W)
+    if (m_monitor)
+        log_commit_pc(pc);
+    m_pc_x = pc;
+    m_pc   = npc;
+    *succ  = 1;
+    return count + 1;
+}
+
+op_slow:
+    // System, CSR and atomic operations
+    m_pc   = pc;
+    m_pc_x = pc;
+
+    // Counted before any side effects (stats dump on a SIM_CTRL exit)
+    m_stats[STATS_INSTRUCTIONS] += count + 1 - m_block_counted;
+    m_block_counted = count + 1;
+
+    if (!execute_decoded(inst))
+        return count + 1;
+
+    count++;
+
+    // Trap / interrupt, block end or code modified
+    if (m_pc != pc + inst->size || inst[1].op == RV_OP_ILLEGAL || block->pc != tag)
+        return count;
+
+    pc = m_pc;
+    inst++;
+    DISPATCH();
+
+op_end:
+    // Fall-through to the next sequential block
+    m_pc_x = pc - inst[-1].size;
+    m_pc   = pc;
+    *succ  = 0;
+    return count;
+
+modified:
+    // Store hit this block, refetch the successor
+    if (m_monitor)
+        log_commit_pc(pc);
+    m_pc_x = pc;
+    m_pc   = pc + inst->size;
+    return count + 1;
+
+fault:
+    // Load / store exception (m_pc is the trap vector)
+    if (m_jit_record)
+        jit_record(0, 0, 0, false, true);
+    m_pc_x = pc;
+    return count + 1;
+
+#undef RS1
+#undef RS2
+#undef WRITE_RD
+#undef DISPATCH
+#undef NEXT
+#undef LOAD
+#undef STORE
+#undef BRANCH
+}
+//-----------------------------------------------------------------
+// time_set: Set the timer (mtime) value from the current cycle
+//-----------------------------------------------------------------
+void rv32::time_set(uint64_t value)
+{
+    m_time_base  = value;
+    m_time_cycle = m_cycle_now;
+    timer_rearm();
+}
+//-----------------------------------------------------------------
+// timer_rearm: Schedule the (non-std) mtimecmp interrupt as a single
+// event on the cycle the timer reaches the compare value
+//-----------------------------------------------------------------
+void rv32::timer_rearm(void)
+{
+    if (!m_enable_mtimecmp || !m_csr_mtime_ie)
     {
-        DPRINTF(LOG_INST,("%08x: sc.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        if (m_load_res == reg_rs1)
-        {
-            // Write
-            if (!store(pc, reg_rs1, reg_rs2, 4))
-                return false;
+        timer_arm(SCHED_NEVER);
+        return;
+    }
 
-            reg_rd = 0;
-        }
-        else
-            reg_rd = 1;
+    uint64_t now = time_now();
+    // Limited internal timer, truncate to 32-bits
+    uint64_t target = now + (uint32_t)(m_csr_mtimecmp - (uint32_t)now);
 
-        m_load_res = 0;
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
+    // First cycle the timer reads target (ticks are applied at the end
+    // of the previous step)
+    uint64_t ticks = target - m_time_base;
+    if (ticks > (SCHED_NEVER - m_time_cycle) / m_timebase_div)
+        timer_arm(SCHED_NEVER);
+    else
+    {
+        uint64_t when = m_time_cycle + ticks * m_timebase_div;
+        timer_arm(when ? (when - 1) : 0);
     }
-    //-----------------------------------------------------------------
-    // C Extension
-    //-----------------------------------------------------------------
-    // RVC - Quadrant 0
-    else if (m_enable_rvc && ((opcode & 3) == 0))
+}
+//-----------------------------------------------------------------
+// timer_expired: mtimecmp reached
+//-----------------------------------------------------------------
+void rv32::timer_expired(void)
+{
+    if (m_enable_mtimecmp && m_csr_mtime_ie)
     {
-        opcode &= 0xFFFF;
-        rvc_decode rvc(opcode);
+        m_csr_mip     |= m_enable_sbi ? SR_IP_STIP : SR_IP_MTIP;
+        m_csr_mtime_ie = false;
+    }
+}
+//-----------------------------------------------------------------
+// wfi_idle: Hart asleep, skip idle cycles up to the next device or
+// timer event (and before end). Returns the number of cycles skipped.
+//-----------------------------------------------------------------
+uint64_t rv32::wfi_idle(uint64_t cycles, uint64_t end)
+{
+    uint64_t next = sched_next_event();
 
-        rs1     = rvc.rs1s();
-        rs2     = rvc.rs2s();
-        rd      = rs2;
-        reg_rs1 = m_gpr[rs1];
-        reg_rs2 = m_gpr[rs2];        
+    if (next < cycles)
+        next = cycles;
+    if (next >= end)
+        next = end - 1;
 
-        // C.ADDI4SPN
-        if ((opcode >> 13) == 0 && opcode != 0)
-        {
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-
-            uint32_t imm = rvc.addi4spn_imm();
-            DPRINTF(LOG_INST,("%08x: c.addi4spn r%d,r%d,%d\n", pc, rd, rs1, imm));
-            INST_STAT(ENUM_INST_ADDI);
-            reg_rd = reg_rs1 + imm;
-            pc += 2;
-        }
-        // C.LW
-        else if ((opcode >> 13) == 2)
-        {
-            uint32_t imm = rvc.lw_imm();
-            DPRINTF(LOG_INST,("%08x: c.lw r%d, %d(r%d)\n", pc, rd, imm, rs1));
-            INST_STAT(ENUM_INST_LW);
-            if (load(pc, reg_rs1 + imm, &reg_rd, 4, true))
-                pc += 2;
-            else
-                return false;
-        }
-        // C.LD
-        else if ((opcode >> 13) == 3)
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-        // C.SW
-        else if ((opcode >> 13) == 6)
-        {
-            uint32_t imm = rvc.lw_imm();
-            DPRINTF(LOG_INST,("%08x: c.sw %d(r%d), r%d\n", pc, imm, rs1, rd));
-            INST_STAT(ENUM_INST_SW);
-            if (store(pc, reg_rs1 + imm, reg_rs2, 4))
-                pc += 2;
-            else
-                return false;
+    // Time passes, devices / timer due at the last idle cycle are clocked
+    m_cycle_now = next;
+    cpu::step(next);
 
-            // No writeback
-            rd = 0;
-        }
-        // C.SD
-        else if ((opcode >> 13) == 7)
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-        // Illegal instruction
-        else
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-    }
-    // RVC - Quadrant 1 (top half - c.nop - c.lui)
-    else if (m_enable_rvc && ((opcode & 3) == 1) && (((opcode & 0xFFFF) >> 13) < 4))
-    {
-        opcode &= 0xFFFF;
-        rvc_decode rvc(opcode);
+    // Wake on a pending (enabled) interrupt
+    if (m_csr_mip & m_csr_mie)
+        m_wfi = false;
 
-        rs1     = rvc.rs1();
-        rs2     = rvc.rs2();
-        rd      = rs1;
-        reg_rs1 = m_gpr[rs1];
-        reg_rs2 = m_gpr[rs2];
+    log_idle(next - cycles + 1);
+    return next - cycles + 1;
+}
+//-----------------------------------------------------------------
+// step_block: Execute chained basic blocks (up to max_steps).
+// Timer, interrupts and devices are updated once per block.
+//-----------------------------------------------------------------
+int rv32::step_block(uint64_t cycles, int max_steps)
+{
+    t_block *block = NULL;
 
-        // C.NOP
-        if ((opcode >> 13) == 0 && opcode == 0)
-        {
-            DPRINTF(LOG_INST,("%08x: c.nop\n", pc));
-            INST_STAT(ENUM_INST_ADDI);
-            pc += 2;
-        }
-        // C.ADDI
-        else if ((opcode >> 13) == 0)
-        {
-            int32_t imm = rvc.imm();
-            DPRINTF(LOG_INST,("%08x: c.addi r%d, %d\n", pc, rs1, imm));
-            INST_STAT(ENUM_INST_ADDI);
-            reg_rd = reg_rs1 + imm;
-            pc += 2;
-        }
-        // C.JAL // TODO: C.ADDIW on RV64
-        else if ((opcode >> 13) == 1)
-        {
-            uint32_t imm = rvc.j_imm();
-            DPRINTF(LOG_INST,("%08x: c.jal 0x%08x\n", pc, pc + imm));
-            INST_STAT(ENUM_INST_JAL);
-            rd     = RISCV_REG_RA;
-            reg_rd = pc + 2;
-            pc += imm;
-
-            log_branch_call(m_pc, pc);
-        }
-        // C.LI
-        else if ((opcode >> 13) == 2)
-        {
-            uint32_t imm = rvc.imm();
-            DPRINTF(LOG_INST,("%08x: c.li r%d, %d\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_LUI);
-            reg_rd = imm;
-            pc += 2;
-        }
-        // C.ADDI16SP
-        else if ((opcode >> 13) == 3 && ((opcode >> 7) & 0x1f) == 2)
-        {
-            uint32_t imm = rvc.addi16sp_imm();
-            rd      = RISCV_REG_SP;
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-            DPRINTF(LOG_INST,("%08x: c.addi16sp r%d, r%d, %d\n", pc, rd, rs1, imm));
-            INST_STAT(ENUM_INST_ADDI);
-            reg_rd  = reg_rs1 + imm;
-            pc += 2;
-        }
-        // C.LUI
-        else if ((opcode >> 13) == 3)
-        {
-            uint32_t imm = rvc.imm() << 12;
-            DPRINTF(LOG_INST,("%08x: c.lui r%d, 0x%x\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_LUI);
-            reg_rd  = imm;
-            pc += 2;
-        }
-        // Illegal instruction
-        else
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
+    m_device_event = false;
+
+    // Asleep, fast-forward to the next event
+    if (m_wfi)
+        return (int)wfi_idle(cycles, cycles + max_steps);
+
+    // Tracing and breakpoints need the per-instruction path
+    if (!m_trace && !m_trace_file && !m_has_breakpoints && max_steps >= BLOCK_MAX_INSTS)
+        block = block_find();
+
+    if (!block)
+    {
+        step(cycles);
+        return 1;
     }
-    // RVC - Quadrant 1 (bottom half - c.srli -)
-    else if (m_enable_rvc && ((opcode & 3) == 1))
+
+    int total = 0;
+    while (block)
     {
-        opcode &= 0xFFFF;
-        rvc_decode rvc(opcode);
+        uint32_t entry_pc = m_pc;
+        int      succ;
+        int      count;
 
-        rs1     = rvc.rs1s();
-        rs2     = rvc.rs2s();
-        rd      = rs1;
-        reg_rs1 = m_gpr[rs1];
-        reg_rs2 = m_gpr[rs2];
+        m_cycle_now = cycles + total;
 
-        // C.SRLI
-        if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x3) == 0)
-        {
-            uint32_t imm = rvc.zimm();
-            DPRINTF(LOG_INST,("%08x: c.srli r%d, %d\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_SRLI);
-            reg_rd = reg_rs1 >> imm;
-            pc += 2;
-        }
-        // C.SRAI
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x3) == 1)
-        {
-            uint32_t imm = rvc.zimm();
-            DPRINTF(LOG_INST,("%08x: c.srai r%d, %d\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_SRAI);
-            reg_rd = (int32_t)reg_rs1 >> imm;
-            pc += 2;
-        }
-        // C.ANDI
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x3) == 2)
-        {
-            uint32_t imm = rvc.imm();
-            DPRINTF(LOG_INST,("%08x: c.andi r%d, 0x%08x\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_ANDI);
-            reg_rd = reg_rs1 & imm;
-            pc += 2;
-        }
-        // C.SUB
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 3 && ((opcode >> 5) & 0x3) == 0)
-        {
-            DPRINTF(LOG_INST,("%08x: c.sub r%d, r%d\n", pc, rs1, rs2));
-            INST_STAT(ENUM_INST_SUB);
-            reg_rd = (int32_t)(reg_rs1 - reg_rs2);
-            pc += 2;
-        }
-        // C.XOR
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 3 && ((opcode >> 5) & 0x3) == 1)
-        {
-            DPRINTF(LOG_INST,("%08x: c.xor r%d, r%d\n", pc, rs1, rs2));
-            INST_STAT(ENUM_INST_XOR);
-            reg_rd = reg_rs1 ^ reg_rs2;
-            pc += 2;
-        }
-        // C.OR
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 3 && ((opcode >> 5) & 0x3) == 2)
-        {
-            DPRINTF(LOG_INST,("%08x: c.or r%d, r%d\n", pc, rs1, rs2));
-            INST_STAT(ENUM_INST_OR);
-            reg_rd = reg_rs1 | reg_rs2;
-            pc += 2;
-        }
-        // C.AND
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 3 && ((opcode >> 5) & 0x3) == 3)
-        {
-            DPRINTF(LOG_INST,("%08x: c.and r%d, r%d\n", pc, rs1, rs2));
-            INST_STAT(ENUM_INST_AND);
-            reg_rd = reg_rs1 & reg_rs2;
-            pc += 2;
-        }
-        // C.SUBW
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 7 && ((opcode >> 5) & 0x3) == 0)
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-        // C.ADDW
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 7 && ((opcode >> 5) & 0x3) == 1)
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-        // C.J
-        else if ((opcode >> 13) == 5)
-        {
-            uint32_t imm = rvc.j_imm();
-            DPRINTF(LOG_INST,("%08x: c.j 0x%08x\n", pc, pc + imm));
-            INST_STAT(ENUM_INST_J);
-            pc += imm;
-            rd = 0;
-            log_branch_jump(m_pc, pc);
-        }
-        // C.BEQZ
-        else if ((opcode >> 13) == 6)
-        {
-            uint32_t imm = rvc.b_imm();
+        // Hot machine mode blocks are translated to host code
+        if (m_jit_mode != JIT_OFF && !block->code && block->mode == PRIV_MACHINE && ++block->hits == JIT_THRESHOLD)
+            jit_compile(block);
 
-            DPRINTF(LOG_INST,("%08x: c.beqz r%d, %d\n", pc, rs1, imm));
-            INST_STAT(ENUM_INST_BEQ);
-            bool take_branch = (reg_rs1 == 0);
-            if (take_branch)
-                pc += imm;
-            else
-                pc += 2;
-            log_branch(m_pc, pc, take_branch);
-            rd = 0;
-        }
-        // C.BNEZ
-        else if ((opcode >> 13) == 7)
-        {
-            uint32_t imm = rvc.b_imm();
-            DPRINTF(LOG_INST,("%08x: c.bnez r%d, %d\n", pc, rs1, imm));
-            INST_STAT(ENUM_INST_BNE);
-            bool take_branch = (reg_rs1 != 0);
-            if (take_branch)
-                pc += imm;
-            else
-                pc += 2;
-            log_branch(m_pc, pc, take_branch);
-            rd = 0;
-        }
-        // Illegal instruction
+        m_block_counted = 0;
+        if (block->code && !(m_csr_msr & SR_MPRV))
+            count = jit_execute(block, &succ);
         else
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-    }
-    // RVC - Quadrant 2
-    else if (m_enable_rvc && ((opcode & 3) == 2))
-    {
-        opcode &= 0xFFFF;
+            count = block_execute(block, &succ);
 
-        rvc_decode rvc(opcode);
-        rs1     = rvc.rs1();
-        rs2     = rvc.rs2();
-        rd      = rs1;
-        reg_rs1 = m_gpr[rs1];
-        reg_rs2 = m_gpr[rs2];
+        total += count;
+        m_stats[STATS_INSTRUCTIONS] += count - m_block_counted;
 
-        // C.SLLI
-        if ((opcode >> 13) == 0)
-        {
-            uint32_t imm = rvc.zimm();
-            DPRINTF(LOG_INST,("%08x: c.slli r%d, %d\n", pc, rs1, imm));
-            INST_STAT(ENUM_INST_SLLI);
-            reg_rd = reg_rs1 << imm;
-            pc += 2;
-        }
-        // C.LWSP
-        else if ((opcode >> 13) == 2)
-        {
-            uint32_t imm = rvc.lwsp_imm();
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-
-            DPRINTF(LOG_INST,("%08x: c.lwsp r%d, %d(r%d)\n", pc, rd, imm, rs1));
-            INST_STAT(ENUM_INST_LW);
-            if (load(pc, reg_rs1 + imm, &reg_rd, 4, true))
-                pc += 2;
-            else
-                return false;
-        }
-        // C.LDSP
-        else if ((opcode >> 13) == 3)
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-        // C.JR
-        // C.MV
-        // C.EBREAK
-        // C.JALR
-        // C.ADD
-        else if ((opcode >> 13) == 4)
-        {
-            if (!(opcode & (1 << 12)))
-            {
-                // C.JR
-                if (((opcode >> 2) & 0x1F) == 0)
-                {
-                    rd = 0;
-                    DPRINTF(LOG_INST,("%08x: c.jr r%d\n", pc, rs1));
-                    INST_STAT(ENUM_INST_J);
-                    pc = reg_rs1 & ~1;
-                    if (rs1 == RISCV_REG_RA)
-                        log_branch_ret(m_pc, pc);
-                    else
-                        log_branch_jump(m_pc, pc);
-                }
-                // C.MV
-                else
-                {
-                    DPRINTF(LOG_INST,("%08x: c.mv r%d, r%d\n", pc, rd, rs2));
-                    INST_STAT(ENUM_INST_ADD);
-                    pc += 2;
-                    reg_rd = reg_rs2;
-                }
-            }
-            else
-            {
-                // C.EBREAK
-                if (((opcode >> 7) & 0x1F) == 0 && ((opcode >> 2) & 0x1F) == 0)
-                {
-                    rd = 0;
-                    DPRINTF(LOG_INST,("%08x: c.ebreak\n", pc));
-                    INST_STAT(ENUM_INST_EBREAK);
+        // Clock peripherals
+        cpu::step(cycles + total - 1);
 
-                    exception(MCAUSE_BREAKPOINT, pc);
-                    take_exception   = true;
-                    m_break          = true;
-                }
-                // C.JALR
-                else if (((opcode >> 2) & 0x1F) == 0)
-                {
-                    rd = RISCV_REG_RA;
-                    DPRINTF(LOG_INST,("%08x: c.jalr r%d, r%d\n", pc, rd, rs1));
-                    INST_STAT(ENUM_INST_JALR);
-                    reg_rd = pc + 2;
-                    pc     = reg_rs1 & ~1;
-                    if (rs1 == RISCV_REG_RA)
-                        log_branch_ret(m_pc, pc);
-                    else
-                        log_branch_call(m_pc, pc);
-                }
-                // C.ADD
-                else
-                {
-                    DPRINTF(LOG_INST,("%08x: c.add r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-                    INST_STAT(ENUM_INST_ADD);
-                    reg_rd = reg_rs1 + reg_rs2;
-                    pc += 2;
-                }
-            }
-        }
-        // C.SWSP
-        else if ((opcode >> 13) == 6)
-        {
-            uint32_t uimm = rvc.swsp_imm();
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-            DPRINTF(LOG_INST,("%08x: c.swsp r%d, %d(r%d)\n", pc, rs2, uimm, rs1));
-            INST_STAT(ENUM_INST_SW);
-
-            if (store(pc, reg_rs1 + uimm, reg_rs2, 4))
-                pc += 2;
-            else
-                return false;
+        // Pending interrupt
+        if ((m_csr_mip & m_csr_mie) && check_interrupts(m_pc))
+            break;
 
-            // No writeback
-            rd = 0;            
-        }
-        // C.SDSP
-        else if ((opcode >> 13) == 7)
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-        // Illegal instruction
-        else
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-    }
-    else
-    {
-        exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        take_exception = true;
-    }
+        if (succ < 0 || (total + BLOCK_MAX_INSTS) > max_steps || m_stopped || m_fault || m_break)
+            break;
 
-    if (rd != 0 && !take_exception)
-        m_gpr[rd] = reg_rd;
+        // Device event or run() stop PC
+        if (m_device_event || m_pc_x == m_run_stop_pc)
+            break;
 
-    // Monitor executed instructions
-    log_commit_pc(m_pc_x);
+        // Branch to self (idle loop) / WFI
+        if (block->count == 1 && block->inst[0].op == RV_OP_JAL && block->inst[0].imm == 0)
+            wfi_sleep();
+        if (m_wfi)
+            break;
 
-    // Pending interrupt
-    if (!take_exception && (m_csr_mip & m_csr_mie))
-    {
-        uint32_t pending_interrupts = (m_csr_mip & m_csr_mie);
-        uint32_t m_enabled          = m_csr_mpriv < PRIV_MACHINE || (m_csr_mpriv == PRIV_MACHINE && (m_csr_msr & SR_MIE));
-        uint32_t s_enabled          = m_csr_mpriv < PRIV_SUPER   || (m_csr_mpriv == PRIV_SUPER   && (m_csr_msr & SR_SIE));
-        uint32_t m_interrupts       = pending_interrupts & ~m_csr_mideleg & -m_enabled;
-        uint32_t s_interrupts       = pending_interrupts & m_csr_mideleg & -s_enabled;
-        uint32_t interrupts         = m_interrupts ? m_interrupts : s_interrupts;
+        block = block_next(block, succ, entry_pc);
+    }
 
-        // Interrupt pending and mask enabled
-        if (interrupts)
-        {
-            //printf("Take Interrupt...: %08x\n", interrupts);
-            int i;
+    return total;
+}
+//-----------------------------------------------------------------
+// run: Execute up to max_steps instructions as chained basic blocks
+//-----------------------------------------------------------------
+int rv32::run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc)
+{
+    uint64_t end = cycles + max_steps;
 
-            for (i=IRQ_MIN;i<IRQ_MAX;i++)
-            {
-                if (interrupts & (1 << i))
-                {
-                    // Only service one interrupt per cycle
-                    DPRINTF(LOG_INST,( "Interrupt%d taken...\n", i));
-                    exception(MCAUSE_INTERRUPT + i, pc);
-                    take_exception = true;
-                    break;
-                }
-            }
-        }
+    // Cached blocks are split at the stop PC
+    uint32_t stop = (stop_pc == RUN_NO_STOP_PC) ? DECODE_INVALID : (uint32_t)stop_pc;
+    if (stop != m_run_stop_pc)
+    {
+        m_run_stop_pc = stop;
+        decode_flush();
     }
 
-    if (!take_exception)
-        m_pc = pc;
+    m_device_event = false;
+    while (cycles < end)
+    {
+        uint64_t budget = end - cycles;
+        if (m_wfi)
+            cycles += wfi_idle(cycles, end);
+        else
+            cycles += rv32::step_block(cycles, budget < RUN_BLOCK_STEPS ? (int)budget : RUN_BLOCK_STEPS);
 
-    return true;
+        int status = run_status(m_pc_x, stop_pc);
+        if (status != RUN_BUDGET)
+            return status;
+    }
+
+    return RUN_BUDGET;
 }
 //-----------------------------------------------------------------
 // step: Step through one instruction
 //-----------------------------------------------------------------
 void rv32::step(uint64_t cycles)
 {
+    // Asleep (one idle cycle)
+    if (m_wfi)
+    {
+        wfi_idle(cycles, cycles + 1);
+        return;
+    }
+
+    m_cycle_now = cycles;
     m_stats[STATS_INSTRUCTIONS]++;
 
     // Execute instruction at current PC
+    uint64_t traced = m_trace_file ? m_trace_file->get_insts() : 0;
     int max_steps = 2;
     while (max_steps-- && !execute())
-        ;
-
-    // Increment timer counter
-    m_csr_mtime++;
-
-    // Non-std: Timer should generate an internal interrupt?
-    if (m_enable_mtimecmp)
     {
-        // Limited internal timer, truncate to 32-bits
-        if ((m_csr_mtime & 0xFFFFFFFF) == m_csr_mtimecmp && m_csr_mtime_ie)
+        // Faulting instruction, the handler runs in the same step
+        if (m_trace_file && m_trace_file->get_insts() != traced)
         {
-            m_csr_mip     |= m_enable_sbi ? SR_IP_STIP : SR_IP_MTIP;
-            m_csr_mtime_ie = false;
+            m_trace_file->abort();
+            traced = m_trace_file->get_insts();
         }
     }
 
@@ -2285,8 +2274,12 @@ void rv32::step(uint64_t cycles)
 //-----------------------------------------------------------------
 void rv32::set_interrupt(int irq)
 {
-    assert(irq == IRQ_M_EXT || irq == IRQ_M_TIMER);
-    if (irq == IRQ_M_EXT)
+    assert(irq == IRQ_M_EXT || irq == IRQ_M_TIMER || irq == IRQ_M_SOFT || irq == IRQ_S_SOFT);
+    if (irq == IRQ_M_SOFT)
+        m_csr_mip |= SR_IP_MSIP;
+    else if (irq == IRQ_S_SOFT)
+        m_csr_mip |= SR_IP_SSIP;
+    else if (irq == IRQ_M_EXT)
 #ifdef CPU_INTERRUPT_MEIP_ONLY
         m_csr_mip |= (SR_IP_MEIP);
 #else
@@ -2298,29 +2291,7 @@ void rv32::set_interrupt(int irq)
 #ifdef CPU_INTERRUPT_ON_SET
     // Pending interrupt
     if (m_csr_mip & m_csr_mie)
-    {
-        uint32_t pending_interrupts = (m_csr_mip & m_csr_mie);
-        uint32_t m_enabled          = m_csr_mpriv < PRIV_MACHINE || (m_csr_mpriv == PRIV_MACHINE && (m_csr_msr & SR_MIE));
-        uint32_t s_enabled          = m_csr_mpriv < PRIV_SUPER   || (m_csr_mpriv == PRIV_SUPER   && (m_csr_msr & SR_SIE));
-        uint32_t m_interrupts       = pending_interrupts & ~m_csr_mideleg & -m_enabled;
-        uint32_t s_interrupts       = pending_interrupts & m_csr_mideleg & -s_enabled;
-        uint32_t interrupts         = m_interrupts ? m_interrupts : s_interrupts;
-
-        // Interrupt pending and mask enabled
-        if (interrupts)
-        {
-            for (int i=IRQ_MIN;i<IRQ_MAX;i++)
-            {
-                if (interrupts & (1 << i))
-                {
-                    // Only service one interrupt per cycle
-                    DPRINTF(LOG_INST,( "Interrupt%d taken...\n", i));
-                    exception(MCAUSE_INTERRUPT + i, m_pc);
-                    break;
-                }
-            }
-        }
-    }
+        check_interrupts(m_pc);
 #endif
 }
 //-----------------------------------------------------------------
@@ -2328,8 +2299,12 @@ void rv32::set_interrupt(int irq)
 //-----------------------------------------------------------------
 void rv32::clr_interrupt(int irq)
 {
-    assert(irq == IRQ_M_TIMER || irq == IRQ_M_EXT);
-    if (irq == IRQ_M_TIMER && !m_enable_mtimecmp)
+    assert(irq == IRQ_M_TIMER || irq == IRQ_M_EXT || irq == IRQ_M_SOFT || irq == IRQ_S_SOFT);
+    if (irq == IRQ_M_SOFT)
+        m_csr_mip &= ~SR_IP_MSIP;
+    else if (irq == IRQ_S_SOFT)
+        m_csr_mip &= ~SR_IP_SSIP;
+    else if (irq == IRQ_M_TIMER && !m_enable_mtimecmp)
         m_csr_mip &= ~SR_IP_MTIP;
     else if (irq == IRQ_M_EXT)
     {
@@ -2341,6 +2316,130 @@ void rv32::clr_interrupt(int irq)
     }
 }
 //-----------------------------------------------------------------
+// remote_fence: FENCE.I / SFENCE.VMA requested by another hart
+//-----------------------------------------------------------------
+void rv32::remote_fence(uint32_t mask)
+{
+    if (mask & FENCE_VMA)
+        mmu_flush();
+    if (mask & FENCE_I)
+        decode_flush();
+}
+//-----------------------------------------------------------------
+// serialize_arch: Checkpoint architectural state. The TLB and the
+// decoded instruction caches are not saved, just flushed on restore.
+//-----------------------------------------------------------------
+bool rv32::serialize_arch(checkpoint &cp)
+{
+    cp.section("rv32", 1);
+
+    cp.io(m_gpr);
+    cp.io(m_pc);
+    cp.io(m_pc_x);
+    cp.io(m_load_res);
+    cp.io(m_load_val);
+
+    cp.io(m_csr_mepc);
+    cp.io(m_csr_mcause);
+    cp.io(m_csr_msr);
+    cp.io(m_csr_mpriv);
+    cp.io(m_csr_mevec);
+    cp.io(m_csr_mtval);
+    cp.io(m_csr_mie);
+    cp.io(m_csr_mip);
+    cp.io(m_csr_mtimecmp);
+    cp.io(m_csr_mtime_ie);
+    cp.io(m_csr_mscratch);
+    cp.io(m_csr_mideleg);
+    cp.io(m_csr_medeleg);
+
+    cp.io(m_cycle_now);
+    cp.io(m_time_cycle);
+    cp.io(m_time_base);
+
+    cp.io(m_csr_sepc);
+    cp.io(m_csr_sevec);
+    cp.io(m_csr_scause);
+    cp.io(m_csr_stval);
+    cp.io(m_csr_satp);
+    cp.io(m_csr_sscratch);
+
+    cp.io(m_wfi);
+
+    if (cp.is_restore())
+    {
+        mmu_flush();
+        decode_flush();
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------
+// atomic_translate: Translate the address of an AMO / LR / SC (must be
+// naturally aligned). *host is set if the word is directly backed memory.
+//-----------------------------------------------------------------
+int rv32::atomic_translate(uint32_t pc, uint32_t address, int width, bool write, uint32_t *physical, uint8_t **host)
+{
+    *host = NULL;
+
+    if (address & (width-1))
+    {
+        exception(write ? MCAUSE_MISALIGNED_STORE : MCAUSE_MISALIGNED_LOAD, pc, address);
+        return 0;
+    }
+
+    if (!mmu_d_translate(pc, address, physical, write))
+        return 0;
+
+    *host = get_host_ptr(*physical);
+    return 1;
+}
+//-----------------------------------------------------------------
+// atomic_access: Account an atomic access to directly backed memory
+// (stats, trace, self-modifying code)
+//-----------------------------------------------------------------
+void rv32::atomic_access(uint32_t address, uint32_t physical, bool write, uint32_t data, int width)
+{
+    if (write)
+    {
+        DPRINTF(LOG_MEM, ("STORE: VA 0x%08x PA 0x%08x Value 0x%08x Width %d\n", address, physical, data, width));
+        m_stats[STATS_STORES]++;
+
+        // Self-modifying code
+        if (decode_page_cached(physical))
+            decode_invalidate(physical);
+    }
+    else
+    {
+        DPRINTF(LOG_MEM, ("LOAD: VA 0x%08x PA 0x%08x Width %d\n", address, physical, width));
+        DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n", data));
+        m_stats[STATS_LOADS]++;
+    }
+
+    if (m_trace_file)
+        m_trace_file->mem(write, address, physical, data, width);
+}
+//-----------------------------------------------------------------
+// sc_check: Store conditional to a device. With other harts the word
+// must still hold the value LR returned (read directly, not a load).
+//-----------------------------------------------------------------
+bool rv32::sc_check(uint32_t physical)
+{
+    if (!m_smp)
+        return true;
+
+    // Bad addresses are reported by the store
+    memory_base *mem = find_memory(physical);
+    if (!mem)
+        return true;
+
+    uint32_t val = 0;
+    bus_lock();
+    mem->read32(physical, val);
+    bus_unlock();
+    return val == m_load_val;
+}
+//-----------------------------------------------------------------
 // set_timer: Set built in timer interrupt
 //-----------------------------------------------------------------
 void rv32::set_timer(uint32_t value)
@@ -2349,6 +2448,7 @@ void rv32::set_timer(uint32_t value)
     m_csr_mtime_ie    = true;
     m_csr_mtimecmp    = value;
     m_csr_mip        &= ~SR_IP_STIP;
+    timer_rearm();
 }
 //-----------------------------------------------------------------
 // in_super_mode: Is the CPU in SUPER mode
@@ -2369,10 +2469,23 @@ void rv32::sbi_boot(uint32_t boot_addr, uint32_t dtb_addr)
     m_csr_medeleg = ~MCAUSE_ECALL_S;
 
     m_pc = m_pc_x = boot_addr;
-    m_gpr[RISCV_REG_A0 + 0] = 0;
+    m_gpr[RISCV_REG_A0 + 0] = m_hart_id;
     m_gpr[RISCV_REG_A0 + 1] = dtb_addr;
 }
 //-----------------------------------------------------------------
+// enable_trace_file: Attach binary instruction trace
+//-----------------------------------------------------------------
+bool rv32::enable_trace_file(trace_writer *file)
+{
+    // Initial register state (later records are writebacks)
+    if (file)
+        for (int i=1;i<REGISTERS;i++)
+            file->reg(i, m_gpr[i]);
+
+    m_trace_file = file;
+    return true;
+}
+//-----------------------------------------------------------------
 // stats_reset: Reset runtime stats
 //-----------------------------------------------------------------
 void rv32::stats_reset(void)
@@ -2397,5 +2510,11 @@ void rv32::stats_dump(void)
         printf( "- Division              %d (%d%%)\n", m_stats[STATS_DIV], (m_stats[STATS_DIV] * 100) / m_stats[STATS_INSTRUCTIONS]);
     }
 
+    if (m_stats[STATS_ITLB_MISS] || m_stats[STATS_DTLB_MISS])
+    {
+        printf( "- ITLB Hits / Misses    %d / %d\n", m_stats[STATS_ITLB_HIT], m_stats[STATS_ITLB_MISS]);
+        printf( "- DTLB Hits / Misses    %d / %d\n", m_stats[STATS_DTLB_HIT], m_stats[STATS_DTLB_MISS]);
+    }
+
     stats_reset();
 }
@@ -12,6 +12,8 @@
 #include <vector>
 #include "memory.h"
 #include "cpu.h"
+#include "riscv_decode.h"
+#include "riscv_tlb.h"
 
 //--------------------------------------------------------------------
 // rv32: RV32IM model
@@ -20,10 +22,14 @@ class rv32: public cpu
 {
 public:
                         rv32(uint32_t baseAddr = 0, uint32_t len = 0);
+                       ~rv32();
 
     void                reset(uint32_t start_addr);
+    bool                attach_memory(memory_base *memory);
     uint32_t            get_opcode(uint32_t pc);
     void                step(uint64_t cycles);
+    int                 step_block(uint64_t cycles, int max_steps);
+    int                 run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc = RUN_NO_STOP_PC);
 
     void                set_interrupt(int irq);
     void                clr_interrupt(int irq);
@@ -43,6 +49,11 @@ public:
     void                enable_mem_unaligned(bool en) { m_enable_unaligned = en; }
     void                enable_mem_errors(bool en)    { m_enable_mem_errors = en; }
     void                enable_compliant_csr(bool en) { m_compliant_csr = en; }
+    bool                enable_jit(int mode);
+    uint32_t            get_jit_blocks(void) { return m_jit_blocks; }
+    bool                enable_trace_file(trace_writer *file);
+    bool                has_monitor(void) { return true; }
+    bool                set_tlb_size(int entries, int ways);
 
     // First register for args in ABI
     int                 get_abi_reg_arg0(void) { return 10; }
@@ -51,14 +62,15 @@ public:
     int                 get_abi_reg_num(void) { return 8; }
 
     // Enable / Disable ISA extensions
-    void                enable_rvm(bool en) { m_enable_rvm = en; }
-    void                enable_rvc(bool en) { m_enable_rvc = en; }
-    void                enable_rva(bool en) { m_enable_rva = en; }
+    void                enable_rvm(bool en) { m_enable_rvm = en; decode_flush(); }
+    void                enable_rvc(bool en) { m_enable_rvc = en; decode_flush(); }
+    void                enable_rva(bool en) { m_enable_rva = en; decode_flush(); }
 
     // SBI hosting support
     bool                in_super_mode(void);
     void                set_timer(uint32_t value);
     void                sbi_boot(uint32_t boot_addr, uint32_t dtb_addr);
+    int                 sbi_load(uint32_t address, uint32_t *val) { return load(m_pc, address, val, 4, false); }
 
 protected:  
     bool                execute(void);
@@ -66,15 +78,129 @@ protected:
     int                 store(uint32_t pc, uint32_t address, uint32_t data, int width);
     virtual bool        access_csr(uint32_t address, uint32_t data, bool set, bool clr, uint32_t &result);
     void                exception(uint32_t cause, uint32_t pc, uint32_t badaddr = 0);
+    bool                check_interrupts(uint32_t pc);
+    void                invalidate_code(uint32_t addr, int length);
+    void                remote_fence(uint32_t mask);
+    bool                serialize_arch(checkpoint &cp);
+    int                 atomic_translate(uint32_t pc, uint32_t address, int width, bool write, uint32_t *physical, uint8_t **host);
+    void                atomic_access(uint32_t address, uint32_t physical, bool write, uint32_t data, int width);
+    bool                sc_check(uint32_t physical);
 
 // MMU
 private:
     void                mmu_flush(void);
+    void                mmu_fence(bool by_addr, uint32_t addr, bool by_asid, uint32_t asid);
     int                 mmu_read_word(uint32_t address, uint32_t *val);
-    uint32_t            mmu_walk(uint32_t addr);
+    uint32_t            mmu_walk(uint32_t addr, bool fetch = false);
     int                 mmu_i_translate(uint32_t addr, uint32_t *physical);
     int                 mmu_d_translate(uint32_t pc, uint32_t addr, uint32_t *physical, int writeNotRead);
 
+// Pre-decoded instruction cache
+private:
+    typedef struct
+    {
+        uint32_t        pc;     // Physical PC tag
+        t_riscv_inst    inst;
+    } t_decoded;
+
+    void                decode_flush(void);
+    void                decode_invalidate(uint32_t addr);
+    bool                decode_fill(t_decoded *inst, uint32_t phy_pc);
+    bool                execute_decoded(const t_riscv_inst *inst);
+    void                trace_inst(const t_riscv_inst *inst);
+    uint32_t            decode_flags(void)
+    {
+        return (m_enable_rvm ? RV_DECODE_RVM : 0) |
+               (m_enable_rva ? RV_DECODE_RVA : 0) |
+               (m_enable_rvc ? RV_DECODE_RVC : 0);
+    }
+    bool                decode_page_cached(uint32_t addr)
+    {
+        uint32_t page = addr >> DECODE_PGSHIFT;
+        return m_decode_pages[page >> 5] & (1 << (page & 31));
+    }
+    bool                decode_page_nohost(uint32_t addr)
+    {
+        uint32_t page = addr >> DECODE_PGSHIFT;
+        return m_nohost_pages[page >> 5] & (1 << (page & 31));
+    }
+
+// Basic block cache
+private:
+    static const int    BLOCK_ENTRIES   = 4096;
+    static const int    BLOCK_MAX_INSTS = 32;
+    static const int    RUN_BLOCK_STEPS = 4096; // Per step_block() call from run()
+
+    typedef struct t_block
+    {
+        uint32_t        pc;         // Physical PC tag
+        uint32_t        mode;       // Privilege / MMU mode tag
+        int             count;
+        uint32_t        link_epoch; // Translation epoch links were made in
+        uint32_t        link_pc[2]; // Successor virtual PC (fall-through, taken)
+        uint32_t        link_phy[2];
+        struct t_block *link[2];
+        uint32_t        hits;       // Executions (JIT threshold)
+        void           *code;       // Translated host code
+        t_riscv_inst    inst[BLOCK_MAX_INSTS + 1]; // RV_OP_ILLEGAL terminated
+    } t_block;
+
+    uint32_t            block_mode(void);
+    t_block *           block_find(void);
+    bool                block_build(t_block *block, uint32_t phy_pc, uint32_t mode);
+    t_block *           block_next(t_block *block, int succ, uint32_t entry_pc);
+    int                 block_execute(t_block *block, int *succ);
+    // Timer (mtime derived from the cycle count)
+    uint64_t            time_now(void) { return m_time_base + (m_cycle_now - m_time_cycle) / m_timebase_div; }
+    void                time_set(uint64_t value);
+    void                timer_rearm(void);
+    void                timer_expired(void);
+
+    // Sleep (WFI / idle loop) until an enabled interrupt is pending
+    void                wfi_sleep(void) { if (!(m_csr_mip & m_csr_mie)) m_wfi = true; }
+    uint64_t            wfi_idle(uint64_t cycles, uint64_t end);
+    void                decode_page_mark(uint32_t addr);
+    void                decode_nohost_mark(uint32_t addr);
+
+// Dynamic translation (x86-64 hosts, machine mode blocks)
+private:
+    static const uint32_t JIT_THRESHOLD   = 64;
+    static const int    JIT_CACHE_SIZE  = (8 << 20);
+    static const int    JIT_BLOCK_MAX   = (16 << 10);
+    static const int    JIT_TLB_ENTRIES = 256;
+
+    // Physical page -> host pointer (tag 0xFFF = invalid)
+    typedef struct
+    {
+        uint32_t        tag;
+        uint32_t        pad;
+        uint64_t        addend;
+    } t_jit_tlb;
+
+    // Memory access record (lockstep checking)
+    typedef struct
+    {
+        uint32_t        addr;
+        uint32_t        data;
+        uint8_t         width;
+        bool            store;
+        bool            fault;
+    } t_jit_access;
+
+    bool                jit_compile(t_block *block);
+    int                 jit_execute(t_block *block, int *succ);
+    int                 jit_check(t_block *block, int *succ);
+    void                jit_flush(void);
+    void                jit_release(void);
+    bool                jit_protect(bool exec);
+    void                jit_tlb_flush(void);
+    void                jit_record(uint32_t addr, uint32_t data, int width, bool store, bool fault);
+    t_jit_access *      jit_replay(uint32_t addr, int width, bool store);
+
+    static uint64_t     jit_load(rv32 *cpu, uint32_t pc, uint32_t addr, uint32_t type);
+    static uint32_t     jit_store(rv32 *cpu, uint32_t pc, uint32_t addr, uint32_t data, uint32_t width);
+    static uint32_t     jit_divide(uint32_t op, uint32_t a, uint32_t b);
+
 private:
 
     // CPU Registers
@@ -82,6 +208,7 @@ private:
     uint32_t            m_pc;
     uint32_t            m_pc_x;
     uint32_t            m_load_res;
+    uint32_t            m_load_val;
 
     // CSR - Machine
     uint32_t            m_csr_mepc;
@@ -92,13 +219,17 @@ private:
     uint32_t            m_csr_mtval;
     uint32_t            m_csr_mie;
     uint32_t            m_csr_mip;
-    uint64_t            m_csr_mtime;
     uint32_t            m_csr_mtimecmp;
-    bool                m_csr_mtime_ie;
+    bool                m_csr_mtime_ie; // mtimecmp armed
     uint32_t            m_csr_mscratch;
     uint32_t            m_csr_mideleg;
     uint32_t            m_csr_medeleg;
 
+    // Timer
+    uint64_t            m_cycle_now;    // Cycle of the current instruction / block
+    uint64_t            m_time_cycle;   // Cycle m_time_base was written
+    uint64_t            m_time_base;
+
     // CSR - Supervisor
     uint32_t            m_csr_sepc;
     uint32_t            m_csr_sevec;
@@ -107,10 +238,39 @@ private:
     uint32_t            m_csr_satp;
     uint32_t            m_csr_sscratch;
 
-    // TLB cache
-    static const int MMU_TLB_ENTRIES = 64;
-    uint32_t            m_mmu_addr[MMU_TLB_ENTRIES];
-    uint32_t            m_mmu_pte[MMU_TLB_ENTRIES];
+    // TLBs (ASID tagged, not flushed on SATP writes)
+    riscv_tlb           m_itlb;
+    riscv_tlb           m_dtlb;
+
+    // Decoded instruction cache (direct mapped on physical PC)
+    static const int    DECODE_ENTRIES = 8192;
+    static const int    DECODE_PGSHIFT = 12;
+    std::vector<t_decoded> m_decode;
+    std::vector<uint32_t>  m_decode_pages; // Pages holding cached entries
+    std::vector<uint32_t>  m_nohost_pages; // Pages without a host pointer (never cached)
+
+    // Basic blocks (direct mapped on physical PC)
+    std::vector<t_block>   m_blocks;
+    uint32_t            m_block_epoch;
+    uint32_t            m_nohost_vpage; // Last block_find() on a nohost page (by
+    uint32_t            m_nohost_priv;  // virtual page, mode and block epoch)
+    uint32_t            m_nohost_epoch;
+    int                 m_block_counted; // Instructions of the running block already in m_stats
+    uint32_t            m_run_stop_pc;  // Blocks end here (run)
+    bool                m_wfi;          // Hart asleep
+
+    // Dynamic translation
+    int                 m_jit_mode;
+    uint8_t            *m_jit_cache;
+    uint32_t            m_jit_used;
+    uint32_t            m_jit_blocks;
+    bool                m_jit_exec;     // Cache mapped RX (else RW)
+    t_jit_tlb           m_jit_tlb[2][JIT_TLB_ENTRIES]; // Read, write
+    bool                m_jit_record;
+    bool                m_jit_replay;
+    bool                m_jit_mismatch;
+    uint32_t            m_jit_log_pos;
+    std::vector<t_jit_access> m_jit_log;
 
     // Settings
     bool                m_enable_unaligned;
@@ -132,6 +292,10 @@ private:
         STATS_BRANCHES,
         STATS_MUL,
         STATS_DIV,
+        STATS_ITLB_HIT,
+        STATS_ITLB_MISS,
+        STATS_DTLB_HIT,
+        STATS_DTLB_MISS,
         STATS_MAX
     };
     uint32_t            m_stats[STATS_MAX];
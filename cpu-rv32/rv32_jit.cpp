@@ -0,0 +1,802 @@
+//-----------------------------------------------------------------
+//                        ExactStep IAISS
+//                             V0.5
+//               github.com/ultraembedded/exactstep
+//                     Copyright 2014-2019
+//                    License: BSD 3-Clause
+//-----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include "rv32.h"
+#include "rv32_isa.h"
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+//-----------------------------------------------------------------
+// Dynamic translation of hot machine mode basic blocks to x86-64.
+//
+// Translated code keeps the architectural state in the rv32 object
+// (rbx = this, rbp = &m_gpr[0]) and returns (count << 2) | (succ + 1)
+// with the same exit semantics as block_execute().
+// Loads and stores to directly backed RAM hit an inline physical page
+// TLB, everything else (devices, faults, pages holding cached code)
+// goes through jit_load() / jit_store().
+// The log_* monitor hooks are not called from translated code.
+// The code cache is never writable and executable at the same time,
+// it is switched between RW (translating) and RX (running).
+//-----------------------------------------------------------------
+
+//-----------------------------------------------------------------
+// jit_tlb_flush: Invalidate the translated code's page TLB
+//-----------------------------------------------------------------
+void rv32::jit_tlb_flush(void)
+{
+    for (int t=0;t<2;t++)
+        for (int i=0;i<JIT_TLB_ENTRIES;i++)
+        {
+            m_jit_tlb[t][i].tag    = 0xFFF;
+            m_jit_tlb[t][i].addend = 0;
+        }
+}
+//-----------------------------------------------------------------
+// jit_flush: Drop all translations
+//-----------------------------------------------------------------
+void rv32::jit_flush(void)
+{
+    for (int i=0;i<BLOCK_ENTRIES;i++)
+    {
+        m_blocks[i].code = NULL;
+        m_blocks[i].hits = 0;
+    }
+
+    m_jit_used = 0;
+}
+//-----------------------------------------------------------------
+// jit_record: Log a memory access made by the interpreter (lockstep)
+//-----------------------------------------------------------------
+void rv32::jit_record(uint32_t addr, uint32_t data, int width, bool store, bool fault)
+{
+    t_jit_access a;
+    a.addr  = addr;
+    a.data  = data;
+    a.width = width;
+    a.store = store;
+    a.fault = fault;
+    m_jit_log.push_back(a);
+}
+//-----------------------------------------------------------------
+// jit_replay: Consume the next logged access (NULL on divergence)
+//-----------------------------------------------------------------
+rv32::t_jit_access *rv32::jit_replay(uint32_t addr, int width, bool store)
+{
+    if (m_jit_log_pos >= m_jit_log.size())
+    {
+        m_jit_mismatch = true;
+        return NULL;
+    }
+
+    t_jit_access *a = &m_jit_log[m_jit_log_pos++];
+    if (!a->fault && (a->addr != addr || a->width != width || a->store != store))
+    {
+        m_jit_mismatch = true;
+        return NULL;
+    }
+
+    return a;
+}
+//-----------------------------------------------------------------
+// jit_load: Load helper for translated code.
+// type = width | (signed ? 8 : 0), returns value or (1 << 32) on fault.
+//-----------------------------------------------------------------
+uint64_t rv32::jit_load(rv32 *cpu, uint32_t pc, uint32_t addr, uint32_t type)
+{
+    int      width = type & 7;
+    uint32_t value = 0;
+
+    if (cpu->m_jit_replay)
+    {
+        t_jit_access *a = cpu->jit_replay(addr, width, false);
+        if (!a || a->fault)
+            return 1ULL << 32;
+        return a->data;
+    }
+
+    cpu->m_pc = pc;
+    if (!cpu->load(pc, addr, &value, width, (type & 8) != 0))
+        return 1ULL << 32;
+
+    // Directly backed page - fill the inline TLB
+    uint8_t *host = cpu->get_host_ptr(addr);
+    if (host && cpu->m_jit_mode == JIT_ON)
+    {
+        t_jit_tlb *e = &cpu->m_jit_tlb[0][(addr >> 12) & (JIT_TLB_ENTRIES-1)];
+        e->tag    = addr & ~0xFFF;
+        e->addend = (uint64_t)(uintptr_t)host - addr;
+    }
+
+    return value;
+}
+//-----------------------------------------------------------------
+// jit_store: Store helper for translated code, returns 1 on fault
+//-----------------------------------------------------------------
+uint32_t rv32::jit_store(rv32 *cpu, uint32_t pc, uint32_t addr, uint32_t data, uint32_t width)
+{
+    if (cpu->m_jit_replay)
+    {
+        t_jit_access *a = cpu->jit_replay(addr, width, true);
+        if (!a || a->fault)
+            return 1;
+        if (a->data != data)
+            cpu->m_jit_mismatch = true;
+        return 0;
+    }
+
+    cpu->m_pc = pc;
+    if (!cpu->store(pc, addr, data, width))
+        return 1;
+
+    // Directly backed page without cached code - fill the inline TLB
+    uint8_t *host = cpu->get_host_ptr(addr);
+    if (host && cpu->m_jit_mode == JIT_ON && !cpu->decode_page_cached(addr))
+    {
+        t_jit_tlb *e = &cpu->m_jit_tlb[1][(addr >> 12) & (JIT_TLB_ENTRIES-1)];
+        e->tag    = addr & ~0xFFF;
+        e->addend = (uint64_t)(uintptr_t)host - addr;
+    }
+
+    return 0;
+}
+//-----------------------------------------------------------------
+// jit_divide: DIV / DIVU / REM / REMU helper for translated code
+//-----------------------------------------------------------------
+uint32_t rv32::jit_divide(uint32_t op, uint32_t a, uint32_t b)
+{
+    switch (op)
+    {
+        case RV_OP_DIV:
+            if ((int32_t)a == INT32_MIN && (int32_t)b == -1)
+                return a;
+            return b ? (uint32_t)((int32_t)a / (int32_t)b) : (uint32_t)-1;
+        case RV_OP_DIVU:
+            return b ? a / b : (uint32_t)-1;
+        case RV_OP_REM:
+            if ((int32_t)a == INT32_MIN && (int32_t)b == -1)
+                return 0;
+            return b ? (uint32_t)((int32_t)a % (int32_t)b) : a;
+        default:
+            return b ? a % b : a;
+    }
+}
+
+#if defined(__x86_64__)
+
+typedef uint32_t (*t_jit_fn)(rv32 *cpu);
+
+//-----------------------------------------------------------------
+// jit_emitter: Minimal x86-64 code emitter
+//-----------------------------------------------------------------
+class jit_emitter
+{
+public:
+    enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8 };
+    enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD };
+
+    // ALU / shift extension codes (0x81 / 0xC1 / 0xD3 groups)
+    enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+    enum { SH_SHL = 4, SH_SHR = 5, SH_SAR = 7 };
+
+    jit_emitter(uint8_t *buf): m_buf(buf), m_pos(0) { }
+
+    uint32_t pos(void) { return m_pos; }
+
+    void     u8(uint8_t v)   { m_buf[m_pos++] = v; }
+    void     u32(uint32_t v) { memcpy(&m_buf[m_pos], &v, 4); m_pos += 4; }
+    void     u64(uint64_t v) { memcpy(&m_buf[m_pos], &v, 8); m_pos += 8; }
+
+    void     rex(bool w, int reg, int base)
+    {
+        uint8_t r = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0);
+        if (r != 0x40)
+            u8(r);
+    }
+
+    // op reg, rm (register operands)
+    void     op_rr(uint8_t op, int reg, int rm, bool w = false)
+    {
+        rex(w, reg, rm);
+        u8(op);
+        u8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    // op reg, [base + disp32] (base != RSP)
+    void     op_rm(uint8_t op, int reg, int base, int32_t disp, bool w = false)
+    {
+        rex(w, reg, base);
+        u8(op);
+        u8(0x80 | ((reg & 7) << 3) | (base & 7));
+        u32(disp);
+    }
+
+    // op reg, [base + index + disp32]
+    void     op_rmi(uint8_t op, int reg, int base, int index, int32_t disp, bool w = false)
+    {
+        rex(w, reg, base);
+        u8(op);
+        u8(0x84 | ((reg & 7) << 3));
+        u8(((index & 7) << 3) | (base & 7));
+        u32(disp);
+    }
+
+    void     alu_ri(int ext, int rm, uint32_t imm) { op_rr(0x81, ext, rm); u32(imm); }
+    void     shift_ri(int ext, int rm, uint8_t imm, bool w = false) { op_rr(0xC1, ext, rm, w); u8(imm); }
+    void     shift_cl(int ext, int rm) { op_rr(0xD3, ext, rm); }
+    void     mov_rr(int dst, int src, bool w = false) { op_rr(0x89, src, dst, w); }
+    void     mov_ri(int reg, uint32_t imm) { rex(false, 0, reg); u8(0xB8 + (reg & 7)); u32(imm); }
+    void     mov_ri64(int reg, uint64_t imm) { rex(true, 0, reg); u8(0xB8 + (reg & 7)); u64(imm); }
+    void     mov_mi(int base, int32_t disp, uint32_t imm) { op_rm(0xC7, 0, base, disp); u32(imm); }
+    void     inc_m(int base, int32_t disp) { op_rm(0xFF, 0, base, disp); }
+    void     imul_rr(int reg, int rm, bool w = false) { rex(w, reg, rm); u8(0x0F); u8(0xAF); u8(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+
+    // setcc al; movzx eax, al
+    void     setcc_eax(int cc) { u8(0x0F); u8(0x90 + cc); u8(0xC0); u8(0x0F); u8(0xB6); u8(0xC0); }
+
+    void     call(const void *fn) { mov_ri64(RAX, (uint64_t)(uintptr_t)fn); u8(0xFF); u8(0xD0); }
+
+    // Branches (rel32), return the location to patch
+    uint32_t jcc(int cc) { u8(0x0F); u8(0x80 + cc); u32(0); return m_pos - 4; }
+    uint32_t jmp(void)   { u8(0xE9); u32(0); return m_pos - 4; }
+    void     bind(uint32_t at) { int32_t rel = m_pos - (at + 4); memcpy(&m_buf[at], &rel, 4); }
+
+private:
+    uint8_t *m_buf;
+    uint32_t m_pos;
+};
+
+//-----------------------------------------------------------------
+// jit_supported: Operation has a translation
+//-----------------------------------------------------------------
+static bool jit_supported(int op)
+{
+    return (op >= RV_OP_LUI  && op <= RV_OP_LHU) ||
+           (op >= RV_OP_SB   && op <= RV_OP_SW)  ||
+           (op >= RV_OP_ADDI && op <= RV_OP_AND) ||
+           (op >= RV_OP_MUL  && op <= RV_OP_REMU) ||
+           op == RV_OP_FENCE;
+}
+//-----------------------------------------------------------------
+// enable_jit: Enable / disable dynamic translation
+//-----------------------------------------------------------------
+bool rv32::enable_jit(int mode)
+{
+    if (mode != JIT_OFF && !m_jit_cache)
+    {
+        void *p = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return false;
+
+        m_jit_cache = (uint8_t *)p;
+        m_jit_exec  = false;
+    }
+
+    // Lockstep mode translates without inline memory fast paths
+    m_jit_mode = mode;
+    jit_flush();
+    jit_tlb_flush();
+    return true;
+}
+//-----------------------------------------------------------------
+// jit_release: Free the translation cache
+//-----------------------------------------------------------------
+void rv32::jit_release(void)
+{
+    if (m_jit_cache)
+        munmap(m_jit_cache, JIT_CACHE_SIZE);
+    m_jit_cache = NULL;
+}
+//-----------------------------------------------------------------
+// jit_protect: Switch the code cache between RX (exec) and RW
+//-----------------------------------------------------------------
+bool rv32::jit_protect(bool exec)
+{
+    if (m_jit_exec == exec)
+        return true;
+
+    int prot = exec ? (PROT_READ | PROT_EXEC) : (PROT_READ | PROT_WRITE);
+    if (mprotect(m_jit_cache, JIT_CACHE_SIZE, prot) != 0)
+        return false;
+
+    m_jit_exec = exec;
+    return true;
+}
+//-----------------------------------------------------------------
+// jit_compile: Translate a machine mode block to host code.
+// Blocks are split ahead of the first operation without a
+// translation (system, CSR, atomics), the remainder is interpreted.
+//-----------------------------------------------------------------
+bool rv32::jit_compile(t_block *block)
+{
+    typedef jit_emitter E;
+
+    int n = 0;
+    while (n < block->count && jit_supported(block->inst[n].op))
+        n++;
+
+    if (n == 0 || !jit_protect(false))
+        return false;
+
+    if (n < block->count)
+    {
+        block->inst[n].op = RV_OP_ILLEGAL;
+        block->count      = n;
+    }
+
+    if (m_jit_used + JIT_BLOCK_MAX > (uint32_t)JIT_CACHE_SIZE)
+        jit_flush();
+
+    uint8_t    *code = m_jit_cache + m_jit_used;
+    jit_emitter e(code);
+
+    const int32_t off_gpr   = (int32_t)((uint8_t *)&m_gpr[0] - (uint8_t *)this);
+    const int32_t off_pc    = (int32_t)((uint8_t *)&m_pc - (uint8_t *)this);
+    const int32_t off_pc_x  = (int32_t)((uint8_t *)&m_pc_x - (uint8_t *)this);
+    const int32_t off_stats = (int32_t)((uint8_t *)&m_stats[0] - (uint8_t *)this);
+    const int32_t off_tlb_r = (int32_t)((uint8_t *)&m_jit_tlb[0][0] - (uint8_t *)this);
+    const int32_t off_tlb_w = (int32_t)((uint8_t *)&m_jit_tlb[1][0] - (uint8_t *)this);
+    const bool    fast      = (m_jit_mode == JIT_ON);
+
+#define GPR(r)          ((int32_t)((r) * sizeof(uint32_t)))
+#define STAT(s)         (off_stats + (int32_t)((s) * sizeof(uint32_t)))
+#define LOAD_GPR(x, r)  do { if (r) e.op_rm(0x8B, x, E::RBP, GPR(r)); else e.op_rr(0x31, x, x); } while (0)
+#define STORE_GPR(r, x) do { if (r) e.op_rm(0x89, x, E::RBP, GPR(r)); } while (0)
+
+    // Out of line exits (fault, store to this block)
+    typedef struct
+    {
+        uint32_t patch;
+        uint32_t pc_x;
+        uint32_t pc;
+        bool     set_pc;
+        uint32_t ret;
+    } t_stub;
+    std::vector<t_stub>   stubs;
+    std::vector<uint32_t> exits;
+
+#define EXIT(x, set, npc, r) do { e.mov_mi(E::RBX, off_pc_x, x); \
+                                  if (set) e.mov_mi(E::RBX, off_pc, npc); \
+                                  e.mov_ri(E::RAX, r); exits.push_back(e.jmp()); } while (0)
+#define STUB(at, x, set, npc, r) do { t_stub s = { at, x, npc, set, r }; stubs.push_back(s); } while (0)
+
+    // Prologue: rbx = this, rbp = &m_gpr[0]
+    e.u8(0x53);                                 // push rbx
+    e.u8(0x55);                                 // push rbp
+    e.u8(0x48); e.u8(0x83); e.u8(0xEC); e.u8(8);// sub rsp, 8
+    e.mov_rr(E::RBX, E::RDI, true);
+    e.op_rm(0x8D, E::RBP, E::RBX, off_gpr, true);
+
+    uint32_t pc = block->pc;
+    bool     ended = false;
+
+    for (int i=0;i<n && !ended;i++)
+    {
+        const t_riscv_inst *inst = &block->inst[i];
+        uint32_t ret  = (uint32_t)(i + 1) << 2;
+        int      rd   = inst->rd;
+
+        switch (inst->op)
+        {
+            case RV_OP_LUI:
+                if (rd) e.mov_mi(E::RBP, GPR(rd), inst->imm);
+                break;
+            case RV_OP_AUIPC:
+                if (rd) e.mov_mi(E::RBP, GPR(rd), pc + inst->imm);
+                break;
+            case RV_OP_FENCE:
+                if (rd) e.mov_mi(E::RBP, GPR(rd), 0);
+                break;
+
+            case RV_OP_ADDI: case RV_OP_XORI: case RV_OP_ORI: case RV_OP_ANDI:
+            case RV_OP_SLTI: case RV_OP_SLTIU:
+            case RV_OP_SLLI: case RV_OP_SRLI: case RV_OP_SRAI:
+            {
+                if (!rd)
+                    break;
+
+                LOAD_GPR(E::RAX, inst->rs1);
+                switch (inst->op)
+                {
+                    case RV_OP_ADDI:  if (inst->imm) e.alu_ri(E::ALU_ADD, E::RAX, inst->imm); break;
+                    case RV_OP_XORI:  e.alu_ri(E::ALU_XOR, E::RAX, inst->imm); break;
+                    case RV_OP_ORI:   e.alu_ri(E::ALU_OR,  E::RAX, inst->imm); break;
+                    case RV_OP_ANDI:  e.alu_ri(E::ALU_AND, E::RAX, inst->imm); break;
+                    case RV_OP_SLTI:  e.alu_ri(E::ALU_CMP, E::RAX, inst->imm); e.setcc_eax(E::CC_L); break;
+                    case RV_OP_SLTIU: e.alu_ri(E::ALU_CMP, E::RAX, inst->imm); e.setcc_eax(E::CC_B); break;
+                    case RV_OP_SLLI:  e.shift_ri(E::SH_SHL, E::RAX, inst->imm & 31); break;
+                    case RV_OP_SRLI:  e.shift_ri(E::SH_SHR, E::RAX, inst->imm & 31); break;
+                    default:          e.shift_ri(E::SH_SAR, E::RAX, inst->imm & 31); break;
+                }
+                STORE_GPR(rd, E::RAX);
+            }
+            break;
+
+            case RV_OP_ADD: case RV_OP_SUB: case RV_OP_XOR: case RV_OP_OR: case RV_OP_AND:
+            case RV_OP_SLT: case RV_OP_SLTU:
+            case RV_OP_SLL: case RV_OP_SRL: case RV_OP_SRA:
+            {
+                if (!rd)
+                    break;
+
+                LOAD_GPR(E::RAX, inst->rs1);
+                LOAD_GPR(E::RCX, inst->rs2);
+                switch (inst->op)
+                {
+                    case RV_OP_ADD:  e.op_rr(0x03, E::RAX, E::RCX); break;
+                    case RV_OP_SUB:  e.op_rr(0x2B, E::RAX, E::RCX); break;
+                    case RV_OP_XOR:  e.op_rr(0x33, E::RAX, E::RCX); break;
+                    case RV_OP_OR:   e.op_rr(0x0B, E::RAX, E::RCX); break;
+                    case RV_OP_AND:  e.op_rr(0x23, E::RAX, E::RCX); break;
+                    case RV_OP_SLT:  e.op_rr(0x3B, E::RAX, E::RCX); e.setcc_eax(E::CC_L); break;
+                    case RV_OP_SLTU: e.op_rr(0x3B, E::RAX, E::RCX); e.setcc_eax(E::CC_B); break;
+                    case RV_OP_SLL:  e.shift_cl(E::SH_SHL, E::RAX); break;
+                    case RV_OP_SRL:  e.shift_cl(E::SH_SHR, E::RAX); break;
+                    default:         e.shift_cl(E::SH_SAR, E::RAX); break;
+                }
+                STORE_GPR(rd, E::RAX);
+            }
+            break;
+
+            case RV_OP_MUL: case RV_OP_MULH: case RV_OP_MULHSU: case RV_OP_MULHU:
+            {
+                e.inc_m(E::RBX, STAT(STATS_MUL));
+                if (!rd)
+                    break;
+
+                // Sign / zero extend the operands to 64-bits
+                if (inst->op == RV_OP_MUL || inst->op == RV_OP_MULHU)
+                    LOAD_GPR(E::RAX, inst->rs1);
+                else if (inst->rs1)
+                    e.op_rm(0x63, E::RAX, E::RBP, GPR(inst->rs1), true);
+                else
+                    e.op_rr(0x31, E::RAX, E::RAX);
+
+                if (inst->op == RV_OP_MULH && inst->rs2)
+                    e.op_rm(0x63, E::RCX, E::RBP, GPR(inst->rs2), true);
+                else
+                    LOAD_GPR(E::RCX, inst->rs2);
+
+                if (inst->op == RV_OP_MUL)
+                    e.imul_rr(E::RAX, E::RCX);
+                else
+                {
+                    e.imul_rr(E::RAX, E::RCX, true);
+                    e.shift_ri(inst->op == RV_OP_MULHU ? E::SH_SHR : E::SH_SAR, E::RAX, 32, true);
+                }
+                STORE_GPR(rd, E::RAX);
+            }
+            break;
+
+            case RV_OP_DIV: case RV_OP_DIVU: case RV_OP_REM: case RV_OP_REMU:
+                e.inc_m(E::RBX, STAT(STATS_DIV));
+                if (!rd)
+                    break;
+
+                e.mov_ri(E::RDI, inst->op);
+                LOAD_GPR(E::RSI, inst->rs1);
+                LOAD_GPR(E::RDX, inst->rs2);
+                e.call((const void *)&rv32::jit_divide);
+                STORE_GPR(rd, E::RAX);
+                break;
+
+            case RV_OP_LB: case RV_OP_LH: case RV_OP_LW: case RV_OP_LBU: case RV_OP_LHU:
+            {
+                int  width = (inst->op == RV_OP_LW) ? 4 : (inst->op == RV_OP_LH || inst->op == RV_OP_LHU) ? 2 : 1;
+                bool sign  = (inst->op == RV_OP_LB || inst->op == RV_OP_LH);
+                uint32_t done = 0;
+
+                LOAD_GPR(E::RAX, inst->rs1);
+                if (inst->imm)
+                    e.alu_ri(E::ALU_ADD, E::RAX, inst->imm);
+
+                if (fast)
+                {
+                    // esi = TLB entry offset, edx = tag (misaligned never matches)
+                    e.mov_rr(E::RSI, E::RAX);
+                    e.shift_ri(E::SH_SHR, E::RSI, 12);
+                    e.alu_ri(E::ALU_AND, E::RSI, JIT_TLB_ENTRIES - 1);
+                    e.shift_ri(E::SH_SHL, E::RSI, 4);
+                    e.mov_rr(E::RDX, E::RAX);
+                    e.alu_ri(E::ALU_AND, E::RDX, ~0xFFFu | (width - 1));
+                    e.op_rmi(0x3B, E::RDX, E::RBX, E::RSI, off_tlb_r);
+                    uint32_t miss = e.jcc(E::CC_NE);
+                    e.op_rmi(0x8B, E::RDX, E::RBX, E::RSI, off_tlb_r + 8, true);
+
+                    // eax = [rdx + rax]
+                    if (width == 4)
+                        e.u8(0x8B);
+                    else
+                    {
+                        e.u8(0x0F);
+                        e.u8(width == 2 ? (sign ? 0xBF : 0xB7) : (sign ? 0xBE : 0xB6));
+                    }
+                    e.u8(0x04); e.u8(0x02);
+                    e.inc_m(E::RBX, STAT(STATS_LOADS));
+                    done = e.jmp();
+                    e.bind(miss);
+                }
+
+                e.mov_rr(E::RDX, E::RAX);
+                e.mov_rr(E::RDI, E::RBX, true);
+                e.mov_ri(E::RSI, pc);
+                e.mov_ri(E::RCX, width | (sign ? 8 : 0));
+                e.call((const void *)&rv32::jit_load);
+                e.u8(0x48); e.u8(0x0F); e.u8(0xBA); e.u8(0xE0); e.u8(32); // bt rax, 32
+                STUB(e.jcc(E::CC_B), pc, false, 0, ret);
+
+                if (fast)
+                    e.bind(done);
+                STORE_GPR(rd, E::RAX);
+            }
+            break;
+
+            case RV_OP_SB: case RV_OP_SH: case RV_OP_SW:
+            {
+                int width = (inst->op == RV_OP_SW) ? 4 : (inst->op == RV_OP_SH) ? 2 : 1;
+                uint32_t done = 0;
+
+                LOAD_GPR(E::RAX, inst->rs1);
+                if (inst->imm)
+                    e.alu_ri(E::ALU_ADD, E::RAX, inst->imm);
+
+                if (fast)
+                {
+                    // Pages holding cached code are never in the write TLB
+                    e.mov_rr(E::RSI, E::RAX);
+                    e.shift_ri(E::SH_SHR, E::RSI, 12);
+                    e.alu_ri(E::ALU_AND, E::RSI, JIT_TLB_ENTRIES - 1);
+                    e.shift_ri(E::SH_SHL, E::RSI, 4);
+                    e.mov_rr(E::RDX, E::RAX);
+                    e.alu_ri(E::ALU_AND, E::RDX, ~0xFFFu | (width - 1));
+                    e.op_rmi(0x3B, E::RDX, E::RBX, E::RSI, off_tlb_w);
+                    uint32_t miss = e.jcc(E::CC_NE);
+                    e.op_rmi(0x8B, E::RDX, E::RBX, E::RSI, off_tlb_w + 8, true);
+                    LOAD_GPR(E::RCX, inst->rs2);
+
+                    // [rdx + rax] = ecx
+                    if (width == 2)
+                        e.u8(0x66);
+                    e.u8(width == 1 ? 0x88 : 0x89);
+                    e.u8(0x0C); e.u8(0x02);
+                    e.inc_m(E::RBX, STAT(STATS_STORES));
+                    done = e.jmp();
+                    e.bind(miss);
+                }
+
+                e.mov_rr(E::RDX, E::RAX);
+                LOAD_GPR(E::RCX, inst->rs2);
+                e.mov_rr(E::RDI, E::RBX, true);
+                e.mov_ri(E::RSI, pc);
+                e.mov_ri(E::R8, width);
+                e.call((const void *)&rv32::jit_store);
+                e.op_rr(0x85, E::RAX, E::RAX);
+                STUB(e.jcc(E::CC_NE), pc, false, 0, ret);
+
+                // Store hit this block
+                e.mov_ri64(E::RAX, (uint64_t)(uintptr_t)&block->pc);
+                e.u8(0x81); e.u8(0x38); e.u32(block->pc); // cmp dword [rax], tag
+                STUB(e.jcc(E::CC_NE), pc, true, pc + inst->size, ret);
+
+                if (fast)
+                    e.bind(done);
+            }
+            break;
+
+            case RV_OP_BEQ: case RV_OP_BNE: case RV_OP_BLT:
+            case RV_OP_BGE: case RV_OP_BLTU: case RV_OP_BGEU:
+            {
+                int cc;
+                switch (inst->op)
+                {
+                    case RV_OP_BEQ:  cc = E::CC_E;  break;
+                    case RV_OP_BNE:  cc = E::CC_NE; break;
+                    case RV_OP_BLT:  cc = E::CC_L;  break;
+                    case RV_OP_BGE:  cc = E::CC_GE; break;
+                    case RV_OP_BLTU: cc = E::CC_B;  break;
+                    default:         cc = E::CC_AE; break;
+                }
+
+                LOAD_GPR(E::RAX, inst->rs1);
+                LOAD_GPR(E::RCX, inst->rs2);
+                e.op_rr(0x3B, E::RAX, E::RCX);
+                uint32_t taken = e.jcc(cc);
+
+                if (inst->size == 4)
+                    e.inc_m(E::RBX, STAT(STATS_BRANCHES));
+                EXIT(pc, true, pc + inst->size, ret | 1);
+
+                e.bind(taken);
+                if (inst->size == 4)
+                    e.inc_m(E::RBX, STAT(STATS_BRANCHES));
+                EXIT(pc, true, pc + inst->imm, ret | 2);
+                ended = true;
+            }
+            break;
+
+            case RV_OP_JAL:
+                if (rd) e.mov_mi(E::RBP, GPR(rd), pc + inst->size);
+                if (inst->size == 4)
+                    e.inc_m(E::RBX, STAT(STATS_BRANCHES));
+                EXIT(pc, true, pc + inst->imm, ret | 2);
+                ended = true;
+                break;
+
+            case RV_OP_JALR:
+                LOAD_GPR(E::RAX, inst->rs1);
+                if (inst->imm)
+                    e.alu_ri(E::ALU_ADD, E::RAX, inst->imm);
+                e.alu_ri(E::ALU_AND, E::RAX, ~1u);
+                e.op_rm(0x89, E::RAX, E::RBX, off_pc);
+                if (rd) e.mov_mi(E::RBP, GPR(rd), pc + inst->size);
+                if (inst->size == 4)
+                    e.inc_m(E::RBX, STAT(STATS_BRANCHES));
+                EXIT(pc, false, 0, ret | 2);
+                ended = true;
+                break;
+
+            default:
+                assert(!"Unsupported");
+                break;
+        }
+
+        if (!ended)
+            pc += inst->size;
+    }
+
+    // Fall-through to the next sequential block
+    if (!ended)
+        EXIT(pc - block->inst[n-1].size, true, pc, ((uint32_t)n << 2) | 1);
+
+    for (size_t i=0;i<stubs.size();i++)
+    {
+        e.bind(stubs[i].patch);
+        EXIT(stubs[i].pc_x, stubs[i].set_pc, stubs[i].pc, stubs[i].ret);
+    }
+
+    // Epilogue
+    for (size_t i=0;i<exits.size();i++)
+        e.bind(exits[i]);
+    e.u8(0x48); e.u8(0x83); e.u8(0xC4); e.u8(8);// add rsp, 8
+    e.u8(0x5D);                                 // pop rbp
+    e.u8(0x5B);                                 // pop rbx
+    e.u8(0xC3);                                 // ret
+
+#undef GPR
+#undef STAT
+#undef LOAD_GPR
+#undef STORE_GPR
+#undef EXIT
+#undef STUB
+
+    assert(e.pos() <= (uint32_t)JIT_BLOCK_MAX);
+    block->code = code;
+    m_jit_used += (e.pos() + 15) & ~15;
+    m_jit_blocks++;
+    return true;
+}
+//-----------------------------------------------------------------
+// jit_execute: Run a translated block (same contract as block_execute)
+//-----------------------------------------------------------------
+int rv32::jit_execute(t_block *block, int *succ)
+{
+    if (!jit_protect(true))
+        return block_execute(block, succ);
+
+    if (m_jit_mode == JIT_CHECK)
+        return jit_check(block, succ);
+
+    uint32_t ret = ((t_jit_fn)block->code)(this);
+    *succ = (int)(ret & 3) - 1;
+    return ret >> 2;
+}
+//-----------------------------------------------------------------
+// jit_check: Run a block through the interpreter and then replay it
+// through the translation from the same entry state, comparing the
+// results (registers, PC, exit, memory accesses).
+//-----------------------------------------------------------------
+int rv32::jit_check(t_block *block, int *succ)
+{
+    uint32_t tag = block->pc;
+    uint32_t gpr[REGISTERS];
+    uint32_t stats[STATS_MAX];
+    uint32_t pc  = m_pc;
+
+    memcpy(gpr, m_gpr, sizeof(gpr));
+    memcpy(stats, m_stats, sizeof(stats));
+
+    // Reference: interpreter, logging memory accesses
+    m_jit_log.clear();
+    m_jit_record = true;
+    int count = block_execute(block, succ);
+    m_jit_record = false;
+
+    // Block modified itself
+    if (block->pc != tag || !block->code)
+        return count;
+
+    uint32_t ref_gpr[REGISTERS];
+    uint32_t ref_stats[STATS_MAX];
+    uint32_t ref_pc   = m_pc;
+    uint32_t ref_pc_x = m_pc_x;
+    bool     faulted  = !m_jit_log.empty() && m_jit_log.back().fault;
+
+    memcpy(ref_gpr, m_gpr, sizeof(ref_gpr));
+    memcpy(ref_stats, m_stats, sizeof(ref_stats));
+
+    // Translation: replay the same accesses from the entry state
+    memcpy(m_gpr, gpr, sizeof(gpr));
+    memcpy(m_stats, stats, sizeof(stats));
+    m_pc           = pc;
+    m_jit_log_pos  = 0;
+    m_jit_mismatch = false;
+    m_jit_replay   = true;
+    uint32_t ret   = ((t_jit_fn)block->code)(this);
+    m_jit_replay   = false;
+
+    bool ok = !m_jit_mismatch && m_jit_log_pos == m_jit_log.size();
+    ok &= (int)(ret >> 2) == count && ((int)(ret & 3) - 1) == *succ;
+    ok &= !memcmp(m_gpr, ref_gpr, sizeof(ref_gpr));
+    ok &= m_pc_x == ref_pc_x && (faulted || m_pc == ref_pc);
+
+    // Load / store counts are made by the helpers, not replayed
+    for (int i=STATS_MIN;i<STATS_MAX;i++)
+        if (i != STATS_LOADS && i != STATS_STORES)
+            ok &= m_stats[i] == ref_stats[i];
+
+    if (!ok)
+    {
+        error(false, "%08x: JIT mismatch (block %08x, %d/%d insts, exit %08x/%08x)\n",
+              pc, tag, ret >> 2, count, m_pc_x, ref_pc_x);
+        for (int i=0;i<REGISTERS;i++)
+            if (m_gpr[i] != ref_gpr[i])
+                error(false, "  x%d: %08x (expected %08x)\n", i, m_gpr[i], ref_gpr[i]);
+        m_fault = true;
+    }
+
+    // Interpreter state is authoritative
+    memcpy(m_gpr, ref_gpr, sizeof(ref_gpr));
+    memcpy(m_stats, ref_stats, sizeof(ref_stats));
+    m_pc   = ref_pc;
+    m_pc_x = ref_pc_x;
+    return count;
+}
+
+#else
+
+//-----------------------------------------------------------------
+// No translator for this host
+//-----------------------------------------------------------------
+bool rv32::enable_jit(int mode)
+{
+    return mode == JIT_OFF;
+}
+void rv32::jit_release(void)
+{
+}
+bool rv32::jit_compile(t_block *block)
+{
+    return false;
+}
+int rv32::jit_execute(t_block *block, int *succ)
+{
+    return block_execute(block, succ);
+}
+int rv32::jit_check(t_block *block, int *succ)
+{
+    return block_execute(block, succ);
+}
+
+#endif
@@ -26,6 +26,9 @@
 #define TRACE_ENABLED(l)    (m_trace & l)
 #define INST_STAT(l)
 
+// Odd PC - can never match a fetch address
+#define DECODE_INVALID      0xFFFFFFFF
+
 //-----------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------
@@ -38,6 +41,25 @@ rv64::rv64(uint32_t baseAddr /*= 0*/, uint32_t len /*= 0*/): cpu()
     m_enable_rvc         = true;
     m_enable_rva         = true;
     m_enable_mtimecmp    = false;
+    m_enable_sbi         = false;
+
+    m_decode.resize(DECODE_ENTRIES);
+    m_decode_pages.resize(((1ULL << 32) >> DECODE_PGSHIFT) / 32);
+    m_nohost_pages.resize(((1ULL << 32) >> DECODE_PGSHIFT) / 32);
+    m_blocks.resize(BLOCK_ENTRIES);
+    m_block_epoch = 0;
+    m_nohost_vpage = DECODE_INVALID;
+    m_nohost_priv  = 0;
+    m_nohost_epoch = 0;
+    m_block_counted = 0;
+    m_run_stop_pc = DECODE_INVALID;
+    m_wfi         = false;
+    m_cycle_now   = 0;
+    m_time_cycle  = 0;
+    m_time_base   = 0;
+
+    m_itlb.configure(MMU_LEVELS, MMU_PTIDXBITS);
+    m_dtlb.configure(MMU_LEVELS, MMU_PTIDXBITS);
 
     // Some memory defined
     if (len != 0)
@@ -52,9 +74,20 @@ void rv64::set_pc(uint64_t pc)
 {
     m_pc        = pc;
     m_pc_x      = pc;
+    m_wfi       = false;
 }
 void rv64::set_pc(uint32_t pc)  { set_pc((uint64_t)pc); }
 //-----------------------------------------------------------------
+// attach_memory: Attach memory (invalidates cached host translations)
+//-----------------------------------------------------------------
+bool rv64::attach_memory(memory_base *memory)
+{
+    bool ok = cpu::attach_memory(memory);
+    soft_tlb_flush();
+    decode_flush();
+    return ok;
+}
+//-----------------------------------------------------------------
 // set_register: Set register value
 //-----------------------------------------------------------------
 void rv64::set_register(int r, uint64_t val)
@@ -68,8 +101,8 @@ void rv64::set_register(int r, uint64_t val)
     else if (r == (RISCV_REGNO_CSR0 + CSR_MTVAL)) m_csr_mtval = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIE)) m_csr_mie = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIP)) m_csr_mip = val;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) m_csr_mtime = val;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIMECMP)) m_csr_mtimecmp = val; // Non-std
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) time_set(val);
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIMECMP)) { m_csr_mtimecmp = val; timer_rearm(); } // Non-std
     else if (r == (RISCV_REGNO_CSR0 + CSR_MSCRATCH)) m_csr_mscratch = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIDELEG)) m_csr_mideleg = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MEDELEG)) m_csr_medeleg = val;
@@ -80,6 +113,10 @@ void rv64::set_register(int r, uint64_t val)
     else if (r == (RISCV_REGNO_CSR0 + CSR_SATP)) m_csr_satp = val;
     else if (r == (RISCV_REGNO_CSR0 + CSR_SSCRATCH)) m_csr_sscratch = val;
     else if (r == RISCV_REGNO_PRIV) m_csr_mpriv = val;  
+
+    // Translation state may have changed
+    if (r == (RISCV_REGNO_CSR0 + CSR_SATP) || r == (RISCV_REGNO_CSR0 + CSR_MSTATUS))
+        mmu_flush();
 }
 void rv64::set_register(int r, uint32_t val) { set_register(r, (uint64_t)val); }
 //-----------------------------------------------------------------
@@ -96,8 +133,8 @@ uint32_t rv64::get_register(int r)
     else if (r == (RISCV_REGNO_CSR0 + CSR_MTVAL)) return m_csr_mtval;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIE)) return m_csr_mie;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIP)) return m_csr_mip;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MCYCLE)) return m_csr_mtime;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) return m_csr_mtime;
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MCYCLE)) return m_cycle_now;
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) return time_now();
     else if (r == (RISCV_REGNO_CSR0 + CSR_MTIMECMP)) return m_csr_mtimecmp; // Non-std
     else if (r == (RISCV_REGNO_CSR0 + CSR_MSCRATCH)) return m_csr_mscratch;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIDELEG)) return m_csr_mideleg;
@@ -126,8 +163,8 @@ uint64_t rv64::get_register64(int r)
     else if (r == (RISCV_REGNO_CSR0 + CSR_MTVAL)) return m_csr_mtval;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIE)) return m_csr_mie;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIP)) return m_csr_mip;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MCYCLE)) return m_csr_mtime;
-    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) return m_csr_mtime;
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MCYCLE)) return m_cycle_now;
+    else if (r == (RISCV_REGNO_CSR0 + CSR_MTIME)) return time_now();
     else if (r == (RISCV_REGNO_CSR0 + CSR_MTIMECMP)) return m_csr_mtimecmp; // Non-std
     else if (r == (RISCV_REGNO_CSR0 + CSR_MSCRATCH)) return m_csr_mscratch;
     else if (r == (RISCV_REGNO_CSR0 + CSR_MIDELEG)) return m_csr_mideleg;
@@ -150,6 +187,7 @@ void rv64::reset(uint32_t start_addr)
     m_pc        = start_addr;
     m_pc_x      = start_addr;
     m_load_res  = 0;
+    m_load_val  = 0;
 
     for (int i=0;i<REGISTERS;i++)
         m_gpr[i] = 0;
@@ -165,9 +203,11 @@ void rv64::reset(uint32_t start_addr)
     m_csr_mcause   = 0;
     m_csr_mevec    = 0;
     m_csr_mtval    = 0;
-    m_csr_mtime    = 0;
     m_csr_mtimecmp = 0;
     m_csr_mtime_ie = false;
+    if (m_p_cycles)
+        m_cycle_now = *m_p_cycles;
+    time_set(0);
     m_csr_mscratch = 0;
 
     m_csr_sepc     = 0;
@@ -180,8 +220,10 @@ void rv64::reset(uint32_t start_addr)
     m_fault         = false;
     m_break         = false;
     m_trace         = 0;
+    m_wfi           = false;
 
     mmu_flush();
+    decode_flush();
 
     stats_reset();
 }
@@ -204,19 +246,27 @@ uint32_t rv64::get_opcode(uint64_t address)
 //-----------------------------------------------------------------
 int rv64::mmu_read_word(uint64_t address, uint64_t *val)
 {
-    int m;
     *val = 0;
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(address))
-        {
-            uint32_t dw = 0;
-            mem->read32(address + 0, dw);
-            *val |= ((uint64_t)dw << 0);
-            mem->read32(address + 4, dw);
-            *val |= ((uint64_t)dw << 32);
-            return 1;
-        }
+    uint8_t *host = get_host_ptr(address);
+    if (host)
+    {
+        *val = mem_load64(host);
+        return 1;
+    }
+
+    memory_base *mem = find_memory(address);
+    if (mem)
+    {
+        uint32_t dw = 0;
+        bus_lock();
+        mem->read32(address + 0, dw);
+        *val |= ((uint64_t)dw << 0);
+        mem->read32(address + 4, dw);
+        *val |= ((uint64_t)dw << 32);
+        bus_unlock();
+        return 1;
+    }
 
     return 0;
 }
@@ -225,16 +275,84 @@ int rv64::mmu_read_word(uint64_t address, uint64_t *val)
 //-----------------------------------------------------------------
 void rv64::mmu_flush(void)
 {
-    for (int i=0;i<MMU_TLB_ENTRIES;i++)
-    {
-        m_mmu_addr[i] = 0;
-        m_mmu_pte[i]  = 0;
-    }
+    m_itlb.flush();
+    m_dtlb.flush();
+
+    soft_tlb_flush();
+
+    // Block chains rely on the old translations
+    m_block_epoch++;
+}
+//-----------------------------------------------------------------
+// mmu_fence: SFENCE.VMA (by address and / or ASID)
+//-----------------------------------------------------------------
+void rv64::mmu_fence(bool by_addr, uint64_t addr, bool by_asid, uint64_t asid)
+{
+    asid &= SATP_ASID_MASK;
+    m_itlb.flush_vma(by_addr, addr >> MMU_PGSHIFT, by_asid, asid);
+    m_dtlb.flush_vma(by_addr, addr >> MMU_PGSHIFT, by_asid, asid);
+
+    // Software TLB / block chains are not ASID tagged
+    soft_tlb_flush();
+    m_block_epoch++;
+}
+//-----------------------------------------------------------------
+// set_tlb_size: Set ITLB / DTLB geometry (each)
+//-----------------------------------------------------------------
+bool rv64::set_tlb_size(int entries, int ways)
+{
+    if (!m_itlb.resize(entries, ways))
+        return false;
+    m_dtlb.resize(entries, ways);
+
+    soft_tlb_flush();
+    m_block_epoch++;
+    return true;
+}
+//-----------------------------------------------------------------
+// data_priv: Effective privilege level for loads / stores
+//-----------------------------------------------------------------
+inline uint32_t rv64::data_priv(void)
+{
+    // Modify data access privilege level (allows machine mode to use MMU)
+    if (m_csr_msr & SR_MPRV)
+        return SR_GET_MPP(m_csr_msr);
+
+    return m_csr_mpriv;
+}
+//-----------------------------------------------------------------
+// soft_tlb_flush: Flush software TLB (virtual -> host)
+//-----------------------------------------------------------------
+void rv64::soft_tlb_flush(void)
+{
+    for (int p=0;p<SOFT_TLB_PRIV;p++)
+        for (int t=0;t<SOFT_TLB_MAX;t++)
+            for (int i=0;i<SOFT_TLB_ENTRIES;i++)
+                m_soft_tlb[p][t][i].tag = ~((uint64_t)0);
+}
+//-----------------------------------------------------------------
+// soft_tlb_fill: Record a successful translation (if RAM backed)
+//-----------------------------------------------------------------
+void rv64::soft_tlb_fill(int type, uint32_t priv, uint64_t addr, uint64_t physical)
+{
+    // Physical address map is 32-bit
+    if (physical >> 32)
+        return;
+
+    uint8_t *host = get_host_ptr(physical);
+    if (!host)
+        return;
+
+    uint64_t pgoff = addr & (MMU_PGSIZE-1);
+    t_soft_tlb *e  = &m_soft_tlb[priv][type][(addr >> MMU_PGSHIFT) & (SOFT_TLB_ENTRIES-1)];
+    e->tag         = addr - pgoff;
+    e->addend      = (uint64_t)(uintptr_t)(host - pgoff) - e->tag;
+    e->paddr       = physical - pgoff;
 }
 //-----------------------------------------------------------------
 // mmu_walk: Page table walker
 //-----------------------------------------------------------------
-uint64_t rv64::mmu_walk(uint64_t addr)
+uint64_t rv64::mmu_walk(uint64_t addr, bool fetch /*= false*/)
 {
     uint64_t pte = 0;
 
@@ -247,14 +365,23 @@ uint64_t rv64::mmu_walk(uint64_t addr)
     }
     else
     {
+        uint32_t   asid = ((m_csr_satp >> SATP_ASID_SHIFT) & SATP_ASID_MASK);
+        riscv_tlb *tlb  = fetch ? &m_itlb : &m_dtlb;
+
         // Fast path lookup in TLBs
-        uint32_t tlb_entry = (addr >> MMU_PGSHIFT) & (MMU_TLB_ENTRIES-1);
-        uint64_t tlb_match = (addr >> MMU_PGSHIFT);
-        if (m_mmu_addr[tlb_entry] == tlb_match && m_mmu_pte[tlb_entry] != 0)
-            return m_mmu_pte[tlb_entry];
+        if (tlb->lookup(addr >> MMU_PGSHIFT, asid, &pte))
+        {
+            HOST_STATS_COUNT(COUNT_TLB_HIT);
+            m_stats[fetch ? STATS_ITLB_HIT : STATS_DTLB_HIT]++;
+            return pte;
+        }
+
+        HOST_STATS_COUNT(COUNT_TLB_MISS);
+        HOST_STATS_TIMER(TIMER_MMU_WALK);
+        m_stats[fetch ? STATS_ITLB_MISS : STATS_DTLB_MISS]++;
 
-        uint64_t base = ((m_csr_satp >> SATP_PPN_SHIFT) & SATP_PPN_MASK) * PAGE_SIZE;
-        uint64_t asid = ((m_csr_satp >> SATP_ASID_SHIFT) & SATP_ASID_MASK);
+        uint64_t base   = ((m_csr_satp >> SATP_PPN_SHIFT) & SATP_PPN_MASK) * PAGE_SIZE;
+        bool     global = false;
 
         DPRINTF(LOG_MMU, ("MMU: MMU enabled - base 0x%08x\n", base));
 
@@ -277,6 +404,10 @@ uint64_t rv64::mmu_walk(uint64_t addr)
 
             uint64_t ppn = pte >> PAGE_PFN_SHIFT;
 
+            // Global mappings (applies to all levels below)
+            if (pte & PAGE_GLOBAL)
+                global = true;
+
             // Invalid mapping
             if (!(pte & PAGE_PRESENT))
             {
@@ -323,8 +454,16 @@ uint64_t rv64::mmu_walk(uint64_t addr)
                     error(false, "%08x: PTE access out of range %x\n", m_pc, addr);
                 }
 
-                m_mmu_addr[tlb_entry] = tlb_match;
-                m_mmu_pte[tlb_entry]  = pte;
+                // Superpages are cached as a single entry if entirely backed
+                if (pte)
+                {
+                    uint64_t pgmask = (((uint64_t)MMU_PGSIZE) << ptshift) - 1;
+                    int      level  = i;
+                    if (level && !(valid_addr(ptd_addr & ~pgmask) && valid_addr(ptd_addr | pgmask)))
+                        level = 0;
+
+                    tlb->insert(addr >> MMU_PGSHIFT, level, asid, global, pte);
+                }
                 break;
             }
         }
@@ -342,11 +481,12 @@ int rv64::mmu_i_translate(uint64_t addr, uint64_t *physical)
     // Machine - no MMU
     if (m_csr_mpriv > PRIV_SUPER)
     {
+        soft_tlb_fill(SOFT_TLB_EXEC, m_csr_mpriv, addr, addr);
         *physical = addr;
         return 1; 
     }
     
-    uint64_t pte = mmu_walk(addr);
+    uint64_t pte = mmu_walk(addr, true);
 
     // Reserved configurations
     if (((pte & (PAGE_EXEC | PAGE_READ | PAGE_WRITE)) == PAGE_WRITE) ||
@@ -392,6 +532,8 @@ int rv64::mmu_i_translate(uint64_t addr, uint64_t *physical)
 
     DPRINTF(LOG_MMU, ("IMMU: Lookup VA %x -> PA %x\n", addr, paddr));
 
+    soft_tlb_fill(SOFT_TLB_EXEC, m_csr_mpriv, addr, paddr);
+
     *physical = paddr;
     return 1; 
 }
@@ -410,11 +552,13 @@ int rv64::mmu_d_translate(uint64_t pc, uint64_t addr, uint64_t *physical, int wr
     // Machine - no MMU
     if (priv > PRIV_SUPER)
     {
+        soft_tlb_fill(writeNotRead ? SOFT_TLB_WRITE : SOFT_TLB_READ, priv, addr, addr);
         *physical = addr;
         return 1; 
     }
 
     uint64_t pte = mmu_walk(addr);
+    bool cacheable = true;
 
     // MXR: Loads from pages marked either readable or executable (R=1 or X=1) will succeed.
     if ((m_csr_msr & SR_MXR) && (pte & PAGE_EXEC))
@@ -433,6 +577,7 @@ int rv64::mmu_d_translate(uint64_t pc, uint64_t addr, uint64_t *physical, int wr
         if ((pte & PAGE_USER) && !(m_csr_msr & SR_SUM))
         {
             error(false, "MMU_D: PC=%08x Access %08x - User page access by super\n", pc, addr);
+            cacheable = false;
         }
         else if ((writeNotRead  && ((pte & (PAGE_WRITE)) != (PAGE_WRITE))) || 
                  (!writeNotRead && ((pte & (PAGE_READ))  != (PAGE_READ))))
@@ -463,6 +608,9 @@ int rv64::mmu_d_translate(uint64_t pc, uint64_t addr, uint64_t *physical, int wr
 
     DPRINTF(LOG_MMU, ("DMMU: Lookup VA %x -> PA %x\n", addr, paddr));
 
+    if (cacheable)
+        soft_tlb_fill(writeNotRead ? SOFT_TLB_WRITE : SOFT_TLB_READ, priv, addr, paddr);
+
     *physical = paddr;
     return 1; 
 }
@@ -473,6 +621,32 @@ int rv64::load(uint64_t pc, uint64_t address, uint64_t *result, int width, bool
 {
     uint64_t physical = address;
 
+    // Fast path: aligned access to a cached RAM page
+    if (!(address & (width-1)) && !TRACE_ENABLED((LOG_MEM | LOG_MMU)) && !m_trace_file)
+    {
+        uint8_t *host = soft_tlb_lookup(SOFT_TLB_READ, data_priv(), address, &physical);
+        if (host)
+        {
+            m_stats[STATS_LOADS]++;
+            switch (width)
+            {
+                case 8:
+                    *result = mem_load64(host);
+                    break;
+                case 4:
+                    *result = signedLoad ? (uint64_t)(int32_t)mem_load32(host) : mem_load32(host);
+                    break;
+                case 2:
+                    *result = signedLoad ? (uint64_t)(int16_t)mem_load16(host) : mem_load16(host);
+                    break;
+                default:
+                    *result = signedLoad ? (uint64_t)(int8_t)*host : *host;
+                    break;
+            }
+            return 1;
+        }
+    }
+
     // Translate addresses if required
     if (!mmu_d_translate(pc, address, &physical, 0))
         return 0;
@@ -514,58 +688,89 @@ int rv64::load(uint64_t pc, uint64_t address, uint64_t *result, int width, bool
         return 0;
     }
 
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(physical))
+    // Directly backed memory
+    uint8_t *host = get_host_ptr(physical);
+    if (host)
+    {
+        switch (width)
         {
-            switch (width)
-            {
-                case 8:
-                {
-                    uint32_t dw = 0;
-                    mem->read32(physical + 0, dw);
-                    *result |= ((uint64_t)dw << 0);
-                    mem->read32(physical + 4, dw);
-                    *result |= ((uint64_t)dw << 32);
-                }
+            case 8:
+                *result = mem_load64(host);
                 break;
-                case 4:
-                {
-                    uint32_t dw = 0;
-                    mem->read32(physical, dw);
-                    *result = dw;
-
-                    if (signedLoad && ((*result) & (1 << 31)))
-                         *result |= 0xFFFFFFFF00000000;
-                }
+            case 4:
+                *result = signedLoad ? (uint64_t)(int32_t)mem_load32(host) : mem_load32(host);
                 break;
-                case 2:
-                {
-                    uint16_t dh = 0;
-                    mem->read16(physical, dh);
-                    *result |= dh;
-
-                    if (signedLoad && ((*result) & (1 << 15)))
-                         *result |= 0xFFFFFFFFFFFF0000;
-                }
+            case 2:
+                *result = signedLoad ? (uint64_t)(int16_t)mem_load16(host) : mem_load16(host);
                 break;
-                case 1:
-                {
-                    uint8_t db = 0;
-                    mem->read8(physical + 0, db);
-                    *result |= ((uint32_t)db << 0);
-
-                    if (signedLoad && ((*result) & (1 << 7)))
-                         *result |= 0xFFFFFFFFFFFFFF00;
-                }                
+            default:
+                *result = signedLoad ? (uint64_t)(int8_t)*host : *host;
                 break;
-                default:
-                    assert(!"Invalid");
-                    break;
+        }
+
+        DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
+        if (m_trace_file)
+            m_trace_file->mem(false, address, physical, *result, width);
+        return 1;
+    }
+
+    // Devices
+    memory_base *mem = find_memory(physical);
+    if (mem)
+    {
+        bus_lock();
+        switch (width)
+        {
+            case 8:
+            {
+                uint32_t dw = 0;
+                mem->read32(physical + 0, dw);
+                *result |= ((uint64_t)dw << 0);
+                mem->read32(physical + 4, dw);
+                *result |= ((uint64_t)dw << 32);
             }
+            break;
+            case 4:
+            {
+                uint32_t dw = 0;
+                mem->read32(physical, dw);
+                *result = dw;
 
-            DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
-            return 1;
+                if (signedLoad && ((*result) & (1 << 31)))
+                     *result |= 0xFFFFFFFF00000000;
+            }
+            break;
+            case 2:
+            {
+                uint16_t dh = 0;
+                mem->read16(physical, dh);
+                *result |= dh;
+
+                if (signedLoad && ((*result) & (1 << 15)))
+                     *result |= 0xFFFFFFFFFFFF0000;
+            }
+            break;
+            case 1:
+            {
+                uint8_t db = 0;
+                mem->read8(physical + 0, db);
+                *result |= ((uint32_t)db << 0);
+
+                if (signedLoad && ((*result) & (1 << 7)))
+                     *result |= 0xFFFFFFFFFFFFFF00;
+            }                
+            break;
+            default:
+                assert(!"Invalid");
+                break;
         }
+        bus_unlock();
+
+        DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n",*result));
+        if (m_trace_file)
+            m_trace_file->mem(false, address, physical, *result, width);
+        return 1;
+    }
 
     if (m_enable_mem_errors)
     {
@@ -583,11 +788,44 @@ int rv64::store(uint64_t pc, uint64_t address, uint64_t data, int width)
 {
     uint64_t physical = address;
 
+    // Fast path: aligned access to a cached RAM page
+    if (!(address & (width-1)) && !TRACE_ENABLED((LOG_MEM | LOG_MMU)) && !m_trace_file)
+    {
+        uint8_t *host = soft_tlb_lookup(SOFT_TLB_WRITE, data_priv(), address, &physical);
+        if (host)
+        {
+            m_stats[STATS_STORES]++;
+
+            // Self-modifying code
+            if (decode_page_cached(physical))
+                decode_invalidate(physical);
+
+            switch (width)
+            {
+                case 8:
+                    mem_store64(host, data);
+                    break;
+                case 4:
+                    mem_store32(host, data);
+                    break;
+                case 2:
+                    mem_store16(host, data);
+                    break;
+                default:
+                    *host = data;
+                    break;
+            }
+            return 1;
+        }
+    }
+
     // Translate addresses if required
     if (!mmu_d_translate(pc, address, &physical, 1))
         return 0;
 
     DPRINTF(LOG_MEM, ("STORE: VA 0x%08x PA 0x%08x Value 0x%08x Width %d\n", address, physical, data, width));
+    if (m_trace_file)
+        m_trace_file->mem(true, address, physical, data, width);
     m_stats[STATS_STORES]++;
 
     // Detect misaligned store
@@ -612,31 +850,59 @@ int rv64::store(uint64_t pc, uint64_t address, uint64_t data, int width)
         return 0;
     }
 
-    // Aligned stores
-    for (memory_base *mem = m_memories; mem != NULL; mem = mem->next)
-        if (mem->valid_addr(physical))
+    // Self-modifying code
+    if (decode_page_cached(physical))
+        decode_invalidate(physical);
+
+    // Aligned stores - directly backed memory
+    uint8_t *host = get_host_ptr(physical);
+    if (host)
+    {
+        switch (width)
         {
-            switch (width)
-            {
-                case 8:
-                    mem->write32(physical + 0, data >> 0);
-                    mem->write32(physical + 4, data >> 32);
-                    break;                
-                case 4:
-                    mem->write32(physical, data);
-                    break;
-                case 2:
-                    mem->write16(physical, data & 0xFFFF);
-                    break;
-                case 1:
-                    mem->write8(physical + 0, data & 0xFF);
-                    break;
-                default:
-                    assert(!"Invalid");
-                    break;
-            }
-            return 1;
+            case 8:
+                mem_store64(host, data);
+                break;
+            case 4:
+                mem_store32(host, data);
+                break;
+            case 2:
+                mem_store16(host, data);
+                break;
+            default:
+                *host = data;
+                break;
+        }
+        return 1;
+    }
+
+    // Aligned stores - devices
+    memory_base *mem = find_memory(physical);
+    if (mem)
+    {
+        bus_lock();
+        switch (width)
+        {
+            case 8:
+                mem->write32(physical + 0, data >> 0);
+                mem->write32(physical + 4, data >> 32);
+                break;                
+            case 4:
+                mem->write32(physical, data);
+                break;
+            case 2:
+                mem->write16(physical, data & 0xFFFF);
+                break;
+            case 1:
+                mem->write8(physical + 0, data & 0xFF);
+                break;
+            default:
+                assert(!"Invalid");
+                break;
         }
+        bus_unlock();
+        return 1;
+    }
 
     if (m_enable_mem_errors)
     {
@@ -723,9 +989,17 @@ bool rv64::access_csr(uint64_t address, uint64_t data, bool set, bool clr, uint6
     misa_val |= m_enable_rvc ? MISA_RVC : 0;
     misa_val |= m_enable_rva ? MISA_RVA : 0;
 
-    // SATP write - flush cached TLBs
+    // SATP write - TLB entries are ASID tagged, the software TLB and
+    // block chains are not
     if (((address & 0xFFF) == CSR_SATP) && (set || clr))
-        mmu_flush();
+    {
+        soft_tlb_flush();
+        m_block_epoch++;
+    }
+
+    // Status write (SUM / MXR / MPRV) - flush software TLB
+    if ((((address & 0xFFF) == CSR_MSTATUS) || ((address & 0xFFF) == CSR_SSTATUS)) && (set || clr))
+        soft_tlb_flush();
 
     switch (address & 0xFFF)
     {
@@ -739,11 +1013,7 @@ bool rv64::access_csr(uint64_t address, uint64_t data, bool set, bool clr, uint6
                 case CSR_SIM_CTRL_EXIT:
                     stats_dump();
                     printf("Exit code = %d\n", (char)(data & 0xFF));
-                    // Abnormal exit
-                    if (data & 0xFF)
-                        exit(data & 0xFF);
-                    else
-                        m_stopped = true;
+                    sim_exit(data & 0xFF);
                     break;
                 case CSR_SIM_CTRL_PUTC:
                     if (m_console)
@@ -806,7 +1076,7 @@ bool rv64::access_csr(uint64_t address, uint64_t data, bool set, bool clr, uint6
         CSR_STD(MIDELEG, m_csr_mideleg)
         CSR_STD(MEDELEG, m_csr_medeleg)
         CSR_STD(MSCRATCH,m_csr_mscratch)
-        CSR_CONST(MHARTID,  MHARTID_VALUE)
+        CSR_CONST(MHARTID,  MHARTID_VALUE + m_hart_id)
         //--------------------------------------------------------
         // Standard - Supervisor
         //--------------------------------------------------------
@@ -823,13 +1093,13 @@ bool rv64::access_csr(uint64_t address, uint64_t data, bool set, bool clr, uint6
         // Extensions
         //-------------------------------------------------------- 
         case CSR_MTIME:
-            result      = m_csr_mtime;
+            result      = time_now();
             break;
         case CSR_MTIMEH:
             result      = 0;
             break;
        case CSR_MCYCLE:
-            result      = m_csr_mtime;
+            result      = m_cycle_now;
             break;
 
         // Non-std behaviour
@@ -848,6 +1118,7 @@ bool rv64::access_csr(uint64_t address, uint64_t data, bool set, bool clr, uint6
                 m_csr_mtime_ie = true;
 
             m_enable_mtimecmp = true;
+            timer_rearm();
             break;
 
         default:
@@ -855,8 +1126,15 @@ bool rv64::access_csr(uint64_t address, uint64_t data, bool set, bool clr, uint6
             break;
     }
 
-    m_enable_rvc = (misa_val & MISA_RVC) ? true : false;
-    m_enable_rva = (misa_val & MISA_RVA) ? true : false;
+    // C / A extension toggled - decoded instructions are stale
+    bool rvc = (misa_val & MISA_RVC) ? true : false;
+    bool rva = (misa_val & MISA_RVA) ? true : false;
+    if (rvc != m_enable_rvc || rva != m_enable_rva)
+    {
+        m_enable_rvc = rvc;
+        m_enable_rva = rva;
+        decode_flush();
+    }
 
     return false;
 }
@@ -935,6 +1213,9 @@ void rv64::exception(uint64_t cause, uint64_t pc, uint64_t badaddr /*= 0*/)
         // Set new PC
         m_pc         = m_csr_mevec;
     }
+
+    if (m_trace_file)
+        m_trace_file->exception(pc, m_pc, cause);
 }
 //-----------------------------------------------------------------
 // execute: Instruction execution stage
@@ -942,9 +1223,14 @@ void rv64::exception(uint64_t cause, uint64_t pc, uint64_t badaddr /*= 0*/)
 bool rv64::execute(void)
 {
     uint64_t phy_pc = m_pc;
+    uint8_t *host_pc = NULL;
+
+    // Cached translation to RAM (whole opcode within the page)
+    if ((m_pc & (MMU_PGSIZE-1)) <= (MMU_PGSIZE-4) && !TRACE_ENABLED(LOG_MMU))
+        host_pc = soft_tlb_lookup(SOFT_TLB_EXEC, m_csr_mpriv, m_pc, &phy_pc);
 
     // Translate PC to physical address
-    if (!mmu_i_translate(m_pc, &phy_pc))
+    if (!host_pc && !mmu_i_translate(m_pc, &phy_pc))
         return false;
 
     // Misaligned PC
@@ -954,1762 +1240,1250 @@ bool rv64::execute(void)
         return false;
     }
 
-    // Get opcode at current PC
-    int64_t opcode = (int32_t)get_opcode(phy_pc);
-    m_pc_x = m_pc;
-
-    // Extract registers
-    int rd          = (opcode & OPCODE_RD_MASK)  >> OPCODE_RD_SHIFT;
-    int rs1         = (opcode & OPCODE_RS1_MASK) >> OPCODE_RS1_SHIFT;
-    int rs2         = (opcode & OPCODE_RS2_MASK) >> OPCODE_RS2_SHIFT;
-
-    // Extract immediates
-    int64_t typei_imm   = SEXT32(opcode & OPCODE_TYPEI_IMM_MASK) >> OPCODE_TYPEI_IMM_SHIFT;
-    int64_t typeu_imm   = SEXT32(opcode & OPCODE_TYPEU_IMM_MASK) >> OPCODE_TYPEU_IMM_SHIFT;
-    int64_t imm20       = typeu_imm << OPCODE_TYPEU_IMM_SHIFT;
-    int64_t imm12       = typei_imm;
-    int64_t bimm        = OPCODE_SBTYPE_IMM(opcode);
-    int64_t jimm20      = OPCODE_UJTYPE_IMM(opcode);
-    int64_t storeimm    = OPCODE_STYPE_IMM(opcode);
-    int     shamt       = ((signed)(opcode & OPCODE_SHAMT_MASK)) >> OPCODE_SHAMT_SHIFT;
-
-    // Retrieve registers
-    uint64_t reg_rd  = 0;
-    uint64_t reg_rs1 = m_gpr[rs1];
-    uint64_t reg_rs2 = m_gpr[rs2];
-    uint64_t pc      = m_pc;
-
-    bool take_exception = false;
-
-    DPRINTF(LOG_OPCODES,( "%08x: %08x\n", pc, opcode));
-    DPRINTF(LOG_OPCODES,( "        rd(%d) r%d = %d, r%d = %d\n", rd, rs1, reg_rs1, rs2, reg_rs2));
-
-    // As RVC is not supported, fault on opcode which is all zeros
-    if (opcode == 0)
-    {
-        error(false, "Bad instruction @ %x\n", pc);
-
-        exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        m_fault = true;
-        take_exception = true;        
-    }
-    else if ((opcode & INST_ANDI_MASK) == INST_ANDI)
-    {
-        DPRINTF(LOG_INST,("%016llx: andi r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_ANDI);
-        reg_rd = reg_rs1 & imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_ORI_MASK) == INST_ORI)
-    {
-        DPRINTF(LOG_INST,("%016llx: ori r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_ORI);
-        reg_rd = reg_rs1 | imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_XORI_MASK) == INST_XORI)
-    {
-        DPRINTF(LOG_INST,("%016llx: xori r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_XORI);
-        reg_rd = reg_rs1 ^ imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_ADDI_MASK) == INST_ADDI)
-    {
-        DPRINTF(LOG_INST,("%016llx: addi r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_ADDI);
-        reg_rd = reg_rs1 + imm12;
-        pc += 4;
-    }
-    else if ((opcode & INST_SLTI_MASK) == INST_SLTI)
-    {
-        DPRINTF(LOG_INST,("%016llx: slti r%d, r%d, %d\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_SLTI);
-        reg_rd = (int64_t)reg_rs1 < (int64_t)imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLTIU_MASK) == INST_SLTIU)
-    {
-        DPRINTF(LOG_INST,("%016llx: sltiu r%d, r%d, %d\n", pc, rd, rs1, (uint64_t)imm12));
-        INST_STAT(ENUM_INST_SLTIU);
-        reg_rd = (uint64_t)reg_rs1 < (uint64_t)imm12;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLLI_MASK) == INST_SLLI)
-    {
-        DPRINTF(LOG_INST,("%016llx: slli r%d, r%d, %d\n", pc, rd, rs1, shamt));
-        INST_STAT(ENUM_INST_SLLI);
-        reg_rd = reg_rs1 << shamt;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SRLI_MASK) == INST_SRLI)
-    {
-        DPRINTF(LOG_INST,("%016llx: srli r%d, r%d, %d\n", pc, rd, rs1, shamt));
-        INST_STAT(ENUM_INST_SRLI);
-        reg_rd = (uint64_t)reg_rs1 >> shamt;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SRAI_MASK) == INST_SRAI)
-    {
-        DPRINTF(LOG_INST,("%016llx: srai r%d, r%d, %d\n", pc, rd, rs1, shamt));
-        INST_STAT(ENUM_INST_SRAI);
-        reg_rd = (int64_t)reg_rs1 >> shamt;
-        pc += 4;        
-    }
-    else if ((opcode & INST_LUI_MASK) == INST_LUI)
-    {
-        DPRINTF(LOG_INST,("%016llx: lui r%d, 0x%x\n", pc, rd, imm20));
-        INST_STAT(ENUM_INST_LUI);
-        reg_rd = imm20;
-        pc += 4;        
-    }
-    else if ((opcode & INST_AUIPC_MASK) == INST_AUIPC)
-    {
-        DPRINTF(LOG_INST,("%016llx: auipc r%d, 0x%x\n", pc, rd, imm20));
-        INST_STAT(ENUM_INST_AUIPC);
-        reg_rd = imm20 + pc;
-        pc += 4;        
-    }
-    else if ((opcode & INST_ADD_MASK) == INST_ADD)
-    {
-        DPRINTF(LOG_INST,("%016llx: add r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_ADD);
-        reg_rd = reg_rs1 + reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SUB_MASK) == INST_SUB)
-    {
-        DPRINTF(LOG_INST,("%016llx: sub r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SUB);
-        reg_rd = reg_rs1 - reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLT_MASK) == INST_SLT)
-    {
-        DPRINTF(LOG_INST,("%016llx: slt r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SLT);
-        reg_rd = (int64_t)reg_rs1 < (int64_t)reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLTU_MASK) == INST_SLTU)
-    {
-        DPRINTF(LOG_INST,("%016llx: sltu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SLTU);
-        reg_rd = (uint64_t)reg_rs1 < (uint64_t)reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_XOR_MASK) == INST_XOR)
-    {
-        DPRINTF(LOG_INST,("%016llx: xor r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_XOR);
-        reg_rd = reg_rs1 ^ reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_OR_MASK) == INST_OR)
-    {
-        DPRINTF(LOG_INST,("%016llx: or r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_OR);
-        reg_rd = reg_rs1 | reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_AND_MASK) == INST_AND)
-    {
-        DPRINTF(LOG_INST,("%016llx: and r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_AND);
-        reg_rd = reg_rs1 & reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SLL_MASK) == INST_SLL)
-    {
-        DPRINTF(LOG_INST,("%016llx: sll r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SLL);
-        reg_rd = reg_rs1 << reg_rs2;
-        pc += 4;        
-    }
-    else if ((opcode & INST_SRL_MASK) == INST_SRL)
+    // Pre-decoded instruction (decoded in place if it can't be cached)
+    t_decoded   *entry = &m_decode[(phy_pc >> 1) & (DECODE_ENTRIES-1)];
+    t_riscv_inst uncached;
+    const t_riscv_inst *inst = &entry->inst;
+    HOST_STATS_HIT(entry->pc == phy_pc, COUNT_DECODE_HIT, COUNT_DECODE_MISS);
+    if (!(phy_pc >> 32) && decode_page_nohost(phy_pc))
     {
-        DPRINTF(LOG_INST,("%016llx: srl r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SRL);
-        reg_rd = (uint64_t)reg_rs1 >> reg_rs2;
-        pc += 4;        
+        // Not directly backed, fetched every time and only decoded again
+        // when the opcode differs from the cached entry
+        uint32_t opcode = get_opcode(phy_pc);
+        if (entry->pc != phy_pc || entry->inst.opcode != ((opcode & 3) == 3 ? opcode : (opcode & 0xFFFF)))
+        {
+            riscv_decode(opcode, decode_flags(), &entry->inst);
+            entry->pc = phy_pc;
+        }
     }
-    else if ((opcode & INST_SRA_MASK) == INST_SRA)
+    else if ((phy_pc >> 32) || (entry->pc != phy_pc && !decode_fill(entry, phy_pc)))
     {
-        DPRINTF(LOG_INST,("%016llx: sra r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_SRA);
-        reg_rd = (int64_t)reg_rs1 >> reg_rs2;
-        pc += 4;        
+        riscv_decode(host_pc ? mem_load32(host_pc) : get_opcode(phy_pc), decode_flags(), &uncached);
+        inst = &uncached;
     }
-    else if ((opcode & INST_JAL_MASK) == INST_JAL)
-    {
-        DPRINTF(LOG_INST,("%016llx: jal r%d, %d\n", pc, rd, jimm20));
-        INST_STAT(ENUM_INST_JAL);
-        reg_rd = pc + 4;
-        pc+= jimm20;
 
-        if (rd == RISCV_REG_RA)
-            log_branch_call(m_pc, pc);
-        else
-            log_branch_jump(m_pc, pc);
+    m_pc_x = m_pc;
 
-        m_stats[STATS_BRANCHES]++;
-    }
-    else if ((opcode & INST_JALR_MASK) == INST_JALR)
-    {
-        DPRINTF(LOG_INST,("%016llx: jalr r%d, r%d\n", pc, rs1, imm12));
-        INST_STAT(ENUM_INST_JALR);
-        reg_rd = pc + 4;
-        pc = (reg_rs1 + imm12) & ~1;
+    if (m_trace_file)
+        m_trace_file->inst(m_pc, inst->opcode, inst->size);
 
-        if (rs1 == RISCV_REG_RA && imm12 == 0)
-            log_branch_ret(m_pc, pc);
-        else if (rd == RISCV_REG_RA)
-            log_branch_call(m_pc, pc);
-        else
-            log_branch_jump(m_pc, pc);
+    if (m_trace & (LOG_INST | LOG_OPCODES))
+        trace_inst(inst);
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BEQ_MASK) == INST_BEQ)
+    if (inst->op == RV_OP_ILLEGAL)
     {
-        DPRINTF(LOG_INST,("%016llx: beq r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BEQ);
+        // Zero and reserved compressed encodings stop the simulation
+        if (inst->size == 2 || inst->opcode == 0)
+        {
+            error(false, "Bad instruction @ %x (opcode %x)\n", (uint32_t)m_pc, inst->opcode);
+            m_fault = true;
+        }
 
-        bool take_branch = (reg_rs1 == reg_rs2);
-        if (take_branch)
-            pc += bimm;
-        else
-            pc += 4;
+        exception(MCAUSE_ILLEGAL_INSTRUCTION, m_pc, inst->opcode);
+        log_commit_pc(m_pc_x);
+        return true;
+    }
 
-        log_branch(m_pc, pc, take_branch);
+    return execute_decoded(inst);
+}
+//-----------------------------------------------------------------
+// trace_inst: Instruction trace (LOG_OPCODES / LOG_INST)
+//-----------------------------------------------------------------
+void rv64::trace_inst(const t_riscv_inst *inst)
+{
+    DPRINTF(LOG_OPCODES,( "%08x: %08x\n", (uint32_t)m_pc, inst->opcode));
+    DPRINTF(LOG_OPCODES,( "        rd(%d) r%d = %d, r%d = %d\n", inst->rd, inst->rs1, (int)m_gpr[inst->rs1], inst->rs2, (int)m_gpr[inst->rs2]));
 
-        // No writeback
-        rd = 0;
+    char text[64];
+    if ((m_trace & LOG_INST) && riscv_disasm(inst->opcode, m_pc, RV_DECODE_RV64, text, sizeof(text)))
+        printf("%016llx: %s\n", (unsigned long long)m_pc, text);
+}
+//-----------------------------------------------------------------
+// check_interrupts: Take highest priority pending interrupt (if enabled)
+//-----------------------------------------------------------------
+bool rv64::check_interrupts(uint64_t pc)
+{
+    uint64_t pending_interrupts = (m_csr_mip & m_csr_mie);
+    uint64_t m_enabled          = m_csr_mpriv < PRIV_MACHINE || (m_csr_mpriv == PRIV_MACHINE && (m_csr_msr & SR_MIE));
+    uint64_t s_enabled          = m_csr_mpriv < PRIV_SUPER   || (m_csr_mpriv == PRIV_SUPER   && (m_csr_msr & SR_SIE));
+    uint64_t m_interrupts       = pending_interrupts & ~m_csr_mideleg & -m_enabled;
+    uint64_t s_interrupts       = pending_interrupts & m_csr_mideleg & -s_enabled;
+    uint64_t interrupts         = m_interrupts ? m_interrupts : s_interrupts;
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BNE_MASK) == INST_BNE)
+    // Interrupt pending and mask enabled
+    if (interrupts)
     {
-        DPRINTF(LOG_INST,("%016llx: bne r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BNE);
-
-        bool take_branch = (reg_rs1 != reg_rs2);
-        if (take_branch)
-            pc += bimm;
-        else
-            pc += 4;
+        for (int i=IRQ_MIN;i<IRQ_MAX;i++)
+        {
+            if (interrupts & (1 << i))
+            {
+                // Only service one interrupt per cycle
+                DPRINTF(LOG_INST,( "Interrupt%d taken...\n", i));
+                exception(MCAUSE_INTERRUPT + i, pc);
+                return true;
+            }
+        }
+    }
 
-        log_branch(m_pc, pc, take_branch);
+    return false;
+}
+//-----------------------------------------------------------------
+// decode_flush: Invalidate all pre-decoded instructions
+//-----------------------------------------------------------------
+void rv64::decode_flush(void)
+{
+    for (int i=0;i<DECODE_ENTRIES;i++)
+        m_decode[i].pc = DECODE_INVALID;
 
-        // No writeback
-        rd = 0;
+    for (int i=0;i<BLOCK_ENTRIES;i++)
+        m_blocks[i].pc = DECODE_INVALID;
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BLT_MASK) == INST_BLT)
-    {
-        DPRINTF(LOG_INST,("%016llx: blt r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BLT);
-
-        bool take_branch = ((int64_t)reg_rs1 < (int64_t)reg_rs2);
-        if (take_branch)
-            pc += bimm;
-        else
-            pc += 4;
-
-        log_branch(m_pc, pc, take_branch);
-
-        // No writeback
-        rd = 0;
+    memset(&m_decode_pages[0], 0, m_decode_pages.size() * sizeof(uint32_t));
+    memset(&m_nohost_pages[0], 0, m_nohost_pages.size() * sizeof(uint32_t));
+    m_nohost_vpage = DECODE_INVALID;
+}
+//-----------------------------------------------------------------
+// decode_invalidate: Invalidate pre-decoded instructions in a page
+//-----------------------------------------------------------------
+void rv64::decode_invalidate(uint32_t addr)
+{
+    uint32_t page = addr >> DECODE_PGSHIFT;
+    uint32_t idx  = (page << (DECODE_PGSHIFT - 1));
 
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BGE_MASK) == INST_BGE)
+    // A page maps onto a contiguous (wrapping) run of entries
+    for (int i=0;i<(1 << (DECODE_PGSHIFT - 1));i++)
     {
-        DPRINTF(LOG_INST,("%016llx: bge r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BGE);
-
-        bool take_branch = ((int64_t)reg_rs1 >= (int64_t)reg_rs2);
-        if (take_branch)
-            pc += bimm;
-        else
-            pc += 4;
-
-        log_branch(m_pc, pc, take_branch);
-
-        // No writeback
-        rd = 0;
-
-        m_stats[STATS_BRANCHES]++;        
+        t_decoded *inst = &m_decode[(idx + i) & (DECODE_ENTRIES-1)];
+        if ((inst->pc >> DECODE_PGSHIFT) == page)
+            inst->pc = DECODE_INVALID;
     }
-    else if ((opcode & INST_BLTU_MASK) == INST_BLTU)
-    {
-        DPRINTF(LOG_INST,("%016llx: bltu r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BLTU);
-
-        bool take_branch = ((uint64_t)reg_rs1 < (uint64_t)reg_rs2);
-        if (take_branch)
-            pc += bimm;
-        else
-            pc += 4;
-
-        log_branch(m_pc, pc, take_branch);
 
-        // No writeback
-        rd = 0;
-
-        m_stats[STATS_BRANCHES]++;        
-    }
-    else if ((opcode & INST_BGEU_MASK) == INST_BGEU)
+    idx = (page << (DECODE_PGSHIFT - 1));
+    for (int i=0;i<(1 << (DECODE_PGSHIFT - 1));i++)
     {
-        DPRINTF(LOG_INST,("%016llx: bgeu r%d, r%d, %d\n", pc, rs1, rs2, bimm));
-        INST_STAT(ENUM_INST_BGEU);
-
-        bool take_branch = ((uint64_t)reg_rs1 >= (uint64_t)reg_rs2);
-        if (take_branch)
-            pc += bimm;
-        else
-            pc += 4;
-
-        log_branch(m_pc, pc, take_branch);
-
-        // No writeback
-        rd = 0;
-
-        m_stats[STATS_BRANCHES]++;        
+        t_block *block = &m_blocks[(idx + i) & (BLOCK_ENTRIES-1)];
+        if ((block->pc >> DECODE_PGSHIFT) == page)
+            block->pc = DECODE_INVALID;
     }
-    else if ((opcode & INST_LB_MASK) == INST_LB)
-    {
-        DPRINTF(LOG_INST,("%016llx: lb r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LB);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 1, true))
-            pc += 4;
-        else
-            return false;
-    }
-    else if ((opcode & INST_LH_MASK) == INST_LH)
-    {
-        DPRINTF(LOG_INST,("%016llx: lh r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LH);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 2, true))
-            pc += 4;
-        else
-            return false;
-    }
-    else if ((opcode & INST_LW_MASK) == INST_LW)
-    {
-        INST_STAT(ENUM_INST_LW);
-        DPRINTF(LOG_INST,("%016llx: lw r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 4, true))
-            pc += 4;
-        else
-            return false;
-    }
-    else if ((opcode & INST_LBU_MASK) == INST_LBU)
-    {
-        DPRINTF(LOG_INST,("%016llx: lbu r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LBU);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 1, false))
-            pc += 4;
-        else
-            return false;
-    }
-    else if ((opcode & INST_LHU_MASK) == INST_LHU)
-    {
-        DPRINTF(LOG_INST,("%016llx: lhu r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LHU);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 2, false))
-            pc += 4;
-        else
-            return false;
-    }
-    else if ((opcode & INST_LWU_MASK) == INST_LWU)
-    {
-        DPRINTF(LOG_INST,("%016llx: lwu r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        INST_STAT(ENUM_INST_LWU);
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 4, false))
-            pc += 4;
-        else
-            return false;
-    }
-    else if ((opcode & INST_SB_MASK) == INST_SB)
-    {
-        DPRINTF(LOG_INST,("%016llx: sb %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        INST_STAT(ENUM_INST_SB);
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 1))
-            pc += 4;
-        else
-            return false;
 
-        // No writeback
-        rd = 0;
-    }
-    else if ((opcode & INST_SH_MASK) == INST_SH)
+    m_decode_pages[page >> 5] &= ~(1 << (page & 31));
+}
+//-----------------------------------------------------------------
+// invalidate_code: Memory modified outside of the instruction stream
+//-----------------------------------------------------------------
+void rv64::invalidate_code(uint32_t addr, int length)
+{
+    uint64_t end = (uint64_t)addr + length;
+    for (uint64_t a = addr & ~((1 << DECODE_PGSHIFT) - 1); a < end; a += (1 << DECODE_PGSHIFT))
+        if (decode_page_cached(a))
+            decode_invalidate(a);
+}
+//-----------------------------------------------------------------
+// decode_fill: Decode instruction at physical PC into cache entry
+//-----------------------------------------------------------------
+bool rv64::decode_fill(t_decoded *inst, uint32_t phy_pc)
+{
+    // Only directly backed memory is cached (devices may have side effects)
+    uint8_t *host = get_host_ptr(phy_pc);
+    if (!host)
     {
-        DPRINTF(LOG_INST,("%016llx: sh %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        INST_STAT(ENUM_INST_SH);
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 2))
-            pc += 4;
-        else
-            return false;
-
-        // No writeback
-        rd = 0;
+        // Not retried by the decode / block caches (until the next flush)
+        uint32_t page = phy_pc >> DECODE_PGSHIFT;
+        m_nohost_pages[page >> 5] |= (1 << (page & 31));
+        return false;
     }
-    else if ((opcode & INST_SW_MASK) == INST_SW)
-    {
-        DPRINTF(LOG_INST,("%016llx: sw %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        INST_STAT(ENUM_INST_SW);
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 4))
-            pc += 4;
-        else
-            return false;
 
-        // No writeback
-        rd = 0;
-    }
-    else if (m_enable_rvm && (opcode & INST_MUL_MASK) == INST_MUL)
-    {
-        DPRINTF(LOG_INST,("%016llx: mul r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_MUL);
-        reg_rd = (int64_t)reg_rs1 * (int64_t)reg_rs2;
-        pc += 4;        
-    }
-    else if (m_enable_rvm && (opcode & INST_MULH_MASK) == INST_MULH)
-    {
-        long long res = ((long long) (int64_t)reg_rs1) * ((long long)(int64_t)reg_rs2);
-        INST_STAT(ENUM_INST_MULH);
-        DPRINTF(LOG_INST,("%016llx: mulh r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        reg_rd = (int)(res >> 32);
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_MULHSU_MASK) == INST_MULHSU)
-    {
-        long long res = ((long long) (int)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2);
-        INST_STAT(ENUM_INST_MULHSU);
-        DPRINTF(LOG_INST,("%016llx: mulhsu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        reg_rd = (int)(res >> 32);
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_MULHU_MASK) == INST_MULHU)
-    {
-        unsigned long long res = ((unsigned long long) (unsigned)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2);
-        INST_STAT(ENUM_INST_MULHU);
-        DPRINTF(LOG_INST,("%016llx: mulhu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        reg_rd = (int)(res >> 32);
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_DIV_MASK) == INST_DIV)
-    {
-        DPRINTF(LOG_INST,("%016llx: div r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_DIV);
-        if ((int64_t)reg_rs1 == INT64_MIN && (int64_t)reg_rs2 == -1)
-            reg_rd = reg_rs1;
-        else if (reg_rs2 != 0)
-            reg_rd = (int64_t)reg_rs1 / (int64_t)reg_rs2;
-        else
-            reg_rd = (uint64_t)-1;
-        pc += 4;        
-    }
-    else if (m_enable_rvm && (opcode & INST_DIVU_MASK) == INST_DIVU)
+    uint32_t opcode = mem_load16(host);
+    if ((opcode & 3) == 3)
     {
-        DPRINTF(LOG_INST,("%016llx: divu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_DIVU);
-        if (reg_rs2 != 0)
-            reg_rd = (uint64_t)reg_rs1 / (uint64_t)reg_rs2;
-        else
-            reg_rd = (uint64_t)-1;
-        pc += 4;        
+        // Don't cache 32-bit instructions which straddle a page
+        if ((phy_pc & ((1 << DECODE_PGSHIFT) - 1)) == ((1 << DECODE_PGSHIFT) - 2))
+            return false;
+        opcode = mem_load32(host);
     }
-    else if (m_enable_rvm && (opcode & INST_REM_MASK) == INST_REM)
-    {
-        DPRINTF(LOG_INST,("%016llx: rem r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_REM);
 
-        if((int64_t)reg_rs1 == INT64_MIN && (int64_t)reg_rs2 == -1)
-            reg_rd = 0;
-        else if (reg_rs2 != 0)
-            reg_rd = (int64_t)reg_rs1 % (int64_t)reg_rs2;
-        else
-            reg_rd = reg_rs1;
-        pc += 4;        
-    }
-    else if (m_enable_rvm && (opcode & INST_REMU_MASK) == INST_REMU)
-    {
-        DPRINTF(LOG_INST,("%016llx: remu r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_REMU);
-        if (reg_rs2 != 0)
-            reg_rd = (uint64_t)reg_rs1 % (uint64_t)reg_rs2;
-        else
-            reg_rd = reg_rs1;
-        pc += 4;        
-    }
-    else if ((opcode & INST_ECALL_MASK) == INST_ECALL)
-    {
-        DPRINTF(LOG_INST,("%016llx: ecall\n", pc));
-        INST_STAT(ENUM_INST_ECALL);
+    riscv_decode(opcode, decode_flags(), &inst->inst);
 
-        // Semi-hosted system call?
-        if (syscall_handler())
-            pc += 4;
-        else
-        {
-            exception(MCAUSE_ECALL_U + m_csr_mpriv, pc);
-            take_exception   = true;
-        }
-    }
-    else if ((opcode & INST_EBREAK_MASK) == INST_EBREAK)
-    {
-        DPRINTF(LOG_INST,("%016llx: ebreak\n", pc));
-        INST_STAT(ENUM_INST_EBREAK);
+    inst->pc = phy_pc;
 
-        exception(MCAUSE_BREAKPOINT, pc);
-        take_exception   = true;
-        m_break          = true;
-    }
-    else if ((opcode & INST_MRET_MASK) == INST_MRET)
-    {
-        DPRINTF(LOG_INST,("%016llx: mret\n", pc));
-        INST_STAT(ENUM_INST_MRET);
+    uint32_t page = phy_pc >> DECODE_PGSHIFT;
+    m_decode_pages[page >> 5] |= (1 << (page & 31));
+    return true;
+}
+//-----------------------------------------------------------------
+// execute_decoded: Execute a pre-decoded instruction
+//-----------------------------------------------------------------
+bool rv64::execute_decoded(const t_riscv_inst *inst)
+{
+    uint64_t reg_rd  = 0;
+    uint64_t reg_rs1 = m_gpr[inst->rs1];
+    uint64_t reg_rs2 = m_gpr[inst->rs2];
+    int64_t  imm     = inst->imm;
+    uint64_t pc      = m_pc;
+    uint64_t npc     = pc + inst->size;
+    bool take_branch = false;
+    bool take_exception = false;
 
-        assert(m_csr_mpriv == PRIV_MACHINE);
+    switch (inst->op)
+    {
+        case RV_OP_ANDI:  reg_rd = reg_rs1 & imm; break;
+        case RV_OP_ORI:   reg_rd = reg_rs1 | imm; break;
+        case RV_OP_XORI:  reg_rd = reg_rs1 ^ imm; break;
+        case RV_OP_ADDI:  reg_rd = reg_rs1 + imm; break;
+        case RV_OP_SLTI:  reg_rd = (int64_t)reg_rs1 < (int64_t)imm; break;
+        case RV_OP_SLTIU: reg_rd = (uint64_t)reg_rs1 < (uint64_t)imm; break;
+        case RV_OP_SLLI:  reg_rd = reg_rs1 << imm; break;
+        case RV_OP_SRLI:  reg_rd = (uint64_t)reg_rs1 >> imm; break;
+        case RV_OP_SRAI:  reg_rd = (int64_t)reg_rs1 >> imm; break;
+        case RV_OP_LUI:   reg_rd = imm; break;
+        case RV_OP_AUIPC: reg_rd = imm + pc; break;
+        case RV_OP_ADD:   reg_rd = reg_rs1 + reg_rs2; break;
+        case RV_OP_SUB:   reg_rd = reg_rs1 - reg_rs2; break;
+        case RV_OP_SLT:   reg_rd = (int64_t)reg_rs1 < (int64_t)reg_rs2; break;
+        case RV_OP_SLTU:  reg_rd = (uint64_t)reg_rs1 < (uint64_t)reg_rs2; break;
+        case RV_OP_XOR:   reg_rd = reg_rs1 ^ reg_rs2; break;
+        case RV_OP_OR:    reg_rd = reg_rs1 | reg_rs2; break;
+        case RV_OP_AND:   reg_rd = reg_rs1 & reg_rs2; break;
+        case RV_OP_SLL:   reg_rd = reg_rs1 << reg_rs2; break;
+        case RV_OP_SRL:   reg_rd = (uint64_t)reg_rs1 >> reg_rs2; break;
+        case RV_OP_SRA:   reg_rd = (int64_t)reg_rs1 >> reg_rs2; break;
+        case RV_OP_ADDIW: reg_rd = SEXT32(reg_rs1 + imm); break;
+        case RV_OP_SLLIW: reg_rd = SEXT32((reg_rs1 & 0xFFFFFFFF) << (imm & SHIFT_MASK32)); break;
+        case RV_OP_SRLIW: reg_rd = SEXT32((reg_rs1 & 0xFFFFFFFF) >> (imm & SHIFT_MASK32)); break;
+        case RV_OP_SRAIW: reg_rd = SEXT32((int32_t)reg_rs1 >> (imm & SHIFT_MASK32)); break;
+        case RV_OP_ADDW:  reg_rd = SEXT32(reg_rs1 + reg_rs2); break;
+        case RV_OP_SUBW:  reg_rd = SEXT32(reg_rs1 - reg_rs2); break;
+        case RV_OP_SLLW:  reg_rd = SEXT32(reg_rs1 << (reg_rs2 & SHIFT_MASK32)); break;
+        case RV_OP_SRLW:  reg_rd = SEXT32((reg_rs1 & 0xFFFFFFFF) >> (reg_rs2 & SHIFT_MASK32)); break;
+        case RV_OP_SRAW:  reg_rd = SEXT32((int64_t)reg_rs1 >> (reg_rs2 & SHIFT_MASK32)); break;
+        case RV_OP_JAL:
+            reg_rd = npc;
+            npc    = pc + imm;
+
+            // Branch to self: idle until interrupted
+            if (imm == 0)
+                wfi_sleep();
+
+            if (inst->rd == RISCV_REG_RA)
+                log_branch_call(m_pc, npc);
+            else
+                log_branch_jump(m_pc, npc);
 
-        uint64_t s        = m_csr_msr;
-        uint64_t prev_prv = SR_GET_MPP(m_csr_msr);
+            if (inst->size == 4)
+                m_stats[STATS_BRANCHES]++;
+            break;
+        case RV_OP_JALR:
+            reg_rd = npc;
+            npc    = (reg_rs1 + imm) & ~1;
+
+            if (inst->rs1 == RISCV_REG_RA && imm == 0)
+                log_branch_ret(m_pc, npc);
+            else if (inst->rd == RISCV_REG_RA)
+                log_branch_call(m_pc, npc);
+            else
+                log_branch_jump(m_pc, npc);
 
-        // Interrupt enable pop
-        s &= ~SR_MIE;
-        s |= (s & SR_MPIE) ? SR_MIE : 0;
-        s |= SR_MPIE;
+            if (inst->size == 4)
+                m_stats[STATS_BRANCHES]++;
+            break;
+        case RV_OP_BEQ:
+        case RV_OP_BNE:
+        case RV_OP_BLT:
+        case RV_OP_BGE:
+        case RV_OP_BLTU:
+        case RV_OP_BGEU:
+            switch (inst->op)
+            {
+                case RV_OP_BEQ:  take_branch = (reg_rs1 == reg_rs2); break;
+                case RV_OP_BNE:  take_branch = (reg_rs1 != reg_rs2); break;
+                case RV_OP_BLT:  take_branch = ((int64_t)reg_rs1 < (int64_t)reg_rs2); break;
+                case RV_OP_BGE:  take_branch = ((int64_t)reg_rs1 >= (int64_t)reg_rs2); break;
+                case RV_OP_BLTU: take_branch = ((uint64_t)reg_rs1 < (uint64_t)reg_rs2); break;
+                default:         take_branch = ((uint64_t)reg_rs1 >= (uint64_t)reg_rs2); break;
+            }
 
-        // Set next MPP to user mode
-        s &= ~SR_MPP;
-        s |=  SR_MPP_U;
+            if (take_branch)
+                npc = pc + imm;
 
-        // Set privilege level to previous MPP
-        m_csr_mpriv   = prev_prv;
-        m_csr_msr     = s;
+            log_branch(m_pc, npc, take_branch);
 
-        // Return to EPC
-        pc          = m_csr_mepc;
-    }
-    else if ((opcode & INST_SRET_MASK) == INST_SRET)
-    {
-        DPRINTF(LOG_INST,("%016llx: sret\n", pc));
-        INST_STAT(ENUM_INST_SRET);
+            if (inst->size == 4)
+                m_stats[STATS_BRANCHES]++;
+            break;
+        case RV_OP_LB:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 1, true))
+                return false;
+            break;
+        case RV_OP_LH:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 2, true))
+                return false;
+            break;
+        case RV_OP_LW:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 4, true))
+                return false;
+            break;
+        case RV_OP_LD:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 8, true))
+                return false;
+            break;
+        case RV_OP_LBU:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 1, false))
+                return false;
+            break;
+        case RV_OP_LHU:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 2, false))
+                return false;
+            break;
+        case RV_OP_LWU:
+            if (!load(pc, reg_rs1 + imm, &reg_rd, 4, false))
+                return false;
+            break;
+        case RV_OP_SB:
+            if (!store(pc, reg_rs1 + imm, reg_rs2, 1))
+                return false;
+            break;
+        case RV_OP_SH:
+            if (!store(pc, reg_rs1 + imm, reg_rs2, 2))
+                return false;
+            break;
+        case RV_OP_SW:
+            if (!store(pc, reg_rs1 + imm, reg_rs2, 4))
+                return false;
+            break;
+        case RV_OP_SD:
+            if (!store(pc, reg_rs1 + imm, reg_rs2, 8))
+                return false;
+            break;
+        case RV_OP_MUL:
+            reg_rd = (int64_t)reg_rs1 * (int64_t)reg_rs2;
+            break;
+        case RV_OP_MULH:
+        {
+            long long res = ((long long) (int64_t)reg_rs1) * ((long long)(int64_t)reg_rs2);
+            reg_rd = (int)(res >> 32);
+        }
+        break;
+        case RV_OP_MULHSU:
+        {
+            long long res = ((long long) (int)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2);
+            reg_rd = (int)(res >> 32);
+        }
+        break;
+        case RV_OP_MULHU:
+        {
+            unsigned long long res = ((unsigned long long) (unsigned)reg_rs1) * ((unsigned long long)(unsigned)reg_rs2);
+            reg_rd = (int)(res >> 32);
+        }
+        break;
+        case RV_OP_DIV:
+            if ((int64_t)reg_rs1 == INT64_MIN && (int64_t)reg_rs2 == -1)
+                reg_rd = reg_rs1;
+            else if (reg_rs2 != 0)
+                reg_rd = (int64_t)reg_rs1 / (int64_t)reg_rs2;
+            else
+                reg_rd = (uint64_t)-1;
+            break;
+        case RV_OP_DIVU:
+            if (reg_rs2 != 0)
+                reg_rd = (uint64_t)reg_rs1 / (uint64_t)reg_rs2;
+            else
+                reg_rd = (uint64_t)-1;
+            break;
+        case RV_OP_REM:
+            if ((int64_t)reg_rs1 == INT64_MIN && (int64_t)reg_rs2 == -1)
+                reg_rd = 0;
+            else if (reg_rs2 != 0)
+                reg_rd = (int64_t)reg_rs1 % (int64_t)reg_rs2;
+            else
+                reg_rd = reg_rs1;
+            break;
+        case RV_OP_REMU:
+            if (reg_rs2 != 0)
+                reg_rd = (uint64_t)reg_rs1 % (uint64_t)reg_rs2;
+            else
+                reg_rd = reg_rs1;
+            break;
+        case RV_OP_MULW:
+            reg_rd = SEXT32((int64_t)reg_rs1 * (int64_t)reg_rs2);
+            break;
+        case RV_OP_DIVW:
+            if ((int64_t)(int32_t)reg_rs2 != 0)
+                reg_rd = SEXT32((int64_t)(int32_t)reg_rs1 / (int64_t)(int32_t)reg_rs2);
+            else
+                reg_rd = (uint64_t)-1;
+            break;
+        case RV_OP_DIVUW:
+            if ((uint32_t)reg_rs2 != 0)
+                reg_rd = SEXT32((uint32_t)reg_rs1 / (uint32_t)reg_rs2);
+            else
+                reg_rd = (uint64_t)-1;
+            break;
+        case RV_OP_REMW:
+            if ((int64_t)(int32_t)reg_rs2 != 0)
+                reg_rd = SEXT32((int64_t)(int32_t)reg_rs1 % (int64_t)(int32_t)reg_rs2);
+            else
+                reg_rd = reg_rs1;
+            break;
+        case RV_OP_REMUW:
+            if ((uint32_t)reg_rs2 != 0)
+                reg_rd = SEXT32((uint32_t)reg_rs1 % (uint32_t)reg_rs2);
+            else
+                reg_rd = reg_rs1;
+            break;
+        case RV_OP_ECALL:
+            // Semi-hosted system call?
+            if (!syscall_handler())
+            {
+                exception(MCAUSE_ECALL_U + m_csr_mpriv, pc);
+                take_exception = true;
+            }
+            break;
+        case RV_OP_EBREAK:
+            exception(MCAUSE_BREAKPOINT, pc);
+            take_exception = true;
+            m_break        = true;
+            break;
+        case RV_OP_MRET:
+        {
+            assert(m_csr_mpriv == PRIV_MACHINE);
 
-        assert(m_csr_mpriv == PRIV_SUPER);
+            uint64_t s        = m_csr_msr;
+            uint64_t prev_prv = SR_GET_MPP(m_csr_msr);
 
-        uint64_t s        = m_csr_msr;
-        uint64_t prev_prv = (m_csr_msr & SR_SPP) ? PRIV_SUPER : PRIV_USER;
+            // Interrupt enable pop
+            s &= ~SR_MIE;
+            s |= (s & SR_MPIE) ? SR_MIE : 0;
+            s |= SR_MPIE;
 
-        // Interrupt enable pop
-        s &= ~SR_SIE;
-        s |= (s & SR_SPIE) ? SR_SIE : 0;
-        s |= SR_SPIE;
+            // Set next MPP to user mode
+            s &= ~SR_MPP;
+            s |=  SR_MPP_U;
 
-        // Set next SPP to user mode
-        s &= ~SR_SPP;
+            // Set privilege level to previous MPP
+            m_csr_mpriv   = prev_prv;
+            m_csr_msr     = s;
 
-        // Set privilege level to previous MPP
-        m_csr_mpriv   = prev_prv;
-        m_csr_msr     = s;
+            // Return to EPC
+            npc = m_csr_mepc;
+        }
+        break;
+        case RV_OP_SRET:
+        {
+            assert(m_csr_mpriv == PRIV_SUPER);
 
-        // Return to EPC
-        pc          = m_csr_sepc;
-    }
-    else if ( ((opcode & INST_SFENCE_MASK) == INST_SFENCE) ||
-              ((opcode & INST_FENCE_MASK) == INST_FENCE) ||
-              ((opcode & INST_IFENCE_MASK) == INST_IFENCE))
-    {
-        DPRINTF(LOG_INST,("%016llx: fence\n", pc));
-        INST_STAT(ENUM_INST_FENCE);
+            uint64_t s        = m_csr_msr;
+            uint64_t prev_prv = (m_csr_msr & SR_SPP) ? PRIV_SUPER : PRIV_USER;
 
-        // SFENCE.VMA
-        if ((opcode & INST_SFENCE_MASK) == INST_SFENCE)
-            mmu_flush();
-        pc += 4;
-    }
-    else if ((opcode & INST_CSRRW_MASK) == INST_CSRRW)
-    {
-        DPRINTF(LOG_INST,("%016llx: csrw r%d, r%d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRW);
-        take_exception = access_csr(imm12, reg_rs1, true, true, reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }    
-    else if ((opcode & INST_CSRRS_MASK) == INST_CSRRS)
-    {
-        DPRINTF(LOG_INST,("%016llx: csrs r%d, r%d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRS);
-        take_exception = access_csr(imm12, reg_rs1, (rs1 != 0), false, reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_CSRRC_MASK) == INST_CSRRC)
-    {
-        DPRINTF(LOG_INST,("%016llx: csrc r%d, r%d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRC);
-        take_exception = access_csr(imm12, reg_rs1, false, (rs1 != 0), reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_CSRRWI_MASK) == INST_CSRRWI)
-    {
-        DPRINTF(LOG_INST,("%016llx: csrwi r%d, %d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRWI);
-        take_exception = access_csr(imm12, rs1, true, true, reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_CSRRSI_MASK) == INST_CSRRSI)
-    {
-        DPRINTF(LOG_INST,("%016llx: csrsi r%d, %d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRSI);
-        take_exception = access_csr(imm12, rs1, (rs1 != 0), false, reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_CSRRCI_MASK) == INST_CSRRCI)
-    {
-        DPRINTF(LOG_INST,("%016llx: csrci r%d, %d, 0x%x\n", pc, rd, rs1, imm12));
-        INST_STAT(ENUM_INST_CSRRCI);
-        take_exception = access_csr(imm12, rs1, false, (rs1 != 0), reg_rd);
-        if (take_exception)
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        else
-            pc += 4;
-    }
-    else if ((opcode & INST_WFI_MASK) == INST_WFI)
-    {
-        DPRINTF(LOG_INST,("%016llx: wfi\n", pc));
-        INST_STAT(ENUM_INST_WFI);
-        pc += 4;
-    }
-    else if ((opcode & INST_SD_MASK) == INST_SD)
-    {
-        // ['imm12hi', 'rs1', 'rs2', 'imm12lo']
-        DPRINTF(LOG_INST,("%016llx: sd %d(r%d), r%d\n", pc, storeimm, rs1, rs2));
-        if (store(pc, reg_rs1 + storeimm, reg_rs2, 8))
-            pc += 4;
-        else
-            return false;
+            // Interrupt enable pop
+            s &= ~SR_SIE;
+            s |= (s & SR_SPIE) ? SR_SIE : 0;
+            s |= SR_SPIE;
 
-        INST_STAT(ENUM_INST_SD);
+            // Set next SPP to user mode
+            s &= ~SR_SPP;
 
-        // No writeback
-        rd = 0;
-    }
-    else if ((opcode & INST_LD_MASK) == INST_LD)
-    {        
-        // ['rd', 'rs1', 'imm12']
-        DPRINTF(LOG_INST,("%016llx: ld r%d, %d(r%d)\n", pc, rd, imm12, rs1));
-        if (load(pc, reg_rs1 + imm12, &reg_rd, 8, true))
-            pc += 4;
-        else
-            return false;
+            // Set privilege level to previous MPP
+            m_csr_mpriv   = prev_prv;
+            m_csr_msr     = s;
 
-        INST_STAT(ENUM_INST_LD);
-    }
-    else if ((opcode & INST_ADDIW_MASK) == INST_ADDIW)
-    {
-        // ['rd', 'rs1', 'imm12']
-        INST_STAT(ENUM_INST_ADDIW);
-        reg_rd = SEXT32(reg_rs1 + imm12);
-        pc += 4;
-        DPRINTF(LOG_INST,("%016llx: addiw r%d, r%d, %d\n", pc, rd, rs1, imm12));
-    }
-    else if ((opcode & INST_ADDW_MASK) == INST_ADDW)
-    {
-        // ['rd', 'rs1', 'rs2']
-        INST_STAT(ENUM_INST_ADDW);
-        reg_rd = SEXT32(reg_rs1 + reg_rs2);
-        pc += 4;
-        DPRINTF(LOG_INST,("%016llx: addw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-    }
-    else if ((opcode & INST_SUBW_MASK) == INST_SUBW)
-    {
-        // ['rd', 'rs1', 'rs2']
-        INST_STAT(ENUM_INST_SUBW);
-        reg_rd = SEXT32(reg_rs1 - reg_rs2);
-        pc += 4;
-        DPRINTF(LOG_INST,("%016llx: subw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-    }
-    else if ((opcode & INST_SLLIW_MASK) == INST_SLLIW)
-    {
-        reg_rs1 &= 0xFFFFFFFF;
-        shamt &= SHIFT_MASK32;
+            // Return to EPC
+            npc = m_csr_sepc;
+        }
+        break;
+        case RV_OP_FENCE:
+            break;
+        case RV_OP_WFI:
+            wfi_sleep();
+            break;
+        case RV_OP_FENCE_I:
+            decode_flush();
+            break;
+        case RV_OP_SFENCE_VMA:
+            mmu_fence(inst->rs1 != 0, reg_rs1, inst->rs2 != 0, reg_rs2);
+            break;
+        case RV_OP_CSRRW:
+        case RV_OP_CSRRS:
+        case RV_OP_CSRRC:
+        case RV_OP_CSRRWI:
+        case RV_OP_CSRRSI:
+        case RV_OP_CSRRCI:
+        {
+            // CSRR*I: rs1 field is the immediate operand
+            uint64_t data = (inst->op >= RV_OP_CSRRWI) ? inst->rs1 : reg_rs1;
+            bool     set  = (inst->op == RV_OP_CSRRW || inst->op == RV_OP_CSRRWI) ||
+                            ((inst->op == RV_OP_CSRRS || inst->op == RV_OP_CSRRSI) && inst->rs1 != 0);
+            bool     clr  = (inst->op == RV_OP_CSRRW || inst->op == RV_OP_CSRRWI) ||
+                            ((inst->op == RV_OP_CSRRC || inst->op == RV_OP_CSRRCI) && inst->rs1 != 0);
+
+            take_exception = access_csr(imm, data, set, clr, reg_rd);
+            if (take_exception)
+                exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, SEXT32(inst->opcode));
+        }
+        break;
+        case RV_OP_AMOADD_W:
+        case RV_OP_AMOXOR_W:
+        case RV_OP_AMOOR_W:
+        case RV_OP_AMOAND_W:
+        case RV_OP_AMOMIN_W:
+        case RV_OP_AMOMAX_W:
+        case RV_OP_AMOMINU_W:
+        case RV_OP_AMOMAXU_W:
+        case RV_OP_AMOSWAP_W:
+        {
+            uint64_t physical = 0;
+            uint8_t *host     = NULL;
+            if (!atomic_translate(pc, reg_rs1, 4, true, &physical, &host))
+                return false;
 
-        // ['rd', 'rs1']        
-        INST_STAT(ENUM_INST_SLLIW);
-        reg_rd = SEXT32(reg_rs1 << shamt);
-        pc += 4;
-        DPRINTF(LOG_INST,("%016llx: slliw r%d, r%d, %d\n", pc, rd, rs1, shamt));
-    }
-    else if ((opcode & INST_SRLIW_MASK) == INST_SRLIW)
-    {
-        shamt &= SHIFT_MASK32;
-        reg_rs1 &= 0xFFFFFFFF;
+            // Devices: read / modify / write serialised between harts
+            smp_atomic_guard atomic(m_smp, !host);
 
-        // ['rd', 'rs1', 'shamt']        
-        INST_STAT(ENUM_INST_SRLIW);
-        reg_rd = SEXT32((uint64_t)reg_rs1 >> shamt);
-        pc += 4;
-        DPRINTF(LOG_INST,("%016llx: srliw r%d, r%d, %d\n", pc, rd, rs1, shamt));
-    }
-    else if ((opcode & INST_SRAIW_MASK) == INST_SRAIW)
-    {
-        reg_rs1 &= 0xFFFFFFFF;
-        shamt &= SHIFT_MASK32;
+            // Read
+            uint32_t old;
+            if (host)
+                old = mem_atomic_load32(host);
+            else if (load(pc, reg_rs1, &reg_rd, 4, true))
+                old = reg_rd;
+            else
+                return false;
 
-        // ['rd', 'rs1', 'shamt']        
-        INST_STAT(ENUM_INST_SRAIW);
-        reg_rd = SEXT32((int32_t)reg_rs1 >> shamt);
-        pc += 4;
-        DPRINTF(LOG_INST,("%016llx: sraiw r%d, r%d, %d\n", pc, rd, rs1, shamt));
-    }
-    else if ((opcode & INST_SLLW_MASK) == INST_SLLW)
-    {
-        reg_rs2 &= SHIFT_MASK32;
+            // Modify (retried if another hart wrote the word)
+            uint32_t val;
+            do
+            {
+                val = reg_rs2;
+                switch (inst->op)
+                {
+                    case RV_OP_AMOADD_W:  val = old + reg_rs2; break;
+                    case RV_OP_AMOXOR_W:  val = old ^ reg_rs2; break;
+                    case RV_OP_AMOOR_W:   val = old | reg_rs2; break;
+                    case RV_OP_AMOAND_W:  val = old & reg_rs2; break;
+                    case RV_OP_AMOMIN_W:  if ((int32_t)old < (int32_t)reg_rs2) val = old; break;
+                    case RV_OP_AMOMAX_W:  if ((int32_t)old > (int32_t)reg_rs2) val = old; break;
+                    case RV_OP_AMOMINU_W: if ((uint32_t)old < (uint32_t)reg_rs2) val = old; break;
+                    case RV_OP_AMOMAXU_W: if ((uint32_t)old > (uint32_t)reg_rs2) val = old; break;
+                    default: break;
+                }
+            }
+            while (host && !mem_cas32(host, &old, val));
 
-        // ['rd', 'rs1', 'rs2']        
-        INST_STAT(ENUM_INST_SLLW);
-        reg_rd = SEXT32(reg_rs1 << reg_rs2);
-        pc += 4;
-        DPRINTF(LOG_INST,("%016llx: sllw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-    }
-    else if ((opcode & INST_SRLW_MASK) == INST_SRLW)
-    {
-        reg_rs1 &= 0xFFFFFFFF;
-        reg_rs2 &= SHIFT_MASK32;
+            reg_rd = SEXT32(old);
 
-        // ['rd', 'rs1', 'rs2']
-        INST_STAT(ENUM_INST_SRLW);
-        reg_rd = SEXT32((uint64_t)reg_rs1 >> reg_rs2);
-        pc += 4;
-        DPRINTF(LOG_INST,("%016llx: srlw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-    }
-    else if ((opcode & INST_SRAW_MASK) == INST_SRAW)
-    {
-        reg_rs2 &= SHIFT_MASK32;
+            // Write
+            if (host)
+            {
+                atomic_access(reg_rs1, physical, false, reg_rd, 4);
+                atomic_access(reg_rs1, physical, true, val, 4);
+            }
+            else if (!store(pc, reg_rs1, val, 4))
+                return false;
 
-        // ['rd', 'rs1', 'rs2']        
-        INST_STAT(ENUM_INST_SRAW);
-        reg_rd = SEXT32((int64_t)reg_rs1 >> reg_rs2);
-        pc += 4;
-        DPRINTF(LOG_INST,("%016llx: sraw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-    }
-    else if (m_enable_rvm && (opcode & INST_MULW_MASK) == INST_MULW)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%016llx: mulw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_MULW);
-        reg_rd = SEXT32((int64_t)reg_rs1 * (int64_t)reg_rs2);
-        pc += 4;        
-    }
-    else if (m_enable_rvm && (opcode & INST_DIVW_MASK) == INST_DIVW)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%016llx: divw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_DIVW);
-        if ((int64_t)(int32_t)reg_rs2 != 0)
-            reg_rd = SEXT32((int64_t)(int32_t)reg_rs1 / (int64_t)(int32_t)reg_rs2);
-        else
-            reg_rd = (uint64_t)-1;
-        pc += 4;        
-    }
-    else if (m_enable_rvm && (opcode & INST_DIVUW_MASK) == INST_DIVUW)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%016llx: divuw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_DIVUW);
-        if ((uint32_t)reg_rs2 != 0)
-            reg_rd = SEXT32((uint32_t)reg_rs1 / (uint32_t)reg_rs2);
-        else
-            reg_rd = (uint64_t)-1;
-        pc += 4;        
-    }
-    else if (m_enable_rvm && (opcode & INST_REMW_MASK) == INST_REMW)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%016llx: remw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_REMW);
+            smp_atomic_store(physical);
+        }
+        break;
+        case RV_OP_AMOADD_D:
+        case RV_OP_AMOXOR_D:
+        case RV_OP_AMOOR_D:
+        case RV_OP_AMOAND_D:
+        case RV_OP_AMOMIN_D:
+        case RV_OP_AMOMAX_D:
+        case RV_OP_AMOMINU_D:
+        case RV_OP_AMOMAXU_D:
+        case RV_OP_AMOSWAP_D:
+        {
+            uint64_t physical = 0;
+            uint8_t *host     = NULL;
+            if (!atomic_translate(pc, reg_rs1, 8, true, &physical, &host))
+                return false;
 
-        if ((int64_t)(int32_t)reg_rs2 != 0)
-            reg_rd = SEXT32((int64_t)(int32_t)reg_rs1 % (int64_t)(int32_t)reg_rs2);
-        else
-            reg_rd = reg_rs1;
-        pc += 4;
-    }
-    else if (m_enable_rvm && (opcode & INST_REMUW_MASK) == INST_REMUW)
-    {
-        // ['rd', 'rs1', 'rs2']
-        DPRINTF(LOG_INST,("%016llx: remuw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        INST_STAT(ENUM_INST_REMUW);
+            // Devices: read / modify / write serialised between harts
+            smp_atomic_guard atomic(m_smp, !host);
 
-        if ((uint32_t)reg_rs2 != 0)
-            reg_rd = SEXT32((uint32_t)reg_rs1 % (uint32_t)reg_rs2);
-        else
-            reg_rd = reg_rs1;
-        pc += 4;
-    }
-    //-----------------------------------------------------------------
-    // A Extension
-    //-----------------------------------------------------------------
-    else if (m_enable_rva && (opcode & INST_AMOADD_W_MASK) == INST_AMOADD_W)
-    {
-        DPRINTF(LOG_INST,("%016llx: amoadd.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+            // Read
+            if (host)
+                reg_rd = mem_atomic_load64(host);
+            else if (!load(pc, reg_rs1, &reg_rd, 8, true))
+                return false;
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+            // Modify (retried if another hart wrote the word)
+            uint64_t val;
+            do
+            {
+                val = reg_rs2;
+                switch (inst->op)
+                {
+                    case RV_OP_AMOADD_D:  val = reg_rd + reg_rs2; break;
+                    case RV_OP_AMOXOR_D:  val = reg_rd ^ reg_rs2; break;
+                    case RV_OP_AMOOR_D:   val = reg_rd | reg_rs2; break;
+                    case RV_OP_AMOAND_D:  val = reg_rd & reg_rs2; break;
+                    case RV_OP_AMOMIN_D:  if ((int64_t)reg_rd < (int64_t)reg_rs2) val = reg_rd; break;
+                    case RV_OP_AMOMAX_D:  if ((int64_t)reg_rd > (int64_t)reg_rs2) val = reg_rd; break;
+                    case RV_OP_AMOMINU_D: if ((uint64_t)reg_rd < (uint64_t)reg_rs2) val = reg_rd; break;
+                    case RV_OP_AMOMAXU_D: if ((uint64_t)reg_rd > (uint64_t)reg_rs2) val = reg_rd; break;
+                    default: break;
+                }
+            }
+            while (host && !mem_cas64(host, &reg_rd, val));
 
-        // Modify
-        uint32_t val = reg_rd + reg_rs2;
+            // Write
+            if (host)
+            {
+                atomic_access(reg_rs1, physical, false, reg_rd, 8);
+                atomic_access(reg_rs1, physical, true, val, 8);
+            }
+            else if (!store(pc, reg_rs1, val, 8))
+                return false;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+            smp_atomic_store(physical);
+        }
+        break;
+        case RV_OP_LR_W:
+        case RV_OP_LR_D:
+        {
+            int      width    = (inst->op == RV_OP_LR_D) ? 8 : 4;
+            uint64_t physical = 0;
+            uint8_t *host     = NULL;
+            if (!atomic_translate(pc, reg_rs1, width, false, &physical, &host))
+                return false;
 
-        INST_STAT(ENUM_INST_ADD);
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOXOR_W_MASK) == INST_AMOXOR_W)
-    {
-        DPRINTF(LOG_INST,("%016llx: amoxor.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+            // Reserve before the read (a store after it breaks the reservation)
+            smp_reserve(physical);
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+            if (host)
+            {
+                reg_rd = (width == 8) ? mem_atomic_load64(host) : SEXT32(mem_atomic_load32(host));
+                atomic_access(reg_rs1, physical, false, reg_rd, width);
+            }
+            else if (!load(pc, reg_rs1, &reg_rd, width, true))
+                return false;
 
-        // Modify
-        uint32_t val = reg_rd ^ reg_rs2;
+            // Record load address and value (SC also fails if the word changed)
+            m_load_res = reg_rs1;
+            m_load_val = reg_rd;
+        }
+        break;
+        case RV_OP_SC_W:
+        case RV_OP_SC_D:
+            reg_rd = 1;
+            if (m_load_res == reg_rs1)
+            {
+                int      width    = (inst->op == RV_OP_SC_D) ? 8 : 4;
+                uint64_t physical = 0;
+                uint8_t *host     = NULL;
+                if (!atomic_translate(pc, reg_rs1, width, true, &physical, &host))
+                    return false;
+
+                // Write if the reservation is still held and the word still
+                // holds the value LR returned
+                if (host)
+                {
+                    uint64_t expected64 = m_load_val;
+                    uint32_t expected32 = m_load_val;
+                    if (smp_take_reservation(physical) &&
+                        ((width == 8) ? mem_cas64(host, &expected64, reg_rs2) : mem_cas32(host, &expected32, reg_rs2)))
+                    {
+                        atomic_access(reg_rs1, physical, true, reg_rs2, width);
+                        smp_atomic_store(physical);
+                        reg_rd = 0;
+                    }
+                }
+                else
+                {
+                    smp_atomic_guard atomic(m_smp, true);
+                    if (smp_take_reservation(physical) && sc_check(physical, width))
+                    {
+                        if (!store(pc, reg_rs1, reg_rs2, width))
+                            return false;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+                        smp_atomic_store(physical);
+                        reg_rd = 0;
+                    }
+                }
+            }
 
-        INST_STAT(ENUM_INST_XOR);
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
+            m_load_res = 0;
+            break;
+        default:
+            assert(!"Invalid pre-decoded instruction");
+            break;
     }
-    else if (m_enable_rva && (opcode & INST_AMOOR_W_MASK) == INST_AMOOR_W)
-    {
-        DPRINTF(LOG_INST,("%016llx: amoor.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
-
-        // Modify
-        uint32_t val = reg_rd | reg_rs2;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
-
-        INST_STAT(ENUM_INST_OR);
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOAND_W_MASK) == INST_AMOAND_W)
+    if (inst->rd != 0 && !take_exception)
     {
-        DPRINTF(LOG_INST,("%016llx: amoand.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
-
-        // Modify
-        uint32_t val = reg_rd & reg_rs2;
-
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
-
-        INST_STAT(ENUM_INST_AND);
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
+        m_gpr[inst->rd] = reg_rd;
+        if (m_trace_file)
+            m_trace_file->reg(inst->rd, reg_rd);
     }
-    else if (m_enable_rva && (opcode & INST_AMOMIN_W_MASK) == INST_AMOMIN_W)
-    {
-        DPRINTF(LOG_INST,("%016llx: amomin.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+    // Monitor executed instructions
+    log_commit_pc(m_pc_x);
 
-        // Modify
-        uint32_t val = reg_rs2;
-        if ((int32_t)reg_rd < (int32_t)reg_rs2)
-            val = reg_rd;
+    if (take_exception)
+        return true;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+    // Pending interrupt
+    if ((m_csr_mip & m_csr_mie) && check_interrupts(npc))
+        return true;
 
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOMAX_W_MASK) == INST_AMOMAX_W)
-    {
-        DPRINTF(LOG_INST,("%016llx: amomax.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+    m_pc = npc;
+    return true;
+}
+//-----------------------------------------------------------------
+// block_mode: Privilege / translation mode blocks are tagged with
+//-----------------------------------------------------------------
+uint32_t rv64::block_mode(void)
+{
+    // Machine mode - no MMU
+    if (m_csr_mpriv > PRIV_SUPER)
+        return PRIV_MACHINE;
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
+    return m_csr_mpriv | ((m_csr_satp & SATP_MODE) ? 4 : 0);
+}
+//-----------------------------------------------------------------
+// block_find: Lookup (or build) the basic block at the current PC
+//-----------------------------------------------------------------
+rv64::t_block *rv64::block_find(void)
+{
+    // Misaligned fetch faults are raised by the single step path
+    if (m_pc & (m_enable_rvc ? 1 : 3))
+        return NULL;
 
-        // Modify
-        uint32_t val = reg_rs2;
-        if ((int32_t)reg_rd > (int32_t)reg_rs2)
-            val = reg_rd;
+    // Still on the page which had no host pointer, straight to execute()
+    if ((m_pc >> DECODE_PGSHIFT) == m_nohost_vpage && m_csr_mpriv == m_nohost_priv && m_block_epoch == m_nohost_epoch)
+        return NULL;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
+    uint64_t phy_pc = m_pc;
+    if (!soft_tlb_lookup(SOFT_TLB_EXEC, m_csr_mpriv, m_pc, &phy_pc) && !mmu_i_translate(m_pc, &phy_pc))
+        return NULL;
 
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOMINU_W_MASK) == INST_AMOMINU_W)
+    // Blocks are only built from directly backed pages of the 32-bit physical map
+    if ((phy_pc >> 32) || decode_page_nohost(phy_pc))
     {
-        DPRINTF(LOG_INST,("%016llx: amominu.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
-
-        // Modify
-        uint32_t val = reg_rs2;
-        if ((uint32_t)reg_rd < (uint32_t)reg_rs2)
-            val = reg_rd;
-
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
-
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
+        m_nohost_vpage = m_pc >> DECODE_PGSHIFT;
+        m_nohost_priv  = m_csr_mpriv;
+        m_nohost_epoch = m_block_epoch;
+        return NULL;
     }
-    else if (m_enable_rva && (opcode & INST_AMOMAXU_W_MASK) == INST_AMOMAXU_W)
-    {
-        DPRINTF(LOG_INST,("%016llx: amomaxu.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
 
-        // Modify
-        uint32_t val = reg_rs2;
-        if ((uint32_t)reg_rd > (uint32_t)reg_rs2)
-            val = reg_rd;
+    uint32_t mode  = block_mode();
+    t_block *block = &m_blocks[(phy_pc >> 1) & (BLOCK_ENTRIES-1)];
+    bool hit = (block->pc == phy_pc && block->mode == mode);
+    HOST_STATS_HIT(hit, COUNT_BLOCK_HIT, COUNT_BLOCK_MISS);
+    if (hit)
+        return block;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 4))
-            return false;
-
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOSWAP_W_MASK) == INST_AMOSWAP_W)
+    return block_build(block, phy_pc, mode) ? block : NULL;
+}
+//-----------------------------------------------------------------
+// block_build: Decode instructions up to the end of a basic block
+//-----------------------------------------------------------------
+bool rv64::block_build(t_block *block, uint32_t phy_pc, uint32_t mode)
+{
+    // Only directly backed memory is cached (devices may have side effects)
+    uint8_t *host = get_host_ptr(phy_pc);
+    if (!host)
     {
-        DPRINTF(LOG_INST,("%016llx: amoswap.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
-
-        // Write
-        if (!store(pc, reg_rs1, reg_rs2, 4))
-            return false;
-
-        INST_STAT(ENUM_INST_LW);
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
+        // Not retried by the decode / block caches (until the next flush)
+        uint32_t page = phy_pc >> DECODE_PGSHIFT;
+        m_nohost_pages[page >> 5] |= (1 << (page & 31));
+        return false;
     }
-    else if (m_enable_rva && (opcode & INST_LR_W_MASK) == INST_LR_W)
-    {
-        DPRINTF(LOG_INST,("%016llx: lr.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        if (!load(pc, reg_rs1, &reg_rd, 4, true))
-            return false;
 
-        // Record load address
-        m_load_res = reg_rs1;
+    uint32_t flags = decode_flags();
 
-        INST_STAT(ENUM_INST_LW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_SC_W_MASK) == INST_SC_W)
+    // Blocks never cross a page (physically contiguous, one translation)
+    uint32_t offset = phy_pc & ((1 << DECODE_PGSHIFT) - 1);
+    uint32_t end    = (1 << DECODE_PGSHIFT);
+    int      count  = 0;
+
+    while (count < BLOCK_MAX_INSTS && offset < end)
     {
-        DPRINTF(LOG_INST,("%016llx: sc.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        if (m_load_res == reg_rs1)
+        uint32_t opcode = mem_load16(host);
+        if ((opcode & 3) == 3)
         {
-            // Write
-            if (!store(pc, reg_rs1, reg_rs2, 4))
-                return false;
-
-            reg_rd = 0;
+            if (offset + 4 > end)
+                break;
+            opcode = mem_load32(host);
         }
-        else
-            reg_rd = 1;
-
-        m_load_res = 0;
-        INST_STAT(ENUM_INST_SW);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOADD_D_MASK) == INST_AMOADD_D)
-    {
-        DPRINTF(LOG_INST,("%016llx: amoadd.w r%d, r%d, r%d\n", pc, rd, rs1, rs2));
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
+        // Unsupported encodings are left to the full decoder
+        t_riscv_inst *inst = &block->inst[count];
+        if (!riscv_decode(opcode, flags, inst))
+            break;
 
-        // Modify
-        uint64_t val = reg_rd + reg_rs2;
+        count++;
+        host   += inst->size;
+        offset += inst->size;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 8))
-            return false;
+        if (riscv_ends_block(inst->op))
+            break;
 
-        INST_STAT(ENUM_INST_ADD);
-        INST_STAT(ENUM_INST_LD);
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
+        // Stop PC of run() (page offset, so any mapping of the page ends here)
+        if ((offset - inst->size) == (m_run_stop_pc & ((1 << DECODE_PGSHIFT) - 1)))
+            break;
     }
-    else if (m_enable_rva && (opcode & INST_AMOXOR_D_MASK) == INST_AMOXOR_D)
-    {
-        DPRINTF(LOG_INST,("%016llx: amoxor.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
-
-        // Modify
-        uint64_t val = reg_rd ^ reg_rs2;
-
-        // Write
-        if (!store(pc, reg_rs1, val, 8))
-            return false;
-
-        INST_STAT(ENUM_INST_XOR);
-        INST_STAT(ENUM_INST_LD);
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOOR_D_MASK) == INST_AMOOR_D)
+    block->inst[count].op   = RV_OP_ILLEGAL;
+    block->inst[count].size = 0;
+    if (count == 0)
     {
-        DPRINTF(LOG_INST,("%016llx: amoor.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
-
-        // Modify
-        uint64_t val = reg_rd | reg_rs2;
-
-        // Write
-        if (!store(pc, reg_rs1, val, 8))
-            return false;
-
-        INST_STAT(ENUM_INST_OR);
-        INST_STAT(ENUM_INST_LD);
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
+        block->pc = DECODE_INVALID;
+        return false;
     }
-    else if (m_enable_rva && (opcode & INST_AMOAND_D_MASK) == INST_AMOAND_D)
-    {
-        DPRINTF(LOG_INST,("%016llx: amoand.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
 
-        // Modify
-        uint64_t val = reg_rd & reg_rs2;
+    block->pc         = phy_pc;
+    block->mode       = mode;
+    block->count      = count;
+    block->link[0]    = NULL;
+    block->link[1]    = NULL;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 8))
-            return false;
-
-        INST_STAT(ENUM_INST_AND);
-        INST_STAT(ENUM_INST_LD);
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOMIN_D_MASK) == INST_AMOMIN_D)
-    {
-        DPRINTF(LOG_INST,("%016llx: amomin.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+    // Stores to this page must drop the block
+    uint32_t page = phy_pc >> DECODE_PGSHIFT;
+    m_decode_pages[page >> 5] |= (1 << (page & 31));
+    return true;
+}
+//-----------------------------------------------------------------
+// block_next: Follow (or create) the chain to the successor block
+//-----------------------------------------------------------------
+rv64::t_block *rv64::block_next(t_block *block, int succ, uint64_t entry_pc)
+{
+    uint32_t tag   = block->pc;
+    t_block *next  = block->link[succ];
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
+    // Chained: same successor PC, translations unchanged, not evicted
+    if (next && block->link_epoch == m_block_epoch && block->link_pc[succ] == m_pc &&
+        next->pc == block->link_phy[succ] && next->mode == block->mode)
+        return next;
 
-        // Modify
-        uint64_t val = reg_rs2;
-        if ((int64_t)reg_rd < (int64_t)reg_rs2)
-            val = reg_rd;
+    next = block_find();
+    if (!next || block->pc != tag || next->mode != block->mode)
+        return next;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 8))
-            return false;
+    // Under translation only chain within the page that was looked up
+    if ((block->mode & 4) && ((entry_pc ^ m_pc) >> DECODE_PGSHIFT))
+        return next;
 
-        INST_STAT(ENUM_INST_LD);
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOMAX_D_MASK) == INST_AMOMAX_D)
+    if (block->link_epoch != m_block_epoch)
     {
-        DPRINTF(LOG_INST,("%016llx: amomax.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
-
-        // Modify
-        uint64_t val = reg_rs2;
-        if ((int64_t)reg_rd > (int64_t)reg_rs2)
-            val = reg_rd;
-
-        // Write
-        if (!store(pc, reg_rs1, val, 8))
-            return false;
-
-        INST_STAT(ENUM_INST_LD);
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
+        block->link[0]    = NULL;
+        block->link[1]    = NULL;
+        block->link_epoch = m_block_epoch;
     }
-    else if (m_enable_rva && (opcode & INST_AMOMINU_D_MASK) == INST_AMOMINU_D)
-    {
-        DPRINTF(LOG_INST,("%016llx: amominu.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
-
-        // Modify
-        uint64_t val = reg_rs2;
-        if ((uint64_t)reg_rd < (uint64_t)reg_rs2)
-            val = reg_rd;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 8))
-            return false;
+    block->link[succ]     = next;
+    block->link_pc[succ]  = m_pc;
+    block->link_phy[succ] = next->pc;
+    return next;
+}
+//-----------------------------------------------------------------
+// block_execute: Execute a basic block using threaded dispatch.
+// Returns the number of instructions executed, succ is the chain link
+// to the successor block (-1 = none).
+//-----------------------------------------------------------------
+int rv64::block_execute(t_block *block, int *succ)
+{
+    // Handlers (indexed by eRiscvOp)
+    static const void *dispatch[] =
+    {
+        &&op_end,                                                   // ILLEGAL (end of block)
+        &&op_lui,   &&op_auipc, &&op_jal,   &&op_jalr,
+        &&op_beq,   &&op_bne,   &&op_blt,   &&op_bge,   &&op_bltu,  &&op_bgeu,
+        &&op_lb,    &&op_lh,    &&op_lw,    &&op_lbu,   &&op_lhu,   &&op_lwu,   &&op_ld,
+        &&op_sb,    &&op_sh,    &&op_sw,    &&op_sd,
+        &&op_addi,  &&op_slti,  &&op_sltiu, &&op_xori,  &&op_ori,   &&op_andi,
+        &&op_slli,  &&op_srli,  &&op_srai,
+        &&op_add,   &&op_sub,   &&op_sll,   &&op_slt,   &&op_sltu,  &&op_xor,
+        &&op_srl,   &&op_sra,   &&op_or,    &&op_and,
+        &&op_addiw, &&op_slliw, &&op_srliw, &&op_sraiw,
+        &&op_addw,  &&op_subw,  &&op_sllw,  &&op_srlw,  &&op_sraw,
+        &&op_fence, &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,              // FENCE .. EBREAK
+        &&op_slow,  &&op_slow,  &&op_slow,                                      // MRET, SRET, WFI
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  // CSR*
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,                          // M
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,              // M *W
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  // A (W)
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  // A (D)
+        &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow,  &&op_slow
+    };
+    static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == RV_OP_MAX, "Dispatch table mismatch");
+
+    const t_riscv_inst *inst = block->inst;
+    uint32_t tag   = block->pc;
+    uint64_t pc    = m_pc;
+    int      count = 0;
+
+    *succ = -1;
+
+#define RS1             m_gpr[inst->rs1]
+#define RS2             m_gpr[inst->rs2]
+#define IMM             ((int64_t)inst->imm)
+#define WRITE_RD(v)     do { m_gpr[inst->rd] = (v); m_gpr[0] = 0; } while (0)
+#define DISPATCH()      goto *dispatch[inst->op]
+#define NEXT()          do { if (m_monitor) log_commit_pc(pc); pc += inst->size; inst++; count++; DISPATCH(); } while (0)
+#define LOAD(w, s)      do { uint64_t v; m_pc = pc; \
+                             if (!load(pc, RS1 + IMM, &v, w, s)) goto fault; \
+                             WRITE_RD(v); NEXT(); } while (0)
+#define STORE(w)        do { m_pc = pc; \
+                             if (!store(pc, RS1 + IMM, RS2, w)) goto fault; \
+                             if (block->pc != tag) goto modified; \
+                             NEXT(); } while (0)
+#define BRANCH(c)       do { bool taken = (c); \
+                             uint64_t npc = taken ? pc + IMM : pc + inst->size; \
+                             if (m_monitor) log_branch(pc, npc, taken); \
+                             if (inst->size == 4) m_stats[STATS_BRANCHES]++; \
+                             if (m_monitor) log_commit_pc(pc); \
+                             m_pc_x = pc; m_pc = npc; *succ = taken; \
+                             return count + 1; } while (0)
+
+    DISPATCH();
+
+op_lui:     WRITE_RD(IMM); NEXT();
+op_auipc:   WRITE_RD(pc + IMM); NEXT();
+op_addi:    WRITE_RD(RS1 + IMM); NEXT();
+op_slti:    WRITE_RD((int64_t)RS1 < IMM); NEXT();
+op_sltiu:   WRITE_RD(RS1 < (uint64_t)IMM); NEXT();
+op_xori:    WRITE_RD(RS1 ^ IMM); NEXT();
+op_ori:     WRITE_RD(RS1 | IMM); NEXT();
+op_andi:    WRITE_RD(RS1 & IMM); NEXT();
+op_slli:    WRITE_RD(RS1 << IMM); NEXT();
+op_srli:    WRITE_RD(RS1 >> IMM); NEXT();
+op_srai:    WRITE_RD((int64_t)RS1 >> IMM); NEXT();
+op_add:     WRITE_RD(RS1 + RS2); NEXT();
+op_sub:     WRITE_RD(RS1 - RS2); NEXT();
+op_sll:     WRITE_RD(RS1 << (RS2 & 63)); NEXT();
+op_slt:     WRITE_RD((int64_t)RS1 < (int64_t)RS2); NEXT();
+op_sltu:    WRITE_RD(RS1 < RS2); NEXT();
+op_xor:     WRITE_RD(RS1 ^ RS2); NEXT();
+op_srl:     WRITE_RD(RS1 >> (RS2 & 63)); NEXT();
+op_sra:     WRITE_RD((int64_t)RS1 >> (RS2 & 63)); NEXT();
+op_or:      WRITE_RD(RS1 | RS2); NEXT();
+op_and:     WRITE_RD(RS1 & RS2); NEXT();
+op_addiw:   WRITE_RD(SEXT32(RS1 + IMM)); NEXT();
+op_slliw:   WRITE_RD(SEXT32((RS1 & 0xFFFFFFFF) << (IMM & SHIFT_MASK32))); NEXT();
+op_srliw:   WRITE_RD(SEXT32((RS1 & 0xFFFFFFFF) >> (IMM & SHIFT_MASK32))); NEXT();
+op_sraiw:   WRITE_RD(SEXT32((int32_t)RS1 >> (IMM & SHIFT_MASK32))); NEXT();
+op_addw:    WRITE_RD(SEXT32(RS1 + RS2)); NEXT();
+op_subw:    WRITE_RD(SEXT32(RS1 - RS2)); NEXT();
+op_sllw:    WRITE_RD(SEXT32(RS1 << (RS2 & SHIFT_MASK32))); NEXT();
+op_srlw:    WRITE_RD(SEXT32((RS1 & 0xFFFFFFFF) >> (RS2 & SHIFT_MASK32))); NEXT();
+op_sraw:    WRITE_RD(SEXT32((int64_t)RS1 >> (RS2 & SHIFT_MASK32))); NEXT();
+op_fence:   WRITE_RD(0); NEXT();
+
+op_lb:      LOAD(1, true);
+op_lh:      LOAD(2, true);
+op_lw:      LOAD(4, true);
+op_ld:      LOAD(8, true);
+op_lbu:     LOAD(1, false);
+op_lhu:     LOAD(2, false);
+op_lwu:     LOAD(4, false);
+op_sb:      STORE(1);
+op_sh:      STORE(2);
+op_sw:      STORE(4);
+op_sd:      STORE(8);
+
+op_beq:     BRANCH(RS1 == RS2);
+op_bne:     BRANCH(RS1 != RS2);
+op_blt:     BRANCH((int64_t)RS1 <  (int64_t)RS2);
+op_bge:     BRANCH((int64_t)RS1 >= (int64_t)RS2);
+op_bltu:    BRANCH(RS1 <  RS2);
+op_bgeu:    BRANCH(RS1 >= RS2);
+
+op_jal:
+{
+    uint64_t npc = pc + IMM;
+    WRITE_RD(pc + inst->size);
 
-        INST_STAT(ENUM_INST_LD);
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOMAXU_D_MASK) == INST_AMOMAXU_D)
+    if (m_monitor)
     {
-        DPRINTF(LOG_INST,("%016llx: amomaxu.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
+        if (inst->rd == RISCV_REG_RA)
+            log_branch_call(pc, npc);
+        else
+            log_branch_jump(pc, npc);
+    }
 
-        // Modify
-        uint64_t val = reg_rs2;
-        if ((uint64_t)reg_rd > (uint64_t)reg_rs2)
-            val = reg_rd;
+    if (inst->size == 4)
+        m_stats[STATS_BRANCHES]++;
 
-        // Write
-        if (!store(pc, reg_rs1, val, 8))
-            return false;
+    if (m_monitor)
+        log_commit_pc(pc);
+    m_pc_x = pc;
+    m_pc   = npc;
+    *succ  = 1;
+    return count + 1;
+}
+op_jalr:
+{
+    uint64_t npc = (RS1 + IMM) & ~1;
+    WRITE_RD(pc + inst->size);
 
-        INST_STAT(ENUM_INST_LD);
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_AMOSWAP_D_MASK) == INST_AMOSWAP_D)
+    if (m_monitor)
     {
-        DPRINTF(LOG_INST,("%016llx: amoswap.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
+        if (inst->rs1 == RISCV_REG_RA && inst->imm == 0)
+            log_branch_ret(pc, npc);
+        else if (inst->rd == RISCV_REG_RA)
+            log_branch_call(pc, npc);
+        else
+            log_branch_jump(pc, npc);
+    }
 
-        // Read
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
+    if (inst->size == 4)
+        m_stats[STATS_BRANCHES]++;
 
-        // Write
-        if (!store(pc, reg_rs1, reg_rs2, 8))
-            return false;
+    if (m_monitor)
+        log_commit_pc(pc);
+    m_pc_x = pc;
+    m_pc   = npc;
+    *succ  = 1;
+    return count + 1;
+}
 
-        INST_STAT(ENUM_INST_LD);
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
-    }
-    else if (m_enable_rva && (opcode & INST_LR_D_MASK) == INST_LR_D)
+op_slow:
+    // System, CSR, multiply / divide and atomic operations
+    m_pc   = pc;
+    m_pc_x = pc;
+
+    // Counted before any side effects (stats dump on a SIM_CTRL exit)
+    m_stats[STATS_INSTRUCTIONS] += count + 1 - m_block_counted;
+    m_block_counted = count + 1;
+
+    if (!execute_decoded(inst))
+        return count + 1;
+
+    count++;
+
+    // Trap / interrupt, block end or code modified
+    if (m_pc != pc + inst->size || inst[1].op == RV_OP_ILLEGAL || block->pc != tag)
+        return count;
+
+    pc = m_pc;
+    inst++;
+    DISPATCH();
+
+op_end:
+    // Fall-through to the next sequential block
+    m_pc_x = pc - inst[-1].size;
+    m_pc   = pc;
+    *succ  = 0;
+    return count;
+
+modified:
+    // Store hit this block, refetch the successor
+    if (m_monitor)
+        log_commit_pc(pc);
+    m_pc_x = pc;
+    m_pc   = pc + inst->size;
+    return count + 1;
+
+fault:
+    // Load / store exception (m_pc is the trap vector)
+    m_pc_x = pc;
+    return count + 1;
+
+#undef RS1
+#undef RS2
+#undef IMM
+#undef WRITE_RD
+#undef DISPATCH
+#undef NEXT
+#undef LOAD
+#undef STORE
+#undef BRANCH
+}
+//-----------------------------------------------------------------
+// time_set: Set the timer (mtime) value from the current cycle
+//-----------------------------------------------------------------
+void rv64::time_set(uint64_t value)
+{
+    m_time_base  = value;
+    m_time_cycle = m_cycle_now;
+    timer_rearm();
+}
+//-----------------------------------------------------------------
+// timer_rearm: Schedule the (non-std) mtimecmp interrupt as a single
+// event on the cycle the timer reaches the compare value
+//-----------------------------------------------------------------
+void rv64::timer_rearm(void)
+{
+    if (!m_enable_mtimecmp || !m_csr_mtime_ie)
     {
-        DPRINTF(LOG_INST,("%016llx: lr.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        if (!load(pc, reg_rs1, &reg_rd, 8, true))
-            return false;
+        timer_arm(SCHED_NEVER);
+        return;
+    }
 
-        // Record load address
-        m_load_res = reg_rs1;
+    uint64_t now = time_now();
+    if (m_csr_mtimecmp <= now)
+    {
+        timer_arm(0);
+        return;
+    }
+    uint64_t target = m_csr_mtimecmp;
 
-        INST_STAT(ENUM_INST_LD);
-        pc += 4;
+    // First cycle the timer reads target (ticks are applied at the end
+    // of the previous step)
+    uint64_t ticks = target - m_time_base;
+    if (ticks > (SCHED_NEVER - m_time_cycle) / m_timebase_div)
+        timer_arm(SCHED_NEVER);
+    else
+    {
+        uint64_t when = m_time_cycle + ticks * m_timebase_div;
+        timer_arm(when ? (when - 1) : 0);
     }
-    else if (m_enable_rva && (opcode & INST_SC_D_MASK) == INST_SC_D)
+}
+//-----------------------------------------------------------------
+// timer_expired: mtimecmp reached
+//-----------------------------------------------------------------
+void rv64::timer_expired(void)
+{
+    if (m_enable_mtimecmp && m_csr_mtime_ie)
     {
-        DPRINTF(LOG_INST,("%016llx: sc.d r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-        if (m_load_res == reg_rs1)
-        {
-            // Write
-            if (!store(pc, reg_rs1, reg_rs2, 8))
-                return false;
+        m_csr_mip     |= m_enable_sbi ? SR_IP_STIP : SR_IP_MTIP;
+        m_csr_mtime_ie = false;
+    }
+}
+//-----------------------------------------------------------------
+// wfi_idle: Hart asleep, skip idle cycles up to the next device or
+// timer event (and before end). Returns the number of cycles skipped.
+//-----------------------------------------------------------------
+uint64_t rv64::wfi_idle(uint64_t cycles, uint64_t end)
+{
+    uint64_t next = sched_next_event();
 
-            reg_rd = 0;
-        }
-        else
-            reg_rd = 1;
+    if (next < cycles)
+        next = cycles;
+    if (next >= end)
+        next = end - 1;
 
-        m_load_res = 0;
-        INST_STAT(ENUM_INST_SD);
-        pc += 4;
-    }
-    //-----------------------------------------------------------------
-    // C Extension
-    //-----------------------------------------------------------------
-    // RVC - Quadrant 0
-    else if (m_enable_rvc && ((opcode & 3) == 0))
-    {
-        opcode &= 0xFFFF;
-        rvc_decode rvc(opcode);
+    // Time passes, devices / timer due at the last idle cycle are clocked
+    m_cycle_now = next;
+    cpu::step(next);
 
-        rs1     = rvc.rs1s();
-        rs2     = rvc.rs2s();
-        rd      = rs2;
-        reg_rs1 = m_gpr[rs1];
-        reg_rs2 = m_gpr[rs2];        
+    // Wake on a pending (enabled) interrupt
+    if (m_csr_mip & m_csr_mie)
+        m_wfi = false;
 
-        // C.ADDI4SPN
-        if ((opcode >> 13) == 0 && opcode != 0)
-        {
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-
-            uint64_t imm = rvc.addi4spn_imm();
-            DPRINTF(LOG_INST,("%016llx: c.addi4spn r%d,r%d,%d\n", pc, rd, rs1, imm));
-            INST_STAT(ENUM_INST_ADDI);
-            reg_rd = reg_rs1 + imm;
-            pc += 2;
-        }
-        // C.LW
-        else if ((opcode >> 13) == 2)
-        {
-            uint64_t imm = rvc.lw_imm();
-            DPRINTF(LOG_INST,("%016llx: c.lw r%d, %d(r%d)\n", pc, rd, imm, rs1));
-            INST_STAT(ENUM_INST_LW);
-            if (load(pc, reg_rs1 + imm, &reg_rd, 4, true))
-                pc += 2;
-            else
-                return false;
-        }
-        // C.LD
-        else if ((opcode >> 13) == 3)
-        {
-            uint64_t imm = rvc.ld_imm();
-            DPRINTF(LOG_INST,("%016llx: c.ld r%d, %d(r%d)\n", pc, rd, imm, rs1));
-            INST_STAT(ENUM_INST_LD);
-            if (load(pc, reg_rs1 + imm, &reg_rd, 8, true))
-                pc += 2;
-            else
-                return false;
-        }
-        // C.SW
-        else if ((opcode >> 13) == 6)
-        {
-            uint64_t imm = rvc.lw_imm();
-            DPRINTF(LOG_INST,("%016llx: c.sw %d(r%d), r%d\n", pc, imm, rs1, rd));
-            INST_STAT(ENUM_INST_SW);
-            if (store(pc, reg_rs1 + imm, reg_rs2, 4))
-                pc += 2;
-            else
-                return false;
+    log_idle(next - cycles + 1);
+    return next - cycles + 1;
+}
+//-----------------------------------------------------------------
+// step_block: Execute chained basic blocks (up to max_steps).
+// Timer, interrupts and devices are updated once per block.
+//-----------------------------------------------------------------
+int rv64::step_block(uint64_t cycles, int max_steps)
+{
+    t_block *block = NULL;
 
-            // No writeback
-            rd = 0;
-        }
-        // C.SD
-        else if ((opcode >> 13) == 7)
-        {
-            uint64_t imm = rvc.ld_imm();
-            DPRINTF(LOG_INST,("%016llx: c.sd %d(r%d), r%d\n", pc, imm, rs1, rd));
-            INST_STAT(ENUM_INST_SD);
-            if (store(pc, reg_rs1 + imm, reg_rs2, 8))
-                pc += 2;
-            else
-                return false;
+    m_device_event = false;
 
-            // No writeback
-            rd = 0;
-        }
-        // Illegal instruction
-        else
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-    }
-    // RVC - Quadrant 1 (top half - c.nop - c.lui)
-    else if (m_enable_rvc && ((opcode & 3) == 1) && (((opcode & 0xFFFF) >> 13) < 4))
-    {
-        opcode &= 0xFFFF;
-        rvc_decode rvc(opcode);
+    // Asleep, fast-forward to the next event
+    if (m_wfi)
+        return (int)wfi_idle(cycles, cycles + max_steps);
 
-        rs1     = rvc.rs1();
-        rs2     = rvc.rs2();
-        rd      = rs1;
-        reg_rs1 = m_gpr[rs1];
-        reg_rs2 = m_gpr[rs2];
+    // Tracing and breakpoints need the per-instruction path
+    if (!m_trace && !m_trace_file && !m_has_breakpoints && max_steps >= BLOCK_MAX_INSTS)
+        block = block_find();
 
-        // C.NOP
-        if ((opcode >> 13) == 0 && opcode == 0)
-        {
-            DPRINTF(LOG_INST,("%016llx: c.nop\n", pc));
-            INST_STAT(ENUM_INST_ADDI);
-            pc += 2;
-        }
-        // C.ADDI
-        else if ((opcode >> 13) == 0)
-        {
-            int64_t imm = rvc.imm();
-            DPRINTF(LOG_INST,("%016llx: c.addi r%d, %d\n", pc, rs1, imm));
-            INST_STAT(ENUM_INST_ADDI);
-            reg_rd = reg_rs1 + imm;
-            pc += 2;
-        }
-        // C.ADDIW
-        else if ((opcode >> 13) == 1)
-        {
-            int64_t imm = rvc.imm();
-            DPRINTF(LOG_INST,("%016llx: c.addiw r%d, %d\n", pc, rs1, imm));
-            INST_STAT(ENUM_INST_ADDIW);
-            reg_rd = SEXT32(reg_rs1 + imm);
-            pc += 2;
-        }
-        // C.LI
-        else if ((opcode >> 13) == 2)
-        {
-            uint64_t imm = rvc.imm();
-            DPRINTF(LOG_INST,("%016llx: c.li r%d, %d\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_LUI);
-            reg_rd = imm;
-            pc += 2;
-        }
-        // C.ADDI16SP
-        else if ((opcode >> 13) == 3 && ((opcode >> 7) & 0x1f) == 2)
-        {
-            uint64_t imm = rvc.addi16sp_imm();
-            rd      = RISCV_REG_SP;
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-            DPRINTF(LOG_INST,("%016llx: c.addi16sp r%d, r%d, %d\n", pc, rd, rs1, imm));
-            INST_STAT(ENUM_INST_ADDI);
-            reg_rd  = reg_rs1 + imm;
-            pc += 2;
-        }
-        // C.LUI
-        else if ((opcode >> 13) == 3)
-        {
-            uint64_t imm = rvc.imm() << 12;
-            DPRINTF(LOG_INST,("%016llx: c.lui r%d, 0x%x\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_LUI);
-            reg_rd  = imm;
-            pc += 2;
-        }
-        // Illegal instruction
-        else
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
+    if (!block)
+    {
+        step(cycles);
+        return 1;
     }
-    // RVC - Quadrant 1 (bottom half - c.srli -)
-    else if (m_enable_rvc && ((opcode & 3) == 1))
+
+    int total = 0;
+    while (block)
     {
-        opcode &= 0xFFFF;
-        rvc_decode rvc(opcode);
+        uint64_t entry_pc = m_pc;
+        int      succ;
 
-        rs1     = rvc.rs1s();
-        rs2     = rvc.rs2s();
-        rd      = rs1;
-        reg_rs1 = m_gpr[rs1];
-        reg_rs2 = m_gpr[rs2];
+        m_cycle_now = cycles + total;
+        m_block_counted = 0;
+        int      count    = block_execute(block, &succ);
 
-        // C.SRLI
-        if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x3) == 0)
-        {
-            uint64_t imm = rvc.zimm();
-            DPRINTF(LOG_INST,("%016llx: c.srli r%d, %d\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_SRLI);
-            reg_rd = (uint64_t)reg_rs1 >> imm;
-            pc += 2;
-        }
-        // C.SRAI
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x3) == 1)
-        {
-            uint64_t imm = rvc.zimm();
-            DPRINTF(LOG_INST,("%016llx: c.srai r%d, %d\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_SRAI);
-            reg_rd = (int64_t)reg_rs1 >> imm;
-            pc += 2;
-        }
-        // C.ANDI
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x3) == 2)
-        {
-            uint64_t imm = rvc.imm();
-            DPRINTF(LOG_INST,("%016llx: c.andi r%d, 0x%08x\n", pc, rd, imm));
-            INST_STAT(ENUM_INST_ANDI);
-            reg_rd = reg_rs1 & imm;
-            pc += 2;
-        }
-        // C.SUB
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 3 && ((opcode >> 5) & 0x3) == 0)
-        {
-            DPRINTF(LOG_INST,("%016llx: c.sub r%d, r%d\n", pc, rs1, rs2));
-            INST_STAT(ENUM_INST_SUB);
-            reg_rd = (int64_t)(reg_rs1 - reg_rs2);
-            pc += 2;
-        }
-        // C.XOR
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 3 && ((opcode >> 5) & 0x3) == 1)
-        {
-            DPRINTF(LOG_INST,("%016llx: c.xor r%d, r%d\n", pc, rs1, rs2));
-            INST_STAT(ENUM_INST_XOR);
-            reg_rd = reg_rs1 ^ reg_rs2;
-            pc += 2;
-        }
-        // C.OR
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 3 && ((opcode >> 5) & 0x3) == 2)
-        {
-            DPRINTF(LOG_INST,("%016llx: c.or r%d, r%d\n", pc, rs1, rs2));
-            INST_STAT(ENUM_INST_OR);
-            reg_rd = reg_rs1 | reg_rs2;
-            pc += 2;
-        }
-        // C.AND
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 3 && ((opcode >> 5) & 0x3) == 3)
-        {
-            DPRINTF(LOG_INST,("%016llx: c.and r%d, r%d\n", pc, rs1, rs2));
-            INST_STAT(ENUM_INST_AND);
-            reg_rd = reg_rs1 & reg_rs2;
-            pc += 2;
-        }
-        // C.SUBW
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 7 && ((opcode >> 5) & 0x3) == 0)
-        {
-            DPRINTF(LOG_INST,("%016llx: c.subw r%d, r%d\n", pc, rs1, rs2));
-            INST_STAT(ENUM_INST_SUBW);
-            reg_rd = SEXT32(reg_rs1 - reg_rs2);
-            pc += 2;
-        }
-        // C.ADDW
-        else if ((opcode >> 13) == 4 && ((opcode >> 10) & 0x7) == 7 && ((opcode >> 5) & 0x3) == 1)
-        {
-            DPRINTF(LOG_INST,("%016llx: c.addw r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-            INST_STAT(ENUM_INST_ADDW);
-            reg_rd = SEXT32(reg_rs1 + reg_rs2);
-            pc += 2;
-        }
-        // C.J
-        else if ((opcode >> 13) == 5)
-        {
-            uint64_t imm = rvc.j_imm();
-            DPRINTF(LOG_INST,("%016llx: c.j 0x%08x\n", pc, pc + imm));
-            INST_STAT(ENUM_INST_J);
-            pc += imm;
-            log_branch_jump(m_pc, pc);
-            rd = 0;
-        }
-        // C.BEQZ
-        else if ((opcode >> 13) == 6)
-        {
-            uint64_t imm = rvc.b_imm();
+        total += count;
+        m_stats[STATS_INSTRUCTIONS] += count - m_block_counted;
 
-            DPRINTF(LOG_INST,("%016llx: c.beqz r%d, %d\n", pc, rs1, imm));
-            INST_STAT(ENUM_INST_BEQ);
-            bool take_branch = (reg_rs1 == 0);
-            if (take_branch)
-                pc += imm;
-            else
-                pc += 2;
-            log_branch(m_pc, pc, take_branch);
-            rd = 0;
-        }
-        // C.BNEZ
-        else if ((opcode >> 13) == 7)
-        {
-            uint64_t imm = rvc.b_imm();
-            DPRINTF(LOG_INST,("%016llx: c.bnez r%d, %d\n", pc, rs1, imm));
-            INST_STAT(ENUM_INST_BNE);
-            bool take_branch = (reg_rs1 != 0);
-            if (take_branch)
-                pc += imm;
-            else
-                pc += 2;
-            log_branch(m_pc, pc, take_branch);
-            rd = 0;
-        }
-        // Illegal instruction
-        else
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
-    }
-    // RVC - Quadrant 2
-    else if (m_enable_rvc && ((opcode & 3) == 2))
-    {
-        opcode &= 0xFFFF;
+        // Clock peripherals
+        cpu::step(cycles + total - 1);
 
-        rvc_decode rvc(opcode);
-        rs1     = rvc.rs1();
-        rs2     = rvc.rs2();
-        rd      = rs1;
-        reg_rs1 = m_gpr[rs1];
-        reg_rs2 = m_gpr[rs2];
+        // Pending interrupt
+        if ((m_csr_mip & m_csr_mie) && check_interrupts(m_pc))
+            break;
 
-        // C.SLLI
-        if ((opcode >> 13) == 0)
-        {
-            uint64_t imm = rvc.zimm();
-            DPRINTF(LOG_INST,("%016llx: c.slli r%d, %d\n", pc, rs1, imm));
-            INST_STAT(ENUM_INST_SLLI);
-            reg_rd = reg_rs1 << imm;
-            pc += 2;
-        }
-        // C.LWSP
-        else if ((opcode >> 13) == 2)
-        {
-            uint64_t imm = rvc.lwsp_imm();
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-
-            DPRINTF(LOG_INST,("%016llx: c.lwsp r%d, %d(r%d)\n", pc, rd, imm, rs1));
-            INST_STAT(ENUM_INST_LW);
-            if (load(pc, reg_rs1 + imm, &reg_rd, 4, true))
-                pc += 2;
-            else
-                return false;
-        }
-        // C.LDSP
-        else if ((opcode >> 13) == 3)
-        {
-            uint64_t imm = rvc.ldsp_imm();
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-
-            DPRINTF(LOG_INST,("%016llx: c.ldsp r%d, %d(r%d)\n", pc, rd, imm, rs1));
-            INST_STAT(ENUM_INST_LW);
-            if (load(pc, reg_rs1 + imm, &reg_rd, 8, true))
-                pc += 2;
-            else
-                return false;
-        }
-        // C.JR
-        // C.MV
-        // C.EBREAK
-        // C.JALR
-        // C.ADD
-        else if ((opcode >> 13) == 4)
-        {
-            if (!(opcode & (1 << 12)))
-            {
-                // C.JR
-                if (((opcode >> 2) & 0x1F) == 0)
-                {
-                    rd = 0;
-                    DPRINTF(LOG_INST,("%016llx: c.jr r%d\n", pc, rs1));
-                    INST_STAT(ENUM_INST_J);
-                    pc = reg_rs1 & ~1;
-                    if (rs1 == RISCV_REG_RA)
-                        log_branch_ret(m_pc, pc);
-                    else
-                        log_branch_jump(m_pc, pc);
-                }
-                // C.MV
-                else
-                {
-                    DPRINTF(LOG_INST,("%016llx: c.mv r%d, r%d\n", pc, rd, rs2));
-                    INST_STAT(ENUM_INST_ADD);
-                    pc += 2;
-                    reg_rd = reg_rs2;
-                }
-            }
-            else
-            {
-                // C.EBREAK
-                if (((opcode >> 7) & 0x1F) == 0 && ((opcode >> 2) & 0x1F) == 0)
-                {
-                    rd = 0;
-                    DPRINTF(LOG_INST,("%016llx: c.ebreak\n", pc));
-                    INST_STAT(ENUM_INST_EBREAK);
+        if (succ < 0 || (total + BLOCK_MAX_INSTS) > max_steps || m_stopped || m_fault || m_break)
+            break;
 
-                    exception(MCAUSE_BREAKPOINT, pc);
-                    take_exception   = true;
-                    m_break          = true;
-                }
-                // C.JALR
-                else if (((opcode >> 2) & 0x1F) == 0)
-                {
-                    rd = RISCV_REG_RA;
-                    DPRINTF(LOG_INST,("%016llx: c.jalr r%d, r%d\n", pc, rd, rs1));
-                    INST_STAT(ENUM_INST_JALR);
-                    reg_rd = pc + 2;
-                    pc     = reg_rs1 & ~1;
-                    if (rs1 == RISCV_REG_RA)
-                        log_branch_ret(m_pc, pc);
-                    else
-                        log_branch_call(m_pc, pc);
-                }
-                // C.ADD
-                else
-                {
-                    DPRINTF(LOG_INST,("%016llx: c.add r%d, r%d, r%d\n", pc, rd, rs1, rs2));
-                    INST_STAT(ENUM_INST_ADD);
-                    reg_rd = reg_rs1 + reg_rs2;
-                    pc += 2;
-                }
-            }
-        }
-        // C.SWSP
-        else if ((opcode >> 13) == 6)
-        {
-            uint64_t uimm = rvc.swsp_imm();
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-            DPRINTF(LOG_INST,("%016llx: c.swsp r%d, %d(r%d)\n", pc, rs2, uimm, rs1));
-            INST_STAT(ENUM_INST_SW);
-
-            if (store(pc, reg_rs1 + uimm, reg_rs2, 4))
-                pc += 2;
-            else
-                return false;
+        // Device event or run() stop PC
+        if (m_device_event || m_pc_x == m_run_stop_pc)
+            break;
 
-            // No writeback
-            rd = 0;            
-        }
-        // C.SDSP
-        else if ((opcode >> 13) == 7)
-        {
-            uint64_t uimm = rvc.sdsp_imm();
-            rs1     = RISCV_REG_SP;
-            reg_rs1 = m_gpr[rs1];
-            DPRINTF(LOG_INST,("%016llx: c.sdsp r%d, %d(r%d)\n", pc, rs2, uimm, rs1));
-            INST_STAT(ENUM_INST_SW);
-
-            if (store(pc, reg_rs1 + uimm, reg_rs2, 8))
-                pc += 2;
-            else
-                return false;
+        // Branch to self (idle loop) / WFI
+        if (block->count == 1 && block->inst[0].op == RV_OP_JAL && block->inst[0].imm == 0)
+            wfi_sleep();
+        if (m_wfi)
+            break;
 
-            // No writeback
-            rd = 0; 
-        }
-        // Illegal instruction
-        else
-        {
-            error(false, "Bad instruction @ %x (opcode %x)\n", pc, opcode);
-            exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-            m_fault        = true;
-            take_exception = true;
-        }
+        block = block_next(block, succ, entry_pc);
     }
-    else
-    {
-        exception(MCAUSE_ILLEGAL_INSTRUCTION, pc, opcode);
-        take_exception = true;
-    }
-
-    if (rd != 0 && !take_exception)
-        m_gpr[rd] = reg_rd;
 
-    // Monitor executed instructions
-    log_commit_pc(m_pc_x);
+    return total;
+}
+//-----------------------------------------------------------------
+// run: Execute up to max_steps instructions as chained basic blocks
+//-----------------------------------------------------------------
+int rv64::run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc)
+{
+    uint64_t end = cycles + max_steps;
 
-    // Pending interrupt
-    if (!take_exception && (m_csr_mip & m_csr_mie))
+    // Cached blocks are split at the stop PC
+    uint64_t stop = (stop_pc == RUN_NO_STOP_PC) ? DECODE_INVALID : (uint64_t)stop_pc;
+    if (stop != m_run_stop_pc)
     {
-        uint64_t pending_interrupts = (m_csr_mip & m_csr_mie);
-        uint64_t m_enabled          = m_csr_mpriv < PRIV_MACHINE || (m_csr_mpriv == PRIV_MACHINE && (m_csr_msr & SR_MIE));
-        uint64_t s_enabled          = m_csr_mpriv < PRIV_SUPER   || (m_csr_mpriv == PRIV_SUPER   && (m_csr_msr & SR_SIE));
-        uint64_t m_interrupts       = pending_interrupts & ~m_csr_mideleg & -m_enabled;
-        uint64_t s_interrupts       = pending_interrupts & m_csr_mideleg & -s_enabled;
-        uint64_t interrupts         = m_interrupts ? m_interrupts : s_interrupts;
+        m_run_stop_pc = stop;
+        decode_flush();
+    }
 
-        // Interrupt pending and mask enabled
-        if (interrupts)
-        {
-            //printf("Take Interrupt...: %08x\n", interrupts);
-            int i;
+    m_device_event = false;
+    while (cycles < end)
+    {
+        uint64_t budget = end - cycles;
+        if (m_wfi)
+            cycles += wfi_idle(cycles, end);
+        else
+            cycles += rv64::step_block(cycles, budget < RUN_BLOCK_STEPS ? (int)budget : RUN_BLOCK_STEPS);
 
-            for (i=IRQ_MIN;i<IRQ_MAX;i++)
-            {
-                if (interrupts & (1 << i))
-                {
-                    // Only service one interrupt per cycle
-                    DPRINTF(LOG_INST,( "Interrupt%d taken...\n", i));
-                    exception(MCAUSE_INTERRUPT + i, pc);
-                    take_exception = true;
-                    break;
-                }
-            }
-        }
+        int status = run_status(m_pc_x, stop_pc);
+        if (status != RUN_BUDGET)
+            return status;
     }
 
-    if (!take_exception)
-        m_pc = pc;
-
-    return true;
+    return RUN_BUDGET;
 }
 //-----------------------------------------------------------------
 // step: Step through one instruction
 //-----------------------------------------------------------------
 void rv64::step(uint64_t cycles)
 {
+    // Asleep (one idle cycle)
+    if (m_wfi)
+    {
+        wfi_idle(cycles, cycles + 1);
+        return;
+    }
+
+    m_cycle_now = cycles;
     m_stats[STATS_INSTRUCTIONS]++;
 
     // Execute instruction at current PC
+    uint64_t traced = m_trace_file ? m_trace_file->get_insts() : 0;
     int max_steps = 2;
     while (max_steps-- && !execute())
-        ;
-
-    // Increment timer counter
-    m_csr_mtime++;
-
-    // Non-std: Timer should generate an internal interrupt?
-    if (m_enable_mtimecmp)
     {
-        if (m_csr_mtime == m_csr_mtimecmp && m_csr_mtime_ie)
+        // Faulting instruction, the handler runs in the same step
+        if (m_trace_file && m_trace_file->get_insts() != traced)
         {
-            m_csr_mip     |= m_enable_sbi ? SR_IP_STIP : SR_IP_MTIP;
-            m_csr_mtime_ie = false;
+            m_trace_file->abort();
+            traced = m_trace_file->get_insts();
         }
     }
 
@@ -2732,8 +2506,12 @@ void rv64::step(uint64_t cycles)
 //-----------------------------------------------------------------
 void rv64::set_interrupt(int irq)
 {
-    assert(irq == IRQ_M_EXT || irq == IRQ_M_TIMER);
-    if (irq == IRQ_M_EXT)
+    assert(irq == IRQ_M_EXT || irq == IRQ_M_TIMER || irq == IRQ_M_SOFT || irq == IRQ_S_SOFT);
+    if (irq == IRQ_M_SOFT)
+        m_csr_mip |= SR_IP_MSIP;
+    else if (irq == IRQ_S_SOFT)
+        m_csr_mip |= SR_IP_SSIP;
+    else if (irq == IRQ_M_EXT)
 #ifdef CPU_INTERRUPT_MEIP_ONLY
         m_csr_mip |= (SR_IP_MEIP);
 #else
@@ -2745,29 +2523,7 @@ void rv64::set_interrupt(int irq)
 #ifdef CPU_INTERRUPT_ON_SET
     // Pending interrupt
     if (m_csr_mip & m_csr_mie)
-    {
-        uint64_t pending_interrupts = (m_csr_mip & m_csr_mie);
-        uint64_t m_enabled          = m_csr_mpriv < PRIV_MACHINE || (m_csr_mpriv == PRIV_MACHINE && (m_csr_msr & SR_MIE));
-        uint64_t s_enabled          = m_csr_mpriv < PRIV_SUPER   || (m_csr_mpriv == PRIV_SUPER   && (m_csr_msr & SR_SIE));
-        uint64_t m_interrupts       = pending_interrupts & ~m_csr_mideleg & -m_enabled;
-        uint64_t s_interrupts       = pending_interrupts & m_csr_mideleg & -s_enabled;
-        uint64_t interrupts         = m_interrupts ? m_interrupts : s_interrupts;
-
-        // Interrupt pending and mask enabled
-        if (interrupts)
-        {
-            for (int i=IRQ_MIN;i<IRQ_MAX;i++)
-            {
-                if (interrupts & (1 << i))
-                {
-                    // Only service one interrupt per cycle
-                    DPRINTF(LOG_INST,( "Interrupt%d taken...\n", i));
-                    exception(MCAUSE_INTERRUPT + i, m_pc);
-                    break;
-                }
-            }
-        }
-    }
+        check_interrupts(m_pc);
 #endif
 }
 //-----------------------------------------------------------------
@@ -2775,8 +2531,12 @@ void rv64::set_interrupt(int irq)
 //-----------------------------------------------------------------
 void rv64::clr_interrupt(int irq)
 {
-    assert(irq == IRQ_M_TIMER || irq == IRQ_M_EXT);
-    if (irq == IRQ_M_TIMER && !m_enable_mtimecmp)
+    assert(irq == IRQ_M_TIMER || irq == IRQ_M_EXT || irq == IRQ_M_SOFT || irq == IRQ_S_SOFT);
+    if (irq == IRQ_M_SOFT)
+        m_csr_mip &= ~SR_IP_MSIP;
+    else if (irq == IRQ_S_SOFT)
+        m_csr_mip &= ~SR_IP_SSIP;
+    else if (irq == IRQ_M_TIMER && !m_enable_mtimecmp)
         m_csr_mip &= ~SR_IP_MTIP;
     else if (irq == IRQ_M_EXT)
     {
@@ -2788,6 +2548,136 @@ void rv64::clr_interrupt(int irq)
     }
 }
 //-----------------------------------------------------------------
+// remote_fence: FENCE.I / SFENCE.VMA requested by another hart
+//-----------------------------------------------------------------
+void rv64::remote_fence(uint32_t mask)
+{
+    if (mask & FENCE_VMA)
+        mmu_flush();
+    if (mask & FENCE_I)
+        decode_flush();
+}
+//-----------------------------------------------------------------
+// serialize_arch: Checkpoint architectural state. The TLB and the
+// decoded instruction caches are not saved, just flushed on restore.
+//-----------------------------------------------------------------
+bool rv64::serialize_arch(checkpoint &cp)
+{
+    cp.section("rv64", 1);
+
+    cp.io(m_gpr);
+    cp.io(m_pc);
+    cp.io(m_pc_x);
+    cp.io(m_load_res);
+    cp.io(m_load_val);
+
+    cp.io(m_csr_mepc);
+    cp.io(m_csr_mcause);
+    cp.io(m_csr_msr);
+    cp.io(m_csr_mpriv);
+    cp.io(m_csr_mevec);
+    cp.io(m_csr_mtval);
+    cp.io(m_csr_mie);
+    cp.io(m_csr_mip);
+    cp.io(m_csr_mtimecmp);
+    cp.io(m_csr_mtime_ie);
+    cp.io(m_csr_mscratch);
+    cp.io(m_csr_mideleg);
+    cp.io(m_csr_medeleg);
+
+    cp.io(m_cycle_now);
+    cp.io(m_time_cycle);
+    cp.io(m_time_base);
+
+    cp.io(m_csr_sepc);
+    cp.io(m_csr_sevec);
+    cp.io(m_csr_scause);
+    cp.io(m_csr_stval);
+    cp.io(m_csr_satp);
+    cp.io(m_csr_sscratch);
+
+    cp.io(m_wfi);
+
+    if (cp.is_restore())
+    {
+        mmu_flush();
+        decode_flush();
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------
+// atomic_translate: Translate the address of an AMO / LR / SC (must be
+// naturally aligned). *host is set if the word is directly backed memory.
+//-----------------------------------------------------------------
+int rv64::atomic_translate(uint64_t pc, uint64_t address, int width, bool write, uint64_t *physical, uint8_t **host)
+{
+    *host = NULL;
+
+    if (address & (width-1))
+    {
+        exception(write ? MCAUSE_MISALIGNED_STORE : MCAUSE_MISALIGNED_LOAD, pc, address);
+        return 0;
+    }
+
+    if (!mmu_d_translate(pc, address, physical, write))
+        return 0;
+
+    *host = get_host_ptr(*physical);
+    return 1;
+}
+//-----------------------------------------------------------------
+// atomic_access: Account an atomic access to directly backed memory
+// (stats, trace, self-modifying code)
+//-----------------------------------------------------------------
+void rv64::atomic_access(uint64_t address, uint64_t physical, bool write, uint64_t data, int width)
+{
+    if (write)
+    {
+        DPRINTF(LOG_MEM, ("STORE: VA 0x%08x PA 0x%08x Value 0x%08x Width %d\n", address, physical, data, width));
+        m_stats[STATS_STORES]++;
+
+        // Self-modifying code
+        if (decode_page_cached(physical))
+            decode_invalidate(physical);
+    }
+    else
+    {
+        DPRINTF(LOG_MEM, ("LOAD: VA 0x%08x PA 0x%08x Width %d\n", address, physical, width));
+        DPRINTF(LOG_MEM, ("LOAD_RESULT: 0x%08x\n", data));
+        m_stats[STATS_LOADS]++;
+    }
+
+    if (m_trace_file)
+        m_trace_file->mem(write, address, physical, data, width);
+}
+//-----------------------------------------------------------------
+// sc_check: Store conditional to a device. With other harts the word
+// must still hold the value LR returned (read directly, not a load).
+//-----------------------------------------------------------------
+bool rv64::sc_check(uint64_t physical, int width)
+{
+    if (!m_smp)
+        return true;
+
+    // Bad addresses are reported by the store
+    memory_base *mem = find_memory(physical);
+    if (!mem)
+        return true;
+
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+    bus_lock();
+    mem->read32(physical, lo);
+    if (width == 8)
+        mem->read32(physical + 4, hi);
+    bus_unlock();
+
+    if (width == 8)
+        return ((((uint64_t)hi) << 32) | lo) == m_load_val;
+    return lo == (uint32_t)m_load_val;
+}
+//-----------------------------------------------------------------
 // set_timer: Set built in timer interrupt
 //-----------------------------------------------------------------
 void rv64::set_timer(uint64_t value)
@@ -2796,6 +2686,7 @@ void rv64::set_timer(uint64_t value)
     m_csr_mtime_ie    = true;
     m_csr_mtimecmp    = value;
     m_csr_mip        &= ~SR_IP_STIP;
+    timer_rearm();
 }
 //-----------------------------------------------------------------
 // in_super_mode: Is the CPU in SUPER mode
@@ -2816,10 +2707,23 @@ void rv64::sbi_boot(uint32_t boot_addr, uint32_t dtb_addr)
     m_csr_medeleg = ~MCAUSE_ECALL_S;
 
     m_pc = m_pc_x = boot_addr;
-    m_gpr[RISCV_REG_A0 + 0] = 0;
+    m_gpr[RISCV_REG_A0 + 0] = m_hart_id;
     m_gpr[RISCV_REG_A0 + 1] = dtb_addr;
 }
 //-----------------------------------------------------------------
+// enable_trace_file: Attach binary instruction trace
+//-----------------------------------------------------------------
+bool rv64::enable_trace_file(trace_writer *file)
+{
+    // Initial register state (later records are writebacks)
+    if (file)
+        for (int i=1;i<REGISTERS;i++)
+            file->reg(i, m_gpr[i]);
+
+    m_trace_file = file;
+    return true;
+}
+//-----------------------------------------------------------------
 // stats_reset: Reset runtime stats
 //-----------------------------------------------------------------
 void rv64::stats_reset(void)
@@ -2842,5 +2746,11 @@ void rv64::stats_dump(void)
         printf( "- Branches Operations %d (%d%%)\n", m_stats[STATS_BRANCHES], (m_stats[STATS_BRANCHES] * 100)  / m_stats[STATS_INSTRUCTIONS]);
     }
 
+    if (m_stats[STATS_ITLB_MISS] || m_stats[STATS_DTLB_MISS])
+    {
+        printf( "- ITLB Hits / Misses %d / %d\n", m_stats[STATS_ITLB_HIT], m_stats[STATS_ITLB_MISS]);
+        printf( "- DTLB Hits / Misses %d / %d\n", m_stats[STATS_DTLB_HIT], m_stats[STATS_DTLB_MISS]);
+    }
+
     stats_reset();
 }
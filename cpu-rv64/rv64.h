@@ -12,6 +12,8 @@
 #include <vector>
 #include "memory.h"
 #include "cpu.h"
+#include "riscv_decode.h"
+#include "riscv_tlb.h"
 
 //--------------------------------------------------------------------
 // rv64: RV64IM model
@@ -24,6 +26,8 @@ public:
     void                reset(uint32_t start_addr);
     uint32_t            get_opcode(uint64_t pc);
     void                step(uint64_t cycles);
+    int                 step_block(uint64_t cycles, int max_steps);
+    int                 run(uint64_t &cycles, uint64_t max_steps, uint64_t stop_pc = RUN_NO_STOP_PC);
 
     void                set_interrupt(int irq);
     void                clr_interrupt(int irq);
@@ -42,6 +46,11 @@ public:
     void                set_pc(uint32_t val);
     void                set_pc(uint64_t val);
 
+    bool                attach_memory(memory_base *memory);
+    bool                enable_trace_file(trace_writer *file);
+    bool                has_monitor(void) { return true; }
+    bool                set_tlb_size(int entries, int ways);
+
     void                stats_reset(void);
     void                stats_dump(void);
 
@@ -56,14 +65,15 @@ public:
     int                 get_abi_reg_num(void) { return 8; }
 
     // Enable / Disable ISA extensions
-    void                enable_rvm(bool en) { m_enable_rvm = en; }
-    void                enable_rvc(bool en) { m_enable_rvc = en; }
-    void                enable_rva(bool en) { m_enable_rva = en; }
+    void                enable_rvm(bool en) { m_enable_rvm = en; decode_flush(); }
+    void                enable_rvc(bool en) { m_enable_rvc = en; decode_flush(); }
+    void                enable_rva(bool en) { m_enable_rva = en; decode_flush(); }
 
     // SBI hosting support
     void                set_timer(uint64_t value);
     bool                in_super_mode(void);
     void                sbi_boot(uint32_t boot_addr, uint32_t dtb_addr);
+    int                 sbi_load(uint64_t address, uint64_t *val) { return load(m_pc, address, val, 8, false); }
 
     enum eStats
     { 
@@ -72,6 +82,10 @@ public:
         STATS_LOADS,
         STATS_STORES,
         STATS_BRANCHES,
+        STATS_ITLB_HIT,
+        STATS_ITLB_MISS,
+        STATS_DTLB_HIT,
+        STATS_DTLB_MISS,
         STATS_MAX
     };    
 
@@ -81,15 +95,102 @@ protected:
     int                 store(uint64_t pc, uint64_t address, uint64_t data, int width);
     virtual bool        access_csr(uint64_t address, uint64_t data, bool set, bool clr, uint64_t &result);
     void                exception(uint64_t cause, uint64_t pc, uint64_t badaddr = 0);
+    bool                check_interrupts(uint64_t pc);
+    void                invalidate_code(uint32_t addr, int length);
+    void                remote_fence(uint32_t mask);
+    bool                serialize_arch(checkpoint &cp);
+    int                 atomic_translate(uint64_t pc, uint64_t address, int width, bool write, uint64_t *physical, uint8_t **host);
+    void                atomic_access(uint64_t address, uint64_t physical, bool write, uint64_t data, int width);
+    bool                sc_check(uint64_t physical, int width);
 
 // MMU
 private:
     void                mmu_flush(void);
+    void                mmu_fence(bool by_addr, uint64_t addr, bool by_asid, uint64_t asid);
+    uint32_t            data_priv(void);
+    void                soft_tlb_flush(void);
+    void                soft_tlb_fill(int type, uint32_t priv, uint64_t addr, uint64_t physical);
+    uint8_t *           soft_tlb_lookup(int type, uint32_t priv, uint64_t addr, uint64_t *physical)
+    {
+        t_soft_tlb *e = &m_soft_tlb[priv][type][(addr >> SOFT_TLB_PGSHIFT) & (SOFT_TLB_ENTRIES-1)];
+        bool hit      = (e->tag == (addr >> SOFT_TLB_PGSHIFT << SOFT_TLB_PGSHIFT));
+        HOST_STATS_HIT(hit, COUNT_SOFT_TLB_HIT, COUNT_SOFT_TLB_MISS);
+        if (hit)
+        {
+            *physical = e->paddr | (addr & ((1 << SOFT_TLB_PGSHIFT) - 1));
+            return (uint8_t *)(uintptr_t)(addr + e->addend);
+        }
+        return NULL;
+    }
     int                 mmu_read_word(uint64_t address, uint64_t *val);
-    uint64_t            mmu_walk(uint64_t addr);
+    uint64_t            mmu_walk(uint64_t addr, bool fetch = false);
     int                 mmu_i_translate(uint64_t addr, uint64_t *physical);
     int                 mmu_d_translate(uint64_t pc, uint64_t addr, uint64_t *physical, int writeNotRead);
 
+// Pre-decoded instruction cache
+private:
+    typedef struct
+    {
+        uint32_t        pc;     // Physical PC tag
+        t_riscv_inst    inst;
+    } t_decoded;
+
+    void                decode_flush(void);
+    void                decode_invalidate(uint32_t addr);
+    bool                decode_fill(t_decoded *inst, uint32_t phy_pc);
+    bool                execute_decoded(const t_riscv_inst *inst);
+    void                trace_inst(const t_riscv_inst *inst);
+    uint32_t            decode_flags(void)
+    {
+        return RV_DECODE_RV64 |
+               (m_enable_rvm ? RV_DECODE_RVM : 0) |
+               (m_enable_rva ? RV_DECODE_RVA : 0) |
+               (m_enable_rvc ? RV_DECODE_RVC : 0);
+    }
+    bool                decode_page_cached(uint64_t addr)
+    {
+        uint64_t page = addr >> DECODE_PGSHIFT;
+        return page < (1 << (32 - DECODE_PGSHIFT)) && (m_decode_pages[page >> 5] & (1 << (page & 31)));
+    }
+    bool                decode_page_nohost(uint32_t addr)
+    {
+        uint32_t page = addr >> DECODE_PGSHIFT;
+        return m_nohost_pages[page >> 5] & (1 << (page & 31));
+    }
+
+// Basic block cache
+private:
+    static const int    BLOCK_ENTRIES   = 4096;
+    static const int    BLOCK_MAX_INSTS = 32;
+    static const int    RUN_BLOCK_STEPS = 4096; // Per step_block() call from run()
+
+    typedef struct t_block
+    {
+        uint32_t        pc;         // Physical PC tag
+        uint32_t        mode;       // Privilege / MMU mode tag
+        int             count;
+        uint32_t        link_epoch; // Translation epoch links were made in
+        uint64_t        link_pc[2]; // Successor virtual PC (fall-through, taken)
+        uint32_t        link_phy[2];
+        struct t_block *link[2];
+        t_riscv_inst    inst[BLOCK_MAX_INSTS + 1]; // RV_OP_ILLEGAL terminated
+    } t_block;
+
+    uint32_t            block_mode(void);
+    t_block *           block_find(void);
+    bool                block_build(t_block *block, uint32_t phy_pc, uint32_t mode);
+    t_block *           block_next(t_block *block, int succ, uint64_t entry_pc);
+    int                 block_execute(t_block *block, int *succ);
+    // Timer (mtime derived from the cycle count)
+    uint64_t            time_now(void) { return m_time_base + (m_cycle_now - m_time_cycle) / m_timebase_div; }
+    void                time_set(uint64_t value);
+    void                timer_rearm(void);
+    void                timer_expired(void);
+
+    // Sleep (WFI / idle loop) until an enabled interrupt is pending
+    void                wfi_sleep(void) { if (!(m_csr_mip & m_csr_mie)) m_wfi = true; }
+    uint64_t            wfi_idle(uint64_t cycles, uint64_t end);
+
 private:
 
     // CPU Registers
@@ -97,6 +198,7 @@ private:
     uint64_t            m_pc;
     uint64_t            m_pc_x;
     uint64_t            m_load_res;
+    uint64_t            m_load_val;
 
     // CSR - Machine
     uint64_t            m_csr_mepc;
@@ -107,13 +209,17 @@ private:
     uint64_t            m_csr_mtval;
     uint64_t            m_csr_mie;
     uint64_t            m_csr_mip;
-    uint64_t            m_csr_mtime;
     uint64_t            m_csr_mtimecmp;
-    bool                m_csr_mtime_ie;
+    bool                m_csr_mtime_ie; // mtimecmp armed
     uint64_t            m_csr_mscratch;
     uint64_t            m_csr_mideleg;
     uint64_t            m_csr_medeleg;
 
+    // Timer
+    uint64_t            m_cycle_now;    // Cycle of the current instruction / block
+    uint64_t            m_time_cycle;   // Cycle m_time_base was written
+    uint64_t            m_time_base;
+
     // CSR - Supervisor
     uint64_t            m_csr_sepc;
     uint64_t            m_csr_sevec;
@@ -122,10 +228,47 @@ private:
     uint64_t            m_csr_satp;
     uint64_t            m_csr_sscratch;
 
-    // TLB cache
-    static const int MMU_TLB_ENTRIES = 64;
-    uint64_t            m_mmu_addr[MMU_TLB_ENTRIES];
-    uint64_t            m_mmu_pte[MMU_TLB_ENTRIES];
+    // TLBs (ASID tagged, not flushed on SATP writes)
+    riscv_tlb           m_itlb;
+    riscv_tlb           m_dtlb;
+
+    // Software TLB: virtual page -> host memory (per privilege level).
+    // Only populated for translations that hit directly backed RAM and
+    // passed the permission checks, anything else takes the slow path.
+    enum eSoftTlb
+    {
+        SOFT_TLB_READ,
+        SOFT_TLB_WRITE,
+        SOFT_TLB_EXEC,
+        SOFT_TLB_MAX
+    };
+    static const int    SOFT_TLB_ENTRIES = 256;
+    static const int    SOFT_TLB_PGSHIFT = 12;
+    static const int    SOFT_TLB_PRIV    = 4;
+    struct t_soft_tlb
+    {
+        uint64_t tag;     // Virtual page address (~0 = invalid)
+        uint64_t addend;  // Host address - virtual address
+        uint64_t paddr;   // Physical page address
+    };
+    t_soft_tlb          m_soft_tlb[SOFT_TLB_PRIV][SOFT_TLB_MAX][SOFT_TLB_ENTRIES];
+
+    // Decoded instruction cache (direct mapped on physical PC < 4GB)
+    static const int    DECODE_ENTRIES = 8192;
+    static const int    DECODE_PGSHIFT = 12;
+    std::vector<t_decoded> m_decode;
+    std::vector<uint32_t>  m_decode_pages; // Pages holding cached entries
+    std::vector<uint32_t>  m_nohost_pages; // Pages without a host pointer (never cached)
+
+    // Basic blocks (direct mapped on physical PC)
+    std::vector<t_block>   m_blocks;
+    uint32_t            m_block_epoch;
+    uint64_t            m_nohost_vpage; // Last block_find() on a nohost page (by
+    uint64_t            m_nohost_priv;  // virtual page, mode and block epoch)
+    uint32_t            m_nohost_epoch;
+    int                 m_block_counted; // Instructions of the running block already in m_stats
+    uint64_t            m_run_stop_pc;  // Blocks end here (run)
+    bool                m_wfi;          // Hart asleep
 
     // Settings
     bool                m_enable_unaligned;
@@ -45,6 +45,7 @@ device_tree::device_tree(const char *filename, console_io *con_io /*= NULL*/)
     m_mem_size    = 0;
     m_initrd_base = 0;
     m_initrd_end  = 0;
+    m_num_harts   = 0;
 }
 //-----------------------------------------------------------------
 // open_fdt: Open FDT file (binary)
@@ -130,6 +131,7 @@ bool device_tree::load(cpu *cpu)
                 }
                 else if (!strcmp(device_type, "cpu"))
                 {
+                    m_num_harts++;
                     continue;
                 }
             }
@@ -35,6 +35,9 @@ public:
     uint32_t     get_initrd_base(void) { return m_initrd_base; }
     uint32_t     get_initrd_size(void) { return m_initrd_end - m_initrd_base; }
 
+    // Number of 'cpu' nodes
+    int          get_num_harts(void) { return m_num_harts; }
+
 protected:
     bool         open_fdt(void);
     int          process_node(int offset);
@@ -47,6 +50,7 @@ protected:
     uint32_t     m_mem_size;
     uint32_t     m_initrd_base;
     uint32_t     m_initrd_end;
+    int          m_num_harts;
 };
 
 #endif
\ No newline at end of file
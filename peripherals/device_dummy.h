@@ -40,9 +40,12 @@ public:
 
     int clock(uint64_t cycles)
     {
-        return 0;
+        return CLOCK_IDLE;
     }
 
+    // No state
+    void serialize(checkpoint &cp) { }
+
 private:
 };
 
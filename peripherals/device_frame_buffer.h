@@ -11,6 +11,9 @@
 #include "device.h"
 #include "display.h"
 
+// Display refresh interval (cycles)
+#define FB_UPDATE_CYCLES    100000
+
 //-----------------------------------------------------------------
 // device_frame_buffer: Simplified frame buffer device
 //-----------------------------------------------------------------
@@ -20,8 +23,6 @@ public:
     device_frame_buffer(uint32_t base_addr, int width, int height): device("fb", base_addr, height * width * 2, NULL, -1)
     {
         m_fb      = new uint8_t[height * width * 2];
-        m_ticks   = 0;
-
         m_display.init(width, height);
     }
 
@@ -64,17 +65,18 @@ public:
 
     int clock(uint64_t cycles)
     {
-        if (++m_ticks == 100000)
-        {
-            m_display.update(m_fb);
-            m_ticks   = 0;
-        }
-        return 0;
+        m_display.update(m_fb);
+        return FB_UPDATE_CYCLES;
+    }
+
+    void serialize(checkpoint &cp)
+    {
+        cp.section("fb", 1);
+        cp.io_mem(m_fb, m_size);
     }
 
 private:
     uint8_t *m_fb;
-    int      m_ticks;
     display  m_display;
 };
 
@@ -154,7 +154,16 @@ public:
 
     int clock(uint64_t cycles)
     {
-        return 0;
+        return CLOCK_IDLE;
+    }
+
+    void serialize(checkpoint &cp)
+    {
+        cp.section("irq_ctrl", 1);
+        cp.io(m_isr);
+        cp.io(m_ier);
+        cp.io(m_mer);
+        cp.io(m_irq_last);
     }
 
 private:
@@ -8,7 +8,9 @@
 #ifndef __DEVICE_IRQ_PLIC_H__
 #define __DEVICE_IRQ_PLIC_H__
 
+#include <vector>
 #include "device.h"
+#include "cpu.h"
 
 //-----------------------------------------------------------------
 // Defines
@@ -28,60 +30,112 @@
 #define PLIC_REG_SIZE                (0x10000000 - 0x0c000000)
 #define PLIC_IRQ_GROUPS              4
 
+// Contexts per hart (M and S mode, aliased in this implementation)
+#define PLIC_HART_CONTEXTS           2
+
+#define IRQ_M_EXT                    11
+
+// Per hart context (M and S mode contexts share state)
+typedef struct
+{
+    cpu     *hart;          // NULL: device interrupt (hart 0)
+    uint32_t enable[PLIC_IRQ_GROUPS];
+    uint8_t  prio_thresh;
+    bool     irq;
+} t_plic_context;
+
 //-----------------------------------------------------------------
 // device_irq_plic: 'Platform Interrupt Controller' model
 //-----------------------------------------------------------------
+// Hart 0 is signalled through the device interrupt (irq), further harts
+// (add_hart()) directly with IRQ_M_EXT.
 class device_irq_plic: public device
 {
 public:
     device_irq_plic(uint32_t base_addr, int irq): device("plic", base_addr, PLIC_REG_SIZE, NULL, irq)
     {
+        add_hart(NULL);
         reset();
     }
-    
+
+    void add_hart(cpu *hart)
+    {
+        t_plic_context ctx;
+        ctx.hart = hart;
+        m_ctx.push_back(ctx);
+        reset_context(m_ctx.back());
+    }
+
+    void reset_context(t_plic_context &ctx)
+    {
+        for (int x=0;x<PLIC_IRQ_GROUPS;x++)
+            ctx.enable[x] = 0;
+        ctx.prio_thresh = 0;
+        ctx.irq         = false;
+    }
+
     void reset(void)
     {
         for (int x=0;x<PLIC_IRQ_GROUPS;x++)
         {
             m_pending[x] = 0;
-            m_enable[x]  = 0;
+            m_claimed[x] = 0;
         }
         for (int i=0;i<PLIC_NUM_IRQS;i++)
             m_prio[i] = 0;
 
-        m_prio_thresh = 0;
-        m_irq = false;
+        for (unsigned h=0;h<m_ctx.size();h++)
+            reset_context(m_ctx[h]);
     }
 
-    int eval_irq(void)
+    // Highest priority (lowest numbered) claimable interrupt for a hart
+    int eval_irq(int hart)
     {
+        t_plic_context &ctx = m_ctx[hart];
         uint32_t masked[PLIC_IRQ_GROUPS];
 
         for (int x=0;x<PLIC_IRQ_GROUPS;x++)
-            masked[x] = m_pending[x] & m_enable[x];
+            masked[x] = m_pending[x] & ~m_claimed[x] & ctx.enable[x];
 
         // Mask interrupts less than or equal to threshold
         for (int i=0;i<PLIC_NUM_IRQS;i++)
-            if (m_prio[i] <= m_prio_thresh)
+            if (m_prio[i] <= ctx.prio_thresh)
             {
                 int grp = i / 32;
                 int bit = i % 32;
                 masked[grp] &= ~(1  << bit);
             }
 
-        m_irq = false;
         for (int x=0;x<PLIC_IRQ_GROUPS;x++)
             for (int i=0;i<32;i++)
                 if (masked[x] & (1 << i))
-                {
-                    raise_interrupt();
-                    m_irq = true;
                     return (x*32) + i;
-                }
 
         return 0; // Interrupt 0 not valid
     }
 
+    // Update the interrupt line of each hart
+    void update_irqs(void)
+    {
+        for (unsigned h=0;h<m_ctx.size();h++)
+        {
+            t_plic_context &ctx = m_ctx[h];
+            bool irq = eval_irq(h) != 0;
+
+            if (h == 0)
+            {
+                if (irq)
+                    raise_interrupt();
+                else if (ctx.irq)
+                    drop_interrupt();
+            }
+            else if (irq != ctx.irq)
+                ctx.hart->post_interrupt(IRQ_M_EXT, irq);
+
+            ctx.irq = irq;
+        }
+    }
+
     void set_irq(int irq)
     {
         if (irq != -1)
@@ -95,41 +149,54 @@ public:
         // Interrupt 0 is hard-wired to zero
         m_pending[0] &= ~(1 << 0);
 
-        eval_irq();
+        update_irqs();
+    }
+
+    // Register -> hart for per context registers (-1 if not a valid context)
+    int enable_hart(uint32_t address)
+    {
+        uint32_t ctx = (address - PLIC_REG_ENABLE0) / PLIC_ENABLE_PER_HART;
+        if (address < PLIC_REG_ENABLE0 || (ctx / PLIC_HART_CONTEXTS) >= m_ctx.size())
+            return -1;
+        if ((address - PLIC_REG_ENABLE0) % PLIC_ENABLE_PER_HART > (PLIC_REG_ENABLE3 - PLIC_REG_ENABLE0))
+            return -1;
+        return ctx / PLIC_HART_CONTEXTS;
+    }
+    int context_hart(uint32_t address)
+    {
+        uint32_t ctx = (address - PLIC_REG_PRIO_THRESH) / PLIC_CONTEXT_PER_HART;
+        if (address < PLIC_REG_PRIO_THRESH || (ctx / PLIC_HART_CONTEXTS) >= m_ctx.size())
+            return -1;
+        return ctx / PLIC_HART_CONTEXTS;
     }
 
     bool write32(uint32_t address, uint32_t data)
     {
         address -= m_base;
 
+        int hart;
         if (address >= PLIC_REG_SRC_PRIO0 && address <= PLIC_REG_SRC_PRIO127)
             m_prio[(address-PLIC_REG_SRC_PRIO0)/4] = data;
-        else if (address >= PLIC_REG_ENABLE0 && address <= PLIC_REG_ENABLE3)
-            m_enable[(address-PLIC_REG_ENABLE0)/4] = data;
-        // Context 1 (S) aliases to context 0 (M) in this implementation
-        else if (address >= (PLIC_REG_ENABLE0 + PLIC_ENABLE_PER_HART) && address <= (PLIC_REG_ENABLE3 + PLIC_ENABLE_PER_HART))
-            m_enable[(address-PLIC_REG_ENABLE0-PLIC_ENABLE_PER_HART)/4] = data;
-        else if ((address == PLIC_REG_PRIO_THRESH) || (address == PLIC_REG_PRIO_THRESH + PLIC_CONTEXT_PER_HART))
-            m_prio_thresh = data;
+        else if ((hart = enable_hart(address)) >= 0)
+            m_ctx[hart].enable[((address-PLIC_REG_ENABLE0) % PLIC_ENABLE_PER_HART)/4] = data;
+        else if ((hart = context_hart(address)) >= 0 && (address % PLIC_CONTEXT_PER_HART) == (PLIC_REG_PRIO_THRESH % PLIC_CONTEXT_PER_HART))
+            m_ctx[hart].prio_thresh = data;
         // Complete interrupt
-        else if ((address == PLIC_REG_CLAIM) || (address == (PLIC_REG_CLAIM + PLIC_CONTEXT_PER_HART)))
+        else if ((hart = context_hart(address)) >= 0 && (address % PLIC_CONTEXT_PER_HART) == (PLIC_REG_CLAIM % PLIC_CONTEXT_PER_HART))
         {
-            // Interrupt claimed - clear
-            if (data > 0)
+            // Interrupt handled - clear
+            int grp = data / 32;
+            int bit = data % 32;
+            if (data > 0 && grp < PLIC_IRQ_GROUPS)
             {
-                int grp = data / 32;
-                int bit = data % 32;
                 m_pending[grp] &= ~(1 << bit);
+                m_claimed[grp] &= ~(1 << bit);
             }
-
-            // Drop interrupt if nothing new pending
-            if (eval_irq() == 0)
-                drop_interrupt();
         }
         else
             fprintf(stderr, "PLIC: Bad write @ %08x\n", address);
 
-        eval_irq();
+        update_irqs();
         return true;
     }
 
@@ -138,6 +205,7 @@ public:
         data = 0;
         address -= m_base;
 
+        int hart;
         if (address >= PLIC_REG_SRC_PRIO0 && address <= PLIC_REG_SRC_PRIO127)
         {
             data = m_prio[(address-PLIC_REG_SRC_PRIO0)/4];
@@ -148,25 +216,24 @@ public:
             data = m_pending[(address-PLIC_REG_PENDING0)/4];
             return true;
         }
-        else if (address >= PLIC_REG_ENABLE0 && address <= PLIC_REG_ENABLE3)
-        {
-            data = m_enable[(address-PLIC_REG_ENABLE0)/4];
-            return true;
-        }
-        // Context 1 (S) aliases to context 0 (M) in this implementation
-        else if (address >= (PLIC_REG_ENABLE0 + PLIC_ENABLE_PER_HART) && address <= (PLIC_REG_ENABLE3 + PLIC_ENABLE_PER_HART))
+        else if ((hart = enable_hart(address)) >= 0)
         {
-            data = m_enable[(address-PLIC_REG_ENABLE0 - PLIC_ENABLE_PER_HART)/4];
+            data = m_ctx[hart].enable[((address-PLIC_REG_ENABLE0) % PLIC_ENABLE_PER_HART)/4];
             return true;
         }
-        else if ((address == PLIC_REG_PRIO_THRESH) || (address == PLIC_REG_PRIO_THRESH + PLIC_CONTEXT_PER_HART))
+        else if ((hart = context_hart(address)) >= 0 && (address % PLIC_CONTEXT_PER_HART) == (PLIC_REG_PRIO_THRESH % PLIC_CONTEXT_PER_HART))
         {
-            data = m_prio_thresh;
+            data = m_ctx[hart].prio_thresh;
             return true;
         }
-        else if ((address == PLIC_REG_CLAIM) || (address == (PLIC_REG_CLAIM + PLIC_CONTEXT_PER_HART)))
+        // Claim interrupt (not offered to other harts until completed)
+        else if ((hart = context_hart(address)) >= 0 && (address % PLIC_CONTEXT_PER_HART) == (PLIC_REG_CLAIM % PLIC_CONTEXT_PER_HART))
         {
-            int irq = eval_irq();
+            int irq = eval_irq(hart);
+            if (irq)
+                m_claimed[irq / 32] |= (1 << (irq % 32));
+            update_irqs();
+
             data = (uint32_t)irq;
             return true;
         }
@@ -177,15 +244,37 @@ public:
 
     int clock(uint64_t cycles)
     {
-        return 0;
+        return CLOCK_IDLE;
+    }
+
+    void serialize(checkpoint &cp)
+    {
+        cp.section("plic", 1);
+        cp.io(m_prio);
+        cp.io(m_pending);
+        cp.io(m_claimed);
+
+        uint32_t contexts = m_ctx.size();
+        cp.io(contexts);
+        if (contexts != m_ctx.size())
+        {
+            cp.fail("PLIC: %d contexts saved, %d configured", contexts, (int)m_ctx.size());
+            return;
+        }
+
+        for (unsigned i=0;i<m_ctx.size();i++)
+        {
+            cp.io(m_ctx[i].enable);
+            cp.io(m_ctx[i].prio_thresh);
+            cp.io(m_ctx[i].irq);
+        }
     }
 
 private:
     uint8_t  m_prio[PLIC_NUM_IRQS];
     uint32_t m_pending[PLIC_IRQ_GROUPS];
-    uint32_t m_enable[PLIC_IRQ_GROUPS];
-    uint8_t  m_prio_thresh;
-    bool     m_irq;
+    uint32_t m_claimed[PLIC_IRQ_GROUPS];
+    std::vector<t_plic_context > m_ctx;
 };
 
 #endif
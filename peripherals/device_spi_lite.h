@@ -126,7 +126,6 @@ public:
     void reset(void)
     {
         memset(&m_reg, 0, 256 * 4);
-        m_spi_delay   = 0;
         m_irq_inhibit = false;
     }
 
@@ -158,6 +157,8 @@ public:
     {
         dprintf("SPI: Write %08x=%08x\n", address, data);
         address -= m_base;
+        sched_wake();
+
         switch (address)
         {
             case SPI_DTR:
@@ -235,23 +236,17 @@ public:
         bool tx_empty_irq_en = (m_reg[SPI_IPIER/4] & (1 << SPI_IPIER_TX_EMPTY_SHIFT)) != 0;
         bool tx_empty_event  = false;
 
-        if (m_spi_delay == 0)
+        if (enable && !trans_inhibit && m_tx.size() != 0)
         {
-            if (enable && !trans_inhibit && m_tx.size() != 0)
-            {
-                if (loopback)
-                    rx_push(m_tx.front());
-                else 
-                    rx_push(0xFF);
-                m_tx.pop();
-
-                if (m_tx.size() == 0)
-                    tx_empty_event = true;
-            }
-            m_spi_delay = SPI_CLOCK_DIV;
+            if (loopback)
+                rx_push(m_tx.front());
+            else 
+                rx_push(0xFF);
+            m_tx.pop();
+
+            if (m_tx.size() == 0)
+                tx_empty_event = true;
         }
-        else if (enable && !trans_inhibit)
-            m_spi_delay -= 1;
 
         // Tx empty event, set interrupt
         if (tx_empty_event)
@@ -263,14 +258,49 @@ public:
             raise_interrupt();
         }
 
-        return 0;
+        // Next byte after the SPI clock divider, sleep until written when idle
+        if (enable && !trans_inhibit && m_tx.size() != 0)
+            return SPI_CLOCK_DIV + 1;
+
+        return CLOCK_IDLE;
+    }
+
+    void serialize(checkpoint &cp)
+    {
+        cp.section("spi_lite", 1);
+        cp.io(m_reg);
+        cp.io(m_irq_inhibit);
+        serialize_fifo(cp, m_tx);
+        serialize_fifo(cp, m_rx);
     }
 
 private:
+    void serialize_fifo(checkpoint &cp, std::queue <uint32_t> &fifo)
+    {
+        std::queue <uint32_t> copy = fifo;
+        uint32_t count = fifo.size();
+        cp.io(count);
+
+        if (cp.is_restore())
+        {
+            fifo = std::queue <uint32_t>();
+            for (uint32_t i=0;i<count && cp.ok();i++)
+            {
+                uint32_t data = 0;
+                cp.io(data);
+                fifo.push(data);
+            }
+        }
+        else
+        {
+            for (;!copy.empty();copy.pop())
+                cp.io(copy.front());
+        }
+    }
+
     uint32_t m_reg[256];
     std::queue <uint32_t> m_tx;
     std::queue <uint32_t> m_rx;
-    uint32_t m_spi_delay;
     bool     m_irq_inhibit;
 };
 
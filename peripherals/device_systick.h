@@ -47,11 +47,49 @@ public:
         m_reg_csr     = 0;
         m_reg_reload  = 0;
         m_reg_current = 0;
+        m_next        = sched_cycle();
+    }
+
+    // Advance the down counter to an absolute cycle
+    void advance(uint64_t cycles)
+    {
+        if (cycles < m_next)
+            return;
+
+        uint64_t elapsed = cycles + 1 - m_next;
+        m_next = cycles + 1;
+
+        // Timer disabled
+        if (!(m_reg_csr & (1 << TIMER_CSR_ENABLE_SHIFT)))
+        {
+            m_reg_current = m_reg_reload;
+            m_irq         = false;
+        }
+        else if (elapsed <= m_reg_current)
+            m_reg_current -= (uint32_t)elapsed;
+        // Timer expired (possibly several reload periods)
+        else
+        {
+            elapsed      -= (uint64_t)m_reg_current + 1;
+            elapsed      %= (uint64_t)m_reg_reload + 1;
+            m_reg_current = m_reg_reload - (uint32_t)elapsed;
+            m_irq         = true;
+        }
+
+        // Interrupts enabled
+        if (m_irq && (m_reg_csr & (1 << TIMER_CSR_INTERRUPT_SHIFT)))
+        {
+            raise_interrupt();
+            m_irq = false;
+        }
     }
 
     bool write32(uint32_t address, uint32_t data)
     {
         address -= m_base;
+        advance(sched_cycle());
+        sched_wake();
+
         switch (address)
         {
             case TIMER_CSR:
@@ -70,6 +108,7 @@ public:
     {
         data = 0;
         address -= m_base;        
+        advance(sched_cycle());
 
         switch (address)
         {
@@ -91,28 +130,25 @@ public:
 
     int clock(uint64_t cycles)
     {
+        advance(cycles);
+
         // Timer disabled
         if (!(m_reg_csr & (1 << TIMER_CSR_ENABLE_SHIFT)))
-        {
-            m_reg_current = m_reg_reload;
-            m_irq         = false;
-        }
-        // Timer expired
-        else if (m_reg_current == 0)
-        {
-            m_reg_current = m_reg_reload;
-            m_irq         = true;
-        }
-        else
-            m_reg_current-= 1;
+            return CLOCK_IDLE;
 
-        // Interrupts enabled
-        if (m_irq && (m_reg_csr & (1 << TIMER_CSR_INTERRUPT_SHIFT)))
-        {
-            raise_interrupt();
-            m_irq = false;
-        }
-        return 0;
+        // Next call on reload
+        uint64_t delta = (uint64_t)m_reg_current + 1;
+        return delta < CLOCK_IDLE ? (int)delta : (CLOCK_IDLE - 1);
+    }
+
+    void serialize(checkpoint &cp)
+    {
+        cp.section("systick", 1);
+        cp.io(m_irq);
+        cp.io(m_reg_csr);
+        cp.io(m_reg_reload);
+        cp.io(m_reg_current);
+        cp.io(m_next);
     }
 
 private:
@@ -121,6 +157,7 @@ private:
     uint32_t m_reg_csr;
     uint32_t m_reg_reload;
     uint32_t m_reg_current;
+    uint64_t m_next;    // First cycle not yet counted
 };
 
 #endif
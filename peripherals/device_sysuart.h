@@ -40,8 +40,11 @@ public:
 
     int clock(uint64_t cycles)
     {
-        return 0;
+        return CLOCK_IDLE;
     }
+
+    // No state (transmit only)
+    void serialize(checkpoint &cp) { }
 };
 
 #endif
@@ -20,51 +20,97 @@
 #define CLINT_REG_TIMER_VAL_LO  0xbff8
 #define CLINT_REG_TIMER_VAL_HI  0xbffc
 #define CLINT_REG_SIZE          0xc000
+#define CLINT_MAX_HARTS         4095
 
+#define IRQ_M_SOFT              3
 #define IRQ_M_TIMER             7
 
 //-----------------------------------------------------------------
 // device_timer_clint: Model of 'Core-Local Interruptor'
 //-----------------------------------------------------------------
+// One MSIP / MTIMECMP register pair per hart (hart 0 is the CPU passed
+// to the constructor, further harts are added with add_hart()).
 class device_timer_clint: public device
 {
 public:
     device_timer_clint(uint32_t base_addr, cpu *cpu): device("clint", base_addr, CLINT_REG_SIZE, NULL, 0)
     {
         m_cpu = cpu;
+        add_hart(cpu);
         reset();
     }
-    
+
+    bool add_hart(cpu *hart)
+    {
+        if (m_harts.size() >= CLINT_MAX_HARTS)
+            return false;
+
+        t_hart h;
+        h.hart = hart;
+        h.cmp  = (uint64_t)-1;
+        h.msip = false;
+        m_harts.push_back(h);
+        return true;
+    }
+
     void reset(void)
     {
-        m_reg_cmp  = (uint64_t)-1;
-        m_reg_val  = 0;
+        for (unsigned i=0;i<m_harts.size();i++)
+        {
+            m_harts[i].cmp  = (uint64_t)-1;
+            m_harts[i].msip = false;
+        }
+        m_origin = sched_cycle();
+    }
+
+    // Timer value after the clock at an absolute cycle (derived from the
+    // cycle count, one tick every timebase_div cycles)
+    uint64_t value(uint64_t cycles)
+    {
+        return (cycles + 1 - m_origin) / m_cpu->get_timebase_div();
+    }
+
+    // Compare written: reschedule the match, drop a stale interrupt now
+    // (blocks may return from the handler before the next clock() call)
+    void cmp_written(int hart)
+    {
+        if (value(sched_cycle()) < m_harts[hart].cmp)
+            m_harts[hart].hart->post_interrupt(IRQ_M_TIMER, false);
+        sched_wake();
     }
 
     bool write32(uint32_t address, uint32_t data)
     {
         address -= m_base;
-        switch (address)
+
+        uint32_t num = m_harts.size();
+        if (address < CLINT_REG_MSIP + (num * 4))
         {
-            case CLINT_REG_MSIP:
-                if (data != 0)
-                {
-                    fprintf(stderr, "CLINT: Error - trying to raise MSIP - not supported yet\n");
-                    return false;
-                }
-                break;
-            case CLINT_REG_TIMER_CMP_LO:
-                m_reg_cmp &= ~0xffffffffull;
-                m_reg_cmp |= data;
-            break;
-            case CLINT_REG_TIMER_CMP_HI:
-                m_reg_cmp &= ~0xffffffff00000000ull;
-                m_reg_cmp |= ((uint64_t)data) << 32;
-            break;
-            default:
-                fprintf(stderr, "CLINT: Bad write @ %08x\n", address);
-                return false;
-            break;
+            t_hart &h = m_harts[(address - CLINT_REG_MSIP) / 4];
+            h.msip = (data & 1) != 0;
+            h.hart->post_interrupt(IRQ_M_SOFT, h.msip);
+        }
+        else if (address >= CLINT_REG_TIMER_CMP_LO && address < CLINT_REG_TIMER_CMP_LO + (num * 8))
+        {
+            int hart = (address - CLINT_REG_TIMER_CMP_LO) / 8;
+            uint64_t &cmp = m_harts[hart].cmp;
+
+            if ((address & 4) == (CLINT_REG_TIMER_CMP_LO & 4))
+            {
+                cmp &= ~0xffffffffull;
+                cmp |= data;
+            }
+            else
+            {
+                cmp &= ~0xffffffff00000000ull;
+                cmp |= ((uint64_t)data) << 32;
+            }
+            cmp_written(hart);
+        }
+        else
+        {
+            fprintf(stderr, "CLINT: Bad write @ %08x\n", address);
+            return false;
         }
         return true;
     }
@@ -73,45 +119,90 @@ public:
         data = 0;
         address -= m_base;
 
-        switch (address)
+        uint32_t num = m_harts.size();
+        if (address < CLINT_REG_MSIP + (num * 4))
+            data = m_harts[(address - CLINT_REG_MSIP) / 4].msip;
+        else if (address >= CLINT_REG_TIMER_CMP_LO && address < CLINT_REG_TIMER_CMP_LO + (num * 8))
         {
-            case CLINT_REG_TIMER_CMP_LO:
-                data = m_reg_cmp >> 0;
-            break;
-            case CLINT_REG_TIMER_CMP_HI:
-                data = m_reg_cmp >> 32;
-            break;
-            case CLINT_REG_TIMER_VAL_LO:
-                data = m_reg_val >> 0;
-            break;
-            case CLINT_REG_TIMER_VAL_HI:
-                data = m_reg_val >> 32;
-            break;
-            default:
-                fprintf(stderr, "CLINT: Bad read @ %08x\n", address);
-                return false;
-            break;
+            uint64_t cmp = m_harts[(address - CLINT_REG_TIMER_CMP_LO) / 8].cmp;
+            data = ((address & 4) == (CLINT_REG_TIMER_CMP_LO & 4)) ? (cmp >> 0) : (cmp >> 32);
+        }
+        else if (address == CLINT_REG_TIMER_VAL_LO)
+            data = value(sched_cycle()) >> 0;
+        else if (address == CLINT_REG_TIMER_VAL_HI)
+            data = value(sched_cycle()) >> 32;
+        else
+        {
+            fprintf(stderr, "CLINT: Bad read @ %08x\n", address);
+            return false;
         }
         return true;
     }
 
     int clock(uint64_t cycles)
     {
-        m_reg_val += 1;
+        uint64_t now   = value(cycles);
+        uint64_t div   = m_cpu->get_timebase_div();
+        int      delay = CLOCK_IDLE;
 
-        // Timer match - should set MIP_MTIP
-        if (m_reg_val >= m_reg_cmp)
-            m_cpu->set_interrupt(IRQ_M_TIMER);
-        else
-            m_cpu->clr_interrupt(IRQ_M_TIMER);
-        
-        return 0;
+        for (unsigned i=0;i<m_harts.size();i++)
+        {
+            t_hart &h = m_harts[i];
+
+            // Timer match - should set MIP_MTIP (level held until cmp written)
+            if (now >= h.cmp)
+            {
+                h.hart->post_interrupt(IRQ_M_TIMER, true);
+                continue;
+            }
+
+            h.hart->post_interrupt(IRQ_M_TIMER, false);
+
+            // Next call on the cycle the earliest compare matches
+            uint64_t delta = CLOCK_IDLE - 1;
+            if (h.cmp <= (~0ULL - m_origin) / div)
+                delta = (m_origin + h.cmp * div - 1) - cycles;
+            if (delta >= CLOCK_IDLE)
+                delta = CLOCK_IDLE - 1;
+
+            if (delta < (uint64_t)delay)
+                delay = (int)delta;
+        }
+
+        return delay;
+    }
+
+    void serialize(checkpoint &cp)
+    {
+        cp.section("clint", 1);
+
+        uint32_t harts = m_harts.size();
+        cp.io(harts);
+        if (harts != m_harts.size())
+        {
+            cp.fail("CLINT: %d harts saved, %d configured", harts, (int)m_harts.size());
+            return;
+        }
+
+        for (unsigned i=0;i<m_harts.size();i++)
+        {
+            cp.io(m_harts[i].cmp);
+            cp.io(m_harts[i].msip);
+        }
+        cp.io(m_origin);
     }
 
 private:
+    typedef struct
+    {
+        cpu     *hart;
+        uint64_t cmp;
+        bool     msip;
+    } t_hart;
+
     cpu     *m_cpu;
-    uint64_t m_reg_cmp;
-    uint64_t m_reg_val;
+    std::vector<t_hart> m_harts;
+    uint64_t m_origin;  // Cycle the timer was reset
 };
 
 #endif
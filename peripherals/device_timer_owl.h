@@ -50,11 +50,47 @@ public:
             m_reg_cmp[i]  = 0;
             m_reg_val[i]  = 0;
         }
+        m_next = sched_cycle();
+    }
+
+    // Advance enabled timers to an absolute cycle (interrupt on cmp match)
+    void advance(uint64_t cycles)
+    {
+        if (cycles < m_next)
+            return;
+
+        uint64_t elapsed = cycles + 1 - m_next;
+        bool     irq     = false;
+
+        m_next = cycles + 1;
+
+        for (int i=0;i<NUM_TIMERS;i++)
+        {
+            uint32_t enable  = (m_reg_ctrl[i] & (1 << TIMER_CTRL_EN_SHIFT))    != 0;
+            uint32_t int_en  = (m_reg_ctrl[i] & (1 << TIMER_CTRL_INTEN_SHIFT)) != 0;
+
+            // Timer disabled
+            if (!enable)
+                continue;
+
+            uint32_t to_cmp = m_reg_cmp[i] - m_reg_val[i];
+            m_reg_val[i] += (uint32_t)elapsed;
+
+            // Timer expired
+            if (int_en && ((to_cmp == 0 && elapsed >= (1ull << 32)) || (to_cmp != 0 && to_cmp <= elapsed)))
+                irq = true;
+        }
+
+        // Interrupt generated
+        if (irq)
+            raise_interrupt();
     }
 
     bool write32(uint32_t address, uint32_t data)
     {
         address -= m_base;
+        advance(sched_cycle());
+        sched_wake();
 
         switch (address)
         {
@@ -89,6 +125,7 @@ public:
     {
         data = 0;
         address -= m_base;
+        advance(sched_cycle());
 
         switch (address)
         {
@@ -121,33 +158,43 @@ public:
 
     int clock(uint64_t cycles)
     {
-        bool irq[NUM_TIMERS] = {false, false};
+        uint32_t next = CLOCK_IDLE;
+
+        advance(cycles);
 
+        // Next call on the earliest compare match
         for (int i=0;i<NUM_TIMERS;i++)
         {
             uint32_t enable  = (m_reg_ctrl[i] & (1 << TIMER_CTRL_EN_SHIFT))    != 0;
             uint32_t int_en  = (m_reg_ctrl[i] & (1 << TIMER_CTRL_INTEN_SHIFT)) != 0;
 
-            // Timer disabled
-            if (enable)
-                m_reg_val[i] += 1;
+            if (!enable || !int_en)
+                continue;
 
-            // Timer expired
-            if (m_reg_val[i] == m_reg_cmp[i])
-                irq[i] = enable && int_en;
+            uint32_t delta = m_reg_cmp[i] - m_reg_val[i];
+            if (delta == 0 || delta >= (uint32_t)CLOCK_IDLE)
+                delta = CLOCK_IDLE - 1;
+            if (delta < next)
+                next = delta;
         }
 
-        // Interrupt generated
-        if (irq[1] || irq[0])
-            raise_interrupt();
+        return (int)next;
+    }
 
-        return 0;
+    void serialize(checkpoint &cp)
+    {
+        cp.section("timer_owl", 1);
+        cp.io(m_reg_ctrl);
+        cp.io(m_reg_cmp);
+        cp.io(m_reg_val);
+        cp.io(m_next);
     }
 
 private:
     uint32_t m_reg_ctrl[NUM_TIMERS];
     uint32_t m_reg_cmp[NUM_TIMERS];
     uint32_t m_reg_val[NUM_TIMERS];
+    uint64_t m_next;    // First cycle not yet counted
 };
 
 #endif
@@ -42,11 +42,33 @@ public:
         m_reg_ctrl = 0;
         m_reg_cmp  = 0;
         m_reg_val  = 0;
+        m_next     = sched_cycle();
+    }
+
+    // Advance the counter to an absolute cycle (interrupt if it passed cmp)
+    void advance(uint64_t cycles)
+    {
+        if (cycles < m_next)
+            return;
+
+        uint64_t elapsed = cycles + 1 - m_next;
+        uint32_t to_cmp  = m_reg_cmp - m_reg_val;
+
+        m_next     = cycles + 1;
+        m_reg_val += (uint32_t)elapsed;
+
+        // Interrupts enabled and timer match
+        if ((m_reg_ctrl & (1 << TIMER_CTRL_INTERRUPT_SHIFT)) &&
+            ((to_cmp == 0 && elapsed >= (1ull << 32)) || (to_cmp != 0 && to_cmp <= elapsed)))
+            raise_interrupt();
     }
 
     bool write32(uint32_t address, uint32_t data)
     {
         address -= m_base;
+        advance(sched_cycle());
+        sched_wake();
+
         switch (address)
         {
             case TIMER_CTRL:
@@ -66,6 +88,7 @@ public:
     {
         data = 0;
         address -= m_base;
+        advance(sched_cycle());
 
         switch (address)
         {
@@ -88,19 +111,32 @@ public:
 
     int clock(uint64_t cycles)
     {
-        m_reg_val += 1;
+        advance(cycles);
 
-        // Interrupts enabled and timer match
-        if (m_reg_val == m_reg_cmp && (m_reg_ctrl & (1 << TIMER_CTRL_INTERRUPT_SHIFT)))
-            raise_interrupt();
-        
-        return 0;
+        if (!(m_reg_ctrl & (1 << TIMER_CTRL_INTERRUPT_SHIFT)))
+            return CLOCK_IDLE;
+
+        // Next call on the compare match (counter wraps)
+        uint32_t delta = m_reg_cmp - m_reg_val;
+        if (delta == 0 || delta >= (uint32_t)CLOCK_IDLE)
+            return CLOCK_IDLE - 1;
+        return (int)delta;
+    }
+
+    void serialize(checkpoint &cp)
+    {
+        cp.section("timer_r5", 1);
+        cp.io(m_reg_ctrl);
+        cp.io(m_reg_cmp);
+        cp.io(m_reg_val);
+        cp.io(m_next);
     }
 
 private:
     uint32_t m_reg_ctrl;
     uint32_t m_reg_cmp;
     uint32_t m_reg_val;
+    uint64_t m_next;    // First cycle not yet counted
 };
 
 #endif
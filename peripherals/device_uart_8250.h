@@ -44,6 +44,9 @@
 
 #define UART8250_LCR_DLAB       0x80
 
+// Console input poll interval (cycles)
+#define UART8250_POLL_CYCLES    1024
+
 //-----------------------------------------------------------------
 // Simplified model of 8250 UART
 //-----------------------------------------------------------------
@@ -63,7 +66,6 @@ public:
         memset(m_reg, 0, UART8250_REG_SIZE);
         m_reg[UART8250_LSR_OFFSET] = UART8250_LSR_TEMT | UART8250_LSR_THRE;
         m_rx  = -1;
-        m_poll_count = 0;
     }
 
     bool write8(uint32_t address, uint8_t data)
@@ -102,8 +104,12 @@ public:
     {
         address -= m_base;        
 
-        if (address == UART8250_RBR_OFFSET)
+        // Rx char consumed, resume polling
+        if (address == UART8250_RBR_OFFSET && m_rx != -1)
+        {
             m_rx = -1;
+            sched_wake();
+        }
 
         if (m_rx != -1)
             m_reg[UART8250_LSR_OFFSET] |= UART8250_LSR_DR;
@@ -124,22 +130,25 @@ public:
         // No rx char in the buffer, poll again...
         if (m_rx == -1)
         {
-            if (m_poll_count++ == 1024)
-            {
-                m_poll_count = 0;
-                m_rx = m_console->getchar();
-                m_reg[UART8250_RBR_OFFSET] = (uint8_t)m_rx;
-            }
+            m_rx = m_console->getchar();
+            m_reg[UART8250_RBR_OFFSET] = (uint8_t)m_rx;
         }
 
-        return 0;
+        // Sleep until the rx char is consumed
+        return (m_rx == -1) ? UART8250_POLL_CYCLES : CLOCK_IDLE;
+    }
+
+    void serialize(checkpoint &cp)
+    {
+        cp.section("uart_8250", 1);
+        cp.io(m_reg);
+        cp.io(m_rx);
     }
 
 private:
     console_io *m_console;
     uint8_t  m_reg[UART8250_REG_SIZE];
     int      m_rx;
-    int      m_poll_count;
 };
 
 #endif
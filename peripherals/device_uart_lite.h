@@ -56,6 +56,9 @@
     #define ULITE_CONTROL_RST_TX_SHIFT           0
     #define ULITE_CONTROL_RST_TX_MASK            0x1
 
+// Console input poll interval (cycles)
+#define ULITE_POLL_CYCLES 1024
+
 //-----------------------------------------------------------------
 // UartLite: Model of Xilinx UART-Lite IP
 //-----------------------------------------------------------------
@@ -81,6 +84,7 @@ public:
     bool write32(uint32_t address, uint32_t data)
     {
         address -= m_base;
+
         switch (address)
         {
             case ULITE_TX:
@@ -97,6 +101,10 @@ public:
                 exit (-1);
             break;
         }
+
+        // Only needs clocking early to raise the interrupt
+        if (m_irq && (m_ctrl & (1 << ULITE_CONTROL_IE_SHIFT)))
+            sched_wake();
         return true;
     }
     bool read32(uint32_t address, uint32_t &data)
@@ -109,7 +117,10 @@ public:
         {
             m_rx = m_console->getchar();
             if (m_rx != -1)
+            {
                 m_irq = true;
+                sched_wake();
+            }
         }
 
         switch (address)
@@ -117,6 +128,9 @@ public:
             case ULITE_RX:
                 data = ((uint32_t)m_rx) & ULITE_RX_DATA_MASK;
                 m_rx = -1;
+
+                // Resume polling
+                sched_wake();
             break;
             case ULITE_CONTROL:
                 data = m_ctrl;
@@ -141,15 +155,9 @@ public:
         // No rx char in the buffer, poll again...
         if (m_rx == -1)
         {
-            static int poll_count = 0;
-
-            if (poll_count++ == 1024)
-            {
-                poll_count = 0;
-                m_rx = m_console->getchar();
-                if (m_rx != -1)
-                    m_irq = true;
-            }
+            m_rx = m_console->getchar();
+            if (m_rx != -1)
+                m_irq = true;
         }
 
         // Interrupts enabled
@@ -159,7 +167,16 @@ public:
             m_irq = false;
         }
 
-        return 0;
+        // Sleep until the rx char is consumed
+        return (m_rx == -1) ? ULITE_POLL_CYCLES : CLOCK_IDLE;
+    }
+
+    void serialize(checkpoint &cp)
+    {
+        cp.section("uart_lite", 1);
+        cp.io(m_irq);
+        cp.io(m_ctrl);
+        cp.io(m_rx);
     }
 
 private:
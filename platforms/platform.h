@@ -13,7 +13,11 @@
 class platform
 {
 public:
+    virtual ~platform() { }
     virtual cpu* get_cpu(void) = 0;
+
+    // Multi-hart group (NULL for a single hart)
+    virtual smp* get_smp(void) { return NULL; }
 };
 
 #endif
\ No newline at end of file
@@ -29,6 +29,8 @@
 #include "device_systick.h"
 #include "device_sysuart.h"
 #include "device_dummy.h"
+#include "device_timer_clint.h"
+#include "device_irq_plic.h"
 
 class platform_cpu: public platform
 {
@@ -42,8 +44,47 @@ public:
         uint32_t    frequency = 100000000
     )
     {
-        m_cpu = NULL;
+        m_cpu       = NULL;
+        m_smp       = NULL;
+        m_misa      = std::string(misa);
+        m_support_s = support_s;
 
+        m_cpu = create_riscv(misa, support_s, membase, memsize);
+
+#ifdef __USE_ARMV6M__
+        if (!strncmp(misa, "armv6", 5))
+        {
+            if (membase == 0) membase = 0x20000000;
+
+            printf("Platform: Select ARMv6m\n");
+            armv6m *cpu = new armv6m(membase, memsize);
+
+            // Simple UART - writes to 0xE0000000 are output on the console
+            cpu->attach_device(new device_sysuart(0xE0000000, 0x1000, NULL, -1));
+
+            // Dummy System Control Block - writes have no effect, reads return 0
+            cpu->attach_device(new device_dummy(0xE000ED00, 36));
+
+            m_cpu = cpu;
+        }
+#endif
+
+#ifdef __USE_MIPS1__
+        if (!strncmp(misa, "mips1", 5) || !strncmp(misa, "mips", 4))
+        {
+            printf("Platform: Select %s\n", misa);
+            mips_i * cpu = new mips_i(membase, memsize);
+            m_cpu = cpu;
+        }
+#endif
+        
+        if (m_cpu) m_cpu->set_cpu_frequency(frequency);
+    }
+
+    // RISC-V core (NULL if misa is not a RISC-V ISA)
+    static cpu * create_riscv(const char *misa, bool support_s, uint32_t membase, uint32_t memsize)
+    {
+        cpu *hart = NULL;
 #ifdef __USE_RV32__
         if (!strncmp(misa, "RV32", 4) || !strncmp(misa, "rv32", 4))
         {
@@ -58,7 +99,7 @@ public:
             cpu->enable_rvc((strchr(misa, 'C') || strchr(misa, 'c')));
             cpu->enable_rva((strchr(misa, 'A') || strchr(misa, 'a')));
 
-            m_cpu = cpu;
+            hart = cpu;
         }
 #endif
 
@@ -76,42 +117,49 @@ public:
             cpu->enable_rvc((strchr(misa, 'C') || strchr(misa, 'c')));
             cpu->enable_rva((strchr(misa, 'A') || strchr(misa, 'a')));
 
-            m_cpu = cpu;
+            hart = cpu;
         }
 #endif
 
-#ifdef __USE_ARMV6M__
-        if (!strncmp(misa, "armv6", 5))
-        {
-            if (membase == 0) membase = 0x20000000;
-
-            printf("Platform: Select ARMv6m\n");
-            armv6m *cpu = new armv6m(membase, memsize);
+        return hart;
+    }
 
-            // Simple UART - writes to 0xE0000000 are output on the console
-            cpu->attach_device(new device_sysuart(0xE0000000, 0x1000, NULL, -1));
+    // Add harts (sharing the memory and devices of the boot hart) so
+    // that there are num harts in total (RISC-V only)
+    bool create_harts(int num)
+    {
+        if (!m_cpu || num <= 1 || m_smp)
+            return m_cpu != NULL;
 
-            // Dummy System Control Block - writes have no effect, reads return 0
-            cpu->attach_device(new device_dummy(0xE000ED00, 36));
+        m_smp = new smp();
+        m_smp->add_hart(m_cpu);
 
-            m_cpu = cpu;
-        }
-#endif
+        device_timer_clint *clint = (device_timer_clint *)m_cpu->find_device("clint", 0);
+        device_irq_plic    *plic  = (device_irq_plic *)m_cpu->find_device("plic", 0);
 
-#ifdef __USE_MIPS1__
-        if (!strncmp(misa, "mips1", 5) || !strncmp(misa, "mips", 4))
+        for (int i=1;i<num;i++)
         {
-            printf("Platform: Select %s\n", misa);
-            mips_i * cpu = new mips_i(membase, memsize);
-            m_cpu = cpu;
+            cpu *hart = create_riscv(m_misa.c_str(), m_support_s, 0, 0);
+            if (!hart)
+                return false;
+
+            hart->set_cpu_frequency(m_cpu->get_cpu_frequency());
+            m_smp->add_hart(hart);
+
+            if (clint) clint->add_hart(hart);
+            if (plic)  plic->add_hart(hart);
         }
-#endif
-        
-        if (m_cpu) m_cpu->set_cpu_frequency(frequency);
+
+        printf("Platform: %d harts\n", num);
+        return true;
     }
 
     virtual cpu* get_cpu(void) { return m_cpu; }
-    cpu * m_cpu;
+    virtual smp* get_smp(void) { return m_smp; }
+    cpu *       m_cpu;
+    smp *       m_smp;
+    std::string m_misa;
+    bool        m_support_s;
 };
 
 #endif
\ No newline at end of file
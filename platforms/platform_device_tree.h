@@ -44,6 +44,9 @@ public:
 
             m_initrd_base = fdt.get_initrd_base();
             m_initrd_size = fdt.get_initrd_size();
+
+            // One hart per 'cpu' node
+            create_harts(fdt.get_num_harts());
         }
 
         return m_this_cpu;
@@ -30,7 +30,8 @@ public:
         uint32_t    memsize,
         console_io *con_io = NULL,
         uint64_t   *p_cycles = NULL,
-        uint32_t    frequency = 100000000
+        uint32_t    frequency = 100000000,
+        int         harts = 1
     ):
         platform_cpu(misa, true, membase, memsize)
     {
@@ -42,6 +43,8 @@ public:
         m_cpu->attach_device(new device_irq_plic(CONFIG_PLIC_BASE, 11));
         m_cpu->attach_device(new device_timer_clint(CONFIG_CLINT_BASE, m_cpu));
         m_cpu->attach_device(new device_uart_8250(CONFIG_UART8250_BASE, NULL, -1, con_io));
+
+        create_harts(harts);
     }
 };
 
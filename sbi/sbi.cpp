@@ -37,6 +37,9 @@
 #define SBI_EXT_GET_MARCHID        5
 #define SBI_EXT_GET_MIMPID         6
 
+// Supervisor software interrupt (IPI)
+#define IRQ_S_SOFT                 1
+
 //-----------------------------------------------------------------
 // setup: Setup SBI handler (and load some binaries)
 //-----------------------------------------------------------------
@@ -93,6 +96,26 @@ uint32_t sbi::sbi_ext(uint32_t fid, uint32_t extid)
     return 0;
 }
 //-----------------------------------------------------------------
+// hart_mask: Read the (legacy) hart mask argument, a NULL pointer
+// selects all harts
+//-----------------------------------------------------------------
+bool sbi::hart_mask(cpu *cpu, uint64_t addr, uint64_t *mask)
+{
+    *mask = ~0ULL;
+    if (addr == 0)
+        return true;
+
+    if (cpu->get_reg_width() == 64)
+        return ((rv64*)cpu)->sbi_load(addr, mask) != 0;
+
+    uint32_t val = 0;
+    if (!((rv32*)cpu)->sbi_load((uint32_t)addr, &val))
+        return false;
+
+    *mask = val;
+    return true;
+}
+//-----------------------------------------------------------------
 // syscall_handler: Try and execute a hosted system call
 //-----------------------------------------------------------------
 bool sbi::syscall_handler(cpu *cpu)
@@ -107,6 +130,8 @@ bool sbi::syscall_handler(cpu *cpu)
 
     #define SET_RET(x) cpu->set_register(reg_ret, (uint32_t)(x))
 
+    smp *group = cpu->get_smp();
+
     // Only take over syscalls in SUPER mode
     if (cpu->get_reg_width() == 64)
     {
@@ -123,19 +148,27 @@ bool sbi::syscall_handler(cpu *cpu)
     {
         case SBI_SHUTDOWN:
             printf("Shutdown...\n");
-            exit(0);
+            cpu->sim_exit(0);
             return true;
         case SBI_CONSOLE_PUTCHAR:
             if (m_conio)
+            {
+                if (group) group->bus_lock();
                 m_conio->putchar(a0);
+                if (group) group->bus_unlock();
+            }
             return true;
         case SBI_CONSOLE_GETCHAR:
             if (m_conio)
             {
+                if (group) group->bus_lock();
+                int ch = m_conio->getchar();
+                if (group) group->bus_unlock();
+
                 if (cpu->get_reg_width() == 64)
-                    ((rv64*)cpu)->set_register(reg_ret, (uint64_t)m_conio->getchar());
+                    ((rv64*)cpu)->set_register(reg_ret, (uint64_t)ch);
                 else
-                    ((rv32*)cpu)->set_register(reg_ret, (uint32_t)m_conio->getchar());
+                    ((rv32*)cpu)->set_register(reg_ret, (uint32_t)ch);
             }
             return true;
         case SBI_SET_TIMER:
@@ -144,9 +177,32 @@ bool sbi::syscall_handler(cpu *cpu)
             else
                 ((rv32*)cpu)->set_timer(a0);
             return true;
+        case SBI_CLEAR_IPI:
+            cpu->clr_interrupt(IRQ_S_SOFT);
+            return true;
+        case SBI_SEND_IPI:
         case SBI_REMOTE_FENCE_I:
         case SBI_REMOTE_SFENCE_VMA:
+        case SBI_REMOTE_SFENCE_VMA_ASID:
+        {
+            uint64_t mask;
+            if (!hart_mask(cpu, a0, &mask))
+                return true;
+
+            int num_harts = group ? group->get_num_harts() : 1;
+            for (int h=0;h<num_harts && h<64;h++)
+            {
+                if (!(mask & (1ULL << h)))
+                    continue;
+
+                ::cpu *target = group ? group->get_hart(h) : cpu;
+                if (which == SBI_SEND_IPI)
+                    target->post_interrupt(IRQ_S_SOFT, true);
+                else
+                    target->post_fence((which == SBI_REMOTE_FENCE_I) ? ::cpu::FENCE_I : ::cpu::FENCE_VMA);
+            }
             return true;
+        }
         case SBI_EXT_BASE:
             SET_RET(sbi_ext(a0, a1));
             return true;
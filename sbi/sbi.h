@@ -26,6 +26,9 @@ public:
 
     static bool setup(cpu *cpu, console_io *conio, uint32_t kernel_addr, uint32_t dtb_addr);
 
+protected:
+    bool hart_mask(cpu *cpu, uint64_t addr, uint64_t *mask);
+
 protected:
     console_io *m_conio;
 };
@@ -68,6 +68,35 @@ void virtio::reset(void)
     assert(sizeof(t_virtio_desc) == 16);
 }
 //--------------------------------------------------------------------
+// serialize: Checkpoint transport registers and queue state (the
+// descriptor rings live in guest memory), then the backend
+//--------------------------------------------------------------------
+void virtio::serialize(checkpoint &cp)
+{
+    cp.section("virtio", 1);
+    cp.io(m_status);
+    cp.io(m_sel_q);
+    cp.io(m_sel_feat);
+    cp.io(m_int_status);
+    cp.io(m_cfg_space);
+
+    for (int i=0;i<VIRTIO_QUEUES;i++)
+    {
+        t_virtio_q *q = &m_queue[i];
+        cp.io(q->ready);
+        cp.io(q->num);
+        cp.io(q->last_avail_idx);
+        cp.io(q->desc_addr);
+        cp.io(q->avail_addr);
+        cp.io(q->used_addr);
+        cp.io(q->notify);
+        cp.io(q->desc);
+    }
+
+    if (m_dev)
+        m_dev->serialize(cp);
+}
+//--------------------------------------------------------------------
 // write8:
 //--------------------------------------------------------------------
 bool virtio::write8(uint32_t address, uint8_t data)
@@ -97,6 +126,9 @@ bool virtio::write32(uint32_t address, uint32_t data)
 {
     address -= m_base;
 
+    // Status change / queue notify, clock the device on the next step
+    sched_wake();
+
     if (address >= VIRTIO_MMIO_CONFIG)
     {
         dprintf(("[VIRTIO] Config write %08x=%08x\n", address, data));
@@ -484,9 +516,9 @@ bool virtio::get_desc_size(int *pread_size, int *pwrite_size, int queue_idx, int
 //--------------------------------------------------------------------
 int virtio::clock(uint64_t cycles) 
 { 
-    // Not ready
+    // Not ready (sleep until the driver writes a register)
     if (!(m_status & (1 << VIRTIO_CONFIG_S_DRIVER)))
-        return 0;
+        return CLOCK_IDLE;
 
     return m_dev->clock(cycles);
 }
@@ -65,7 +65,11 @@ class cpu;
 class virtio_device
 {
 public:
-    virtual int  clock(uint64_t cycles) { return 0; }
+    // Returns next call cycle delta (see memory_base::clock)
+    virtual int  clock(uint64_t cycles) { return memory_base::CLOCK_IDLE; }
+
+    // Checkpoint: save / restore backend state (default: fail)
+    virtual void serialize(checkpoint &cp) { cp.fail("VirtIO device does not support checkpoints"); }
 };
 
 //-----------------------------------------------------------------
@@ -77,6 +81,7 @@ public:
     virtio(cpu *pcpu, uint32_t base_addr, device *irq_ctrl, int irq_num): device("virtio", base_addr, 4096, irq_ctrl, irq_num)
     {
         m_mem = pcpu;
+        m_dev = NULL;
         m_device_id = 0;
         m_vendor_id = 0;
         m_features  = 0;
@@ -95,6 +100,7 @@ public:
 
     void         reset(void);
     int          clock(uint64_t cycles);
+    void         serialize(checkpoint &cp);
     virtual int  min_access_size(void) { return 1; }
 
     virtual bool write32(uint32_t address, uint32_t data);
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string>
 #include <assert.h>
+#include <unistd.h>
 
 #include "cpu.h"
 #include "virtio_block.h"
@@ -43,9 +44,10 @@ typedef struct
 //--------------------------------------------------------------------
 virtio_block::virtio_block(virtio *virtio)
 {
-    m_fp      = NULL;
-    m_virtio  = virtio;
-    m_clk_div = 0;
+    m_fp          = NULL;
+    m_virtio      = virtio;
+    m_num_sectors = 0;
+    m_overlay     = NULL;
 }
 //--------------------------------------------------------------------
 // open:
@@ -61,6 +63,8 @@ bool virtio_block::open(const char *filename)
     fseek(m_fp, 0, SEEK_SET);
 
     uint64_t num_sectors = (file_size + 511) / 512;
+    m_filename    = filename;
+    m_num_sectors = num_sectors;
     m_virtio->m_cfg_space[0] = num_sectors >> 0;
     m_virtio->m_cfg_space[1] = num_sectors >> 32;
 
@@ -69,6 +73,47 @@ bool virtio_block::open(const char *filename)
     return true;
 }
 //--------------------------------------------------------------------
+// open_overlay: Redirect writes to an overlay file (NULL: temporary
+// file). The disk image is re-opened read-only (the file position is
+// not shared with a process this one was forked from). Sectors in a
+// previous overlay are copied to the new one.
+//--------------------------------------------------------------------
+bool virtio_block::open_overlay(const char *filename)
+{
+    if (!m_fp)
+        return false;
+
+    m_fp = freopen(m_filename.c_str(), "rb", m_fp);
+    if (!m_fp)
+        return false;
+
+    FILE *prev = m_overlay;
+    m_overlay  = filename ? fopen(filename, "wb+") : tmpfile();
+    if (!m_overlay)
+        return false;
+
+    if (!prev)
+    {
+        m_dirty.assign(m_num_sectors, 0);
+        return true;
+    }
+
+    // pread: the previous overlay's file position may be shared
+    bool    ok = fflush(prev) == 0;
+    uint8_t buf[SECTOR_SIZE];
+    for (uint64_t s=0;s<m_num_sectors && ok;s++)
+    {
+        if (!m_dirty[s])
+            continue;
+
+        ok = pread(fileno(prev), buf, SECTOR_SIZE, s * SECTOR_SIZE) == SECTOR_SIZE &&
+             fseeko(m_overlay, s * SECTOR_SIZE, SEEK_SET) == 0 &&
+             fwrite(buf, 1, SECTOR_SIZE, m_overlay) == SECTOR_SIZE;
+    }
+    fclose(prev);
+    return ok;
+}
+//--------------------------------------------------------------------
 // read_block:
 //--------------------------------------------------------------------
 bool virtio_block::read_block(uint64_t sector_num, uint8_t *buf, int num_sectors)
@@ -76,6 +121,20 @@ bool virtio_block::read_block(uint64_t sector_num, uint8_t *buf, int num_sectors
     if (!m_fp)
         return false;
 
+    if (m_overlay)
+    {
+        for (int i=0;i<num_sectors;i++)
+        {
+            uint64_t sector = sector_num + i;
+            FILE *f = (sector < m_num_sectors && m_dirty[sector]) ? m_overlay : m_fp;
+
+            fseeko(f, sector * SECTOR_SIZE, SEEK_SET);
+            if (fread(buf + i * SECTOR_SIZE, 1, SECTOR_SIZE, f) != SECTOR_SIZE)
+                return false;
+        }
+        return true;
+    }
+
     fseek(m_fp, sector_num * SECTOR_SIZE, SEEK_SET);
     int res = fread(buf, 1, num_sectors * SECTOR_SIZE, m_fp);
     return res == (num_sectors * SECTOR_SIZE);
@@ -88,6 +147,20 @@ bool virtio_block::write_block(uint64_t sector_num, uint8_t *buf, int num_sector
     if (!m_fp)
         return false;
 
+    if (m_overlay)
+    {
+        if (sector_num + num_sectors > m_num_sectors)
+            return false;
+
+        fseeko(m_overlay, sector_num * SECTOR_SIZE, SEEK_SET);
+        if (fwrite(buf, 1, num_sectors * SECTOR_SIZE, m_overlay) != (size_t)(num_sectors * SECTOR_SIZE))
+            return false;
+
+        for (int i=0;i<num_sectors;i++)
+            m_dirty[sector_num + i] = 1;
+        return true;
+    }
+
     fseek(m_fp, sector_num * SECTOR_SIZE, SEEK_SET);
     int res = fwrite(buf, 1, num_sectors * SECTOR_SIZE, m_fp);
     return res == (num_sectors * SECTOR_SIZE);
@@ -97,6 +170,8 @@ bool virtio_block::write_block(uint64_t sector_num, uint8_t *buf, int num_sector
 //--------------------------------------------------------------------
 bool virtio_block::request(int queue_idx, int desc_idx, int read_size, int write_size)
 {
+    HOST_STATS_TIMER(TIMER_VIRTIO_REQUEST);
+
     t_virtio_block_hdr h;
     bool ok;
 
@@ -158,10 +233,6 @@ bool virtio_block::request(int queue_idx, int desc_idx, int read_size, int write
 //--------------------------------------------------------------------
 int virtio_block::clock(uint64_t cycles) 
 { 
-    if (m_clk_div++ < 100)
-        return 0;
-    m_clk_div = 0;
-
     int queue_idx = 0;
     int read_size, write_size;
 
@@ -175,5 +246,67 @@ int virtio_block::clock(uint64_t cycles)
         m_virtio->m_queue[queue_idx].last_avail_idx++;
     }
 
-    return 0; 
+    // More requests queued, otherwise sleep until notified
+    if (m_virtio->m_queue[queue_idx].last_avail_idx != m_virtio->get_avail_idx(queue_idx))
+        return VIRTIO_BLK_REQ_CYCLES;
+
+    return memory_base::CLOCK_IDLE;
+}
+//--------------------------------------------------------------------
+// serialize: Save / restore the written sectors
+//--------------------------------------------------------------------
+void virtio_block::serialize(checkpoint &cp)
+{
+    cp.section("virtio_block", 1);
+
+    uint64_t num_sectors = m_num_sectors;
+    cp.io(num_sectors);
+    if (num_sectors != m_num_sectors)
+    {
+        cp.fail("Disk image size mismatch (%llu != %llu sectors)",
+                (unsigned long long)num_sectors, (unsigned long long)m_num_sectors);
+        return;
+    }
+
+    if (!m_overlay)
+    {
+        cp.fail("Disk image %s is written in place", m_filename.c_str());
+        return;
+    }
+
+    uint64_t count = 0;
+    if (cp.is_restore())
+        m_dirty.assign(m_num_sectors, 0);
+    else
+    {
+        for (uint64_t i=0;i<m_num_sectors;i++)
+            count += m_dirty[i];
+    }
+    cp.io(count);
+
+    uint8_t  buf[SECTOR_SIZE];
+    uint64_t sector = 0;
+    for (uint64_t i=0;i<count && cp.ok();i++,sector++)
+    {
+        if (!cp.is_restore())
+        {
+            while (!m_dirty[sector])
+                sector++;
+
+            if (!read_block(sector, buf, 1))
+            {
+                cp.fail("Disk read error (sector %llu)", (unsigned long long)sector);
+                return;
+            }
+        }
+
+        cp.io(sector);
+        cp.io(buf, SECTOR_SIZE);
+
+        if (cp.is_restore() && cp.ok() && !write_block(sector, buf, 1))
+        {
+            cp.fail("Disk write error (sector %llu)", (unsigned long long)sector);
+            return;
+        }
+    }
 }
@@ -8,8 +8,13 @@
 #ifndef __VIRTIO_BLOCK_H__
 #define __VIRTIO_BLOCK_H__
 
+#include <string>
+#include <vector>
 #include "virtio.h"
 
+// Interval between processing queued requests (cycles)
+#define VIRTIO_BLK_REQ_CYCLES   100
+
 //-----------------------------------------------------------------
 // virtio_block: Block VirtIO device
 //-----------------------------------------------------------------
@@ -20,16 +25,29 @@ public:
 
     bool open(const char *filename);
 
+    // Copy-on-write: leave the disk image unmodified, written sectors
+    // are stored in (and later read back from) an overlay file
+    // (NULL: anonymous temporary file)
+    bool open_overlay(const char *filename);
+
     virtual bool read_block(uint64_t sector_num, uint8_t *buf, int num_sectors);
     virtual bool write_block(uint64_t sector_num, uint8_t *buf, int num_sectors);
 
     bool request(int queue_idx, int desc_idx, int read_size, int write_size);
     int  clock(uint64_t cycles);
 
+    // Checkpoint: the sectors held in the overlay (the disk image
+    // itself must be unmodified, so writes need an overlay)
+    void serialize(checkpoint &cp);
+
 protected:
     FILE   *m_fp;
     virtio *m_virtio;
-    int     m_clk_div;
+
+    std::string m_filename;
+    uint64_t    m_num_sectors;
+    FILE       *m_overlay;
+    std::vector<uint8_t> m_dirty; // Sectors held in the overlay
 };
 
 #endif
\ No newline at end of file
@@ -42,7 +42,6 @@ virtio_net::virtio_net(virtio *virtio)
 {
     m_net     = NULL;
     m_virtio  = virtio;
-    m_clk_div = 0;
 }
 //--------------------------------------------------------------------
 // open:
@@ -73,14 +72,10 @@ bool virtio_net::has_rx_space(void)
 //--------------------------------------------------------------------
 // clock:
 //--------------------------------------------------------------------
-int virtio_net::clock(cycles) 
+int virtio_net::clock(uint64_t cycles) 
 {
     uint8_t packet[VIRTIO_MAX_MTU];
 
-    if (m_clk_div++ < 100)
-        return 0;
-    m_clk_div = 0;
-
     // Process network receive
     if (has_rx_space())
     {
@@ -135,6 +130,10 @@ int virtio_net::clock(cycles)
 
     }    
 
-    return 0; 
+    // Poll while rx buffers are available / tx pending, else sleep until notified
+    if (has_rx_space() || m_virtio->m_queue[1].notify)
+        return VIRTIO_NET_POLL_CYCLES;
+
+    return memory_base::CLOCK_IDLE;
 }
 #endif
\ No newline at end of file
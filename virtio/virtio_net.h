@@ -10,6 +10,9 @@
 
 #include "virtio.h"
 
+// Network poll interval (cycles)
+#define VIRTIO_NET_POLL_CYCLES  100
+
 class net_tap;
 
 //-----------------------------------------------------------------
@@ -26,10 +29,12 @@ public:
 
     int  clock(uint64_t cycles);
 
+    // Packets in flight on the host side can't be saved
+    void serialize(checkpoint &cp) { cp.fail("VirtIO net (tap) does not support checkpoints"); }
+
 protected:
     net_tap *m_net;
     virtio  *m_virtio;
-    int      m_clk_div;
 
 };
 